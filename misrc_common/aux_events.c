@@ -0,0 +1,231 @@
+/*
+ * MISRC Common - Event Encoded Aux Stream Implementation
+ */
+
+#include "aux_events.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #include <emmintrin.h>
+    #define AUX_EVENTS_HAVE_SSE2 1
+#elif defined(__aarch64__) || defined(__arm64__)
+    #include <arm_neon.h>
+    #define AUX_EVENTS_HAVE_NEON 1
+#endif
+
+struct aux_encoder {
+    FILE *f;
+    uint64_t samples;           /* Samples encoded so far */
+    uint8_t value;              /* Aux bits at the end of the last block */
+    bool started;               /* The initial value is written */
+    bool failed;                /* A write failed */
+};
+
+struct aux_decoder {
+    FILE *f;
+    uint64_t sample;            /* Samples decoded so far */
+    uint8_t value;              /* Current aux bits */
+    aux_event_t next;           /* Next record, valid unless done */
+    bool done;                  /* End record or end of file reached */
+};
+
+/*-----------------------------------------------------------------------------
+ * Change Detection
+ *-----------------------------------------------------------------------------*/
+
+size_t aux_find_change(const uint8_t *aux, size_t len, uint8_t value)
+{
+    size_t i = 0;
+#if defined(AUX_EVENTS_HAVE_SSE2)
+    const __m128i v = _mm_set1_epi8((char)value);
+    /* 64 equal bytes cost one movemask, the exact offset is found below */
+    while (i + 64 <= len) {
+        __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(aux + i)), v);
+        __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(aux + i + 16)), v);
+        __m128i c = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(aux + i + 32)), v);
+        __m128i d = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(aux + i + 48)), v);
+        if (_mm_movemask_epi8(_mm_and_si128(_mm_and_si128(a, b), _mm_and_si128(c, d))) != 0xffff) break;
+        i += 64;
+    }
+    while (i + 16 <= len) {
+        __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(aux + i)), v);
+        if (_mm_movemask_epi8(a) != 0xffff) break;
+        i += 16;
+    }
+#elif defined(AUX_EVENTS_HAVE_NEON)
+    const uint8x16_t v = vdupq_n_u8(value);
+    while (i + 64 <= len) {
+        uint8x16_t a = vceqq_u8(vld1q_u8(aux + i), v);
+        uint8x16_t b = vceqq_u8(vld1q_u8(aux + i + 16), v);
+        uint8x16_t c = vceqq_u8(vld1q_u8(aux + i + 32), v);
+        uint8x16_t d = vceqq_u8(vld1q_u8(aux + i + 48), v);
+        if (vminvq_u8(vandq_u8(vandq_u8(a, b), vandq_u8(c, d))) != 0xff) break;
+        i += 64;
+    }
+    while (i + 16 <= len) {
+        if (vminvq_u8(vceqq_u8(vld1q_u8(aux + i), v)) != 0xff) break;
+        i += 16;
+    }
+#else
+    const uint64_t pattern = 0x0101010101010101ull * value;
+    while (i + 8 <= len) {
+        uint64_t w;
+        memcpy(&w, aux + i, sizeof(w));
+        if (w != pattern) break;
+        i += 8;
+    }
+#endif
+    while (i < len && aux[i] == value) i++;
+    return i;
+}
+
+/*-----------------------------------------------------------------------------
+ * Encoding
+ *-----------------------------------------------------------------------------*/
+
+static void encoder_put(aux_encoder_t *enc, aux_event_type_t type, uint64_t sample, uint8_t value)
+{
+    aux_event_t e;
+    memset(&e, 0, sizeof(e));
+    e.sample = sample;
+    e.value = value;
+    e.type = (uint8_t)type;
+    if (fwrite(&e, sizeof(e), 1, enc->f) != 1) enc->failed = true;
+}
+
+aux_encoder_t *aux_encoder_open(FILE *f, uint32_t sample_rate)
+{
+    aux_events_header_t header;
+    aux_encoder_t *enc = calloc(1, sizeof(*enc));
+    if (!enc) {
+        if (f != stdout) fclose(f);
+        return NULL;
+    }
+    enc->f = f;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, AUX_EVENTS_MAGIC, sizeof(header.magic));
+    header.version = AUX_EVENTS_VERSION;
+    header.header_size = sizeof(header);
+    header.event_size = sizeof(aux_event_t);
+    header.sample_rate = sample_rate;
+    if (fwrite(&header, sizeof(header), 1, f) != 1) {
+        fprintf(stderr, "Failed to write aux event header\n");
+        if (f != stdout) fclose(f);
+        free(enc);
+        return NULL;
+    }
+    return enc;
+}
+
+int aux_encoder_write(aux_encoder_t *enc, const uint8_t *aux, size_t len)
+{
+    size_t i = 0;
+    if (len == 0) return enc->failed ? -1 : 0;
+    if (!enc->started) {
+        enc->value = aux[0];
+        enc->started = true;
+        encoder_put(enc, AUX_EVENT_CHANGE, 0, enc->value);
+    }
+    for (;;) {
+        i += aux_find_change(aux + i, len - i, enc->value);
+        if (i == len) break;
+        enc->value = aux[i];
+        encoder_put(enc, AUX_EVENT_CHANGE, enc->samples + i, enc->value);
+    }
+    enc->samples += len;
+    return enc->failed ? -1 : 0;
+}
+
+int aux_encoder_close(aux_encoder_t *enc)
+{
+    int r;
+    if (!enc) return 0;
+    encoder_put(enc, AUX_EVENT_END, enc->samples, enc->value);
+    if (enc->f == stdout) {
+        if (fflush(stdout) != 0) enc->failed = true;
+    }
+    else if (fclose(enc->f) != 0) {
+        enc->failed = true;
+    }
+    r = enc->failed ? -1 : 0;
+    free(enc);
+    return r;
+}
+
+/*-----------------------------------------------------------------------------
+ * Decoding
+ *-----------------------------------------------------------------------------*/
+
+/* Read the next record, a stream without end record just ends */
+static void decoder_next(aux_decoder_t *dec)
+{
+    if (fread(&dec->next, sizeof(dec->next), 1, dec->f) != 1) {
+        fprintf(stderr, "Aux event stream has no end record, ends at sample %llu\n",
+                (unsigned long long)dec->sample);
+        dec->done = true;
+    }
+    else if (dec->next.sample < dec->sample) {
+        fprintf(stderr, "Aux event stream goes back to sample %llu at sample %llu, stopping\n",
+                (unsigned long long)dec->next.sample, (unsigned long long)dec->sample);
+        dec->done = true;
+    }
+}
+
+aux_decoder_t *aux_decoder_open(FILE *f, aux_events_header_t *header)
+{
+    aux_events_header_t h;
+    aux_decoder_t *dec;
+    if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, AUX_EVENTS_MAGIC, sizeof(h.magic)) != 0
+        || h.version != AUX_EVENTS_VERSION || h.event_size != sizeof(aux_event_t)
+        || h.header_size < sizeof(h)) {
+        fprintf(stderr, "Not an aux event stream\n");
+        if (f != stdin) fclose(f);
+        return NULL;
+    }
+    /* Later header fields are skipped, the input may be a pipe */
+    for (uint32_t i = sizeof(h); i < h.header_size; i++) {
+        if (fgetc(f) == EOF) {
+            if (f != stdin) fclose(f);
+            return NULL;
+        }
+    }
+    dec = calloc(1, sizeof(*dec));
+    if (!dec) {
+        if (f != stdin) fclose(f);
+        return NULL;
+    }
+    dec->f = f;
+    decoder_next(dec);
+    if (header) *header = h;
+    return dec;
+}
+
+size_t aux_decoder_read(aux_decoder_t *dec, uint8_t *aux, size_t len)
+{
+    size_t n = 0;
+    while (n < len && !dec->done) {
+        uint64_t run = dec->next.sample - dec->sample;
+        if (run > len - n) run = len - n;
+        if (aux) memset(aux + n, dec->value, (size_t)run);
+        n += (size_t)run;
+        dec->sample += run;
+        if (dec->sample < dec->next.sample) break;
+        if (dec->next.type == AUX_EVENT_END) {
+            dec->done = true;
+            break;
+        }
+        dec->value = dec->next.value;
+        decoder_next(dec);
+    }
+    return n;
+}
+
+void aux_decoder_close(aux_decoder_t *dec)
+{
+    if (!dec) return;
+    if (dec->f != stdin) fclose(dec->f);
+    free(dec);
+}
@@ -0,0 +1,119 @@
+/*
+ * MISRC Common - Event Encoded Aux Stream
+ *
+ * The aux bits mostly carry slow control and sync signals, so the raw aux
+ * output (one byte per sample, 40 MB/s) is nearly always the same value.
+ * The event format only stores where the value changes: an
+ * aux_events_header_t, one AUX_EVENT_CHANGE record per change (the first
+ * one at sample 0 with the initial value), and an AUX_EVENT_END record with
+ * the number of samples. A capture that was cut off has no end record,
+ * decoding then stops at the last change.
+ *
+ * Every change costs 16 bytes, an aux line toggling every few samples is
+ * smaller in the raw format.
+ *
+ * Header and records are little endian.
+ */
+
+#ifndef MISRC_AUX_EVENTS_H
+#define MISRC_AUX_EVENTS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define AUX_EVENTS_MAGIC        "MISRCAUX"
+#define AUX_EVENTS_VERSION      1
+
+typedef enum {
+    AUX_EVENT_CHANGE = 0,       /* The aux bits are value from sample on */
+    AUX_EVENT_END,              /* The stream has sample samples */
+} aux_event_type_t;
+
+typedef struct {
+    char magic[8];              /* AUX_EVENTS_MAGIC, not terminated */
+    uint32_t version;           /* AUX_EVENTS_VERSION */
+    uint32_t header_size;       /* sizeof(aux_events_header_t), records start here */
+    uint32_t event_size;        /* sizeof(aux_event_t) */
+    uint32_t sample_rate;       /* Samples per second */
+} aux_events_header_t;
+
+typedef struct {
+    uint64_t sample;            /* Sample offset from the start of the stream */
+    uint8_t value;              /* Aux bits from this sample on */
+    uint8_t type;               /* aux_event_type_t */
+    uint8_t reserved[6];
+} aux_event_t;
+
+typedef struct aux_encoder aux_encoder_t;
+typedef struct aux_decoder aux_decoder_t;
+
+/* Find the first sample whose aux bits differ from value
+ *
+ * @param aux           Aux byte of every sample
+ * @param len           Number of samples
+ * @param value         Current aux bits
+ * @return Offset of the first differing sample, len if there is none
+ *
+ * SSE2 on x86_64, NEON on arm64, 8 bytes at a time elsewhere. Meant to run
+ * on a block right after extraction, while it is still in the cache.
+ */
+size_t aux_find_change(const uint8_t *aux, size_t len, uint8_t value);
+
+/*-----------------------------------------------------------------------------
+ * Encoding
+ *-----------------------------------------------------------------------------*/
+
+/* Start an event stream in an already opened file
+ *
+ * @param f             Output file, owned by the encoder afterwards
+ * @param sample_rate   Samples per second
+ * @return Encoder state, or NULL on failure (f is closed unless it is stdout)
+ */
+aux_encoder_t *aux_encoder_open(FILE *f, uint32_t sample_rate);
+
+/* Append a block of extracted aux bytes
+ *
+ * @param enc           Encoder state
+ * @param aux           Aux byte of every sample
+ * @param len           Number of samples
+ * @return 0 on success, -1 if writing failed
+ */
+int aux_encoder_write(aux_encoder_t *enc, const uint8_t *aux, size_t len);
+
+/* Write the end record and close the file (unless it is stdout)
+ *
+ * @param enc           Encoder state, freed (NULL is ignored)
+ * @return 0 on success, -1 if any write failed
+ */
+int aux_encoder_close(aux_encoder_t *enc);
+
+/*-----------------------------------------------------------------------------
+ * Decoding
+ *-----------------------------------------------------------------------------*/
+
+/* Start decoding an event stream
+ *
+ * @param f             Input file, owned by the decoder afterwards
+ * @param header        Receives the header, may be NULL
+ * @return Decoder state, or NULL if f is not an event stream (f is closed
+ *         unless it is stdin)
+ */
+aux_decoder_t *aux_decoder_open(FILE *f, aux_events_header_t *header);
+
+/* Expand the next samples back to one aux byte per sample
+ *
+ * @param dec           Decoder state
+ * @param aux           Receives the aux bytes, NULL to skip the samples
+ * @param len           Number of samples wanted
+ * @return Number of samples, less than len only at the end of the stream
+ */
+size_t aux_decoder_read(aux_decoder_t *dec, uint8_t *aux, size_t len);
+
+/* Close the file (unless it is stdin) and free the decoder
+ *
+ * @param dec           Decoder state, NULL is ignored
+ */
+void aux_decoder_close(aux_decoder_t *dec);
+
+#endif /* MISRC_AUX_EVENTS_H */
@@ -0,0 +1,222 @@
+/*
+ * MISRC Common - Scratch Buffer Pool Implementation
+ */
+
+#include "buffer_pool.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#include "ringbuffer.h"
+
+typedef struct {
+    unsigned count;             /* Blocks reserved */
+    size_t offset;              /* Of the first block in the arena */
+    atomic_uint *refs;          /* References per block, 0 = free */
+} pool_class_t;
+
+struct buffer_pool {
+    size_t huge_request;        /* Huge page size asked for */
+    size_t huge_size;           /* Huge page size the arena got */
+    uint8_t *arena;
+    size_t arena_size;
+    pool_class_t cls[BUFFER_POOL_CLASSES];
+};
+
+/*-----------------------------------------------------------------------------
+ * Helpers
+ *-----------------------------------------------------------------------------*/
+
+static size_t class_block(int c)
+{
+    return (size_t)BUFFER_POOL_MIN_BLOCK << c;
+}
+
+/* Smallest class holding size bytes, -1 if none does */
+static int class_of(size_t size)
+{
+    for (int c = 0; c < BUFFER_POOL_CLASSES; c++) {
+        if (size <= class_block(c)) return c;
+    }
+    return -1;
+}
+
+/* Class and index of a block, -1 if it is not one of the pool */
+static int block_of(const buffer_pool_t *pool, const void *block, unsigned *index)
+{
+    if (!pool->arena || (const uint8_t *)block < pool->arena) return -1;
+    size_t off = (size_t)((const uint8_t *)block - pool->arena);
+    for (int c = 0; c < BUFFER_POOL_CLASSES; c++) {
+        const pool_class_t *k = &pool->cls[c];
+        if (k->count && off >= k->offset && off < k->offset + k->count * class_block(c)) {
+            *index = (unsigned)((off - k->offset) / class_block(c));
+            return c;
+        }
+    }
+    return -1;
+}
+
+static uint8_t *map_arena(size_t size, size_t huge_size)
+{
+    void *p;
+#ifdef _WIN32
+    (void)huge_size;
+    int node = rb_get_numa_node();
+    if (node >= 0) {
+        p = VirtualAllocExNuma(GetCurrentProcess(), NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, (DWORD)node);
+    } else {
+        p = VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    }
+    return p;
+#else
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+    if (huge_size != 0) {
+        flags |= MAP_HUGETLB | ((huge_size == RB_HUGE_1G ? 30 : 21) << MAP_HUGE_SHIFT);
+    }
+#else
+    if (huge_size != 0) return NULL;
+#endif
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (p == MAP_FAILED) return NULL;
+#ifdef MADV_HUGEPAGE
+    /* Without hugetlb pages at least ask for transparent huge pages */
+    if (huge_size == 0) madvise(p, size, MADV_HUGEPAGE);
+#endif
+    return p;
+#endif
+}
+
+static void unmap_arena(uint8_t *arena, size_t size)
+{
+#ifdef _WIN32
+    (void)size;
+    VirtualFree(arena, 0, MEM_RELEASE);
+#else
+    munmap(arena, size);
+#endif
+}
+
+/*-----------------------------------------------------------------------------
+ * Public API
+ *-----------------------------------------------------------------------------*/
+
+buffer_pool_t *buffer_pool_create(size_t huge_size)
+{
+    buffer_pool_t *pool = calloc(1, sizeof(*pool));
+    if (!pool) return NULL;
+    pool->huge_request = huge_size;
+    return pool;
+}
+
+int buffer_pool_reserve(buffer_pool_t *pool, size_t size, unsigned count)
+{
+    int c = class_of(size);
+    if (pool->arena || c < 0) return -1;
+    pool->cls[c].count += count;
+    return 0;
+}
+
+int buffer_pool_commit(buffer_pool_t *pool)
+{
+    size_t total = 0;
+    unsigned blocks = 0;
+
+    if (pool->arena) return 0;
+    /* Largest blocks first, every block stays aligned to its own size up to the page size */
+    for (int c = BUFFER_POOL_CLASSES - 1; c >= 0; c--) {
+        pool->cls[c].offset = total;
+        total += pool->cls[c].count * class_block(c);
+        blocks += pool->cls[c].count;
+    }
+    if (total == 0) return 0;
+
+    atomic_uint *refs = calloc(blocks, sizeof(atomic_uint));
+    if (!refs) return -1;
+    for (unsigned i = 0; i < blocks; i++) atomic_init(&refs[i], 0);
+    for (int c = BUFFER_POOL_CLASSES - 1; c >= 0; c--) {
+        pool->cls[c].refs = refs;
+        refs += pool->cls[c].count;
+    }
+
+    if (pool->huge_request != 0) {
+        size_t huge_total = (total + pool->huge_request - 1) / pool->huge_request * pool->huge_request;
+        pool->arena = map_arena(huge_total, pool->huge_request);
+        if (pool->arena) {
+            pool->arena_size = huge_total;
+            pool->huge_size = pool->huge_request;
+        }
+    }
+    if (!pool->arena) {
+        pool->arena = map_arena(total, 0);
+        if (!pool->arena) {
+            free(pool->cls[BUFFER_POOL_CLASSES - 1].refs);
+            return -1;
+        }
+        pool->arena_size = total;
+    }
+    /* Prefer the node before the first touch, then touch every page now instead of in the pipeline */
+    rb_bind_numa(pool->arena, pool->arena_size);
+    memset(pool->arena, 0, pool->arena_size);
+    return 0;
+}
+
+void *buffer_pool_get(buffer_pool_t *pool, size_t size)
+{
+    int c = class_of(size);
+    if (!pool || !pool->arena || c < 0) return NULL;
+    /* A larger block rather than none */
+    for (; c < BUFFER_POOL_CLASSES; c++) {
+        pool_class_t *k = &pool->cls[c];
+        for (unsigned i = 0; i < k->count; i++) {
+            unsigned expected = 0;
+            if (atomic_compare_exchange_strong(&k->refs[i], &expected, 1)) {
+                return pool->arena + k->offset + i * class_block(c);
+            }
+        }
+    }
+    return NULL;
+}
+
+void buffer_pool_ref(buffer_pool_t *pool, void *block)
+{
+    unsigned i;
+    int c = block_of(pool, block, &i);
+    if (c >= 0) atomic_fetch_add(&pool->cls[c].refs[i], 1);
+}
+
+void buffer_pool_put(buffer_pool_t *pool, void *block)
+{
+    unsigned i;
+    if (!pool || !block) return;
+    int c = block_of(pool, block, &i);
+    if (c >= 0) atomic_fetch_sub(&pool->cls[c].refs[i], 1);
+}
+
+size_t buffer_pool_size(const buffer_pool_t *pool)
+{
+    return pool->arena_size;
+}
+
+size_t buffer_pool_huge_size(const buffer_pool_t *pool)
+{
+    return pool->huge_size;
+}
+
+void buffer_pool_free(buffer_pool_t *pool)
+{
+    if (!pool) return;
+    if (pool->arena) {
+        unmap_arena(pool->arena, pool->arena_size);
+        free(pool->cls[BUFFER_POOL_CLASSES - 1].refs);
+    }
+    free(pool);
+}
@@ -0,0 +1,91 @@
+/*
+ * MISRC Common - Scratch Buffer Pool
+ *
+ * One arena for the scratch buffers of the pipeline stages (conversion,
+ * packing and extraction buffers), instead of an aligned_alloc() per stage.
+ * The stages reserve the blocks they will need before the capture starts,
+ * buffer_pool_commit() then maps all of them at once, optionally backed by
+ * huge pages and on the NUMA node of rb_set_numa_node(), and touches every
+ * page so nothing faults later on. Starting and stopping a capture or a
+ * recording only takes blocks from the pool and hands them back.
+ *
+ * Blocks come in power of two size classes from BUFFER_POOL_MIN_BLOCK up and
+ * are page aligned, so also cache line and SIMD aligned. A block is taken
+ * with one reference, stages that pass it on take another with
+ * buffer_pool_ref(), and the last buffer_pool_put() returns it to its class,
+ * where the next stage asking for that size gets it again.
+ *
+ * Taking and returning blocks is thread-safe, they are meant for start and
+ * stop paths, not for every block of samples.
+ */
+
+#ifndef MISRC_BUFFER_POOL_H
+#define MISRC_BUFFER_POOL_H
+
+#include <stddef.h>
+
+#define BUFFER_POOL_MIN_BLOCK   4096    /* Smallest size class, one page */
+#define BUFFER_POOL_CLASSES     19      /* 4 KiB to 1 GiB */
+
+typedef struct buffer_pool buffer_pool_t;
+
+/* Create an empty pool
+ *
+ * @param huge_size     Huge page size for the arena (RB_HUGE_2M or RB_HUGE_1G),
+ *                      0 for normal pages, falls back to normal pages silently
+ * @return The pool, NULL if out of memory
+ */
+buffer_pool_t *buffer_pool_create(size_t huge_size);
+
+/* Reserve blocks, before buffer_pool_commit()
+ *
+ * @param pool          Pool
+ * @param size          Bytes every block holds at least
+ * @param count         Blocks of that size
+ * @return 0 on success, -1 if the pool is committed already or size is too large
+ */
+int buffer_pool_reserve(buffer_pool_t *pool, size_t size, unsigned count);
+
+/* Map and touch the memory of all reservations
+ *
+ * @param pool          Pool
+ * @return 0 on success, -1 if the memory could not be mapped
+ */
+int buffer_pool_commit(buffer_pool_t *pool);
+
+/* Take a free block of the smallest class that holds size bytes, or of a
+ * larger class when that one has none left
+ *
+ * @param pool          Pool (NULL is allowed)
+ * @param size          Bytes needed
+ * @return The block with one reference, NULL if no block that large is free
+ */
+void *buffer_pool_get(buffer_pool_t *pool, size_t size);
+
+/* Take another reference to a block, for a stage it is handed on to
+ *
+ * @param pool          Pool
+ * @param block         Block from buffer_pool_get()
+ */
+void buffer_pool_ref(buffer_pool_t *pool, void *block);
+
+/* Drop a reference, the last one returns the block to the pool
+ *
+ * @param pool          Pool
+ * @param block         Block from buffer_pool_get() (NULL is ignored)
+ */
+void buffer_pool_put(buffer_pool_t *pool, void *block);
+
+/* Bytes mapped for the arena, 0 before buffer_pool_commit() */
+size_t buffer_pool_size(const buffer_pool_t *pool);
+
+/* Huge page size the arena got, 0 for normal pages */
+size_t buffer_pool_huge_size(const buffer_pool_t *pool);
+
+/* Unmap the arena, all blocks must have been returned
+ *
+ * @param pool          Pool (NULL is ignored)
+ */
+void buffer_pool_free(buffer_pool_t *pool);
+
+#endif /* MISRC_BUFFER_POOL_H */
@@ -0,0 +1,110 @@
+/*
+ * MISRC Common - Ringbuffer Sizing Implementation
+ */
+
+#include "buffer_sizing.h"
+
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <sys/types.h>
+#include <sys/sysctl.h>
+#else
+#include <unistd.h>
+#endif
+
+/*-----------------------------------------------------------------------------
+ * System Memory
+ *-----------------------------------------------------------------------------*/
+
+uint64_t buffer_sizing_system_memory(void)
+{
+#ifdef _WIN32
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+    if (!GlobalMemoryStatusEx(&status)) return 0;
+    return (uint64_t)status.ullTotalPhys;
+#elif defined(__APPLE__)
+    uint64_t mem = 0;
+    size_t len = sizeof(mem);
+    if (sysctlbyname("hw.memsize", &mem, &len, NULL, 0) != 0) return 0;
+    return mem;
+#else
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (pages <= 0 || page_size <= 0) return 0;
+    return (uint64_t)pages * (uint64_t)page_size;
+#endif
+}
+
+/*-----------------------------------------------------------------------------
+ * Sizing
+ *-----------------------------------------------------------------------------*/
+
+/* Round up to the granularity, to the nearest multiple of a huge page so
+ * 1G pages do not add up to a gigabyte to a ringbuffer */
+static size_t round_size(double bytes, size_t granularity)
+{
+    double bias = granularity > BUFFER_SIZING_GRANULARITY ? 0.5 : 1.0 - 1.0 / (double)granularity;
+    uint64_t n = (uint64_t)(bytes / (double)granularity + bias);
+    if (n == 0) n = 1;
+    return (size_t)(n * granularity);
+}
+
+uint64_t buffer_sizing_compute(const buffer_sizing_t *cfg, buffer_stream_t *streams, int n, uint64_t limit)
+{
+    size_t granularity = cfg->granularity ? cfg->granularity : BUFFER_SIZING_GRANULARITY;
+    double want[BUFFER_SIZING_MAX_STREAMS];
+    double rates = 0.0, sum = 0.0, sum_min = 0.0;
+    uint64_t total = 0;
+
+    if (n > BUFFER_SIZING_MAX_STREAMS) return 0;
+    if (limit == 0) {
+        uint64_t ram = buffer_sizing_system_memory();
+        limit = ram ? (uint64_t)((double)ram * BUFFER_SIZING_RAM_SHARE) : UINT64_MAX;
+    }
+    if (!cfg->low_memory && cfg->budget > 0 && cfg->budget < limit) limit = cfg->budget;
+
+    for (int i = 0; i < n; i++) rates += streams[i].rate;
+    for (int i = 0; i < n; i++) {
+        const buffer_stream_t *s = &streams[i];
+        if (cfg->low_memory) want[i] = (double)s->min_size;
+        else if (cfg->seconds > 0.0) want[i] = s->rate * cfg->seconds;
+        else if (cfg->budget > 0 && rates > 0.0) want[i] = (double)cfg->budget * s->rate / rates;
+        else want[i] = (double)s->default_size;
+        if (want[i] < (double)s->min_size) want[i] = (double)s->min_size;
+        sum += want[i];
+        sum_min += (double)s->min_size;
+    }
+    if (sum_min > (double)limit) return 0;
+
+    /* Over the limit every ringbuffer gives up the same share of what it has above its minimum */
+    if (sum > (double)limit) {
+        double f = ((double)limit - sum_min) / (sum - sum_min);
+        for (int i = 0; i < n; i++) {
+            want[i] = (double)streams[i].min_size + (want[i] - (double)streams[i].min_size) * f;
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        streams[i].size = round_size(want[i], want[i] >= (double)granularity ? granularity : BUFFER_SIZING_GRANULARITY);
+        total += streams[i].size;
+    }
+    return total;
+}
+
+void buffer_sizing_report(const char *tag, const buffer_stream_t *streams, int n)
+{
+    uint64_t total = 0;
+    uint64_t ram = buffer_sizing_system_memory();
+
+    fprintf(stderr, "%sRingbuffers:", tag ? tag : "");
+    for (int i = 0; i < n; i++) {
+        fprintf(stderr, "%s %s %zu MiB", i ? "," : "", streams[i].name, streams[i].size >> 20);
+        if (streams[i].rate > 0.0) fprintf(stderr, " (%.1f s)", (double)streams[i].size / streams[i].rate);
+        total += streams[i].size;
+    }
+    if (ram) fprintf(stderr, ", %llu of %llu MiB RAM\n", (unsigned long long)(total >> 20), (unsigned long long)(ram >> 20));
+    else fprintf(stderr, ", %llu MiB\n", (unsigned long long)(total >> 20));
+}
@@ -0,0 +1,80 @@
+/*
+ * MISRC Common - Ringbuffer Sizing
+ *
+ * Works out the size of the ringbuffers of a capture at runtime instead of
+ * the fixed 64 MB each, which is about 0.4 s of the capture stream. A
+ * target buffering time gives every ringbuffer that many seconds of its
+ * data rate, so a workstation can ride out a disk stall of several seconds;
+ * a memory budget is shared out in proportion to the rates; the low memory
+ * profile takes the smallest working sizes for small ARM boards.
+ *
+ * All ringbuffers together never take more than BUFFER_SIZING_RAM_SHARE of
+ * the physical memory, larger requests are scaled down. No ringbuffer gets
+ * less than its minimum, a few of the largest reads or writes on it.
+ */
+
+#ifndef MISRC_BUFFER_SIZING_H
+#define MISRC_BUFFER_SIZING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Sizes are multiples of this, the allocation granularity of Windows and
+ * the largest common page size, unless huge pages ask for more */
+#define BUFFER_SIZING_GRANULARITY   ((size_t)64 << 10)
+
+/* Largest share of the physical memory all ringbuffers take together */
+#define BUFFER_SIZING_RAM_SHARE     0.5
+
+/* Most ringbuffers sized together */
+#define BUFFER_SIZING_MAX_STREAMS   8
+
+/* Longest target buffering time accepted */
+#define BUFFER_SIZING_MAX_SECONDS   600.0
+
+typedef struct {
+    const char *name;           /* For the report */
+    double rate;                /* Bytes per second through the ringbuffer */
+    size_t min_size;            /* Smallest working size */
+    size_t default_size;        /* Size without a target time or budget */
+    size_t size;                /* Result of buffer_sizing_compute() */
+} buffer_stream_t;
+
+typedef struct {
+    double seconds;             /* Target buffering time, 0 = not set */
+    uint64_t budget;            /* All ringbuffers together, 0 = not set */
+    bool low_memory;            /* Minimum sizes, the other two are ignored */
+    size_t granularity;         /* Huge page size if the ringbuffers use them, 0 = BUFFER_SIZING_GRANULARITY,
+                                   ringbuffers smaller than one huge page use BUFFER_SIZING_GRANULARITY */
+} buffer_sizing_t;
+
+/* Physical memory of the machine
+ *
+ * @return Bytes, 0 if unknown
+ */
+uint64_t buffer_sizing_system_memory(void);
+
+/* Size the ringbuffers of a capture
+ *
+ * Without a target time or budget every ringbuffer gets its default size,
+ * with a target time rate * seconds, with a budget only its share of it.
+ * When both are given the budget caps the time.
+ *
+ * @param cfg           Target time, budget and profile
+ * @param streams       Ringbuffers, size is filled in
+ * @param n             Number of ringbuffers, at most BUFFER_SIZING_MAX_STREAMS
+ * @param limit         Memory all ringbuffers may take, 0 = BUFFER_SIZING_RAM_SHARE of the RAM
+ * @return Total bytes, 0 if not even the minimum sizes fit into the limit
+ */
+uint64_t buffer_sizing_compute(const buffer_sizing_t *cfg, buffer_stream_t *streams, int n, uint64_t limit);
+
+/* Print the sizes and the time each ringbuffer covers at its rate
+ *
+ * @param tag           Put in front of the line, may be NULL
+ * @param streams       Sized ringbuffers
+ * @param n             Number of ringbuffers
+ */
+void buffer_sizing_report(const char *tag, const buffer_stream_t *streams, int n);
+
+#endif /* MISRC_BUFFER_SIZING_H */
@@ -0,0 +1,187 @@
+/*
+ * MISRC Common - ADC Code Histogram Implementation
+ */
+
+#include "code_histogram.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Words per fold, no lane counter passes UINT16_MAX */
+#define CODE_HIST_FOLD_WORDS    (CODE_HIST_LANES * UINT16_MAX)
+
+#define CODE_A(w)               ((w) & 0xfff)
+#define CODE_B(w)               (((w) >> 20) & 0xfff)
+/* Extracted 12-bit sample value back to its raw code */
+#define CODE_S(v)               ((2047 - (v)) & 0xfff)
+
+/*-----------------------------------------------------------------------------
+ * Counting
+ *-----------------------------------------------------------------------------*/
+
+/* Sum the lanes into the bins, the raw code c is the sample value 2047 - c */
+static void code_hist_fold(code_hist_t *h)
+{
+    if (h->pending == 0) return;
+    for (int ch = 0; ch < 2; ch++) {
+        uint16_t (*lane)[CODE_HIST_BINS] = h->lanes[ch];
+        uint64_t *bins = h->bins[ch];
+        for (int c = 0; c < CODE_HIST_BINS; c++) {
+            bins[CODE_HIST_BINS - 1 - c] += (uint32_t)lane[0][c] + lane[1][c] + lane[2][c] + lane[3][c];
+        }
+    }
+    memset(h->lanes, 0, sizeof(h->lanes));
+    h->samples += h->pending;
+    h->pending = 0;
+}
+
+/* Word k since the last fold goes to lane k % CODE_HIST_LANES, so the lanes fill evenly */
+static void code_hist_count(code_hist_t *h, const uint32_t *in, size_t len)
+{
+    uint16_t (*a)[CODE_HIST_BINS] = h->lanes[0];
+    uint16_t (*b)[CODE_HIST_BINS] = h->lanes[1];
+    size_t i = 0;
+    for (; i < len && ((h->pending + i) & (CODE_HIST_LANES - 1)) != 0; i++) {
+        size_t l = (h->pending + i) & (CODE_HIST_LANES - 1);
+        a[l][CODE_A(in[i])]++;
+        b[l][CODE_B(in[i])]++;
+    }
+    for (; i + 4 <= len; i += 4) {
+        uint32_t w0 = in[i], w1 = in[i + 1], w2 = in[i + 2], w3 = in[i + 3];
+        a[0][CODE_A(w0)]++;
+        a[1][CODE_A(w1)]++;
+        a[2][CODE_A(w2)]++;
+        a[3][CODE_A(w3)]++;
+        b[0][CODE_B(w0)]++;
+        b[1][CODE_B(w1)]++;
+        b[2][CODE_B(w2)]++;
+        b[3][CODE_B(w3)]++;
+    }
+    for (size_t l = 0; i < len; i++, l++) {
+        a[l][CODE_A(in[i])]++;
+        b[l][CODE_B(in[i])]++;
+    }
+    h->pending += len;
+}
+
+/* Same for extracted samples, one array per channel */
+static void code_hist_count_samples(code_hist_t *h, const int16_t *in_a, const int16_t *in_b, size_t len)
+{
+    uint16_t (*a)[CODE_HIST_BINS] = h->lanes[0];
+    uint16_t (*b)[CODE_HIST_BINS] = h->lanes[1];
+    for (size_t i = 0; i < len; i++) {
+        size_t l = (h->pending + i) & (CODE_HIST_LANES - 1);
+        a[l][CODE_S(in_a[i])]++;
+        b[l][CODE_S(in_b[i])]++;
+    }
+    h->pending += len;
+}
+
+/* Whether the stride counts the next block */
+static bool code_hist_take(code_hist_t *h)
+{
+    if (h->skipped + 1 < h->stride) {
+        h->skipped++;
+        return false;
+    }
+    h->skipped = 0;
+    return true;
+}
+
+/*-----------------------------------------------------------------------------
+ * Public API
+ *-----------------------------------------------------------------------------*/
+
+code_hist_t *code_hist_new(uint32_t stride)
+{
+    code_hist_t *h = calloc(1, sizeof(*h));
+    if (!h) return NULL;
+    h->stride = stride ? stride : 1;
+    return h;
+}
+
+void code_hist_free(code_hist_t *h)
+{
+    free(h);
+}
+
+void code_hist_reset(code_hist_t *h)
+{
+    uint32_t stride = h->stride;
+    memset(h, 0, sizeof(*h));
+    h->stride = stride;
+}
+
+bool code_hist_add(code_hist_t *h, const uint32_t *in, size_t len)
+{
+    if (!code_hist_take(h)) return false;
+    while (len > 0) {
+        if (h->pending >= CODE_HIST_FOLD_WORDS) code_hist_fold(h);
+        size_t n = CODE_HIST_FOLD_WORDS - h->pending;
+        if (n > len) n = len;
+        code_hist_count(h, in, n);
+        in += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool code_hist_add_samples(code_hist_t *h, const int16_t *a, const int16_t *b, size_t len)
+{
+    if (!code_hist_take(h)) return false;
+    while (len > 0) {
+        if (h->pending >= CODE_HIST_FOLD_WORDS) code_hist_fold(h);
+        size_t n = CODE_HIST_FOLD_WORDS - h->pending;
+        if (n > len) n = len;
+        code_hist_count_samples(h, a, b, n);
+        a += n;
+        b += n;
+        len -= n;
+    }
+    return true;
+}
+
+void code_hist_metrics(code_hist_t *h, int ch, const extract_stats_t *stats, code_hist_metrics_t *m)
+{
+    const uint64_t *bins;
+    double n, sum = 0.0, sum_sq = 0.0, entropy = 0.0;
+    int lo = -1, hi = -1;
+
+    memset(m, 0, sizeof(*m));
+    code_hist_fold(h);
+    if (h->samples == 0) return;
+    bins = h->bins[ch];
+    n = (double)h->samples;
+
+    for (int i = 0; i < CODE_HIST_BINS; i++) {
+        if (bins[i] == 0) continue;
+        double p = (double)bins[i] / n;
+        double v = (double)(i - CODE_HIST_BINS / 2);
+        if (lo < 0) lo = i;
+        hi = i;
+        m->codes_used++;
+        sum += v * (double)bins[i];
+        sum_sq += v * v * (double)bins[i];
+        entropy -= p * log2(p);
+    }
+    m->samples = h->samples;
+    m->min = (int16_t)(lo - CODE_HIST_BINS / 2);
+    m->max = (int16_t)(hi - CODE_HIST_BINS / 2);
+    m->codes_missing = (uint32_t)(hi - lo + 1) - m->codes_used;
+    m->effective_bits = entropy;
+
+    if (stats && stats->count > 0) {
+        double count = (double)stats->count;
+        m->dc = (double)stats->sum[ch] / count;
+        m->rms = (double)stats->sum_sq[ch] / count - m->dc * m->dc;
+        m->peak = fmax((double)stats->max[ch] - m->dc, m->dc - (double)stats->min[ch]);
+    }
+    else {
+        m->dc = sum / n;
+        m->rms = sum_sq / n - m->dc * m->dc;
+        m->peak = fmax((double)m->max - m->dc, m->dc - (double)m->min);
+    }
+    m->rms = m->rms > 0.0 ? sqrt(m->rms) : 0.0;
+    m->crest = m->rms > 0.0 ? m->peak / m->rms : 0.0;
+}
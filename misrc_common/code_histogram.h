@@ -0,0 +1,107 @@
+/*
+ * MISRC Common - ADC Code Histogram
+ *
+ * Counts how often every 12-bit code of both ADCs occurs, straight from the
+ * raw capture words the extraction kernels read. From the histogram follow
+ * the signal quality figures a level meter cannot show: how many codes the
+ * signal actually exercises (effective bits) and which codes inside its
+ * range never occur (missing codes, a sign of a broken ADC bit or a bad
+ * clock). DC offset, RMS and crest factor are taken from the statistics the
+ * stats kernels gather in the same pass when they are passed in, they cover
+ * every sample while the histogram may only see every stride-th block.
+ *
+ * Counting uses four sub-histograms of 16-bit counters per channel, so
+ * consecutive samples of the same code do not wait on each other's
+ * increment, and folds them into the 64-bit bins before they can overflow.
+ */
+
+#ifndef MISRC_CODE_HISTOGRAM_H
+#define MISRC_CODE_HISTOGRAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "extract.h"
+
+#define CODE_HIST_BINS          4096    /* One bin per 12-bit code */
+#define CODE_HIST_LANES         4       /* Sub-histograms per channel */
+
+typedef struct {
+    uint64_t bins[2][CODE_HIST_BINS];   /* Count per sample value, index value + 2048 */
+    uint64_t samples;                   /* Samples per channel in bins */
+    uint32_t stride;                    /* Only every stride-th block is counted */
+    uint32_t skipped;                   /* Blocks passed over since the last counted one */
+    size_t pending;                     /* Words counted in lanes, not yet in bins */
+    uint16_t lanes[2][CODE_HIST_LANES][CODE_HIST_BINS];
+} code_hist_t;
+
+typedef struct {
+    uint64_t samples;           /* Samples the histogram figures are based on */
+    int16_t min;                /* Lowest value in the histogram */
+    int16_t max;                /* Highest value in the histogram */
+    uint32_t codes_used;        /* Distinct values in the histogram */
+    uint32_t codes_missing;     /* Values between min and max that never occurred */
+    double dc;                  /* Mean value */
+    double rms;                 /* RMS around the mean */
+    double peak;                /* Largest distance from the mean */
+    double crest;               /* peak / rms, 0 without signal */
+    double effective_bits;      /* Entropy of the code distribution in bits */
+} code_hist_metrics_t;
+
+/* Allocate an empty histogram
+ *
+ * @param stride        Count one block in stride (0 and 1 count every block)
+ * @return Histogram, or NULL on allocation failure
+ */
+code_hist_t *code_hist_new(uint32_t stride);
+
+/* Free a histogram
+ *
+ * @param h             Histogram, NULL is ignored
+ */
+void code_hist_free(code_hist_t *h);
+
+/* Clear all counts, the stride is kept
+ *
+ * @param h             Histogram
+ */
+void code_hist_reset(code_hist_t *h);
+
+/* Offer a block of raw capture words
+ *
+ * @param h             Histogram
+ * @param in            Capture words as read by the extraction kernels
+ * @param len           Number of words (samples per channel)
+ * @return true if the block was counted, false if the stride skipped it
+ */
+bool code_hist_add(code_hist_t *h, const uint32_t *in, size_t len);
+
+/* Offer a block of extracted samples instead, e.g. copies kept after the
+ * capture words were handed back
+ *
+ * @param h             Histogram
+ * @param a             12-bit sample values of ADC A, as the unpadded kernels write them
+ * @param b             Same for ADC B
+ * @param len           Samples per channel
+ * @return true if the block was counted, false if the stride skipped it
+ */
+bool code_hist_add_samples(code_hist_t *h, const int16_t *a, const int16_t *b, size_t len);
+
+/* Derive the signal quality figures of one channel
+ *
+ * @param h             Histogram, pending counts are folded into the bins
+ * @param ch            0 for ADC A, 1 for ADC B
+ * @param stats         Statistics of the same period from the stats kernels,
+ *                      used for DC, RMS and peak; NULL or empty to take them
+ *                      from the histogram
+ * @param m             Receives the figures, all zero for an empty histogram
+ *
+ * A signal spread evenly over all codes has 12 effective bits, a full-scale
+ * sine about 11.6; noise and unused range lower the figure. Histograms of a
+ * few thousand samples show gaps in the tails of a noisy signal, which count
+ * as missing codes, so base the figures on a long enough period.
+ */
+void code_hist_metrics(code_hist_t *h, int ch, const extract_stats_t *stats, code_hist_metrics_t *m);
+
+#endif /* MISRC_CODE_HISTOGRAM_H */
@@ -0,0 +1,288 @@
+/*
+ * MISRC Common - Fast CRC16-CCITT Implementation
+ *
+ * The folding paths treat the data as one long polynomial: 128-bit blocks are
+ * loaded byte-reversed (first byte in the top bits), the running remainder is
+ * carried forward by multiplying with x^n mod P, and the final 128-bit value
+ * plus any tail bytes are reduced with the table code. Constants are
+ * x^n mod 0x11021 for the fold distances used below.
+ */
+
+#include "crc16.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #include <emmintrin.h>
+    #include <tmmintrin.h>
+    #include <wmmintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+    #else
+        #include <cpuid.h>
+    #endif
+    #define CRC16_HAVE_CLMUL 1
+#elif (defined(__aarch64__) || defined(__arm64__)) && \
+      (defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_AES))
+    #include <arm_neon.h>
+    #if defined(__linux__)
+        #include <sys/auxv.h>
+        #include <asm/hwcap.h>
+    #endif
+    #define CRC16_HAVE_PMULL 1
+#endif
+
+#define CRC16_POLY 0x1021
+
+/* x^n mod P for folding 16 bytes (n = 128, 192) and 64 bytes (n = 512, 576) */
+#define CRC16_K128 0xaefc
+#define CRC16_K192 0x650b
+#define CRC16_K512 0x13fc
+#define CRC16_K576 0x8832
+
+typedef uint16_t (*crc16_fn_t)(uint16_t crc, const uint8_t *buf, size_t len);
+
+static uint16_t s_table[8][256];
+static crc16_fn_t s_crc16_fn = NULL;
+static const char *s_impl_name = "slice-by-8";
+static atomic_bool s_ready = false;
+
+/*-----------------------------------------------------------------------------
+ * Portable Slice-by-8
+ *-----------------------------------------------------------------------------*/
+
+static uint16_t crc16_bytes(uint16_t crc, const uint8_t *buf, size_t len)
+{
+    while (len--) {
+        crc = (uint16_t)((crc << 8) ^ s_table[0][(crc >> 8) ^ *buf++]);
+    }
+    return crc;
+}
+
+static uint16_t crc16_slice8(uint16_t crc, const uint8_t *buf, size_t len)
+{
+    while (len >= 8) {
+        crc = s_table[7][(crc >> 8) ^ buf[0]] ^
+              s_table[6][(crc & 0xff) ^ buf[1]] ^
+              s_table[5][buf[2]] ^
+              s_table[4][buf[3]] ^
+              s_table[3][buf[4]] ^
+              s_table[2][buf[5]] ^
+              s_table[1][buf[6]] ^
+              s_table[0][buf[7]];
+        buf += 8;
+        len -= 8;
+    }
+    return crc16_bytes(crc, buf, len);
+}
+
+/*-----------------------------------------------------------------------------
+ * x86_64 PCLMULQDQ Folding
+ *-----------------------------------------------------------------------------*/
+
+#ifdef CRC16_HAVE_CLMUL
+
+#if defined(__GNUC__)
+#define CRC16_TARGET_CLMUL __attribute__((target("pclmul,ssse3")))
+#else
+#define CRC16_TARGET_CLMUL
+#endif
+
+static bool crc16_cpu_has_clmul(void)
+{
+    unsigned int ecx;
+#ifdef _MSC_VER
+    int regs[4];
+    __cpuid(regs, 1);
+    ecx = (unsigned int)regs[2];
+#else
+    unsigned int eax, ebx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+#endif
+    // bit 1: PCLMULQDQ, bit 9: SSSE3
+    return (ecx & (1u << 1)) && (ecx & (1u << 9));
+}
+
+CRC16_TARGET_CLMUL
+static inline __m128i crc16_fold_clmul(__m128i x, __m128i k, __m128i data)
+{
+    __m128i hi = _mm_clmulepi64_si128(x, k, 0x11);
+    __m128i lo = _mm_clmulepi64_si128(x, k, 0x00);
+    return _mm_xor_si128(_mm_xor_si128(hi, lo), data);
+}
+
+CRC16_TARGET_CLMUL
+static uint16_t crc16_clmul(uint16_t crc, const uint8_t *buf, size_t len)
+{
+    if (len < 64) {
+        return crc16_slice8(crc, buf, len);
+    }
+
+    const __m128i bswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m128i k64 = _mm_set_epi64x(CRC16_K576, CRC16_K512);
+    const __m128i k16 = _mm_set_epi64x(CRC16_K192, CRC16_K128);
+    uint8_t rem[16];
+
+    __m128i x0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf +  0)), bswap);
+    __m128i x1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf + 16)), bswap);
+    __m128i x2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf + 32)), bswap);
+    __m128i x3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf + 48)), bswap);
+    // The initial register value lines up with the first 16 message bits
+    x0 = _mm_xor_si128(x0, _mm_set_epi64x((long long)((uint64_t)crc << 48), 0));
+    buf += 64;
+    len -= 64;
+
+    // Four independent lanes hide the multiplier latency
+    while (len >= 64) {
+        x0 = crc16_fold_clmul(x0, k64, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf +  0)), bswap));
+        x1 = crc16_fold_clmul(x1, k64, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf + 16)), bswap));
+        x2 = crc16_fold_clmul(x2, k64, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf + 32)), bswap));
+        x3 = crc16_fold_clmul(x3, k64, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf + 48)), bswap));
+        buf += 64;
+        len -= 64;
+    }
+
+    x0 = crc16_fold_clmul(x0, k16, x1);
+    x0 = crc16_fold_clmul(x0, k16, x2);
+    x0 = crc16_fold_clmul(x0, k16, x3);
+    while (len >= 16) {
+        x0 = crc16_fold_clmul(x0, k16, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)buf), bswap));
+        buf += 16;
+        len -= 16;
+    }
+
+    _mm_storeu_si128((__m128i *)rem, _mm_shuffle_epi8(x0, bswap));
+    crc = crc16_slice8(0, rem, sizeof(rem));
+    return crc16_slice8(crc, buf, len);
+}
+
+#endif /* CRC16_HAVE_CLMUL */
+
+/*-----------------------------------------------------------------------------
+ * AArch64 PMULL Folding
+ *-----------------------------------------------------------------------------*/
+
+#ifdef CRC16_HAVE_PMULL
+
+static bool crc16_cpu_has_pmull(void)
+{
+#if defined(__linux__)
+    return (getauxval(AT_HWCAP) & HWCAP_PMULL) != 0;
+#else
+    // Built with the crypto extension enabled, which Apple and Windows
+    // AArch64 targets always provide
+    return true;
+#endif
+}
+
+static inline uint64x2_t crc16_load_be(const uint8_t *p)
+{
+    uint8x16_t v = vrev64q_u8(vld1q_u8(p));
+    return vreinterpretq_u64_u8(vextq_u8(v, v, 8));
+}
+
+static inline uint64x2_t crc16_fold_pmull(uint64x2_t x, poly64_t k_hi, poly64_t k_lo, uint64x2_t data)
+{
+    poly128_t hi = vmull_p64((poly64_t)vgetq_lane_u64(x, 1), k_hi);
+    poly128_t lo = vmull_p64((poly64_t)vgetq_lane_u64(x, 0), k_lo);
+    return veorq_u64(veorq_u64(vreinterpretq_u64_p128(hi), vreinterpretq_u64_p128(lo)), data);
+}
+
+static uint16_t crc16_pmull(uint16_t crc, const uint8_t *buf, size_t len)
+{
+    if (len < 64) {
+        return crc16_slice8(crc, buf, len);
+    }
+
+    uint8_t rem[16];
+    uint64x2_t x0 = crc16_load_be(buf +  0);
+    uint64x2_t x1 = crc16_load_be(buf + 16);
+    uint64x2_t x2 = crc16_load_be(buf + 32);
+    uint64x2_t x3 = crc16_load_be(buf + 48);
+    // The initial register value lines up with the first 16 message bits
+    x0 = veorq_u64(x0, vcombine_u64(vcreate_u64(0), vcreate_u64((uint64_t)crc << 48)));
+    buf += 64;
+    len -= 64;
+
+    // Four independent lanes hide the multiplier latency
+    while (len >= 64) {
+        x0 = crc16_fold_pmull(x0, CRC16_K576, CRC16_K512, crc16_load_be(buf +  0));
+        x1 = crc16_fold_pmull(x1, CRC16_K576, CRC16_K512, crc16_load_be(buf + 16));
+        x2 = crc16_fold_pmull(x2, CRC16_K576, CRC16_K512, crc16_load_be(buf + 32));
+        x3 = crc16_fold_pmull(x3, CRC16_K576, CRC16_K512, crc16_load_be(buf + 48));
+        buf += 64;
+        len -= 64;
+    }
+
+    x0 = crc16_fold_pmull(x0, CRC16_K192, CRC16_K128, x1);
+    x0 = crc16_fold_pmull(x0, CRC16_K192, CRC16_K128, x2);
+    x0 = crc16_fold_pmull(x0, CRC16_K192, CRC16_K128, x3);
+    while (len >= 16) {
+        x0 = crc16_fold_pmull(x0, CRC16_K192, CRC16_K128, crc16_load_be(buf));
+        buf += 16;
+        len -= 16;
+    }
+
+    uint8x16_t r = vrev64q_u8(vreinterpretq_u8_u64(x0));
+    vst1q_u8(rem, vextq_u8(r, r, 8));
+    crc = crc16_slice8(0, rem, sizeof(rem));
+    return crc16_slice8(crc, buf, len);
+}
+
+#endif /* CRC16_HAVE_PMULL */
+
+/*-----------------------------------------------------------------------------
+ * Public API
+ *-----------------------------------------------------------------------------*/
+
+void crc16_init(void)
+{
+    if (atomic_load_explicit(&s_ready, memory_order_acquire)) {
+        return;
+    }
+
+    for (int b = 0; b < 256; b++) {
+        uint16_t c = (uint16_t)(b << 8);
+        for (int i = 0; i < 8; i++) {
+            c = (c & 0x8000) ? (uint16_t)((c << 1) ^ CRC16_POLY) : (uint16_t)(c << 1);
+        }
+        s_table[0][b] = c;
+    }
+    for (int k = 1; k < 8; k++) {
+        for (int b = 0; b < 256; b++) {
+            uint16_t prev = s_table[k - 1][b];
+            s_table[k][b] = (uint16_t)((prev << 8) ^ s_table[0][prev >> 8]);
+        }
+    }
+
+    s_crc16_fn = crc16_slice8;
+    s_impl_name = "slice-by-8";
+#if defined(CRC16_HAVE_CLMUL)
+    if (crc16_cpu_has_clmul()) {
+        s_crc16_fn = crc16_clmul;
+        s_impl_name = "pclmulqdq";
+    }
+#elif defined(CRC16_HAVE_PMULL)
+    if (crc16_cpu_has_pmull()) {
+        s_crc16_fn = crc16_pmull;
+        s_impl_name = "pmull";
+    }
+#endif
+
+    atomic_store_explicit(&s_ready, true, memory_order_release);
+}
+
+uint16_t crc16_update(uint16_t crc, const uint8_t *buf, size_t len)
+{
+    if (!atomic_load_explicit(&s_ready, memory_order_acquire)) {
+        crc16_init();
+    }
+    return s_crc16_fn(crc, buf, len);
+}
+
+const char *crc16_impl_name(void)
+{
+    crc16_init();
+    return s_impl_name;
+}
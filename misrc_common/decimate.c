@@ -0,0 +1,347 @@
+/*
+ * MISRC Common - Half-band Decimators
+ *
+ * Polyphase form: the input is split into even samples e[] and odd samples
+ * o[]. Output j is the centre tap on o[j + 11] plus the symmetric pairs
+ * e[j + 11 - m] + e[j + 12 + m] for m = 0..11. Each stage keeps the last
+ * HB_HIST pairs in front of its work buffers so blocks join seamlessly.
+ * The vector kernels compute 8 (SSE2, NEON) or 16 (AVX2) outputs at a time
+ * with 32 bit accumulators, the scalar code does the rest with the same
+ * arithmetic, so every implementation gives bit identical results.
+ */
+
+#include "decimate.h"
+#include "buffer.h"
+#include "extract.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #include <emmintrin.h>
+    #include <immintrin.h>
+    #define DECIMATE_HAVE_X86 1
+#elif defined(__aarch64__) || defined(__arm64__)
+    #include <arm_neon.h>
+    #define DECIMATE_HAVE_NEON 1
+#endif
+
+#define HB_PAIRS    12                  /* Symmetric tap pairs, 4 * HB_PAIRS - 1 taps */
+#define HB_HIST     (2 * HB_PAIRS - 1)  /* Sample pairs of history per stage */
+#define HB_CENTRE   (HB_PAIRS - 1)      /* Offset of the centre tap in o[] */
+#define HB_CHUNK    4096                /* Sample pairs per FIR call */
+#define HB_MAX_STAGES 3
+
+/* Kaiser window, beta 7.2, Q15, one side of the odd taps (sum 8192, centre 16384) */
+static const int16_t s_coeffs[HB_PAIRS] = {
+    10364, -3284, 1778, -1086, 682, -422, 252, -141, 72, -32, 11, -2
+};
+
+typedef void (*hb_fir_fn_t)(const int16_t *e, const int16_t *o, size_t n, int16_t *out);
+
+typedef struct {
+    int16_t *e;          /* HB_HIST pairs of history, then the current chunk */
+    int16_t *o;
+    int16_t pending;     /* Even sample waiting for its odd partner */
+    bool has_pending;
+} halfband_t;
+
+struct decimator {
+    unsigned factor;
+    unsigned stages;
+    halfband_t hb[HB_MAX_STAGES];
+};
+
+static hb_fir_fn_t s_fir_fn = NULL;
+static const char *s_impl_name = "C";
+static atomic_bool s_ready = false;
+
+/*-----------------------------------------------------------------------------
+ * Portable C
+ *-----------------------------------------------------------------------------*/
+
+static inline int16_t hb_sat(int32_t acc)
+{
+    acc >>= 15;
+    if (acc > INT16_MAX) return INT16_MAX;
+    if (acc < INT16_MIN) return INT16_MIN;
+    return (int16_t)acc;
+}
+
+static void hb_fir_C(const int16_t *e, const int16_t *o, size_t n, int16_t *out)
+{
+    for (size_t j = 0; j < n; j++) {
+        int32_t acc = 16384 * (int32_t)o[j + HB_CENTRE] + 16384;
+        for (int m = 0; m < HB_PAIRS; m++) {
+            acc += s_coeffs[m] * ((int32_t)e[j + HB_CENTRE - m] + e[j + HB_CENTRE + 1 + m]);
+        }
+        out[j] = hb_sat(acc);
+    }
+}
+
+static void hb_deinterleave_C(const int16_t *in, int16_t *e, int16_t *o, size_t pairs)
+{
+    for (size_t i = 0; i < pairs; i++) {
+        e[i] = in[2 * i];
+        o[i] = in[2 * i + 1];
+    }
+}
+
+/*-----------------------------------------------------------------------------
+ * x86_64 SSE2 / AVX2
+ *-----------------------------------------------------------------------------*/
+
+#ifdef DECIMATE_HAVE_X86
+
+#if defined(__GNUC__)
+#define DECIMATE_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define DECIMATE_TARGET_AVX2
+#endif
+
+/* SSE2 is part of x86_64, no check needed */
+static void hb_fir_sse2(const int16_t *e, const int16_t *o, size_t n, int16_t *out)
+{
+    const __m128i round = _mm_set1_epi16(1);
+    const __m128i centre = _mm_set1_epi16(16384);
+    size_t j = 0;
+
+    for (; j + 8 <= n; j += 8) {
+        // (o, 1) pairs times (16384, 16384) give the centre tap and the rounding
+        __m128i c = _mm_loadu_si128((const __m128i *)(o + j + HB_CENTRE));
+        __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(c, round), centre);
+        __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(c, round), centre);
+        for (int m = 0; m < HB_PAIRS; m++) {
+            const __m128i k = _mm_set1_epi16(s_coeffs[m]);
+            __m128i a = _mm_loadu_si128((const __m128i *)(e + j + HB_CENTRE - m));
+            __m128i b = _mm_loadu_si128((const __m128i *)(e + j + HB_CENTRE + 1 + m));
+            lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), k));
+            hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), k));
+        }
+        lo = _mm_srai_epi32(lo, 15);
+        hi = _mm_srai_epi32(hi, 15);
+        _mm_storeu_si128((__m128i *)(out + j), _mm_packs_epi32(lo, hi));
+    }
+    if (j < n) hb_fir_C(e + j, o + j, n - j, out + j);
+}
+
+/* unpack and pack both work within 128 bit lanes, so the outputs come out in order */
+DECIMATE_TARGET_AVX2
+static void hb_fir_avx2(const int16_t *e, const int16_t *o, size_t n, int16_t *out)
+{
+    const __m256i round = _mm256_set1_epi16(1);
+    const __m256i centre = _mm256_set1_epi16(16384);
+    size_t j = 0;
+
+    for (; j + 16 <= n; j += 16) {
+        __m256i c = _mm256_loadu_si256((const __m256i *)(o + j + HB_CENTRE));
+        __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(c, round), centre);
+        __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(c, round), centre);
+        for (int m = 0; m < HB_PAIRS; m++) {
+            const __m256i k = _mm256_set1_epi16(s_coeffs[m]);
+            __m256i a = _mm256_loadu_si256((const __m256i *)(e + j + HB_CENTRE - m));
+            __m256i b = _mm256_loadu_si256((const __m256i *)(e + j + HB_CENTRE + 1 + m));
+            lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), k));
+            hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), k));
+        }
+        lo = _mm256_srai_epi32(lo, 15);
+        hi = _mm256_srai_epi32(hi, 15);
+        _mm256_storeu_si256((__m256i *)(out + j), _mm256_packs_epi32(lo, hi));
+    }
+    if (j < n) hb_fir_sse2(e + j, o + j, n - j, out + j);
+}
+
+static void hb_deinterleave(const int16_t *in, int16_t *e, int16_t *o, size_t pairs)
+{
+    size_t i = 0;
+    for (; i + 8 <= pairs; i += 8) {
+        __m128i v0 = _mm_loadu_si128((const __m128i *)(in + 2 * i));
+        __m128i v1 = _mm_loadu_si128((const __m128i *)(in + 2 * i + 8));
+        // Sign extend the low (even) and high (odd) halves of each 32 bit pair, then pack
+        __m128i e0 = _mm_srai_epi32(_mm_slli_epi32(v0, 16), 16);
+        __m128i e1 = _mm_srai_epi32(_mm_slli_epi32(v1, 16), 16);
+        __m128i o0 = _mm_srai_epi32(v0, 16);
+        __m128i o1 = _mm_srai_epi32(v1, 16);
+        _mm_storeu_si128((__m128i *)(e + i), _mm_packs_epi32(e0, e1));
+        _mm_storeu_si128((__m128i *)(o + i), _mm_packs_epi32(o0, o1));
+    }
+    if (i < pairs) hb_deinterleave_C(in + 2 * i, e + i, o + i, pairs - i);
+}
+
+#endif /* DECIMATE_HAVE_X86 */
+
+/*-----------------------------------------------------------------------------
+ * AArch64 NEON
+ *-----------------------------------------------------------------------------*/
+
+#ifdef DECIMATE_HAVE_NEON
+
+static void hb_fir_neon(const int16_t *e, const int16_t *o, size_t n, int16_t *out)
+{
+    size_t j = 0;
+
+    for (; j + 8 <= n; j += 8) {
+        int16x8_t c = vld1q_s16(o + j + HB_CENTRE);
+        int32x4_t lo = vmlal_n_s16(vdupq_n_s32(16384), vget_low_s16(c), 16384);
+        int32x4_t hi = vmlal_n_s16(vdupq_n_s32(16384), vget_high_s16(c), 16384);
+        for (int m = 0; m < HB_PAIRS; m++) {
+            int16x8_t a = vld1q_s16(e + j + HB_CENTRE - m);
+            int16x8_t b = vld1q_s16(e + j + HB_CENTRE + 1 + m);
+            lo = vmlal_n_s16(lo, vget_low_s16(a), s_coeffs[m]);
+            lo = vmlal_n_s16(lo, vget_low_s16(b), s_coeffs[m]);
+            hi = vmlal_n_s16(hi, vget_high_s16(a), s_coeffs[m]);
+            hi = vmlal_n_s16(hi, vget_high_s16(b), s_coeffs[m]);
+        }
+        vst1q_s16(out + j, vcombine_s16(vqshrn_n_s32(lo, 15), vqshrn_n_s32(hi, 15)));
+    }
+    if (j < n) hb_fir_C(e + j, o + j, n - j, out + j);
+}
+
+static void hb_deinterleave(const int16_t *in, int16_t *e, int16_t *o, size_t pairs)
+{
+    size_t i = 0;
+    for (; i + 8 <= pairs; i += 8) {
+        int16x8x2_t v = vld2q_s16(in + 2 * i);
+        vst1q_s16(e + i, v.val[0]);
+        vst1q_s16(o + i, v.val[1]);
+    }
+    if (i < pairs) hb_deinterleave_C(in + 2 * i, e + i, o + i, pairs - i);
+}
+
+#endif /* DECIMATE_HAVE_NEON */
+
+#if !defined(DECIMATE_HAVE_X86) && !defined(DECIMATE_HAVE_NEON)
+#define hb_deinterleave hb_deinterleave_C
+#endif
+
+/*-----------------------------------------------------------------------------
+ * Helpers
+ *-----------------------------------------------------------------------------*/
+
+static void decimator_init(void)
+{
+    if (atomic_load_explicit(&s_ready, memory_order_acquire)) {
+        return;
+    }
+    s_fir_fn = hb_fir_C;
+    s_impl_name = "C";
+#if defined(DECIMATE_HAVE_X86)
+    s_fir_fn = hb_fir_sse2;
+    s_impl_name = "SSE2";
+    if (check_cpu_feat() >= 3) {
+        s_fir_fn = hb_fir_avx2;
+        s_impl_name = "AVX2";
+    }
+#elif defined(DECIMATE_HAVE_NEON)
+    s_fir_fn = hb_fir_neon;
+    s_impl_name = "NEON";
+#endif
+    atomic_store_explicit(&s_ready, true, memory_order_release);
+}
+
+/* One half-band stage, out may be in (outputs never overtake unread input) */
+static size_t hb_process(halfband_t *hb, const int16_t *in, size_t len, int16_t *out)
+{
+    size_t produced = 0;
+
+    while (len > 0) {
+        size_t n = 0;
+        size_t pairs;
+
+        if (hb->has_pending) {
+            hb->e[HB_HIST] = hb->pending;
+            hb->o[HB_HIST] = *in++;
+            hb->has_pending = false;
+            len--;
+            n = 1;
+        }
+        pairs = len / 2;
+        if (pairs > HB_CHUNK - n) pairs = HB_CHUNK - n;
+        hb_deinterleave(in, hb->e + HB_HIST + n, hb->o + HB_HIST + n, pairs);
+        in += 2 * pairs;
+        len -= 2 * pairs;
+        n += pairs;
+        if (len == 1) {
+            hb->pending = *in;
+            hb->has_pending = true;
+            len = 0;
+        }
+        if (n == 0) break;
+
+        s_fir_fn(hb->e, hb->o, n, out + produced);
+        produced += n;
+        memmove(hb->e, hb->e + n, HB_HIST * sizeof(int16_t));
+        memmove(hb->o, hb->o + n, HB_HIST * sizeof(int16_t));
+    }
+    return produced;
+}
+
+/*-----------------------------------------------------------------------------
+ * Public API
+ *-----------------------------------------------------------------------------*/
+
+int decimator_factor_valid(unsigned factor)
+{
+    return factor == 2 || factor == 4 || factor == 8;
+}
+
+decimator_t *decimator_create(unsigned factor)
+{
+    // Rounded up to whole vectors for the allocator
+    const size_t buf_size = ((HB_HIST + HB_CHUNK) * sizeof(int16_t) + ALIGN_AVX - 1) & ~(size_t)(ALIGN_AVX - 1);
+    decimator_t *dec;
+
+    if (!decimator_factor_valid(factor)) return NULL;
+    decimator_init();
+    dec = calloc(1, sizeof(*dec));
+    if (!dec) return NULL;
+    dec->factor = factor;
+    for (unsigned f = factor; f > 1; f >>= 1) {
+        halfband_t *hb = &dec->hb[dec->stages++];
+        hb->e = aligned_alloc(ALIGN_AVX, buf_size);
+        hb->o = aligned_alloc(ALIGN_AVX, buf_size);
+        if (!hb->e || !hb->o) {
+            decimator_free(dec);
+            return NULL;
+        }
+    }
+    decimator_reset(dec);
+    return dec;
+}
+
+size_t decimator_process(decimator_t *dec, const int16_t *in, size_t len, int16_t *out)
+{
+    // Later stages work in place on what the first one wrote
+    len = hb_process(&dec->hb[0], in, len, out);
+    for (unsigned s = 1; s < dec->stages; s++) {
+        len = hb_process(&dec->hb[s], out, len, out);
+    }
+    return len;
+}
+
+void decimator_reset(decimator_t *dec)
+{
+    for (unsigned s = 0; s < dec->stages; s++) {
+        memset(dec->hb[s].e, 0, HB_HIST * sizeof(int16_t));
+        memset(dec->hb[s].o, 0, HB_HIST * sizeof(int16_t));
+        dec->hb[s].has_pending = false;
+    }
+}
+
+void decimator_free(decimator_t *dec)
+{
+    if (!dec) return;
+    for (unsigned s = 0; s < dec->stages; s++) {
+        if (dec->hb[s].e) aligned_free(dec->hb[s].e);
+        if (dec->hb[s].o) aligned_free(dec->hb[s].o);
+    }
+    free(dec);
+}
+
+const char *decimator_impl_name(void)
+{
+    decimator_init();
+    return s_impl_name;
+}
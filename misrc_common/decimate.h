@@ -0,0 +1,65 @@
+/*
+ * MISRC Common - Half-band Decimators
+ *
+ * Fixed ratio decimation of 16 bit samples by 2, 4 or 8, as a cheap
+ * alternative to libsoxr for the common 40 -> 20 / 10 / 5 MSPS cases.
+ * Each factor of 2 is a 47 tap half-band FIR run in polyphase form: every
+ * other tap of a half-band is zero, so one output costs 12 symmetric tap
+ * pairs plus the centre tap. Coefficients are Q15 and sum to exactly 1.0,
+ * the passband (to 0.4 of the output rate) is flat within 0.003 dB and
+ * everything from 0.6 of the output rate up is 71 dB down, about the
+ * dynamic range of the 12 bit ADCs.
+ *
+ * The filter and output are streaming: successive calls behave like one
+ * long input, the group delay is 23 input samples per stage. The FIR runs
+ * with SSE2 or AVX2 on x86_64 and NEON on AArch64, picked at runtime.
+ */
+
+#ifndef MISRC_DECIMATE_H
+#define MISRC_DECIMATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct decimator decimator_t;
+
+/* Check whether a decimation factor is supported
+ *
+ * @param factor        Input samples per output sample
+ * @return 1 for 2, 4 and 8, 0 otherwise
+ */
+int decimator_factor_valid(unsigned factor);
+
+/* Create a decimator
+ *
+ * @param factor        2, 4 or 8
+ * @return Decimator, or NULL for an unsupported factor or out of memory
+ */
+decimator_t *decimator_create(unsigned factor);
+
+/* Decimate a block of samples
+ *
+ * @param dec           Decimator
+ * @param in            Input samples
+ * @param len           Number of input samples, any count
+ * @param out           Output, room for len / factor + 1 samples, may be in
+ * @return Number of output samples written
+ */
+size_t decimator_process(decimator_t *dec, const int16_t *in, size_t len, int16_t *out);
+
+/* Forget the filter history, the next call starts a new stream
+ *
+ * @param dec           Decimator
+ */
+void decimator_reset(decimator_t *dec);
+
+/* Free a decimator
+ *
+ * @param dec           Decimator (NULL is ignored)
+ */
+void decimator_free(decimator_t *dec);
+
+/* Name of the FIR implementation in use, for log messages */
+const char *decimator_impl_name(void);
+
+#endif /* MISRC_DECIMATE_H */
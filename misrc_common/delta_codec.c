@@ -0,0 +1,811 @@
+/*
+ * MISRC Common - Delta Coded RF Stream Implementation
+ */
+
+#include "delta_codec.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #include <emmintrin.h>
+    #define DELTA_CODEC_HAVE_SSE2 1
+#elif defined(__aarch64__) || defined(__arm64__)
+    #include <arm_neon.h>
+    #define DELTA_CODEC_HAVE_NEON 1
+#endif
+
+#if defined(_WIN32) || defined(_WIN64)
+    #define delta_fseek(f, off) _fseeki64((f), (int64_t)(off), SEEK_SET)
+#else
+    #include <sys/types.h>
+    #define delta_fseek(f, off) fseeko((f), (off_t)(off), SEEK_SET)
+#endif
+
+struct delta_writer {
+    FILE *f;
+    uint64_t bytes;             /* Written to f so far */
+    uint64_t samples;           /* Samples in written blocks */
+    uint64_t blocks;            /* Written blocks */
+    int16_t pending[DELTA_BLOCK_SAMPLES];
+    size_t pending_n;           /* Samples waiting for a full block */
+    uint8_t block[DELTA_BLOCK_MAX_BYTES];
+    delta_index_entry_t *index;
+    size_t index_n;
+    size_t index_cap;
+    bool failed;                /* A write failed */
+};
+
+struct delta_reader {
+    FILE *f;
+    uint32_t header_size;
+    uint64_t sample;            /* Next sample handed out */
+    int16_t block[DELTA_BLOCK_SAMPLES];
+    size_t block_n;             /* Decoded samples in block */
+    size_t block_pos;           /* Next of them handed out */
+    uint8_t coded[DELTA_BLOCK_MAX_BYTES];
+    delta_index_entry_t *index; /* NULL without seek index */
+    size_t index_n;
+    uint64_t samples;           /* Samples in the stream, from the index */
+    bool done;                  /* End of the blocks reached */
+};
+
+/* Bits needed for an unsigned value */
+static inline unsigned bit_width(uint32_t v)
+{
+#if defined(__GNUC__)
+    return v ? 32u - (unsigned)__builtin_clz(v) : 0;
+#else
+    unsigned n = 0;
+    while (v) { v >>= 1; n++; }
+    return n;
+#endif
+}
+
+/* Number of low zero bits of a non-zero value */
+static inline unsigned low_zero_bits(uint32_t v)
+{
+#if defined(__GNUC__)
+    return (unsigned)__builtin_ctz(v);
+#else
+    unsigned n = 0;
+    while (!(v & 1)) { v >>= 1; n++; }
+    return n;
+#endif
+}
+
+static inline uint16_t zigzag(uint16_t v)
+{
+    return (uint16_t)((v << 1) ^ (uint16_t)((int16_t)v >> 15));
+}
+
+static inline uint16_t unzigzag(uint16_t z)
+{
+    return (uint16_t)((z >> 1) ^ (uint16_t)-(z & 1));
+}
+
+/*-----------------------------------------------------------------------------
+ * Block Analysis
+ *-----------------------------------------------------------------------------*/
+
+/* OR of all samples, for the common low zero bits */
+static uint16_t block_or(const int16_t *in, size_t n)
+{
+    size_t i = 0;
+    uint16_t r = 0;
+#if defined(DELTA_CODEC_HAVE_SSE2)
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 8 <= n; i += 8) acc = _mm_or_si128(acc, _mm_loadu_si128((const __m128i *)(in + i)));
+    acc = _mm_or_si128(acc, _mm_srli_si128(acc, 8));
+    acc = _mm_or_si128(acc, _mm_srli_si128(acc, 4));
+    acc = _mm_or_si128(acc, _mm_srli_si128(acc, 2));
+    r = (uint16_t)_mm_extract_epi16(acc, 0);
+#elif defined(DELTA_CODEC_HAVE_NEON)
+    uint16x8_t acc = vdupq_n_u16(0);
+    for (; i + 8 <= n; i += 8) acc = vorrq_u16(acc, vld1q_u16((const uint16_t *)(in + i)));
+    uint16x4_t h = vorr_u16(vget_low_u16(acc), vget_high_u16(acc));
+    uint64_t w = vget_lane_u64(vreinterpret_u64_u16(h), 0);
+    w |= w >> 32;
+    w |= w >> 16;
+    r = (uint16_t)w;
+#endif
+    for (; i < n; i++) r |= (uint16_t)in[i];
+    return r;
+}
+
+#if defined(DELTA_CODEC_HAVE_SSE2)
+static inline __m128i zigzag_sse2(__m128i v)
+{
+    return _mm_xor_si128(_mm_slli_epi16(v, 1), _mm_srai_epi16(v, 15));
+}
+
+static inline unsigned or_width_sse2(__m128i v)
+{
+    v = _mm_or_si128(v, _mm_srli_si128(v, 8));
+    v = _mm_or_si128(v, _mm_srli_si128(v, 4));
+    v = _mm_or_si128(v, _mm_srli_si128(v, 2));
+    return bit_width((uint32_t)_mm_extract_epi16(v, 0));
+}
+#elif defined(DELTA_CODEC_HAVE_NEON)
+static inline uint16x8_t zigzag_neon(int16x8_t v)
+{
+    return vreinterpretq_u16_s16(veorq_s16(vshlq_n_s16(v, 1), vshrq_n_s16(v, 15)));
+}
+#endif
+
+/* Group widths of the residuals of all three orders
+ *
+ * y has two samples of history in front and is readable up to whole groups.
+ */
+static void analyse_groups(const int16_t *y, size_t groups, uint8_t widths[3][DELTA_BLOCK_GROUPS])
+{
+    for (size_t g = 0; g < groups; g++) {
+        const int16_t *p = y + g * DELTA_GROUP_SAMPLES;
+#if defined(DELTA_CODEC_HAVE_SSE2)
+        __m128i o0 = _mm_setzero_si128(), o1 = o0, o2 = o0;
+        for (int k = 0; k < DELTA_GROUP_SAMPLES; k += 8) {
+            __m128i a = _mm_loadu_si128((const __m128i *)(p + k));
+            __m128i b = _mm_loadu_si128((const __m128i *)(p + k - 1));
+            __m128i c = _mm_loadu_si128((const __m128i *)(p + k - 2));
+            __m128i d1 = _mm_sub_epi16(a, b);
+            __m128i d2 = _mm_add_epi16(_mm_sub_epi16(d1, b), c);
+            o0 = _mm_or_si128(o0, zigzag_sse2(a));
+            o1 = _mm_or_si128(o1, zigzag_sse2(d1));
+            o2 = _mm_or_si128(o2, zigzag_sse2(d2));
+        }
+        widths[0][g] = (uint8_t)or_width_sse2(o0);
+        widths[1][g] = (uint8_t)or_width_sse2(o1);
+        widths[2][g] = (uint8_t)or_width_sse2(o2);
+#elif defined(DELTA_CODEC_HAVE_NEON)
+        /* The largest value has the width of the OR of all */
+        uint16x8_t m0 = vdupq_n_u16(0), m1 = m0, m2 = m0;
+        for (int k = 0; k < DELTA_GROUP_SAMPLES; k += 8) {
+            int16x8_t a = vld1q_s16(p + k);
+            int16x8_t b = vld1q_s16(p + k - 1);
+            int16x8_t c = vld1q_s16(p + k - 2);
+            int16x8_t d1 = vsubq_s16(a, b);
+            int16x8_t d2 = vaddq_s16(vsubq_s16(d1, b), c);
+            m0 = vmaxq_u16(m0, zigzag_neon(a));
+            m1 = vmaxq_u16(m1, zigzag_neon(d1));
+            m2 = vmaxq_u16(m2, zigzag_neon(d2));
+        }
+        widths[0][g] = (uint8_t)bit_width(vmaxvq_u16(m0));
+        widths[1][g] = (uint8_t)bit_width(vmaxvq_u16(m1));
+        widths[2][g] = (uint8_t)bit_width(vmaxvq_u16(m2));
+#else
+        uint16_t o0 = 0, o1 = 0, o2 = 0;
+        for (int k = 0; k < DELTA_GROUP_SAMPLES; k++) {
+            uint16_t a = (uint16_t)p[k], b = (uint16_t)p[k - 1], c = (uint16_t)p[k - 2];
+            o0 |= zigzag(a);
+            o1 |= zigzag((uint16_t)(a - b));
+            o2 |= zigzag((uint16_t)(a - 2 * b + c));
+        }
+        widths[0][g] = (uint8_t)bit_width(o0);
+        widths[1][g] = (uint8_t)bit_width(o1);
+        widths[2][g] = (uint8_t)bit_width(o2);
+#endif
+    }
+}
+
+#if defined(__GNUC__)
+# define DELTA_INLINE static inline __attribute__((always_inline))
+#else
+# define DELTA_INLINE static inline
+#endif
+
+/* Zigzag coded residuals of one order, n samples */
+static void residuals(const int16_t *y, size_t n, unsigned order, uint16_t *r)
+{
+    size_t i = 0;
+#if defined(DELTA_CODEC_HAVE_SSE2)
+    for (; i + 8 <= n; i += 8) {
+        __m128i d = _mm_loadu_si128((const __m128i *)(y + i));
+        if (order > 0) {
+            __m128i b = _mm_loadu_si128((const __m128i *)(y + i - 1));
+            d = _mm_sub_epi16(d, b);
+            if (order > 1) d = _mm_add_epi16(_mm_sub_epi16(d, b), _mm_loadu_si128((const __m128i *)(y + i - 2)));
+        }
+        _mm_storeu_si128((__m128i *)(r + i), zigzag_sse2(d));
+    }
+#elif defined(DELTA_CODEC_HAVE_NEON)
+    for (; i + 8 <= n; i += 8) {
+        int16x8_t d = vld1q_s16(y + i);
+        if (order > 0) {
+            int16x8_t b = vld1q_s16(y + i - 1);
+            d = vsubq_s16(d, b);
+            if (order > 1) d = vaddq_s16(vsubq_s16(d, b), vld1q_s16(y + i - 2));
+        }
+        vst1q_u16(r + i, zigzag_neon(d));
+    }
+#endif
+    for (; i < n; i++) {
+        uint16_t a = (uint16_t)y[i], b = (uint16_t)y[i - 1], c = (uint16_t)y[i - 2];
+        uint16_t d = order == 0 ? a : order == 1 ? (uint16_t)(a - b) : (uint16_t)(a - 2 * b + c);
+        r[i] = zigzag(d);
+    }
+}
+
+/*-----------------------------------------------------------------------------
+ * Bit Packing
+ *-----------------------------------------------------------------------------*/
+
+/* A group is DELTA_GROUP_LANES lanes of 16 bit, value j of lane l is
+ * r[j * DELTA_GROUP_LANES + l]. Each lane packs its DELTA_GROUP_SAMPLES /
+ * DELTA_GROUP_LANES values into w words of its own, so one vector holds a
+ * word of every lane and w vectors the whole group (2 * w * lanes bytes).
+ * Inlined with a constant w for each width, the shifts are constants then. */
+#define DELTA_LANE_VALUES   (DELTA_GROUP_SAMPLES / DELTA_GROUP_LANES)
+
+DELTA_INLINE uint8_t *pack_bits(const uint16_t *r, unsigned w, uint8_t *out)
+{
+#if defined(DELTA_CODEC_HAVE_SSE2)
+    __m128i acc = _mm_setzero_si128();
+    unsigned bits = 0;
+    for (int j = 0; j < DELTA_LANE_VALUES; j++) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(r + j * DELTA_GROUP_LANES));
+        acc = _mm_or_si128(acc, _mm_sll_epi16(v, _mm_cvtsi32_si128((int)bits)));
+        bits += w;
+        if (bits >= 16) {
+            _mm_storeu_si128((__m128i *)out, acc);
+            out += 16;
+            bits -= 16;
+            acc = bits ? _mm_srl_epi16(v, _mm_cvtsi32_si128((int)(w - bits))) : _mm_setzero_si128();
+        }
+    }
+#elif defined(DELTA_CODEC_HAVE_NEON)
+    uint16x8_t acc = vdupq_n_u16(0);
+    unsigned bits = 0;
+    for (int j = 0; j < DELTA_LANE_VALUES; j++) {
+        uint16x8_t v = vld1q_u16(r + j * DELTA_GROUP_LANES);
+        acc = vorrq_u16(acc, vshlq_u16(v, vdupq_n_s16((int16_t)bits)));
+        bits += w;
+        if (bits >= 16) {
+            vst1q_u8(out, vreinterpretq_u8_u16(acc));
+            out += 16;
+            bits -= 16;
+            acc = bits ? vshlq_u16(v, vdupq_n_s16(-(int16_t)(w - bits))) : vdupq_n_u16(0);
+        }
+    }
+#else
+    for (int l = 0; l < DELTA_GROUP_LANES; l++) {
+        uint32_t acc = 0;
+        unsigned bits = 0, k = 0;
+        for (int j = 0; j < DELTA_LANE_VALUES; j++) {
+            acc |= (uint32_t)r[j * DELTA_GROUP_LANES + l] << bits;
+            bits += w;
+            if (bits >= 16) {
+                uint16_t word = (uint16_t)acc;
+                memcpy(out + (k++ * DELTA_GROUP_LANES + l) * 2, &word, sizeof(word));
+                acc >>= 16;
+                bits -= 16;
+            }
+        }
+    }
+    out += 2 * w * DELTA_GROUP_LANES;
+#endif
+    return out;
+}
+
+DELTA_INLINE const uint8_t *unpack_bits(const uint8_t *in, unsigned w, uint16_t *r)
+{
+#if defined(DELTA_CODEC_HAVE_SSE2)
+    const __m128i mask = _mm_set1_epi16((short)((1u << w) - 1));
+    __m128i cur = _mm_loadu_si128((const __m128i *)in);
+    unsigned shift = 0;
+    in += 16;
+    for (int j = 0; j < DELTA_LANE_VALUES; j++) {
+        __m128i v = _mm_srl_epi16(cur, _mm_cvtsi32_si128((int)shift));
+        if (shift + w > 16) {
+            cur = _mm_loadu_si128((const __m128i *)in);
+            in += 16;
+            v = _mm_or_si128(v, _mm_sll_epi16(cur, _mm_cvtsi32_si128((int)(16 - shift))));
+            shift = shift + w - 16;
+        } else {
+            shift += w;
+            if (shift == 16 && j < DELTA_LANE_VALUES - 1) {
+                cur = _mm_loadu_si128((const __m128i *)in);
+                in += 16;
+                shift = 0;
+            }
+        }
+        _mm_storeu_si128((__m128i *)(r + j * DELTA_GROUP_LANES), _mm_and_si128(v, mask));
+    }
+#elif defined(DELTA_CODEC_HAVE_NEON)
+    const uint16x8_t mask = vdupq_n_u16((uint16_t)((1u << w) - 1));
+    uint16x8_t cur = vreinterpretq_u16_u8(vld1q_u8(in));
+    unsigned shift = 0;
+    in += 16;
+    for (int j = 0; j < DELTA_LANE_VALUES; j++) {
+        uint16x8_t v = vshlq_u16(cur, vdupq_n_s16(-(int16_t)shift));
+        if (shift + w > 16) {
+            cur = vreinterpretq_u16_u8(vld1q_u8(in));
+            in += 16;
+            v = vorrq_u16(v, vshlq_u16(cur, vdupq_n_s16((int16_t)(16 - shift))));
+            shift = shift + w - 16;
+        } else {
+            shift += w;
+            if (shift == 16 && j < DELTA_LANE_VALUES - 1) {
+                cur = vreinterpretq_u16_u8(vld1q_u8(in));
+                in += 16;
+                shift = 0;
+            }
+        }
+        vst1q_u16(r + j * DELTA_GROUP_LANES, vandq_u16(v, mask));
+    }
+#else
+    const uint32_t mask = (1u << w) - 1;
+    for (int l = 0; l < DELTA_GROUP_LANES; l++) {
+        uint32_t acc = 0;
+        unsigned bits = 0, k = 0;
+        for (int j = 0; j < DELTA_LANE_VALUES; j++) {
+            if (bits < w) {
+                uint16_t word;
+                memcpy(&word, in + (k++ * DELTA_GROUP_LANES + l) * 2, sizeof(word));
+                acc |= (uint32_t)word << bits;
+                bits += 16;
+            }
+            r[j * DELTA_GROUP_LANES + l] = (uint16_t)(acc & mask);
+            acc >>= w;
+            bits -= w;
+        }
+    }
+    in += 2 * w * DELTA_GROUP_LANES;
+#endif
+    return in;
+}
+
+#define DELTA_WIDTH_CASES(X) \
+    X(1) X(2) X(3) X(4) X(5) X(6) X(7) X(8) X(9) X(10) X(11) X(12) X(13) X(14) X(15)
+
+static uint8_t *pack_group(const uint16_t *r, unsigned w, uint8_t *out)
+{
+    switch (w) {
+#define PACK_CASE(W) case W: return pack_bits(r, W, out);
+    DELTA_WIDTH_CASES(PACK_CASE)
+#undef PACK_CASE
+    case 16:
+        memcpy(out, r, DELTA_GROUP_SAMPLES * 2);
+        return out + DELTA_GROUP_SAMPLES * 2;
+    default:
+        return out;
+    }
+}
+
+static const uint8_t *unpack_group(const uint8_t *in, unsigned w, uint16_t *r)
+{
+    switch (w) {
+#define UNPACK_CASE(W) case W: return unpack_bits(in, W, r);
+    DELTA_WIDTH_CASES(UNPACK_CASE)
+#undef UNPACK_CASE
+    case 16:
+        memcpy(r, in, DELTA_GROUP_SAMPLES * 2);
+        return in + DELTA_GROUP_SAMPLES * 2;
+    default:
+        memset(r, 0, DELTA_GROUP_SAMPLES * 2);
+        return in;
+    }
+}
+
+/*-----------------------------------------------------------------------------
+ * Reconstruction
+ *-----------------------------------------------------------------------------*/
+
+static void zigzag_decode(uint16_t *v, size_t n)
+{
+    size_t i = 0;
+#if defined(DELTA_CODEC_HAVE_SSE2)
+    const __m128i one = _mm_set1_epi16(1);
+    for (; i + 8 <= n; i += 8) {
+        __m128i z = _mm_loadu_si128((const __m128i *)(v + i));
+        __m128i s = _mm_sub_epi16(_mm_setzero_si128(), _mm_and_si128(z, one));
+        _mm_storeu_si128((__m128i *)(v + i), _mm_xor_si128(_mm_srli_epi16(z, 1), s));
+    }
+#elif defined(DELTA_CODEC_HAVE_NEON)
+    const uint16x8_t one = vdupq_n_u16(1);
+    for (; i + 8 <= n; i += 8) {
+        uint16x8_t z = vld1q_u16(v + i);
+        uint16x8_t s = vreinterpretq_u16_s16(vnegq_s16(vreinterpretq_s16_u16(vandq_u16(z, one))));
+        vst1q_u16(v + i, veorq_u16(vshrq_n_u16(z, 1), s));
+    }
+#endif
+    for (; i < n; i++) v[i] = unzigzag(v[i]);
+}
+
+/* Running sum in place, starting from carry */
+static void integrate(uint16_t *v, size_t n, uint16_t carry)
+{
+    size_t i = 0;
+#if defined(DELTA_CODEC_HAVE_SSE2)
+    __m128i c = _mm_set1_epi16((short)carry);
+    for (; i + 8 <= n; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(v + i));
+        x = _mm_add_epi16(x, _mm_slli_si128(x, 2));
+        x = _mm_add_epi16(x, _mm_slli_si128(x, 4));
+        x = _mm_add_epi16(x, _mm_slli_si128(x, 8));
+        x = _mm_add_epi16(x, c);
+        _mm_storeu_si128((__m128i *)(v + i), x);
+        c = _mm_shufflehi_epi16(x, 0xff);
+        c = _mm_unpackhi_epi64(c, c);
+    }
+    carry = (uint16_t)_mm_extract_epi16(c, 0);
+#elif defined(DELTA_CODEC_HAVE_NEON)
+    const uint16x8_t zero = vdupq_n_u16(0);
+    uint16x8_t c = vdupq_n_u16(carry);
+    for (; i + 8 <= n; i += 8) {
+        uint16x8_t x = vld1q_u16(v + i);
+        x = vaddq_u16(x, vextq_u16(zero, x, 7));
+        x = vaddq_u16(x, vextq_u16(zero, x, 6));
+        x = vaddq_u16(x, vextq_u16(zero, x, 4));
+        x = vaddq_u16(x, c);
+        vst1q_u16(v + i, x);
+        c = vdupq_laneq_u16(x, 7);
+    }
+    carry = vgetq_lane_u16(c, 0);
+#endif
+    for (; i < n; i++) {
+        carry = (uint16_t)(carry + v[i]);
+        v[i] = carry;
+    }
+}
+
+static void shift_up(uint16_t *v, size_t n, unsigned shift)
+{
+    if (shift == 0) return;
+    for (size_t i = 0; i < n; i++) v[i] = (uint16_t)(v[i] << shift);
+}
+
+/*-----------------------------------------------------------------------------
+ * Blocks
+ *-----------------------------------------------------------------------------*/
+
+size_t delta_encode_block(const int16_t *in, size_t n, uint8_t *out)
+{
+    int16_t ybuf[DELTA_BLOCK_SAMPLES + 2];
+    uint16_t r[DELTA_BLOCK_SAMPLES];
+    uint8_t widths[3][DELTA_BLOCK_GROUPS];
+    int16_t *y = ybuf + 2;
+    delta_block_t h;
+    size_t groups, cost[3] = {0, 0, 0};
+    unsigned shift = 0, order = 0;
+    uint16_t all;
+    uint8_t *p;
+
+    if (n == 0 || n > DELTA_BLOCK_SAMPLES) return 0;
+    groups = (n + DELTA_GROUP_SAMPLES - 1) / DELTA_GROUP_SAMPLES;
+
+    all = block_or(in, n);
+    if (all != 0) shift = low_zero_bits(all);
+    if (shift == 0) {
+        memcpy(y, in, n * sizeof(int16_t));
+    } else {
+        for (size_t i = 0; i < n; i++) y[i] = (int16_t)(in[i] >> shift);
+    }
+    /* The first sample is its own history, the tail repeats the last one */
+    y[-1] = y[-2] = y[0];
+    for (size_t i = n; i < groups * DELTA_GROUP_SAMPLES; i++) y[i] = y[n - 1];
+
+    analyse_groups(y, groups, widths);
+    for (int o = 0; o < 3; o++) {
+        for (size_t g = 0; g < groups; g++) cost[o] += widths[o][g];
+    }
+    if (cost[1] < cost[order]) order = 1;
+    if (cost[2] < cost[order]) order = 2;
+
+    residuals(y, n, order, r);
+    memset(r + n, 0, (groups * DELTA_GROUP_SAMPLES - n) * sizeof(uint16_t));
+
+    p = out + sizeof(h);
+    memcpy(p, widths[order], groups);
+    p += groups;
+    for (size_t g = 0; g < groups; g++) {
+        p = pack_group(r + g * DELTA_GROUP_SAMPLES, widths[order][g], p);
+    }
+
+    h.sync = DELTA_BLOCK_SYNC;
+    h.samples = (uint16_t)n;
+    h.payload = (uint16_t)(p - out - sizeof(h));
+    h.order = (uint8_t)order;
+    h.shift = (uint8_t)shift;
+    h.first = y[0];
+    memcpy(out, &h, sizeof(h));
+    return (size_t)(p - out);
+}
+
+int delta_decode_block(const uint8_t *in, size_t len, int16_t *out, size_t *samples)
+{
+    delta_block_t h;
+    const uint8_t *widths, *p;
+    uint16_t *v = (uint16_t *)out;
+    size_t groups, payload;
+
+    if (len < sizeof(h)) return 0;
+    memcpy(&h, in, sizeof(h));
+    if (h.sync != DELTA_BLOCK_SYNC || h.samples == 0 || h.samples > DELTA_BLOCK_SAMPLES
+        || h.order > 2 || h.shift > 15) {
+        return -1;
+    }
+    groups = (h.samples + DELTA_GROUP_SAMPLES - 1) / DELTA_GROUP_SAMPLES;
+    if (h.payload < groups) return -1;
+    if (len < sizeof(h) + h.payload) return 0;
+
+    widths = in + sizeof(h);
+    payload = groups;
+    for (size_t g = 0; g < groups; g++) {
+        if (widths[g] > 16) return -1;
+        payload += 2u * DELTA_GROUP_LANES * widths[g];
+    }
+    if (payload != h.payload) return -1;
+
+    p = widths + groups;
+    for (size_t g = 0; g < groups; g++) {
+        p = unpack_group(p, widths[g], v + g * DELTA_GROUP_SAMPLES);
+    }
+    zigzag_decode(v, h.samples);
+    if (h.order == 2) integrate(v, h.samples, 0);
+    if (h.order >= 1) integrate(v, h.samples, (uint16_t)h.first);
+    shift_up(v, h.samples, h.shift);
+
+    *samples = h.samples;
+    return (int)(sizeof(h) + h.payload);
+}
+
+/*-----------------------------------------------------------------------------
+ * Writing
+ *-----------------------------------------------------------------------------*/
+
+static void writer_put(delta_writer_t *w, const void *data, size_t len)
+{
+    if (fwrite(data, 1, len, w->f) != len) w->failed = true;
+    w->bytes += len;
+}
+
+static void writer_block(delta_writer_t *w, const int16_t *samples, size_t n)
+{
+    size_t len;
+    if (w->blocks % DELTA_INDEX_INTERVAL == 0) {
+        if (w->index_n == w->index_cap) {
+            size_t cap = w->index_cap ? w->index_cap * 2 : 1024;
+            delta_index_entry_t *index = realloc(w->index, cap * sizeof(*index));
+            /* Without memory the index just stops, the stream is still complete */
+            if (index) {
+                w->index = index;
+                w->index_cap = cap;
+            }
+        }
+        if (w->index_n < w->index_cap) {
+            w->index[w->index_n].sample = w->samples;
+            w->index[w->index_n].offset = w->bytes;
+            w->index_n++;
+        }
+    }
+    len = delta_encode_block(samples, n, w->block);
+    writer_put(w, w->block, len);
+    w->samples += n;
+    w->blocks++;
+}
+
+delta_writer_t *delta_writer_create(FILE *f, uint32_t sample_rate)
+{
+    delta_header_t header;
+    delta_writer_t *w = calloc(1, sizeof(*w));
+    if (!w) return NULL;
+    w->f = f;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DELTA_CODEC_MAGIC, sizeof(header.magic));
+    header.version = DELTA_CODEC_VERSION;
+    header.header_size = sizeof(header);
+    header.sample_rate = sample_rate;
+    header.block_samples = DELTA_BLOCK_SAMPLES;
+    writer_put(w, &header, sizeof(header));
+    if (w->failed) {
+        fprintf(stderr, "Failed to write delta stream header\n");
+        free(w);
+        return NULL;
+    }
+    return w;
+}
+
+int delta_writer_process(delta_writer_t *w, const int16_t *samples, size_t n)
+{
+    if (w->pending_n > 0) {
+        size_t take = DELTA_BLOCK_SAMPLES - w->pending_n;
+        if (take > n) take = n;
+        memcpy(w->pending + w->pending_n, samples, take * sizeof(int16_t));
+        w->pending_n += take;
+        samples += take;
+        n -= take;
+        if (w->pending_n < DELTA_BLOCK_SAMPLES) return w->failed ? -1 : 0;
+        writer_block(w, w->pending, DELTA_BLOCK_SAMPLES);
+        w->pending_n = 0;
+    }
+    while (n >= DELTA_BLOCK_SAMPLES) {
+        writer_block(w, samples, DELTA_BLOCK_SAMPLES);
+        samples += DELTA_BLOCK_SAMPLES;
+        n -= DELTA_BLOCK_SAMPLES;
+    }
+    if (n > 0) {
+        memcpy(w->pending, samples, n * sizeof(int16_t));
+        w->pending_n = n;
+    }
+    return w->failed ? -1 : 0;
+}
+
+uint64_t delta_writer_get_bytes_written(const delta_writer_t *w)
+{
+    return w->bytes;
+}
+
+int delta_writer_finish(delta_writer_t *w)
+{
+    delta_index_t index;
+    delta_trailer_t trailer;
+    int r;
+    if (!w) return 0;
+    if (w->pending_n > 0) writer_block(w, w->pending, w->pending_n);
+
+    memset(&trailer, 0, sizeof(trailer));
+    trailer.index_offset = w->bytes;
+    memcpy(trailer.magic, DELTA_TRAILER_MAGIC, sizeof(trailer.magic));
+    memset(&index, 0, sizeof(index));
+    index.sync = DELTA_INDEX_SYNC;
+    index.entries = (uint32_t)w->index_n;
+    index.samples = w->samples;
+    writer_put(w, &index, sizeof(index));
+    if (w->index_n > 0) writer_put(w, w->index, w->index_n * sizeof(*w->index));
+    writer_put(w, &trailer, sizeof(trailer));
+    if (fflush(w->f) != 0) w->failed = true;
+
+    r = w->failed ? -1 : 0;
+    free(w->index);
+    free(w);
+    return r;
+}
+
+/*-----------------------------------------------------------------------------
+ * Reading
+ *-----------------------------------------------------------------------------*/
+
+/* Load the seek index through the trailer, the file is at the first block again afterwards */
+static void reader_load_index(delta_reader_t *r)
+{
+    delta_trailer_t trailer;
+    delta_index_t index;
+    delta_index_entry_t *entries = NULL;
+
+    if (r->f == stdin) return;
+#if defined(_WIN32) || defined(_WIN64)
+    if (_fseeki64(r->f, -(int64_t)sizeof(trailer), SEEK_END) != 0) return;
+#else
+    if (fseeko(r->f, -(off_t)sizeof(trailer), SEEK_END) != 0) return;
+#endif
+    if (fread(&trailer, sizeof(trailer), 1, r->f) == 1
+        && memcmp(trailer.magic, DELTA_TRAILER_MAGIC, sizeof(trailer.magic)) == 0
+        && delta_fseek(r->f, trailer.index_offset) == 0
+        && fread(&index, sizeof(index), 1, r->f) == 1 && index.sync == DELTA_INDEX_SYNC
+        && index.entries > 0 && (entries = malloc(index.entries * sizeof(*entries))) != NULL
+        && fread(entries, sizeof(*entries), index.entries, r->f) == index.entries) {
+        r->index = entries;
+        r->index_n = index.entries;
+        r->samples = index.samples;
+    } else {
+        free(entries);
+    }
+    delta_fseek(r->f, r->header_size);
+}
+
+/* Read and decode the next block */
+static bool reader_next_block(delta_reader_t *r)
+{
+    delta_block_t h;
+    size_t n;
+    int len;
+
+    r->block_n = r->block_pos = 0;
+    if (r->done) return false;
+    if (fread(&h, sizeof(h), 1, r->f) != 1) {
+        fprintf(stderr, "Delta stream has no index, ends at sample %llu\n", (unsigned long long)r->sample);
+        r->done = true;
+        return false;
+    }
+    if (h.sync == DELTA_INDEX_SYNC) {
+        r->done = true;
+        return false;
+    }
+    memcpy(r->coded, &h, sizeof(h));
+    if (h.sync != DELTA_BLOCK_SYNC || h.payload > DELTA_BLOCK_MAX_BYTES - sizeof(h)
+        || fread(r->coded + sizeof(h), 1, h.payload, r->f) != h.payload
+        || (len = delta_decode_block(r->coded, sizeof(h) + h.payload, r->block, &n)) <= 0) {
+        fprintf(stderr, "Delta stream has a broken block at sample %llu, stopping\n",
+                (unsigned long long)r->sample);
+        r->done = true;
+        return false;
+    }
+    r->block_n = n;
+    return true;
+}
+
+delta_reader_t *delta_reader_open(FILE *f, delta_header_t *header)
+{
+    delta_header_t h;
+    delta_reader_t *r;
+    if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, DELTA_CODEC_MAGIC, sizeof(h.magic)) != 0
+        || h.version != DELTA_CODEC_VERSION || h.header_size < sizeof(h)) {
+        fprintf(stderr, "Not a delta coded stream\n");
+        if (f != stdin) fclose(f);
+        return NULL;
+    }
+    /* Later header fields are skipped, the input may be a pipe */
+    for (uint32_t i = sizeof(h); i < h.header_size; i++) {
+        if (fgetc(f) == EOF) {
+            if (f != stdin) fclose(f);
+            return NULL;
+        }
+    }
+    r = calloc(1, sizeof(*r));
+    if (!r) {
+        if (f != stdin) fclose(f);
+        return NULL;
+    }
+    r->f = f;
+    r->header_size = h.header_size;
+    reader_load_index(r);
+    if (header) *header = h;
+    return r;
+}
+
+size_t delta_reader_read(delta_reader_t *r, int16_t *out, size_t n)
+{
+    size_t done = 0;
+    while (done < n) {
+        size_t run;
+        if (r->block_pos == r->block_n && !reader_next_block(r)) break;
+        run = r->block_n - r->block_pos;
+        if (run > n - done) run = n - done;
+        if (out) memcpy(out + done, r->block + r->block_pos, run * sizeof(int16_t));
+        r->block_pos += run;
+        r->sample += run;
+        done += run;
+    }
+    return done;
+}
+
+int delta_reader_seek(delta_reader_t *r, uint64_t sample)
+{
+    if (r->index) {
+        size_t lo = 0, hi = r->index_n;
+        if (sample > r->samples) return -1;
+        /* Last entry at or before the sample, then read through at most DELTA_INDEX_INTERVAL blocks */
+        while (hi - lo > 1) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (r->index[mid].sample <= sample) lo = mid;
+            else hi = mid;
+        }
+        if (r->index[lo].sample > r->sample || sample < r->sample) {
+            if (delta_fseek(r->f, r->index[lo].offset) != 0) return -1;
+            r->sample = r->index[lo].sample;
+            r->block_n = r->block_pos = 0;
+            r->done = false;
+        }
+    } else if (sample < r->sample) {
+        if (r->f == stdin || delta_fseek(r->f, r->header_size) != 0) return -1;
+        r->sample = 0;
+        r->block_n = r->block_pos = 0;
+        r->done = false;
+    }
+    while (r->sample < sample) {
+        uint64_t left = sample - r->sample;
+        if (delta_reader_read(r, NULL, left < DELTA_BLOCK_SAMPLES ? (size_t)left : DELTA_BLOCK_SAMPLES) == 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void delta_reader_close(delta_reader_t *r)
+{
+    if (!r) return;
+    if (r->f != stdin) fclose(r->f);
+    free(r->index);
+    free(r);
+}
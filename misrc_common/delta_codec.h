@@ -0,0 +1,175 @@
+/*
+ * MISRC Common - Delta Coded RF Stream
+ *
+ * A lossless format for the 16 bit RF samples that costs far less CPU than
+ * FLAC, for hosts running several devices. The samples are cut into blocks
+ * of DELTA_BLOCK_SAMPLES, each predicted with the order (0, 1 or 2) that
+ * packs smallest. The residuals are zigzag coded and bit packed in groups of
+ * DELTA_GROUP_SAMPLES, each group with the width of its largest residual.
+ * A group is packed as DELTA_GROUP_LANES interleaved lanes of 16 bit words,
+ * so SSE2 and NEON pack and unpack a word of every lane at once.
+ * Low bits that are zero in every sample of a block (the padding of -p) are
+ * shifted out first. All arithmetic wraps at 16 bit, any input round trips.
+ *
+ * Layout: a delta_header_t, the blocks, each a delta_block_t followed by
+ * one width byte per group and the packed groups, then a seek index of
+ * every DELTA_INDEX_INTERVAL-th block and a delta_trailer_t at the very end.
+ * A capture that was cut off has no index, it decodes up to the last
+ * complete block and seeks by reading through.
+ *
+ * Header, blocks and index are little endian.
+ */
+
+#ifndef MISRC_DELTA_CODEC_H
+#define MISRC_DELTA_CODEC_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define DELTA_CODEC_MAGIC       "MISRCDLT"
+#define DELTA_TRAILER_MAGIC     "MISRCDIX"
+#define DELTA_CODEC_VERSION     1
+#define DELTA_BLOCK_SYNC        0x4b4c4244u     /* "DBLK" */
+#define DELTA_INDEX_SYNC        0x58444944u     /* "DIDX" */
+
+#define DELTA_BLOCK_SAMPLES     4096
+#define DELTA_GROUP_SAMPLES     128
+#define DELTA_GROUP_LANES       8               /* Interleaved 16 bit lanes of a packed group */
+#define DELTA_BLOCK_GROUPS      (DELTA_BLOCK_SAMPLES / DELTA_GROUP_SAMPLES)
+#define DELTA_INDEX_INTERVAL    64              /* Blocks between index entries */
+
+/* Largest coded block: header, widths and all groups at 16 bit */
+#define DELTA_BLOCK_MAX_BYTES   (sizeof(delta_block_t) + DELTA_BLOCK_GROUPS + DELTA_BLOCK_SAMPLES * 2)
+
+typedef struct {
+    char magic[8];              /* DELTA_CODEC_MAGIC, not terminated */
+    uint32_t version;           /* DELTA_CODEC_VERSION */
+    uint32_t header_size;       /* sizeof(delta_header_t), blocks start here */
+    uint32_t sample_rate;       /* Samples per second */
+    uint32_t block_samples;     /* DELTA_BLOCK_SAMPLES, only the last block is shorter */
+    uint32_t reserved[2];
+} delta_header_t;
+
+typedef struct {
+    uint32_t sync;              /* DELTA_BLOCK_SYNC */
+    uint16_t samples;           /* 1 .. DELTA_BLOCK_SAMPLES */
+    uint16_t payload;           /* Bytes of widths and packed groups after this header */
+    uint8_t order;              /* Prediction order, 0 .. 2 */
+    uint8_t shift;              /* Low zero bits shifted out of every sample */
+    int16_t first;              /* First sample after the shift, also the history of the prediction */
+} delta_block_t;
+
+typedef struct {
+    uint32_t sync;              /* DELTA_INDEX_SYNC, ends the blocks */
+    uint32_t entries;           /* delta_index_entry_t following */
+    uint64_t samples;           /* Samples in the stream */
+} delta_index_t;
+
+typedef struct {
+    uint64_t sample;            /* First sample of the block */
+    uint64_t offset;            /* File offset of its delta_block_t */
+} delta_index_entry_t;
+
+typedef struct {
+    uint64_t index_offset;      /* File offset of the delta_index_t */
+    char magic[8];              /* DELTA_TRAILER_MAGIC, not terminated */
+} delta_trailer_t;
+
+typedef struct delta_writer delta_writer_t;
+typedef struct delta_reader delta_reader_t;
+
+/*-----------------------------------------------------------------------------
+ * Blocks
+ *-----------------------------------------------------------------------------*/
+
+/* Code one block
+ *
+ * @param in            Samples
+ * @param n             Number of samples, 1 .. DELTA_BLOCK_SAMPLES
+ * @param out           Receives the block, DELTA_BLOCK_MAX_BYTES
+ * @return Bytes of the block, 0 if n is out of range
+ *
+ * The residuals of all three orders are measured in one pass. SSE2 on
+ * x86_64, NEON on arm64, scalar elsewhere, all write the same bytes.
+ */
+size_t delta_encode_block(const int16_t *in, size_t n, uint8_t *out);
+
+/* Decode one block
+ *
+ * @param in            Coded block, starting at its delta_block_t
+ * @param len           Bytes available at in
+ * @param out           Receives the samples, DELTA_BLOCK_SAMPLES
+ * @param samples       Receives the number of samples
+ * @return Bytes of the block, 0 if len is too short, -1 if it is not a valid block
+ */
+int delta_decode_block(const uint8_t *in, size_t len, int16_t *out, size_t *samples);
+
+/*-----------------------------------------------------------------------------
+ * Writing
+ *-----------------------------------------------------------------------------*/
+
+/* Start a stream in an already opened file
+ *
+ * @param f             Output file, stays open, the caller closes it after delta_writer_finish()
+ * @param sample_rate   Samples per second
+ * @return Writer state, or NULL on failure
+ */
+delta_writer_t *delta_writer_create(FILE *f, uint32_t sample_rate);
+
+/* Append samples, full blocks are written right away
+ *
+ * @param w             Writer state
+ * @param samples       Samples
+ * @param n             Number of samples
+ * @return 0 on success, -1 if writing failed
+ */
+int delta_writer_process(delta_writer_t *w, const int16_t *samples, size_t n);
+
+/* Bytes written to the file so far, for segment sizes */
+uint64_t delta_writer_get_bytes_written(const delta_writer_t *w);
+
+/* Write the last partial block and the seek index
+ *
+ * @param w             Writer state, freed (NULL is ignored)
+ * @return 0 on success, -1 if any write failed
+ */
+int delta_writer_finish(delta_writer_t *w);
+
+/*-----------------------------------------------------------------------------
+ * Reading
+ *-----------------------------------------------------------------------------*/
+
+/* Start decoding a stream, the seek index is loaded if the file is seekable
+ *
+ * @param f             Input file, owned by the reader afterwards
+ * @param header        Receives the header, may be NULL
+ * @return Reader state, or NULL if f is not a delta stream (f is closed
+ *         unless it is stdin)
+ */
+delta_reader_t *delta_reader_open(FILE *f, delta_header_t *header);
+
+/* Decode the next samples
+ *
+ * @param r             Reader state
+ * @param out           Receives the samples, NULL to skip them
+ * @param n             Number of samples wanted
+ * @return Number of samples, less than n only at the end of the stream
+ */
+size_t delta_reader_read(delta_reader_t *r, int16_t *out, size_t n);
+
+/* Continue at a sample, through the seek index or by reading through
+ *
+ * @param r             Reader state
+ * @param sample        Sample to continue at, at most the end of the stream
+ * @return 0 on success, -1 if the stream ends before the sample
+ */
+int delta_reader_seek(delta_reader_t *r, uint64_t sample);
+
+/* Close the file (unless it is stdin) and free the reader
+ *
+ * @param r             Reader state, NULL is ignored
+ */
+void delta_reader_close(delta_reader_t *r);
+
+#endif /* MISRC_DELTA_CODEC_H */
@@ -0,0 +1,149 @@
+/*
+ * MISRC Common - Edge Search Implementation
+ */
+
+#include "edge_search.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #include <emmintrin.h>
+    #define EDGE_HAVE_SSE2 1
+#elif defined(__aarch64__) || defined(__arm64__)
+    #include <arm_neon.h>
+    #define EDGE_HAVE_NEON 1
+#endif
+
+/*-----------------------------------------------------------------------------
+ * Search Kernels
+ *-----------------------------------------------------------------------------*/
+
+/* Index of the lowest set bit (x != 0) */
+static inline unsigned first_set_bit(uint64_t x)
+{
+#if defined(__GNUC__)
+    return (unsigned)__builtin_ctzll(x);
+#else
+    unsigned n = 0;
+    while (!(x & 1)) { x >>= 1; n++; }
+    return n;
+#endif
+}
+
+/* First i in [start, end) with buf[i - 1] < level <= buf[i], or end (start >= 1) */
+static size_t scan_rising(const int16_t *buf, size_t start, size_t end, int16_t level)
+{
+    size_t i = start;
+#if defined(EDGE_HAVE_SSE2)
+    const __m128i lv = _mm_set1_epi16(level);
+    for (; i + 8 <= end; i += 8) {
+        __m128i prev = _mm_loadu_si128((const __m128i *)(buf + i - 1));
+        __m128i curr = _mm_loadu_si128((const __m128i *)(buf + i));
+        __m128i hit = _mm_andnot_si128(_mm_cmplt_epi16(curr, lv), _mm_cmplt_epi16(prev, lv));
+        unsigned mask = (unsigned)_mm_movemask_epi8(hit);
+        if (mask) return i + first_set_bit(mask) / 2;
+    }
+#elif defined(EDGE_HAVE_NEON)
+    const int16x8_t lv = vdupq_n_s16(level);
+    for (; i + 8 <= end; i += 8) {
+        uint16x8_t hit = vandq_u16(vcltq_s16(vld1q_s16(buf + i - 1), lv),
+                                   vcgeq_s16(vld1q_s16(buf + i), lv));
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vmovn_u16(hit)), 0);
+        if (mask) return i + first_set_bit(mask) / 8;
+    }
+#endif
+    for (; i < end; i++) {
+        if (buf[i - 1] < level && buf[i] >= level) return i;
+    }
+    return end;
+}
+
+/* First i in [start, end) with buf[i - 1] > level >= buf[i], or end (start >= 1) */
+static size_t scan_falling(const int16_t *buf, size_t start, size_t end, int16_t level)
+{
+    size_t i = start;
+#if defined(EDGE_HAVE_SSE2)
+    const __m128i lv = _mm_set1_epi16(level);
+    for (; i + 8 <= end; i += 8) {
+        __m128i prev = _mm_loadu_si128((const __m128i *)(buf + i - 1));
+        __m128i curr = _mm_loadu_si128((const __m128i *)(buf + i));
+        __m128i hit = _mm_andnot_si128(_mm_cmpgt_epi16(curr, lv), _mm_cmpgt_epi16(prev, lv));
+        unsigned mask = (unsigned)_mm_movemask_epi8(hit);
+        if (mask) return i + first_set_bit(mask) / 2;
+    }
+#elif defined(EDGE_HAVE_NEON)
+    const int16x8_t lv = vdupq_n_s16(level);
+    for (; i + 8 <= end; i += 8) {
+        uint16x8_t hit = vandq_u16(vcgtq_s16(vld1q_s16(buf + i - 1), lv),
+                                   vcleq_s16(vld1q_s16(buf + i), lv));
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vmovn_u16(hit)), 0);
+        if (mask) return i + first_set_bit(mask) / 8;
+    }
+#endif
+    for (; i < end; i++) {
+        if (buf[i - 1] > level && buf[i] <= level) return i;
+    }
+    return end;
+}
+
+/* First i in [start, end) with buf[i] > level, or end */
+static size_t scan_above(const int16_t *buf, size_t start, size_t end, int16_t level)
+{
+    size_t i = start;
+#if defined(EDGE_HAVE_SSE2)
+    const __m128i lv = _mm_set1_epi16(level);
+    for (; i + 8 <= end; i += 8) {
+        __m128i curr = _mm_loadu_si128((const __m128i *)(buf + i));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpgt_epi16(curr, lv));
+        if (mask) return i + first_set_bit(mask) / 2;
+    }
+#elif defined(EDGE_HAVE_NEON)
+    const int16x8_t lv = vdupq_n_s16(level);
+    for (; i + 8 <= end; i += 8) {
+        uint16x8_t hit = vcgtq_s16(vld1q_s16(buf + i), lv);
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vmovn_u16(hit)), 0);
+        if (mask) return i + first_set_bit(mask) / 8;
+    }
+#endif
+    for (; i < end; i++) {
+        if (buf[i] > level) return i;
+    }
+    return end;
+}
+
+/*-----------------------------------------------------------------------------
+ * Public API
+ *-----------------------------------------------------------------------------*/
+
+ssize_t trigger_find_above(const int16_t *buf, size_t count,
+                           int16_t level, size_t min_index)
+{
+    if (!buf || min_index >= count) return -1;
+
+    size_t i = scan_above(buf, min_index, count, level);
+    return (i < count) ? (ssize_t)i : -1;
+}
+
+ssize_t trigger_find_rising_edge(const int16_t *buf, size_t count,
+                                 int16_t level, size_t min_index)
+{
+    if (!buf || count < 2) return -1;
+
+    size_t start = (min_index > 1) ? min_index : 1;
+    if (start >= count) return -1;
+
+    /* Cross from below to at or above level */
+    size_t i = scan_rising(buf, start, count, level);
+    return (i < count) ? (ssize_t)i : -1;
+}
+
+ssize_t trigger_find_falling_edge(const int16_t *buf, size_t count,
+                                  int16_t level, size_t min_index)
+{
+    if (!buf || count < 2) return -1;
+
+    size_t start = (min_index > 1) ? min_index : 1;
+    if (start >= count) return -1;
+
+    /* Cross from above to at or below level */
+    size_t i = scan_falling(buf, start, count, level);
+    return (i < count) ? (ssize_t)i : -1;
+}
@@ -0,0 +1,50 @@
+/*
+ * MISRC Common - Edge Search
+ *
+ * Finds where 16 bit samples cross a level, for the oscilloscope trigger
+ * of the GUI and the triggered recording of misrc_capture. The search
+ * compares 8 samples at a time (SSE2 on x86_64, NEON on AArch64) and turns
+ * the comparison mask into the index of the first match.
+ */
+
+#ifndef MISRC_EDGE_SEARCH_H
+#define MISRC_EDGE_SEARCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Find a rising edge, buf[i - 1] < level <= buf[i]
+ *
+ * @param buf           Samples
+ * @param count         Number of samples
+ * @param level         Level to cross
+ * @param min_index     First index to look at (at least 1)
+ * @return Index of the crossing, or -1 if there is none
+ */
+ssize_t trigger_find_rising_edge(const int16_t *buf, size_t count,
+                                 int16_t level, size_t min_index);
+
+/* Find a falling edge, buf[i - 1] > level >= buf[i]
+ *
+ * @param buf           Samples
+ * @param count         Number of samples
+ * @param level         Level to cross
+ * @param min_index     First index to look at (at least 1)
+ * @return Index of the crossing, or -1 if there is none
+ */
+ssize_t trigger_find_falling_edge(const int16_t *buf, size_t count,
+                                  int16_t level, size_t min_index);
+
+/* Find the first sample above a level, e.g. the end of a run at or below it
+ *
+ * @param buf           Samples
+ * @param count         Number of samples
+ * @param level         Level to exceed
+ * @param min_index     First index to look at
+ * @return Index of the sample, or -1 if there is none
+ */
+ssize_t trigger_find_above(const int16_t *buf, size_t count,
+                           int16_t level, size_t min_index);
+
+#endif /* MISRC_EDGE_SEARCH_H */
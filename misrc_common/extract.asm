@@ -57,6 +57,19 @@ default rel
 	%define to32_len  rdx
 %endif
 
+%if WIN
+	%define au_in    rcx
+	%define au_len   rdx
+	%define au_out2  r8
+	%define au_out1  r9
+%else
+	%define au_in    rdi
+	%define au_len   rsi
+	%define au_out2  rdx
+	%define au_out1  rcx
+%endif
+%define au_off r10
+
 %macro STARTP 0
 	%if WIN
 		mov outA, [rsp+40]
@@ -125,6 +138,47 @@ section .data
 	clip_maskA: db	 1,	1,	1,	1,	1,	1,	1,	1
 	clip_maskB: db	 2,	2,	2,	2,	2,	2,	2,	2
 
+	ALIGN 16
+	shuf_a2ch12_l0: db  0, 1, 2, 3, 4, 5, 12, 13, 14, 15, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80
+	shuf_a2ch12_l1: db  0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0, 1, 8, 9, 10, 11
+	shuf_a2ch12_h1: db  12, 13, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80
+	shuf_a2ch12_h2: db  0x80, 0x80, 4, 5, 6, 7, 8, 9, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80
+	shuf_a2ch34_l0: db  6, 7, 8, 9, 10, 11, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80
+	shuf_a2ch34_l1: db  0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 2, 3, 4, 5, 6, 7, 14, 15, 0x80, 0x80
+	shuf_a2ch34_l2: db  0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0, 1
+	shuf_a2ch34_h2: db  2, 3, 10, 11, 12, 13, 14, 15, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80
+	shuf_a1ch0_l0:  db  0, 1, 2, 12, 13, 14, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80
+	shuf_a1ch0_l1:  db  0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 8, 9, 10, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80
+	shuf_a1ch0_l2:  db  0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 4, 5, 6, 0x80, 0x80, 0x80, 0x80
+	shuf_a1ch1_l0:  db  3, 4, 5, 15, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80
+	shuf_a1ch1_l1:  db  0x80, 0x80, 0x80, 0x80, 0, 1, 11, 12, 13, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80
+	shuf_a1ch1_l2:  db  0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 7, 8, 9, 0x80, 0x80, 0x80, 0x80
+	shuf_a1ch2_l0:  db  6, 7, 8, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80
+	shuf_a1ch2_l1:  db  0x80, 0x80, 0x80, 2, 3, 4, 14, 15, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80
+	shuf_a1ch2_l2:  db  0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0, 10, 11, 12, 0x80, 0x80, 0x80, 0x80
+	shuf_a1ch3_l0:  db  9, 10, 11, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80
+	shuf_a1ch3_l1:  db  0x80, 0x80, 0x80, 5, 6, 7, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80
+	shuf_a1ch3_l2:  db  0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 1, 2, 3, 13, 14, 15, 0x80, 0x80, 0x80, 0x80
+
+	ALIGN 16
+	shuf_p12_0:  db  0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 0x80, 0x80, 0x80, 0x80
+	shuf_p12_1l: db  0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0, 1, 2, 4
+	shuf_p12_1h: db  5, 6, 8, 9, 10, 12, 13, 14, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80
+	shuf_u12:    db  0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11
+	pmadd_p12:   dw  1, 4096, 1, 4096, 1, 4096, 1, 4096
+	pmull_u12:   dw  16, 1, 16, 1, 16, 1, 16, 1
+	ones16:      times 8 dw 1
+
+	ALIGN 32
+	shuf_aux0_y:  db	 0,	4,	8,   12, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80
+	              db	 0,	4,	8,   12, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80
+	andmask_y:    times 16 dw 0x0fff
+	andmask32_y:  times 8 dd 0x00000fff
+	auxmask32_y:  times 8 dd 0x000000ff
+	subval_y:     times 16 dw 2047
+	subval32_y:   times 8 dd 2047
+	ones16_y:     times 16 dw 1
+
 section .text
 
 
@@ -652,6 +706,364 @@ loop_S_p_0:
 
 
 
+; AVX2 versions of the above, 16 samples (8 for 32 bit output) per iteration
+; CHA / CHB select which of the two outputs is written
+
+%macro CLIPCNT_AVX 3
+	vmovq rax, xmm2
+	and rax, [%2]
+	popcnt rax, rax
+	add [clip+%1], rax
+%if %3 > 1
+	vpextrq rax, xmm2, 1
+	and rax, [%2]
+	popcnt rax, rax
+	add [clip+%1], rax
+%endif
+%endmacro
+
+%macro PEAKFOLD_AVX 2
+	vextracti128 xmm0, ymm7, 1
+	%1 xmm7, xmm7, xmm0
+	vextracti128 xmm0, ymm8, 1
+	%1 xmm8, xmm8, xmm0
+	vzeroupper
+%if CHA
+	%2 rax, xmm7
+	mov [level], ax
+%endif
+%if CHB
+	%2 rax, xmm8
+	mov [level+2], ax
+%endif
+%endmacro
+
+%macro EXTRACT_AVX 0
+%if PEAK
+	STARTP
+	vpxor xmm7, xmm7, xmm7
+	vpxor xmm8, xmm8, xmm8
+%else
+	START
+%endif
+	vmovdqu ymm5, [subval_y]
+%%loop_avx:
+	vmovdqu ymm0, [in]
+	vmovdqu ymm1, [in+32]
+%if CHA
+	vpand ymm2, ymm0, [andmask32_y]
+	vpand ymm3, ymm1, [andmask32_y]
+	vpackusdw ymm2, ymm2, ymm3
+	vpermq ymm2, ymm2, 0xd8
+	vpsubw ymm4, ymm5, ymm2
+%if PEAK
+	vpabsw ymm6, ymm4
+	vpmaxuw ymm7, ymm7, ymm6
+%endif
+%if PAD
+	vpsllw ymm4, ymm4, 4
+%endif
+	vmovdqu [outA], ymm4
+	add outA, 32
+%endif
+%if CHB
+	vpsrld ymm2, ymm0, 20
+	vpsrld ymm3, ymm1, 20
+	vpackusdw ymm2, ymm2, ymm3
+	vpermq ymm2, ymm2, 0xd8
+	vpsubw ymm4, ymm5, ymm2
+%if PEAK
+	vpabsw ymm6, ymm4
+	vpmaxuw ymm8, ymm8, ymm6
+%endif
+%if PAD
+	vpsllw ymm4, ymm4, 4
+%endif
+	vmovdqu [outB], ymm4
+	add outB, 32
+%endif
+	vpsrld ymm2, ymm0, 12
+	vpsrld ymm3, ymm1, 12
+	vpand ymm2, ymm2, [auxmask32_y]
+	vpand ymm3, ymm3, [auxmask32_y]
+	vpackusdw ymm2, ymm2, ymm3
+	vpermq ymm2, ymm2, 0xd8
+	vextracti128 xmm3, ymm2, 1
+	vpackuswb xmm2, xmm2, xmm3
+	vmovdqu [aux], xmm2
+%if CHA
+	CLIPCNT_AVX 0, clip_maskA, 2
+%endif
+%if CHB
+	CLIPCNT_AVX 8, clip_maskB, 2
+%endif
+	add aux, 16
+	add in, 64
+	sub len, 16
+	jg %%loop_avx
+%if PEAK
+	PEAKFOLD_AVX vpmaxuw, PEAKCALC16
+	ENDP
+%else
+	vzeroupper
+%endif
+	ret
+%endmacro
+
+%macro EXTRACT_32_AVX 0
+%if PEAK
+	STARTP
+	vpxor xmm7, xmm7, xmm7
+	vpxor xmm8, xmm8, xmm8
+%else
+	START
+%endif
+	vmovdqu ymm5, [subval32_y]
+%%loop_32_avx:
+	vmovdqu ymm0, [in]
+%if CHA
+	vpand ymm2, ymm0, [andmask32_y]
+	vpsubd ymm4, ymm5, ymm2
+%if PEAK
+	vpabsd ymm6, ymm4
+	vpmaxud ymm7, ymm7, ymm6
+%endif
+%if PAD
+	vpslld ymm4, ymm4, 4
+%endif
+	vmovdqu [outA], ymm4
+	add outA, 32
+%endif
+%if CHB
+	vpsrld ymm2, ymm0, 20
+	vpsubd ymm4, ymm5, ymm2
+%if PEAK
+	vpabsd ymm6, ymm4
+	vpmaxud ymm8, ymm8, ymm6
+%endif
+%if PAD
+	vpslld ymm4, ymm4, 4
+%endif
+	vmovdqu [outB], ymm4
+	add outB, 32
+%endif
+	vpsrld ymm2, ymm0, 12
+	vpshufb ymm2, ymm2, [shuf_aux0_y]
+	vextracti128 xmm3, ymm2, 1
+	vpunpckldq xmm2, xmm2, xmm3
+	vmovq [aux], xmm2
+%if CHA
+	CLIPCNT_AVX 0, clip_maskA, 1
+%endif
+%if CHB
+	CLIPCNT_AVX 8, clip_maskB, 1
+%endif
+	add aux, 8
+	add in, 32
+	sub len, 8
+	jg %%loop_32_avx
+%if PEAK
+	PEAKFOLD_AVX vpmaxud, PEAKCALC32
+	ENDP
+%else
+	vzeroupper
+%endif
+	ret
+%endmacro
+
+%macro EXTRACT_S_AVX 0
+	START
+	vmovdqu ymm5, [subval_y]
+%%loop_S_avx:
+	vmovdqu ymm0, [in]
+	vpand ymm2, ymm0, [andmask_y]
+	vpsubw ymm4, ymm5, ymm2
+%if PAD
+	vpsllw ymm4, ymm4, 4
+%endif
+	vmovdqu [outA], ymm4
+	vpsrlw ymm2, ymm0, 12
+	vextracti128 xmm3, ymm2, 1
+	vpackuswb xmm2, xmm2, xmm3
+	vmovdqu [aux], xmm2
+	CLIPCNT_AVX 0, clip_maskA, 2
+	add aux, 16
+	add outA, 32
+	add in, 32
+	sub len, 16
+	jg %%loop_S_avx
+	vzeroupper
+	ret
+%endmacro
+
+%define CHA 1
+%define CHB 1
+
+%define PAD 0
+%define PEAK 1
+global extract_AB_peak_avx
+extract_AB_peak_avx:
+	EXTRACT_AVX
+
+%define PEAK 0
+global extract_AB_avx
+extract_AB_avx:
+	EXTRACT_AVX
+
+%define PAD 1
+%define PEAK 1
+global extract_AB_p_peak_avx
+extract_AB_p_peak_avx:
+	EXTRACT_AVX
+
+%define PEAK 0
+global extract_AB_p_avx
+extract_AB_p_avx:
+	EXTRACT_AVX
+
+
+%define CHA 1
+%define CHB 0
+
+%define PAD 0
+%define PEAK 1
+global extract_A_peak_avx
+extract_A_peak_avx:
+	EXTRACT_AVX
+
+%define PEAK 0
+global extract_A_avx
+extract_A_avx:
+	EXTRACT_AVX
+
+%define PAD 1
+%define PEAK 1
+global extract_A_p_peak_avx
+extract_A_p_peak_avx:
+	EXTRACT_AVX
+
+%define PEAK 0
+global extract_A_p_avx
+extract_A_p_avx:
+	EXTRACT_AVX
+
+
+%define CHA 0
+%define CHB 1
+
+%define PAD 0
+%define PEAK 1
+global extract_B_peak_avx
+extract_B_peak_avx:
+	EXTRACT_AVX
+
+%define PEAK 0
+global extract_B_avx
+extract_B_avx:
+	EXTRACT_AVX
+
+%define PAD 1
+%define PEAK 1
+global extract_B_p_peak_avx
+extract_B_p_peak_avx:
+	EXTRACT_AVX
+
+%define PEAK 0
+global extract_B_p_avx
+extract_B_p_avx:
+	EXTRACT_AVX
+
+
+%define CHA 1
+%define CHB 1
+
+%define PAD 0
+%define PEAK 1
+global extract_AB_peak_32_avx
+extract_AB_peak_32_avx:
+	EXTRACT_32_AVX
+
+%define PEAK 0
+global extract_AB_32_avx
+extract_AB_32_avx:
+	EXTRACT_32_AVX
+
+%define PAD 1
+%define PEAK 1
+global extract_AB_p_peak_32_avx
+extract_AB_p_peak_32_avx:
+	EXTRACT_32_AVX
+
+%define PEAK 0
+global extract_AB_p_32_avx
+extract_AB_p_32_avx:
+	EXTRACT_32_AVX
+
+
+%define CHA 1
+%define CHB 0
+
+%define PAD 0
+%define PEAK 1
+global extract_A_peak_32_avx
+extract_A_peak_32_avx:
+	EXTRACT_32_AVX
+
+%define PEAK 0
+global extract_A_32_avx
+extract_A_32_avx:
+	EXTRACT_32_AVX
+
+%define PAD 1
+%define PEAK 1
+global extract_A_p_peak_32_avx
+extract_A_p_peak_32_avx:
+	EXTRACT_32_AVX
+
+%define PEAK 0
+global extract_A_p_32_avx
+extract_A_p_32_avx:
+	EXTRACT_32_AVX
+
+
+%define CHA 0
+%define CHB 1
+
+%define PAD 0
+%define PEAK 1
+global extract_B_peak_32_avx
+extract_B_peak_32_avx:
+	EXTRACT_32_AVX
+
+%define PEAK 0
+global extract_B_32_avx
+extract_B_32_avx:
+	EXTRACT_32_AVX
+
+%define PAD 1
+%define PEAK 1
+global extract_B_p_peak_32_avx
+extract_B_p_peak_32_avx:
+	EXTRACT_32_AVX
+
+%define PEAK 0
+global extract_B_p_32_avx
+extract_B_p_32_avx:
+	EXTRACT_32_AVX
+
+
+%define PAD 0
+global extract_S_avx
+extract_S_avx:
+	EXTRACT_S_AVX
+
+%define PAD 1
+global extract_S_p_avx
+extract_S_p_avx:
+	EXTRACT_S_AVX
+
+
+
 ; SSE4.1
 global convert_16to32_sse
 convert_16to32_sse:
@@ -723,6 +1135,227 @@ convert_16to8to32_sse:
 	jg convert_16to8to32_sse
 	ret
 
+; SSSE3 12 bit packing, 16 samples (24 bytes) per iteration, len must be a multiple of 16
+global convert_16to12p_ssse3
+convert_16to12p_ssse3:
+	movdqa xmm4, [andmask]
+	movdqa xmm5, [pmadd_p12]
+pack12_loop:
+	movdqu xmm0, [to32_in]
+	movdqu xmm1, [to32_in+16]
+	pand xmm0, xmm4
+	pand xmm1, xmm4
+	pmaddwd xmm0, xmm5 ; s0 | s1 << 12 in each dword
+	pmaddwd xmm1, xmm5
+	pshufb xmm0, [shuf_p12_0]
+	movdqa xmm2, xmm1
+	pshufb xmm2, [shuf_p12_1l]
+	por xmm0, xmm2
+	pshufb xmm1, [shuf_p12_1h]
+	movdqu [to32_out], xmm0
+	movq [to32_out+16], xmm1
+	add to32_in, 32
+	add to32_out, 24
+	sub to32_len, 16
+	jg pack12_loop
+	ret
+
+; SSSE3 12 bit unpacking, 24 bytes (16 samples) per iteration, len must be a multiple of 16
+global convert_12pto16_ssse3
+convert_12pto16_ssse3:
+	movdqa xmm4, [shuf_u12]
+	movdqa xmm5, [pmull_u12]
+unpack12_loop:
+	movdqu xmm0, [to32_in]
+	movq xmm1, [to32_in+16]
+	palignr xmm1, xmm0, 12
+	pshufb xmm0, xmm4 ; every sample in a word of its own, even ones in the low 12 bits, odd ones in the high 12
+	pshufb xmm1, xmm4
+	pmullw xmm0, xmm5 ; move the even ones up as well
+	pmullw xmm1, xmm5
+	psraw xmm0, 4
+	psraw xmm1, 4
+	movdqu [to32_out], xmm0
+	movdqu [to32_out+16], xmm1
+	add to32_in, 24
+	add to32_out, 32
+	sub to32_len, 16
+	jg unpack12_loop
+	ret
+
+; float32 conversion, out = (in - offset) * scale, returns the sum of the input samples
+; offset and scale come in xmm0 and xmm1 (System V), xmm3 and on the stack (Windows)
+; the sum is kept in 32 bit lanes, len must be at most 65536
+%macro F32_ARGS 0
+	%if WIN
+		movaps xmm0, xmm3
+		movss xmm1, [rsp+40]
+	%endif
+%endmacro
+
+%macro F32_HSUM 0
+	pshufd xmm3, xmm4, 0b01001110
+	paddd xmm4, xmm3
+	pshufd xmm3, xmm4, 0b00000001
+	paddd xmm4, xmm3
+	movd eax, xmm4
+%endmacro
+
+; SSE4.1, 8 samples per iteration, len must be a multiple of 8
+global convert_16tof32_sse
+convert_16tof32_sse:
+	F32_ARGS
+	shufps xmm0, xmm0, 0
+	shufps xmm1, xmm1, 0
+	movdqa xmm5, [ones16]
+	pxor xmm4, xmm4
+f32_sse_loop:
+	movdqu xmm2, [to32_in]
+	pmovsxwd xmm3, xmm2
+	pmaddwd xmm2, xmm5 ; pairs of samples summed into the 32 bit lanes
+	paddd xmm4, xmm2
+	pmovsxwd xmm2, [to32_in+8]
+	cvtdq2ps xmm3, xmm3
+	cvtdq2ps xmm2, xmm2
+	subps xmm3, xmm0
+	subps xmm2, xmm0
+	mulps xmm3, xmm1
+	mulps xmm2, xmm1
+	movups [to32_out], xmm3
+	movups [to32_out+16], xmm2
+	add to32_in, 16
+	add to32_out, 32
+	sub to32_len, 8
+	jg f32_sse_loop
+	F32_HSUM
+	ret
+
+; AVX2, 16 samples per iteration, len must be a multiple of 16
+global convert_16tof32_avx
+convert_16tof32_avx:
+	F32_ARGS
+	vbroadcastss ymm0, xmm0
+	vbroadcastss ymm1, xmm1
+	vmovdqa ymm5, [ones16_y]
+	vpxor ymm4, ymm4, ymm4
+f32_avx_loop:
+	vpmaddwd ymm2, ymm5, [to32_in]
+	vpaddd ymm4, ymm4, ymm2
+	vpmovsxwd ymm3, [to32_in]
+	vpmovsxwd ymm2, [to32_in+16]
+	vcvtdq2ps ymm3, ymm3
+	vcvtdq2ps ymm2, ymm2
+	vsubps ymm3, ymm3, ymm0
+	vsubps ymm2, ymm2, ymm0
+	vmulps ymm3, ymm3, ymm1
+	vmulps ymm2, ymm2, ymm1
+	vmovups [to32_out], ymm3
+	vmovups [to32_out+32], ymm2
+	add to32_in, 32
+	add to32_out, 64
+	sub to32_len, 16
+	jg f32_avx_loop
+	vextracti128 xmm3, ymm4, 1
+	vzeroupper
+	paddd xmm4, xmm3
+	F32_HSUM
+	ret
+
+; SSSE3 audio de-interleave, 4 frames (48 bytes) per iteration, len must be >= 48
+; out2ch / out1ch are arrays of 2 / 4 output pointers, either may be NULL
+global extract_audio_ssse3
+extract_audio_ssse3:
+	xor au_off, au_off
+audio_loop:
+	movdqu xmm0, [au_in]
+	movdqu xmm1, [au_in+16]
+	movdqu xmm2, [au_in+32]
+	test au_out2, au_out2
+	jz audio_1ch
+	mov rax, [au_out2+0]
+	movdqa xmm3, xmm0
+	pshufb xmm3, [shuf_a2ch12_l0]
+	movdqa xmm4, xmm1
+	pshufb xmm4, [shuf_a2ch12_l1]
+	por xmm3, xmm4
+	movdqu [rax+2*au_off], xmm3
+	movdqa xmm3, xmm1
+	pshufb xmm3, [shuf_a2ch12_h1]
+	movdqa xmm4, xmm2
+	pshufb xmm4, [shuf_a2ch12_h2]
+	por xmm3, xmm4
+	movq [rax+2*au_off+16], xmm3
+	mov rax, [au_out2+8]
+	movdqa xmm3, xmm0
+	pshufb xmm3, [shuf_a2ch34_l0]
+	movdqa xmm4, xmm1
+	pshufb xmm4, [shuf_a2ch34_l1]
+	por xmm3, xmm4
+	movdqa xmm4, xmm2
+	pshufb xmm4, [shuf_a2ch34_l2]
+	por xmm3, xmm4
+	movdqu [rax+2*au_off], xmm3
+	movdqa xmm3, xmm2
+	pshufb xmm3, [shuf_a2ch34_h2]
+	movq [rax+2*au_off+16], xmm3
+audio_1ch:
+	test au_out1, au_out1
+	jz audio_next
+	mov rax, [au_out1+0]
+	movdqa xmm3, xmm0
+	pshufb xmm3, [shuf_a1ch0_l0]
+	movdqa xmm4, xmm1
+	pshufb xmm4, [shuf_a1ch0_l1]
+	por xmm3, xmm4
+	movdqa xmm4, xmm2
+	pshufb xmm4, [shuf_a1ch0_l2]
+	por xmm3, xmm4
+	movq [rax+au_off], xmm3
+	psrldq xmm3, 8
+	movd [rax+au_off+8], xmm3
+	mov rax, [au_out1+8]
+	movdqa xmm3, xmm0
+	pshufb xmm3, [shuf_a1ch1_l0]
+	movdqa xmm4, xmm1
+	pshufb xmm4, [shuf_a1ch1_l1]
+	por xmm3, xmm4
+	movdqa xmm4, xmm2
+	pshufb xmm4, [shuf_a1ch1_l2]
+	por xmm3, xmm4
+	movq [rax+au_off], xmm3
+	psrldq xmm3, 8
+	movd [rax+au_off+8], xmm3
+	mov rax, [au_out1+16]
+	movdqa xmm3, xmm0
+	pshufb xmm3, [shuf_a1ch2_l0]
+	movdqa xmm4, xmm1
+	pshufb xmm4, [shuf_a1ch2_l1]
+	por xmm3, xmm4
+	movdqa xmm4, xmm2
+	pshufb xmm4, [shuf_a1ch2_l2]
+	por xmm3, xmm4
+	movq [rax+au_off], xmm3
+	psrldq xmm3, 8
+	movd [rax+au_off+8], xmm3
+	mov rax, [au_out1+24]
+	movdqa xmm3, xmm0
+	pshufb xmm3, [shuf_a1ch3_l0]
+	movdqa xmm4, xmm1
+	pshufb xmm4, [shuf_a1ch3_l1]
+	por xmm3, xmm4
+	movdqa xmm4, xmm2
+	pshufb xmm4, [shuf_a1ch3_l2]
+	por xmm3, xmm4
+	movq [rax+au_off], xmm3
+	psrldq xmm3, 8
+	movd [rax+au_off+8], xmm3
+audio_next:
+	add au_in, 48
+	add au_off, 12
+	sub au_len, 48
+	jg audio_loop
+	ret
+
 global check_cpu_feat
 check_cpu_feat:
 	push rbx
@@ -734,7 +1367,24 @@ check_cpu_feat:
 	sub edx, 0x00800201
 	jnz check_cpu_feat_end
 	inc eax
-	and ecx, 0x02000000 ; check for SSE4.1
+	test ecx, 0x00080000 ; check for SSE4.1
+	jz check_cpu_feat_end
+	inc eax
+	and ecx, 0x18000000 ; check for OSXSAVE and AVX
+	cmp ecx, 0x18000000
+	jne check_cpu_feat_end
+	mov r8d, eax
+	xor ecx, ecx
+	xgetbv              ; check that the OS saves the ymm state
+	and eax, 6
+	cmp eax, 6
+	mov eax, r8d
+	jne check_cpu_feat_end
+	mov eax, 7
+	xor ecx, ecx
+	cpuid
+	mov eax, r8d
+	test ebx, 0x00000020 ; check for AVX2
 	jz check_cpu_feat_end
 	inc eax
 check_cpu_feat_end:
@@ -19,6 +19,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include "extract.h"
 
 //bit masking
@@ -33,9 +34,24 @@
 # define UNUSED(x) x
 #endif
 
+// the C kernels are all there is on targets without the asm or NEON code,
+// and the stats and aux only variants run on every target. With ifunc
+// support (glibc on x86_64) each one is also built for AVX2 and the loader
+// binds the clone for the running CPU, elsewhere they stay baseline.
+// NEON is baseline on arm64, so the plain build vectorizes for it already.
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__GLIBC__) && defined(__has_attribute)
+# if __has_attribute(target_clones)
+#  define EXTRACT_CLONES __attribute__((target_clones("avx2","default")))
+# endif
+#endif
+#ifndef EXTRACT_CLONES
+# define EXTRACT_CLONES
+#endif
+
 #define INT12_MAX 2047
 #define INT12_MIN -2048
 
+EXTRACT_CLONES
 void extract_audio_2ch_C(uint16_t *in, size_t len, uint16_t *out12, uint16_t *out34) {
 	for(size_t i = 0; i < len/4; i+=3)
 	{
@@ -48,6 +64,7 @@ void extract_audio_2ch_C(uint16_t *in, size_t len, uint16_t *out12, uint16_t *ou
 	}
 }
 
+EXTRACT_CLONES
 void extract_audio_1ch_C(uint8_t *in, size_t len, uint8_t *out1, uint8_t *out2, uint8_t *out3, uint8_t *out4) {
 	for(size_t i = 0; i < len/4; i+=3)
 	{
@@ -66,6 +83,26 @@ void extract_audio_1ch_C(uint8_t *in, size_t len, uint8_t *out1, uint8_t *out2,
 	}
 }
 
+// fused 4ch -> 2ch/1ch de-interleave, one pass over the input, either output set may be NULL
+EXTRACT_CLONES
+void extract_audio_C(uint8_t *in, size_t len, uint8_t **out2ch, uint8_t **out1ch) {
+	for(size_t i = 0; i < len/12; i++)
+	{
+		uint8_t *frame = in + 12*i;
+		if(out2ch) {
+			memcpy(out2ch[0] + 6*i, frame, 6);
+			memcpy(out2ch[1] + 6*i, frame + 6, 6);
+		}
+		if(out1ch) {
+			memcpy(out1ch[0] + 3*i, frame, 3);
+			memcpy(out1ch[1] + 3*i, frame + 3, 3);
+			memcpy(out1ch[2] + 3*i, frame + 6, 3);
+			memcpy(out1ch[3] + 3*i, frame + 9, 3);
+		}
+	}
+}
+
+EXTRACT_CLONES
 void extract_XS_C(uint16_t *in, size_t len, size_t UNUSED(*clip), uint8_t *aux, int16_t UNUSED(*outA), int16_t UNUSED(*outB), uint16_t UNUSED(*peak_level)) {
 	for(size_t i = 0; i < len; i++)
 	{
@@ -73,6 +110,7 @@ void extract_XS_C(uint16_t *in, size_t len, size_t UNUSED(*clip), uint8_t *aux,
 	}
 }
 
+EXTRACT_CLONES
 void extract_X_C(uint32_t *in, size_t len, size_t UNUSED(*clip), uint8_t *aux, int16_t UNUSED(*outA), int16_t UNUSED(*outB), uint16_t UNUSED(*peak_level)) {
 	for(size_t i = 0; i < len; i++)
 	{
@@ -80,6 +118,7 @@ void extract_X_C(uint32_t *in, size_t len, size_t UNUSED(*clip), uint8_t *aux, i
 	}
 }
 
+EXTRACT_CLONES
 void extract_X_peak_C(uint32_t *in, size_t len, size_t UNUSED(*clip), uint8_t *aux, int16_t UNUSED(*outA), int16_t UNUSED(*outB), uint16_t *peak_level) {
 	peak_level[0] = 0;
 	peak_level[1] = 0;
@@ -93,6 +132,7 @@ void extract_X_peak_C(uint32_t *in, size_t len, size_t UNUSED(*clip), uint8_t *a
 	}
 }
 
+EXTRACT_CLONES
 void extract_S_C(uint16_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t UNUSED(*outB), uint16_t UNUSED(*peak_level)) {
 	for(size_t i = 0; i < len; i++)
 	{
@@ -102,6 +142,7 @@ void extract_S_C(uint16_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *
 	}
 }
 
+EXTRACT_CLONES
 void extract_A_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t UNUSED(*outB), uint16_t UNUSED(*peak_level)) {
 	for(size_t i = 0; i < len; i++)
 	{
@@ -111,6 +152,7 @@ void extract_A_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *
 	}
 }
 
+EXTRACT_CLONES
 void extract_A_peak_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t UNUSED(*outB), uint16_t *peak_level) {
 	peak_level[0] = 0;
 	for(size_t i = 0; i < len; i++)
@@ -122,6 +164,7 @@ void extract_A_peak_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int1
 	}
 }
 
+EXTRACT_CLONES
 void extract_B_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t UNUSED(*outA), int16_t *outB, uint16_t UNUSED(*peak_level)) {
 	for(size_t i = 0; i < len; i++)
 	{
@@ -131,6 +174,7 @@ void extract_B_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t U
 	}
 }
 
+EXTRACT_CLONES
 void extract_B_peak_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t UNUSED(*outA), int16_t *outB, uint16_t *peak_level) {
 	peak_level[1] = 0;
 	for(size_t i = 0; i < len; i++)
@@ -142,6 +186,7 @@ void extract_B_peak_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int1
 	}
 }
 
+EXTRACT_CLONES
 void extract_AB_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t *outB, uint16_t UNUSED(*peak_level)) {
 	for(size_t i = 0; i < len; i++)
 	{
@@ -153,6 +198,7 @@ void extract_AB_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t
 	}
 }
 
+EXTRACT_CLONES
 void extract_AB_peak_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t *outB, uint16_t *peak_level) {
 	peak_level[0] = 0;
 	peak_level[1] = 0;
@@ -168,6 +214,7 @@ void extract_AB_peak_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int
 	}
 }
 
+EXTRACT_CLONES
 void extract_S_p_C(uint16_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t UNUSED(*outB), uint16_t UNUSED(*peak_level)) {
 	for(size_t i = 0; i < len; i++)
 	{
@@ -177,6 +224,7 @@ void extract_S_p_C(uint16_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t
 	}
 }
 
+EXTRACT_CLONES
 void extract_A_p_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t UNUSED(*outB), uint16_t UNUSED(*peak_level)) {
 	for(size_t i = 0; i < len; i++)
 	{
@@ -186,6 +234,7 @@ void extract_A_p_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t
 	}
 }
 
+EXTRACT_CLONES
 void extract_A_p_peak_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t UNUSED(*outB), uint16_t *peak_level) {
 	peak_level[0] = 0;
 	for(size_t i = 0; i < len; i++)
@@ -198,6 +247,7 @@ void extract_A_p_peak_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, in
 	}
 }
 
+EXTRACT_CLONES
 void extract_B_p_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t UNUSED(*outA), int16_t *outB, uint16_t UNUSED(*peak_level)) {
 	for(size_t i = 0; i < len; i++)
 	{
@@ -207,6 +257,7 @@ void extract_B_p_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t
 	}
 }
 
+EXTRACT_CLONES
 void extract_B_p_peak_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t UNUSED(*outA), int16_t *outB, uint16_t *peak_level) {
 	peak_level[1] = 0;
 	for(size_t i = 0; i < len; i++)
@@ -219,6 +270,7 @@ void extract_B_p_peak_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, in
 	}
 }
 
+EXTRACT_CLONES
 void extract_AB_p_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t *outB, uint16_t UNUSED(*peak_level)) {
 	for(size_t i = 0; i < len; i++)
 	{
@@ -230,6 +282,7 @@ void extract_AB_p_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_
 	}
 }
 
+EXTRACT_CLONES
 void extract_AB_p_peak_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t *outB, uint16_t *peak_level) {
 	peak_level[0] = 0;
 	peak_level[1] = 0;
@@ -247,6 +300,7 @@ void extract_AB_p_peak_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, i
 	}
 }
 
+EXTRACT_CLONES
 void extract_S_32_C(uint16_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t UNUSED(*outB), uint16_t UNUSED(*peak_level)) {
 	for(size_t i = 0; i < len; i++)
 	{
@@ -256,6 +310,7 @@ void extract_S_32_C(uint16_t *in, size_t len, size_t *clip, uint8_t *aux, int32_
 	}
 }
 
+EXTRACT_CLONES
 void extract_A_32_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t UNUSED(*outB), uint16_t UNUSED(*peak_level)) {
 	for(size_t i = 0; i < len; i++)
 	{
@@ -265,6 +320,7 @@ void extract_A_32_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_
 	}
 }
 
+EXTRACT_CLONES
 void extract_A_peak_32_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t UNUSED(*outB), uint16_t *peak_level) {
 	peak_level[0] = 0;
 	for(size_t i = 0; i < len; i++)
@@ -277,6 +333,7 @@ void extract_A_peak_32_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, i
 }
 
 
+EXTRACT_CLONES
 void extract_B_32_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t UNUSED(*outA), int32_t *outB, uint16_t UNUSED(*peak_level)) {
 	for(size_t i = 0; i < len; i++)
 	{
@@ -286,6 +343,7 @@ void extract_B_32_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_
 	}
 }
 
+EXTRACT_CLONES
 void extract_B_peak_32_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t UNUSED(*outA), int32_t *outB, uint16_t *peak_level) {
 	peak_level[1] = 0;
 	for(size_t i = 0; i < len; i++)
@@ -297,6 +355,7 @@ void extract_B_peak_32_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, i
 	}
 }
 
+EXTRACT_CLONES
 void extract_AB_32_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t *outB, uint16_t UNUSED(*peak_level)) {
 	for(size_t i = 0; i < len; i++)
 	{
@@ -308,6 +367,7 @@ void extract_AB_32_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32
 	}
 }
 
+EXTRACT_CLONES
 void extract_AB_peak_32_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t *outB, uint16_t *peak_level) {
 	peak_level[0] = 0;
 	peak_level[1] = 0;
@@ -323,6 +383,7 @@ void extract_AB_peak_32_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux,
 	}
 }
 
+EXTRACT_CLONES
 void extract_S_p_32_C(uint16_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t UNUSED(*outB), uint16_t UNUSED(*peak_level)) {
 	for(size_t i = 0; i < len; i++)
 	{
@@ -332,6 +393,7 @@ void extract_S_p_32_C(uint16_t *in, size_t len, size_t *clip, uint8_t *aux, int3
 	}
 }
 
+EXTRACT_CLONES
 void extract_A_p_32_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t UNUSED(*outB), uint16_t UNUSED(*peak_level)) {
 	for(size_t i = 0; i < len; i++)
 	{
@@ -341,6 +403,7 @@ void extract_A_p_32_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int3
 	}
 }
 
+EXTRACT_CLONES
 void extract_A_p_peak_32_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t UNUSED(*outB), uint16_t *peak_level) {
 	peak_level[0] = 0;
 	for(size_t i = 0; i < len; i++)
@@ -353,6 +416,7 @@ void extract_A_p_peak_32_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux,
 	}
 }
 
+EXTRACT_CLONES
 void extract_B_p_32_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t UNUSED(*outA), int32_t *outB, uint16_t UNUSED(*peak_level)) {
 	for(size_t i = 0; i < len; i++)
 	{
@@ -362,6 +426,7 @@ void extract_B_p_32_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int3
 	}
 }
 
+EXTRACT_CLONES
 void extract_B_p_peak_32_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t UNUSED(*outA), int32_t *outB, uint16_t *peak_level) {
 	peak_level[1] = 0;
 	for(size_t i = 0; i < len; i++)
@@ -374,6 +439,7 @@ void extract_B_p_peak_32_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux,
 	}
 }
 
+EXTRACT_CLONES
 void extract_AB_p_32_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t *outB, uint16_t UNUSED(*peak_level)) {
 	for(size_t i = 0; i < len; i++)
 	{
@@ -385,6 +451,7 @@ void extract_AB_p_32_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int
 	}
 }
 
+EXTRACT_CLONES
 void extract_AB_p_peak_32_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t *outB, uint16_t *peak_level) {
 	peak_level[0] = 0;
 	peak_level[1] = 0;
@@ -402,6 +469,122 @@ void extract_AB_p_peak_32_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux
 	}
 }
 
+// extended statistics in the same pass as the extraction
+// the inner loop works on short blocks with 32 bit accumulators so that it
+// can be vectorized, the block totals are folded into the 64 bit struct
+// and the block extremes make up the envelope
+
+void extract_stats_reset(extract_stats_t *stats) {
+	memset(stats, 0, sizeof(*stats));
+	stats->min[0] = stats->min[1] = INT16_MAX;
+	stats->max[0] = stats->max[1] = INT16_MIN;
+}
+
+uint16_t extract_stats_peak(const extract_stats_t *stats, int ch) {
+	if (stats->count == 0) return 0;
+	int32_t peak = -(int32_t)stats->min[ch];
+	if (stats->max[ch] > peak) peak = stats->max[ch];
+	return (uint16_t)peak;
+}
+
+// adds the statistics of src to dst, so one pass can feed meters that reset at different times
+void extract_stats_merge(extract_stats_t *dst, const extract_stats_t *src) {
+	if (src->count == 0) return;
+	for (int c = 0; c < 2; c++) {
+		if (src->min[c] < dst->min[c]) dst->min[c] = src->min[c];
+		if (src->max[c] > dst->max[c]) dst->max[c] = src->max[c];
+		dst->clip_pos[c] += src->clip_pos[c];
+		dst->clip_neg[c] += src->clip_neg[c];
+		dst->sum[c] += src->sum[c];
+		dst->sum_sq[c] += src->sum_sq[c];
+	}
+	dst->count += src->count;
+}
+
+static inline void extract_stats_kernel(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, void *outA, void *outB, extract_stats_t *stats, const int chA, const int chB, const int pad, const int dword) {
+	const int32_t scale = pad ? 16 : 1;
+	for(size_t j = 0; j < len; j += EXTRACT_STATS_BLOCK)
+	{
+		size_t end = (len - j < EXTRACT_STATS_BLOCK) ? len : j + EXTRACT_STATS_BLOCK;
+		int32_t min_a = INT16_MAX, max_a = INT16_MIN;
+		int32_t min_b = INT16_MAX, max_b = INT16_MIN;
+		int32_t sum_a = 0, sum_b = 0;
+		uint32_t sq_a = 0, sq_b = 0;
+		uint32_t cp_a = 0, cn_a = 0, cp_b = 0, cn_b = 0;
+		uint32_t clip_a = 0, clip_b = 0;
+		for(size_t i = j; i < end; i++)
+		{
+			int32_t a = INT12_MAX - (int32_t)(in[i] & MASK_1);
+			int32_t b = INT12_MAX - (int32_t)((in[i] & MASK_2) >> 20);
+			if (chA) {
+				if (dword) ((int32_t*)outA)[i] = a * scale;
+				else ((int16_t*)outA)[i] = (int16_t)(a * scale);
+			}
+			if (chB) {
+				if (dword) ((int32_t*)outB)[i] = b * scale;
+				else ((int16_t*)outB)[i] = (int16_t)(b * scale);
+			}
+			aux[i]  = (in[i] & MASK_AUX) >> 12;
+			clip_a += ((in[i] >> 12) & 1);
+			clip_b += ((in[i] >> 13) & 1);
+			min_a = (a < min_a) ? a : min_a;
+			max_a = (a > max_a) ? a : max_a;
+			min_b = (b < min_b) ? b : min_b;
+			max_b = (b > max_b) ? b : max_b;
+			cp_a += (a == INT12_MAX);
+			cn_a += (a == INT12_MIN);
+			cp_b += (b == INT12_MAX);
+			cn_b += (b == INT12_MIN);
+			sum_a += a;
+			sum_b += b;
+			sq_a += (uint32_t)(a * a);
+			sq_b += (uint32_t)(b * b);
+		}
+		if (chA) clip[0] += clip_a;
+		if (chB) clip[1] += clip_b;
+		if (min_a < stats->min[0]) stats->min[0] = (int16_t)min_a;
+		if (max_a > stats->max[0]) stats->max[0] = (int16_t)max_a;
+		if (min_b < stats->min[1]) stats->min[1] = (int16_t)min_b;
+		if (max_b > stats->max[1]) stats->max[1] = (int16_t)max_b;
+		if (stats->envelope) {
+			extract_envelope_t *e = &stats->envelope[j / EXTRACT_STATS_BLOCK];
+			e->min[0] = (int16_t)min_a;
+			e->max[0] = (int16_t)max_a;
+			e->min[1] = (int16_t)min_b;
+			e->max[1] = (int16_t)max_b;
+		}
+		stats->clip_pos[0] += cp_a;
+		stats->clip_neg[0] += cn_a;
+		stats->clip_pos[1] += cp_b;
+		stats->clip_neg[1] += cn_b;
+		stats->sum[0] += sum_a;
+		stats->sum[1] += sum_b;
+		stats->sum_sq[0] += sq_a;
+		stats->sum_sq[1] += sq_b;
+	}
+	stats->count += len;
+}
+
+#define EXTRACT_STATS_C(name, chA, chB, pad, dword) \
+EXTRACT_CLONES void name(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, void *outA, void *outB, extract_stats_t *stats) { \
+	extract_stats_kernel(in, len, clip, aux, outA, outB, stats, chA, chB, pad, dword); \
+}
+
+EXTRACT_STATS_C(extract_X_stats_C,       0, 0, 0, 0)
+EXTRACT_STATS_C(extract_A_stats_C,       1, 0, 0, 0)
+EXTRACT_STATS_C(extract_B_stats_C,       0, 1, 0, 0)
+EXTRACT_STATS_C(extract_AB_stats_C,      1, 1, 0, 0)
+EXTRACT_STATS_C(extract_A_p_stats_C,     1, 0, 1, 0)
+EXTRACT_STATS_C(extract_B_p_stats_C,     0, 1, 1, 0)
+EXTRACT_STATS_C(extract_AB_p_stats_C,    1, 1, 1, 0)
+EXTRACT_STATS_C(extract_A_stats_32_C,    1, 0, 0, 1)
+EXTRACT_STATS_C(extract_B_stats_32_C,    0, 1, 0, 1)
+EXTRACT_STATS_C(extract_AB_stats_32_C,   1, 1, 0, 1)
+EXTRACT_STATS_C(extract_A_p_stats_32_C,  1, 0, 1, 1)
+EXTRACT_STATS_C(extract_B_p_stats_32_C,  0, 1, 1, 1)
+EXTRACT_STATS_C(extract_AB_p_stats_32_C, 1, 1, 1, 1)
+
+EXTRACT_CLONES
 void convert_16to32_C(int16_t *in, int32_t *out, size_t len) {
 	for(size_t i = 0; i < len; i++)
 	{
@@ -409,6 +592,7 @@ void convert_16to32_C(int16_t *in, int32_t *out, size_t len) {
 	}
 }
 
+EXTRACT_CLONES
 void convert_16to8to32_C(int16_t *in, int32_t *out, size_t len) {
 	for(size_t i = 0; i < len; i++)
 	{
@@ -416,6 +600,7 @@ void convert_16to8to32_C(int16_t *in, int32_t *out, size_t len) {
 	}
 }
 
+EXTRACT_CLONES
 void convert_16to12to32_C(int16_t *in, int32_t *out, size_t len) {
 	for(size_t i = 0; i < len; i++)
 	{
@@ -423,6 +608,7 @@ void convert_16to12to32_C(int16_t *in, int32_t *out, size_t len) {
 	}
 }
 
+EXTRACT_CLONES
 void convert_16to8_C(int16_t *in, int8_t *out, size_t len) {
 	for(size_t i = 0; i < len; i++)
 	{
@@ -430,59 +616,345 @@ void convert_16to8_C(int16_t *in, int8_t *out, size_t len) {
 	}
 }
 
-/* untested, therefore not used yet */
+EXTRACT_CLONES
+int64_t convert_16tof32_C(int16_t *in, float *out, size_t len, float offset, float scale) {
+	int64_t sum = 0;
+	for(size_t i = 0; i < len; i++)
+	{
+		sum += in[i];
+		out[i] = ((float)in[i] - offset) * scale;
+	}
+	return sum;
+}
+
+// packed 12 bit: two samples in three bytes, little endian, s0 in the low 12 bits.
+// the samples are not clamped, anything outside the 12 bit range wraps.
+EXTRACT_CLONES
+void convert_16to12p_C(int16_t *in, uint8_t *out, size_t len) {
+	size_t i = 0;
+	for(; i + 2 <= len; i += 2, out += 3)
+	{
+		uint16_t s0 = in[i] & 0xfff, s1 = in[i+1] & 0xfff;
+		out[0] = s0;
+		out[1] = (s0 >> 8) | (s1 << 4);
+		out[2] = s1 >> 4;
+	}
+	if(i < len) // odd length, the missing second sample is 0
+	{
+		uint16_t s0 = in[i] & 0xfff;
+		out[0] = s0;
+		out[1] = s0 >> 8;
+		out[2] = 0;
+	}
+}
+
+EXTRACT_CLONES
+void convert_12pto16_C(uint8_t *in, int16_t *out, size_t len) {
+	size_t i = 0;
+	for(; i + 2 <= len; i += 2, in += 3)
+	{
+		out[i]   = (int16_t)((in[0] | in[1] << 8) << 4) >> 4;
+		out[i+1] = (int16_t)(in[1] | in[2] << 8) >> 4;
+	}
+	if(i < len) out[i] = (int16_t)((in[0] | in[1] << 8) << 4) >> 4;
+}
+
 #if defined(__aarch64__) || defined(__arm64__)
 #include <arm_neon.h>
 
-void convert_16to8_arm(int16_t *in, int8_t *out, size_t len)
-{
-	int16_t *src = in;
-	int8_t  *dst = out;
-#ifdef __builtin_assume_aligned
-	src = (int16_t *)__builtin_assume_aligned(src, 16);
-	dst = (int8_t  *)__builtin_assume_aligned(dst, 16);
-#endif
-	for (size_t i = 0; i < len; i += 16) {
-		int16x8_t a = vld1q_s16(src);       // load 8 x int16
-		int16x8_t b = vld1q_s16(src + 8);   // load next 8 x int16
-		int8x8_t   lo = vqmovn_s16(a);          // SQXTN: saturate+narrow low 8 -> int8x8_t
-		int8x16_t  v  = vqmovn_high_s16(lo, b); // SQXTN2: saturate+narrow high 8 into top half
-		vst1q_s8(dst, v);                   // store 16 x int8
-		src += 16;
-		dst += 16;
-	}
-}
-
-void convert_16to8to32_arm(int16_t *in, int32_t *out, size_t len)
-{
-	int16_t *src = in;
-	int32_t *dst = out;
-#ifdef __builtin_assume_aligned
-	src = (int16_t *)__builtin_assume_aligned(src, 16);
-	dst = (int8_t  *)__builtin_assume_aligned(dst, 16);
+#if defined(__GNUC__)
+# define NEON_INLINE static inline __attribute__((always_inline))
+#else
+# define NEON_INLINE static inline
 #endif
-	for (size_t i = 0; i < len; i += 16) {
-		// Load 16 x int16_t as two 8-lane vectors
-		int16x8_t a = vld1q_s16(src);
-		int16x8_t b = vld1q_s16(src + 8);
-		// Saturating narrow to signed 8-bit ([-128, 127])
-		int8x8_t a8 = vqmovn_s16(a);
-		int8x8_t b8 = vqmovn_s16(b);
-		// Widen to signed 16-bit
-		int16x8_t a16 = vmovl_s8(a8);
-		int16x8_t b16 = vmovl_s8(b8);
-		// Widen to signed 32-bit (two 4-lane groups per 8-lane vector)
-		int32x4_t a32_lo = vmovl_s16(vget_low_s16(a16));
-		int32x4_t a32_hi = vmovl_s16(vget_high_s16(a16));
-		int32x4_t b32_lo = vmovl_s16(vget_low_s16(b16));
-		int32x4_t b32_hi = vmovl_s16(vget_high_s16(b16));
-		// Store 16 x int32_t
-		vst1q_s32(dst + 0,  a32_lo);
-		vst1q_s32(dst + 4,  a32_hi);
-		vst1q_s32(dst + 8,  b32_lo);
-		vst1q_s32(dst + 12, b32_hi);
-		src += 16;
-		dst += 16;
+
+// NEON is mandatory on AArch64, so these are always used there.
+// 16 samples are processed per iteration, the remainder is handled by scalar code.
+
+NEON_INLINE void store_neon(int16x8_t v0, int16x8_t v1, void *out, size_t i, uint16x8_t *peak, const int pad, const int peak_level, const int dword) {
+	if (peak_level) {
+		*peak = vmaxq_u16(*peak, vreinterpretq_u16_s16(vabsq_s16(v0)));
+		*peak = vmaxq_u16(*peak, vreinterpretq_u16_s16(vabsq_s16(v1)));
+	}
+	if (pad) {
+		v0 = vshlq_n_s16(v0, 4);
+		v1 = vshlq_n_s16(v1, 4);
+	}
+	if (dword) {
+		int32_t *o = (int32_t*)out + i;
+		vst1q_s32(o,      vmovl_s16(vget_low_s16(v0)));
+		vst1q_s32(o + 4,  vmovl_high_s16(v0));
+		vst1q_s32(o + 8,  vmovl_s16(vget_low_s16(v1)));
+		vst1q_s32(o + 12, vmovl_high_s16(v1));
+	}
+	else {
+		int16_t *o = (int16_t*)out + i;
+		vst1q_s16(o,     v0);
+		vst1q_s16(o + 8, v1);
+	}
+}
+
+NEON_INLINE void store_scalar(int16_t v, void *out, size_t i, uint16_t *peak, const int pad, const int peak_level, const int dword) {
+	if (peak_level && abs(v) > *peak) *peak = abs(v);
+	if (dword) ((int32_t*)out)[i] = pad ? ((int32_t)v)<<4 : v;
+	else ((int16_t*)out)[i] = pad ? v<<4 : v;
+}
+
+NEON_INLINE void extract_neon(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, void *outA, void *outB, uint16_t *peak_level, const int cha, const int chb, const int pad, const int peak, const int dword) {
+	const uint16x8_t mask = vdupq_n_u16(MASK_1);
+	const int16x8_t sub = vdupq_n_s16(INT12_MAX);
+	uint16x8_t peakA = vdupq_n_u16(0), peakB = vdupq_n_u16(0);
+	uint16_t peakA_s = 0, peakB_s = 0;
+	size_t clipA = 0, clipB = 0;
+	size_t i = 0;
+
+	for(; i + 16 <= len; i += 16)
+	{
+		// val[0] holds the lower (A, clip, aux[3:0]), val[1] the upper (aux[7:4], B) 16 bit
+		uint16x8x2_t s0 = vld2q_u16((uint16_t*)(in + i));
+		uint16x8x2_t s1 = vld2q_u16((uint16_t*)(in + i + 8));
+		uint8x16_t x = vcombine_u8(
+			vmovn_u16(vorrq_u16(vshrq_n_u16(s0.val[0], 12), vshlq_n_u16(s0.val[1], 4))),
+			vmovn_u16(vorrq_u16(vshrq_n_u16(s1.val[0], 12), vshlq_n_u16(s1.val[1], 4))));
+		vst1q_u8(aux + i, x);
+		if (cha) {
+			int16x8_t v0 = vsubq_s16(sub, vreinterpretq_s16_u16(vandq_u16(s0.val[0], mask)));
+			int16x8_t v1 = vsubq_s16(sub, vreinterpretq_s16_u16(vandq_u16(s1.val[0], mask)));
+			store_neon(v0, v1, outA, i, &peakA, pad, peak, dword);
+			clipA += vaddvq_u8(vandq_u8(x, vdupq_n_u8(1)));
+		}
+		if (chb) {
+			int16x8_t v0 = vsubq_s16(sub, vreinterpretq_s16_u16(vshrq_n_u16(s0.val[1], 4)));
+			int16x8_t v1 = vsubq_s16(sub, vreinterpretq_s16_u16(vshrq_n_u16(s1.val[1], 4)));
+			store_neon(v0, v1, outB, i, &peakB, pad, peak, dword);
+			clipB += vaddvq_u8(vshrq_n_u8(vandq_u8(x, vdupq_n_u8(2)), 1));
+		}
+	}
+	for(; i < len; i++)
+	{
+		aux[i] = (in[i] & MASK_AUX) >> 12;
+		if (cha) {
+			store_scalar(INT12_MAX - ((int16_t)(in[i] & MASK_1)), outA, i, &peakA_s, pad, peak, dword);
+			clipA += ((in[i] >> 12) & 1);
+		}
+		if (chb) {
+			store_scalar(INT12_MAX - ((int16_t)((in[i] & MASK_2) >> 20)), outB, i, &peakB_s, pad, peak, dword);
+			clipB += ((in[i] >> 13) & 1);
+		}
+	}
+	if (cha) {
+		clip[0] += clipA;
+		if (peak) peak_level[0] = (vmaxvq_u16(peakA) > peakA_s) ? vmaxvq_u16(peakA) : peakA_s;
+	}
+	if (chb) {
+		clip[1] += clipB;
+		if (peak) peak_level[1] = (vmaxvq_u16(peakB) > peakB_s) ? vmaxvq_u16(peakB) : peakB_s;
+	}
+}
+
+NEON_INLINE void extract_S_neon_int(uint16_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, const int pad) {
+	const uint16x8_t mask = vdupq_n_u16(MASK_1);
+	const int16x8_t sub = vdupq_n_s16(INT12_MAX);
+	size_t clipA = 0;
+	size_t i = 0;
+
+	for(; i + 16 <= len; i += 16)
+	{
+		uint16x8_t s0 = vld1q_u16(in + i);
+		uint16x8_t s1 = vld1q_u16(in + i + 8);
+		uint8x16_t x = vcombine_u8(vshrn_n_u16(s0, 12), vshrn_n_u16(s1, 12));
+		vst1q_u8(aux + i, x);
+		int16x8_t v0 = vsubq_s16(sub, vreinterpretq_s16_u16(vandq_u16(s0, mask)));
+		int16x8_t v1 = vsubq_s16(sub, vreinterpretq_s16_u16(vandq_u16(s1, mask)));
+		store_neon(v0, v1, outA, i, NULL, pad, 0, 0);
+		clipA += vaddvq_u8(vandq_u8(x, vdupq_n_u8(1)));
+	}
+	for(; i < len; i++)
+	{
+		store_scalar(INT12_MAX - ((int16_t)(in[i] & MASK_1)), outA, i, NULL, pad, 0, 0);
+		aux[i] = (in[i] & MASK_AUXS) >> 12;
+		clipA += ((in[i] >> 12) & 1);
+	}
+	clip[0] += clipA;
+}
+
+#define EXTRACT_NEON(name, cha, chb, pad, peak, dword, type) \
+void name(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, type *outA, type *outB, uint16_t *peak_level) { \
+	extract_neon(in, len, clip, aux, outA, outB, peak_level, cha, chb, pad, peak, dword); \
+}
+
+EXTRACT_NEON(extract_A_neon,           1, 0, 0, 0, 0, int16_t)
+EXTRACT_NEON(extract_B_neon,           0, 1, 0, 0, 0, int16_t)
+EXTRACT_NEON(extract_AB_neon,          1, 1, 0, 0, 0, int16_t)
+EXTRACT_NEON(extract_A_p_neon,         1, 0, 1, 0, 0, int16_t)
+EXTRACT_NEON(extract_B_p_neon,         0, 1, 1, 0, 0, int16_t)
+EXTRACT_NEON(extract_AB_p_neon,        1, 1, 1, 0, 0, int16_t)
+EXTRACT_NEON(extract_A_32_neon,        1, 0, 0, 0, 1, int32_t)
+EXTRACT_NEON(extract_B_32_neon,        0, 1, 0, 0, 1, int32_t)
+EXTRACT_NEON(extract_AB_32_neon,       1, 1, 0, 0, 1, int32_t)
+EXTRACT_NEON(extract_A_p_32_neon,      1, 0, 1, 0, 1, int32_t)
+EXTRACT_NEON(extract_B_p_32_neon,      0, 1, 1, 0, 1, int32_t)
+EXTRACT_NEON(extract_AB_p_32_neon,     1, 1, 1, 0, 1, int32_t)
+EXTRACT_NEON(extract_A_peak_neon,      1, 0, 0, 1, 0, int16_t)
+EXTRACT_NEON(extract_B_peak_neon,      0, 1, 0, 1, 0, int16_t)
+EXTRACT_NEON(extract_AB_peak_neon,     1, 1, 0, 1, 0, int16_t)
+EXTRACT_NEON(extract_A_p_peak_neon,    1, 0, 1, 1, 0, int16_t)
+EXTRACT_NEON(extract_B_p_peak_neon,    0, 1, 1, 1, 0, int16_t)
+EXTRACT_NEON(extract_AB_p_peak_neon,   1, 1, 1, 1, 0, int16_t)
+EXTRACT_NEON(extract_A_peak_32_neon,   1, 0, 0, 1, 1, int32_t)
+EXTRACT_NEON(extract_B_peak_32_neon,   0, 1, 0, 1, 1, int32_t)
+EXTRACT_NEON(extract_AB_peak_32_neon,  1, 1, 0, 1, 1, int32_t)
+EXTRACT_NEON(extract_A_p_peak_32_neon, 1, 0, 1, 1, 1, int32_t)
+EXTRACT_NEON(extract_B_p_peak_32_neon, 0, 1, 1, 1, 1, int32_t)
+EXTRACT_NEON(extract_AB_p_peak_32_neon,1, 1, 1, 1, 1, int32_t)
+
+void extract_S_neon(uint16_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t UNUSED(*outB), uint16_t UNUSED(*peak_level)) {
+	extract_S_neon_int(in, len, clip, aux, outA, 0);
+}
+
+void extract_S_p_neon(uint16_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t UNUSED(*outB), uint16_t UNUSED(*peak_level)) {
+	extract_S_neon_int(in, len, clip, aux, outA, 1);
+}
+
+void convert_16to32_neon(int16_t *in, int32_t *out, size_t len) {
+	size_t i = 0;
+	for(; i + 8 <= len; i += 8)
+	{
+		int16x8_t a = vld1q_s16(in + i);
+		vst1q_s32(out + i,     vmovl_s16(vget_low_s16(a)));
+		vst1q_s32(out + i + 4, vmovl_high_s16(a));
+	}
+	for(; i < len; i++) out[i] = in[i];
+}
+
+void convert_16to12to32_neon(int16_t *in, int32_t *out, size_t len) {
+	const int16x8_t max = vdupq_n_s16(INT12_MAX);
+	const int16x8_t min = vdupq_n_s16(INT12_MIN);
+	size_t i = 0;
+	for(; i + 8 <= len; i += 8)
+	{
+		int16x8_t a = vminq_s16(vmaxq_s16(vld1q_s16(in + i), min), max);
+		vst1q_s32(out + i,     vmovl_s16(vget_low_s16(a)));
+		vst1q_s32(out + i + 4, vmovl_high_s16(a));
+	}
+	for(; i < len; i++) out[i] = (in[i]>INT12_MAX) ? INT12_MAX : ((in[i]<INT12_MIN) ? INT12_MIN : in[i]);
+}
+
+void convert_16to8_neon(int16_t *in, int8_t *out, size_t len) {
+	size_t i = 0;
+	for(; i + 16 <= len; i += 16)
+	{
+		int8x8_t lo = vqmovn_s16(vld1q_s16(in + i));                  // saturate+narrow low 8
+		vst1q_s8(out + i, vqmovn_high_s16(lo, vld1q_s16(in + i + 8))); // and high 8
+	}
+	for(; i < len; i++) out[i] = (in[i]>INT8_MAX) ? INT8_MAX : ((in[i]<INT8_MIN) ? INT8_MIN : in[i]);
+}
+
+void convert_16to8to32_neon(int16_t *in, int32_t *out, size_t len) {
+	size_t i = 0;
+	for(; i + 8 <= len; i += 8)
+	{
+		int16x8_t a = vmovl_s8(vqmovn_s16(vld1q_s16(in + i))); // saturate to int8, widen back
+		vst1q_s32(out + i,     vmovl_s16(vget_low_s16(a)));
+		vst1q_s32(out + i + 4, vmovl_high_s16(a));
+	}
+	for(; i < len; i++) out[i] = (in[i]>INT8_MAX) ? INT8_MAX : ((in[i]<INT8_MIN) ? INT8_MIN : in[i]);
+}
+
+// packed 12 bit: 16 samples (24 bytes) per iteration, the structured loads/stores do the interleaving
+void convert_16to12p_neon(int16_t *in, uint8_t *out, size_t len) {
+	const uint16x8_t mask = vdupq_n_u16(0x0fff);
+	size_t i = 0;
+	for(; i + 16 <= len; i += 16, out += 24)
+	{
+		uint16x8x2_t v = vld2q_u16((uint16_t*)in + i); // even / odd samples
+		uint16x8_t s0 = vandq_u16(v.val[0], mask);
+		uint16x8_t s1 = vandq_u16(v.val[1], mask);
+		uint8x8x3_t p;
+		p.val[0] = vmovn_u16(s0);
+		p.val[1] = vmovn_u16(vorrq_u16(vshrq_n_u16(s0, 8), vshlq_n_u16(s1, 4)));
+		p.val[2] = vmovn_u16(vshrq_n_u16(s1, 4));
+		vst3_u8(out, p);
+	}
+	if(i < len) convert_16to12p_C(in + i, out, len - i);
+}
+
+void convert_12pto16_neon(uint8_t *in, int16_t *out, size_t len) {
+	size_t i = 0;
+	for(; i + 16 <= len; i += 16, in += 24)
+	{
+		uint8x8x3_t p = vld3_u8(in);
+		int16x8x2_t v;
+		// shift each sample to the top of its lane, the arithmetic shift back sign extends
+		uint16x8_t w0 = vshlq_n_u16(vorrq_u16(vmovl_u8(p.val[0]), vshll_n_u8(p.val[1], 8)), 4);
+		uint16x8_t w1 = vorrq_u16(vmovl_u8(p.val[1]), vshll_n_u8(p.val[2], 8));
+		v.val[0] = vshrq_n_s16(vreinterpretq_s16_u16(w0), 4);
+		v.val[1] = vshrq_n_s16(vreinterpretq_s16_u16(w1), 4);
+		vst2q_s16(out + i, v);
+	}
+	if(i < len) convert_12pto16_C(in, out + i, len - i);
+}
+
+int64_t convert_16tof32_neon(int16_t *in, float *out, size_t len, float offset, float scale) {
+	const float32x4_t o = vdupq_n_f32(offset);
+	const float32x4_t s = vdupq_n_f32(scale);
+	int64x2_t sum = vdupq_n_s64(0);
+	size_t i = 0;
+	for(; i + 8 <= len; i += 8)
+	{
+		int16x8_t a = vld1q_s16(in + i);
+		sum = vpadalq_s32(sum, vpaddlq_s16(a));
+		float32x4_t lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(a)));
+		float32x4_t hi = vcvtq_f32_s32(vmovl_high_s16(a));
+		vst1q_f32(out + i,     vmulq_f32(vsubq_f32(lo, o), s));
+		vst1q_f32(out + i + 4, vmulq_f32(vsubq_f32(hi, o), s));
+	}
+	int64_t r = vaddvq_s64(sum);
+	if(i < len) r += convert_16tof32_C(in + i, out + i, len - i, offset, scale);
+	return r;
+}
+
+// audio: 4 frames (48 bytes) per iteration, table lookups over the three loaded vectors
+static const uint8_t audio_idx_2ch[2][24] = {
+	{ 0,  1,  2,  3,  4,  5, 12, 13, 14, 15, 16, 17, 24, 25, 26, 27, 28, 29, 36, 37, 38, 39, 40, 41},
+	{ 6,  7,  8,  9, 10, 11, 18, 19, 20, 21, 22, 23, 30, 31, 32, 33, 34, 35, 42, 43, 44, 45, 46, 47}
+};
+static const uint8_t audio_idx_1ch[4][16] = {
+	{ 0,  1,  2, 12, 13, 14, 24, 25, 26, 36, 37, 38, 0xff, 0xff, 0xff, 0xff},
+	{ 3,  4,  5, 15, 16, 17, 27, 28, 29, 39, 40, 41, 0xff, 0xff, 0xff, 0xff},
+	{ 6,  7,  8, 18, 19, 20, 30, 31, 32, 42, 43, 44, 0xff, 0xff, 0xff, 0xff},
+	{ 9, 10, 11, 21, 22, 23, 33, 34, 35, 45, 46, 47, 0xff, 0xff, 0xff, 0xff}
+};
+
+void extract_audio_neon(uint8_t *in, size_t len, uint8_t **out2ch, uint8_t **out1ch) {
+	size_t i = 0, o = 0;
+	for(; i + 48 <= len; i += 48, o += 12)
+	{
+		uint8x16x3_t v;
+		v.val[0] = vld1q_u8(in + i);
+		v.val[1] = vld1q_u8(in + i + 16);
+		v.val[2] = vld1q_u8(in + i + 32);
+		if(out2ch) {
+			for(int c = 0; c < 2; c++)
+			{
+				vst1q_u8(out2ch[c] + 2*o,      vqtbl3q_u8(v, vld1q_u8(audio_idx_2ch[c])));
+				vst1_u8 (out2ch[c] + 2*o + 16, vqtbl3_u8(v, vld1_u8(audio_idx_2ch[c] + 16)));
+			}
+		}
+		if(out1ch) {
+			for(int c = 0; c < 4; c++)
+			{
+				uint8x16_t r = vqtbl3q_u8(v, vld1q_u8(audio_idx_1ch[c]));
+				vst1_u8(out1ch[c] + o, vget_low_u8(r));
+				vst1q_lane_u32((uint32_t*)(out1ch[c] + o + 8), vreinterpretq_u32_u8(r), 2);
+			}
+		}
+	}
+	if(i < len) {
+		uint8_t *o2[2], *o1[4];
+		for(int c = 0; c < 2; c++) o2[c] = out2ch ? out2ch[c] + 2*o : NULL;
+		for(int c = 0; c < 4; c++) o1[c] = out1ch ? out1ch[c] + o : NULL;
+		extract_audio_C(in + i, len - i, out2ch ? o2 : NULL, out1ch ? o1 : NULL);
 	}
 }
 #endif
@@ -497,6 +969,63 @@ conv_function_t get_conv_function(uint8_t single, uint8_t pad, uint8_t dword, ui
 		else return (conv_function_t) &extract_X_C;
 	}
 #if defined(__x86_64__) || defined(_M_X64)
+	if(check_cpu_feat()>=3) {
+		fprintf(stderr,"Detected processor with AVX2, using optimized extraction routine\n\n");
+		if (peak_level == 1) {
+			if (dword==0) {
+				if (pad==1) {
+					if (outA == NULL) return (conv_function_t) &extract_B_p_peak_avx;
+					if (outB == NULL) return (conv_function_t) &extract_A_p_peak_avx;
+					return (conv_function_t) &extract_AB_p_peak_avx;
+				}
+				else {
+					if (outA == NULL) return (conv_function_t) &extract_B_peak_avx;
+					if (outB == NULL) return (conv_function_t) &extract_A_peak_avx;
+					return (conv_function_t) &extract_AB_peak_avx;
+				}
+			}
+			else {
+				if (pad==1) {
+					if (outA == NULL) return (conv_function_t) &extract_B_p_peak_32_avx;
+					if (outB == NULL) return (conv_function_t) &extract_A_p_peak_32_avx;
+					return (conv_function_t) &extract_AB_p_peak_32_avx;
+				}
+				else {
+					if (outA == NULL) return (conv_function_t) &extract_B_peak_32_avx;
+					if (outB == NULL) return (conv_function_t) &extract_A_peak_32_avx;
+					return (conv_function_t) &extract_AB_peak_32_avx;
+				}
+			}
+		}
+		else {
+			if (dword==0) {
+				if (pad==1) {
+					if (single == 1) return (conv_function_t) &extract_S_p_avx;
+					else if (outA == NULL) return (conv_function_t) &extract_B_p_avx;
+					else if (outB == NULL) return (conv_function_t) &extract_A_p_avx;
+					else return (conv_function_t) &extract_AB_p_avx;
+				}
+				else {
+					if (single == 1) return (conv_function_t) &extract_S_avx;
+					else if (outA == NULL) return (conv_function_t) &extract_B_avx;
+					else if (outB == NULL) return (conv_function_t) &extract_A_avx;
+					else return (conv_function_t) &extract_AB_avx;
+				}
+			}
+			else {
+				if (pad==1) {
+					if (outA == NULL) return (conv_function_t) &extract_B_p_32_avx;
+					else if (outB == NULL) return (conv_function_t) &extract_A_p_32_avx;
+					else return (conv_function_t) &extract_AB_p_32_avx;
+				}
+				else {
+					if (outA == NULL) return (conv_function_t) &extract_B_32_avx;
+					else if (outB == NULL) return (conv_function_t) &extract_A_32_avx;
+					else return (conv_function_t) &extract_AB_32_avx;
+				}
+			}
+		}
+	}
 	if (peak_level == 1) {
 		if(check_cpu_feat()>=2) {
 			fprintf(stderr,"Detected processor with SSE4.1, using optimized extraction routine\n\n");
@@ -559,6 +1088,62 @@ conv_function_t get_conv_function(uint8_t single, uint8_t pad, uint8_t dword, ui
 	}
 	if (peak_level == 1) fprintf(stderr,"Detected processor without SSE4.1, using standard extraction routine\n\n");
 	else  fprintf(stderr,"Detected processor without SSSE3 and POPCNT, using standard extraction routine\n\n");
+#elif defined(__aarch64__) || defined(__arm64__)
+	fprintf(stderr,"Detected ARM64 processor, using NEON extraction routine\n\n");
+	if (peak_level == 1) {
+		if (dword==0) {
+			if (pad==1) {
+				if (outA == NULL) return (conv_function_t) &extract_B_p_peak_neon;
+				if (outB == NULL) return (conv_function_t) &extract_A_p_peak_neon;
+				return (conv_function_t) &extract_AB_p_peak_neon;
+			}
+			else {
+				if (outA == NULL) return (conv_function_t) &extract_B_peak_neon;
+				if (outB == NULL) return (conv_function_t) &extract_A_peak_neon;
+				return (conv_function_t) &extract_AB_peak_neon;
+			}
+		}
+		else {
+			if (pad==1) {
+				if (outA == NULL) return (conv_function_t) &extract_B_p_peak_32_neon;
+				if (outB == NULL) return (conv_function_t) &extract_A_p_peak_32_neon;
+				return (conv_function_t) &extract_AB_p_peak_32_neon;
+			}
+			else {
+				if (outA == NULL) return (conv_function_t) &extract_B_peak_32_neon;
+				if (outB == NULL) return (conv_function_t) &extract_A_peak_32_neon;
+				return (conv_function_t) &extract_AB_peak_32_neon;
+			}
+		}
+	}
+	else {
+		if (dword==0) {
+			if (pad==1) {
+				if (single == 1) return (conv_function_t) &extract_S_p_neon;
+				else if (outA == NULL) return (conv_function_t) &extract_B_p_neon;
+				else if (outB == NULL) return (conv_function_t) &extract_A_p_neon;
+				else return (conv_function_t) &extract_AB_p_neon;
+			}
+			else {
+				if (single == 1) return (conv_function_t) &extract_S_neon;
+				else if (outA == NULL) return (conv_function_t) &extract_B_neon;
+				else if (outB == NULL) return (conv_function_t) &extract_A_neon;
+				else return (conv_function_t) &extract_AB_neon;
+			}
+		}
+		else {
+			if (pad==1) {
+				if (outA == NULL) return (conv_function_t) &extract_B_p_32_neon;
+				else if (outB == NULL) return (conv_function_t) &extract_A_p_32_neon;
+				else return (conv_function_t) &extract_AB_p_32_neon;
+			}
+			else {
+				if (outA == NULL) return (conv_function_t) &extract_B_32_neon;
+				else if (outB == NULL) return (conv_function_t) &extract_A_32_neon;
+				else return (conv_function_t) &extract_AB_32_neon;
+			}
+		}
+	}
 #endif
 	if (peak_level == 1) {
 		if (dword==0) { 
@@ -617,6 +1202,34 @@ conv_function_t get_conv_function(uint8_t single, uint8_t pad, uint8_t dword, ui
 	return NULL;
 }
 
+conv_stats_t get_conv_stats_function(uint8_t pad, uint8_t dword, void* outA, void* outB) {
+	if (outA == NULL && outB == NULL) return &extract_X_stats_C;
+	if (dword==0) {
+		if (pad==1) {
+			if (outA == NULL) return &extract_B_p_stats_C;
+			if (outB == NULL) return &extract_A_p_stats_C;
+			return &extract_AB_p_stats_C;
+		}
+		else {
+			if (outA == NULL) return &extract_B_stats_C;
+			if (outB == NULL) return &extract_A_stats_C;
+			return &extract_AB_stats_C;
+		}
+	}
+	else {
+		if (pad==1) {
+			if (outA == NULL) return &extract_B_p_stats_32_C;
+			if (outB == NULL) return &extract_A_p_stats_32_C;
+			return &extract_AB_p_stats_32_C;
+		}
+		else {
+			if (outA == NULL) return &extract_B_stats_32_C;
+			if (outB == NULL) return &extract_A_stats_32_C;
+			return &extract_AB_stats_32_C;
+		}
+	}
+}
+
 conv_16to32_t get_16to32_function() {
 #if defined(__x86_64__) || defined(_M_X64)
 	if(check_cpu_feat()>=2) {
@@ -625,6 +1238,8 @@ conv_16to32_t get_16to32_function() {
 	}
 	else {
 		fprintf(stderr,"Detected processor without SSE4.1, using standard resampling/repacking routine\n");
+#elif defined(__aarch64__) || defined(__arm64__)
+	return (conv_16to32_t) &convert_16to32_neon;
 #endif
 		return (conv_16to32_t) &convert_16to32_C;
 #if defined(__x86_64__) || defined(_M_X64)
@@ -640,6 +1255,8 @@ conv_16to32_t get_16to8to32_function() {
 	}
 	else {
 		fprintf(stderr,"Detected processor without SSE4.1, using standard 8 bit repacking routine\n");
+#elif defined(__aarch64__) || defined(__arm64__)
+	return (conv_16to32_t) &convert_16to8to32_neon;
 #endif
 		return (conv_16to32_t) &convert_16to8to32_C;
 #if defined(__x86_64__) || defined(_M_X64)
@@ -655,6 +1272,8 @@ conv_16to32_t get_16to12to32_function() {
 	}
 	else {
 		fprintf(stderr,"Detected processor without SSE4.1, using standard 8 bit repacking routine\n");
+#elif defined(__aarch64__) || defined(__arm64__)
+	return (conv_16to32_t) &convert_16to12to32_neon;
 #endif
 		return (conv_16to32_t) &convert_16to12to32_C;
 #if defined(__x86_64__) || defined(_M_X64)
@@ -665,7 +1284,135 @@ conv_16to32_t get_16to12to32_function() {
 conv_16to8_t get_16to8_function() {
 #if defined(__x86_64__) || defined(_M_X64) // SSE2 is mandatory on x86_64
 	return (conv_16to8_t) &convert_16to8_sse;
+#elif defined(__aarch64__) || defined(__arm64__) // so is NEON on AArch64
+	return (conv_16to8_t) &convert_16to8_neon;
 #else
 	return (conv_16to8_t) &convert_16to8_C;
 #endif
 }
+
+#if defined(__x86_64__) || defined(_M_X64)
+// the asm kernels only handle whole blocks of 16 samples, finish the rest in C
+static void convert_16to12p_x86(int16_t *in, uint8_t *out, size_t len) {
+	size_t blk = len - (len % 16);
+	if(blk > 0) convert_16to12p_ssse3(in, out, blk);
+	if(blk < len) convert_16to12p_C(in + blk, out + blk/2*3, len - blk);
+}
+
+static void convert_12pto16_x86(uint8_t *in, int16_t *out, size_t len) {
+	size_t blk = len - (len % 16);
+	if(blk > 0) convert_12pto16_ssse3(in, out, blk);
+	if(blk < len) convert_12pto16_C(in + blk/2*3, out + blk, len - blk);
+}
+#endif
+
+conv_16to12p_t get_16to12p_function() {
+#if defined(__x86_64__) || defined(_M_X64)
+	if(check_cpu_feat()>=1) {
+		fprintf(stderr,"Detected processor with SSSE3, using optimized 12 bit packing routine\n");
+		return (conv_16to12p_t) &convert_16to12p_x86;
+	}
+	fprintf(stderr,"Detected processor without SSSE3, using standard 12 bit packing routine\n");
+#elif defined(__aarch64__) || defined(__arm64__)
+	return (conv_16to12p_t) &convert_16to12p_neon;
+#endif
+	return (conv_16to12p_t) &convert_16to12p_C;
+}
+
+conv_12pto16_t get_12pto16_function() {
+#if defined(__x86_64__) || defined(_M_X64)
+	if(check_cpu_feat()>=1) {
+		fprintf(stderr,"Detected processor with SSSE3, using optimized 12 bit unpacking routine\n");
+		return (conv_12pto16_t) &convert_12pto16_x86;
+	}
+	fprintf(stderr,"Detected processor without SSSE3, using standard 12 bit unpacking routine\n");
+#elif defined(__aarch64__) || defined(__arm64__)
+	return (conv_12pto16_t) &convert_12pto16_neon;
+#endif
+	return (conv_12pto16_t) &convert_12pto16_C;
+}
+
+#if defined(__x86_64__) || defined(_M_X64)
+// the asm kernel only handles whole 48 byte blocks, finish the rest in C
+static void extract_audio_x86(uint8_t *in, size_t len, uint8_t **out2ch, uint8_t **out1ch) {
+	size_t blk = len - (len % 48);
+	if(blk > 0) extract_audio_ssse3(in, blk, out2ch, out1ch);
+	if(blk < len) {
+		uint8_t *o2[2], *o1[4];
+		for(int c = 0; c < 2; c++) o2[c] = out2ch ? out2ch[c] + blk/2 : NULL;
+		for(int c = 0; c < 4; c++) o1[c] = out1ch ? out1ch[c] + blk/4 : NULL;
+		extract_audio_C(in + blk, len - blk, out2ch ? o2 : NULL, out1ch ? o1 : NULL);
+	}
+}
+#endif
+
+conv_audio_t get_audio_function() {
+#if defined(__x86_64__) || defined(_M_X64)
+	if(check_cpu_feat()>=1) {
+		fprintf(stderr,"Detected processor with SSSE3, using optimized audio extraction routine\n");
+		return (conv_audio_t) &extract_audio_x86;
+	}
+	fprintf(stderr,"Detected processor without SSSE3, using standard audio extraction routine\n");
+#elif defined(__aarch64__) || defined(__arm64__)
+	return (conv_audio_t) &extract_audio_neon;
+#endif
+	return (conv_audio_t) &extract_audio_C;
+}
+
+#if defined(__x86_64__) || defined(_M_X64)
+// the asm kernels sum in 32 bit lanes and only handle whole blocks of 8 (SSE4.1) or
+// 16 (AVX2) samples, so they get at most F32_ASM_CHUNK samples a call, the rest is done in C
+#define F32_ASM_CHUNK 65536
+#define CONVERT_16TOF32_X86(name, kernel, step) \
+static int64_t name(int16_t *in, float *out, size_t len, float offset, float scale) { \
+	int64_t sum = 0; \
+	size_t blk = len - (len % step); \
+	for(size_t i = 0; i < blk; i += F32_ASM_CHUNK) \
+		sum += kernel(in + i, out + i, (blk - i < F32_ASM_CHUNK) ? blk - i : F32_ASM_CHUNK, offset, scale); \
+	if(blk < len) sum += convert_16tof32_C(in + blk, out + blk, len - blk, offset, scale); \
+	return sum; \
+}
+CONVERT_16TOF32_X86(convert_16tof32_x86_sse, convert_16tof32_sse, 8)
+CONVERT_16TOF32_X86(convert_16tof32_x86_avx, convert_16tof32_avx, 16)
+#endif
+
+conv_16tof32_t get_16tof32_function() {
+#if defined(__x86_64__) || defined(_M_X64)
+	int feat = check_cpu_feat();
+	if(feat>=3) {
+		fprintf(stderr,"Detected processor with AVX2, using optimized float conversion routine\n");
+		return (conv_16tof32_t) &convert_16tof32_x86_avx;
+	}
+	if(feat>=2) {
+		fprintf(stderr,"Detected processor with SSE4.1, using optimized float conversion routine\n");
+		return (conv_16tof32_t) &convert_16tof32_x86_sse;
+	}
+	fprintf(stderr,"Detected processor without SSE4.1, using standard float conversion routine\n");
+#elif defined(__aarch64__) || defined(__arm64__)
+	return (conv_16tof32_t) &convert_16tof32_neon;
+#endif
+	return (conv_16tof32_t) &convert_16tof32_C;
+}
+
+void f32_out_init(f32_out_t *f, conv_16tof32_t conv, uint8_t pad, uint8_t dc_remove) {
+	f->conv = conv;
+	f->scale = pad ? F32_SCALE_16BIT : F32_SCALE_12BIT;
+	f->dc = 0.0f;
+	f->dc_remove = dc_remove;
+	f->primed = 0;
+}
+
+void f32_out_convert(f32_out_t *f, int16_t *in, float *out, size_t len) {
+	if(len == 0) return;
+	int64_t sum = f->conv(in, out, len, f->dc_remove ? f->dc : 0.0f, f->scale);
+	float mean = (float)((double)sum / (double)len);
+	// the first block sets the estimate, later ones pull it along weighted by their length,
+	// the offset of a block is the estimate of the blocks before it
+	if(!f->primed) {
+		f->dc = mean;
+		f->primed = 1;
+		// nothing went before the first block, it is converted again with its own mean
+		if(f->dc_remove) f->conv(in, out, len, f->dc, f->scale);
+	}
+	else f->dc += (mean - f->dc) * (float)len / (float)(len + F32_DC_SAMPLES);
+}
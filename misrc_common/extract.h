@@ -22,6 +22,50 @@
 typedef void (*conv_function_t)(void*,size_t,size_t*,uint8_t*,void*,void*,uint16_t*);
 typedef void (*conv_16to32_t)(int16_t*,int32_t*,size_t);
 typedef void (*conv_16to8_t)(int16_t*,int8_t*,size_t);
+typedef void (*conv_16to12p_t)(int16_t*,uint8_t*,size_t);
+typedef void (*conv_12pto16_t)(uint8_t*,int16_t*,size_t);
+typedef int64_t (*conv_16tof32_t)(int16_t*,float*,size_t,float,float);
+typedef void (*conv_audio_t)(uint8_t*,size_t,uint8_t**,uint8_t**);
+
+// bytes taken by n samples in the packed 12 bit format (2 samples in 3 bytes)
+#define PACKED12_SIZE(n) (((n)*3+1)/2)
+
+// float32 output: (sample - offset) * scale, the kernels return the sum of the input samples
+// so the DC offset is tracked without another pass over the block
+#define F32_SCALE_12BIT (1.0f/2048.0f)   // sign extended 12 bit samples to [-1, 1)
+#define F32_SCALE_16BIT (1.0f/32768.0f)  // padded samples (-p)
+#define F32_DC_SAMPLES  (1u<<24)         // time constant of the DC tracking, about 0.4 s at 40 MHz
+
+typedef struct {
+	conv_16tof32_t conv;
+	float scale;
+	float dc;            // DC offset in sample units, subtracted when dc_remove is set
+	uint8_t dc_remove;
+	uint8_t primed;      // dc holds an estimate
+} f32_out_t;
+
+// samples the stats kernels work on at a time, one envelope entry each
+#define EXTRACT_STATS_BLOCK 256
+
+// smallest and largest sample of A and B in one block of EXTRACT_STATS_BLOCK samples
+typedef struct {
+	int16_t  min[2];
+	int16_t  max[2];
+} extract_envelope_t;
+
+// per channel signal statistics, accumulated by the stats kernels until reset
+typedef struct {
+	int16_t  min[2];      // smallest sample
+	int16_t  max[2];      // largest sample
+	uint64_t clip_pos[2]; // samples at positive full scale (2047)
+	uint64_t clip_neg[2]; // samples at negative full scale (-2048)
+	int64_t  sum[2];      // for DC offset
+	uint64_t sum_sq[2];   // for RMS
+	uint64_t count;       // samples per channel
+	extract_envelope_t *envelope; // if set, gets an entry per started block of each call, reset clears it
+} extract_stats_t;
+
+typedef void (*conv_stats_t)(uint32_t*,size_t,size_t*,uint8_t*,void*,void*,extract_stats_t*);
 
 #if defined(__x86_64__) || defined(_M_X64)
 void extract_A_sse      (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t *outB, uint16_t *peak_level);
@@ -51,13 +95,81 @@ void extract_A_p_peak_32_sse (uint32_t *in, size_t len, size_t *clip, uint8_t *a
 void extract_B_p_peak_32_sse (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t *outB, uint16_t *peak_level);
 void extract_AB_p_peak_32_sse(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t *outB, uint16_t *peak_level);
 
+void extract_A_avx           (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t *outB, uint16_t *peak_level);
+void extract_B_avx           (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t *outB, uint16_t *peak_level);
+void extract_AB_avx          (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t *outB, uint16_t *peak_level);
+void extract_S_avx           (uint16_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t *outB, uint16_t *peak_level);
+void extract_A_p_avx         (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t *outB, uint16_t *peak_level);
+void extract_B_p_avx         (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t *outB, uint16_t *peak_level);
+void extract_AB_p_avx        (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t *outB, uint16_t *peak_level);
+void extract_S_p_avx         (uint16_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t *outB, uint16_t *peak_level);
+void extract_A_32_avx        (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t *outB, uint16_t *peak_level);
+void extract_B_32_avx        (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t *outB, uint16_t *peak_level);
+void extract_AB_32_avx       (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t *outB, uint16_t *peak_level);
+void extract_A_p_32_avx      (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t *outB, uint16_t *peak_level);
+void extract_B_p_32_avx      (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t *outB, uint16_t *peak_level);
+void extract_AB_p_32_avx     (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t *outB, uint16_t *peak_level);
+void extract_A_peak_avx      (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t *outB, uint16_t *peak_level);
+void extract_B_peak_avx      (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t *outB, uint16_t *peak_level);
+void extract_AB_peak_avx     (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t *outB, uint16_t *peak_level);
+void extract_A_p_peak_avx    (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t *outB, uint16_t *peak_level);
+void extract_B_p_peak_avx    (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t *outB, uint16_t *peak_level);
+void extract_AB_p_peak_avx   (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t *outB, uint16_t *peak_level);
+void extract_A_peak_32_avx   (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t *outB, uint16_t *peak_level);
+void extract_B_peak_32_avx   (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t *outB, uint16_t *peak_level);
+void extract_AB_peak_32_avx  (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t *outB, uint16_t *peak_level);
+void extract_A_p_peak_32_avx (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t *outB, uint16_t *peak_level);
+void extract_B_p_peak_32_avx (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t *outB, uint16_t *peak_level);
+void extract_AB_p_peak_32_avx(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t *outB, uint16_t *peak_level);
+
 void convert_16to32_sse (int16_t *in, int32_t *out, size_t len);
 void convert_16to32_avx (int16_t *in, int32_t *out, size_t len);
 void convert_16to8to32_sse (int16_t *in, int32_t *out, size_t len);
 void convert_16to12to32_sse (int16_t *in, int32_t *out, size_t len);
 void convert_16to8_sse (int16_t *in, int8_t *out, size_t len);
+void convert_16to12p_ssse3 (int16_t *in, uint8_t *out, size_t len);
+void convert_12pto16_ssse3 (uint8_t *in, int16_t *out, size_t len);
+int32_t convert_16tof32_sse (int16_t *in, float *out, size_t len, float offset, float scale);
+int32_t convert_16tof32_avx (int16_t *in, float *out, size_t len, float offset, float scale);
+void extract_audio_ssse3 (uint8_t *in, size_t len, uint8_t **out2ch, uint8_t **out1ch);
 
 int check_cpu_feat();
+#elif defined(__aarch64__) || defined(__arm64__)
+void extract_A_neon           (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t *outB, uint16_t *peak_level);
+void extract_B_neon           (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t *outB, uint16_t *peak_level);
+void extract_AB_neon          (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t *outB, uint16_t *peak_level);
+void extract_S_neon           (uint16_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t *outB, uint16_t *peak_level);
+void extract_A_p_neon         (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t *outB, uint16_t *peak_level);
+void extract_B_p_neon         (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t *outB, uint16_t *peak_level);
+void extract_AB_p_neon        (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t *outB, uint16_t *peak_level);
+void extract_S_p_neon         (uint16_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t *outB, uint16_t *peak_level);
+void extract_A_32_neon        (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t *outB, uint16_t *peak_level);
+void extract_B_32_neon        (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t *outB, uint16_t *peak_level);
+void extract_AB_32_neon       (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t *outB, uint16_t *peak_level);
+void extract_A_p_32_neon      (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t *outB, uint16_t *peak_level);
+void extract_B_p_32_neon      (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t *outB, uint16_t *peak_level);
+void extract_AB_p_32_neon     (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t *outB, uint16_t *peak_level);
+void extract_A_peak_neon      (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t *outB, uint16_t *peak_level);
+void extract_B_peak_neon      (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t *outB, uint16_t *peak_level);
+void extract_AB_peak_neon     (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t *outB, uint16_t *peak_level);
+void extract_A_p_peak_neon    (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t *outB, uint16_t *peak_level);
+void extract_B_p_peak_neon    (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t *outB, uint16_t *peak_level);
+void extract_AB_p_peak_neon   (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int16_t *outA, int16_t *outB, uint16_t *peak_level);
+void extract_A_peak_32_neon   (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t *outB, uint16_t *peak_level);
+void extract_B_peak_32_neon   (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t *outB, uint16_t *peak_level);
+void extract_AB_peak_32_neon  (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t *outB, uint16_t *peak_level);
+void extract_A_p_peak_32_neon (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t *outB, uint16_t *peak_level);
+void extract_B_p_peak_32_neon (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t *outB, uint16_t *peak_level);
+void extract_AB_p_peak_32_neon(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t *outB, uint16_t *peak_level);
+
+void convert_16to32_neon (int16_t *in, int32_t *out, size_t len);
+void convert_16to8to32_neon (int16_t *in, int32_t *out, size_t len);
+void convert_16to12to32_neon (int16_t *in, int32_t *out, size_t len);
+void convert_16to8_neon (int16_t *in, int8_t *out, size_t len);
+void convert_16to12p_neon (int16_t *in, uint8_t *out, size_t len);
+void convert_12pto16_neon (uint8_t *in, int16_t *out, size_t len);
+int64_t convert_16tof32_neon (int16_t *in, float *out, size_t len, float offset, float scale);
+void extract_audio_neon (uint8_t *in, size_t len, uint8_t **out2ch, uint8_t **out1ch);
 #endif
 
 
@@ -93,18 +205,51 @@ void extract_A_p_peak_32_C (uint32_t *in, size_t len, size_t *clip, uint8_t *aux
 void extract_B_p_peak_32_C (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t *outB, uint16_t *peak_level);
 void extract_AB_p_peak_32_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, int32_t *outA, int32_t *outB, uint16_t *peak_level);
 
+void extract_X_stats_C      (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, void *outA, void *outB, extract_stats_t *stats);
+void extract_A_stats_C      (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, void *outA, void *outB, extract_stats_t *stats);
+void extract_B_stats_C      (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, void *outA, void *outB, extract_stats_t *stats);
+void extract_AB_stats_C     (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, void *outA, void *outB, extract_stats_t *stats);
+void extract_A_p_stats_C    (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, void *outA, void *outB, extract_stats_t *stats);
+void extract_B_p_stats_C    (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, void *outA, void *outB, extract_stats_t *stats);
+void extract_AB_p_stats_C   (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, void *outA, void *outB, extract_stats_t *stats);
+void extract_A_stats_32_C   (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, void *outA, void *outB, extract_stats_t *stats);
+void extract_B_stats_32_C   (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, void *outA, void *outB, extract_stats_t *stats);
+void extract_AB_stats_32_C  (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, void *outA, void *outB, extract_stats_t *stats);
+void extract_A_p_stats_32_C (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, void *outA, void *outB, extract_stats_t *stats);
+void extract_B_p_stats_32_C (uint32_t *in, size_t len, size_t *clip, uint8_t *aux, void *outA, void *outB, extract_stats_t *stats);
+void extract_AB_p_stats_32_C(uint32_t *in, size_t len, size_t *clip, uint8_t *aux, void *outA, void *outB, extract_stats_t *stats);
+
+void extract_stats_reset(extract_stats_t *stats);
+uint16_t extract_stats_peak(const extract_stats_t *stats, int ch);
+void extract_stats_merge(extract_stats_t *dst, const extract_stats_t *src);
+
 void convert_16to32_C (int16_t *in, int32_t *out, size_t len);
 void convert_16to8to32_C (int16_t *in, int32_t *out, size_t len);
 void convert_16to12to32_C (int16_t *in, int32_t *out, size_t len);
 void convert_16to8_C (int16_t *in, int8_t *out, size_t len);
+void convert_16to12p_C (int16_t *in, uint8_t *out, size_t len);
+void convert_12pto16_C (uint8_t *in, int16_t *out, size_t len);
+int64_t convert_16tof32_C (int16_t *in, float *out, size_t len, float offset, float scale);
 
 void extract_audio_2ch_C  (uint16_t *in, size_t len, uint16_t *out12, uint16_t *out34);
 void extract_audio_1ch_C  (uint8_t  *in, size_t len, uint8_t   *out1, uint8_t  *out2, uint8_t *out3, uint8_t *out4);
+void extract_audio_C      (uint8_t  *in, size_t len, uint8_t **out2ch, uint8_t **out1ch);
 
 conv_function_t get_conv_function(uint8_t single, uint8_t pad, uint8_t dword, uint8_t peak_level, void* outA, void* outB);
+conv_stats_t get_conv_stats_function(uint8_t pad, uint8_t dword, void* outA, void* outB);
 conv_16to32_t get_16to32_function();
 conv_16to32_t get_16to8to32_function();
 conv_16to32_t get_16to12to32_function();
 conv_16to8_t get_16to8_function();
+conv_16to12p_t get_16to12p_function();
+conv_12pto16_t get_12pto16_function();
+conv_16tof32_t get_16tof32_function();
+conv_audio_t get_audio_function();
+
+// set up the float32 output of one channel with a kernel of get_16tof32_function(),
+// pad: the samples are padded (-p), dc_remove: subtract the tracked DC offset
+void f32_out_init(f32_out_t *f, conv_16tof32_t conv, uint8_t pad, uint8_t dc_remove);
+// convert a block of one channel and update the DC offset with its mean
+void f32_out_convert(f32_out_t *f, int16_t *in, float *out, size_t len);
 
 #endif // EXTRACT_H
@@ -0,0 +1,194 @@
+/*
+ * MISRC Common - Windowed File Mapping Implementation
+ */
+
+#define _FILE_OFFSET_BITS 64
+
+#include "file_map.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/*-----------------------------------------------------------------------------
+ * Helpers
+ *-----------------------------------------------------------------------------*/
+
+static void file_map_unmap(file_map_t *m)
+{
+    if (m->_base != NULL) {
+#ifdef _WIN32
+        UnmapViewOfFile(m->_base);
+#else
+        munmap(m->_base, m->_map_len);
+#endif
+    }
+    m->_base = NULL;
+    m->_map_len = 0;
+    m->data = NULL;
+    m->len = 0;
+}
+
+size_t file_map_granularity(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO sysInfo;
+    GetSystemInfo(&sysInfo);
+    return sysInfo.dwAllocationGranularity;
+#else
+    return (size_t)getpagesize();
+#endif
+}
+
+/*-----------------------------------------------------------------------------
+ * Open / Close
+ *-----------------------------------------------------------------------------*/
+
+int file_map_open_read(file_map_t *m, const char *path)
+{
+    memset(m, 0, sizeof(*m));
+#ifdef _WIN32
+    LARGE_INTEGER size;
+    m->_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (m->_file == INVALID_HANDLE_VALUE) {
+        m->_file = NULL;
+        return -1;
+    }
+    if (!GetFileSizeEx(m->_file, &size)) {
+        file_map_close(m);
+        return -1;
+    }
+    m->file_size = (uint64_t)size.QuadPart;
+    if (m->file_size > 0) {
+        m->_mapping = CreateFileMappingA(m->_file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (m->_mapping == NULL) {
+            file_map_close(m);
+            return -1;
+        }
+    }
+#else
+    struct stat st;
+    m->_fd = open(path, O_RDONLY);
+    if (m->_fd < 0) {
+        return -1;
+    }
+    if (fstat(m->_fd, &st) != 0) {
+        file_map_close(m);
+        return -1;
+    }
+    m->file_size = (uint64_t)st.st_size;
+#endif
+    m->writable = false;
+    return 0;
+}
+
+int file_map_open_write(file_map_t *m, const char *path, uint64_t size)
+{
+    memset(m, 0, sizeof(*m));
+#ifdef _WIN32
+    LARGE_INTEGER li;
+    m->_file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                           FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m->_file == INVALID_HANDLE_VALUE) {
+        m->_file = NULL;
+        return -1;
+    }
+    li.QuadPart = (LONGLONG)size;
+    if (!SetFilePointerEx(m->_file, li, NULL, FILE_BEGIN) || !SetEndOfFile(m->_file)) {
+        file_map_close(m);
+        return -1;
+    }
+    if (size > 0) {
+        m->_mapping = CreateFileMappingA(m->_file, NULL, PAGE_READWRITE,
+                                         (DWORD)(size >> 32), (DWORD)(size & 0xffffffff), NULL);
+        if (m->_mapping == NULL) {
+            file_map_close(m);
+            return -1;
+        }
+    }
+#else
+    m->_fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (m->_fd < 0) {
+        return -1;
+    }
+    if (ftruncate(m->_fd, (off_t)size) != 0) {
+        file_map_close(m);
+        return -1;
+    }
+#endif
+    m->file_size = size;
+    m->writable = true;
+    return 0;
+}
+
+void file_map_close(file_map_t *m)
+{
+    file_map_unmap(m);
+#ifdef _WIN32
+    if (m->_mapping != NULL) CloseHandle(m->_mapping);
+    if (m->_file != NULL) CloseHandle(m->_file);
+    m->_mapping = NULL;
+    m->_file = NULL;
+#else
+    if (m->_fd >= 0) close(m->_fd);
+    m->_fd = -1;
+#endif
+}
+
+/*-----------------------------------------------------------------------------
+ * Window Mapping
+ *-----------------------------------------------------------------------------*/
+
+int file_map_window(file_map_t *m, uint64_t offset, size_t len)
+{
+    uint64_t gran = file_map_granularity();
+    uint64_t base_off;
+    size_t skip;
+
+    file_map_unmap(m);
+
+    if (offset >= m->file_size || len == 0) {
+        return 0;
+    }
+    if (len > m->file_size - offset) {
+        len = (size_t)(m->file_size - offset);
+    }
+
+    // Mapping offsets have to be aligned, map a bit more in front if needed
+    base_off = offset - (offset % gran);
+    skip = (size_t)(offset - base_off);
+
+#ifdef _WIN32
+    m->_base = MapViewOfFile(m->_mapping, m->writable ? FILE_MAP_WRITE : FILE_MAP_READ,
+                             (DWORD)(base_off >> 32), (DWORD)(base_off & 0xffffffff), skip + len);
+    if (m->_base == NULL) {
+        return -1;
+    }
+#else
+    m->_base = mmap(NULL, skip + len, m->writable ? (PROT_READ | PROT_WRITE) : PROT_READ,
+                    MAP_SHARED, m->_fd, (off_t)base_off);
+    if (m->_base == MAP_FAILED) {
+        m->_base = NULL;
+        return -1;
+    }
+    if (!m->writable) {
+        madvise(m->_base, skip + len, MADV_SEQUENTIAL);
+        madvise(m->_base, skip + len, MADV_WILLNEED);
+#ifdef MADV_HUGEPAGE
+        madvise(m->_base, skip + len, MADV_HUGEPAGE);
+#endif
+    }
+#endif
+    m->_map_len = skip + len;
+    m->data = m->_base + skip;
+    m->len = len;
+    return 0;
+}
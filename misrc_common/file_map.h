@@ -0,0 +1,75 @@
+/*
+ * MISRC Common - Windowed File Mapping
+ *
+ * Maps a bounded window of a (possibly very large) file into memory so that
+ * extraction can work directly on the page cache without stdio copies.
+ * Only one window per file is mapped at a time, which keeps the address
+ * space use bounded on 32-bit builds.
+ */
+
+#ifndef MISRC_FILE_MAP_H
+#define MISRC_FILE_MAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef struct {
+    uint8_t *data;        /* start of the requested window */
+    size_t   len;         /* length of the requested window */
+    uint64_t file_size;   /* total size of the file */
+    bool     writable;
+    /* internal */
+    uint8_t *_base;       /* granularity aligned mapping base */
+    size_t   _map_len;
+#ifdef _WIN32
+    void    *_file;
+    void    *_mapping;
+#else
+    int      _fd;
+#endif
+} file_map_t;
+
+/* Get the alignment required for window offsets
+ *
+ * @return page size on POSIX, allocation granularity on Windows
+ */
+size_t file_map_granularity(void);
+
+/* Open an existing file for read-only mapping
+ *
+ * @param m             File map to initialize
+ * @param path          Path to the file
+ * @return 0 on success, -1 on failure
+ */
+int file_map_open_read(file_map_t *m, const char *path);
+
+/* Create (or truncate) a file and pre-size it for writable mapping
+ *
+ * @param m             File map to initialize
+ * @param path          Path to the file
+ * @param size          Final size of the file in bytes
+ * @return 0 on success, -1 on failure
+ */
+int file_map_open_write(file_map_t *m, const char *path, uint64_t size);
+
+/* Map a window of the file, replacing any previously mapped window
+ *
+ * @param m             Opened file map
+ * @param offset        File offset of the window (any value)
+ * @param len           Length of the window, clamped to the end of the file
+ * @return 0 on success, -1 on failure
+ *
+ * Read-only windows are advised for sequential access (and huge pages where
+ * the platform supports it for file mappings). On success m->data/m->len
+ * describe the window.
+ */
+int file_map_window(file_map_t *m, uint64_t offset, size_t len);
+
+/* Unmap the current window and close the file
+ *
+ * @param m             File map to close, safe to call on a closed map
+ */
+void file_map_close(file_map_t *m);
+
+#endif /* MISRC_FILE_MAP_H */
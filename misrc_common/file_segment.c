@@ -0,0 +1,270 @@
+/*
+ * MISRC Common - Rolling Segmented Output Implementation
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE      /* nanosleep() in threading.h */
+#endif
+
+#include "file_segment.h"
+#include "file_utils.h"
+#include "threading.h"
+#include "rb_event.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+enum { SEG_NEXT_NONE = 0, SEG_NEXT_REQUESTED, SEG_NEXT_READY, SEG_NEXT_FAILED };
+
+struct file_segment {
+    file_segment_config_t config;
+    char *path;                 /* Own copy of config.path */
+    unsigned index;             /* Current segment number */
+    FILE *current;
+    bool disabled;              /* Opening a segment failed, stay in the current one */
+
+    /* Handed over between the writer and the helper thread */
+    FILE *next;                 /* Segment index + 1, valid in SEG_NEXT_READY */
+    FILE *retire;               /* Finished segment, valid while retire_pending */
+    atomic_int next_state;
+    atomic_bool retire_pending;
+    atomic_bool exit;
+    rb_event_t work;            /* Writer -> helper */
+    rb_event_t done;            /* Helper -> writer */
+    thrd_t thread;
+};
+
+/*-----------------------------------------------------------------------------
+ * Helpers
+ *-----------------------------------------------------------------------------*/
+
+/* name.ext -> name_NNN.ext, the extension only counts in the last path component */
+static void segment_name(const file_segment_t *seg, unsigned index, char *buf, size_t size)
+{
+    const char *base = seg->path;
+    const char *slash = strrchr(base, '/');
+    const char *bslash = strrchr(base, '\\');
+    const char *dot;
+    if (bslash && (!slash || bslash > slash)) slash = bslash;
+    dot = strrchr(slash ? slash : base, '.');
+    if (!dot || dot == (slash ? slash + 1 : base)) dot = base + strlen(base);
+    snprintf(buf, size, "%.*s_%03u%s", (int)(dot - base), base, index, dot);
+}
+
+static FILE *segment_create(const file_segment_t *seg, unsigned index, bool interactive)
+{
+    char name[4096];
+    FILE *f = NULL;
+    segment_name(seg, index, name, sizeof(name));
+    if (file_open_write(&f, name, seg->config.overwrite, interactive) != 0) {
+        return NULL;
+    }
+    /* Only an optimization, the file works just the same without */
+    if (seg->config.preallocate > 0) {
+        file_preallocate(f, seg->config.preallocate);
+    }
+    return f;
+}
+
+static void segment_finish(FILE *f)
+{
+    fflush(f);
+    file_trim(f);
+    fclose(f);
+}
+
+static int segment_thread(void *ctx)
+{
+    file_segment_t *seg = (file_segment_t *)ctx;
+
+    while (1) {
+        rb_event_wait(&seg->work);
+        if (atomic_load(&seg->retire_pending)) {
+            segment_finish(seg->retire);
+            seg->retire = NULL;
+            atomic_store(&seg->retire_pending, false);
+            rb_event_signal(&seg->done);
+        }
+        if (atomic_load(&seg->next_state) == SEG_NEXT_REQUESTED) {
+            seg->next = segment_create(seg, seg->index + 1, false);
+            atomic_store(&seg->next_state, seg->next ? SEG_NEXT_READY : SEG_NEXT_FAILED);
+            rb_event_signal(&seg->done);
+        }
+        /* Outstanding work is done first, the writer waits for it on close */
+        if (atomic_load(&seg->exit)) break;
+    }
+    return 0;
+}
+
+static void request_next(file_segment_t *seg)
+{
+    atomic_store(&seg->next_state, SEG_NEXT_REQUESTED);
+    rb_event_signal(&seg->work);
+}
+
+static bool near_limit(uint64_t value, uint64_t limit)
+{
+    return limit > 0 && value >= limit / 8 * FILE_SEGMENT_PREPARE_EIGHTHS;
+}
+
+/*-----------------------------------------------------------------------------
+ * Public API
+ *-----------------------------------------------------------------------------*/
+
+file_segment_t *file_segment_open(const file_segment_config_t *config, FILE **file)
+{
+    file_segment_t *seg;
+
+    if (strcmp(config->path, "-") == 0) {
+        fprintf(stderr, "Segmented output needs a file, stdout cannot be split\n");
+        return NULL;
+    }
+    seg = calloc(1, sizeof(*seg));
+    if (!seg) return NULL;
+    seg->config = *config;
+    seg->path = strdup(config->path);
+    seg->config.path = seg->path;
+    if (!seg->path || rb_event_init(&seg->work) != 0 || rb_event_init(&seg->done) != 0) {
+        goto fail;
+    }
+    seg->current = segment_create(seg, 0, config->interactive);
+    if (!seg->current) {
+        goto fail;
+    }
+    if (thrd_create(&seg->thread, &segment_thread, seg) != thrd_success) {
+        fprintf(stderr, "Failed to create thread for segmented output\n");
+        fclose(seg->current);
+        goto fail;
+    }
+    *file = seg->current;
+    return seg;
+
+fail:
+    rb_event_destroy(&seg->work);
+    rb_event_destroy(&seg->done);
+    free(seg->path);
+    free(seg);
+    return NULL;
+}
+
+bool file_segment_due(file_segment_t *seg, uint64_t file_bytes, uint64_t input_bytes)
+{
+    const file_segment_config_t *c = &seg->config;
+
+    if (seg->disabled) return false;
+    if ((c->max_bytes > 0 && file_bytes >= c->max_bytes) ||
+        (c->max_input > 0 && input_bytes >= c->max_input)) {
+        return true;
+    }
+    if (atomic_load(&seg->next_state) == SEG_NEXT_NONE &&
+        (near_limit(file_bytes, c->max_bytes) || near_limit(input_bytes, c->max_input))) {
+        request_next(seg);
+    }
+    return false;
+}
+
+bool file_segment_wait_next(file_segment_t *seg)
+{
+    char name[4096];
+
+    if (seg->disabled) return false;
+    /* Normally prepared long ago, only tiny limits get here first */
+    if (atomic_load(&seg->next_state) == SEG_NEXT_NONE) {
+        request_next(seg);
+    }
+    while (atomic_load(&seg->next_state) == SEG_NEXT_REQUESTED) {
+        rb_event_wait(&seg->done);
+    }
+    if (atomic_load(&seg->next_state) == SEG_NEXT_FAILED) {
+        segment_name(seg, seg->index, name, sizeof(name));
+        fprintf(stderr, "Could not open the next segment, continuing in %s\n", name);
+        atomic_store(&seg->next_state, SEG_NEXT_NONE);
+        seg->disabled = true;
+        return false;
+    }
+    return true;
+}
+
+FILE *file_segment_next(file_segment_t *seg)
+{
+    if (!file_segment_wait_next(seg)) return NULL;
+    /* The previous segment was handed over a whole segment ago */
+    while (atomic_load(&seg->retire_pending)) {
+        rb_event_wait(&seg->done);
+    }
+
+    seg->retire = seg->current;
+    atomic_store(&seg->retire_pending, true);
+    seg->current = seg->next;
+    seg->next = NULL;
+    seg->index++;
+    atomic_store(&seg->next_state, SEG_NEXT_NONE);
+    rb_event_signal(&seg->work);
+    return seg->current;
+}
+
+unsigned file_segment_index(const file_segment_t *seg)
+{
+    return seg->index;
+}
+
+void file_segment_name(const file_segment_t *seg, char *buf, size_t size)
+{
+    segment_name(seg, seg->index, buf, size);
+}
+
+int file_segment_parse_size(const char *str, uint64_t *bytes)
+{
+    char *end;
+    uint64_t v = (uint64_t)strtoull(str, &end, 10);
+    if (end == str) return -1;
+    switch (*end) {
+        case 'G': case 'g': v <<= 10; /* fall through */
+        case 'M': case 'm': v <<= 10; /* fall through */
+        case 'K': case 'k': v <<= 10; end++; break;
+        default: break;
+    }
+    if (*end != 0) return -1;
+    *bytes = v;
+    return 0;
+}
+
+int file_segment_parse_time(const char *str, uint64_t *seconds)
+{
+    uint64_t v = 0;
+    int fields = 0;
+    while (*str) {
+        char *end;
+        uint64_t part = (uint64_t)strtoull(str, &end, 10);
+        if (end == str || ++fields > 3) return -1;
+        v = v * 60 + part;
+        if (*end == ':') end++;
+        else if (*end != 0) return -1;
+        str = end;
+    }
+    if (fields == 0) return -1;
+    *seconds = v;
+    return 0;
+}
+
+void file_segment_close(file_segment_t *seg)
+{
+    char name[4096];
+
+    if (!seg) return;
+    atomic_store(&seg->exit, true);
+    rb_event_signal(&seg->work);
+    thrd_join(seg->thread, NULL);
+
+    if (seg->next) {
+        fclose(seg->next);
+        segment_name(seg, seg->index + 1, name, sizeof(name));
+        remove(name);
+    }
+    segment_finish(seg->current);
+    rb_event_destroy(&seg->work);
+    rb_event_destroy(&seg->done);
+    free(seg->path);
+    free(seg);
+}
@@ -0,0 +1,106 @@
+/*
+ * MISRC Common - Rolling Segmented Output
+ *
+ * Splits one output into numbered files (name_000.ext, name_001.ext, ...)
+ * by size or duration without losing a sample in between. The next file is
+ * opened and preallocated on a helper thread shortly before it is needed,
+ * and finished files are trimmed to their real size and closed there too,
+ * so the rollover on the writer thread only swaps the FILE pointer.
+ */
+
+#ifndef MISRC_FILE_SEGMENT_H
+#define MISRC_FILE_SEGMENT_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* The next segment is prepared once the current one is this far (in 1/8) through its limit */
+#define FILE_SEGMENT_PREPARE_EIGHTHS 7
+
+typedef struct {
+    const char *path;           /* Output name, the segment number goes in front of the extension */
+    uint64_t max_bytes;         /* Roll over once a segment file reaches this size (0 = no limit) */
+    uint64_t max_input;         /* Roll over after this much input, for duration limits (0 = no limit) */
+    uint64_t preallocate;       /* Bytes reserved for each segment when it is opened (0 = none) */
+    bool overwrite;             /* Overwrite existing segment files */
+    bool interactive;           /* Ask before overwriting the first segment, later ones never ask */
+} file_segment_config_t;
+
+typedef struct file_segment file_segment_t;
+
+/* Open the first segment and start the helper thread
+ *
+ * @param config        Segment configuration, path is copied
+ * @param file          Receives the first segment's file
+ * @return Segment state, or NULL if the first file could not be opened
+ *         (or path is "-", stdout cannot be split)
+ */
+file_segment_t *file_segment_open(const file_segment_config_t *config, FILE **file);
+
+/* Check whether the current segment is full, call between writes
+ *
+ * @param seg           Segment state
+ * @param file_bytes    Bytes in the current segment file
+ * @param input_bytes   Input consumed for the current segment, counts towards max_input
+ * @return true if the writer should finish the current file and call file_segment_next()
+ *
+ * Also asks the helper thread to prepare the next segment when the limit comes near.
+ */
+bool file_segment_due(file_segment_t *seg, uint64_t file_bytes, uint64_t input_bytes);
+
+/* Wait until the next segment is open
+ *
+ * @param seg           Segment state
+ * @return true if file_segment_next() will succeed, false if the next file could not
+ *         be opened: the caller keeps writing the current file and file_segment_due()
+ *         never fires again
+ *
+ * For writers that cannot continue a file once they finished it (FLAC), call this
+ * before finishing the current segment.
+ */
+bool file_segment_wait_next(file_segment_t *seg);
+
+/* Switch to the next segment
+ *
+ * @param seg           Segment state
+ * @return The next segment's file, or NULL if it could not be opened: the caller
+ *         keeps writing the current file and file_segment_due() never fires again
+ *
+ * The current file has to be complete (headers fixed up, FLAC finished), it is
+ * flushed, trimmed and closed on the helper thread.
+ */
+FILE *file_segment_next(file_segment_t *seg);
+
+/* Number of the current segment, starting at 0 */
+unsigned file_segment_index(const file_segment_t *seg);
+
+/* Name of the current segment's file, for files that go along with it
+ *
+ * @param seg           Segment state
+ * @param buf           Receives the name
+ * @param size          Size of buf
+ */
+void file_segment_name(const file_segment_t *seg, char *buf, size_t size);
+
+/* Parse a segment size like 4096, 500M or 2G (k, M and G are powers of 1024)
+ *
+ * @return 0 on success, -1 if the string is not a valid size
+ */
+int file_segment_parse_size(const char *str, uint64_t *bytes);
+
+/* Parse a segment length as seconds, m:s or h:m:s
+ *
+ * @return 0 on success, -1 if the string is not a valid time
+ */
+int file_segment_parse_time(const char *str, uint64_t *seconds);
+
+/* Close the current segment and stop the helper thread
+ *
+ * @param seg           Segment state, freed afterwards (NULL is ignored)
+ *
+ * A segment opened ahead of time but never used is removed again.
+ */
+void file_segment_close(file_segment_t *seg);
+
+#endif /* MISRC_FILE_SEGMENT_H */
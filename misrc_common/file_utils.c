@@ -2,16 +2,24 @@
  * MISRC Common - File Utilities Implementation
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE      /* fallocate() */
+#endif
+#define _FILE_OFFSET_BITS 64
+
 #include "file_utils.h"
 
 #include <string.h>
 
 #if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
 #include <io.h>
 #define access _access
 #define F_OK 0
 #else
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #endif
 
 int file_open_write(FILE **f, const char *filename, bool overwrite, bool interactive)
@@ -52,3 +60,49 @@ void file_close_if_not_stdout(FILE *f)
         fclose(f);
     }
 }
+
+int file_preallocate(FILE *f, uint64_t size)
+{
+#if defined(_WIN32) || defined(_WIN64)
+    HANDLE h = (HANDLE)_get_osfhandle(_fileno(f));
+    FILE_ALLOCATION_INFO info;
+    if (h == INVALID_HANDLE_VALUE) return -1;
+    info.AllocationSize.QuadPart = (LONGLONG)size;
+    return SetFileInformationByHandle(h, FileAllocationInfo, &info, sizeof(info)) ? 0 : -1;
+#elif defined(__linux__)
+    return fallocate(fileno(f), FALLOC_FL_KEEP_SIZE, 0, (off_t)size) == 0 ? 0 : -1;
+#elif defined(__APPLE__)
+    fstore_t store = { F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, (off_t)size, 0 };
+    if (fcntl(fileno(f), F_PREALLOCATE, &store) == 0) return 0;
+    /* Not enough contiguous space, take what is there */
+    store.fst_flags = F_ALLOCATEALL;
+    return fcntl(fileno(f), F_PREALLOCATE, &store) == 0 ? 0 : -1;
+#else
+    (void)f;
+    (void)size;
+    return -1;
+#endif
+}
+
+int file_trim(FILE *f)
+{
+    if (fflush(f) != 0) return -1;
+#if defined(_WIN32) || defined(_WIN64)
+    {
+        __int64 size;
+        __int64 pos = _ftelli64(f);
+        if (pos < 0 || _fseeki64(f, 0, SEEK_END) != 0) return -1;
+        size = _ftelli64(f);
+        _fseeki64(f, pos, SEEK_SET);
+        if (size < 0) return -1;
+        /* Setting the end of file again drops the allocation behind it */
+        return _chsize_s(_fileno(f), size) == 0 ? 0 : -1;
+    }
+#else
+    {
+        struct stat st;
+        if (fstat(fileno(f), &st) != 0) return -1;
+        return ftruncate(fileno(f), st.st_size) == 0 ? 0 : -1;
+    }
+#endif
+}
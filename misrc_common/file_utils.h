@@ -9,6 +9,7 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /*-----------------------------------------------------------------------------
  * File Opening
@@ -35,4 +36,27 @@ int file_open_write(FILE **f, const char *filename, bool overwrite, bool interac
  */
 void file_close_if_not_stdout(FILE *f);
 
+/*-----------------------------------------------------------------------------
+ * Preallocation
+ *-----------------------------------------------------------------------------*/
+
+/* Reserve disk space for a file without changing its size
+ *
+ * @param f             File opened for writing
+ * @param size          Bytes to reserve from the start of the file
+ * @return 0 on success, -1 if not supported or failed
+ *
+ * Keeps the file from fragmenting and makes running out of space show up
+ * before the capture instead of during it. Use file_trim() when done, some
+ * platforms keep the reserved space allocated otherwise.
+ */
+int file_preallocate(FILE *f, uint64_t size);
+
+/* Release space reserved by file_preallocate() beyond the written data
+ *
+ * @param f             File opened for writing, flushed by this call
+ * @return 0 on success, -1 on failure
+ */
+int file_trim(FILE *f);
+
 #endif /* MISRC_FILE_UTILS_H */
@@ -4,9 +4,17 @@
  * Shared FLAC encoding library for CLI and GUI tools.
  */
 
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L  // nanosleep() in threading.h with -std=c11
+#endif
+
 #include "flac_writer.h"
 #include <stdlib.h>
 #include <string.h>
+#include "threading.h"
+#include "rb_event.h"
+#include "thread_role.h"
+#include "trace.h"
 
 #if LIBFLAC_ENABLED == 1
 
@@ -17,7 +25,8 @@
  * Internal Writer Structure
  * ============================================================================ */
 struct flac_writer {
-    FLAC__StreamEncoder *encoder;
+    FLAC__StreamEncoder *encoder;    // NULL in block-parallel mode
+    struct flac_par *par;            // block-parallel state, NULL otherwise
     FLAC__StreamMetadata *seektable;
     FILE *output_file;
     bool use_stream_callbacks;       // Stream mode vs FILE mode
@@ -33,11 +42,14 @@ struct flac_writer {
     flac_writer_error_t last_error;
     char error_message[256];
 
-    // Conversion buffer for int16->int32
+    // Scratch buffer for int16->int32, FLAC_WRITER_SCRATCH_SAMPLES long
     int32_t *conv_buffer;
-    size_t conv_buffer_size;
 };
 
+// int16 input is widened in chunks of this many samples, small enough
+// for the scratch buffer to stay in L2 until the encoder has read it
+#define FLAC_WRITER_SCRATCH_SAMPLES 32768
+
 /* ============================================================================
  * Thread count status strings (for FLAC API v14+)
  * ============================================================================ */
@@ -76,7 +88,9 @@ static FLAC__StreamEncoderWriteStatus stream_write_callback(
     (void)encoder; (void)samples; (void)current_frame;
     flac_writer_t *writer = (flac_writer_t *)client_data;
 
+    TRACE_BEGIN("flac_write");
     size_t written = fwrite(buffer, 1, bytes, writer->output_file);
+    TRACE_END("flac_write");
     if (written != bytes) {
         return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
     }
@@ -143,13 +157,23 @@ flac_writer_config_t flac_writer_default_config(void) {
     flac_writer_config_t config = {
         .sample_rate = 40000,
         .bits_per_sample = 16,
+        .channels = 1,
         .compression_level = 1,
         .verify = false,
+        .adaptive_level = false,
+        .compression_level_min = 0,
+        .compression_level_max = 8,
+        .realtime_rate = 0.0,
         .num_threads = 0,  // Auto-detect
+        .block_parallel = false,
+        .shared_pool = false,
         .enable_seektable = true,
         .seektable_spacing = 1 << 18,  // ~6.5 seconds at 40kHz
+        .seek_sidecar = NULL,
+        .checkpoint_seconds = 0,
         .error_cb = NULL,
         .bytes_cb = NULL,
+        .backlog_cb = NULL,
         .callback_user_data = NULL
     };
     return config;
@@ -158,18 +182,28 @@ flac_writer_config_t flac_writer_default_config(void) {
 /* ============================================================================
  * Internal: Configure Encoder (common setup for both modes)
  * ============================================================================ */
-static flac_writer_error_t configure_encoder(flac_writer_t *writer) {
-    FLAC__StreamEncoder *enc = writer->encoder;
+// RF outputs are mono, audio has up to 4 channels; 0 from configs made before the field existed
+static uint32_t config_channels(const flac_writer_config_t *config) {
+    return config->channels ? config->channels : 1;
+}
+
+static FLAC__bool set_encoder_params(FLAC__StreamEncoder *enc, const flac_writer_config_t *config,
+                                     uint8_t level) {
     FLAC__bool ok = true;
 
-    ok &= FLAC__stream_encoder_set_verify(enc, writer->config.verify);
-    ok &= FLAC__stream_encoder_set_compression_level(enc, writer->config.compression_level);
-    ok &= FLAC__stream_encoder_set_channels(enc, 1);  // Always mono for MISRC
-    ok &= FLAC__stream_encoder_set_bits_per_sample(enc, writer->config.bits_per_sample);
-    ok &= FLAC__stream_encoder_set_sample_rate(enc, writer->config.sample_rate);
+    ok &= FLAC__stream_encoder_set_verify(enc, config->verify);
+    ok &= FLAC__stream_encoder_set_compression_level(enc, level);
+    ok &= FLAC__stream_encoder_set_channels(enc, config_channels(config));
+    ok &= FLAC__stream_encoder_set_bits_per_sample(enc, config->bits_per_sample);
+    ok &= FLAC__stream_encoder_set_sample_rate(enc, config->sample_rate);
     ok &= FLAC__stream_encoder_set_total_samples_estimate(enc, 0);  // Unknown length
+    return ok;
+}
 
-    if (!ok) {
+static flac_writer_error_t configure_encoder(flac_writer_t *writer) {
+    FLAC__StreamEncoder *enc = writer->encoder;
+
+    if (!set_encoder_params(enc, &writer->config, writer->config.compression_level)) {
         report_error(writer, FLAC_WRITER_ERR_CONFIG, "Failed to configure FLAC encoder parameters");
         return FLAC_WRITER_ERR_CONFIG;
     }
@@ -214,6 +248,981 @@ static flac_writer_error_t configure_encoder(flac_writer_t *writer) {
     return FLAC_WRITER_OK;
 }
 
+/* ============================================================================
+ * Block-parallel mode
+ *
+ * The input is cut into jobs of FLAC_PAR_FRAMES_PER_JOB fixed-size frames.
+ * Every job is encoded as a stream of its own by one of the workers, the
+ * write callback drops that stream's metadata and rewrites the frame number
+ * in each frame header (plus both CRCs), so the concatenated frames form one
+ * fixed-blocksize stream. Jobs finish out of order, the writer thread writes
+ * them in order and keeps STREAMINFO, MD5 and seektable up to date itself.
+ * ============================================================================ */
+#define FLAC_PAR_FRAMES_PER_JOB 128
+#define FLAC_PAR_MAX_THREADS    64
+#define FLAC_PAR_JOBS_PER_THREAD 2
+#define FLAC_PAR_STREAMINFO_LEN 34
+#define FLAC_PAR_SEEKPOINT_LEN  18
+// a seektable has to fit into a metadata block with 24 bit length
+#define FLAC_PAR_MAX_SEEKPOINTS (((1u << 24) - 1) / FLAC_PAR_SEEKPOINT_LEN)
+
+// Shared pool: writers registered at once, threads a pool writer keeps jobs
+// in flight for, and how long an idle worker sleeps before looking again
+#define FLAC_POOL_MAX_WRITERS   32
+#define FLAC_POOL_WRITER_THREADS 8
+#define FLAC_POOL_IDLE_MS       100
+
+// Adaptive level: step down when the workers would need more than 1/1.15 of
+// their time or the input buffer is over a third full, step up only with
+// twice the time needed (a level step costs up to about that) and a nearly
+// empty buffer. A level that had to be left is not retried for a while.
+#define FLAC_ADAPT_HEADROOM_LOW   1.15
+#define FLAC_ADAPT_HEADROOM_HIGH  2.0
+#define FLAC_ADAPT_FILL_HIGH      0.33
+#define FLAC_ADAPT_FILL_LOW       0.05
+#define FLAC_ADAPT_RETRY_MS       30000
+
+typedef struct {
+    uint32_t state[4];
+    uint64_t length;
+    uint8_t block[64];
+} par_md5_t;
+
+enum { PAR_JOB_FREE = 0, PAR_JOB_READY, PAR_JOB_DONE };
+
+typedef struct {
+    atomic_int state;
+    rb_event_t done;
+    uint64_t first_frame;
+    uint32_t num_samples;
+    uint8_t level;                   // compression level of the job
+    uint64_t encode_ns;              // time the worker took for it
+    int32_t *samples;                // job_samples input samples
+    uint8_t *out;                    // renumbered frames
+    size_t out_len;
+    size_t out_size;
+    uint32_t frame_bytes[FLAC_PAR_FRAMES_PER_JOB];
+    uint32_t num_frames;
+    bool failed;
+    char error_message[128];
+} par_job_t;
+
+typedef struct {
+    struct flac_par *par;
+    FLAC__StreamEncoder *encoder;
+    par_job_t *job;                  // job being encoded
+    thrd_t thread;
+    rb_event_t work;
+    uint32_t index;
+    bool started;
+    atomic_bool idle;                // pool worker waiting for work
+    uint32_t next_slot;              // pool writer slot to look at first
+} par_worker_t;
+
+typedef struct flac_par {
+    const flac_writer_config_t *config;
+    par_worker_t *workers;
+    par_job_t *jobs;
+    uint32_t num_workers;
+    uint32_t num_jobs;
+    uint32_t channels;
+    uint32_t blocksize;
+    uint32_t job_samples;            // per channel, jobs hold job_samples * channels
+    atomic_bool exit;
+
+    // encoded by the shared pool, which claims jobs in order up to ready_seq
+    bool pooled;
+    _Atomic uint64_t ready_seq;      // jobs submitted
+    _Atomic uint64_t claim_seq;      // jobs taken by pool workers, under the pool lock
+    atomic_uint busy;                // jobs being encoded by pool workers
+
+    // writer thread only
+    par_job_t *fill;                 // job being filled, NULL if none
+    uint64_t next_seq;               // jobs submitted
+    uint64_t write_seq;              // jobs written
+    uint64_t frames_written;
+    uint64_t stream_bytes;           // bytes of frames written
+    uint32_t min_frame_bytes;
+    uint32_t max_frame_bytes;
+    par_md5_t md5;
+
+    // adaptive level, writer thread only
+    uint8_t level;                   // level of the jobs submitted next
+    uint64_t level_seq;              // first job submitted at that level
+    uint32_t level_jobs;             // jobs at that level written so far
+    double ns_per_sample;            // average encode time at that level
+    uint8_t ceiling;                 // level left for being too slow, 0xff if none
+    uint64_t ceiling_ms;             // when it was left
+
+    // metadata, rewritten at the end if the output is seekable
+    long metadata_pos;               // -1 if not seekable
+    FLAC__StreamMetadata_SeekPoint *points;
+    uint32_t num_points;
+    uint32_t next_point;
+    uint64_t samples_coded;          // samples of the frames written
+    uint64_t checkpoint_samples;     // samples between STREAMINFO rewrites, 0 = only at the end
+    uint64_t next_checkpoint;
+
+    // seek points written as they are reached, instead of the points above
+    FILE *sidecar;
+    uint32_t sidecar_spacing;
+    uint64_t sidecar_next;           // target sample of the next point
+
+    uint8_t crc8_table[256];
+    uint16_t crc16_table[256];
+} flac_par_t;
+
+/*---- MD5 (RFC 1321) of the decoded samples, as stored in STREAMINFO ----*/
+
+static const uint32_t md5_k[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+static const uint8_t md5_r[64] = {
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+    5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20,
+    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+    6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+};
+
+static void md5_init(par_md5_t *md5) {
+    md5->state[0] = 0x67452301;
+    md5->state[1] = 0xefcdab89;
+    md5->state[2] = 0x98badcfe;
+    md5->state[3] = 0x10325476;
+    md5->length = 0;
+}
+
+static void md5_transform(par_md5_t *md5, const uint8_t *block) {
+    uint32_t m[16];
+    uint32_t a = md5->state[0], b = md5->state[1], c = md5->state[2], d = md5->state[3];
+
+    for (int i = 0; i < 16; i++) {
+        m[i] = (uint32_t)block[i * 4] | (uint32_t)block[i * 4 + 1] << 8 |
+               (uint32_t)block[i * 4 + 2] << 16 | (uint32_t)block[i * 4 + 3] << 24;
+    }
+    for (int i = 0; i < 64; i++) {
+        uint32_t f;
+        int g;
+        if (i < 16)      { f = (b & c) | (~b & d); g = i; }
+        else if (i < 32) { f = (d & b) | (~d & c); g = (5 * i + 1) & 15; }
+        else if (i < 48) { f = b ^ c ^ d;          g = (3 * i + 5) & 15; }
+        else             { f = c ^ (b | ~d);       g = (7 * i) & 15; }
+        f += a + md5_k[i] + m[g];
+        a = d;
+        d = c;
+        c = b;
+        b += (f << md5_r[i]) | (f >> (32 - md5_r[i]));
+    }
+    md5->state[0] += a;
+    md5->state[1] += b;
+    md5->state[2] += c;
+    md5->state[3] += d;
+}
+
+static void md5_update(par_md5_t *md5, const uint8_t *data, size_t len) {
+    size_t used = (size_t)(md5->length & 63);
+    md5->length += len;
+
+    if (used) {
+        size_t n = 64 - used;
+        if (n > len) n = len;
+        memcpy(md5->block + used, data, n);
+        data += n;
+        len -= n;
+        if (used + n < 64) return;
+        md5_transform(md5, md5->block);
+    }
+    for (; len >= 64; data += 64, len -= 64) {
+        md5_transform(md5, data);
+    }
+    memcpy(md5->block, data, len);
+}
+
+static void md5_final(par_md5_t *md5, uint8_t digest[16]) {
+    static const uint8_t pad[64] = { 0x80 };
+    uint8_t bits[8];
+    uint64_t length = md5->length << 3;
+
+    for (int i = 0; i < 8; i++) bits[i] = (uint8_t)(length >> (i * 8));
+    size_t used = (size_t)(md5->length & 63);
+    md5_update(md5, pad, used < 56 ? 56 - used : 120 - used);
+    md5_update(md5, bits, 8);
+    for (int i = 0; i < 16; i++) digest[i] = (uint8_t)(md5->state[i / 4] >> ((i % 4) * 8));
+}
+
+// libflac hashes the interleaved samples as little-endian integers of (bits_per_sample + 7) / 8 bytes
+static void par_md5_samples(flac_par_t *par, const int32_t *samples, uint32_t num_samples) {
+    uint8_t buf[4095];
+    uint32_t bytes = (par->config->bits_per_sample + 7u) / 8u;
+    uint32_t per_chunk = sizeof(buf) / bytes;
+
+    while (num_samples) {
+        uint32_t n = num_samples < per_chunk ? num_samples : per_chunk;
+        if (bytes == 1) {
+            for (uint32_t i = 0; i < n; i++) buf[i] = (uint8_t)samples[i];
+        } else if (bytes == 2) {
+            for (uint32_t i = 0; i < n; i++) {
+                buf[i * 2] = (uint8_t)samples[i];
+                buf[i * 2 + 1] = (uint8_t)(samples[i] >> 8);
+            }
+        } else {
+            for (uint32_t i = 0; i < n; i++) {
+                buf[i * 3] = (uint8_t)samples[i];
+                buf[i * 3 + 1] = (uint8_t)(samples[i] >> 8);
+                buf[i * 3 + 2] = (uint8_t)(samples[i] >> 16);
+            }
+        }
+        md5_update(&par->md5, buf, n * bytes);
+        samples += n;
+        num_samples -= n;
+    }
+}
+
+/*---- Frame renumbering ----*/
+
+static void par_init_crc(flac_par_t *par) {
+    for (int i = 0; i < 256; i++) {
+        uint8_t c8 = (uint8_t)i;
+        uint16_t c16 = (uint16_t)(i << 8);
+        for (int b = 0; b < 8; b++) {
+            c8 = (uint8_t)((c8 & 0x80) ? (c8 << 1) ^ 0x07 : c8 << 1);
+            c16 = (uint16_t)((c16 & 0x8000) ? (c16 << 1) ^ 0x8005 : c16 << 1);
+        }
+        par->crc8_table[i] = c8;
+        par->crc16_table[i] = c16;
+    }
+}
+
+// length of the UTF-8 style coded number starting with byte, 0 if invalid
+static size_t utf8_coded_len(uint8_t byte) {
+    if (!(byte & 0x80)) return 1;
+    for (size_t n = 2; n <= 7; n++) {
+        if (!(byte & (0x80 >> n))) return n;
+    }
+    return 0;
+}
+
+static size_t utf8_encode(uint64_t v, uint8_t *out) {
+    if (v < 0x80) {
+        out[0] = (uint8_t)v;
+        return 1;
+    }
+    size_t n = 2;
+    while (n < 7 && v >= ((uint64_t)1 << (5 * n + 1))) n++;
+    for (size_t i = n - 1; i > 0; i--) {
+        out[i] = (uint8_t)(0x80 | (v & 0x3f));
+        v >>= 6;
+    }
+    out[0] = (uint8_t)((0xff00 >> n) | v);
+    return n;
+}
+
+// copy a frame to out with its frame number replaced, returns the new size or 0 if malformed
+static size_t par_renumber_frame(const flac_par_t *par, const uint8_t *in, size_t len,
+                                 uint64_t frame_number, uint8_t *out) {
+    // only fixed-blocksize frames, as produced with an explicit block size
+    if (len < 8 || in[0] != 0xff || in[1] != 0xf8) return 0;
+
+    size_t coded = utf8_coded_len(in[4]);
+    if (coded == 0) return 0;
+
+    // optional block size and sample rate behind the frame number
+    uint8_t bs_code = in[2] >> 4, sr_code = in[2] & 0x0f;
+    size_t extra = (bs_code == 6) ? 1 : (bs_code == 7) ? 2 : 0;
+    extra += (sr_code == 12) ? 1 : (sr_code == 13 || sr_code == 14) ? 2 : 0;
+
+    size_t src = 4 + coded + extra + 1;
+    if (src + 2 > len) return 0;
+
+    memcpy(out, in, 4);
+    size_t dst = 4 + utf8_encode(frame_number, out + 4);
+    memcpy(out + dst, in + 4 + coded, extra);
+    dst += extra;
+
+    uint8_t crc8 = 0;
+    for (size_t i = 0; i < dst; i++) crc8 = par->crc8_table[crc8 ^ out[i]];
+    out[dst++] = crc8;
+
+    size_t body = len - src - 2;
+    memcpy(out + dst, in + src, body);
+    dst += body;
+
+    uint16_t crc16 = 0;
+    for (size_t i = 0; i < dst; i++) {
+        crc16 = (uint16_t)((crc16 << 8) ^ par->crc16_table[(crc16 >> 8) ^ out[i]]);
+    }
+    out[dst++] = (uint8_t)(crc16 >> 8);
+    out[dst++] = (uint8_t)crc16;
+    return dst;
+}
+
+/*---- Workers ----*/
+
+static FLAC__StreamEncoderWriteStatus par_write_callback(
+    const FLAC__StreamEncoder *encoder,
+    const FLAC__byte buffer[],
+    size_t bytes,
+    uint32_t samples,
+    uint32_t current_frame,
+    void *client_data)
+{
+    (void)encoder;
+    par_worker_t *worker = (par_worker_t *)client_data;
+    par_job_t *job = worker->job;
+
+    // "fLaC" and the job's own metadata, the writer thread emits the real ones
+    if (samples == 0) return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+
+    if (job->num_frames == FLAC_PAR_FRAMES_PER_JOB) {
+        return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
+    }
+
+    // a longer frame number takes at most 6 more bytes
+    if (job->out_len + bytes + 8 > job->out_size) {
+        size_t size = job->out_size * 2;
+        if (size < job->out_len + bytes + 8) size = job->out_len + bytes + 8;
+        uint8_t *out = realloc(job->out, size);
+        if (!out) return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
+        job->out = out;
+        job->out_size = size;
+    }
+
+    size_t len = par_renumber_frame(worker->par, buffer, bytes,
+                                    job->first_frame + current_frame, job->out + job->out_len);
+    if (len == 0) return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
+
+    job->frame_bytes[job->num_frames++] = (uint32_t)len;
+    job->out_len += len;
+    return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+}
+
+static void par_encode_job(par_worker_t *worker, par_job_t *job) {
+    flac_par_t *par = worker->par;
+    FLAC__StreamEncoder *enc = worker->encoder;
+
+    job->out_len = 0;
+    job->num_frames = 0;
+    job->failed = false;
+    worker->job = job;
+
+    // finishing an encoder resets its settings, so configure it for every job
+    FLAC__bool ok = set_encoder_params(enc, par->config, job->level);
+    ok &= FLAC__stream_encoder_set_blocksize(enc, par->blocksize);
+    ok &= FLAC__stream_encoder_set_do_md5(enc, false);
+    if (!ok) {
+        job->failed = true;
+        snprintf(job->error_message, sizeof(job->error_message), "Failed to configure FLAC encoder parameters");
+        return;
+    }
+
+    FLAC__StreamEncoderInitStatus init_status =
+        FLAC__stream_encoder_init_stream(enc, par_write_callback, NULL, NULL, NULL, worker);
+    if (init_status != FLAC__STREAM_ENCODER_INIT_STATUS_OK) {
+        job->failed = true;
+        snprintf(job->error_message, sizeof(job->error_message), "FLAC init failed: %s",
+                 FLAC__StreamEncoderInitStatusString[init_status]);
+        return;
+    }
+
+    if (!FLAC__stream_encoder_process_interleaved(enc, job->samples, job->num_samples)) {
+        job->failed = true;
+        snprintf(job->error_message, sizeof(job->error_message), "FLAC process error: %s",
+                 FLAC__StreamEncoderStateString[FLAC__stream_encoder_get_state(enc)]);
+    }
+    // flushes the last frame, also needed after an error to return the encoder to uninitialized
+    if (!FLAC__stream_encoder_finish(enc) && !job->failed) {
+        job->failed = true;
+        snprintf(job->error_message, sizeof(job->error_message), "FLAC finish error: %s",
+                 FLAC__StreamEncoderStateString[FLAC__stream_encoder_get_state(enc)]);
+    }
+}
+
+static void par_run_job(par_worker_t *worker, par_job_t *job) {
+    uint64_t t0 = get_time_ns();
+    par_encode_job(worker, job);
+    job->encode_ns = get_time_ns() - t0;
+    atomic_store(&job->state, PAR_JOB_DONE);
+    rb_event_signal(&job->done);
+}
+
+// worker i encodes the jobs i, i + num_workers, i + 2 * num_workers, ...
+static int par_worker_thread(void *ctx) {
+    par_worker_t *worker = (par_worker_t *)ctx;
+    flac_par_t *par = worker->par;
+    uint64_t seq = worker->index;
+
+    thread_role_apply(THREAD_ROLE_FLAC);
+
+    for (;;) {
+        par_job_t *job = &par->jobs[seq % par->num_jobs];
+        while (atomic_load(&job->state) != PAR_JOB_READY) {
+            if (atomic_load(&par->exit)) return 0;
+            rb_event_wait(&worker->work);
+        }
+        if (atomic_load(&par->exit)) return 0;
+        par_run_job(worker, job);
+        seq += par->num_workers;
+    }
+}
+
+/*---- Shared pool ----*/
+
+typedef struct {
+    par_worker_t *workers;
+    uint32_t num_workers;
+    atomic_bool exit;
+    atomic_flag lock;                // guards the writer slots and claim_seq
+    flac_par_t *pars[FLAC_POOL_MAX_WRITERS];
+    atomic_uint num_pars;
+} flac_pool_t;
+
+// set before any writer uses it and cleared after the last one is gone
+static flac_pool_t *s_pool;
+
+static void pool_lock(void) {
+    while (atomic_flag_test_and_set_explicit(&s_pool->lock, memory_order_acquire)) {}
+}
+
+static void pool_unlock(void) {
+    atomic_flag_clear_explicit(&s_pool->lock, memory_order_release);
+}
+
+// take the oldest unclaimed job of the next writer that has one, going
+// round the writers so a busy one cannot starve the others
+static par_job_t *pool_claim(par_worker_t *worker) {
+    par_job_t *job = NULL;
+
+    pool_lock();
+    for (uint32_t i = 0; i < FLAC_POOL_MAX_WRITERS && !job; i++) {
+        uint32_t slot = (worker->next_slot + i) % FLAC_POOL_MAX_WRITERS;
+        flac_par_t *par = s_pool->pars[slot];
+        if (!par) continue;
+        uint64_t seq = atomic_load(&par->claim_seq);
+        if (seq >= atomic_load(&par->ready_seq)) continue;
+        atomic_store(&par->claim_seq, seq + 1);
+        atomic_fetch_add(&par->busy, 1);
+        worker->par = par;
+        worker->next_slot = slot + 1;
+        job = &par->jobs[seq % par->num_jobs];
+    }
+    pool_unlock();
+    return job;
+}
+
+static int pool_worker_thread(void *ctx) {
+    par_worker_t *worker = (par_worker_t *)ctx;
+
+    thread_role_apply(THREAD_ROLE_FLAC);
+
+    while (!atomic_load(&s_pool->exit)) {
+        par_job_t *job = pool_claim(worker);
+        if (!job) {
+            // announce the wait before looking again, a job submitted in between wakes us
+            atomic_store(&worker->idle, true);
+            job = pool_claim(worker);
+            if (!job) {
+                rb_event_wait_timeout(&worker->work, FLAC_POOL_IDLE_MS);
+                atomic_store(&worker->idle, false);
+                continue;
+            }
+            atomic_store(&worker->idle, false);
+        }
+        flac_par_t *par = worker->par;
+        par_run_job(worker, job);
+        // the writer may be destroyed right after this
+        atomic_fetch_sub(&par->busy, 1);
+    }
+    return 0;
+}
+
+static void pool_wake(void) {
+    for (uint32_t i = 0; i < s_pool->num_workers; i++) {
+        if (atomic_exchange(&s_pool->workers[i].idle, false)) {
+            rb_event_signal(&s_pool->workers[i].work);
+            return;
+        }
+    }
+}
+
+static bool pool_register(flac_par_t *par) {
+    bool ok = false;
+
+    pool_lock();
+    for (uint32_t i = 0; i < FLAC_POOL_MAX_WRITERS && !ok; i++) {
+        if (s_pool->pars[i]) continue;
+        s_pool->pars[i] = par;
+        atomic_fetch_add(&s_pool->num_pars, 1);
+        ok = true;
+    }
+    pool_unlock();
+    return ok;
+}
+
+// no job of the writer is claimed anymore once this returns
+static void pool_unregister(flac_par_t *par) {
+    pool_lock();
+    for (uint32_t i = 0; i < FLAC_POOL_MAX_WRITERS; i++) {
+        if (s_pool->pars[i] != par) continue;
+        s_pool->pars[i] = NULL;
+        atomic_fetch_sub(&s_pool->num_pars, 1);
+    }
+    pool_unlock();
+    while (atomic_load(&par->busy) > 0) thrd_sleep_ms(1);
+}
+
+// encoders working for a writer, its share of the pool when pooled
+static double par_threads(const flac_par_t *par) {
+    if (!par->pooled) return par->num_workers;
+    uint32_t writers = atomic_load(&s_pool->num_pars);
+    return (double)s_pool->num_workers / (writers ? writers : 1);
+}
+
+/*---- Metadata ----*/
+
+static void put_be(uint8_t *p, uint64_t v, int bytes) {
+    for (int i = bytes - 1; i >= 0; i--) {
+        p[i] = (uint8_t)v;
+        v >>= 8;
+    }
+}
+
+// total is 0 while unknown, the MD5 is only there when final
+static bool par_write_metadata(flac_writer_t *writer, uint64_t total, bool final) {
+    flac_par_t *par = writer->par;
+    const flac_writer_config_t *cfg = &writer->config;
+    uint8_t head[8 + FLAC_PAR_STREAMINFO_LEN];
+    uint8_t point[FLAC_PAR_SEEKPOINT_LEN];
+    uint8_t digest[16] = { 0 };
+
+    if (final) md5_final(&par->md5, digest);
+
+    memcpy(head, "fLaC", 4);
+    head[4] = par->num_points ? 0x00 : 0x80;  // last-metadata-block flag, type STREAMINFO
+    put_be(head + 5, FLAC_PAR_STREAMINFO_LEN, 3);
+    uint8_t *si = head + 8;
+    put_be(si, par->blocksize, 2);
+    put_be(si + 2, par->blocksize, 2);
+    put_be(si + 4, total ? par->min_frame_bytes : 0, 3);
+    put_be(si + 7, total ? par->max_frame_bytes : 0, 3);
+    put_be(si + 10, (uint64_t)cfg->sample_rate << 44 |
+                    (uint64_t)(par->channels - 1) << 41 |
+                    (uint64_t)(cfg->bits_per_sample - 1) << 36 | (total & 0xfffffffffULL), 8);
+    memcpy(si + 18, digest, 16);
+    if (fwrite(head, 1, sizeof(head), writer->output_file) != sizeof(head)) return false;
+
+    if (par->num_points) {
+        uint8_t block_head[4];
+        block_head[0] = 0x80 | 3;  // last-metadata-block flag, type SEEKTABLE
+        put_be(block_head + 1, (uint64_t)par->num_points * FLAC_PAR_SEEKPOINT_LEN, 3);
+        if (fwrite(block_head, 1, 4, writer->output_file) != 4) return false;
+        for (uint32_t i = 0; i < par->num_points; i++) {
+            const FLAC__StreamMetadata_SeekPoint *p = &par->points[i];
+            // points not reached by the stream stay placeholders
+            bool used = i < par->next_point;
+            put_be(point, used ? p->sample_number : 0xFFFFFFFFFFFFFFFFULL, 8);
+            put_be(point + 8, used ? p->stream_offset : 0, 8);
+            put_be(point + 16, used ? p->frame_samples : 0, 2);
+            if (fwrite(point, 1, sizeof(point), writer->output_file) != sizeof(point)) return false;
+        }
+    }
+    return true;
+}
+
+/*---- Writer thread ----*/
+
+static int par_job_written(flac_writer_t *writer, const par_job_t *job) {
+    flac_par_t *par = writer->par;
+    uint8_t point[FLAC_PAR_SEEKPOINT_LEN];
+
+    for (uint32_t i = 0; i < job->num_frames; i++) {
+        uint64_t first_sample = par->frames_written * par->blocksize;
+        uint32_t frame_samples = par->blocksize;
+        if (i == job->num_frames - 1) {
+            frame_samples = job->num_samples - (job->num_frames - 1) * par->blocksize;
+        }
+
+        // libflac sets each point to the frame containing its target sample
+        while (par->next_point < par->num_points &&
+               par->points[par->next_point].sample_number < first_sample + frame_samples) {
+            FLAC__StreamMetadata_SeekPoint *p = &par->points[par->next_point++];
+            p->sample_number = first_sample;
+            p->stream_offset = par->stream_bytes;
+            p->frame_samples = frame_samples;
+        }
+        // one sidecar point for all targets within the frame, as the sorted seektable has
+        if (par->sidecar && par->sidecar_next < first_sample + frame_samples) {
+            while (par->sidecar_next < first_sample + frame_samples) par->sidecar_next += par->sidecar_spacing;
+            put_be(point, first_sample, 8);
+            put_be(point + 8, par->stream_bytes, 8);
+            put_be(point + 16, frame_samples, 2);
+            if (fwrite(point, 1, sizeof(point), par->sidecar) != sizeof(point)) return -1;
+        }
+
+        if (job->frame_bytes[i] < par->min_frame_bytes || par->min_frame_bytes == 0) {
+            par->min_frame_bytes = job->frame_bytes[i];
+        }
+        if (job->frame_bytes[i] > par->max_frame_bytes) par->max_frame_bytes = job->frame_bytes[i];
+        par->stream_bytes += job->frame_bytes[i];
+        par->frames_written++;
+    }
+    par->samples_coded += job->num_samples;
+    return 0;
+}
+
+// bring STREAMINFO (and an in-stream seektable) up to the frames written so
+// far and hand everything to the OS, a file cut off later decodes and seeks
+static int par_checkpoint(flac_writer_t *writer) {
+    flac_par_t *par = writer->par;
+
+    par->next_checkpoint = par->samples_coded + par->checkpoint_samples;
+    if (par->sidecar && fflush(par->sidecar) != 0) {
+        report_error(writer, FLAC_WRITER_ERR_PROCESS, "Failed to write FLAC seek sidecar");
+        return -1;
+    }
+    if (par->metadata_pos < 0) return 0;
+    if (fseek(writer->output_file, par->metadata_pos, SEEK_SET) != 0 ||
+        !par_write_metadata(writer, par->samples_coded, false) ||
+        fseek(writer->output_file, 0, SEEK_END) != 0 ||
+        fflush(writer->output_file) != 0) {
+        report_error(writer, FLAC_WRITER_ERR_PROCESS, "Failed to checkpoint FLAC metadata");
+        return -1;
+    }
+    return 0;
+}
+
+// step the level of the next jobs from the encode time of a written job
+static void par_adapt(flac_writer_t *writer, const par_job_t *job, uint64_t seq) {
+    flac_par_t *par = writer->par;
+    const flac_writer_config_t *cfg = &writer->config;
+
+    // only full jobs submitted after the last step tell about the current level
+    if (seq < par->level_seq || job->num_samples != par->job_samples) return;
+
+    double ns = (double)job->encode_ns / job->num_samples;
+    par->ns_per_sample = par->level_jobs ? par->ns_per_sample * 0.75 + ns * 0.25 : ns;
+    // let every worker finish a job at the new level first
+    if (++par->level_jobs < par_threads(par)) return;
+
+    uint64_t now = get_time_ms();
+    if (par->ceiling != 0xff && now - par->ceiling_ms >= FLAC_ADAPT_RETRY_MS) par->ceiling = 0xff;
+
+    double fill = cfg->backlog_cb ? cfg->backlog_cb(cfg->callback_user_data) : 0.0;
+    // workers' sample rate against the input, without a rate only the backlog counts
+    double headroom = FLAC_ADAPT_HEADROOM_HIGH;
+    if (cfg->realtime_rate > 0.0 && par->ns_per_sample > 0.0) {
+        headroom = par_threads(par) * 1e9 / (par->ns_per_sample * cfg->realtime_rate);
+    }
+
+    uint8_t level = par->level;
+    if ((fill > FLAC_ADAPT_FILL_HIGH || headroom < FLAC_ADAPT_HEADROOM_LOW) &&
+        level > cfg->compression_level_min) {
+        par->ceiling = level;
+        par->ceiling_ms = now;
+        level--;
+    } else if (fill < FLAC_ADAPT_FILL_LOW && headroom >= FLAC_ADAPT_HEADROOM_HIGH &&
+               level < cfg->compression_level_max && level + 1 < par->ceiling) {
+        level++;
+    }
+    if (level != par->level) {
+        par->level = level;
+        par->level_seq = par->next_seq;
+        par->level_jobs = 0;
+    }
+}
+
+// write finished jobs in order, waiting for the oldest ones while more than
+// max_pending are submitted but not written yet
+static int par_write_jobs(flac_writer_t *writer, uint64_t max_pending) {
+    flac_par_t *par = writer->par;
+
+    while (par->write_seq < par->next_seq) {
+        par_job_t *job = &par->jobs[par->write_seq % par->num_jobs];
+        if (atomic_load(&job->state) != PAR_JOB_DONE) {
+            if (par->next_seq - par->write_seq <= max_pending) break;
+            TRACE_BEGIN("flac_wait");
+            while (atomic_load(&job->state) != PAR_JOB_DONE) rb_event_wait(&job->done);
+            TRACE_END("flac_wait");
+        }
+        if (job->failed) {
+            report_error(writer, FLAC_WRITER_ERR_PROCESS, job->error_message);
+            return -1;
+        }
+        TRACE_BEGIN("flac_write");
+        size_t written = fwrite(job->out, 1, job->out_len, writer->output_file);
+        TRACE_END("flac_write");
+        if (written != job->out_len) {
+            report_error(writer, FLAC_WRITER_ERR_PROCESS, "Failed to write FLAC frames");
+            return -1;
+        }
+        if (par_job_written(writer, job) != 0) {
+            report_error(writer, FLAC_WRITER_ERR_PROCESS, "Failed to write FLAC seek sidecar");
+            return -1;
+        }
+        if (par->checkpoint_samples && par->samples_coded >= par->next_checkpoint && par_checkpoint(writer) != 0) {
+            return -1;
+        }
+        if (writer->config.adaptive_level) par_adapt(writer, job, par->write_seq);
+        writer->bytes_written += job->out_len;
+        if (writer->config.bytes_cb) {
+            writer->config.bytes_cb(writer->config.callback_user_data, job->out_len);
+        }
+        job->num_samples = 0;
+        atomic_store(&job->state, PAR_JOB_FREE);
+        par->write_seq++;
+    }
+    return 0;
+}
+
+static int par_submit(flac_writer_t *writer) {
+    flac_par_t *par = writer->par;
+    par_job_t *job = par->fill;
+
+    par->fill = NULL;
+    job->level = par->level;
+    atomic_store(&job->state, PAR_JOB_READY);
+    if (par->pooled) {
+        atomic_store(&par->ready_seq, par->next_seq + 1);
+        pool_wake();
+    } else {
+        rb_event_signal(&par->workers[par->next_seq % par->num_workers].work);
+    }
+    par->next_seq++;
+    // keep the output moving without waiting
+    return par_write_jobs(writer, par->num_jobs);
+}
+
+// takes either int32 or int16 samples, the latter are widened straight into the job
+// counts are per channel, the samples of all channels are interleaved
+static int par_process(flac_writer_t *writer, const int32_t *samples, const int16_t *samples16,
+                       uint32_t num_samples) {
+    flac_par_t *par = writer->par;
+    uint32_t ch = par->channels;
+    uint32_t done = 0;
+
+    while (done < num_samples) {
+        if (!par->fill) {
+            // the slot for the next job is free once its previous job is written
+            if (par_write_jobs(writer, par->num_jobs - 1) != 0) return -1;
+            par->fill = &par->jobs[par->next_seq % par->num_jobs];
+            par->fill->first_frame = par->next_seq * FLAC_PAR_FRAMES_PER_JOB;
+        }
+        par_job_t *job = par->fill;
+        uint32_t n = par->job_samples - job->num_samples;
+        if (n > num_samples - done) n = num_samples - done;
+        int32_t *dst = job->samples + (size_t)job->num_samples * ch;
+        if (samples16) {
+            for (uint32_t i = 0; i < n * ch; i++) dst[i] = samples16[(size_t)done * ch + i];
+        } else {
+            memcpy(dst, samples + (size_t)done * ch, (size_t)n * ch * sizeof(int32_t));
+        }
+        par_md5_samples(par, dst, n * ch);
+        job->num_samples += n;
+        done += n;
+        if (job->num_samples == par->job_samples && par_submit(writer) != 0) return -1;
+    }
+
+    writer->samples_written += num_samples;
+    return (int)num_samples;
+}
+
+static void par_destroy(flac_par_t *par) {
+    if (!par) return;
+
+    if (par->pooled) pool_unregister(par);
+    atomic_store(&par->exit, true);
+    for (uint32_t i = 0; i < par->num_workers; i++) {
+        if (par->workers[i].started) rb_event_signal(&par->workers[i].work);
+    }
+    for (uint32_t i = 0; i < par->num_workers; i++) {
+        par_worker_t *worker = &par->workers[i];
+        if (worker->started) thrd_join(worker->thread, NULL);
+        if (worker->encoder) FLAC__stream_encoder_delete(worker->encoder);
+        rb_event_destroy(&worker->work);
+    }
+    for (uint32_t i = 0; i < par->num_jobs; i++) {
+        rb_event_destroy(&par->jobs[i].done);
+        free(par->jobs[i].samples);
+        free(par->jobs[i].out);
+    }
+    // after an abort the points so far are still useful
+    if (par->sidecar) fclose(par->sidecar);
+    free(par->workers);
+    free(par->jobs);
+    free(par->points);
+    free(par);
+}
+
+static flac_writer_error_t par_create(flac_writer_t *writer) {
+    const flac_writer_config_t *cfg = &writer->config;
+    bool pooled = cfg->shared_pool && s_pool;
+    uint32_t threads = cfg->num_threads ? cfg->num_threads : get_cpu_count();
+    if (pooled) {
+        // jobs to keep the writer's share of the pool busy, the pool has no per-writer threads
+        threads = s_pool->num_workers;
+        if (threads > FLAC_POOL_WRITER_THREADS) threads = FLAC_POOL_WRITER_THREADS;
+    }
+    if (threads > FLAC_PAR_MAX_THREADS) threads = FLAC_PAR_MAX_THREADS;
+
+    flac_par_t *par = calloc(1, sizeof(flac_par_t));
+    if (!par) {
+        report_error(writer, FLAC_WRITER_ERR_ALLOC, "Failed to allocate FLAC block-parallel state");
+        return FLAC_WRITER_ERR_ALLOC;
+    }
+    writer->par = par;
+    par->config = cfg;
+    par->channels = config_channels(cfg);
+    par->level = cfg->compression_level;
+    par->ceiling = 0xff;
+    // libflac's block size for the level (the highest one when adaptive), set
+    // explicitly so all workers agree
+    uint8_t block_level = cfg->adaptive_level ? cfg->compression_level_max : cfg->compression_level;
+    par->blocksize = block_level <= 2 ? 1152 : 4096;
+    par->job_samples = par->blocksize * FLAC_PAR_FRAMES_PER_JOB;
+    par->workers = pooled ? NULL : calloc(threads, sizeof(par_worker_t));
+    par->jobs = calloc(threads * FLAC_PAR_JOBS_PER_THREAD, sizeof(par_job_t));
+    if ((!pooled && !par->workers) || !par->jobs) {
+        report_error(writer, FLAC_WRITER_ERR_ALLOC, "Failed to allocate FLAC block-parallel state");
+        return FLAC_WRITER_ERR_ALLOC;
+    }
+    par_init_crc(par);
+    md5_init(&par->md5);
+
+    for (uint32_t i = 0; i < threads * FLAC_PAR_JOBS_PER_THREAD; i++) {
+        par_job_t *job = &par->jobs[i];
+        par->num_jobs++;
+        // about the input size, the write callback grows it if a job does not compress
+        job->out_size = (size_t)par->job_samples * par->channels * ((cfg->bits_per_sample + 7u) / 8u);
+        job->samples = malloc((size_t)par->job_samples * par->channels * sizeof(int32_t));
+        job->out = malloc(job->out_size);
+        if (rb_event_init(&job->done) != 0 || !job->samples || !job->out) {
+            report_error(writer, FLAC_WRITER_ERR_ALLOC, "Failed to allocate FLAC block-parallel jobs");
+            return FLAC_WRITER_ERR_ALLOC;
+        }
+    }
+
+    for (uint32_t i = 0; !pooled && i < threads; i++) {
+        par_worker_t *worker = &par->workers[i];
+        par->num_workers++;
+        worker->par = par;
+        worker->index = i;
+        worker->encoder = FLAC__stream_encoder_new();
+        if (!worker->encoder || rb_event_init(&worker->work) != 0) {
+            report_error(writer, FLAC_WRITER_ERR_ALLOC, "Failed to allocate FLAC encoder");
+            return FLAC_WRITER_ERR_ALLOC;
+        }
+    }
+    for (uint32_t i = 0; !pooled && i < threads; i++) {
+        if (thrd_create(&par->workers[i].thread, &par_worker_thread, &par->workers[i]) != thrd_success) {
+            report_error(writer, FLAC_WRITER_ERR_THREADS, "Failed to start FLAC encoder threads");
+            return FLAC_WRITER_ERR_THREADS;
+        }
+        par->workers[i].started = true;
+    }
+
+    uint32_t spacing = cfg->seektable_spacing;
+    if (spacing == 0) spacing = 1 << 18;
+    if (cfg->seek_sidecar) {
+        par->sidecar = fopen(cfg->seek_sidecar, "wb");
+        if (!par->sidecar) {
+            report_error(writer, FLAC_WRITER_ERR_SEEKTABLE, "Failed to create FLAC seek sidecar");
+            return FLAC_WRITER_ERR_SEEKTABLE;
+        }
+        par->sidecar_spacing = spacing;
+    }
+    par->checkpoint_samples = (uint64_t)cfg->checkpoint_seconds * cfg->sample_rate;
+    par->next_checkpoint = par->checkpoint_samples;
+
+    // metadata can only be completed afterwards when we are able to seek back
+    par->metadata_pos = ftell(writer->output_file);
+    if (par->metadata_pos >= 0 && cfg->enable_seektable && !par->sidecar) {
+        // same estimate as the libflac seektable template, capped to one metadata block
+        uint64_t num_points = ((uint64_t)1 << 41) / spacing;
+        if (num_points > FLAC_PAR_MAX_SEEKPOINTS) num_points = FLAC_PAR_MAX_SEEKPOINTS;
+        par->points = calloc((size_t)num_points, sizeof(FLAC__StreamMetadata_SeekPoint));
+        if (!par->points) {
+            report_error(writer, FLAC_WRITER_ERR_SEEKTABLE, "Failed to allocate seektable");
+            return FLAC_WRITER_ERR_SEEKTABLE;
+        }
+        par->num_points = (uint32_t)num_points;
+        for (uint32_t i = 0; i < par->num_points; i++) {
+            par->points[i].sample_number = (uint64_t)i * spacing;
+        }
+    }
+
+    if (!par_write_metadata(writer, 0, false)) {
+        report_error(writer, FLAC_WRITER_ERR_INIT, "Failed to write FLAC metadata");
+        return FLAC_WRITER_ERR_INIT;
+    }
+    writer->bytes_written += 8 + FLAC_PAR_STREAMINFO_LEN +
+                             (par->num_points ? 4 + (uint64_t)par->num_points * FLAC_PAR_SEEKPOINT_LEN : 0);
+
+    if (pooled) {
+        if (!pool_register(par)) {
+            report_error(writer, FLAC_WRITER_ERR_THREADS, "Too many FLAC writers on the encoder pool");
+            return FLAC_WRITER_ERR_THREADS;
+        }
+        par->pooled = true;
+    }
+    return FLAC_WRITER_OK;
+}
+
+static flac_writer_error_t par_finish(flac_writer_t *writer) {
+    flac_par_t *par = writer->par;
+
+    if (par->fill && par->fill->num_samples > 0 && par_submit(writer) != 0) return FLAC_WRITER_ERR_FINISH;
+    if (par_write_jobs(writer, 0) != 0) return FLAC_WRITER_ERR_FINISH;
+
+    if (par->metadata_pos >= 0) {
+        // seeking back only works within the first 2 GiB with fseek(), plenty for the metadata
+        if (fseek(writer->output_file, par->metadata_pos, SEEK_SET) != 0 ||
+            !par_write_metadata(writer, writer->samples_written, true) ||
+            fseek(writer->output_file, 0, SEEK_END) != 0) {
+            report_error(writer, FLAC_WRITER_ERR_FINISH, "Failed to update FLAC metadata");
+            return FLAC_WRITER_ERR_FINISH;
+        }
+    }
+    if (par->sidecar) {
+        int err = fclose(par->sidecar);
+        par->sidecar = NULL;
+        if (err != 0) {
+            report_error(writer, FLAC_WRITER_ERR_FINISH, "Failed to write FLAC seek sidecar");
+            return FLAC_WRITER_ERR_FINISH;
+        }
+    }
+    return FLAC_WRITER_OK;
+}
+
+// block-parallel mode is libflac's only way to multiple threads before API v14,
+// the only one where the level can change within the stream and the only one
+// that leaves the metadata to us
+static bool use_block_parallel(const flac_writer_config_t *config) {
+    if (config->adaptive_level || (config->shared_pool && s_pool)) return true;
+    if (config->seek_sidecar || config->checkpoint_seconds) return true;
+    if (config->num_threads <= 1) return false;
+#if defined(FLAC_API_VERSION_CURRENT) && FLAC_API_VERSION_CURRENT >= 14
+    return config->block_parallel;
+#else
+    return true;
+#endif
+}
+
+static flac_writer_t *create_block_parallel(flac_writer_t *writer) {
+    if (par_create(writer) != FLAC_WRITER_OK) {
+        par_destroy(writer->par);
+        free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
 /* ============================================================================
  * Create Writer (FILE mode)
  * ============================================================================ */
@@ -225,6 +1234,8 @@ flac_writer_t *flac_writer_create_file(FILE *output_file, const flac_writer_conf
     writer->output_file = output_file;
     writer->use_stream_callbacks = false;
 
+    if (use_block_parallel(config)) return create_block_parallel(writer);
+
     writer->encoder = FLAC__stream_encoder_new();
     if (!writer->encoder) {
         report_error(writer, FLAC_WRITER_ERR_ALLOC, "Failed to allocate FLAC encoder");
@@ -268,6 +1279,8 @@ flac_writer_t *flac_writer_create_stream(FILE *output_file, const flac_writer_co
     writer->output_file = output_file;
     writer->use_stream_callbacks = true;
 
+    if (use_block_parallel(config)) return create_block_parallel(writer);
+
     writer->encoder = FLAC__stream_encoder_new();
     if (!writer->encoder) {
         report_error(writer, FLAC_WRITER_ERR_ALLOC, "Failed to allocate FLAC encoder");
@@ -313,14 +1326,16 @@ flac_writer_t *flac_writer_create_stream(FILE *output_file, const flac_writer_co
 /* ============================================================================
  * Process Samples (int32_t)
  * ============================================================================ */
-int flac_writer_process(flac_writer_t *writer, const int32_t *samples, uint32_t num_samples) {
-    if (!writer || !samples || num_samples == 0) return -1;
-
-    // FLAC expects pointer to array of pointers (for multi-channel)
-    // For mono, we pass address of our single pointer
-    const FLAC__int32 *channel_ptrs[1] = { samples };
-
-    FLAC__bool ok = FLAC__stream_encoder_process(writer->encoder, channel_ptrs, num_samples);
+static int encoder_process(flac_writer_t *writer, const int32_t *samples, uint32_t num_samples) {
+    FLAC__bool ok;
+    if (config_channels(&writer->config) > 1) {
+        ok = FLAC__stream_encoder_process_interleaved(writer->encoder, samples, num_samples);
+    } else {
+        // FLAC expects pointer to array of pointers (for multi-channel)
+        // For mono, we pass address of our single pointer
+        const FLAC__int32 *channel_ptrs[1] = { samples };
+        ok = FLAC__stream_encoder_process(writer->encoder, channel_ptrs, num_samples);
+    }
     if (!ok) {
         char msg[256];
         snprintf(msg, sizeof(msg), "FLAC process error: %s",
@@ -333,29 +1348,53 @@ int flac_writer_process(flac_writer_t *writer, const int32_t *samples, uint32_t
     return (int)num_samples;
 }
 
+int flac_writer_process(flac_writer_t *writer, const int32_t *samples, uint32_t num_samples) {
+    int result;
+    if (!writer || !samples || num_samples == 0) return -1;
+
+    TRACE_BEGIN("flac_process");
+    if (writer->par) result = par_process(writer, samples, NULL, num_samples);
+    else result = encoder_process(writer, samples, num_samples);
+    TRACE_END("flac_process");
+    return result;
+}
+
 /* ============================================================================
  * Process Samples (int16_t convenience)
  * ============================================================================ */
-int flac_writer_process_int16(flac_writer_t *writer, const int16_t *samples, uint32_t num_samples) {
-    if (!writer || !samples || num_samples == 0) return -1;
-
-    // Ensure conversion buffer is large enough
-    if (writer->conv_buffer_size < num_samples) {
-        int32_t *new_buf = realloc(writer->conv_buffer, num_samples * sizeof(int32_t));
-        if (!new_buf) {
+static int encoder_process_int16(flac_writer_t *writer, const int16_t *samples, uint32_t num_samples) {
+    if (!writer->conv_buffer) {
+        writer->conv_buffer = malloc(FLAC_WRITER_SCRATCH_SAMPLES * sizeof(int32_t));
+        if (!writer->conv_buffer) {
             report_error(writer, FLAC_WRITER_ERR_ALLOC, "Failed to allocate conversion buffer");
             return -1;
         }
-        writer->conv_buffer = new_buf;
-        writer->conv_buffer_size = num_samples;
     }
 
-    // Convert int16 to int32 (sign-extend)
-    for (uint32_t i = 0; i < num_samples; i++) {
-        writer->conv_buffer[i] = samples[i];
+    // Convert int16 to int32 (sign-extend) one scratch buffer at a time
+    uint32_t ch = config_channels(&writer->config);
+    for (uint32_t done = 0; done < num_samples; ) {
+        uint32_t n = num_samples - done;
+        if (n > FLAC_WRITER_SCRATCH_SAMPLES / ch) n = FLAC_WRITER_SCRATCH_SAMPLES / ch;
+        for (uint32_t i = 0; i < n * ch; i++) {
+            writer->conv_buffer[i] = samples[(size_t)done * ch + i];
+        }
+        if (encoder_process(writer, writer->conv_buffer, n) < 0) return -1;
+        done += n;
     }
 
-    return flac_writer_process(writer, writer->conv_buffer, num_samples);
+    return (int)num_samples;
+}
+
+int flac_writer_process_int16(flac_writer_t *writer, const int16_t *samples, uint32_t num_samples) {
+    int result;
+    if (!writer || !samples || num_samples == 0) return -1;
+
+    TRACE_BEGIN("flac_process");
+    if (writer->par) result = par_process(writer, NULL, samples, num_samples);
+    else result = encoder_process_int16(writer, samples, num_samples);
+    TRACE_END("flac_process");
+    return result;
 }
 
 /* ============================================================================
@@ -364,6 +1403,14 @@ int flac_writer_process_int16(flac_writer_t *writer, const int16_t *samples, uin
 flac_writer_error_t flac_writer_finish(flac_writer_t *writer) {
     if (!writer) return FLAC_WRITER_ERR_ALLOC;
 
+    if (writer->par) {
+        flac_writer_error_t par_result = par_finish(writer);
+        par_destroy(writer->par);
+        if (writer->conv_buffer) free(writer->conv_buffer);
+        free(writer);
+        return par_result;
+    }
+
     // Sort seektable before finishing
     if (writer->seektable) {
         FLAC__metadata_object_seektable_template_sort(writer->seektable, false);
@@ -403,8 +1450,9 @@ flac_writer_error_t flac_writer_finish(flac_writer_t *writer) {
 void flac_writer_abort(flac_writer_t *writer) {
     if (!writer) return;
 
+    par_destroy(writer->par);
     if (writer->seektable) FLAC__metadata_object_delete(writer->seektable);
-    FLAC__stream_encoder_delete(writer->encoder);
+    if (writer->encoder) FLAC__stream_encoder_delete(writer->encoder);
     if (writer->conv_buffer) free(writer->conv_buffer);
     free(writer);
 }
@@ -424,6 +1472,11 @@ uint64_t flac_writer_get_bytes_written(flac_writer_t *writer) {
     return writer ? writer->bytes_written : 0;
 }
 
+uint8_t flac_writer_get_compression_level(flac_writer_t *writer) {
+    if (!writer) return 0;
+    return writer->par ? writer->par->level : writer->config.compression_level;
+}
+
 bool flac_writer_available(void) {
     return true;
 }
@@ -433,11 +1486,64 @@ const char *flac_writer_get_flac_version(void) {
 }
 
 bool flac_writer_multithreading_available(void) {
-#if defined(FLAC_API_VERSION_CURRENT) && FLAC_API_VERSION_CURRENT >= 14
-    return true;
-#else
-    return false;
-#endif
+    return true;  // libflac's own threads or block-parallel mode
+}
+
+/* ============================================================================
+ * Shared Encoder Pool
+ * ============================================================================ */
+int flac_writer_pool_start(uint32_t threads) {
+    if (s_pool) return -1;
+    if (threads == 0) threads = get_cpu_count();
+    if (threads > FLAC_PAR_MAX_THREADS) threads = FLAC_PAR_MAX_THREADS;
+
+    flac_pool_t *pool = calloc(1, sizeof(flac_pool_t));
+    if (!pool) return -1;
+    atomic_flag_clear(&pool->lock);
+    pool->workers = calloc(threads, sizeof(par_worker_t));
+    if (!pool->workers) {
+        free(pool);
+        return -1;
+    }
+    s_pool = pool;
+    for (uint32_t i = 0; i < threads; i++) {
+        par_worker_t *worker = &pool->workers[i];
+        pool->num_workers++;
+        worker->index = i;
+        worker->next_slot = i % FLAC_POOL_MAX_WRITERS;
+        worker->encoder = FLAC__stream_encoder_new();
+        if (!worker->encoder || rb_event_init(&worker->work) != 0) {
+            flac_writer_pool_stop();
+            return -1;
+        }
+    }
+    for (uint32_t i = 0; i < threads; i++) {
+        if (thrd_create(&pool->workers[i].thread, &pool_worker_thread, &pool->workers[i]) != thrd_success) {
+            flac_writer_pool_stop();
+            return -1;
+        }
+        pool->workers[i].started = true;
+    }
+    return 0;
+}
+
+void flac_writer_pool_stop(void) {
+    flac_pool_t *pool = s_pool;
+    if (!pool) return;
+
+    atomic_store(&pool->exit, true);
+    for (uint32_t i = 0; i < pool->num_workers; i++) {
+        if (pool->workers[i].started) rb_event_signal(&pool->workers[i].work);
+    }
+    for (uint32_t i = 0; i < pool->num_workers; i++) {
+        par_worker_t *worker = &pool->workers[i];
+        if (worker->started) thrd_join(worker->thread, NULL);
+        if (worker->encoder) FLAC__stream_encoder_delete(worker->encoder);
+        rb_event_destroy(&worker->work);
+    }
+    s_pool = NULL;
+    free(pool->workers);
+    free(pool);
 }
 
 #else // LIBFLAC_ENABLED != 1
@@ -485,8 +1591,42 @@ const char *flac_writer_get_error_string(flac_writer_t *w) {
 
 uint64_t flac_writer_get_samples_written(flac_writer_t *w) { (void)w; return 0; }
 uint64_t flac_writer_get_bytes_written(flac_writer_t *w) { (void)w; return 0; }
+uint8_t flac_writer_get_compression_level(flac_writer_t *w) { (void)w; return 0; }
 bool flac_writer_available(void) { return false; }
 const char *flac_writer_get_flac_version(void) { return "N/A"; }
 bool flac_writer_multithreading_available(void) { return false; }
+int flac_writer_pool_start(uint32_t threads) { (void)threads; return -1; }
+void flac_writer_pool_stop(void) { }
 
 #endif // LIBFLAC_ENABLED
+
+/* ============================================================================
+ * Level Argument Parsing (also without FLAC, for option parsing)
+ * ============================================================================ */
+int flac_writer_parse_level(const char *arg, flac_writer_config_t *config) {
+    unsigned lo, hi;
+    char end;
+
+    if (!arg || !config) return -1;
+    if (strcmp(arg, "auto") == 0) {
+        lo = 0;
+        hi = 8;
+    } else if (sscanf(arg, "%u-%u%c", &lo, &hi, &end) == 2) {
+        if (lo > hi) return -1;
+    } else if (sscanf(arg, "%u%c", &lo, &end) == 1) {
+        if (lo > 8) return -1;
+        config->compression_level = (uint8_t)lo;
+        config->adaptive_level = false;
+        return 0;
+    } else {
+        return -1;
+    }
+    if (hi > 8) return -1;
+
+    // start at the bottom, the level only goes up with measured headroom
+    config->compression_level = (uint8_t)lo;
+    config->compression_level_min = (uint8_t)lo;
+    config->compression_level_max = (uint8_t)hi;
+    config->adaptive_level = lo != hi;
+    return 0;
+}
@@ -3,6 +3,37 @@
  *
  * Provides a unified API for FLAC encoding used by both CLI and GUI tools.
  * Supports configurable bit depth, compression, multi-threading, and seektables.
+ *
+ * Multi-threading uses libflac's own threads (libflac >= 1.5.0) or the
+ * block-parallel mode: the stream is split into runs of frames which are
+ * encoded by a pool of single-threaded encoders and stitched back together
+ * with renumbered frame headers, the writer then emits STREAMINFO (incl. MD5)
+ * and the seektable itself. This works with any libflac version and also
+ * scales at the higher compression levels.
+ *
+ * With an adaptive level the block-parallel mode is always used, as it sets
+ * up the encoder for every job anyway: the level of each job is stepped
+ * between the bounds from the measured encode time against the real-time
+ * rate and the fill of the caller's input buffer.
+ *
+ * Several writers in one process (e.g. one per channel of several devices)
+ * can share one pool of block-parallel encoders started with
+ * flac_writer_pool_start(), instead of each bringing its own threads. Idle
+ * pool workers take the oldest job of the next writer that has one, so the
+ * cores go wherever there is work.
+ *
+ * The seektable of a long recording is a large placeholder in front of the
+ * frames which is only filled in when the writer finishes. With a seek
+ * sidecar the seek points go to a file of their own as the frames are
+ * written instead, and with checkpoints STREAMINFO is brought up to date
+ * every few seconds, so finishing only rewrites those 42 bytes and a
+ * recording that was cut off stays seekable. Both use the block-parallel
+ * mode, where the writer keeps the metadata itself.
+ *
+ * The sidecar holds the 18 byte seek points one after the other, exactly as
+ * in the body of a SEEKTABLE block (big endian sample number, offset from
+ * the first frame and frame samples), in ascending order. A partial point
+ * at its end is left over from an interruption and is to be ignored.
  */
 
 #ifndef FLAC_WRITER_H
@@ -41,6 +72,10 @@ typedef void (*flac_error_callback_t)(
     const char *message
 );
 
+// Input backlog callback - fill of the buffer the writer is fed from (0.0 - 1.0)
+// Used by the adaptive level to step down before the buffer overflows
+typedef double (*flac_backlog_callback_t)(void *user_data);
+
 // Bytes written callback - for tracking compressed output size
 // GUI uses this to update atomic counter for compression ratio display
 typedef void (*flac_bytes_written_callback_t)(
@@ -54,20 +89,40 @@ typedef void (*flac_bytes_written_callback_t)(
 typedef struct {
     // Core encoder settings
     uint32_t sample_rate;            // Sample rate in Hz (default: 40000)
-    uint8_t bits_per_sample;         // 8, 12, or 16 (default: 16)
-    uint8_t compression_level;       // 0-8 (default: 1)
+    uint8_t bits_per_sample;         // 8, 12, 16 or 24 (default: 16)
+    uint8_t channels;                // 1-8, samples interleaved (default: 1)
+    uint8_t compression_level;       // 0-8 (default: 1), start level when adaptive
     bool verify;                     // Enable verification (default: false)
 
-    // Multi-threading (FLAC API v14+, requires libflac >= 1.5.0)
+    // Adaptive compression level
+    bool adaptive_level;             // Step the level per job within the bounds (default: false)
+    uint8_t compression_level_min;   // Lower bound (default: 0)
+    uint8_t compression_level_max;   // Upper bound (default: 8)
+    double realtime_rate;            // Input samples per second to sustain (0 = unknown,
+                                     // only the backlog is used then)
+
+    // Multi-threading
     uint32_t num_threads;            // 0 = auto-detect, 1 = single-threaded
+    bool block_parallel;             // Encode independent blocks on num_threads encoders
+                                     // instead of libflac's own threading (default: false,
+                                     // always used with more than one thread on libflac < 1.5)
+    bool shared_pool;                // Encode on the pool of flac_writer_pool_start() in
+                                     // block-parallel mode, num_threads is ignored then
+                                     // (default: false, own threads if no pool runs)
 
     // Seektable configuration
     bool enable_seektable;           // Generate seektable metadata (default: true)
     uint32_t seektable_spacing;      // Samples between seek points (0 = default: 1<<18)
+    const char *seek_sidecar;        // Write the seek points to this file as they are reached,
+                                     // instead of a seektable placeholder in the stream that has
+                                     // to be filled in at the end (default: NULL = off)
+    uint32_t checkpoint_seconds;     // Rewrite STREAMINFO with the samples so far this often, so
+                                     // a file cut off early still knows its length (0 = off)
 
     // Callbacks (all optional - NULL disables)
     flac_error_callback_t error_cb;
     flac_bytes_written_callback_t bytes_cb;
+    flac_backlog_callback_t backlog_cb;
     void *callback_user_data;        // Passed to all callbacks
 } flac_writer_config_t;
 
@@ -103,6 +158,8 @@ flac_writer_t *flac_writer_create_stream(
 // Process samples - samples are in int32_t format
 // For 12-bit: samples should be sign-extended 12-bit values in int32_t
 // For 16-bit: samples should be sign-extended 16-bit values in int32_t
+// With several channels the samples are interleaved and num_samples counts
+// samples per channel
 // Returns number of samples successfully processed, or -1 on error
 int flac_writer_process(
     flac_writer_t *writer,
@@ -110,9 +167,11 @@ int flac_writer_process(
     uint32_t num_samples
 );
 
-// Process int16_t samples (convenience function)
-// Internally converts to int32_t and calls flac_writer_process
-// Use this when your buffer contains int16_t data
+// Process int16_t samples (interleaved with several channels, like flac_writer_process())
+// Widens to int32_t in small chunks through a reused scratch buffer (or straight
+// into the job buffers in block-parallel mode), so callers can keep 16-bit
+// samples in their ringbuffers
+// Returns number of samples successfully processed, or -1 on error
 int flac_writer_process_int16(
     flac_writer_t *writer,
     const int16_t *samples,
@@ -137,13 +196,30 @@ uint64_t flac_writer_get_samples_written(flac_writer_t *writer);
 // Get total compressed bytes written so far (stream mode only)
 uint64_t flac_writer_get_bytes_written(flac_writer_t *writer);
 
+// Get the compression level of the data submitted last (writer thread)
+uint8_t flac_writer_get_compression_level(flac_writer_t *writer);
+
+// Parse a compression level argument into config: "N" (fixed), "auto" (adaptive 0-8)
+// or "N-M" (adaptive between N and M, starting at N)
+// Returns 0 on success, -1 if invalid
+int flac_writer_parse_level(const char *arg, flac_writer_config_t *config);
+
 // Check if FLAC support is compiled in
 bool flac_writer_available(void);
 
 // Get FLAC library version string (for diagnostics)
 const char *flac_writer_get_flac_version(void);
 
-// Check if multi-threading is available (requires FLAC API v14+)
+// Check if multi-threading is available (always with FLAC, block-parallel on libflac < 1.5)
 bool flac_writer_multithreading_available(void);
 
+// Start the process-wide encoder pool for writers with shared_pool set
+// threads: 0 = one per CPU
+// Call before creating those writers, only one pool can run
+// Returns 0 on success, -1 on failure or without FLAC
+int flac_writer_pool_start(uint32_t threads);
+
+// Stop the encoder pool, after all writers using it are finished or aborted
+void flac_writer_pool_stop(void);
+
 #endif // FLAC_WRITER_H
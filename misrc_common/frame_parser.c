@@ -5,7 +5,7 @@
  */
 
 #include "frame_parser.h"
-#include <hsdaoh_crc.h>
+#include "crc16.h"
 
 #include <string.h>
 
@@ -107,6 +107,8 @@ frame_sync_result_t frame_check_sync(frame_sync_state_t *state,
 void frame_crc_init(frame_crc_state_t *state)
 {
     memset(state, 0, sizeof(*state));
+    /* Set up the CRC tables here rather than on the first callback */
+    crc16_init();
 }
 
 bool frame_check_crc(frame_crc_state_t *state, const uint8_t *line_dat,
@@ -127,7 +129,7 @@ bool frame_check_crc(frame_crc_state_t *state, const uint8_t *line_dat,
 
     /* Update running CRC values */
     state->last_crc[1] = state->last_crc[0];
-    state->last_crc[0] = crc16_ccitt(line_dat, width * sizeof(uint16_t));
+    state->last_crc[0] = crc16_ccitt_fast(line_dat, width * sizeof(uint16_t));
 
     return (received_crc == expected_crc);
 }
@@ -171,12 +173,19 @@ void frame_parser_init(frame_parser_state_t *state)
  * High-Level Frame Processing
  *-----------------------------------------------------------------------------*/
 
-frame_process_result_t frame_process(frame_parser_state_t *state,
-                                      const uint8_t *buf,
-                                      unsigned int width,
-                                      unsigned int height,
-                                      const metadata_t *meta,
-                                      unsigned int sync_threshold)
+/* Single walk over the frame shared by frame_process() and
+ * frame_process_and_copy(). Payloads are only scattered while the stream is
+ * synced, as only then the frame can turn out valid. */
+static frame_process_result_t frame_walk(frame_parser_state_t *state,
+                                         const uint8_t *buf,
+                                         unsigned int width,
+                                         unsigned int height,
+                                         const metadata_t *meta,
+                                         unsigned int sync_threshold,
+                                         uint8_t *out_stream0,
+                                         uint8_t *out_stream1,
+                                         frame_payload_cb_t callback,
+                                         void *ctx)
 {
     frame_process_result_t result = {0};
     result.sync_result = FRAME_SYNC_OK;
@@ -216,6 +225,7 @@ frame_process_result_t frame_process(frame_parser_state_t *state,
     /* Parse all lines - always parse to update CRC/idle state */
     bool has_stream_id = (meta->flags & FLAG_STREAM_ID_PRESENT) != 0;
     bool has_crc = (meta->crc_config != CRC_NONE);
+    bool copy = state->sync.stream_synced && (out_stream0 || out_stream1 || callback);
 
     for (unsigned int line = 0; line < height; line++) {
         const uint8_t *line_dat = buf + (width * sizeof(uint16_t) * line);
@@ -248,7 +258,7 @@ frame_process_result_t frame_process(frame_parser_state_t *state,
 
             /* Always update CRC state */
             state->crc.last_crc[1] = state->crc.last_crc[0];
-            state->crc.last_crc[0] = crc16_ccitt(line_dat, width * sizeof(uint16_t));
+            state->crc.last_crc[0] = crc16_ccitt_fast(line_dat, width * sizeof(uint16_t));
         }
 
         /* Accumulate payload sizes by stream (only when synced) */
@@ -259,6 +269,23 @@ frame_process_result_t frame_process(frame_parser_state_t *state,
                 result.stream1_bytes += parsed.payload_len * sizeof(uint16_t);
             }
         }
+
+        /* Scatter the payload while the line is still in cache */
+        if (copy && parsed.payload_len > 0) {
+            size_t payload_bytes = parsed.payload_len * sizeof(uint16_t);
+
+            if (callback && !callback(ctx, parsed.stream_id, line_dat, payload_bytes)) {
+                continue;
+            }
+
+            if (parsed.stream_id == 0 && out_stream0) {
+                memcpy(out_stream0 + result.stream0_copied, line_dat, payload_bytes);
+                result.stream0_copied += payload_bytes;
+            } else if (parsed.stream_id == 1 && out_stream1) {
+                memcpy(out_stream1 + result.stream1_copied, line_dat, payload_bytes);
+                result.stream1_copied += payload_bytes;
+            }
+        }
     }
 
     /* Handle errors - only count when synced */
@@ -287,6 +314,40 @@ frame_process_result_t frame_process(frame_parser_state_t *state,
     return result;
 }
 
+frame_process_result_t frame_process(frame_parser_state_t *state,
+                                      const uint8_t *buf,
+                                      unsigned int width,
+                                      unsigned int height,
+                                      const metadata_t *meta,
+                                      unsigned int sync_threshold)
+{
+    return frame_walk(state, buf, width, height, meta, sync_threshold,
+                      NULL, NULL, NULL, NULL);
+}
+
+frame_process_result_t frame_process_and_copy(frame_parser_state_t *state,
+                                               const uint8_t *buf,
+                                               unsigned int width,
+                                               unsigned int height,
+                                               const metadata_t *meta,
+                                               unsigned int sync_threshold,
+                                               uint8_t *out_stream0,
+                                               uint8_t *out_stream1,
+                                               frame_payload_cb_t callback,
+                                               void *ctx)
+{
+    frame_process_result_t result = frame_walk(state, buf, width, height, meta,
+                                               sync_threshold, out_stream0,
+                                               out_stream1, callback, ctx);
+
+    /* Roll back: nothing may be published from a frame that is not valid */
+    if (!result.valid) {
+        result.stream0_copied = 0;
+        result.stream1_copied = 0;
+    }
+    return result;
+}
+
 size_t frame_copy_payloads_cb(const uint8_t *buf,
                                unsigned int width,
                                unsigned int height,
@@ -147,6 +147,8 @@ typedef struct {
     frame_sync_result_t sync_result;    /* Sync status (OK, acquired, missed, etc.) */
     size_t stream0_bytes;               /* Payload bytes for stream 0 (RF) */
     size_t stream1_bytes;               /* Payload bytes for stream 1 (audio) */
+    size_t stream0_copied;              /* Bytes scattered to stream 0 output (frame_process_and_copy) */
+    size_t stream1_copied;              /* Bytes scattered to stream 1 output (frame_process_and_copy) */
     int error_count;                    /* Number of CRC/idle errors in frame */
     bool valid;                         /* True if frame can be processed */
     bool report_errors;                 /* True if errors should be reported (after priming) */
@@ -233,4 +235,43 @@ size_t frame_copy_payloads_cb(const uint8_t *buf,
                                frame_payload_cb_t callback,
                                void *ctx);
 
+/*-----------------------------------------------------------------------------
+ * Single-pass Processing and Copying
+ *-----------------------------------------------------------------------------*/
+
+/* Process a frame and scatter its payloads in the same walk over the lines
+ *
+ * @param state         Parser state to update
+ * @param buf           Frame buffer from hsdaoh callback
+ * @param width         Width in 16-bit words
+ * @param height        Height (number of lines)
+ * @param meta          Metadata extracted from frame
+ * @param sync_threshold Number of in-order frames required for sync (typically 4)
+ * @param out_stream0   Output buffer for stream 0 (RF), or NULL to skip
+ * @param out_stream1   Output buffer for stream 1 (audio), or NULL to skip
+ * @param callback      Callback to decide whether to copy each payload (or NULL for all)
+ * @param ctx           User context passed to callback
+ * @return Processing result as frame_process(), plus the bytes written to
+ *         each output in stream0_copied/stream1_copied
+ *
+ * Each output must have room for a whole frame of payload
+ * (width * height * sizeof(uint16_t) bytes), e.g. a ringbuffer write pointer
+ * reserved before the call. Payloads are written while the lines are
+ * validated; if the frame turns out invalid, the copied counts are reset to 0
+ * so the caller simply does not commit the reserved space. Only the bytes
+ * reported in stream0_copied/stream1_copied should be committed.
+ *
+ * The callback may be called for lines of a frame that is rolled back later.
+ */
+frame_process_result_t frame_process_and_copy(frame_parser_state_t *state,
+                                               const uint8_t *buf,
+                                               unsigned int width,
+                                               unsigned int height,
+                                               const metadata_t *meta,
+                                               unsigned int sync_threshold,
+                                               uint8_t *out_stream0,
+                                               uint8_t *out_stream1,
+                                               frame_payload_cb_t callback,
+                                               void *ctx);
+
 #endif /* MISRC_FRAME_PARSER_H */
@@ -0,0 +1,153 @@
+/*
+ * MISRC Common - Raw Frame Queue Implementation
+ */
+
+#include "frame_queue.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "rb_event.h"
+
+struct frame_queue {
+    frame_queue_slot_t *slots;
+    unsigned depth;
+    size_t slot_size;
+    buffer_pool_t *pool;
+    atomic_uint head;                   /* Frames published, by the producer */
+    atomic_uint tail;                   /* Frames handed back, by the consumer */
+    atomic_uint high_water;             /* By the producer */
+    atomic_uint_fast64_t dropped;       /* By the producer */
+    rb_event_t data_event;              /* A frame was published */
+    rb_event_t space_event;             /* A slot was handed back */
+};
+
+/*-----------------------------------------------------------------------------
+ * Helpers
+ *-----------------------------------------------------------------------------*/
+
+static unsigned queued(frame_queue_t *q)
+{
+    return atomic_load_explicit(&q->head, memory_order_relaxed) - atomic_load_explicit(&q->tail, memory_order_acquire);
+}
+
+/*-----------------------------------------------------------------------------
+ * Public API
+ *-----------------------------------------------------------------------------*/
+
+bool frame_queue_depth_valid(unsigned depth)
+{
+    return depth >= 2 && depth <= FRAME_QUEUE_MAX_DEPTH && (depth & (depth - 1)) == 0;
+}
+
+frame_queue_t *frame_queue_create(unsigned depth, size_t slot_size, buffer_pool_t *pool)
+{
+    if (!frame_queue_depth_valid(depth)) return NULL;
+    frame_queue_t *q = calloc(1, sizeof(*q));
+    if (!q) return NULL;
+    q->slots = calloc(depth, sizeof(frame_queue_slot_t));
+    if (!q->slots) {
+        free(q);
+        return NULL;
+    }
+    q->depth = depth;
+    q->slot_size = slot_size;
+    q->pool = pool;
+    for (unsigned i = 0; i < depth; i++) {
+        if ((q->slots[i].buf = buffer_pool_get(pool, slot_size)) == NULL) {
+            frame_queue_free(q);
+            return NULL;
+        }
+    }
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->high_water, 0);
+    atomic_init(&q->dropped, 0);
+    if (rb_event_init(&q->data_event) != 0 || rb_event_init(&q->space_event) != 0) {
+        frame_queue_free(q);
+        return NULL;
+    }
+    return q;
+}
+
+frame_queue_slot_t *frame_queue_write_slot(frame_queue_t *q, size_t len, uint32_t timeout_ms)
+{
+    if (len <= q->slot_size) {
+        if (queued(q) == q->depth && timeout_ms != 0) rb_event_wait_timeout(&q->space_event, timeout_ms);
+        if (queued(q) < q->depth)
+            return &q->slots[atomic_load_explicit(&q->head, memory_order_relaxed) & (q->depth - 1)];
+    }
+    return NULL;
+}
+
+void frame_queue_drop(frame_queue_t *q)
+{
+    /* Single writer, so a relaxed load and store is enough */
+    atomic_store_explicit(&q->dropped, atomic_load_explicit(&q->dropped, memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+void frame_queue_write_finished(frame_queue_t *q)
+{
+    atomic_fetch_add_explicit(&q->head, 1, memory_order_release);
+    unsigned n = queued(q);
+    if (n > atomic_load_explicit(&q->high_water, memory_order_relaxed))
+        atomic_store_explicit(&q->high_water, n, memory_order_relaxed);
+    rb_event_signal(&q->data_event);
+}
+
+frame_queue_slot_t *frame_queue_read_slot_wait(frame_queue_t *q, uint32_t timeout_ms)
+{
+    unsigned tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    if (atomic_load_explicit(&q->head, memory_order_acquire) == tail) {
+        rb_event_wait_timeout(&q->data_event, timeout_ms);
+        if (atomic_load_explicit(&q->head, memory_order_acquire) == tail) return NULL;
+    }
+    return &q->slots[tail & (q->depth - 1)];
+}
+
+void frame_queue_read_finished(frame_queue_t *q)
+{
+    atomic_fetch_add_explicit(&q->tail, 1, memory_order_release);
+    rb_event_signal(&q->space_event);
+}
+
+void frame_queue_wake(frame_queue_t *q)
+{
+    rb_event_signal(&q->data_event);
+    rb_event_signal(&q->space_event);
+}
+
+unsigned frame_queue_fill(frame_queue_t *q)
+{
+    return atomic_load_explicit(&q->head, memory_order_acquire) - atomic_load_explicit(&q->tail, memory_order_acquire);
+}
+
+unsigned frame_queue_high_water(frame_queue_t *q)
+{
+    return atomic_load_explicit(&q->high_water, memory_order_relaxed);
+}
+
+uint64_t frame_queue_dropped(frame_queue_t *q)
+{
+    return atomic_load_explicit(&q->dropped, memory_order_relaxed);
+}
+
+unsigned frame_queue_depth(const frame_queue_t *q)
+{
+    return q->depth;
+}
+
+size_t frame_queue_slot_size(const frame_queue_t *q)
+{
+    return q->slot_size;
+}
+
+void frame_queue_free(frame_queue_t *q)
+{
+    if (!q) return;
+    for (unsigned i = 0; i < q->depth; i++) buffer_pool_put(q->pool, q->slots[i].buf);
+    rb_event_destroy(&q->data_event);
+    rb_event_destroy(&q->space_event);
+    free(q->slots);
+    free(q);
+}
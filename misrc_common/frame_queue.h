@@ -0,0 +1,114 @@
+/*
+ * MISRC Common - Raw Frame Queue
+ *
+ * Hands whole raw frames from the capture callback to a parser thread, so
+ * the callback only copies the frame and returns: sync, CRC, idle checks and
+ * the payload scatter into the ringbuffers run on the parser instead of the
+ * thread that delivers the USB transfers. The queue holds a fixed number of
+ * slots of one size, taken from a buffer pool when it is created, so nothing
+ * is allocated while frames come in.
+ *
+ * One producer (the callback) and one consumer (the parser). The producer
+ * fills the slot of frame_queue_write_slot() and publishes it with
+ * frame_queue_write_finished(), the consumer gets the oldest frame with
+ * frame_queue_read_slot_wait() and hands the slot back with
+ * frame_queue_read_finished() when it is done with the frame.
+ */
+
+#ifndef MISRC_FRAME_QUEUE_H
+#define MISRC_FRAME_QUEUE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "buffer_pool.h"
+
+#define FRAME_QUEUE_DEFAULT_DEPTH   8       /* Frames, about 130 ms of 1080p60 frames */
+#define FRAME_QUEUE_MAX_DEPTH       256     /* Depths are powers of two, see frame_queue_depth_valid() */
+
+/* A queued frame, the fields besides buf are filled in by the producer */
+typedef struct {
+    uint8_t *buf;               /* Raw frame, frame_queue_slot_size() bytes */
+    uint32_t len;               /* Bytes of the frame */
+    uint16_t width;             /* 16-bit words per line */
+    uint16_t height;
+    uint64_t arrival_ns;        /* When the callback got the frame */
+    bool device_error;          /* The library reported an error instead of a frame */
+    unsigned timing_flags;      /* frame_timing_add() result of the callback */
+    uint64_t interval_ns;       /* Since the previous frame */
+    uint64_t duration_ns;       /* Time the callback spent on the frame */
+} frame_queue_slot_t;
+
+typedef struct frame_queue frame_queue_t;
+
+/* Check a queue depth
+ *
+ * The free-running frame counters wrap at 2^32, so the slot of a frame is
+ * only the same before and after the wrap if the depth divides 2^32.
+ *
+ * @param depth         Slots
+ * @return true if depth is a power of two from 2 to FRAME_QUEUE_MAX_DEPTH
+ */
+bool frame_queue_depth_valid(unsigned depth);
+
+/* Create a queue
+ *
+ * @param depth         Slots, see frame_queue_depth_valid()
+ * @param slot_size     Largest frame in bytes
+ * @param pool          Committed pool with depth blocks of slot_size reserved
+ * @return The queue, NULL if the depth is invalid, out of memory or the pool has no blocks left
+ */
+frame_queue_t *frame_queue_create(unsigned depth, size_t slot_size, buffer_pool_t *pool);
+
+/* Free slot for the next frame, from the producer
+ *
+ * @param q             Queue
+ * @param len           Bytes of the frame
+ * @param timeout_ms    Wait this long for the consumer to free a slot, 0 to not wait
+ * @return The slot, NULL if the queue stayed full or the frame is larger than a slot
+ */
+frame_queue_slot_t *frame_queue_write_slot(frame_queue_t *q, size_t len, uint32_t timeout_ms);
+
+/* Count a frame the producer gave up on */
+void frame_queue_drop(frame_queue_t *q);
+
+/* Publish the slot of the last frame_queue_write_slot() */
+void frame_queue_write_finished(frame_queue_t *q);
+
+/* Oldest queued frame, from the consumer
+ *
+ * @param q             Queue
+ * @param timeout_ms    Wait this long for a frame
+ * @return The slot, NULL if none came or frame_queue_wake() was called
+ */
+frame_queue_slot_t *frame_queue_read_slot_wait(frame_queue_t *q, uint32_t timeout_ms);
+
+/* Hand back the slot of the last frame_queue_read_slot_wait() */
+void frame_queue_read_finished(frame_queue_t *q);
+
+/* Wake both sides from their waits, e.g. to stop */
+void frame_queue_wake(frame_queue_t *q);
+
+/* Frames queued or still being parsed, from any thread */
+unsigned frame_queue_fill(frame_queue_t *q);
+
+/* Most frames queued at once so far, from any thread */
+unsigned frame_queue_high_water(frame_queue_t *q);
+
+/* Frames counted by frame_queue_drop(), from any thread */
+uint64_t frame_queue_dropped(frame_queue_t *q);
+
+/* Slots of the queue */
+unsigned frame_queue_depth(const frame_queue_t *q);
+
+/* Largest frame a slot holds */
+size_t frame_queue_slot_size(const frame_queue_t *q);
+
+/* Return the slots to the pool and free the queue
+ *
+ * @param q             Queue (NULL is ignored)
+ */
+void frame_queue_free(frame_queue_t *q);
+
+#endif /* MISRC_FRAME_QUEUE_H */
@@ -0,0 +1,101 @@
+/*
+ * MISRC Common - Frame Arrival Timing Implementation
+ */
+
+#include "frame_timing.h"
+
+#include <math.h>
+#include <string.h>
+
+/*-----------------------------------------------------------------------------
+ * Helpers
+ *-----------------------------------------------------------------------------*/
+
+/* Single writer, so a relaxed load and store is enough */
+static void count(atomic_uint_fast64_t *c, uint64_t n)
+{
+    atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+/* Bucket of a time: the bit length of the whole microseconds */
+static int bucket_of(uint64_t ns)
+{
+    uint64_t us = ns / 1000;
+    int b = 0;
+    while (us && b < FRAME_TIMING_BUCKETS - 1) {
+        us >>= 1;
+        b++;
+    }
+    return b;
+}
+
+static void record(frame_timing_t *t, frame_timing_kind_t kind, uint64_t ns)
+{
+    count(&t->hist[kind][bucket_of(ns)], 1);
+    count(&t->sum_ns[kind], ns);
+    if (ns > atomic_load_explicit(&t->max_ns[kind], memory_order_relaxed))
+        atomic_store_explicit(&t->max_ns[kind], ns, memory_order_relaxed);
+}
+
+/*-----------------------------------------------------------------------------
+ * Public API
+ *-----------------------------------------------------------------------------*/
+
+void frame_timing_init(frame_timing_t *t)
+{
+    memset(t, 0, sizeof(*t));
+    for (int k = 0; k < FRAME_TIMING_KINDS; k++) {
+        for (int i = 0; i < FRAME_TIMING_BUCKETS; i++) atomic_init(&t->hist[k][i], 0);
+        atomic_init(&t->sum_ns[k], 0);
+        atomic_init(&t->max_ns[k], 0);
+    }
+    atomic_init(&t->late, 0);
+    atomic_init(&t->slow, 0);
+    atomic_init(&t->period_ns, 0);
+}
+
+void frame_timing_set_period(frame_timing_t *t, uint64_t samples, uint32_t sample_rate)
+{
+    if (sample_rate == 0 || samples == 0) return;
+    atomic_store_explicit(&t->period_ns, samples * 1000000000ull / sample_rate, memory_order_relaxed);
+}
+
+unsigned frame_timing_add(frame_timing_t *t, uint64_t arrival_ns, uint64_t done_ns)
+{
+    uint64_t period = atomic_load_explicit(&t->period_ns, memory_order_relaxed);
+    unsigned flags = 0;
+
+    t->interval_ns = t->last_arrival_ns ? arrival_ns - t->last_arrival_ns : 0;
+    t->duration_ns = done_ns - arrival_ns;
+    if (t->last_arrival_ns) {
+        record(t, FRAME_TIMING_INTERVAL, t->interval_ns);
+        if (period && (double)t->interval_ns > FRAME_TIMING_LATE_FACTOR * (double)period) {
+            count(&t->late, 1);
+            flags |= FRAME_TIMING_LATE;
+        }
+    }
+    t->last_arrival_ns = arrival_ns;
+    record(t, FRAME_TIMING_DURATION, t->duration_ns);
+    if (period && t->duration_ns > period) {
+        count(&t->slow, 1);
+        flags |= FRAME_TIMING_SLOW;
+    }
+    return flags;
+}
+
+void frame_timing_add_parse(frame_timing_t *t, uint64_t ns)
+{
+    record(t, FRAME_TIMING_PARSE, ns);
+}
+
+double frame_timing_read(frame_timing_t *t, frame_timing_kind_t kind, uint64_t *counts)
+{
+    for (int i = 0; i < FRAME_TIMING_BUCKETS; i++)
+        counts[i] = atomic_load_explicit(&t->hist[kind][i], memory_order_relaxed);
+    return (double)atomic_load_explicit(&t->sum_ns[kind], memory_order_relaxed) * 1e-9;
+}
+
+double frame_timing_bucket_bound(int bucket)
+{
+    return (bucket < FRAME_TIMING_BUCKETS - 1) ? ldexp(1e-6, bucket) : INFINITY;
+}
@@ -0,0 +1,97 @@
+/*
+ * MISRC Common - Frame Arrival Timing
+ *
+ * Timestamps every frame with the host monotonic clock when the capture
+ * callback gets it, and keeps streaming histograms of the time between
+ * frames and of how long the callback spent on each. Against the frame
+ * period the hsdaoh metadata implies (RF samples per frame at the stream
+ * sample rate), a frame that comes much later than its predecessor is late
+ * and a callback that takes longer than a period is slow: both leave the
+ * USB controller without a free buffer for a while, the source of drops.
+ *
+ * The histograms have power of two buckets in microseconds, bucket i counts
+ * times below 2^i us (bucket 0 below 1 us), the last one everything from
+ * about 4 s on. Only the capture callback writes, with relaxed stores on
+ * counters it alone owns, telemetry reads them from any thread. With a
+ * parser thread behind the callback, the parser records its own time per
+ * frame in a third histogram.
+ */
+
+#ifndef MISRC_FRAME_TIMING_H
+#define MISRC_FRAME_TIMING_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define FRAME_TIMING_BUCKETS        24      /* Below 1 us, 2 us, ... 2^22 us, and the rest */
+#define FRAME_TIMING_LATE_FACTOR    1.5     /* Interval beyond this many periods is late */
+
+/* frame_timing_add() results */
+#define FRAME_TIMING_LATE           1       /* Came more than FRAME_TIMING_LATE_FACTOR periods after the previous frame */
+#define FRAME_TIMING_SLOW           2       /* The callback took longer than a period */
+
+typedef enum {
+    FRAME_TIMING_INTERVAL = 0,  /* Time between the arrivals of consecutive frames */
+    FRAME_TIMING_DURATION,      /* Time the callback spent on a frame */
+    FRAME_TIMING_PARSE,         /* Time the parser thread spent on a frame */
+    FRAME_TIMING_KINDS
+} frame_timing_kind_t;
+
+typedef struct {
+    atomic_uint_fast64_t hist[FRAME_TIMING_KINDS][FRAME_TIMING_BUCKETS];
+    atomic_uint_fast64_t sum_ns[FRAME_TIMING_KINDS];
+    atomic_uint_fast64_t max_ns[FRAME_TIMING_KINDS];
+    atomic_uint_fast64_t late;          /* Late frames */
+    atomic_uint_fast64_t slow;          /* Slow callbacks */
+    atomic_uint_fast64_t period_ns;     /* Expected frame period, 0 until known */
+    /* Only the callback thread */
+    uint64_t last_arrival_ns;           /* 0 before the first frame */
+    uint64_t interval_ns;               /* Of the last frame_timing_add() */
+    uint64_t duration_ns;
+} frame_timing_t;
+
+/* Reset all counters
+ *
+ * @param t             Timing state
+ */
+void frame_timing_init(frame_timing_t *t);
+
+/* Set the expected frame period from a frame's payload
+ *
+ * @param t             Timing state
+ * @param samples       RF samples in the frame
+ * @param sample_rate   Stream sample rate from the metadata, 0 keeps the period
+ */
+void frame_timing_set_period(frame_timing_t *t, uint64_t samples, uint32_t sample_rate);
+
+/* Record a frame, from the capture callback
+ *
+ * @param t             Timing state
+ * @param arrival_ns    get_time_ns() when the callback was entered
+ * @param done_ns       get_time_ns() when it was done with the frame
+ * @return FRAME_TIMING_LATE and/or FRAME_TIMING_SLOW, t->interval_ns and
+ *         t->duration_ns hold the times
+ */
+unsigned frame_timing_add(frame_timing_t *t, uint64_t arrival_ns, uint64_t done_ns);
+
+/* Record the time the parser thread spent on a frame
+ *
+ * @param t             Timing state
+ * @param ns            Time from taking the frame until it was in the ringbuffers
+ */
+void frame_timing_add_parse(frame_timing_t *t, uint64_t ns);
+
+/* Copy a histogram, from any thread
+ *
+ * @param t             Timing state
+ * @param kind          Which one
+ * @param counts        Receives FRAME_TIMING_BUCKETS counts (not cumulative)
+ * @return Sum of all times in seconds
+ */
+double frame_timing_read(frame_timing_t *t, frame_timing_kind_t kind, uint64_t *counts);
+
+/* Upper bound of a bucket in seconds, the last bucket has none (infinity) */
+double frame_timing_bucket_bound(int bucket);
+
+#endif /* MISRC_FRAME_TIMING_H */
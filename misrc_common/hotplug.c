@@ -0,0 +1,209 @@
+/*
+ * MISRC Common - Device Hotplug Watcher Implementation
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE      /* clock_gettime() in threading.h */
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#include <cfgmgr32.h>
+#elif LIBUSB_ENABLED
+#include <libusb.h>
+#endif
+
+#include "hotplug.h"
+#include "threading.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+/* Upper bound for one wait for libusb events, so a stop is noticed */
+#define HOTPLUG_WAIT_MS         200
+
+struct hotplug {
+    const char *tag;
+    atomic_uint_fast64_t events;        /* Arrivals and removals so far */
+    atomic_uint_fast64_t last_event_ms;
+    uint64_t seen;                      /* events at the last burst hotplug_poll() reported */
+#ifdef _WIN32
+    HCMNOTIFICATION notify;
+#elif LIBUSB_ENABLED
+    libusb_context *usb;
+    libusb_hotplug_callback_handle usb_cb;
+    thrd_t thread;
+    atomic_bool running;
+#endif
+};
+
+#if defined(_WIN32) || LIBUSB_ENABLED
+/* Called by the backend for every arrival or removal, on a thread of its own */
+static void hotplug_event(hotplug_t *h)
+{
+    atomic_store(&h->last_event_ms, get_time_ms());
+    atomic_fetch_add(&h->events, 1);
+}
+#endif
+
+/*-----------------------------------------------------------------------------
+ * Windows: Configuration Manager notifications
+ *-----------------------------------------------------------------------------*/
+
+#ifdef _WIN32
+
+/* GUID_DEVINTERFACE_USB_DEVICE, the MS2130 and UVC capture cards both register it */
+static const GUID hotplug_usb_device_guid =
+    { 0xA5DCBF10, 0x6530, 0x11D2, { 0x90, 0x1F, 0x00, 0xC0, 0x4F, 0xB9, 0x51, 0xED } };
+
+static DWORD CALLBACK hotplug_cm_callback(HCMNOTIFICATION notify, PVOID ctx, CM_NOTIFY_ACTION action,
+                                          PCM_NOTIFY_EVENT_DATA data, DWORD size)
+{
+    (void)notify;
+    (void)data;
+    (void)size;
+    if (action == CM_NOTIFY_ACTION_DEVICEINTERFACEARRIVAL || action == CM_NOTIFY_ACTION_DEVICEINTERFACEREMOVAL) {
+        hotplug_event((hotplug_t *)ctx);
+    }
+    return ERROR_SUCCESS;
+}
+
+static int hotplug_backend_start(hotplug_t *h)
+{
+    CM_NOTIFY_FILTER filter;
+    memset(&filter, 0, sizeof(filter));
+    filter.cbSize = sizeof(filter);
+    filter.FilterType = CM_NOTIFY_FILTER_TYPE_DEVICEINTERFACE;
+    filter.u.DeviceInterface.ClassGuid = hotplug_usb_device_guid;
+
+    CONFIGRET cr = CM_Register_Notification(&filter, h, hotplug_cm_callback, &h->notify);
+    if (cr != CR_SUCCESS) {
+        fprintf(stderr, "%sCM_Register_Notification failed: %lu\n", h->tag, (unsigned long)cr);
+        return -1;
+    }
+    return 0;
+}
+
+static void hotplug_backend_stop(hotplug_t *h)
+{
+    /* Waits for running callbacks, none is called afterwards */
+    CM_Unregister_Notification(h->notify);
+}
+
+/*-----------------------------------------------------------------------------
+ * Linux, macOS: libusb hotplug callbacks
+ *-----------------------------------------------------------------------------*/
+
+#elif LIBUSB_ENABLED
+
+static int LIBUSB_CALL hotplug_usb_callback(libusb_context *ctx, libusb_device *dev,
+                                            libusb_hotplug_event event, void *user_data)
+{
+    (void)ctx;
+    (void)dev;
+    (void)event;
+    hotplug_event((hotplug_t *)user_data);
+    return 0;   /* Stay registered */
+}
+
+static int hotplug_usb_thread(void *ctx)
+{
+    hotplug_t *h = ctx;
+    while (atomic_load(&h->running)) {
+        struct timeval tv = { 0, HOTPLUG_WAIT_MS * 1000 };
+        libusb_handle_events_timeout_completed(h->usb, &tv, NULL);
+    }
+    return 0;
+}
+
+static int hotplug_backend_start(hotplug_t *h)
+{
+    /* A context of its own, hsdaoh keeps using its own one */
+    int r = libusb_init(&h->usb);
+    if (r != 0) {
+        fprintf(stderr, "%slibusb_init failed: %s\n", h->tag, libusb_error_name(r));
+        return -1;
+    }
+    if (!libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG)) {
+        libusb_exit(h->usb);
+        return -1;
+    }
+    r = libusb_hotplug_register_callback(h->usb,
+                                         LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+                                         0, LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY,
+                                         LIBUSB_HOTPLUG_MATCH_ANY, hotplug_usb_callback, h, &h->usb_cb);
+    if (r != LIBUSB_SUCCESS) {
+        fprintf(stderr, "%slibusb_hotplug_register_callback failed: %s\n", h->tag, libusb_error_name(r));
+        libusb_exit(h->usb);
+        return -1;
+    }
+
+    atomic_store(&h->running, true);
+    if (thrd_create(&h->thread, hotplug_usb_thread, h) != thrd_success) {
+        fprintf(stderr, "%sFailed to create hotplug thread\n", h->tag);
+        libusb_hotplug_deregister_callback(h->usb, h->usb_cb);
+        libusb_exit(h->usb);
+        return -1;
+    }
+    return 0;
+}
+
+static void hotplug_backend_stop(hotplug_t *h)
+{
+    atomic_store(&h->running, false);
+    /* Deregistering wakes libusb_handle_events_timeout_completed() */
+    libusb_hotplug_deregister_callback(h->usb, h->usb_cb);
+    thrd_join(h->thread, NULL);
+    libusb_exit(h->usb);
+}
+
+#else
+
+static int hotplug_backend_start(hotplug_t *h)
+{
+    (void)h;
+    return -1;
+}
+
+static void hotplug_backend_stop(hotplug_t *h)
+{
+    (void)h;
+}
+
+#endif
+
+/*-----------------------------------------------------------------------------
+ * Public API
+ *-----------------------------------------------------------------------------*/
+
+hotplug_t *hotplug_start(const char *tag)
+{
+    hotplug_t *h = calloc(1, sizeof(*h));
+    if (!h) return NULL;
+    h->tag = tag ? tag : "";
+    if (hotplug_backend_start(h) != 0) {
+        free(h);
+        return NULL;
+    }
+    fprintf(stderr, "%sWatching for device hotplug events\n", h->tag);
+    return h;
+}
+
+bool hotplug_poll(hotplug_t *h)
+{
+    if (!h) return false;
+    uint64_t events = atomic_load(&h->events);
+    if (events == h->seen) return false;
+    if (get_time_ms() - atomic_load(&h->last_event_ms) < HOTPLUG_SETTLE_MS) return false;
+    h->seen = events;
+    return true;
+}
+
+void hotplug_stop(hotplug_t *h)
+{
+    if (!h) return;
+    hotplug_backend_stop(h);
+    free(h);
+}
@@ -0,0 +1,49 @@
+/*
+ * MISRC Common - Device Hotplug Watcher
+ *
+ * Notices capture devices being plugged in or removed, so the device list
+ * only has to be enumerated again when something changed instead of on a
+ * timer. Backends:
+ *
+ * - Linux, macOS: libusb hotplug callbacks on a context of their own (the
+ *   MS2130 and the UVC capture cards are USB devices), built when libusb is
+ *   found (LIBUSB_ENABLED)
+ * - Windows: CM_Register_Notification() for device interface arrivals and
+ *   removals, which needs no window, unlike RegisterDeviceNotification()
+ *
+ * A device appearing shows up as several events (USB device, then the video
+ * node or interfaces once the driver bound), so events are coalesced until
+ * none came for HOTPLUG_SETTLE_MS.
+ */
+
+#ifndef MISRC_HOTPLUG_H
+#define MISRC_HOTPLUG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define HOTPLUG_SETTLE_MS       300     /* Quiet time after the last event of a burst */
+
+typedef struct hotplug hotplug_t;
+
+/* Start watching for device arrivals and removals
+ *
+ * @param tag           Put in front of messages, may be NULL
+ * @return Watcher, or NULL if hotplug events are not available on this
+ *         system (callers keep polling then)
+ */
+hotplug_t *hotplug_start(const char *tag);
+
+/* Check whether devices changed, call periodically (e.g. once per frame)
+ *
+ * @return true once per burst of events, HOTPLUG_SETTLE_MS after its last event
+ */
+bool hotplug_poll(hotplug_t *h);
+
+/* Stop watching and free the watcher
+ *
+ * @param h             Watcher, NULL is ignored
+ */
+void hotplug_stop(hotplug_t *h);
+
+#endif /* MISRC_HOTPLUG_H */
@@ -0,0 +1,489 @@
+/*
+ * MISRC Common - Network Streaming Implementation
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE      /* MSG_ZEROCOPY, nanosleep() in threading.h */
+#endif
+
+#include "net_stream.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET net_socket_t;
+#define NET_INVALID_SOCKET INVALID_SOCKET
+#define net_close_socket closesocket
+#else
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+typedef int net_socket_t;
+#define NET_INVALID_SOCKET (-1)
+#define net_close_socket close
+#endif
+
+#if defined(__linux__) && defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY)
+#include <linux/errqueue.h>
+#define NET_HAVE_ZEROCOPY 1
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/* Chunks in flight with MSG_ZEROCOPY, ringbuffer space is released as the kernel lets go */
+#define NET_MAX_INFLIGHT    16
+/* Socket send buffer, a couple of chunks keep a fast link busy */
+#define NET_SNDBUF          (8 << 20)
+/* Zero-copy is only worth it if the kernel does not end up copying anyway (loopback) */
+#define NET_ZC_COPIED_LIMIT 8
+
+typedef struct {
+    net_chunk_header_t header;  /* Must stay untouched until the send completes */
+    size_t len;
+    uint32_t last_call;         /* Zero-copy send calls once the chunk was sent */
+} net_inflight_t;
+
+struct net_sink {
+    net_socket_t sock;
+    bool failed;
+    bool zerocopy;
+    uint32_t zc_calls;          /* Zero-copy send calls so far */
+    uint32_t zc_done;           /* Completed zero-copy send calls */
+    unsigned zc_copied;         /* Completions where the kernel copied after all */
+    uint64_t offset;            /* Payload bytes sent by net_sink_send() */
+    net_inflight_t inflight[NET_MAX_INFLIGHT];
+};
+
+struct net_source {
+    net_socket_t sock;
+};
+
+/*-----------------------------------------------------------------------------
+ * Helpers
+ *-----------------------------------------------------------------------------*/
+
+/* tcp://host:port, tcp://[v6]:port, tcp://:port (listen) */
+static int parse_url(const char *url, char *host, size_t host_size, char *port, size_t port_size)
+{
+    const char *p, *colon;
+    size_t len;
+
+    if (!net_stream_is_url(url)) return -1;
+    p = url + strlen(NET_STREAM_PREFIX);
+    colon = strrchr(p, ':');
+    if (!colon || colon[1] == 0) return -1;
+    len = (size_t)(colon - p);
+    if (len >= 2 && p[0] == '[' && p[len - 1] == ']') {
+        p++;
+        len -= 2;
+    }
+    if (len >= host_size || strlen(colon + 1) >= port_size) return -1;
+    memcpy(host, p, len);
+    host[len] = 0;
+    if (strcmp(host, "*") == 0) host[0] = 0;
+    strcpy(port, colon + 1);
+    return 0;
+}
+
+/* Connect to host:port, or accept one connection on port if there is no host */
+static net_socket_t net_open(const char *url)
+{
+    char host[256], port[16];
+    struct addrinfo hints, *res, *ai;
+    net_socket_t s = NET_INVALID_SOCKET;
+    bool listening;
+    int one = 1;
+
+    if (!net_startup() || parse_url(url, host, sizeof(host), port, sizeof(port)) != 0) {
+        fprintf(stderr, "Invalid network address %s, use tcp://host:port or tcp://:port\n", url);
+        return NET_INVALID_SOCKET;
+    }
+    listening = (host[0] == 0);
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = listening ? AI_PASSIVE : 0;
+    if (getaddrinfo(listening ? NULL : host, port, &hints, &res) != 0) {
+        fprintf(stderr, "Cannot resolve %s\n", url);
+        return NET_INVALID_SOCKET;
+    }
+    for (ai = res; ai; ai = ai->ai_next) {
+        s = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (s == NET_INVALID_SOCKET) continue;
+        if (!listening) {
+            if (connect(s, ai->ai_addr, (int)ai->ai_addrlen) == 0) break;
+        } else {
+            setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char *)&one, sizeof(one));
+            if (bind(s, ai->ai_addr, (int)ai->ai_addrlen) == 0 && listen(s, 1) == 0) break;
+        }
+        net_close_socket(s);
+        s = NET_INVALID_SOCKET;
+    }
+    freeaddrinfo(res);
+    if (s == NET_INVALID_SOCKET) {
+        fprintf(stderr, "Cannot %s %s\n", listening ? "listen on" : "connect to", url);
+        return NET_INVALID_SOCKET;
+    }
+    if (listening) {
+        net_socket_t c;
+        fprintf(stderr, "Waiting for a connection on port %s...\n", port);
+        c = accept(s, NULL, NULL);
+        net_close_socket(s);
+        if (c == NET_INVALID_SOCKET) {
+            fprintf(stderr, "Accepting a connection on port %s failed\n", port);
+            return NET_INVALID_SOCKET;
+        }
+        s = c;
+    }
+    return s;
+}
+
+/* Gather write of header and payload, returns false once the connection is gone */
+static bool send_all(net_sink_t *sink, const void *hdr, size_t hdr_len, const uint8_t *data, size_t len, bool zc)
+{
+    size_t total = hdr_len + len, done = 0;
+    while (done < total) {
+#ifdef _WIN32
+        WSABUF bufs[2];
+        DWORD sent = 0, n = 0;
+        if (done < hdr_len) {
+            bufs[n].buf = (char *)hdr + done;
+            bufs[n++].len = (ULONG)(hdr_len - done);
+        }
+        if (len > 0) {
+            size_t skip = done > hdr_len ? done - hdr_len : 0;
+            bufs[n].buf = (char *)data + skip;
+            bufs[n++].len = (ULONG)(len - skip);
+        }
+        (void)zc;
+        if (WSASend(sink->sock, bufs, n, &sent, 0, NULL, NULL) != 0) return false;
+#else
+        struct iovec iov[2];
+        struct msghdr msg;
+        ssize_t sent;
+        int n = 0, flags = MSG_NOSIGNAL;
+        if (done < hdr_len) {
+            iov[n].iov_base = (uint8_t *)hdr + done;
+            iov[n++].iov_len = hdr_len - done;
+        }
+        if (len > 0) {
+            size_t skip = done > hdr_len ? done - hdr_len : 0;
+            iov[n].iov_base = (uint8_t *)data + skip;
+            iov[n++].iov_len = len - skip;
+        }
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = n;
+#ifdef NET_HAVE_ZEROCOPY
+        if (zc) flags |= MSG_ZEROCOPY;
+#else
+        (void)zc;
+#endif
+        sent = sendmsg(sink->sock, &msg, flags);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+#ifdef NET_HAVE_ZEROCOPY
+        if (zc) sink->zc_calls++;
+#endif
+#endif
+        done += (size_t)sent;
+    }
+    return true;
+}
+
+#ifdef NET_HAVE_ZEROCOPY
+/* Collect zero-copy completions, waits up to timeout_ms for the first one */
+static void zc_reap(net_sink_t *sink, int timeout_ms)
+{
+    while (1) {
+        char control[128];
+        struct msghdr msg;
+        struct cmsghdr *cm;
+        struct pollfd pfd = { sink->sock, 0, 0 };
+
+        if (timeout_ms > 0 && poll(&pfd, 1, timeout_ms) <= 0) return;
+        timeout_ms = 0;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(sink->sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) return;
+        for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            struct sock_extended_err *err = (struct sock_extended_err *)CMSG_DATA(cm);
+            if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+            /* Completions are ranges of send calls, TCP hands them back in order */
+            if ((int32_t)(err->ee_data + 1 - sink->zc_done) > 0) sink->zc_done = err->ee_data + 1;
+            if ((err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) && ++sink->zc_copied == NET_ZC_COPIED_LIMIT) {
+                fprintf(stderr, "Network sink: the kernel copies anyway, not using MSG_ZEROCOPY\n");
+            }
+        }
+    }
+}
+#endif
+
+static bool read_all(net_socket_t s, void *buf, size_t len)
+{
+    uint8_t *p = buf;
+    while (len > 0) {
+#ifdef _WIN32
+        int n = recv(s, (char *)p, (int)(len > 0x40000000 ? 0x40000000 : len), 0);
+#else
+        ssize_t n = recv(s, p, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+#endif
+        if (n <= 0) return false;
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+/*-----------------------------------------------------------------------------
+ * Common
+ *-----------------------------------------------------------------------------*/
+
+bool net_startup(void)
+{
+#ifdef _WIN32
+    static bool started = false;
+    WSADATA wsa;
+    if (!started) {
+        if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) return false;
+        started = true;
+    }
+#endif
+    return true;
+}
+
+bool net_stream_is_url(const char *name)
+{
+    return name && strncmp(name, NET_STREAM_PREFIX, strlen(NET_STREAM_PREFIX)) == 0;
+}
+
+void net_stream_header_init(net_stream_header_t *header, uint32_t sample_rate,
+                            net_format_t format, uint8_t channel, uint32_t max_chunk)
+{
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, NET_STREAM_MAGIC, sizeof(header->magic));
+    header->version = NET_STREAM_VERSION;
+    header->header_size = sizeof(*header);
+    header->sample_rate = sample_rate;
+    header->format = (uint8_t)format;
+    header->channel = channel;
+    header->bits = 12;
+    header->max_chunk = max_chunk;
+}
+
+/*-----------------------------------------------------------------------------
+ * Sender
+ *-----------------------------------------------------------------------------*/
+
+net_sink_t *net_sink_open(const char *url, const net_stream_header_t *header)
+{
+    net_sink_t *sink;
+    int sndbuf = NET_SNDBUF;
+
+    sink = calloc(1, sizeof(*sink));
+    if (!sink) return NULL;
+    sink->sock = net_open(url);
+    if (sink->sock == NET_INVALID_SOCKET) {
+        free(sink);
+        return NULL;
+    }
+    setsockopt(sink->sock, SOL_SOCKET, SO_SNDBUF, (const char *)&sndbuf, sizeof(sndbuf));
+#ifdef SO_NOSIGPIPE
+    {
+        /* No MSG_NOSIGNAL on macOS, a lost receiver must not take the capture down with SIGPIPE */
+        int one = 1;
+        setsockopt(sink->sock, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+    }
+#endif
+#ifdef NET_HAVE_ZEROCOPY
+    {
+        int one = 1;
+        sink->zerocopy = setsockopt(sink->sock, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0;
+    }
+#endif
+    if (!send_all(sink, header, sizeof(*header), NULL, 0, false)) {
+        fprintf(stderr, "Sending the stream header to %s failed\n", url);
+        net_close_socket(sink->sock);
+        free(sink);
+        return NULL;
+    }
+    fprintf(stderr, "Streaming to %s%s\n", url, sink->zerocopy ? " (zero-copy)" : "");
+    return sink;
+}
+
+uint64_t net_sink_run(net_sink_t *sink, ringbuffer_t *rb, size_t chunk,
+                      rb_writer_should_exit_cb_t should_exit, rb_writer_progress_cb_t progress,
+                      void *user_ctx, atomic_uint *frame)
+{
+    uint64_t offset = 0;
+    size_t ahead = 0;           /* Bytes sent but not yet released */
+    unsigned first = 0, inflight = 0, depth = 1;
+
+#ifdef NET_HAVE_ZEROCOPY
+    /* Everything in flight has to fit in the ringbuffer at once, like the io_uring writer */
+    if (sink->zerocopy) {
+        depth = NET_MAX_INFLIGHT;
+        if (depth > rb->buffer_size / (2 * chunk)) depth = (unsigned)(rb->buffer_size / (2 * chunk));
+        if (depth == 0) depth = 1;
+    }
+#endif
+
+    while (!sink->failed) {
+        bool zc = sink->zerocopy && sink->zc_copied < NET_ZC_COPIED_LIMIT;
+        size_t len = chunk;
+        uint8_t *buf = NULL;
+
+        if (inflight < depth) {
+            buf = rb_read_ptr(rb, ahead + len);
+            if (!buf && should_exit(user_ctx)) {
+                /* Send what is left before exiting */
+                size_t remaining = rb_available(rb) - ahead;
+                if (remaining > 0 && remaining < len) {
+                    len = remaining;
+                    buf = rb_read_ptr(rb, ahead + len);
+                }
+            }
+        }
+        if (buf) {
+            net_inflight_t *slot = &sink->inflight[(first + inflight) % depth];
+            slot->header.magic = NET_CHUNK_MAGIC;
+            slot->header.length = (uint32_t)len;
+            slot->header.offset = offset;
+            slot->header.frame = frame ? atomic_load(frame) : 0;
+            slot->header.reserved = 0;
+            slot->len = len;
+            if (!send_all(sink, &slot->header, sizeof(slot->header), buf + ahead, len, zc)) {
+                fprintf(stderr, "Network sink: connection lost after %" PRIu64 " bytes\n", offset);
+                sink->failed = true;
+                break;
+            }
+            slot->last_call = sink->zc_calls;
+            offset += len;
+            ahead += len;
+            inflight++;
+        }
+        else if (inflight == 0) {
+            if (should_exit(user_ctx) && rb_available(rb) == 0) break;
+            /* Block until the producer commits more data, then retry */
+            rb_read_ptr_wait(rb, chunk, 100);
+            continue;
+        }
+
+        /* Copying sends are done as soon as sendmsg() returns, zero-copy ones once the
+         * kernel reports them, and chunks sent after zero-copy was given up wait their turn */
+#ifdef NET_HAVE_ZEROCOPY
+        if (sink->zerocopy && inflight > 0) {
+            zc_reap(sink, (inflight == depth || !buf) ? 100 : 0);
+        }
+#endif
+        while (inflight > 0 && (!sink->zerocopy ||
+                                (int32_t)(sink->zc_done - sink->inflight[first].last_call) >= 0)) {
+            rb_read_finished(rb, sink->inflight[first].len);
+            if (progress) progress(user_ctx, sink->inflight[first].len);
+            ahead -= sink->inflight[first].len;
+            first = (first + 1) % depth;
+            inflight--;
+        }
+    }
+    return offset;
+}
+
+int net_sink_send(net_sink_t *sink, const void *data, size_t len, uint32_t frame)
+{
+    net_chunk_header_t header;
+
+    if (sink->failed) return -1;
+    header.magic = NET_CHUNK_MAGIC;
+    header.length = (uint32_t)len;
+    header.offset = sink->offset;
+    header.frame = frame;
+    header.reserved = 0;
+    if (!send_all(sink, &header, sizeof(header), data, len, false)) {
+        fprintf(stderr, "Network sink: connection lost after %" PRIu64 " bytes\n", sink->offset);
+        sink->failed = true;
+        return -1;
+    }
+    sink->offset += len;
+    return 0;
+}
+
+bool net_sink_failed(const net_sink_t *sink)
+{
+    return sink->failed;
+}
+
+void net_sink_close(net_sink_t *sink)
+{
+    if (!sink) return;
+#ifdef _WIN32
+    shutdown(sink->sock, SD_SEND);
+#else
+    shutdown(sink->sock, SHUT_WR);
+#endif
+    net_close_socket(sink->sock);
+    free(sink);
+}
+
+/*-----------------------------------------------------------------------------
+ * Receiver
+ *-----------------------------------------------------------------------------*/
+
+net_source_t *net_source_open(const char *url, net_stream_header_t *header)
+{
+    net_source_t *src = calloc(1, sizeof(*src));
+    if (!src) return NULL;
+    src->sock = net_open(url);
+    if (src->sock == NET_INVALID_SOCKET) {
+        free(src);
+        return NULL;
+    }
+    if (!read_all(src->sock, header, sizeof(*header)) ||
+        memcmp(header->magic, NET_STREAM_MAGIC, sizeof(header->magic)) != 0 ||
+        header->header_size < sizeof(*header)) {
+        fprintf(stderr, "%s is not sending a MISRC stream\n", url);
+        net_close_socket(src->sock);
+        free(src);
+        return NULL;
+    }
+    /* Skip what a later version added to the header */
+    for (size_t skip = header->header_size - sizeof(*header); skip > 0; skip--) {
+        uint8_t b;
+        if (!read_all(src->sock, &b, 1)) break;
+    }
+    return src;
+}
+
+long net_source_read(net_source_t *src, net_chunk_header_t *chunk, void *buf, size_t size)
+{
+    if (!read_all(src->sock, chunk, sizeof(*chunk))) return 0;
+    if (chunk->magic != NET_CHUNK_MAGIC || chunk->length > size) {
+        fprintf(stderr, "Corrupt chunk header in the network stream\n");
+        return -1;
+    }
+    if (!read_all(src->sock, buf, chunk->length)) return -1;
+    return (long)chunk->length;
+}
+
+void net_source_close(net_source_t *src)
+{
+    if (!src) return;
+    net_close_socket(src->sock);
+    free(src);
+}
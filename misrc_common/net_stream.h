@@ -0,0 +1,172 @@
+/*
+ * MISRC Common - Network Streaming
+ *
+ * Streams an output ringbuffer over TCP to a decoder on another machine,
+ * sent straight from the ringbuffer mapping with one gather write per chunk
+ * (MSG_ZEROCOPY on Linux when the kernel supports it). A slow link simply
+ * stops the sender from releasing ringbuffer space, so it shows up in the
+ * ringbuffer stall counters like a slow disk.
+ *
+ * Wire format, all little endian: one net_stream_header_t, then chunks of
+ * a net_chunk_header_t followed by length payload bytes. Payload offsets
+ * are contiguous, a receiver can check them to be sure nothing is missing.
+ *
+ * Addresses are tcp://host:port to connect, or tcp://:port to listen for
+ * a single connection on all interfaces. Either side can listen.
+ */
+
+#ifndef MISRC_NET_STREAM_H
+#define MISRC_NET_STREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "ringbuffer.h"
+#include "ringbuffer_writer.h"
+
+#define NET_STREAM_PREFIX   "tcp://"
+#define NET_STREAM_MAGIC    "MISRCNET"
+#define NET_STREAM_VERSION  1
+#define NET_CHUNK_MAGIC     0x4b4e4843u     /* "CHNK" */
+
+/* Sample formats of the payload */
+typedef enum {
+    NET_FORMAT_S16 = 0,         /* 16 bit, 12 bit samples sign extended */
+    NET_FORMAT_S16_PADDED,      /* 16 bit, 12 bit samples in the upper bits (misrc_capture -p) */
+    NET_FORMAT_RAW32,           /* 32 bit capture words as misrc_capture -r writes them */
+    NET_FORMAT_PREVIEW,         /* Preview records (preview.h), the channel is 0 */
+    NET_FORMAT_F32,             /* 32 bit float normalized to [-1, 1) (misrc_capture --rf-float) */
+} net_format_t;
+
+typedef struct {
+    char magic[8];              /* NET_STREAM_MAGIC, not terminated */
+    uint32_t version;           /* NET_STREAM_VERSION */
+    uint32_t header_size;       /* sizeof(net_stream_header_t), for later extensions */
+    uint32_t sample_rate;       /* Samples per second */
+    uint8_t format;             /* net_format_t */
+    uint8_t channel;            /* 0 = ADC A, 1 = ADC B */
+    uint8_t bits;               /* Significant bits per sample */
+    uint8_t reserved;
+    uint32_t max_chunk;         /* Largest payload the sender uses */
+    uint32_t reserved2;
+} net_stream_header_t;
+
+typedef struct {
+    uint32_t magic;             /* NET_CHUNK_MAGIC */
+    uint32_t length;            /* Payload bytes following */
+    uint64_t offset;            /* Stream offset of the payload in bytes */
+    uint32_t frame;             /* Last hsdaoh frame counter seen when the chunk was sent */
+    uint32_t reserved;
+} net_chunk_header_t;
+
+typedef struct net_sink net_sink_t;
+typedef struct net_source net_source_t;
+
+/* Check whether an output name is a network address
+ *
+ * @param name          Output name
+ * @return true if it starts with NET_STREAM_PREFIX
+ */
+bool net_stream_is_url(const char *name);
+
+/* Fill in a stream header
+ *
+ * @param header        Header to initialize
+ * @param sample_rate   Samples per second
+ * @param format        Payload format
+ * @param channel       0 = ADC A, 1 = ADC B
+ * @param max_chunk     Largest payload per chunk
+ */
+void net_stream_header_init(net_stream_header_t *header, uint32_t sample_rate,
+                            net_format_t format, uint8_t channel, uint32_t max_chunk);
+
+/* Start the socket library once per process (WSAStartup on Windows)
+ *
+ * @return false if it cannot be started
+ */
+bool net_startup(void);
+
+/*-----------------------------------------------------------------------------
+ * Sender
+ *-----------------------------------------------------------------------------*/
+
+/* Connect (or wait for the receiver) and send the stream header
+ *
+ * @param url           tcp://host:port or tcp://:port
+ * @param header        Stream header
+ * @return Sink, or NULL on failure. Blocks until connected.
+ */
+net_sink_t *net_sink_open(const char *url, const net_stream_header_t *header);
+
+/* Send a ringbuffer until told to exit (blocking)
+ *
+ * @param sink          Sink from net_sink_open()
+ * @param rb            Ringbuffer to read, space is released once the data is sent
+ * @param chunk         Payload bytes per chunk, at most header max_chunk
+ * @param should_exit   Exit condition, the remaining data is sent before returning
+ * @param progress      Called with the bytes of each released chunk (optional)
+ * @param user_ctx      For should_exit and progress
+ * @param frame         Current frame counter, NULL if not known
+ * @return Bytes sent, stops early if the connection is lost (see net_sink_failed())
+ */
+uint64_t net_sink_run(net_sink_t *sink, ringbuffer_t *rb, size_t chunk,
+                      rb_writer_should_exit_cb_t should_exit, rb_writer_progress_cb_t progress,
+                      void *user_ctx, atomic_uint *frame);
+
+/* Send one chunk from memory, for streams too sparse to wait for full chunks
+ *
+ * Copies through the socket buffer, never zero-copy. Do not mix with
+ * net_sink_run() on the same sink.
+ *
+ * @param sink          Sink from net_sink_open()
+ * @param data          Payload
+ * @param len           Payload bytes, at most header max_chunk
+ * @param frame         Current frame counter, 0 if not known
+ * @return 0 on success, -1 if the connection is lost
+ */
+int net_sink_send(net_sink_t *sink, const void *data, size_t len, uint32_t frame);
+
+/* Check whether the connection was lost
+ *
+ * @param sink          Sink
+ * @return true after a send failed
+ */
+bool net_sink_failed(const net_sink_t *sink);
+
+/* Close the connection
+ *
+ * @param sink          Sink, freed (NULL is ignored)
+ */
+void net_sink_close(net_sink_t *sink);
+
+/*-----------------------------------------------------------------------------
+ * Receiver
+ *-----------------------------------------------------------------------------*/
+
+/* Connect (or wait for the sender) and read the stream header
+ *
+ * @param url           tcp://host:port or tcp://:port
+ * @param header        Receives the stream header
+ * @return Source, or NULL on failure or if the peer is not a MISRC stream
+ */
+net_source_t *net_source_open(const char *url, net_stream_header_t *header);
+
+/* Read the next chunk
+ *
+ * @param src           Source
+ * @param chunk         Receives the chunk header
+ * @param buf           Receives the payload
+ * @param size          Size of buf, at least header max_chunk
+ * @return Payload bytes, 0 at the end of the stream, -1 on error
+ */
+long net_source_read(net_source_t *src, net_chunk_header_t *chunk, void *buf, size_t size);
+
+/* Close the connection
+ *
+ * @param src           Source, freed (NULL is ignored)
+ */
+void net_source_close(net_source_t *src);
+
+#endif /* MISRC_NET_STREAM_H */
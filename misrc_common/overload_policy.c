@@ -0,0 +1,191 @@
+/*
+ * MISRC Common - Overload Policy Implementation
+ */
+
+#include "overload_policy.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+typedef struct {
+    bool open;
+    uint64_t start;             /* Position of the open gap */
+    uint64_t samples;           /* Length of the open gap */
+    uint64_t gaps;              /* Closed gaps so far */
+    uint64_t lost;              /* Samples in closed gaps */
+} overload_gap_t;
+
+struct overload {
+    overload_policy_t policy;
+    const char *tag;
+    atomic_uint engaged;        /* Bit per overload_step_t */
+    overload_gap_t gaps[OVERLOAD_STREAMS];
+};
+
+static const char *s_step_names[OVERLOAD_STEPS] = {
+    [OVERLOAD_DISPLAY] = "display",
+    [OVERLOAD_AUX] = "aux",
+    [OVERLOAD_AUDIO] = "audio",
+    [OVERLOAD_FLAC] = "flac",
+};
+
+/* What a step gives up, for the messages */
+static const char *s_step_what[OVERLOAD_STEPS] = {
+    [OVERLOAD_DISPLAY] = "display updates",
+    [OVERLOAD_AUX] = "aux output",
+    [OVERLOAD_AUDIO] = "audio outputs",
+    [OVERLOAD_FLAC] = "higher FLAC levels",
+};
+
+static const char *s_stream_names[OVERLOAD_STREAMS] = {
+    [OVERLOAD_STREAM_RF] = "RF",
+    [OVERLOAD_STREAM_AUX] = "Aux",
+    [OVERLOAD_STREAM_AUDIO] = "Audio",
+};
+
+/*-----------------------------------------------------------------------------
+ * Policy
+ *-----------------------------------------------------------------------------*/
+
+void overload_policy_default(overload_policy_t *p)
+{
+    p->engage[OVERLOAD_DISPLAY] = 0.50;
+    p->engage[OVERLOAD_AUX] = 0.60;
+    p->engage[OVERLOAD_AUDIO] = 0.70;
+    p->engage[OVERLOAD_FLAC] = 0.80;
+    p->rf_wait_ms = OVERLOAD_RF_WAIT_MS;
+}
+
+static int parse_entry(const char *key, size_t key_len, const char *value, overload_policy_t *p)
+{
+    char *end;
+    long v;
+
+    if (key_len == 7 && strncmp(key, "rf-wait", 7) == 0) {
+        v = strtol(value, &end, 10);
+        if (end == value || (*end != '\0' && *end != ',') || v < 0 || v > 10000) return -1;
+        p->rf_wait_ms = (uint32_t)v;
+        return 0;
+    }
+    for (int s = 0; s < OVERLOAD_STEPS; s++) {
+        if (strlen(s_step_names[s]) != key_len || strncmp(key, s_step_names[s], key_len) != 0) continue;
+        if (strncmp(value, "off", 3) == 0 && (value[3] == '\0' || value[3] == ',')) {
+            p->engage[s] = OVERLOAD_NEVER;
+            return 0;
+        }
+        v = strtol(value, &end, 10);
+        if (end == value || (*end != '\0' && *end != ',') || v < 1 || v > 100) return -1;
+        p->engage[s] = (double)v / 100.0;
+        return 0;
+    }
+    return -1;
+}
+
+int overload_policy_parse(const char *arg, overload_policy_t *p)
+{
+    overload_policy_t parsed = *p;
+    const char *entry = arg;
+
+    if (!arg || !*arg) return -1;
+    while (*entry) {
+        const char *eq = strchr(entry, '=');
+        const char *comma = strchr(entry, ',');
+        if (!eq || (comma && comma < eq)) return -1;
+        if (parse_entry(entry, (size_t)(eq - entry), eq + 1, &parsed) != 0) return -1;
+        if (!comma) break;
+        entry = comma + 1;
+    }
+    *p = parsed;
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Pressure
+ *-----------------------------------------------------------------------------*/
+
+overload_t *overload_create(const overload_policy_t *p, const char *tag)
+{
+    overload_t *o = calloc(1, sizeof(*o));
+    if (!o) return NULL;
+    o->policy = *p;
+    o->tag = tag ? tag : "";
+    atomic_init(&o->engaged, 0);
+    return o;
+}
+
+void overload_update(overload_t *o, double fill)
+{
+    if (!o) return;
+    unsigned engaged = atomic_load_explicit(&o->engaged, memory_order_relaxed);
+    unsigned next = engaged;
+
+    for (int s = 0; s < OVERLOAD_STEPS; s++) {
+        unsigned bit = 1u << s;
+        if (!(engaged & bit) && fill >= o->policy.engage[s]) {
+            next |= bit;
+            fprintf(stderr, "%sOverload: buffers %.0f%% full, giving up %s\n",
+                    o->tag, fill * 100.0, s_step_what[s]);
+        } else if ((engaged & bit) && fill < o->policy.engage[s] - OVERLOAD_HYSTERESIS) {
+            next &= ~bit;
+            fprintf(stderr, "%sOverload: buffers %.0f%% full, %s back\n",
+                    o->tag, fill * 100.0, s_step_what[s]);
+        }
+    }
+    if (next != engaged) atomic_store_explicit(&o->engaged, next, memory_order_relaxed);
+}
+
+bool overload_shed(const overload_t *o, overload_step_t step)
+{
+    if (!o) return false;
+    return (atomic_load_explicit(&((overload_t *)o)->engaged, memory_order_relaxed) & (1u << step)) != 0;
+}
+
+uint32_t overload_rf_wait_ms(const overload_t *o)
+{
+    return o ? o->policy.rf_wait_ms : OVERLOAD_RF_WAIT_MS;
+}
+
+/*-----------------------------------------------------------------------------
+ * Gaps
+ *-----------------------------------------------------------------------------*/
+
+void overload_gap(overload_t *o, overload_stream_t s, uint64_t at, uint64_t samples)
+{
+    if (!o) return;
+    overload_gap_t *g = &o->gaps[s];
+    if (g->open && g->start != at) overload_resume(o, s);
+    if (!g->open) {
+        g->open = true;
+        g->start = at;
+        g->samples = 0;
+    }
+    g->samples += samples;
+}
+
+void overload_resume(overload_t *o, overload_stream_t s)
+{
+    if (!o) return;
+    overload_gap_t *g = &o->gaps[s];
+    if (!g->open) return;
+    fprintf(stderr, "%sOverload: %s output is missing %llu samples at sample %llu\n",
+            o->tag, s_stream_names[s], (unsigned long long)g->samples, (unsigned long long)g->start);
+    g->gaps++;
+    g->lost += g->samples;
+    g->open = false;
+}
+
+void overload_free(overload_t *o)
+{
+    if (!o) return;
+    for (int s = 0; s < OVERLOAD_STREAMS; s++) {
+        overload_resume(o, (overload_stream_t)s);
+        if (o->gaps[s].gaps > 0) {
+            fprintf(stderr, "%sOverload: %s output has %llu gaps, %llu samples missing in total\n",
+                    o->tag, s_stream_names[s], (unsigned long long)o->gaps[s].gaps,
+                    (unsigned long long)o->gaps[s].lost);
+        }
+    }
+    free(o);
+}
@@ -0,0 +1,121 @@
+/*
+ * MISRC Common - Overload Policy
+ *
+ * Decides what to give up when the capture chain cannot keep up (a disk
+ * hiccup, the FLAC encoders falling behind), so the USB callback keeps
+ * draining the device at full rate and the RF samples are the last thing
+ * lost. The fill of the buffers between the stages is the pressure, as it
+ * rises the steps engage in the order of overload_step_t:
+ *
+ * - display:  skip display, level meter, histogram and FFT updates
+ * - aux:      stop writing the raw aux output
+ * - audio:    stop capturing the audio outputs
+ * - flac:     make the adaptive FLAC level (MIN-MAX) step down
+ *
+ * Each step releases again OVERLOAD_HYSTERESIS below its threshold. RF
+ * frames are only dropped when the capture buffer is still full after
+ * rf_wait_ms, instead of blocking the USB callback.
+ *
+ * Every gap in an output is logged once it ends, with its position and
+ * length in samples of that output.
+ */
+
+#ifndef MISRC_OVERLOAD_POLICY_H
+#define MISRC_OVERLOAD_POLICY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define OVERLOAD_HYSTERESIS     0.10    /* A step releases this far below its threshold */
+#define OVERLOAD_NEVER          2.0     /* Threshold of a disabled step, the fill never gets there */
+#define OVERLOAD_RF_WAIT_MS     50      /* Default wait for capture buffer space */
+
+typedef enum {
+    OVERLOAD_DISPLAY = 0,
+    OVERLOAD_AUX,
+    OVERLOAD_AUDIO,
+    OVERLOAD_FLAC,
+    OVERLOAD_STEPS
+} overload_step_t;
+
+typedef enum {
+    OVERLOAD_STREAM_RF = 0,
+    OVERLOAD_STREAM_AUX,
+    OVERLOAD_STREAM_AUDIO,
+    OVERLOAD_STREAMS
+} overload_stream_t;
+
+typedef struct {
+    double engage[OVERLOAD_STEPS];  /* Buffer fill (0..1) at which each step engages */
+    uint32_t rf_wait_ms;            /* Longest wait for capture buffer space before an RF frame is dropped */
+} overload_policy_t;
+
+typedef struct overload overload_t;
+
+/* Default policy: display at 50%, aux at 60%, audio at 70%, flac at 80%,
+ * RF frames dropped after OVERLOAD_RF_WAIT_MS
+ *
+ * @param p             Policy to fill in
+ */
+void overload_policy_default(overload_policy_t *p);
+
+/* Change a policy from a comma separated list of STEP=PERCENT, STEP=off
+ * and rf-wait=MS, e.g. "display=30,aux=off,rf-wait=100"
+ *
+ * @param arg           Option argument
+ * @param p             Policy, usually the default one, changed in place
+ * @return 0 on success, -1 on a malformed list
+ */
+int overload_policy_parse(const char *arg, overload_policy_t *p);
+
+/* Start tracking the pressure of one capture
+ *
+ * @param p             Policy, copied
+ * @param tag           Put in front of messages, may be NULL
+ * @return Policy state, or NULL on allocation failure
+ */
+overload_t *overload_create(const overload_policy_t *p, const char *tag);
+
+/* Engage or release steps for the current pressure, from one thread only
+ *
+ * @param o             Policy state
+ * @param fill          Fullest buffer between the stages, 0..1
+ */
+void overload_update(overload_t *o, double fill);
+
+/* Check whether a step is engaged, from any thread
+ *
+ * @param o             Policy state, NULL means no policy (never engaged)
+ * @param step          Step to check
+ */
+bool overload_shed(const overload_t *o, overload_step_t step);
+
+/* Wait for capture buffer space before an RF frame is dropped
+ *
+ * @param o             Policy state
+ */
+uint32_t overload_rf_wait_ms(const overload_t *o);
+
+/* Record samples an output lost, consecutive losses make one gap
+ *
+ * @param o             Policy state
+ * @param s             Output, each one is only used from one thread
+ * @param at            Samples the output holds so far, where the gap is
+ * @param samples       Samples lost
+ */
+void overload_gap(overload_t *o, overload_stream_t s, uint64_t at, uint64_t samples);
+
+/* Output continues, log its open gap if there is one
+ *
+ * @param o             Policy state
+ * @param s             Output
+ */
+void overload_resume(overload_t *o, overload_stream_t s);
+
+/* Log open gaps and the totals, then free the state
+ *
+ * @param o             Policy state, NULL is ignored
+ */
+void overload_free(overload_t *o);
+
+#endif /* MISRC_OVERLOAD_POLICY_H */
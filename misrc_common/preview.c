@@ -0,0 +1,342 @@
+/*
+ * MISRC Common - Low Rate Preview Stream Implementation
+ */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L  // nanosleep() in threading.h with -std=c11
+#endif
+
+#include "preview.h"
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "net_stream.h"
+#include "rb_shm.h"
+#include "ringbuffer.h"
+#include "threading.h"
+
+#define PREVIEW_RB_SIZE     (1 << 20)       /* Seconds of envelope even at the lowest decimation */
+#define PREVIEW_NET_CHUNK   (64 << 10)      /* Largest network chunk */
+#define PREVIEW_WAIT_MS     100
+#define PREVIEW_DB_FLOOR    -150.0
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+struct preview {
+    preview_config_t cfg;
+    ringbuffer_t rb;            /* Queued records, the sink itself for shm:// */
+    FILE *f;                    /* File sink, NULL otherwise */
+    net_sink_t *net;            /* tcp:// sink, NULL otherwise */
+    bool shm;
+    thrd_t thread;              /* Writer of file and tcp:// sinks */
+    bool thread_started;
+    atomic_bool stop;
+    atomic_uint_fast64_t dropped;
+
+    /* Envelope, folded from the blocks of the stats kernel */
+    uint32_t group;             /* Stats blocks per entry */
+    uint32_t group_fill;        /* Blocks folded into acc so far */
+    extract_envelope_t acc;
+    extract_envelope_t pending[PREVIEW_RECORD_ENTRIES];
+    uint32_t pending_n;
+    uint64_t pending_sample;    /* Capture sample of pending[0], or of acc if nothing is pending */
+    uint64_t next_sample;       /* Where the next block should start */
+    uint64_t flush_samples;
+
+    /* Spectra */
+    uint64_t fft_next;          /* Capture sample of the next spectrum */
+    uint64_t fft_interval;      /* In samples, 0 for none */
+    float window[PREVIEW_FFT_SIZE];
+    float twiddle[PREVIEW_FFT_SIZE];    /* cos and sin of the first half turn, interleaved */
+    float re[PREVIEW_FFT_SIZE], im[PREVIEW_FFT_SIZE];
+    int16_t bins[PREVIEW_FFT_SIZE / 2];
+};
+
+/*-----------------------------------------------------------------------------
+ * Records
+ *-----------------------------------------------------------------------------*/
+
+/* Queue one record, dropped if the sink is behind, the extraction never waits */
+static void put_record(preview_t *p, uint32_t sync, uint64_t sample, uint8_t channel, const void *payload, size_t len)
+{
+    preview_record_t rec;
+    uint8_t *dst = rb_write_ptr(&p->rb, sizeof(rec) + len);
+
+    if (!dst) {
+        atomic_fetch_add_explicit(&p->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    memset(&rec, 0, sizeof(rec));
+    rec.sync = sync;
+    rec.length = (uint32_t)len;
+    rec.sample = sample;
+    rec.channel = channel;
+    memcpy(dst, &rec, sizeof(rec));
+    memcpy(dst + sizeof(rec), payload, len);
+    rb_write_finished(&p->rb, sizeof(rec) + len);
+}
+
+static void put_info(preview_t *p, uint64_t sample)
+{
+    preview_info_t info;
+
+    memcpy(info.magic, PREVIEW_MAGIC, sizeof(info.magic));
+    info.version = PREVIEW_VERSION;
+    info.sample_rate = p->cfg.sample_rate;
+    info.decimation = p->cfg.decimation;
+    info.fft_size = PREVIEW_FFT_SIZE;
+    put_record(p, PREVIEW_INFO_SYNC, sample, 0, &info, sizeof(info));
+}
+
+static void flush_envelope(preview_t *p)
+{
+    if (p->pending_n == 0) return;
+    put_record(p, PREVIEW_ENVELOPE_SYNC, p->pending_sample, 0, p->pending, p->pending_n * sizeof(extract_envelope_t));
+    p->pending_sample += (uint64_t)p->pending_n * p->cfg.decimation;
+    p->pending_n = 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Spectra
+ *-----------------------------------------------------------------------------*/
+
+/* In place radix 2 FFT of re/im */
+static void fft(preview_t *p)
+{
+    const unsigned n = PREVIEW_FFT_SIZE;
+
+    for (unsigned i = 1, j = 0; i < n; i++) {
+        unsigned bit = n >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j |= bit;
+        if (i < j) {
+            float t = p->re[i]; p->re[i] = p->re[j]; p->re[j] = t;
+            t = p->im[i]; p->im[i] = p->im[j]; p->im[j] = t;
+        }
+    }
+    for (unsigned len = 2; len <= n; len <<= 1) {
+        unsigned step = n / len;
+        for (unsigned i = 0; i < n; i += len) {
+            for (unsigned k = 0; k < len / 2; k++) {
+                float wr = p->twiddle[2 * k * step], wi = -p->twiddle[2 * k * step + 1];
+                unsigned a = i + k, b = i + k + len / 2;
+                float xr = p->re[b] * wr - p->im[b] * wi;
+                float xi = p->re[b] * wi + p->im[b] * wr;
+                p->re[b] = p->re[a] - xr;
+                p->im[b] = p->im[a] - xi;
+                p->re[a] += xr;
+                p->im[a] += xi;
+            }
+        }
+    }
+}
+
+/* Hann windowed spectrum of PREVIEW_FFT_SIZE samples from the raw words */
+static void put_spectrum(preview_t *p, uint64_t sample, const uint32_t *in, int ch)
+{
+    /* A full scale sine peaks at 2048 * N / 4 with the Hann window */
+    const double scale = 4.0 / (2048.0 * PREVIEW_FFT_SIZE);
+
+    for (unsigned i = 0; i < PREVIEW_FFT_SIZE; i++) {
+        int32_t v = 2047 - (int32_t)(ch ? (in[i] >> 20) & 0xfff : in[i] & 0xfff);
+        p->re[i] = (float)v * p->window[i];
+        p->im[i] = 0.0f;
+    }
+    fft(p);
+    for (unsigned k = 0; k < PREVIEW_FFT_SIZE / 2; k++) {
+        double mag = sqrt((double)p->re[k] * p->re[k] + (double)p->im[k] * p->im[k]) * scale;
+        double db = mag > 0.0 ? 20.0 * log10(mag) : PREVIEW_DB_FLOOR;
+        if (db < PREVIEW_DB_FLOOR) db = PREVIEW_DB_FLOOR;
+        p->bins[k] = (int16_t)lrint(db * 100.0);
+    }
+    put_record(p, PREVIEW_SPECTRUM_SYNC, sample, (uint8_t)ch, p->bins, sizeof(p->bins));
+}
+
+/*-----------------------------------------------------------------------------
+ * Writer Thread
+ *-----------------------------------------------------------------------------*/
+
+static int preview_writer(void *ctx)
+{
+    preview_t *p = ctx;
+    bool failed = false;
+
+    while (1) {
+        bool stop = atomic_load(&p->stop);
+        size_t len = rb_available(&p->rb);
+        uint8_t *buf;
+
+        if (len == 0) {
+            if (stop) break;
+            rb_read_ptr_wait(&p->rb, 1, PREVIEW_WAIT_MS);
+            continue;
+        }
+        if (p->net && len > PREVIEW_NET_CHUNK) len = PREVIEW_NET_CHUNK;
+        buf = rb_read_ptr(&p->rb, len);
+        // a sink that failed is drained all the same, the capture goes on without it
+        if (!failed && p->f) {
+            failed = fwrite(buf, 1, len, p->f) != len || fflush(p->f) != 0;
+            if (failed) fprintf(stderr, "Preview: write failed, no more preview\n");
+        }
+        else if (!failed && p->net) {
+            failed = net_sink_send(p->net, buf, len, 0) != 0;
+            if (failed) fprintf(stderr, "Preview: connection lost, no more preview\n");
+        }
+        rb_read_finished(&p->rb, len);
+    }
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Public API
+ *-----------------------------------------------------------------------------*/
+
+void preview_config_init(preview_config_t *cfg, uint32_t sample_rate)
+{
+    cfg->sample_rate = sample_rate;
+    cfg->decimation = PREVIEW_DEFAULT_DECIMATION;
+    cfg->fft_interval = PREVIEW_DEFAULT_FFT_INTERVAL;
+}
+
+int preview_parse_decimation(const char *s, uint32_t *decimation)
+{
+    char *end;
+    unsigned long v = strtoul(s, &end, 10);
+
+    if (end == s || *end != 0) return -1;
+    if (v < PREVIEW_MIN_DECIMATION || v > PREVIEW_MAX_DECIMATION || (v & (v - 1)) != 0) return -1;
+    *decimation = (uint32_t)v;
+    return 0;
+}
+
+preview_t *preview_open(const char *dest, FILE *f, const preview_config_t *cfg)
+{
+    preview_t *p;
+    int r;
+
+    if (cfg->decimation < PREVIEW_MIN_DECIMATION || cfg->decimation > PREVIEW_MAX_DECIMATION ||
+        (cfg->decimation & (cfg->decimation - 1)) != 0) {
+        fprintf(stderr, "Preview: invalid decimation %u\n", cfg->decimation);
+        return NULL;
+    }
+    p = calloc(1, sizeof(preview_t));
+    if (!p) return NULL;
+    p->cfg = *cfg;
+    p->group = cfg->decimation / EXTRACT_STATS_BLOCK;
+    p->flush_samples = (uint64_t)(cfg->sample_rate * PREVIEW_FLUSH_SECONDS);
+    p->fft_interval = (uint64_t)(cfg->sample_rate * cfg->fft_interval);
+    for (unsigned i = 0; i < PREVIEW_FFT_SIZE; i++) {
+        p->window[i] = (float)(0.5 - 0.5 * cos(2.0 * M_PI * i / PREVIEW_FFT_SIZE));
+    }
+    for (unsigned k = 0; k < PREVIEW_FFT_SIZE / 2; k++) {
+        p->twiddle[2 * k] = (float)cos(2.0 * M_PI * k / PREVIEW_FFT_SIZE);
+        p->twiddle[2 * k + 1] = (float)sin(2.0 * M_PI * k / PREVIEW_FFT_SIZE);
+    }
+
+    if (rb_shm_is_url(dest)) {
+        rb_shm_info_t info = { cfg->sample_rate, RB_SHM_FORMAT_PREVIEW, 0, 12 };
+        r = rb_init_shm(&p->rb, dest + strlen(RB_SHM_PREFIX), PREVIEW_RB_SIZE, &info);
+        if (r != 0) {
+            fprintf(stderr, "Preview: failed to create shared memory %s%s\n", dest, (r == 8) ? ", another capture is using it" : "");
+            free(p);
+            return NULL;
+        }
+        p->shm = true;
+    }
+    else {
+        if (net_stream_is_url(dest)) {
+            net_stream_header_t header;
+            net_stream_header_init(&header, cfg->sample_rate, NET_FORMAT_PREVIEW, 0, PREVIEW_NET_CHUNK);
+            header.bits = 12;
+            if ((p->net = net_sink_open(dest, &header)) == NULL) {
+                free(p);
+                return NULL;
+            }
+        }
+        else p->f = f;
+        if (rb_init(&p->rb, "preview_ringbuffer", PREVIEW_RB_SIZE) != 0) {
+            fprintf(stderr, "Preview: no memory for the ringbuffer\n");
+            net_sink_close(p->net);
+            free(p);
+            return NULL;
+        }
+        if (thrd_create(&p->thread, &preview_writer, p) != thrd_success) {
+            fprintf(stderr, "Preview: failed to start the writer\n");
+            rb_close(&p->rb);
+            net_sink_close(p->net);
+            free(p);
+            return NULL;
+        }
+        p->thread_started = true;
+    }
+    put_info(p, 0);
+    return p;
+}
+
+void preview_push(preview_t *p, uint64_t sample, const uint32_t *in, const extract_envelope_t *env, size_t len)
+{
+    size_t blocks = len / EXTRACT_STATS_BLOCK;
+
+    // a gap (frames dropped, a new recording) ends the entry in progress
+    if (sample != p->next_sample) {
+        flush_envelope(p);
+        p->group_fill = 0;
+        p->pending_sample = sample;
+    }
+    for (size_t i = 0; i < blocks; i++) {
+        const extract_envelope_t *e = &env[i];
+        if (p->group_fill == 0) p->acc = *e;
+        else {
+            for (int c = 0; c < 2; c++) {
+                if (e->min[c] < p->acc.min[c]) p->acc.min[c] = e->min[c];
+                if (e->max[c] > p->acc.max[c]) p->acc.max[c] = e->max[c];
+            }
+        }
+        if (++p->group_fill == p->group) {
+            p->pending[p->pending_n++] = p->acc;
+            p->group_fill = 0;
+            if (p->pending_n == PREVIEW_RECORD_ENTRIES) flush_envelope(p);
+        }
+    }
+    p->next_sample = sample + len;
+    if (p->pending_n > 0 && p->next_sample - p->pending_sample >= p->flush_samples) flush_envelope(p);
+
+    if (p->fft_interval && len >= PREVIEW_FFT_SIZE && p->next_sample > p->fft_next) {
+        size_t off = p->fft_next > sample ? (size_t)(p->fft_next - sample) : 0;
+        if (off + PREVIEW_FFT_SIZE > len) off = len - PREVIEW_FFT_SIZE;
+        put_info(p, sample + off);
+        put_spectrum(p, sample + off, in + off, 0);
+        put_spectrum(p, sample + off, in + off, 1);
+        p->fft_next = sample + off + p->fft_interval;
+    }
+}
+
+uint64_t preview_dropped(const preview_t *p)
+{
+    return atomic_load_explicit((atomic_uint_fast64_t *)&p->dropped, memory_order_relaxed);
+}
+
+void preview_close(preview_t *p)
+{
+    uint64_t dropped;
+
+    if (!p) return;
+    flush_envelope(p);
+    if (p->thread_started) {
+        atomic_store(&p->stop, true);
+        thrd_join(p->thread, NULL);
+    }
+    dropped = preview_dropped(p);
+    if (dropped) fprintf(stderr, "Preview: %" PRIu64 " records dropped, the sink was behind\n", dropped);
+    rb_close(&p->rb);
+    net_sink_close(p->net);
+    if (p->f && p->f != stdout) fclose(p->f);
+    free(p);
+}
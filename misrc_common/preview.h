@@ -0,0 +1,120 @@
+/*
+ * MISRC Common - Low Rate Preview Stream
+ *
+ * A small stream next to the full rate recording for checking from
+ * elsewhere that the deck still delivers a signal: the min/max envelope of
+ * both ADCs at a low rate and now and then a spectrum of each. It is made
+ * from what the extraction pass has at hand anyway, the per block extremes
+ * of the stats kernels (extract_stats_t.envelope) and a few raw capture
+ * words for the spectra, so the extraction thread only folds entries.
+ *
+ * Records are queued in a small ringbuffer and never wait for the sink,
+ * when it falls behind records are dropped and counted. Sinks are a file,
+ * tcp://host:port (net_stream.h, NET_FORMAT_PREVIEW) or shm://name
+ * (rb_shm.h, RB_SHM_FORMAT_PREVIEW), where the ringbuffer itself is shared.
+ *
+ * The stream is a sequence of records, all little endian: a
+ * preview_record_t followed by length payload bytes.
+ *  - PREVIEW_INFO_SYNC: a preview_info_t, first in the stream and again
+ *    before every spectrum, so a reader that joins late finds it.
+ *  - PREVIEW_ENVELOPE_SYNC: extract_envelope_t entries (min A, min B,
+ *    max A, max B, 12 bit sample values), one per decimation samples.
+ *  - PREVIEW_SPECTRUM_SYNC: fft_size / 2 int16 bins of one ADC in
+ *    hundredths of a dB relative to a full scale sine, bin k is at
+ *    k * sample_rate / fft_size Hz.
+ * A reader that lost its place looks for the next sync word.
+ */
+
+#ifndef MISRC_PREVIEW_H
+#define MISRC_PREVIEW_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "extract.h"
+
+#define PREVIEW_MAGIC               "MISRCPRV"
+#define PREVIEW_VERSION             1
+#define PREVIEW_INFO_SYNC           0x464e4950u     /* "PINF" */
+#define PREVIEW_ENVELOPE_SYNC       0x564e4550u     /* "PENV" */
+#define PREVIEW_SPECTRUM_SYNC       0x43505350u     /* "PSPC" */
+
+#define PREVIEW_DEFAULT_DECIMATION  4096            /* About 10k entries per second at 40 MHz */
+#define PREVIEW_MIN_DECIMATION      EXTRACT_STATS_BLOCK
+#define PREVIEW_MAX_DECIMATION      (1u << 24)
+#define PREVIEW_DEFAULT_FFT_INTERVAL 1.0            /* Seconds between spectra */
+#define PREVIEW_FFT_SIZE            1024
+#define PREVIEW_FLUSH_SECONDS       0.25            /* Longest an envelope entry is held back */
+#define PREVIEW_RECORD_ENTRIES      1024            /* Most envelope entries per record */
+
+typedef struct {
+    uint32_t sync;              /* One of the PREVIEW_*_SYNC */
+    uint32_t length;            /* Payload bytes following */
+    uint64_t sample;            /* Capture sample of the first envelope entry or of the spectrum */
+    uint8_t channel;            /* Spectrum: 0 = ADC A, 1 = ADC B, otherwise 0 */
+    uint8_t reserved[7];
+} preview_record_t;
+
+typedef struct {
+    char magic[8];              /* PREVIEW_MAGIC, not terminated */
+    uint32_t version;           /* PREVIEW_VERSION */
+    uint32_t sample_rate;       /* Capture samples per second */
+    uint32_t decimation;        /* Capture samples per envelope entry */
+    uint32_t fft_size;          /* Points of the spectra */
+} preview_info_t;
+
+typedef struct {
+    uint32_t sample_rate;       /* Capture samples per second */
+    uint32_t decimation;        /* Capture samples per envelope entry, a power of two
+                                   from PREVIEW_MIN_DECIMATION to PREVIEW_MAX_DECIMATION */
+    double fft_interval;        /* Seconds between spectra, 0 for none */
+} preview_config_t;
+
+typedef struct preview preview_t;
+
+/* Fill in the defaults
+ *
+ * @param cfg           Configuration to initialize
+ * @param sample_rate   Capture samples per second
+ */
+void preview_config_init(preview_config_t *cfg, uint32_t sample_rate);
+
+/* Parse a decimation option
+ *
+ * @param s             Capture samples per envelope entry
+ * @param decimation    Receives the value
+ * @return 0 on success, -1 if it is not a power of two in range
+ */
+int preview_parse_decimation(const char *s, uint32_t *decimation);
+
+/* Open a preview sink, the writer thread starts right away
+ *
+ * @param dest          tcp://host:port (blocks until connected), shm://name, or a file name
+ * @param f             The opened file for a file name, NULL for tcp:// and shm://,
+ *                      closed by preview_close() unless it is stdout
+ * @param cfg           Configuration
+ * @return Preview state, or NULL on failure
+ */
+preview_t *preview_open(const char *dest, FILE *f, const preview_config_t *cfg);
+
+/* Add a block of the capture, from the extraction thread
+ *
+ * @param p             Preview state
+ * @param sample        Capture sample of in[0], a jump starts a new envelope entry
+ * @param in            Raw capture words, read for the spectra
+ * @param env           Envelope the stats kernel wrote for the block
+ * @param len           Samples in the block, a multiple of EXTRACT_STATS_BLOCK
+ */
+void preview_push(preview_t *p, uint64_t sample, const uint32_t *in, const extract_envelope_t *env, size_t len);
+
+/* Records dropped because the sink was behind */
+uint64_t preview_dropped(const preview_t *p);
+
+/* Send what is held back, stop the writer thread and close the sink
+ *
+ * @param p             Preview state, freed (NULL is ignored)
+ */
+void preview_close(preview_t *p);
+
+#endif /* MISRC_PREVIEW_H */
@@ -0,0 +1,216 @@
+/*
+ * MISRC Common - Shared Memory Ringbuffer Export, Consumer Side
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE      /* syscall() for the futex */
+#endif
+
+#include "rb_shm.h"
+#include "ringbuffer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+struct rb_shm_reader {
+    ringbuffer_t rb;            /* Mapping of the export */
+    rb_shm_consumer_t *slot;
+    uint64_t pos;               /* Local copy, only this reader writes slot->pos */
+    uint64_t tail;              /* Cached producer position */
+};
+
+/* The layout is an interface to other programs, keep it where the header says */
+_Static_assert(offsetof(rb_shm_header_t, tail) == 64, "rb_shm_header_t layout");
+_Static_assert(offsetof(rb_shm_header_t, reserve) == 80, "rb_shm_header_t layout");
+_Static_assert(offsetof(rb_shm_header_t, read_seq) == 128, "rb_shm_header_t layout");
+_Static_assert(offsetof(rb_shm_header_t, consumers) == 192, "rb_shm_header_t layout");
+_Static_assert(sizeof(rb_shm_consumer_t) == 64, "rb_shm_consumer_t layout");
+
+/*-----------------------------------------------------------------------------
+ * Helpers
+ *-----------------------------------------------------------------------------*/
+
+static uint64_t now_ms(void)
+{
+#ifdef _WIN32
+    return (uint64_t)GetTickCount64();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+#endif
+}
+
+/* Other processes bump the counters, only Linux can sleep on them */
+static void wait_seq(_Atomic uint32_t *seq, uint32_t val, uint32_t timeout_ms)
+{
+#ifdef __linux__
+    struct timespec ts = { .tv_sec = timeout_ms / 1000, .tv_nsec = (long)(timeout_ms % 1000) * 1000000 };
+    syscall(SYS_futex, (uint32_t *)seq, FUTEX_WAIT, val, &ts, NULL, 0);
+#else
+    (void)seq; (void)val;
+    if (timeout_ms > 1) timeout_ms = 1;
+#ifdef _WIN32
+    Sleep(timeout_ms);
+#else
+    usleep(timeout_ms * 1000);
+#endif
+#endif
+}
+
+static void wake_seq(_Atomic uint32_t *seq)
+{
+#ifdef __linux__
+    syscall(SYS_futex, (uint32_t *)seq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#else
+    (void)seq;
+#endif
+}
+
+/* Tell a producer waiting for space that this consumer moved on */
+static void release(rb_shm_reader_t *reader)
+{
+    rb_shm_header_t *h = reader->rb.shm;
+    atomic_fetch_add(&h->read_seq, 1);
+    if (atomic_load(&h->write_waiting)) wake_seq(&h->read_seq);
+}
+
+/*-----------------------------------------------------------------------------
+ * Public API
+ *-----------------------------------------------------------------------------*/
+
+bool rb_shm_is_url(const char *name)
+{
+    return name && strncmp(name, RB_SHM_PREFIX, strlen(RB_SHM_PREFIX)) == 0;
+}
+
+rb_shm_reader_t *rb_shm_reader_open(const char *name, bool lossy)
+{
+    rb_shm_reader_t *reader = calloc(1, sizeof(*reader));
+    rb_shm_header_t *h;
+
+    if (!reader) return NULL;
+    if (rb_attach_shm(&reader->rb, name) != 0) {
+        fprintf(stderr, "No MISRC shared memory export named %s\n", name);
+        free(reader);
+        return NULL;
+    }
+    h = reader->rb.shm;
+
+    for (int i = 0; i < RB_SHM_MAX_CONSUMERS; i++) {
+        rb_shm_consumer_t *c = &h->consumers[i];
+        uint32_t expected = RB_SHM_SLOT_FREE;
+        if (!atomic_compare_exchange_strong(&c->state, &expected, RB_SHM_SLOT_CLAIMED)) continue;
+        c->lossy = lossy ? 1 : 0;
+#ifdef _WIN32
+        c->pid = (uint32_t)GetCurrentProcessId();
+#else
+        c->pid = (uint32_t)getpid();
+#endif
+        atomic_store(&c->dropped, 0);
+        reader->pos = reader->tail = atomic_load_explicit(&h->tail, memory_order_acquire);
+        atomic_store(&c->pos, reader->pos);
+        atomic_store_explicit(&c->state, RB_SHM_SLOT_ACTIVE, memory_order_release);
+        reader->slot = c;
+        return reader;
+    }
+
+    fprintf(stderr, "All %d consumer slots of %s are taken\n", RB_SHM_MAX_CONSUMERS, name);
+    rb_close(&reader->rb);
+    free(reader);
+    return NULL;
+}
+
+const rb_shm_header_t *rb_shm_reader_header(const rb_shm_reader_t *reader)
+{
+    return reader->rb.shm;
+}
+
+void *rb_shm_reader_read_ptr_wait(rb_shm_reader_t *reader, size_t size, uint32_t timeout_ms)
+{
+    rb_shm_header_t *h = reader->rb.shm;
+    rb_shm_consumer_t *c = reader->slot;
+    uint64_t deadline = now_ms() + timeout_ms;
+    bool waiting = false;
+    void *ptr = NULL;
+
+    for (;;) {
+        uint32_t val = atomic_load(&h->write_seq);
+        bool stopped = atomic_load(&h->state) == RB_SHM_STOPPED;
+        reader->tail = atomic_load_explicit(&h->tail, memory_order_acquire);
+        uint64_t lag = reader->tail - reader->pos;
+
+        /* Fell too far behind, skip whole blocks so the sample alignment is kept */
+        if (c->lossy && lag > reader->rb.buffer_size / 2 && lag > size) {
+            uint64_t skip = (lag - size) / size * size;
+            reader->pos += skip;
+            lag -= skip;
+            atomic_store_explicit(&c->pos, reader->pos, memory_order_release);
+            atomic_fetch_add_explicit(&c->dropped, skip, memory_order_relaxed);
+        }
+        if (lag >= size) {
+            ptr = &reader->rb.buffer[reader->pos % reader->rb.buffer_size];
+            break;
+        }
+        uint64_t now = now_ms();
+        if (stopped || now >= deadline) break;
+        /* Announce, then look once more before sleeping, the producer may have been faster */
+        if (!waiting) {
+            atomic_fetch_add(&h->read_waiting, 1);
+            waiting = true;
+            continue;
+        }
+        wait_seq(&h->write_seq, val, (uint32_t)(deadline - now));
+    }
+    if (waiting) atomic_fetch_sub(&h->read_waiting, 1);
+    return ptr;
+}
+
+int rb_shm_reader_read_finished(rb_shm_reader_t *reader, size_t size)
+{
+    uint64_t start = reader->pos;
+    reader->pos += size;
+    atomic_store_explicit(&reader->slot->pos, reader->pos, memory_order_release);
+    release(reader);
+    /* The producer does not wait for lossy consumers, it may have wrapped into this block,
+     * published or not: the fence keeps the reads of the block before the reserve load */
+    if (reader->slot->lossy) {
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&reader->rb.shm->reserve, memory_order_relaxed) - start > reader->rb.buffer_size) {
+            return 2;
+        }
+    }
+    return 0;
+}
+
+uint64_t rb_shm_reader_dropped(const rb_shm_reader_t *reader)
+{
+    return atomic_load(&reader->slot->dropped);
+}
+
+bool rb_shm_reader_stopped(const rb_shm_reader_t *reader)
+{
+    return atomic_load(&reader->rb.shm->state) == RB_SHM_STOPPED;
+}
+
+void rb_shm_reader_close(rb_shm_reader_t *reader)
+{
+    if (!reader) return;
+    atomic_store(&reader->slot->state, RB_SHM_SLOT_FREE);
+    release(reader);
+    rb_close(&reader->rb);
+    free(reader);
+}
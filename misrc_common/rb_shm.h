@@ -0,0 +1,176 @@
+/*
+ * MISRC Common - Shared Memory Ringbuffer Export
+ *
+ * A channel ringbuffer can live in a named shared memory object, so that a
+ * decoder on the same host (vhs-decode, hifi-decode, a monitor) reads the
+ * live samples straight out of the capture's memory, without a file or a
+ * pipe in between. misrc_capture creates it for -a/-b shm://name.
+ *
+ * Object layout: the rb_shm_header_t below at offset 0, the sample data at
+ * header_size (a page or allocation granularity multiple). The data is a
+ * ring of data_size bytes, byte position p lives at p % data_size. All
+ * positions are absolute 64 bit byte counts and never wrap.
+ *
+ * Consumer protocol:
+ *  1. Map the object, check magic, version and state.
+ *  2. Claim a free slot in consumers[]: compare-and-swap state from
+ *     RB_SHM_SLOT_FREE to RB_SHM_SLOT_CLAIMED, fill in lossy, pid and
+ *     pos = tail, then store RB_SHM_SLOT_ACTIVE.
+ *  3. tail - pos bytes are readable at pos. Store the new pos once done
+ *     with them and increment read_seq, waking write_waiting waiters.
+ *  4. Store RB_SHM_SLOT_FREE when leaving.
+ *
+ * Lossless consumers hold the capture back: the producer never overwrites
+ * bytes they have not released, a slow lossless consumer stalls the capture
+ * like a slow disk. Lossy consumers never stall it. They skip ahead when
+ * more than half the ring is behind them and have to check after reading
+ * that the block was not overwritten meanwhile: the producer raises reserve,
+ * the end of the bytes it may be filling, before it writes to them, which
+ * can be ahead of tail. After reading, issue an acquire fence (so the reads
+ * of the block cannot move after the next load), then load reserve. If
+ * reserve - (their old pos) is more than data_size, the block is torn.
+ * Comparing against tail instead misses writes that are not published yet.
+ *
+ * write_seq and read_seq are futex words on Linux (shared, not private).
+ * Waiters increment *_waiting before waiting and decrement it afterwards.
+ * Elsewhere waiters poll them. A producer that ends sets state to
+ * RB_SHM_STOPPED. Consumers whose pid is gone are dropped by the producer.
+ */
+
+#ifndef MISRC_RB_SHM_H
+#define MISRC_RB_SHM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define RB_SHM_PREFIX           "shm://"
+#define RB_SHM_MAGIC            "MISRCSHM"
+#define RB_SHM_VERSION          2      /* 2: reserve */
+#define RB_SHM_MAX_CONSUMERS    8
+
+/* Sample formats of the data, same meaning as the network stream formats */
+typedef enum {
+    RB_SHM_FORMAT_S16 = 0,      /* 16 bit, 12 bit samples sign extended */
+    RB_SHM_FORMAT_S16_PADDED,   /* 16 bit, 12 bit samples in the upper bits (misrc_capture -p) */
+    RB_SHM_FORMAT_PREVIEW,      /* Preview records (preview.h), the channel is 0 */
+    RB_SHM_FORMAT_F32,          /* 32 bit float normalized to [-1, 1) (misrc_capture --rf-float) */
+} rb_shm_format_t;
+
+/* Producer state */
+enum {
+    RB_SHM_RUNNING = 1,
+    RB_SHM_STOPPED = 2,
+};
+
+/* Consumer slot state */
+enum {
+    RB_SHM_SLOT_FREE = 0,
+    RB_SHM_SLOT_ACTIVE = 1,
+    RB_SHM_SLOT_CLAIMED = 2,    /* Being set up */
+};
+
+/* One cache line per consumer, offsets relative to the slot */
+typedef struct {
+    _Alignas(64)
+    _Atomic uint32_t state;     /* +0  slot state */
+    uint32_t lossy;             /* +4  1 = never stall the producer */
+    uint32_t pid;               /* +8  consumer process, dead ones get evicted */
+    uint32_t reserved;          /* +12 */
+    _Atomic uint64_t pos;       /* +16 absolute read position */
+    _Atomic uint64_t dropped;   /* +24 bytes a lossy consumer skipped */
+} rb_shm_consumer_t;
+
+/* Offsets given for readers in other languages, all fields native endian */
+typedef struct {
+    char magic[8];              /* 0   RB_SHM_MAGIC, not terminated */
+    uint32_t version;           /* 8   RB_SHM_VERSION */
+    uint32_t header_size;       /* 12  offset of the data in the object */
+    uint64_t data_size;         /* 16  ring size in bytes */
+    uint32_t sample_rate;       /* 24  samples per second */
+    uint8_t format;             /* 28  rb_shm_format_t */
+    uint8_t channel;            /* 29  0 = ADC A, 1 = ADC B */
+    uint8_t bits;               /* 30  significant bits per sample */
+    uint8_t reserved;           /* 31 */
+    uint32_t producer_pid;      /* 32 */
+    _Atomic uint32_t state;     /* 36  RB_SHM_RUNNING or RB_SHM_STOPPED */
+
+    /* Producer side */
+    _Alignas(64)
+    _Atomic uint64_t tail;      /* 64  absolute write position, bytes before it are valid */
+    _Atomic uint32_t write_seq; /* 72  bumped on every commit */
+    _Atomic int32_t read_waiting;  /* 76  consumers waiting on write_seq */
+    _Atomic uint64_t reserve;   /* 80  end of the bytes the producer may be writing, >= tail */
+
+    /* Consumer side */
+    _Alignas(64)
+    _Atomic uint32_t read_seq;  /* 128 bumped on every release */
+    _Atomic int32_t write_waiting; /* 132 producer waiting on read_seq */
+
+    rb_shm_consumer_t consumers[RB_SHM_MAX_CONSUMERS];  /* 192 */
+} rb_shm_header_t;
+
+/* Stream description the producer puts in the header */
+typedef struct {
+    uint32_t sample_rate;
+    rb_shm_format_t format;
+    uint8_t channel;
+    uint8_t bits;
+} rb_shm_info_t;
+
+/* Check whether an output name is a shared memory export
+ *
+ * @param name          Output name
+ * @return true if it starts with RB_SHM_PREFIX
+ */
+bool rb_shm_is_url(const char *name);
+
+/*-----------------------------------------------------------------------------
+ * Consumer
+ *-----------------------------------------------------------------------------*/
+
+typedef struct rb_shm_reader rb_shm_reader_t;
+
+/* Attach to an export as a consumer
+ *
+ * @param name          Export name, with or without RB_SHM_PREFIX
+ * @param lossy         true to never stall the capture
+ * @return Reader, or NULL if there is no such export or all slots are taken
+ */
+rb_shm_reader_t *rb_shm_reader_open(const char *name, bool lossy);
+
+/* Header of the export, for sample rate and format */
+const rb_shm_header_t *rb_shm_reader_header(const rb_shm_reader_t *reader);
+
+/* Wait until size bytes are readable
+ *
+ * @param reader        Reader
+ * @param size          Bytes wanted, at most half the ring
+ * @param timeout_ms    Longest wait
+ * @return Pointer to size contiguous bytes, NULL on timeout or once the
+ *         producer stopped and less than size bytes are left
+ */
+void *rb_shm_reader_read_ptr_wait(rb_shm_reader_t *reader, size_t size, uint32_t timeout_ms);
+
+/* Release bytes read through rb_shm_reader_read_ptr_wait()
+ *
+ * @param reader        Reader
+ * @param size          Bytes to release
+ * @return 0, or 2 if a lossy reader got overrun while reading
+ */
+int rb_shm_reader_read_finished(rb_shm_reader_t *reader, size_t size);
+
+/* Bytes a lossy reader skipped so far */
+uint64_t rb_shm_reader_dropped(const rb_shm_reader_t *reader);
+
+/* Check whether the producer has stopped */
+bool rb_shm_reader_stopped(const rb_shm_reader_t *reader);
+
+/* Leave the consumer slot and unmap
+ *
+ * @param reader        Reader, freed (NULL is ignored)
+ */
+void rb_shm_reader_close(rb_shm_reader_t *reader);
+
+#endif /* MISRC_RB_SHM_H */
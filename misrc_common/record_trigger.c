@@ -0,0 +1,179 @@
+/*
+ * MISRC Common - Triggered Recording Implementation
+ */
+
+#include "record_trigger.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "edge_search.h"
+
+/* Layout of the capture words, see extract.c */
+#define TRIGGER_AUX_SHIFT   12
+#define TRIGGER_ADC_B_SHIFT 20
+#define TRIGGER_ADC_MASK    0xfff
+#define TRIGGER_ADC_MAX     2047
+
+/*-----------------------------------------------------------------------------
+ * Conditions
+ *-----------------------------------------------------------------------------*/
+
+int record_trigger_parse(const char *s, record_trigger_cond_t *cond)
+{
+    char *end;
+    long v;
+
+    memset(cond, 0, sizeof(*cond));
+    if (strcmp(s, "manual") == 0) {
+        cond->type = RECORD_TRIGGER_MANUAL;
+        return 0;
+    }
+    if ((s[0] == 'a' || s[0] == 'b') && (s[1] == '>' || s[1] == '<')) {
+        v = strtol(s + 2, &end, 10);
+        if (end == s + 2 || *end != 0 || v < -TRIGGER_ADC_MAX - 1 || v > TRIGGER_ADC_MAX) return -1;
+        cond->type = (s[1] == '>') ? RECORD_TRIGGER_RISING : RECORD_TRIGGER_FALLING;
+        cond->channel = (s[0] == 'b');
+        cond->level = (int16_t)v;
+        return 0;
+    }
+    if (strncmp(s, "aux", 3) == 0 && s[3] >= '0' && s[3] <= '7') {
+        cond->channel = s[3] - '0';
+        if (s[4] == 0) cond->type = RECORD_TRIGGER_AUX_CHANGE;
+        else if (s[4] == '+' && s[5] == 0) cond->type = RECORD_TRIGGER_AUX_RISING;
+        else if (s[4] == '-' && s[5] == 0) cond->type = RECORD_TRIGGER_AUX_FALLING;
+        else return -1;
+        return 0;
+    }
+    return -1;
+}
+
+int record_trigger_parse_roll(const char *s, double *seconds)
+{
+    char *end;
+    double v = strtod(s, &end);
+    if (end == s || *end != 0 || !(v >= 0.0 && v <= RECORD_TRIGGER_MAX_ROLL)) return -1;
+    *seconds = v;
+    return 0;
+}
+
+/* Index of the first sample of a block that meets the condition, or -1 */
+static ssize_t scan_block(record_trigger_t *t, const uint32_t *in)
+{
+    const record_trigger_cond_t *c = &t->cond;
+    const size_t n = t->block;
+    ssize_t hit = -1;
+
+    switch (c->type) {
+    case RECORD_TRIGGER_RISING:
+    case RECORD_TRIGGER_FALLING: {
+        /* scratch[0] is the sample before the block, so an edge across blocks is found too */
+        const unsigned shift = c->channel ? TRIGGER_ADC_B_SHIFT : 0;
+        int16_t *s = t->scratch;
+        for (size_t i = 0; i < n; i++) {
+            s[i + 1] = (int16_t)(TRIGGER_ADC_MAX - (int32_t)((in[i] >> shift) & TRIGGER_ADC_MASK));
+        }
+        s[0] = t->primed ? t->last : s[1];
+        hit = (c->type == RECORD_TRIGGER_RISING) ? trigger_find_rising_edge(s, n + 1, c->level, 1)
+                                                 : trigger_find_falling_edge(s, n + 1, c->level, 1);
+        if (hit >= 0) hit--;
+        t->last = s[n];
+        break;
+    }
+    case RECORD_TRIGGER_AUX_RISING:
+    case RECORD_TRIGGER_AUX_FALLING:
+    case RECORD_TRIGGER_AUX_CHANGE: {
+        const unsigned shift = TRIGGER_AUX_SHIFT + (unsigned)c->channel;
+        uint32_t prev = t->primed ? t->last_aux : (in[0] >> shift) & 1;
+        for (size_t i = 0; i < n; i++) {
+            uint32_t bit = (in[i] >> shift) & 1;
+            if (bit != prev && (c->type == RECORD_TRIGGER_AUX_CHANGE || bit == (c->type == RECORD_TRIGGER_AUX_RISING))) {
+                hit = (ssize_t)i;
+                break;
+            }
+            prev = bit;
+        }
+        t->last_aux = (in[n - 1] >> shift) & 1;
+        break;
+    }
+    default:
+        break;
+    }
+    t->primed = true;
+    return hit;
+}
+
+/*-----------------------------------------------------------------------------
+ * Public API
+ *-----------------------------------------------------------------------------*/
+
+int record_trigger_init(record_trigger_t *t, const record_trigger_cond_t *cond, size_t block,
+                        uint64_t pre_samples, uint64_t post_samples)
+{
+    memset(t, 0, sizeof(*t));
+    t->cond = *cond;
+    t->block = block;
+    t->pre_blocks = (uint32_t)((pre_samples + block - 1) / block);
+    t->event_blocks = t->pre_blocks + 1 + (uint32_t)((post_samples + block - 1) / block);
+    t->scratch = malloc((block + 1) * sizeof(int16_t));
+    if (!t->scratch) return -1;
+    atomic_init(&t->fired, 0);
+    return 0;
+}
+
+size_t record_trigger_wanted(const record_trigger_t *t)
+{
+    return (t->remaining ? 1 : (size_t)t->held + 1) * t->block;
+}
+
+size_t record_trigger_held_samples(const record_trigger_t *t)
+{
+    return (size_t)t->held * t->block;
+}
+
+uint64_t record_trigger_event_samples(const record_trigger_t *t)
+{
+    return (uint64_t)t->event_blocks * t->block;
+}
+
+record_trigger_action_t record_trigger_step(record_trigger_t *t, const uint32_t *in, uint64_t sample)
+{
+    if (t->remaining) {
+        if (t->held) t->held--;
+        if (--t->remaining == 0) {
+            /* The blocks after the event were not looked at, start afresh */
+            t->primed = false;
+            atomic_store(&t->fired, 0);
+        }
+        return RECORD_TRIGGER_WRITE;
+    }
+
+    const uint32_t *newest = in + (size_t)t->held * t->block;
+    uint64_t newest_sample = sample + (uint64_t)t->held * t->block;
+    ssize_t hit = scan_block(t, newest);
+    if (hit < 0 && atomic_exchange(&t->fired, 0)) hit = 0;
+    t->held++;
+    if (hit >= 0) {
+        t->remaining = t->event_blocks;
+        t->events++;
+        t->trigger_sample = newest_sample + (uint64_t)hit;
+        return RECORD_TRIGGER_START;
+    }
+    if (t->held > t->pre_blocks) {
+        t->held--;
+        return RECORD_TRIGGER_DISCARD;
+    }
+    return RECORD_TRIGGER_WAIT;
+}
+
+void record_trigger_fire(record_trigger_t *t)
+{
+    atomic_store(&t->fired, 1);
+}
+
+void record_trigger_free(record_trigger_t *t)
+{
+    if (!t) return;
+    free(t->scratch);
+    t->scratch = NULL;
+}
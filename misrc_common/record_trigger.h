@@ -0,0 +1,134 @@
+/*
+ * MISRC Common - Triggered Recording
+ *
+ * Records only a window around events instead of the whole capture. The
+ * extraction thread looks at every block of capture words as it arrives,
+ * but leaves the last pre-roll worth of them unread in the capture
+ * ringbuffer. When a trigger fires, what is still there becomes the
+ * pre-roll and is extracted and written together with the post-roll, the
+ * older blocks were handed back to the capture without being extracted, so
+ * extraction, encoding and disk writes scale with the events.
+ *
+ * Every event is exactly event_blocks blocks long, so the outputs cut a
+ * file segment per event by length alone. A trigger right after an event
+ * finds less than the full pre-roll and gets a longer post-roll instead,
+ * triggers during an event are not looked for.
+ *
+ * Conditions (record_trigger_parse()):
+ *  - a>LEVEL, a<LEVEL, b>LEVEL, b<LEVEL: ADC A or B crosses LEVEL upwards
+ *    or downwards (12 bit sample value, -2048 to 2047)
+ *  - auxN+, auxN-, auxN: aux bit N (0-7) goes high, goes low, or changes
+ *  - manual: only record_trigger_fire()
+ * record_trigger_fire() starts an event with any condition.
+ */
+
+#ifndef MISRC_RECORD_TRIGGER_H
+#define MISRC_RECORD_TRIGGER_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define RECORD_TRIGGER_DEFAULT_PRE_ROLL     1.0     /* Seconds */
+#define RECORD_TRIGGER_DEFAULT_POST_ROLL    5.0     /* Seconds */
+#define RECORD_TRIGGER_MAX_ROLL             600.0   /* Longest pre-roll or post-roll, seconds */
+
+typedef enum {
+    RECORD_TRIGGER_MANUAL = 0,
+    RECORD_TRIGGER_RISING,      /* ADC crosses level upwards */
+    RECORD_TRIGGER_FALLING,     /* ADC crosses level downwards */
+    RECORD_TRIGGER_AUX_RISING,  /* Aux bit goes high */
+    RECORD_TRIGGER_AUX_FALLING, /* Aux bit goes low */
+    RECORD_TRIGGER_AUX_CHANGE   /* Aux bit changes */
+} record_trigger_type_t;
+
+typedef struct {
+    record_trigger_type_t type;
+    int channel;                /* 0 = ADC A, 1 = ADC B, or the aux bit */
+    int16_t level;              /* Crossing level of the edge conditions */
+} record_trigger_cond_t;
+
+/* What the caller does with the capture ringbuffer after record_trigger_step() */
+typedef enum {
+    RECORD_TRIGGER_WAIT,        /* Nothing, wait for the next block */
+    RECORD_TRIGGER_DISCARD,     /* Hand back the oldest block without extracting it */
+    RECORD_TRIGGER_START,       /* An event starts, nothing consumed, write from the oldest block on */
+    RECORD_TRIGGER_WRITE        /* Extract and write the oldest block */
+} record_trigger_action_t;
+
+typedef struct {
+    record_trigger_cond_t cond;
+    size_t block;               /* Capture samples per block */
+    uint32_t pre_blocks;        /* Blocks kept unread while armed */
+    uint32_t event_blocks;      /* Blocks written per event */
+    uint32_t held;              /* Blocks looked at and still unread in the ringbuffer */
+    uint32_t remaining;         /* Blocks of the current event still to write, 0 while armed */
+    uint64_t events;            /* Events started */
+    uint64_t trigger_sample;    /* Capture sample the last event was triggered at */
+    int16_t *scratch;           /* One channel of a block for the edge search, with the sample before */
+    int16_t last;               /* Last sample of the triggering ADC */
+    uint32_t last_aux;          /* Last aux bit */
+    bool primed;                /* last and last_aux are valid */
+    atomic_int fired;           /* Set by record_trigger_fire() */
+} record_trigger_t;
+
+/* Parse a trigger condition
+ *
+ * @param s             Condition, see above
+ * @param cond          Receives the condition
+ * @return 0 on success, -1 if it is not a valid condition
+ */
+int record_trigger_parse(const char *s, record_trigger_cond_t *cond);
+
+/* Parse a pre-roll or post-roll
+ *
+ * @param s             Seconds, 0 to RECORD_TRIGGER_MAX_ROLL
+ * @param seconds       Receives the seconds
+ * @return 0 on success, -1 if it is not a valid length
+ */
+int record_trigger_parse_roll(const char *s, double *seconds);
+
+/* Set up a trigger
+ *
+ * @param t             Trigger state
+ * @param cond          Condition
+ * @param block         Capture samples per block, the unit the caller extracts in
+ * @param pre_samples   Pre-roll in capture samples, rounded up to blocks
+ * @param post_samples  Post-roll in capture samples after the triggering block, rounded up to blocks
+ * @return 0 on success, -1 if out of memory
+ */
+int record_trigger_init(record_trigger_t *t, const record_trigger_cond_t *cond, size_t block,
+                        uint64_t pre_samples, uint64_t post_samples);
+
+/* Capture samples the caller needs unread in the ringbuffer before the next
+ * record_trigger_step(), counted from the oldest unread one
+ */
+size_t record_trigger_wanted(const record_trigger_t *t);
+
+/* Capture samples held back as pre-roll, not part of the backlog */
+size_t record_trigger_held_samples(const record_trigger_t *t);
+
+/* Capture samples written per event */
+uint64_t record_trigger_event_samples(const record_trigger_t *t);
+
+/* Look at the next block and tell what to do with the ringbuffer
+ *
+ * @param t             Trigger state
+ * @param in            Oldest unread capture word, record_trigger_wanted() of them
+ * @param sample        Capture sample of in[0]
+ * @return The action, after RECORD_TRIGGER_DISCARD and RECORD_TRIGGER_WRITE
+ *         the caller consumes exactly one block
+ */
+record_trigger_action_t record_trigger_step(record_trigger_t *t, const uint32_t *in, uint64_t sample);
+
+/* Start an event with the next block, safe to call from a signal handler */
+void record_trigger_fire(record_trigger_t *t);
+
+/* Free the buffers of a trigger
+ *
+ * @param t             Trigger state (NULL is ignored)
+ */
+void record_trigger_free(record_trigger_t *t);
+
+#endif /* MISRC_RECORD_TRIGGER_H */
@@ -0,0 +1,308 @@
+/*
+ * MISRC Common - Capture Replay Implementation
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE      /* clock_gettime() in threading.h */
+#endif
+#define _FILE_OFFSET_BITS 64
+
+#include "replay.h"
+#include "file_map.h"
+#include "threading.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+/* Input mapped at a time, remapped when the next frame runs past it */
+#define REPLAY_WINDOW_BYTES     (64u << 20)
+/* The parser needs a few frames in order before it takes the payload of
+ * one, raw captures repeat their first frame this often so none is lost */
+#define REPLAY_PRIMING_FRAMES   5
+/* Upper bound for the unthrottled wait on the ringbuffer, so a stop is noticed */
+#define REPLAY_WAIT_MS          100
+
+struct replay {
+    replay_config_t cfg;
+    char *path;
+    const char *tag;
+    file_map_t map;
+    uint64_t win_offset;        /* File offset of the mapped window */
+    bool dump;                  /* Frame dump, otherwise a raw capture */
+    unsigned width, height;
+    uint64_t data_offset;       /* File offset of the first frame or payload word */
+    uint64_t data_bytes;        /* Whole frames (or frame payloads) in the file */
+    size_t in_bytes;            /* Input consumed per frame */
+    uint64_t frame_samples;     /* Capture words per frame, for pacing and the summary */
+    uint32_t rate;              /* Sample rate of the recording */
+    uint16_t *frame;
+    thrd_t thread;
+    atomic_bool running;
+    atomic_bool finished;
+    uint64_t frames;            /* Sent through the callback, priming frames included */
+    uint64_t loops;
+    uint64_t t_start, t_end;
+};
+
+/*-----------------------------------------------------------------------------
+ * Helpers
+ *-----------------------------------------------------------------------------*/
+
+/* in_bytes of input at pos, remapping the window when needed */
+static const uint8_t *replay_input(replay_t *r, uint64_t pos)
+{
+    uint64_t off = r->data_offset + pos;
+    if (r->map.data == NULL || off < r->win_offset || off + r->in_bytes > r->win_offset + r->map.len) {
+        size_t len = (r->in_bytes > REPLAY_WINDOW_BYTES) ? r->in_bytes : REPLAY_WINDOW_BYTES;
+        if (file_map_window(&r->map, off, len) != 0 || r->map.len < r->in_bytes) return NULL;
+        r->win_offset = off;
+    }
+    return r->map.data + (off - r->win_offset);
+}
+
+/* Capture words in a frame as the length words of its lines add up, audio
+ * lines of dumps with stream ids count too, close enough for pacing */
+static uint64_t frame_payload_samples(const uint16_t *frame, unsigned width, unsigned height)
+{
+    uint64_t words = 0;
+    for (unsigned line = 0; line < height; line++) {
+        unsigned len = frame[(size_t)line * width + width - 1] & 0x0fff;
+        words += (len < width) ? len : width - 1;
+    }
+    return words / 2;
+}
+
+static int replay_open_dump(replay_t *r)
+{
+    replay_dump_header_t h;
+    if (r->map.file_size < sizeof(h) || file_map_window(&r->map, 0, sizeof(h)) != 0) return -1;
+    memcpy(&h, r->map.data, sizeof(h));
+    if (h.version != REPLAY_DUMP_VERSION || h.width < 2 || h.height < 2 * sizeof(metadata_t)) {
+        fprintf(stderr, "%s%s is a frame dump of an unknown version or size\n", r->tag, r->path);
+        return -1;
+    }
+    r->dump = true;
+    r->width = h.width;
+    r->height = h.height;
+    r->data_offset = sizeof(h);
+    r->in_bytes = (size_t)h.width * h.height * sizeof(uint16_t);
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Replay Thread
+ *-----------------------------------------------------------------------------*/
+
+static int replay_thread(void *ctx)
+{
+    replay_t *r = ctx;
+    const replay_config_t *cfg = &r->cfg;
+    const size_t frame_bytes = (size_t)r->width * r->height * sizeof(uint16_t);
+    const uint64_t frame_ns = (cfg->speed > 0.0) ? (uint64_t)(r->frame_samples * 1e9 / (r->rate * cfg->speed)) : 0;
+    unsigned priming = r->dump ? 0 : REPLAY_PRIMING_FRAMES;
+    uint64_t pos = 0;
+    bool late_reported = false;
+
+    /* Raw captures go out without CRC or stream ids, at the recorded rate */
+    metadata_t meta;
+    memset(&meta, 0, sizeof(meta));
+    meta.magic = HSDAOH_MAGIC;
+    meta.crc_config = CRC_NONE;
+    meta.stream_info[0].srate = r->rate;
+
+    hsdaoh_data_info_t info;
+    memset(&info, 0, sizeof(info));
+    info.ctx = cfg->ctx;
+    info.buf = (uint8_t *)r->frame;
+    info.len = frame_bytes;
+    info.width = r->width;
+    info.height = r->height;
+
+    r->t_start = get_time_ns();
+    while (atomic_load(&r->running)) {
+        if (frame_ns != 0) {
+            uint64_t due = r->t_start + r->frames * frame_ns;
+            uint64_t now = get_time_ns();
+            if (due > now) {
+                int ms = (int)((due - now) / 1000000);
+                if (ms > 0) thrd_sleep_ms(ms);
+            } else if (now - due > 10 * frame_ns && !late_reported) {
+                fprintf(stderr, "%sReplay falls behind %.2fx real time\n", r->tag, cfg->speed);
+                late_reported = true;
+            }
+        } else if (cfg->rb != NULL && rb_write_ptr_wait(cfg->rb, frame_bytes, REPLAY_WAIT_MS) == NULL) {
+            continue;
+        }
+
+        const uint8_t *src = replay_input(r, pos);
+        if (src == NULL) {
+            fprintf(stderr, "%sFailed to map %s at offset %llu\n", r->tag, r->path,
+                    (unsigned long long)(r->data_offset + pos));
+            break;
+        }
+        if (r->dump) {
+            memcpy(r->frame, src, frame_bytes);
+        } else {
+            meta.framecounter = (uint16_t)(r->frames + 1);
+            replay_pack_frame(r->frame, r->width, r->height, (const uint16_t *)src, &meta);
+        }
+        cfg->callback(&info);
+        r->frames++;
+
+        if (priming > 0) {
+            priming--;
+            continue;
+        }
+        pos += r->in_bytes;
+        if (pos + r->in_bytes > r->data_bytes) {
+            if (!cfg->loop) break;
+            pos = 0;
+            r->loops++;
+        }
+    }
+    r->t_end = get_time_ns();
+    atomic_store(&r->finished, true);
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Public API
+ *-----------------------------------------------------------------------------*/
+
+replay_t *replay_start(const replay_config_t *config)
+{
+    replay_t *r = calloc(1, sizeof(*r));
+    if (!r) return NULL;
+    r->cfg = *config;
+    r->tag = config->tag ? config->tag : "";
+    r->path = strdup(config->path);
+    if (!r->path || file_map_open_read(&r->map, r->path) != 0) {
+        fprintf(stderr, "%sFailed to open %s for replay\n", r->tag, config->path);
+        free(r->path);
+        free(r);
+        return NULL;
+    }
+
+    if (r->map.file_size >= sizeof(replay_dump_header_t) &&
+        file_map_window(&r->map, 0, sizeof(replay_dump_header_t)) == 0 &&
+        memcmp(r->map.data, REPLAY_DUMP_MAGIC, 8) == 0) {
+        if (replay_open_dump(r) != 0) goto fail;
+    } else {
+        r->width = REPLAY_FRAME_WIDTH;
+        r->height = REPLAY_FRAME_HEIGHT;
+        r->in_bytes = (size_t)(r->width - 1) * r->height * sizeof(uint16_t);
+        r->rate = REPLAY_SAMPLE_RATE;
+    }
+    /* A trailing partial frame is not sent, loops start over at the first whole one */
+    r->data_bytes = (r->map.file_size - r->data_offset) / r->in_bytes * r->in_bytes;
+    if (r->data_bytes == 0) {
+        fprintf(stderr, "%s%s is shorter than one frame\n", r->tag, r->path);
+        goto fail;
+    }
+
+    r->frame = malloc((size_t)r->width * r->height * sizeof(uint16_t));
+    if (!r->frame) goto fail;
+
+    if (r->dump) {
+        const uint8_t *first = replay_input(r, 0);
+        metadata_t meta;
+        if (!first) goto fail;
+        hsdaoh_extract_metadata((uint8_t *)first, &meta, r->width);
+        r->rate = (meta.magic == HSDAOH_MAGIC && meta.stream_info[0].srate != 0) ? meta.stream_info[0].srate : REPLAY_SAMPLE_RATE;
+        r->frame_samples = frame_payload_samples((const uint16_t *)first, r->width, r->height);
+        if (r->frame_samples == 0) r->frame_samples = (uint64_t)(r->width - 1) * r->height / 2;
+    } else {
+        r->frame_samples = r->in_bytes / 4;
+    }
+
+    fprintf(stderr, "%sReplaying %s%s: %llu frames of %ux%u at %.1f MSPS, ", r->tag,
+            r->dump ? "frame dump " : "", r->path,
+            (unsigned long long)(r->data_bytes / r->in_bytes), r->width, r->height, r->rate / 1e6);
+    if (config->speed > 0.0) fprintf(stderr, "%.2fx real time%s\n", config->speed, config->loop ? ", looped" : "");
+    else fprintf(stderr, "as fast as possible%s\n", config->loop ? ", looped" : "");
+
+    atomic_store(&r->running, true);
+    if (thrd_create(&r->thread, replay_thread, r) != thrd_success) {
+        fprintf(stderr, "%sFailed to create replay thread\n", r->tag);
+        goto fail;
+    }
+    return r;
+
+fail:
+    file_map_close(&r->map);
+    free(r->frame);
+    free(r->path);
+    free(r);
+    return NULL;
+}
+
+bool replay_finished(replay_t *r)
+{
+    return atomic_load(&r->finished);
+}
+
+void replay_stop(replay_t *r)
+{
+    if (!r) return;
+    atomic_store(&r->running, false);
+    if (r->cfg.rb) rb_wake(r->cfg.rb);
+    thrd_join(r->thread, NULL);
+
+    double seconds = (double)(r->t_end - r->t_start) / 1e9;
+    double mbytes = (double)r->frames * r->in_bytes / 1e6;
+    fprintf(stderr, "%sReplay: %llu frames, %llu loops, %.1f MB in %.2f s, %.1f MSPS\n", r->tag,
+            (unsigned long long)r->frames, (unsigned long long)r->loops, mbytes, seconds,
+            seconds > 0.0 ? (double)(r->frames * r->frame_samples) / seconds / 1e6 : 0.0);
+
+    file_map_close(&r->map);
+    free(r->frame);
+    free(r->path);
+    free(r);
+}
+
+int replay_parse_speed(const char *arg, double *speed)
+{
+    if (strcmp(arg, "max") == 0) {
+        *speed = REPLAY_SPEED_MAX;
+        return 0;
+    }
+    char *end;
+    double v = strtod(arg, &end);
+    if (end != arg && *end == 'x') end++;  /* "2x" reads as 2 */
+    if (end == arg || *end != '\0' || !(v > 0.0) || v > REPLAY_SPEED_LIMIT) {
+        return -1;
+    }
+    *speed = v;
+    return 0;
+}
+
+void replay_pack_frame(uint16_t *frame, unsigned width, unsigned height,
+                       const uint16_t *payload, const metadata_t *meta)
+{
+    const uint8_t *meta_bytes = (const uint8_t *)meta;
+    const size_t line_words = width - 1;
+
+    /* One nibble per line in the top bits of the length word, low nibble
+     * first, like the hsdaoh core sends the metadata */
+    for (size_t line = 0; line < height; line++) {
+        uint16_t *dst = frame + line * width;
+        uint16_t nibble = 0;
+        if (line < 2 * sizeof(*meta)) {
+            nibble = (line & 1) ? (meta_bytes[line / 2] >> 4) : (meta_bytes[line / 2] & 0x0F);
+        }
+        memcpy(dst, payload + line * line_words, line_words * sizeof(uint16_t));
+        dst[line_words] = (uint16_t)((nibble << 12) | line_words);
+    }
+}
+
+int replay_dump_header(FILE *f, uint16_t width, uint16_t height)
+{
+    replay_dump_header_t h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, REPLAY_DUMP_MAGIC, sizeof(h.magic));
+    h.version = REPLAY_DUMP_VERSION;
+    h.width = width;
+    h.height = height;
+    return (fwrite(&h, sizeof(h), 1, f) == 1) ? 0 : -1;
+}
@@ -0,0 +1,105 @@
+/*
+ * MISRC Common - Capture Replay
+ *
+ * Feeds a recorded capture through the capture callback as if a device sent
+ * it, so the parser, extraction and writers run on real signals without
+ * hardware. Two inputs are understood:
+ *
+ * - Raw captures (misrc_capture -r): 32-bit capture words, packed into
+ *   1920x1080 hsdaoh frames without CRC or stream ids on the way out
+ * - Frame dumps (misrc_capture --dump-frames): the frames as the device
+ *   sent them, CRC, stream ids and missed frames included
+ *
+ * The input is memory mapped a window at a time and may be looped. Frames go
+ * out in real time, at N x real time or as fast as the capture chain takes
+ * them, which makes a replay of the same file a repeatable benchmark.
+ */
+
+#ifndef MISRC_REPLAY_H
+#define MISRC_REPLAY_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <hsdaoh.h>
+#include <hsdaoh_raw.h>
+
+#include "ringbuffer.h"
+
+#define REPLAY_FRAME_WIDTH      1920        /* Frames built from raw captures, like the MISRC sends them */
+#define REPLAY_FRAME_HEIGHT     1080
+#define REPLAY_SAMPLE_RATE      40000000    /* Of raw captures, frame dumps carry theirs */
+#define REPLAY_SPEED_MAX        (-1.0)      /* As fast as the capture chain takes the frames */
+#define REPLAY_SPEED_LIMIT      100.0       /* Highest N x real time */
+
+/* Frame dumps start with this header, followed by width * height 16-bit words per frame */
+#define REPLAY_DUMP_MAGIC       "MISRCFRM"
+#define REPLAY_DUMP_VERSION     1
+
+typedef struct {
+    char magic[8];              /* REPLAY_DUMP_MAGIC, not terminated */
+    uint32_t version;
+    uint16_t width;             /* 16-bit words per line */
+    uint16_t height;
+} replay_dump_header_t;
+
+typedef void (*replay_frame_cb_t)(hsdaoh_data_info_t *data_info);
+
+typedef struct {
+    const char *path;           /* Raw capture or frame dump, detected by the header */
+    double speed;               /* N x real time, REPLAY_SPEED_MAX for unthrottled */
+    bool loop;                  /* Start over at the end of the file instead of finishing */
+    replay_frame_cb_t callback; /* Capture callback, gets every frame */
+    void *ctx;                  /* data_info->ctx of the callback */
+    ringbuffer_t *rb;           /* Unthrottled replays wait for a frame of room here first, may be NULL */
+    const char *tag;            /* Put in front of messages, may be NULL */
+} replay_config_t;
+
+typedef struct replay replay_t;
+
+/* Open the input and start the replay thread
+ *
+ * @param config        Replay configuration, path is copied
+ * @return Replay state, or NULL if the file cannot be replayed
+ */
+replay_t *replay_start(const replay_config_t *config);
+
+/* Check whether a replay without loop sent the whole file
+ *
+ * @return true once the last frame went through the callback
+ */
+bool replay_finished(replay_t *r);
+
+/* Stop the replay thread, print what was sent and close the input
+ *
+ * @param r             Replay state, NULL is ignored
+ */
+void replay_stop(replay_t *r);
+
+/* Parse a replay speed: N (x real time, fractions and a trailing x allowed) or "max"
+ *
+ * @return 0 on success, -1 if the string is not a valid speed
+ */
+int replay_parse_speed(const char *arg, double *speed);
+
+/* Build an hsdaoh frame around (width - 1) * height 16-bit payload words
+ *
+ * @param frame         Receives width * height words
+ * @param payload       Payload, width - 1 words go into each line
+ * @param meta          Metadata, one nibble per line in the top bits of the length word
+ *
+ * Every line is payload up to the length word, so the metadata must not ask
+ * for CRC or stream ids.
+ */
+void replay_pack_frame(uint16_t *frame, unsigned width, unsigned height,
+                       const uint16_t *payload, const metadata_t *meta);
+
+/* Write the header of a frame dump
+ *
+ * @param f             Dump file, the frames follow as whole width * height word blocks
+ * @return 0 on success, -1 on a write error
+ */
+int replay_dump_header(FILE *f, uint16_t width, uint16_t height);
+
+#endif /* MISRC_REPLAY_H */
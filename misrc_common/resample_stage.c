@@ -0,0 +1,229 @@
+/*
+ * MISRC Common - Resampling Stage Implementation
+ */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L  // nanosleep() in threading.h with -std=c11
+#endif
+
+#include "resample_stage.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#if LIBSOXR_ENABLED == 1
+#include <soxr.h>
+#endif
+
+#include "buffer.h"
+#include "decimate.h"
+#include "threading.h"
+#include "trace.h"
+
+#define STAGE_WAIT_MS 100
+
+struct resample_stage {
+    resample_stage_config_t config;
+    ringbuffer_t out;
+#if LIBSOXR_ENABLED == 1
+    soxr_t soxr;
+#endif
+    decimator_t *dec;           /* Instead of soxr for a decimation factor */
+    int16_t *tmp;               /* Resampler output before the 8 bit reduction */
+    size_t out_max;             /* Most output samples one call may produce */
+    thrd_t thread;
+    atomic_bool done;
+    atomic_bool failed;
+};
+
+/*-----------------------------------------------------------------------------
+ * Helpers
+ *-----------------------------------------------------------------------------*/
+
+/* Convert n input samples (NULL to flush), returns the output samples committed or -1 */
+static long stage_process(resample_stage_t *stage, const int16_t *in, size_t n, size_t *used)
+{
+    const size_t out_bytes = stage->config.conv_8bit ? 1 : 2;
+    uint8_t *out;
+    int16_t *dst;
+    size_t done = 0;
+
+    /* The writer drains the output, wait for it like the capture waits for us */
+    while ((out = rb_write_ptr_wait(&stage->out, stage->out_max * out_bytes, STAGE_WAIT_MS)) == NULL) {
+        if (atomic_load(&stage->failed)) return -1;
+    }
+    dst = stage->config.conv_8bit ? stage->tmp : (int16_t *)out;
+    if (stage->dec) {
+        // The FIR holds its history internally, there is nothing to flush
+        if (in) {
+            TRACE_BEGIN("decimate");
+            done = decimator_process(stage->dec, in, n, dst);
+            TRACE_END("decimate");
+        }
+        if (used) *used = n;
+    }
+#if LIBSOXR_ENABLED == 1
+    else {
+        TRACE_BEGIN("soxr");
+        soxr_error_t err = soxr_process(stage->soxr, in, n, used, dst, stage->out_max, &done);
+        TRACE_END("soxr");
+        if (err != 0) {
+            fprintf(stderr, "Error while converting: %s\n", err);
+            return -1;
+        }
+    }
+#endif
+    if (stage->config.conv_8bit && done > 0) stage->config.conv_8bit(stage->tmp, (int8_t *)out, done);
+    if (done > 0) rb_write_finished(&stage->out, done * out_bytes);
+    return (long)done;
+}
+
+/* Everything but the ringbuffer and the thread */
+static void stage_free(resample_stage_t *stage)
+{
+    if (stage->tmp) aligned_free(stage->tmp);
+    decimator_free(stage->dec);
+#if LIBSOXR_ENABLED == 1
+    if (stage->soxr) soxr_delete(stage->soxr);
+#endif
+    free(stage);
+}
+
+static int stage_thread(void *ctx)
+{
+    resample_stage_t *stage = ctx;
+    ringbuffer_t *in = stage->config.in;
+    size_t len = stage->config.in_block;
+
+    trace_thread_name("resample");
+    while (!atomic_load(&stage->failed)) {
+        size_t used = 0;
+        void *buf = rb_read_ptr_wait(in, len, STAGE_WAIT_MS);
+        if (buf == NULL) {
+            if (!stage->config.should_exit(stage->config.user_ctx)) continue;
+            len = rb_available(in) & ~(size_t)1;
+            if (len == 0) break;
+            if (len > stage->config.in_block) len = stage->config.in_block;
+            buf = rb_read_ptr(in, len);
+        }
+        if (stage_process(stage, buf, len >> 1, &used) < 0) {
+            atomic_store(&stage->failed, true);
+            break;
+        }
+        rb_read_finished(in, used << 1);
+    }
+
+    /* soxr holds back the filter delay, get it out before ending */
+    if (!atomic_load(&stage->failed) && !stage->dec) {
+        long n;
+        while ((n = stage_process(stage, NULL, 0, NULL)) > 0) {}
+        if (n < 0) atomic_store(&stage->failed, true);
+    }
+    atomic_store(&stage->done, true);
+    rb_wake(&stage->out);
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Public API
+ *-----------------------------------------------------------------------------*/
+
+void resample_stage_config_init(resample_stage_config_t *config, ringbuffer_t *in, size_t in_block,
+                                double in_rate, double out_rate)
+{
+    memset(config, 0, sizeof(*config));
+    config->in = in;
+    config->in_block = in_block;
+    config->out_size = 4 * in_block;
+    config->in_rate = in_rate;
+    config->out_rate = out_rate;
+#if LIBSOXR_ENABLED == 1
+    config->quality = SOXR_HQ;
+#endif
+    config->scale = 1.0;
+}
+
+resample_stage_t *resample_stage_start(const resample_stage_config_t *config)
+{
+    resample_stage_t *stage = calloc(1, sizeof(*stage));
+    double ratio = config->decimation ? 1.0 / config->decimation : config->out_rate / config->in_rate;
+    size_t out_size = config->out_size;
+
+    if (!stage) return NULL;
+    stage->config = *config;
+    /* A bit more than the ratio asks for, soxr hands out buffered samples in bursts */
+    stage->out_max = (size_t)((double)(config->in_block >> 1) * ratio) + 4096;
+    if (out_size < 8 * stage->out_max) out_size = 8 * stage->out_max;
+    out_size = (out_size + ALIGN_PAGE - 1) & ~(size_t)(ALIGN_PAGE - 1);
+
+    if (config->decimation) {
+        stage->dec = decimator_create(config->decimation);
+        if (!stage->dec) {
+            fprintf(stderr, "ERROR: cannot decimate by %u\n", config->decimation);
+            free(stage);
+            return NULL;
+        }
+        fprintf(stderr, "Decimating by %u with the %s half-band filter\n", config->decimation, decimator_impl_name());
+    } else {
+#if LIBSOXR_ENABLED == 1
+        soxr_io_spec_t io_spec = soxr_io_spec(SOXR_INT16_S, SOXR_INT16_S);
+        soxr_quality_spec_t qual_spec = soxr_quality_spec(config->quality, 0);
+        soxr_error_t err = NULL;
+        io_spec.scale = config->scale;
+        stage->soxr = soxr_create(config->in_rate, config->out_rate, 1, &err, &io_spec, &qual_spec, NULL);
+        if (!stage->soxr || err != 0) {
+            fprintf(stderr, "ERROR: failed allocating resampling context: %s\n", err);
+            free(stage);
+            return NULL;
+        }
+#else
+        fprintf(stderr, "ERROR: resampling to arbitrary rates needs libsoxr\n");
+        free(stage);
+        return NULL;
+#endif
+    }
+    if (config->conv_8bit && (stage->tmp = aligned_alloc(ALIGN_AVX, stage->out_max * sizeof(int16_t))) == NULL) {
+        fprintf(stderr, "ERROR: failed allocating resampling buffer\n");
+        stage_free(stage);
+        return NULL;
+    }
+    if (rb_init(&stage->out, "resample_out", out_size) != 0) {
+        fprintf(stderr, "ERROR: failed allocating the resampling ringbuffer\n");
+        stage_free(stage);
+        return NULL;
+    }
+    if (thrd_create(&stage->thread, &stage_thread, stage) != thrd_success) {
+        fprintf(stderr, "ERROR: failed to create the resampling thread\n");
+        rb_close(&stage->out);
+        stage_free(stage);
+        return NULL;
+    }
+    return stage;
+}
+
+ringbuffer_t *resample_stage_output(resample_stage_t *stage)
+{
+    return &stage->out;
+}
+
+bool resample_stage_done(void *stage)
+{
+    return atomic_load(&((resample_stage_t *)stage)->done);
+}
+
+bool resample_stage_failed(const resample_stage_t *stage)
+{
+    return atomic_load(&((resample_stage_t *)stage)->failed);
+}
+
+void resample_stage_stop(resample_stage_t *stage)
+{
+    if (!stage) return;
+    /* A writer that gave up early must not leave the stage waiting for space */
+    atomic_store(&stage->failed, true);
+    rb_wake(&stage->out);
+    thrd_join(stage->thread, NULL);
+    rb_close(&stage->out);
+    stage_free(stage);
+}
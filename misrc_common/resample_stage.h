@@ -0,0 +1,93 @@
+/*
+ * MISRC Common - Resampling Stage
+ *
+ * Runs libsoxr, or for plain 2/4/8x decimation the half-band decimators
+ * of decimate.h, on a thread of its own between a ringbuffer of 16 bit
+ * samples and a writer, which reads the resampled samples from the
+ * stage's output ringbuffer. Resampling and encoding or file I/O then run
+ * on separate cores instead of taking turns on one, which is what makes
+ * the high quality soxr recipes keep up with 40 MSPS.
+ *
+ * soxr only spreads multiple channels over threads, and a single channel
+ * stream cannot be cut into independently resampled blocks at arbitrary
+ * ratios without phase errors at the seams, so the stage is one thread per
+ * resampled output.
+ *
+ * Stages with a decimation factor do not need libsoxr and are available in
+ * every build.
+ */
+
+#ifndef MISRC_RESAMPLE_STAGE_H
+#define MISRC_RESAMPLE_STAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ringbuffer.h"
+#include "ringbuffer_writer.h"
+#include "extract.h"
+
+typedef struct {
+    ringbuffer_t *in;           /* 16 bit samples, the stage is its only reader */
+    size_t in_block;            /* Input bytes per soxr_process() call */
+    size_t out_size;            /* Output ringbuffer size, multiple of the page size */
+    double in_rate;             /* Only the ratio of the two rates counts */
+    double out_rate;
+    unsigned decimation;        /* 2, 4 or 8: half-band decimators instead of soxr, rates ignored */
+    unsigned long quality;      /* soxr quality recipe, SOXR_QQ ... SOXR_VHQ */
+    double scale;               /* Gain applied while resampling (soxr only) */
+    conv_16to8_t conv_8bit;     /* Reduce to 8 bit afterwards, NULL to keep 16 bit */
+    rb_writer_should_exit_cb_t should_exit;  /* Input ends, the rest is converted and flushed */
+    void *user_ctx;             /* For should_exit */
+} resample_stage_config_t;
+
+typedef struct resample_stage resample_stage_t;
+
+/* Initialize a stage config with defaults
+ *
+ * @param config        Config to initialize
+ * @param in            Input ringbuffer
+ * @param in_block      Input bytes per call
+ * @param in_rate       Input sample rate
+ * @param out_rate      Output sample rate
+ */
+void resample_stage_config_init(resample_stage_config_t *config, ringbuffer_t *in, size_t in_block,
+                                double in_rate, double out_rate);
+
+/* Create the resampler and start the stage thread
+ *
+ * @param config        Stage configuration, copied
+ * @return Stage, or NULL if the resampler or the output ringbuffer could not
+ *         be set up (or soxr is needed but not built in)
+ */
+resample_stage_t *resample_stage_start(const resample_stage_config_t *config);
+
+/* Ringbuffer the writer reads the resampled samples from
+ *
+ * @param stage         Stage
+ * @return Output ringbuffer, the writer is its only reader
+ */
+ringbuffer_t *resample_stage_output(resample_stage_t *stage);
+
+/* Writer exit condition: the input ended and everything was converted
+ *
+ * @param stage         Stage (void * to fit rb_writer_should_exit_cb_t)
+ * @return true once no more output will be committed, drain what is left
+ */
+bool resample_stage_done(void *stage);
+
+/* Check whether the resampler reported an error
+ *
+ * @param stage         Stage
+ * @return true if the stage stopped early
+ */
+bool resample_stage_failed(const resample_stage_t *stage);
+
+/* Wait for the stage thread and free the stage, the writer has to be done first
+ *
+ * @param stage         Stage (NULL is ignored)
+ */
+void resample_stage_stop(resample_stage_t *stage);
+
+#endif /* MISRC_RESAMPLE_STAGE_H */
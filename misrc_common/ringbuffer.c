@@ -23,35 +23,279 @@
 
 #ifdef _WIN32
 #include <windows.h>
+#include <string.h>
 #else
 #include "shm_anon.h"
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
+#include <errno.h>
+#include <signal.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #endif
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef __linux__
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
 #include "ringbuffer.h"
+#include "trace.h"
 
+static uint64_t rb_now_ms(void) {
+#ifdef _WIN32
+	return (uint64_t)GetTickCount64();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+#endif
+}
 
-int rb_init(ringbuffer_t *rb, char *name, size_t size) {
+#ifndef __linux__
+// polling for shared counters, only Linux can sleep on another process's wakeups
+static void rb_sleep_ms(uint32_t ms) {
+#ifdef _WIN32
+	Sleep(ms);
+#else
+	struct timespec ts = { .tv_sec = ms / 1000, .tv_nsec = (long)(ms % 1000) * 1000000 };
+	nanosleep(&ts, NULL);
+#endif
+}
+#endif
+
+// sleep until *seq is no longer val, the timeout expires or a spurious wakeup
+// shared sequence counters live in a shm export and are bumped by other processes
+static void rb_wait_seq(ringbuffer_t *rb, atomic_uint *seq, unsigned int val, uint32_t timeout_ms, int data, int shared) {
+#if defined(_WIN32)
+	(void)rb; (void)data;
+	// WaitOnAddress() does not see other processes
+	if (shared) rb_sleep_ms(timeout_ms < 1 ? timeout_ms : 1);
+	else WaitOnAddress((volatile VOID*)seq, &val, sizeof(val), timeout_ms);
+#elif defined(__linux__)
+	(void)rb; (void)data;
+	struct timespec ts = { .tv_sec = timeout_ms / 1000, .tv_nsec = (long)(timeout_ms % 1000) * 1000000 };
+	syscall(SYS_futex, (unsigned int*)seq, shared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE, val, &ts, NULL, 0);
+#else
+	(void)seq; (void)val;
+	if (shared) rb_sleep_ms(timeout_ms < 1 ? timeout_ms : 1);
+	else rb_event_wait_timeout(data ? &rb->data_event : &rb->space_event, timeout_ms);
+#endif
+}
+
+static void rb_wake_seq(ringbuffer_t *rb, atomic_uint *seq, int data, int shared) {
+#if defined(_WIN32)
+	(void)rb; (void)data;
+	if (!shared) WakeByAddressAll((PVOID)seq);
+#elif defined(__linux__)
+	(void)rb; (void)data;
+	syscall(SYS_futex, (unsigned int*)seq, shared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#else
+	(void)seq;
+	if (!shared) rb_event_signal(data ? &rb->data_event : &rb->space_event);
+#endif
+}
+
+// only enter the kernel if the other side announced that it is waiting
+// (seq_cst pairs with the waiter incrementing *_waiting before it looks at the indices)
+static void rb_commit_write(ringbuffer_t *rb) {
+	atomic_fetch_add(&rb->write_seq, 1);
+	if (atomic_load(&rb->read_waiting)) rb_wake_seq(rb, &rb->write_seq, 1, 0);
+	if (rb->shm) {
+		// consumers in other processes only look at the export header
+		atomic_store_explicit(&rb->shm->tail, atomic_load_explicit(&rb->tail, memory_order_relaxed), memory_order_release);
+		atomic_fetch_add(&rb->shm->write_seq, 1);
+		if (atomic_load(&rb->shm->read_waiting)) rb_wake_seq(rb, &rb->shm->write_seq, 1, 1);
+	}
+}
+
+static void rb_commit_read(ringbuffer_t *rb) {
+	atomic_fetch_add(&rb->read_seq, 1);
+	if (atomic_load(&rb->write_waiting)) rb_wake_seq(rb, &rb->read_seq, 0, 0);
+	// a writer held back by a shm consumer waits on the export's counter
+	if (rb->shm) {
+		atomic_fetch_add(&rb->shm->read_seq, 1);
+		if (atomic_load(&rb->shm->write_waiting)) rb_wake_seq(rb, &rb->shm->read_seq, 0, 1);
+	}
+}
+
+// position of the slowest consumer: the primary reader and all non-lossy fan-out readers
+static uint64_t rb_min_head(ringbuffer_t *rb, uint64_t tail) {
+	uint64_t min = rb->fanout_only ? tail : atomic_load_explicit(&rb->head, memory_order_acquire);
+	if (atomic_load_explicit(&rb->n_readers, memory_order_relaxed) > 0) {
+		for (int i = 0; i < RB_MAX_READERS; i++) {
+			rb_reader_t *r = &rb->readers[i];
+			if (atomic_load_explicit(&r->active, memory_order_acquire) != 1 || r->lossy) continue;
+			uint64_t pos = atomic_load_explicit(&r->pos, memory_order_acquire);
+			if (tail - pos > tail - min) min = pos;
+		}
+	}
+	if (rb->shm) {
+		for (int i = 0; i < RB_SHM_MAX_CONSUMERS; i++) {
+			rb_shm_consumer_t *c = &rb->shm->consumers[i];
+			if (atomic_load_explicit(&c->state, memory_order_acquire) != RB_SHM_SLOT_ACTIVE || c->lossy) continue;
+			uint64_t pos = atomic_load_explicit(&c->pos, memory_order_acquire);
+			// another process wrote that, ignore positions that cannot be right
+			if (tail - pos > rb->buffer_size) continue;
+			if (tail - pos > tail - min) min = pos;
+		}
+	}
+	return min;
+}
+
+// only the writer calls this, the reader side is looked at only if the cached view is too small
+static void* rb_peek_write(ringbuffer_t *rb, size_t size) {
+	uint64_t tail = atomic_load_explicit(&rb->tail, memory_order_relaxed);
+	uint64_t pos = tail + rb->staged;
+	if(rb->buffer_size - (pos - rb->cached_head) < size) {
+		rb->cached_head = rb_min_head(rb, tail);
+		if(rb->buffer_size - (pos - rb->cached_head) < size) {
+			return NULL;
+		}
+	}
+	// lossy readers are not waited for, announce the bytes before they get overwritten:
+	// the fence keeps the caller's stores into the block behind the new reserve
+	if (pos + size > atomic_load_explicit(&rb->reserve, memory_order_relaxed)) {
+		atomic_store_explicit(&rb->reserve, pos + size, memory_order_relaxed);
+		if (rb->shm) atomic_store_explicit(&rb->shm->reserve, pos + size, memory_order_relaxed);
+		atomic_thread_fence(memory_order_release);
+	}
+	return &rb->buffer[pos % rb->buffer_size];
+}
+
+// only the primary reader calls this, tail is loaded only if the cached copy is too small
+static void* rb_peek_read(ringbuffer_t *rb, size_t size) {
+	uint64_t head = atomic_load_explicit(&rb->head, memory_order_relaxed);
+	if(rb->cached_tail - head < size) {
+		rb->cached_tail = atomic_load_explicit(&rb->tail, memory_order_acquire);
+		if(rb->cached_tail - head < size) {
+			return NULL;
+		}
+	}
+	return &rb->buffer[head % rb->buffer_size];
+}
+
+#ifdef _WIN32
+// large pages need SeLockMemoryPrivilege, which has to be enabled for the process first
+static int rb_enable_lock_memory(void) {
+	HANDLE token;
+	TOKEN_PRIVILEGES tp;
+	int ok;
+	if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+		return 0;
+	}
+	if (!LookupPrivilegeValueA(NULL, "SeLockMemoryPrivilege", &tp.Privileges[0].Luid)) {
+		CloseHandle(token);
+		return 0;
+	}
+	tp.PrivilegeCount = 1;
+	tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+	AdjustTokenPrivileges(token, FALSE, &tp, 0, NULL, NULL);
+	ok = (GetLastError() == ERROR_SUCCESS);
+	CloseHandle(token);
+	return ok;
+}
+#endif
+
+// NUMA node for new mappings, -1 for the OS default
+static int rb_numa_node = -1;
+
+void rb_set_numa_node(int node) {
+	rb_numa_node = node;
+}
+
+#ifdef __linux__
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+#define RB_MAX_NUMA_NODES 1024
+
+// prefer the node for the pages of both views, set before the first touch so nothing has to move
+// best effort like madvise(), without the node's memory the kernel takes another one
+static void rb_bind_node(uint8_t *addr, size_t len, int node) {
+	unsigned long mask[RB_MAX_NUMA_NODES / (8 * sizeof(unsigned long))] = { 0 };
+	if(node < 0 || node >= RB_MAX_NUMA_NODES) return;
+	mask[node / (8 * sizeof(unsigned long))] = 1UL << (node % (8 * sizeof(unsigned long)));
+	// no libnuma needed for a single call, maxnode counts one more than the mask bits
+	syscall(SYS_mbind, addr, len, MPOL_PREFERRED, mask, (unsigned long)RB_MAX_NUMA_NODES + 1, 0);
+}
+#endif
+
+int rb_get_numa_node(void) {
+	return rb_numa_node;
+}
+
+void rb_bind_numa(void *addr, size_t len) {
+#ifdef __linux__
+	if(rb_numa_node >= 0) rb_bind_node(addr, len, rb_numa_node);
+#else
+	(void)addr;
+	(void)len;
+#endif
+}
+
+// how rb_map() gets its memory
+enum {
+	RB_MAP_PRIVATE = 0,   // anonymous, name is only for debugging
+	RB_MAP_CREATE,        // new named export, header bytes before the data
+	RB_MAP_ATTACH         // existing named export
+};
+
+#ifndef _WIN32
+// undo the header mapping of a named export after a later step failed
+static void rb_unmap_shm(ringbuffer_t *rb, char *name, int mode, size_t offset) {
+	if(rb->shm == NULL) return;
+	munmap(rb->shm, offset);
+	rb->shm = NULL;
+	if(mode == RB_MAP_CREATE) shm_unlink(name);
+}
+#endif
+
+// map size bytes twice back to back, huge_size is the huge page size or 0 for normal pages
+// for named exports the data starts at offset in the object, the header before it is mapped to rb->shm
+static int rb_map(ringbuffer_t *rb, char *name, size_t size, size_t huge_size, int mode, size_t offset) {
 
 #ifdef _WIN32
 
 #if !defined(__STDC_VERSION__) || __STDC_VERSION__ < 202311L
 #define nullptr NULL
 #endif
+	(void)name;
 
 	SYSTEM_INFO sysInfo;
 	HANDLE h = nullptr;
 	void* maparea = nullptr;
+	MEM_ADDRESS_REQUIREMENTS addr_req = { 0 };
+	MEM_EXTENDED_PARAMETER param = { 0 };
+	ULONG n_param = 0;
+	DWORD sec_flags = 0;
+	ULONG view_flags = 0;
+	uint64_t total = (uint64_t)offset + size;
 
+	rb->shm = NULL;
 	// First, make sure the size is a multiple of the page size
 	GetSystemInfo (&sysInfo);
 	if((size % sysInfo.dwAllocationGranularity) != 0) {
 		return 1;
 	}
 
-	if((maparea = (PCHAR)VirtualAlloc2(nullptr, nullptr, 2*size, MEM_RESERVE | MEM_RESERVE_PLACEHOLDER, PAGE_NOACCESS, nullptr, 0)) == nullptr) {
+	if(huge_size != 0) {
+		if((size % huge_size) != 0 || !rb_enable_lock_memory()) {
+			return 1;
+		}
+		// large page views have to start on a large page boundary
+		addr_req.Alignment = huge_size;
+		param.Type = MemExtendedParameterAddressRequirements;
+		param.Pointer = &addr_req;
+		n_param = 1;
+		sec_flags = SEC_COMMIT | SEC_LARGE_PAGES;
+		view_flags = MEM_LARGE_PAGES;
+	}
+
+	if((maparea = (PCHAR)VirtualAlloc2(nullptr, nullptr, 2*size, MEM_RESERVE | MEM_RESERVE_PLACEHOLDER, PAGE_NOACCESS, n_param ? &param : nullptr, n_param)) == nullptr) {
 		return 2;
 	}
 
@@ -59,113 +303,621 @@ int rb_init(ringbuffer_t *rb, char *name, size_t size) {
 		return 3;
 	}
 
-	if((h = CreateFileMapping(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, size, nullptr)) == nullptr) {
+	if(mode == RB_MAP_ATTACH) {
+		h = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name);
+	} else {
+		h = CreateFileMappingNumaA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE | sec_flags, (DWORD)(total >> 32), (DWORD)total,
+		                           mode == RB_MAP_CREATE ? name : nullptr, rb_numa_node < 0 ? NUMA_NO_PREFERRED_NODE : (DWORD)rb_numa_node);
+		if(h != nullptr && mode == RB_MAP_CREATE && GetLastError() == ERROR_ALREADY_EXISTS) {
+			CloseHandle(h);
+			h = nullptr;
+		}
+	}
+	if(h == nullptr) {
 		VirtualFree(maparea, 0, MEM_RELEASE);
 		VirtualFree(maparea+size, 0, MEM_RELEASE);
 		return 4;
 	} 
 
-	if((rb->buffer = MapViewOfFile3(h, nullptr, maparea, 0, size, MEM_REPLACE_PLACEHOLDER, PAGE_READWRITE, nullptr, 0)) == nullptr) {
+	if((rb->buffer = MapViewOfFile3(h, nullptr, maparea, offset, size, MEM_REPLACE_PLACEHOLDER | view_flags, PAGE_READWRITE, nullptr, 0)) == nullptr) {
 		CloseHandle(h);
 		VirtualFree(maparea, 0, MEM_RELEASE);
 		VirtualFree(maparea+size, 0, MEM_RELEASE);
 		return 5;
 	}
 
-	if((rb->_buffer2 = MapViewOfFile3(h, nullptr, maparea+size, 0, size, MEM_REPLACE_PLACEHOLDER, PAGE_READWRITE, nullptr, 0)) == nullptr) {
+	if((rb->_buffer2 = MapViewOfFile3(h, nullptr, maparea+size, offset, size, MEM_REPLACE_PLACEHOLDER | view_flags, PAGE_READWRITE, nullptr, 0)) == nullptr) {
 		CloseHandle(h);
 		VirtualFree(maparea+size, 0, MEM_RELEASE);
 		UnmapViewOfFileEx(rb->buffer, 0);
 		return 6;
 	}
+
+	// the views keep a named object alive, the handle is not needed for that
+	if(mode != RB_MAP_PRIVATE && (rb->shm = MapViewOfFile(h, FILE_MAP_ALL_ACCESS, 0, 0, offset)) == nullptr) {
+		CloseHandle(h);
+		UnmapViewOfFile(rb->buffer);
+		UnmapViewOfFile(rb->_buffer2);
+		return 7;
+	}
 	CloseHandle(h);
 #else
+	unsigned int memfd_flags = 0;
+	size_t align = 0;
+	uint8_t *area;
+
+	rb->shm = NULL;
 	// First, make sure the size is a multiple of the page size
 	if(size % getpagesize() != 0) {
 		return 1;
 	}
 
-	// Make an anonymous file and set its size
-	if((rb->fd = memfd_create(name, 0)) == -1) {
-		return 2;
+	if(huge_size != 0) {
+#if defined(MFD_HUGETLB) && defined(MFD_HUGE_2MB) && defined(MFD_HUGE_1GB)
+		if((size % huge_size) != 0) {
+			return 1;
+		}
+		memfd_flags = MFD_HUGETLB | ((huge_size == RB_HUGE_1G) ? MFD_HUGE_1GB : MFD_HUGE_2MB);
+		align = huge_size;
+#else
+		return 1;
+#endif
 	}
 
-	if(ftruncate(rb->fd, size) == -1) {
-		return 3;
+	if(mode == RB_MAP_PRIVATE) {
+		// Make an anonymous file and set its size
+		if((rb->fd = memfd_create(name, memfd_flags)) == -1) {
+			return 2;
+		}
+
+		if(ftruncate(rb->fd, size) == -1) {
+			close(rb->fd);
+			return 3;
+		}
+	} else {
+		// A named object, with the export header in front of the data
+		if(huge_size != 0) {
+			return 1;
+		}
+		if((rb->fd = shm_open(name, (mode == RB_MAP_CREATE) ? (O_RDWR | O_CREAT | O_EXCL) : O_RDWR, 0600)) == -1) {
+			return 2;
+		}
+
+		if(mode == RB_MAP_CREATE && ftruncate(rb->fd, (off_t)(offset + size)) == -1) {
+			close(rb->fd);
+			shm_unlink(name);
+			return 3;
+		}
+
+		if((rb->shm = mmap(NULL, offset, PROT_READ | PROT_WRITE, MAP_SHARED, rb->fd, 0)) == MAP_FAILED) {
+			rb->shm = NULL;
+			close(rb->fd);
+			if(mode == RB_MAP_CREATE) shm_unlink(name);
+			return 3;
+		}
 	}
 
 	// Ask mmap for an address at a location where we can put both virtual copies of the buffer
-	if((rb->buffer = mmap(NULL, 2 * size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+	// huge page mappings have to be aligned, so reserve a bit more and trim it afterwards
+	if((area = mmap(NULL, 2 * size + align, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+		rb_unmap_shm(rb, name, mode, offset);
+		close(rb->fd);
 		return 4;
 	}
+	rb->buffer = area;
+	if(align != 0) {
+		rb->buffer = (uint8_t*)(((uintptr_t)area + align - 1) & ~(uintptr_t)(align - 1));
+		if(rb->buffer > area) munmap(area, rb->buffer - area);
+		if(rb->buffer + 2 * size < area + 2 * size + align) munmap(rb->buffer + 2 * size, (area + 2 * size + align) - (rb->buffer + 2 * size));
+	}
 
 	// Map the buffer at that address
-	if(mmap(rb->buffer, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, rb->fd, 0) == MAP_FAILED)  {
+	if(mmap(rb->buffer, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, rb->fd, (off_t)offset) == MAP_FAILED)  {
+		munmap(rb->buffer, 2 * size);
+		rb_unmap_shm(rb, name, mode, offset);
+		close(rb->fd);
 		return 5;
 	}
 
 	// Now map it again, in the next virtual page
-	if(mmap(rb->buffer + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, rb->fd, 0) == MAP_FAILED)  {
+	if(mmap(rb->buffer + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, rb->fd, (off_t)offset) == MAP_FAILED)  {
+		munmap(rb->buffer, 2 * size);
+		rb_unmap_shm(rb, name, mode, offset);
+		close(rb->fd);
 		return 6;
 	}
+
+#ifdef __linux__
+	if(mode != RB_MAP_ATTACH && rb_numa_node >= 0) rb_bind_node(rb->buffer, 2 * size, rb_numa_node);
+#endif
+
+#ifdef MADV_HUGEPAGE
+	// without hugetlb pages at least ask for transparent huge pages, shmem may honor it
+	if(huge_size == 0) madvise(rb->buffer, 2 * size, MADV_HUGEPAGE);
 #endif
+#endif
+	rb->huge_page_size = huge_size;
+	return 0;
+}
 
-	// Initialize our buffer indices
+// Initialize our buffer indices
+static int rb_setup(ringbuffer_t *rb, size_t size) {
 	rb->buffer_size = size;
+	rb->fanout_only = 0;
+	rb->read_waiting = 0;
+	rb->write_waiting = 0;
+	rb->n_readers = 0;
+	for (int i = 0; i < RB_MAX_READERS; i++) {
+		rb->readers[i].active = 0;
+	}
+	rb->write_seq = 0;
+	rb->read_seq = 0;
+	rb_reset(rb);
+#if !defined(_WIN32) && !defined(__linux__)
+	if (rb_event_init(&rb->data_event) != 0 || rb_event_init(&rb->space_event) != 0) {
+		return 7;
+	}
+#endif
+	return 0;
+}
+
+int rb_init_pages(ringbuffer_t *rb, char *name, size_t size, size_t huge_size) {
+	int r = 1;
+	rb->shm_name = NULL;
+	// fall back to normal pages if no huge pages of that size are available
+	if(huge_size != 0) r = rb_map(rb, name, size, huge_size, RB_MAP_PRIVATE, 0);
+	if(r != 0 && (r = rb_map(rb, name, size, 0, RB_MAP_PRIVATE, 0)) != 0) {
+		return r;
+	}
+	return rb_setup(rb, size);
+}
+
+int rb_init(ringbuffer_t *rb, char *name, size_t size) {
+	return rb_init_pages(rb, name, size, 0);
+}
+
+int rb_init_fanout(ringbuffer_t *rb, char *name, size_t size) {
+	int r = rb_init(rb, name, size);
+	if (r == 0) rb->fanout_only = 1;
+	return r;
+}
+
+// the object name of an export: /name for shm_open(), Local\name for a Windows mapping
+static char *rb_shm_object_name(const char *name) {
+#ifdef _WIN32
+	const char *prefix = "Local\\";
+#else
+	const char *prefix = "/";
+#endif
+	size_t len;
+	char *obj;
+	if (strncmp(name, RB_SHM_PREFIX, strlen(RB_SHM_PREFIX)) == 0) name += strlen(RB_SHM_PREFIX);
+	if (name[0] == 0 || strchr(name, '/') || strchr(name, '\\')) return NULL;
+	len = strlen(prefix) + strlen(name) + 1;
+	if ((obj = malloc(len)) != NULL) snprintf(obj, len, "%s%s", prefix, name);
+	return obj;
+}
+
+// the data has to start on a boundary the data views can be mapped at
+static size_t rb_shm_header_size(void) {
+#ifdef _WIN32
+	SYSTEM_INFO sysInfo;
+	GetSystemInfo(&sysInfo);
+	size_t granularity = sysInfo.dwAllocationGranularity;
+#else
+	size_t granularity = (size_t)getpagesize();
+#endif
+	return (sizeof(rb_shm_header_t) + granularity - 1) / granularity * granularity;
+}
+
+static int rb_pid_alive(uint32_t pid) {
+#ifdef _WIN32
+	HANDLE h = OpenProcess(SYNCHRONIZE, FALSE, pid);
+	int alive;
+	if (h == NULL) return GetLastError() == ERROR_ACCESS_DENIED;
+	alive = WaitForSingleObject(h, 0) == WAIT_TIMEOUT;
+	CloseHandle(h);
+	return alive;
+#else
+	return kill((pid_t)pid, 0) == 0 || errno != ESRCH;
+#endif
+}
+
+// copy of the header of an existing export, 0 if there is one
+static int rb_shm_peek(const char *obj, rb_shm_header_t *header) {
+#ifdef _WIN32
+	HANDLE h = OpenFileMappingA(FILE_MAP_READ, FALSE, obj);
+	void *view;
+	if (h == NULL) return 1;
+	view = MapViewOfFile(h, FILE_MAP_READ, 0, 0, sizeof(*header));
+	CloseHandle(h);
+	if (view == NULL) return 1;
+	memcpy(header, view, sizeof(*header));
+	UnmapViewOfFile(view);
+#else
+	struct stat st;
+	void *view;
+	int fd = shm_open(obj, O_RDONLY, 0);
+	if (fd == -1) return 1;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(*header) ||
+	    (view = mmap(NULL, sizeof(*header), PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		close(fd);
+		return 1;
+	}
+	close(fd);
+	memcpy(header, view, sizeof(*header));
+	munmap(view, sizeof(*header));
+#endif
+	return 0;
+}
+
+// a consumer process that died would hold a lossless writer back forever
+static void rb_shm_evict_dead(ringbuffer_t *rb) {
+	for (int i = 0; i < RB_SHM_MAX_CONSUMERS; i++) {
+		rb_shm_consumer_t *c = &rb->shm->consumers[i];
+		unsigned int state = atomic_load(&c->state);
+		if (state == RB_SHM_SLOT_FREE || rb_pid_alive(c->pid)) continue;
+		if (atomic_compare_exchange_strong(&c->state, &state, RB_SHM_SLOT_FREE)) {
+			fprintf(stderr, "Dropping shared memory consumer %u, the process is gone\n", c->pid);
+		}
+	}
+}
+
+int rb_init_shm(ringbuffer_t *rb, const char *name, size_t size, const rb_shm_info_t *info) {
+	char *obj = rb_shm_object_name(name);
+	size_t header_size = rb_shm_header_size();
+	rb_shm_header_t old;
+	rb_shm_header_t *h;
+	int r;
+
+	if (obj == NULL) return 1;
+	if (rb_shm_peek(obj, &old) == 0) {
+		if (memcmp(old.magic, RB_SHM_MAGIC, sizeof(old.magic)) == 0 &&
+		    atomic_load(&old.state) == RB_SHM_RUNNING && rb_pid_alive(old.producer_pid)) {
+			free(obj);
+			return 8;
+		}
+#ifndef _WIN32
+		// left behind by a capture that did not exit cleanly
+		shm_unlink(obj);
+#endif
+	}
+	if ((r = rb_map(rb, obj, size, 0, RB_MAP_CREATE, header_size)) != 0) {
+		free(obj);
+		return r;
+	}
+	rb->shm_name = obj;
+	rb->huge_page_size = 0;
+	if ((r = rb_setup(rb, size)) != 0) return r;
+	rb->fanout_only = 1;
+
+	// the object is new and zero filled, only fill in what is not zero
+	h = rb->shm;
+	memcpy(h->magic, RB_SHM_MAGIC, sizeof(h->magic));
+	h->version = RB_SHM_VERSION;
+	h->header_size = (uint32_t)header_size;
+	h->data_size = size;
+	h->sample_rate = info->sample_rate;
+	h->format = (uint8_t)info->format;
+	h->channel = info->channel;
+	h->bits = info->bits;
+#ifdef _WIN32
+	h->producer_pid = (uint32_t)GetCurrentProcessId();
+#else
+	h->producer_pid = (uint32_t)getpid();
+#endif
+	atomic_store(&h->state, RB_SHM_RUNNING);
+	return 0;
+}
+
+int rb_attach_shm(ringbuffer_t *rb, const char *name) {
+	char *obj = rb_shm_object_name(name);
+	rb_shm_header_t h;
+	int r;
+
+	if (obj == NULL) return 1;
+	if (rb_shm_peek(obj, &h) != 0 || memcmp(h.magic, RB_SHM_MAGIC, sizeof(h.magic)) != 0 ||
+	    h.version != RB_SHM_VERSION || h.data_size == 0 || h.header_size < sizeof(rb_shm_header_t)) {
+		free(obj);
+		return 2;
+	}
+	r = rb_map(rb, obj, (size_t)h.data_size, 0, RB_MAP_ATTACH, h.header_size);
+	free(obj);
+	if (r != 0) return r;
+	rb->buffer_size = (size_t)h.data_size;
+	rb->huge_page_size = 0;
+	rb->fanout_only = 1;
+	rb->shm_name = NULL;
+	return 0;
+}
+
+void rb_reset(ringbuffer_t *rb) {
 	rb->head = 0;
 	rb->tail = 0;
-	return 0;
+	rb->cached_head = 0;
+	rb->cached_tail = 0;
+	rb->staged = 0;
+	rb->reserve = 0;
+	rb->high_water = 0;
+	rb->full_count = 0;
+	rb->empty_count = 0;
+	for (int i = 0; i < RB_MAX_READERS; i++) {
+		rb->readers[i].pos = 0;
+		rb->readers[i].cached_tail = 0;
+	}
+	if (rb->shm) {
+		atomic_store(&rb->shm->tail, 0);
+		atomic_store(&rb->shm->reserve, 0);
+	}
 }
 
 int rb_put(ringbuffer_t *rb, void *data, size_t size) {
-	if(rb->buffer_size - (rb->tail - rb->head) < size) {
+	void *ptr = rb_peek_write(rb, size);
+	if(ptr == NULL) {
+		atomic_fetch_add_explicit(&rb->full_count, 1, memory_order_relaxed);
 		return 1;
 	}
-	memcpy(&rb->buffer[rb->tail], data, size);
-	rb->tail += size;
+	memcpy(ptr, data, size);
+	rb->staged += size;
+	rb_write_flush(rb);
 	return 0;
 }
 
 void* rb_write_ptr(ringbuffer_t *rb, size_t size) {
-	if(rb->buffer_size - (rb->tail - rb->head) < size) {
-		return NULL;
+	void *ptr = rb_peek_write(rb, size);
+	if (ptr == NULL) atomic_fetch_add_explicit(&rb->full_count, 1, memory_order_relaxed);
+	return ptr;
+}
+
+int rb_write_stage(ringbuffer_t *rb, size_t size) {
+	if(rb_peek_write(rb, size) == NULL) {
+		return 1;
 	}
-	return &rb->buffer[rb->tail];
+	rb->staged += size;
+	return 0;
+}
+
+void rb_write_flush(ringbuffer_t *rb) {
+	if (rb->staged == 0) return;
+	uint64_t tail = atomic_load_explicit(&rb->tail, memory_order_relaxed) + rb->staged;
+	rb->staged = 0;
+	atomic_store_explicit(&rb->tail, tail, memory_order_release);
+	// the cached head only overestimates the fill, refresh it before raising the mark
+	if (tail - rb->cached_head > atomic_load_explicit(&rb->high_water, memory_order_relaxed)) {
+		rb->cached_head = rb_min_head(rb, tail);
+		size_t fill = (size_t)(tail - rb->cached_head);
+		if (fill > atomic_load_explicit(&rb->high_water, memory_order_relaxed)) {
+			atomic_store_explicit(&rb->high_water, fill, memory_order_relaxed);
+		}
+	}
+	rb_commit_write(rb);
 }
 
 int rb_write_finished(ringbuffer_t *rb, size_t size) {
-	if(rb->buffer_size - (rb->tail - rb->head) < size) {
+	if(rb_write_stage(rb, size) != 0) {
 		return 1;
 	}
-	rb->tail += size;
+	rb_write_flush(rb);
 	return 0;
 }
 
 void* rb_read_ptr(ringbuffer_t *rb, size_t size) {
-	if(rb->tail - rb->head < size){
-		return NULL;
-	}
-	return &rb->buffer[rb->head];
+	void *ptr = rb_peek_read(rb, size);
+	if (ptr == NULL) atomic_fetch_add_explicit(&rb->empty_count, 1, memory_order_relaxed);
+	return ptr;
 }
 
 int rb_read_finished(ringbuffer_t *rb, size_t size) {
-	if(rb->tail - rb->head < size){
+	uint64_t head = atomic_load_explicit(&rb->head, memory_order_relaxed);
+	if(rb_peek_read(rb, size) == NULL) {
 		return 1;
 	}
-	rb->head += size;
-	if(rb->head > rb->buffer_size) {
-		rb->head -= rb->buffer_size;
-		rb->tail -= rb->buffer_size;
+	atomic_store_explicit(&rb->head, head + size, memory_order_release);
+	rb_commit_read(rb);
+	return 0;
+}
+
+size_t rb_available(ringbuffer_t *rb) {
+	return (size_t)(atomic_load_explicit(&rb->tail, memory_order_acquire) -
+	                atomic_load_explicit(&rb->head, memory_order_relaxed));
+}
+
+// retry try_ptr() until it succeeds or the timeout expires, sleeping on the
+// sequence counter the other side bumps on every commit/release
+static void* rb_wait_for(ringbuffer_t *rb, void* (*try_ptr)(ringbuffer_t*, int, size_t), int id,
+                         size_t size, uint32_t timeout_ms, int data) {
+	// a writer of an export waits for all consumers on the counter in the export
+	int shared = !data && rb->shm != NULL;
+	atomic_uint *seq = data ? &rb->write_seq : (shared ? &rb->shm->read_seq : &rb->read_seq);
+	atomic_int *waiting = data ? &rb->read_waiting : (shared ? &rb->shm->write_waiting : &rb->write_waiting);
+	void *ptr;
+	uint64_t deadline, next_evict = 0;
+	if ((ptr = try_ptr(rb, id, size)) != NULL) return ptr;
+	atomic_fetch_add_explicit(data ? &rb->empty_count : &rb->full_count, 1, memory_order_relaxed);
+	if (timeout_ms == 0) return NULL;
+	TRACE_BEGIN(data ? "rb_wait_read" : "rb_wait_write");
+	deadline = rb_now_ms() + timeout_ms;
+	atomic_fetch_add(waiting, 1);
+	for (;;) {
+		unsigned int val = atomic_load(seq);
+		// check again after announcing ourselves, the other side may have been faster
+		if ((ptr = try_ptr(rb, id, size)) != NULL) break;
+		uint64_t now = rb_now_ms();
+		if (now >= deadline) break;
+		if (shared && now >= next_evict) {
+			rb_shm_evict_dead(rb);
+			next_evict = now + 100;
+		}
+		rb_wait_seq(rb, seq, val, (uint32_t)(deadline - now), data, shared);
+	}
+	atomic_fetch_sub(waiting, 1);
+	TRACE_END(data ? "rb_wait_read" : "rb_wait_write");
+	return ptr;
+}
+
+static void* rb_try_read(ringbuffer_t *rb, int id, size_t size) {
+	(void)id;
+	return rb_peek_read(rb, size);
+}
+
+static void* rb_try_write(ringbuffer_t *rb, int id, size_t size) {
+	(void)id;
+	return rb_peek_write(rb, size);
+}
+
+void* rb_read_ptr_wait(ringbuffer_t *rb, size_t size, uint32_t timeout_ms) {
+	return rb_wait_for(rb, rb_try_read, 0, size, timeout_ms, 1);
+}
+
+void* rb_write_ptr_wait(ringbuffer_t *rb, size_t size, uint32_t timeout_ms) {
+	return rb_wait_for(rb, rb_try_write, 0, size, timeout_ms, 0);
+}
+
+int rb_reader_add(ringbuffer_t *rb, int lossy) {
+	for (int i = 0; i < RB_MAX_READERS; i++) {
+		rb_reader_t *r = &rb->readers[i];
+		int expected = 0;
+		if (!atomic_compare_exchange_strong(&r->active, &expected, 2)) continue;
+		r->lossy = lossy;
+		r->dropped = 0;
+		r->pos = atomic_load_explicit(&rb->tail, memory_order_acquire);
+		r->cached_tail = r->pos;
+		r->start = r->pos;
+		atomic_store_explicit(&r->active, 1, memory_order_release);
+		atomic_fetch_add(&rb->n_readers, 1);
+		return i;
+	}
+	return -1;
+}
+
+void rb_reader_remove(ringbuffer_t *rb, int id) {
+	if (id < 0 || id >= RB_MAX_READERS || atomic_load(&rb->readers[id].active) != 1) return;
+	atomic_store(&rb->readers[id].active, 0);
+	atomic_fetch_sub(&rb->n_readers, 1);
+	// the writer may have been waiting for this reader
+	rb_commit_read(rb);
+}
+
+size_t rb_reader_available(ringbuffer_t *rb, int id) {
+	return (size_t)(atomic_load_explicit(&rb->tail, memory_order_acquire) -
+	                atomic_load_explicit(&rb->readers[id].pos, memory_order_relaxed));
+}
+
+static void* rb_reader_peek(ringbuffer_t *rb, int id, size_t size) {
+	rb_reader_t *r = &rb->readers[id];
+	uint64_t pos = atomic_load_explicit(&r->pos, memory_order_relaxed);
+	// lossy readers always need the real tail to notice they fell behind
+	if (r->lossy || r->cached_tail - pos < size) {
+		r->cached_tail = atomic_load_explicit(&rb->tail, memory_order_acquire);
+	}
+	uint64_t lag = r->cached_tail - pos;
+	if (r->lossy && lag > rb->buffer_size / 2 && lag > size) {
+		// fell too far behind, skip whole blocks so the sample alignment is kept
+		uint64_t skip = (lag - size) / size * size;
+		pos += skip;
+		lag -= skip;
+		atomic_store_explicit(&r->pos, pos, memory_order_relaxed);
+		atomic_fetch_add_explicit(&r->dropped, skip, memory_order_relaxed);
+	}
+	if (lag < size) {
+		return NULL;
+	}
+	return &rb->buffer[pos % rb->buffer_size];
+}
+
+void* rb_reader_read_ptr(ringbuffer_t *rb, int id, size_t size) {
+	void *ptr = rb_reader_peek(rb, id, size);
+	if (ptr == NULL) atomic_fetch_add_explicit(&rb->empty_count, 1, memory_order_relaxed);
+	return ptr;
+}
+
+void* rb_reader_read_ptr_wait(ringbuffer_t *rb, int id, size_t size, uint32_t timeout_ms) {
+	return rb_wait_for(rb, rb_reader_peek, id, size, timeout_ms, 1);
+}
+
+int rb_reader_read_finished(ringbuffer_t *rb, int id, size_t size) {
+	rb_reader_t *r = &rb->readers[id];
+	uint64_t pos = atomic_load_explicit(&r->pos, memory_order_relaxed);
+	if (r->cached_tail - pos < size) {
+		r->cached_tail = atomic_load_explicit(&rb->tail, memory_order_acquire);
+		if (r->cached_tail - pos < size) {
+			return 1;
+		}
+	}
+	atomic_store_explicit(&r->pos, pos + size, memory_order_release);
+	rb_commit_read(rb);
+	// the writer does not wait for lossy readers, it may have wrapped into this block,
+	// published or not: the fence keeps the reads of the block before the reserve load
+	if (r->lossy) {
+		atomic_thread_fence(memory_order_acquire);
+		if (atomic_load_explicit(&rb->reserve, memory_order_relaxed) - pos > rb->buffer_size) {
+			return 2;
+		}
 	}
 	return 0;
 }
 
+uint64_t rb_reader_dropped(ringbuffer_t *rb, int id) {
+	return atomic_load(&rb->readers[id].dropped);
+}
+
+void rb_wake(ringbuffer_t *rb) {
+	atomic_fetch_add(&rb->write_seq, 1);
+	atomic_fetch_add(&rb->read_seq, 1);
+	rb_wake_seq(rb, &rb->write_seq, 1, 0);
+	rb_wake_seq(rb, &rb->read_seq, 0, 0);
+	if (rb->shm) {
+		atomic_fetch_add(&rb->shm->write_seq, 1);
+		atomic_fetch_add(&rb->shm->read_seq, 1);
+		rb_wake_seq(rb, &rb->shm->write_seq, 1, 1);
+		rb_wake_seq(rb, &rb->shm->read_seq, 0, 1);
+	}
+}
+
+void rb_get_stats(ringbuffer_t *rb, rb_stats_t *stats) {
+	uint64_t tail = atomic_load_explicit(&rb->tail, memory_order_acquire);
+	stats->size = rb->buffer_size;
+	stats->fill = (size_t)(tail - rb_min_head(rb, tail));
+	stats->high_water = atomic_load_explicit(&rb->high_water, memory_order_relaxed);
+	stats->full_count = atomic_load_explicit(&rb->full_count, memory_order_relaxed);
+	stats->empty_count = atomic_load_explicit(&rb->empty_count, memory_order_relaxed);
+	stats->bytes_in = tail;
+	// the primary head is absolute, fan-out readers count from where they joined
+	stats->bytes_out = rb->fanout_only ? 0 : atomic_load_explicit(&rb->head, memory_order_relaxed);
+	for (int i = 0; i < RB_MAX_READERS; i++) {
+		rb_reader_t *r = &rb->readers[i];
+		if (atomic_load_explicit(&r->active, memory_order_acquire) != 1) continue;
+		stats->bytes_out += atomic_load_explicit(&r->pos, memory_order_relaxed) - r->start;
+	}
+}
+
+void rb_reset_high_water(ringbuffer_t *rb) {
+	uint64_t tail = atomic_load_explicit(&rb->tail, memory_order_acquire);
+	atomic_store_explicit(&rb->high_water, (size_t)(tail - rb_min_head(rb, tail)), memory_order_relaxed);
+}
+
 void rb_close(ringbuffer_t *rb) {
+	if (rb->shm && rb->shm_name) {
+		// tell the consumers, they can still read what is left
+		atomic_store(&rb->shm->state, RB_SHM_STOPPED);
+		rb_wake(rb);
+	}
 #ifdef _WIN32
 	UnmapViewOfFile(rb->buffer);
 	UnmapViewOfFile(rb->_buffer2);
+	if (rb->shm) UnmapViewOfFile(rb->shm);
 #else
 	munmap(rb->buffer, rb->buffer_size);
 	munmap(rb->buffer+rb->buffer_size, rb->buffer_size);
+	if (rb->shm) munmap(rb->shm, rb->shm->header_size);
+	// consumers keep their mapping, the name is free for the next capture
+	if (rb->shm_name) shm_unlink(rb->shm_name);
+#endif
+	rb->shm = NULL;
+	free(rb->shm_name);
+	rb->shm_name = NULL;
+#if !defined(_WIN32) && !defined(__linux__)
+	rb_event_destroy(&rb->data_event);
+	rb_event_destroy(&rb->space_event);
 #endif
 }
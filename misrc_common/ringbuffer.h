@@ -21,29 +21,153 @@
 * along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+
 #ifndef RINGBUFFER_H
 #define RINGBUFFER_H
 
 #include <stdint.h>
+#include <stddef.h>
 #include <stdatomic.h>
+#if !defined(_WIN32) && !defined(__linux__)
+#include "rb_event.h"
+#endif
+#include "rb_shm.h"
+
+// huge page sizes for rb_init_pages()
+#define RB_HUGE_2M ((size_t)2 << 20)
+#define RB_HUGE_1G ((size_t)1 << 30)
+
+// maximum number of fan-out readers per ringbuffer, see rb_reader_add()
+#define RB_MAX_READERS 4
+
+// writer and reader state live on separate cache lines so they do not bounce between cores
+#if defined(__APPLE__) && (defined(__aarch64__) || defined(__arm64__))
+#define RB_CACHE_LINE 128
+#else
+#define RB_CACHE_LINE 64
+#endif
+
+// snapshot of the ringbuffer counters, see rb_get_stats()
+typedef struct {
+	size_t   size;
+	size_t   fill;         // bytes not yet released by the slowest reader
+	size_t   high_water;   // highest fill since rb_init(), rb_reset() or rb_reset_high_water()
+	uint64_t full_count;   // times the writer found too little space
+	uint64_t empty_count;  // times a reader found too little data
+	uint64_t bytes_in;
+	uint64_t bytes_out;    // released by all readers together
+} rb_stats_t;
 
 typedef struct {
+	_Alignas(RB_CACHE_LINE)
+	atomic_uint_fast64_t pos;     // absolute read position in bytes
+	uint64_t             cached_tail;
+	uint64_t             start;   // position when the reader was added
+	atomic_uint_fast64_t dropped; // bytes skipped by a lossy reader
+	atomic_int           active;  // 0 free, 1 in use, 2 being set up
+	int                  lossy;
+} rb_reader_t;
+
+// head and tail are absolute byte positions, the buffer offset is position % buffer_size
+typedef struct {
+	// set up by rb_init(), read-only afterwards
 	uint8_t      *buffer;
 #ifdef _WIN32
 	uint8_t      *_buffer2;
 #endif
 	size_t        buffer_size;
+	size_t        huge_page_size; // 0 if backed by normal pages
 	int           fd;
-	atomic_size_t head;
-	atomic_size_t tail;
+	int           fanout_only;    // no primary reader, head is unused
+	rb_shm_header_t *shm;         // header of a named export, NULL for a private ringbuffer
+	char         *shm_name;       // object name if this process created the export
+#if !defined(_WIN32) && !defined(__linux__)
+	rb_event_t    data_event;
+	rb_event_t    space_event;
+#endif
+
+	// only written when a side blocks or a reader is added, so mostly shared clean
+	_Alignas(RB_CACHE_LINE)
+	atomic_int    read_waiting;   // number of blocked readers
+	atomic_int    write_waiting;
+	atomic_int    n_readers;
+
+	// writer side
+	_Alignas(RB_CACHE_LINE)
+	atomic_uint_fast64_t tail;
+	uint64_t      cached_head;    // writer's copy of the slowest reader position
+	size_t        staged;         // written but not yet published, see rb_write_stage()
+	atomic_uint_fast64_t reserve; // end of the bytes the writer may be filling, >= tail
+	atomic_uint   write_seq;      // bumped on every commit by the writer
+	atomic_size_t high_water;
+	atomic_uint_fast64_t full_count;
+
+	// primary reader side
+	_Alignas(RB_CACHE_LINE)
+	atomic_uint_fast64_t head;
+	uint64_t      cached_tail;    // reader's copy of tail
+	atomic_uint   read_seq;       // bumped on every release by a reader
+	atomic_uint_fast64_t empty_count;
+
+	// fan-out readers, the writer only overwrites what all non-lossy readers consumed
+	rb_reader_t   readers[RB_MAX_READERS];
 } ringbuffer_t;
 
 int   rb_init(ringbuffer_t *rb, char *name, size_t size);
+// like rb_init(), but try to back the buffer with huge pages of huge_size bytes
+// (RB_HUGE_2M or RB_HUGE_1G), silently falls back to normal pages when that fails:
+// check rb->huge_page_size afterwards
+int   rb_init_pages(ringbuffer_t *rb, char *name, size_t size, size_t huge_size);
+// put the memory of ringbuffers set up afterwards (not attached ones) on a NUMA node,
+// -1 (the default) leaves it to the OS, which uses the node of the first writer, the producer
+void  rb_set_numa_node(int node);
+// the node of rb_set_numa_node(), for other memory of the pipeline
+int   rb_get_numa_node(void);
+// prefer that node for len bytes at addr before they are first touched (Linux only)
+void  rb_bind_numa(void *addr, size_t len);
+// like rb_init(), but without the primary reader: only readers from rb_reader_add() consume
+int   rb_init_fanout(ringbuffer_t *rb, char *name, size_t size);
+// like rb_init_fanout(), but in a named shared memory object (see rb_shm.h) other processes
+// attach to as consumers, lossless ones hold the writer back like fan-out readers
+// name is without RB_SHM_PREFIX, returns 8 if another running capture uses it
+int   rb_init_shm(ringbuffer_t *rb, const char *name, size_t size, const rb_shm_info_t *info);
+// map an export made by rb_init_shm() in another process, only rb->buffer, rb->buffer_size
+// and rb->shm are valid afterwards, consumers go through rb_shm.h
+int   rb_attach_shm(ringbuffer_t *rb, const char *name);
+// empty the ringbuffer and clear its counters, neither side may be active at that time
+void  rb_reset(ringbuffer_t *rb);
 int   rb_put(ringbuffer_t *rb, void *data, size_t size);
 void* rb_read_ptr(ringbuffer_t *rb, size_t size);
 int   rb_read_finished(ringbuffer_t *rb, size_t size);
+// bytes readable by the primary reader
+size_t rb_available(ringbuffer_t *rb);
 void* rb_write_ptr(ringbuffer_t *rb, size_t size);
 int   rb_write_finished(ringbuffer_t *rb, size_t size);
+// batched commits: rb_write_stage() appends size bytes behind the ones already staged
+// without making them visible (rb_write_ptr() then points behind them),
+// rb_write_flush() publishes everything staged at once
+int   rb_write_stage(ringbuffer_t *rb, size_t size);
+void  rb_write_flush(ringbuffer_t *rb);
+// like rb_read_ptr()/rb_write_ptr(), but block until size bytes are readable/writable
+// returns NULL if that did not happen within timeout_ms
+void* rb_read_ptr_wait(ringbuffer_t *rb, size_t size, uint32_t timeout_ms);
+void* rb_write_ptr_wait(ringbuffer_t *rb, size_t size, uint32_t timeout_ms);
+// wake all threads blocked on the ringbuffer, e.g. to make them notice an exit request
+void  rb_wake(ringbuffer_t *rb);
+// register an additional reader which sees all data committed from now on
+// lossy readers never stall the writer, they skip ahead when falling behind by
+// more than half the buffer (in multiples of the read size, torn reads are possible)
+// returns the reader id or -1 if all slots are taken
+int   rb_reader_add(ringbuffer_t *rb, int lossy);
+void  rb_reader_remove(ringbuffer_t *rb, int id);
+size_t rb_reader_available(ringbuffer_t *rb, int id);
+void* rb_reader_read_ptr(ringbuffer_t *rb, int id, size_t size);
+void* rb_reader_read_ptr_wait(ringbuffer_t *rb, int id, size_t size, uint32_t timeout_ms);
+// returns 1 if less than size bytes were readable, 2 if a lossy reader got overrun while reading
+int   rb_reader_read_finished(ringbuffer_t *rb, int id, size_t size);
+uint64_t rb_reader_dropped(ringbuffer_t *rb, int id);
+void  rb_get_stats(ringbuffer_t *rb, rb_stats_t *stats);
+void  rb_reset_high_water(ringbuffer_t *rb);
 void  rb_close(ringbuffer_t *rb);
 
-#endif // RINGBUFFER_H
\ No newline at end of file
+#endif // RINGBUFFER_H
@@ -2,11 +2,38 @@
  * MISRC Common - Ringbuffer to File Writer Implementation
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE      /* O_DIRECT */
+#endif
+#define _FILE_OFFSET_BITS 64
+
 #include "ringbuffer_writer.h"
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#endif
 #include "threading.h"
+#include "trace.h"
 
 #include <string.h>
 
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define RB_WRITER_HAVE_URING 1
+#endif
+#endif
+
+#ifdef RB_WRITER_HAVE_URING
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#endif
+
 void rb_writer_config_init(rb_writer_config_t *config,
                            ringbuffer_t *rb,
                            FILE *file,
@@ -16,7 +43,10 @@ void rb_writer_config_init(rb_writer_config_t *config,
     config->rb = rb;
     config->file = file;
     config->read_size = read_size;
-    config->sleep_ms = 1;  /* Default 1ms sleep */
+    config->sleep_ms = 100;  /* Default 100ms between exit checks */
+    config->reader = -1;     /* Primary reader */
+    config->backend = RB_WRITER_STDIO;
+    config->queue_depth = RB_WRITER_QUEUE_DEPTH;
 }
 
 static bool should_exit(rb_writer_config_t *config)
@@ -35,26 +65,71 @@ static bool should_exit(rb_writer_config_t *config)
     return false;
 }
 
-size_t rb_writer_run(rb_writer_config_t *config)
+/* Primary reader or fan-out reader, depending on the config */
+static void *writer_read_ptr(rb_writer_config_t *config, size_t len)
+{
+    if (config->reader >= 0) {
+        return rb_reader_read_ptr(config->rb, config->reader, len);
+    }
+    return rb_read_ptr(config->rb, len);
+}
+
+static void *writer_read_ptr_wait(rb_writer_config_t *config, size_t len)
+{
+    if (config->reader >= 0) {
+        return rb_reader_read_ptr_wait(config->rb, config->reader, len, (uint32_t)config->sleep_ms);
+    }
+    return rb_read_ptr_wait(config->rb, len, (uint32_t)config->sleep_ms);
+}
+
+static void writer_read_finished(rb_writer_config_t *config, size_t len)
+{
+    if (config->reader >= 0) {
+        rb_reader_read_finished(config->rb, config->reader, len);
+    } else {
+        rb_read_finished(config->rb, len);
+    }
+}
+
+static size_t writer_available(rb_writer_config_t *config)
+{
+    if (config->reader >= 0) {
+        return rb_reader_available(config->rb, config->reader);
+    }
+    return rb_available(config->rb);
+}
+
+/* The current segment is full, the backend returns so rb_writer_run() can switch files */
+static bool writer_segment_due(rb_writer_config_t *config)
+{
+    return config->segment &&
+           file_segment_due(config->segment, config->segment_written, config->segment_written);
+}
+
+static size_t rb_writer_run_stdio(rb_writer_config_t *config)
 {
     size_t total_written = 0;
     size_t len = config->read_size;
     void *buf;
 
     while (1) {
-        buf = rb_read_ptr(config->rb, len);
+        if (writer_segment_due(config)) {
+            break;
+        }
+        buf = writer_read_ptr(config, len);
 
         if (!buf) {
             /* No data available - check if we should exit */
             if (should_exit(config)) {
                 /* Drain any remaining partial data before exiting */
-                size_t remaining = config->rb->tail - config->rb->head;
+                size_t remaining = writer_available(config);
                 if (remaining > 0 && remaining < len) {
-                    buf = rb_read_ptr(config->rb, remaining);
+                    buf = writer_read_ptr(config, remaining);
                     if (buf) {
                         size_t written = fwrite(buf, 1, remaining, config->file);
-                        rb_read_finished(config->rb, remaining);
+                        writer_read_finished(config, remaining);
                         total_written += written;
+                        config->segment_written += written;
 
                         if (config->progress_cb) {
                             config->progress_cb(config->user_ctx, written);
@@ -64,15 +139,18 @@ size_t rb_writer_run(rb_writer_config_t *config)
                 break;
             }
 
-            /* Sleep and retry */
-            thrd_sleep_ms(config->sleep_ms);
+            /* Block until the producer commits more data, then retry */
+            writer_read_ptr_wait(config, len);
             continue;
         }
 
         /* Write data to file */
+        TRACE_BEGIN("file_write");
         size_t written = fwrite(buf, 1, len, config->file);
-        rb_read_finished(config->rb, len);
+        TRACE_END("file_write");
+        writer_read_finished(config, len);
         total_written += written;
+        config->segment_written += written;
 
         if (config->progress_cb) {
             config->progress_cb(config->user_ctx, written);
@@ -82,6 +160,605 @@ size_t rb_writer_run(rb_writer_config_t *config)
     return total_written;
 }
 
+/*-----------------------------------------------------------------------------
+ * io_uring Backend
+ *-----------------------------------------------------------------------------*/
+
+#ifdef RB_WRITER_HAVE_URING
+
+/* Minimal io_uring setup without liburing, only what a single submitter needs */
+typedef struct {
+    int fd;
+    void *sq_ring;
+    void *cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    bool failed;                /* An enter failed, the ring takes no more writes */
+} writer_uring_t;
+
+/* One write in flight, released to the ringbuffer in submission order */
+typedef struct {
+    struct iovec iov;
+    off_t offset;
+    bool done;
+} writer_slot_t;
+
+static void uring_close(writer_uring_t *u)
+{
+    if (u->sqes) munmap(u->sqes, u->sqes_size);
+    if (u->cq_ring && u->cq_ring != u->sq_ring) munmap(u->cq_ring, u->cq_ring_size);
+    if (u->sq_ring) munmap(u->sq_ring, u->sq_ring_size);
+    if (u->fd >= 0) close(u->fd);
+}
+
+static int uring_open(writer_uring_t *u, unsigned entries)
+{
+    struct io_uring_params p;
+    uint8_t *sq, *cq;
+
+    memset(u, 0, sizeof(*u));
+    memset(&p, 0, sizeof(p));
+    u->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (u->fd < 0) {
+        return -errno;
+    }
+
+    u->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (u->cq_ring_size > u->sq_ring_size) u->sq_ring_size = u->cq_ring_size;
+        u->cq_ring_size = u->sq_ring_size;
+    }
+    u->sq_ring = mmap(NULL, u->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      u->fd, IORING_OFF_SQ_RING);
+    if (u->sq_ring == MAP_FAILED) {
+        u->sq_ring = NULL;
+        goto fail;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        u->cq_ring = u->sq_ring;
+    } else {
+        u->cq_ring = mmap(NULL, u->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          u->fd, IORING_OFF_CQ_RING);
+        if (u->cq_ring == MAP_FAILED) {
+            u->cq_ring = NULL;
+            goto fail;
+        }
+    }
+    u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   u->fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) {
+        u->sqes = NULL;
+        goto fail;
+    }
+
+    sq = u->sq_ring;
+    cq = u->cq_ring;
+    u->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    u->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    u->sq_array = (unsigned *)(sq + p.sq_off.array);
+    u->cq_head = (unsigned *)(cq + p.cq_off.head);
+    u->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    u->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return 0;
+
+fail:
+    {
+        int err = -errno;
+        uring_close(u);
+        return err;
+    }
+}
+
+static int uring_submit_write(writer_uring_t *u, int fd, writer_slot_t *slot, uint64_t user_data)
+{
+    /* The SQE of a failed enter is still in the ring, the next enter would
+     * write its data a second time after the caller wrote it synchronously */
+    if (u->failed) return -EIO;
+
+    unsigned tail = *u->sq_tail;
+    unsigned idx = tail & *u->sq_mask;
+    struct io_uring_sqe *sqe = &u->sqes[idx];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = fd;
+    sqe->off = (uint64_t)slot->offset;
+    sqe->addr = (uint64_t)(uintptr_t)&slot->iov;
+    sqe->len = 1;
+    sqe->user_data = user_data;
+    u->sq_array[idx] = idx;
+    __atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    while (syscall(__NR_io_uring_enter, u->fd, 1, 0, 0, NULL, 0) < 0) {
+        if (errno != EINTR) {
+            u->failed = true;
+            return -errno;
+        }
+    }
+    return 0;
+}
+
+static int uring_wait(writer_uring_t *u)
+{
+    TRACE_BEGIN("file_write_wait");
+    while (syscall(__NR_io_uring_enter, u->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0) {
+        if (errno != EINTR) {
+            TRACE_END("file_write_wait");
+            return -errno;
+        }
+    }
+    TRACE_END("file_write_wait");
+    return 0;
+}
+
+/* Clear or set O_DIRECT on an open file, returns false if the file system refuses */
+static bool set_direct(int fd, bool enable)
+{
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0) return false;
+    flags = enable ? (flags | O_DIRECT) : (flags & ~O_DIRECT);
+    return fcntl(fd, F_SETFL, flags) == 0;
+}
+
+/* Blocking write for short writes and the unaligned tail, never with O_DIRECT */
+static size_t write_sync(int fd, const uint8_t *buf, size_t len, off_t offset, bool *direct)
+{
+    size_t done = 0;
+    if (*direct) {
+        set_direct(fd, false);
+        *direct = false;
+    }
+    while (done < len) {
+        ssize_t r = pwrite(fd, buf + done, len - done, offset + (off_t)done);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        done += (size_t)r;
+    }
+    return done;
+}
+
+/* Mark completed slots and hand back how many bytes the kernel wrote for each */
+static void uring_reap(writer_uring_t *u, int fd, writer_slot_t *slots, size_t *written, bool *direct)
+{
+    unsigned head = *u->cq_head;
+    unsigned tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+
+    while (head != tail) {
+        struct io_uring_cqe *cqe = &u->cqes[head & *u->cq_mask];
+        writer_slot_t *slot = &slots[cqe->user_data];
+        size_t len = slot->iov.iov_len;
+        size_t done = cqe->res > 0 ? (size_t)cqe->res : 0;
+
+        /* Rare on regular files, finish the rest synchronously while the data is still reserved */
+        if (done < len) {
+            done += write_sync(fd, (uint8_t *)slot->iov.iov_base + done, len - done,
+                               slot->offset + (off_t)done, direct);
+        }
+        written[cqe->user_data] = done;
+        slot->done = true;
+        head++;
+    }
+    __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/* Returns (size_t)-1 if io_uring cannot be used, so the caller falls back to stdio */
+static size_t rb_writer_run_uring(rb_writer_config_t *config)
+{
+    writer_uring_t u;
+    writer_slot_t slots[RB_WRITER_MAX_QUEUE_DEPTH];
+    size_t written[RB_WRITER_MAX_QUEUE_DEPTH];
+    size_t total_written = 0;
+    size_t len = config->read_size;
+    size_t ahead = 0;           /* Bytes submitted but not yet released */
+    unsigned first = 0, inflight = 0;
+    unsigned depth;
+    bool direct = false;
+    struct stat st;
+    off_t offset;
+    int fd, r;
+
+    fflush(config->file);
+    fd = fileno(config->file);
+    /* Pipes and terminals keep using stdio, explicit offsets need a regular file */
+    if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return (size_t)-1;
+    }
+    offset = lseek(fd, 0, SEEK_CUR);
+    if (offset < 0) {
+        return (size_t)-1;
+    }
+
+    /* All writes in flight have to fit in the ringbuffer at once */
+    depth = config->queue_depth > 0 ? (unsigned)config->queue_depth : RB_WRITER_QUEUE_DEPTH;
+    if (depth > RB_WRITER_MAX_QUEUE_DEPTH) depth = RB_WRITER_MAX_QUEUE_DEPTH;
+    if (len > 0 && depth > config->rb->buffer_size / (2 * len)) {
+        depth = (unsigned)(config->rb->buffer_size / (2 * len));
+        if (depth == 0) depth = 1;
+    }
+
+    if ((r = uring_open(&u, depth)) != 0) {
+        fprintf(stderr, "io_uring unavailable (%s), using buffered writes\n", strerror(-r));
+        return (size_t)-1;
+    }
+
+    if (config->direct) {
+        if (len % RB_WRITER_DIRECT_ALIGN != 0 || offset % RB_WRITER_DIRECT_ALIGN != 0) {
+            fprintf(stderr, "Direct I/O needs %d byte aligned writes, using the page cache\n",
+                    RB_WRITER_DIRECT_ALIGN);
+        } else if (!(direct = set_direct(fd, true))) {
+            fprintf(stderr, "Direct I/O not supported by the file system, using the page cache\n");
+        }
+    }
+
+    while (1) {
+        /* Keep the queue full, each write covers the next read_size bytes behind the ones in flight */
+        while (inflight < depth && !writer_segment_due(config)) {
+            uint8_t *buf = writer_read_ptr(config, ahead + len);
+            if (!buf) break;
+            buf += ahead;
+            if (direct && ((uintptr_t)buf % RB_WRITER_DIRECT_ALIGN) != 0) {
+                set_direct(fd, false);
+                direct = false;
+            }
+            unsigned idx = (first + inflight) % depth;
+            writer_slot_t *slot = &slots[idx];
+            slot->iov.iov_base = buf;
+            slot->iov.iov_len = len;
+            slot->offset = offset;
+            slot->done = false;
+            if (uring_submit_write(&u, fd, slot, idx) != 0) {
+                written[idx] = write_sync(fd, buf, len, offset, &direct);
+                slot->done = true;
+            }
+            offset += (off_t)len;
+            ahead += len;
+            config->segment_written += len;
+            inflight++;
+        }
+
+        if (inflight == 0) {
+            if (writer_segment_due(config)) {
+                break;
+            }
+            if (should_exit(config)) {
+                /* Drain any remaining partial data before exiting */
+                size_t remaining = writer_available(config);
+                if (remaining > 0 && remaining < len) {
+                    uint8_t *buf = writer_read_ptr(config, remaining);
+                    if (buf) {
+                        size_t w = write_sync(fd, buf, remaining, offset, &direct);
+                        writer_read_finished(config, remaining);
+                        offset += (off_t)w;
+                        total_written += w;
+                        config->segment_written += w;
+
+                        if (config->progress_cb) {
+                            config->progress_cb(config->user_ctx, w);
+                        }
+                    }
+                }
+                break;
+            }
+
+            /* Block until the producer commits more data, then retry */
+            writer_read_ptr_wait(config, len);
+            continue;
+        }
+
+        if (!slots[first].done) {
+            if (uring_wait(&u) != 0) {
+                /* Should not happen, finish everything in flight synchronously */
+                for (unsigned i = 0; i < inflight; i++) {
+                    writer_slot_t *slot = &slots[(first + i) % depth];
+                    if (slot->done) continue;
+                    written[(first + i) % depth] = write_sync(fd, slot->iov.iov_base, slot->iov.iov_len,
+                                                              slot->offset, &direct);
+                    slot->done = true;
+                }
+            }
+        }
+        uring_reap(&u, fd, slots, written, &direct);
+
+        /* Ring space is only handed back once the oldest writes are on their way to disk */
+        while (inflight > 0 && slots[first].done) {
+            writer_read_finished(config, len);
+            ahead -= len;
+            total_written += written[first];
+
+            if (config->progress_cb) {
+                config->progress_cb(config->user_ctx, written[first]);
+            }
+            first = (first + 1) % depth;
+            inflight--;
+        }
+    }
+
+    uring_close(&u);
+    if (direct) set_direct(fd, false);
+    /* Keep the stdio position in line for whoever uses the file afterwards */
+    fseeko(config->file, offset, SEEK_SET);
+    return total_written;
+}
+
+#endif /* RB_WRITER_HAVE_URING */
+
+/*-----------------------------------------------------------------------------
+ * Windows Overlapped Backend
+ *-----------------------------------------------------------------------------*/
+
+#ifdef _WIN32
+
+/* The file is grown in steps of this size ahead of the writes */
+#define WRITER_EXTEND_SIZE ((LONGLONG)1 << 30)
+
+/* One write in flight, released to the ringbuffer in submission order */
+typedef struct {
+    OVERLAPPED ov;
+    bool submitted;
+} writer_slot_t;
+
+/* SetFileValidData() needs SeManageVolumePrivilege, usually only held by administrators */
+static bool enable_manage_volume(void)
+{
+    HANDLE token;
+    TOKEN_PRIVILEGES tp;
+    bool ok;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+        return false;
+    }
+    if (!LookupPrivilegeValueA(NULL, "SeManageVolumePrivilege", &tp.Privileges[0].Luid)) {
+        CloseHandle(token);
+        return false;
+    }
+    tp.PrivilegeCount = 1;
+    tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+    AdjustTokenPrivileges(token, FALSE, &tp, 0, NULL, NULL);
+    ok = (GetLastError() == ERROR_SUCCESS);
+    CloseHandle(token);
+    return ok;
+}
+
+/* Writes that extend the file are executed synchronously by NTFS, so move the end of
+ * file (and with the privilege the valid data length, skipping the zero fill) ahead */
+static void extend_file(HANDLE h, LONGLONG *allocated, LONGLONG needed, bool valid_data)
+{
+    LARGE_INTEGER end;
+    if (needed <= *allocated) return;
+    end.QuadPart = (needed + WRITER_EXTEND_SIZE - 1) / WRITER_EXTEND_SIZE * WRITER_EXTEND_SIZE;
+    if (!SetFilePointerEx(h, end, NULL, FILE_BEGIN) || !SetEndOfFile(h)) return;
+    /* The data between the writes and the new end is never exposed, the file is
+     * truncated to what was written when the writer finishes */
+    if (valid_data) SetFileValidData(h, end.QuadPart);
+    *allocated = end.QuadPart;
+}
+
+/* Wait for a write and return how many bytes made it to the file */
+static size_t slot_finish(HANDLE h, writer_slot_t *slot)
+{
+    DWORD n = 0;
+    if (!slot->submitted) return 0;
+    if (!GetOverlappedResult(h, &slot->ov, &n, TRUE)) {
+        fprintf(stderr, "Overlapped write failed (error %lu)\n", GetLastError());
+        n = 0;
+    }
+    slot->submitted = false;
+    return n;
+}
+
+/* Returns (size_t)-1 if overlapped I/O cannot be used, so the caller falls back to stdio */
+static size_t rb_writer_run_overlapped(rb_writer_config_t *config)
+{
+    writer_slot_t slots[RB_WRITER_MAX_QUEUE_DEPTH];
+    size_t total_written = 0;
+    size_t len = config->read_size;
+    size_t ahead = 0;           /* Bytes submitted but not yet released */
+    unsigned first = 0, inflight = 0;
+    unsigned depth;
+    bool direct = false, unaligned = false, valid_data;
+    LARGE_INTEGER pos, zero;
+    LONGLONG offset, allocated;
+    HANDLE orig, h = INVALID_HANDLE_VALUE;
+
+    fflush(config->file);
+    orig = (HANDLE)_get_osfhandle(_fileno(config->file));
+    /* Pipes and consoles keep using stdio, explicit offsets need a disk file */
+    if (orig == INVALID_HANDLE_VALUE || GetFileType(orig) != FILE_TYPE_DISK || len > MAXDWORD) {
+        return (size_t)-1;
+    }
+    zero.QuadPart = 0;
+    if (!SetFilePointerEx(orig, zero, &pos, FILE_CURRENT)) {
+        return (size_t)-1;
+    }
+    offset = pos.QuadPart;
+
+    /* All writes in flight have to fit in the ringbuffer at once */
+    depth = config->queue_depth > 0 ? (unsigned)config->queue_depth : RB_WRITER_QUEUE_DEPTH;
+    if (depth > RB_WRITER_MAX_QUEUE_DEPTH) depth = RB_WRITER_MAX_QUEUE_DEPTH;
+    if (len > 0 && depth > config->rb->buffer_size / (2 * len)) {
+        depth = (unsigned)(config->rb->buffer_size / (2 * len));
+        if (depth == 0) depth = 1;
+    }
+
+    /* A second handle on the same file, the CRT one stays untouched for the tail */
+    if (config->direct) {
+        if (len % RB_WRITER_DIRECT_ALIGN != 0 || offset % RB_WRITER_DIRECT_ALIGN != 0) {
+            fprintf(stderr, "Direct I/O needs %d byte aligned writes, using the page cache\n",
+                    RB_WRITER_DIRECT_ALIGN);
+        } else {
+            h = ReOpenFile(orig, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                           FILE_FLAG_OVERLAPPED | FILE_FLAG_NO_BUFFERING);
+            direct = (h != INVALID_HANDLE_VALUE);
+            if (!direct) {
+                fprintf(stderr, "Unbuffered I/O not supported for this file, using the page cache\n");
+            }
+        }
+    }
+    if (h == INVALID_HANDLE_VALUE) {
+        h = ReOpenFile(orig, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, FILE_FLAG_OVERLAPPED);
+    }
+    if (h == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "Overlapped I/O unavailable (error %lu), using buffered writes\n", GetLastError());
+        return (size_t)-1;
+    }
+    for (unsigned i = 0; i < depth; i++) {
+        memset(&slots[i], 0, sizeof(slots[i]));
+        slots[i].ov.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+    }
+    valid_data = enable_manage_volume();
+    allocated = offset;
+
+    while (1) {
+        /* Keep the queue full, each write covers the next read_size bytes behind the ones in flight */
+        while (inflight < depth && !writer_segment_due(config)) {
+            uint8_t *buf = writer_read_ptr(config, ahead + len);
+            if (!buf) break;
+            buf += ahead;
+            /* The ringbuffer view is page aligned, so this only trips for odd read positions */
+            if (direct && ((uintptr_t)buf % RB_WRITER_DIRECT_ALIGN) != 0) {
+                unaligned = true;
+                break;
+            }
+            extend_file(h, &allocated, offset + (LONGLONG)len, valid_data);
+            writer_slot_t *slot = &slots[(first + inflight) % depth];
+            ResetEvent(slot->ov.hEvent);
+            slot->ov.Offset = (DWORD)(offset & 0xffffffff);
+            slot->ov.OffsetHigh = (DWORD)(offset >> 32);
+            slot->submitted = WriteFile(h, buf, (DWORD)len, NULL, &slot->ov) ||
+                              GetLastError() == ERROR_IO_PENDING;
+            if (!slot->submitted) {
+                fprintf(stderr, "Overlapped write failed (error %lu)\n", GetLastError());
+            }
+            offset += (LONGLONG)len;
+            ahead += len;
+            config->segment_written += len;
+            inflight++;
+        }
+
+        if (inflight == 0) {
+            /* On exit or unaligned data the rest goes through the CRT handle */
+            if (should_exit(config) || unaligned || writer_segment_due(config)) {
+                break;
+            }
+
+            /* Block until the producer commits more data, then retry */
+            writer_read_ptr_wait(config, len);
+            continue;
+        }
+
+        /* Ring space is only handed back once the oldest write completed */
+        size_t written = slot_finish(h, &slots[first]);
+        writer_read_finished(config, len);
+        ahead -= len;
+        total_written += written;
+
+        if (config->progress_cb) {
+            config->progress_cb(config->user_ctx, written);
+        }
+        first = (first + 1) % depth;
+        inflight--;
+    }
+
+    /* Cut the preallocated space off again */
+    pos.QuadPart = offset;
+    SetFilePointerEx(h, pos, NULL, FILE_BEGIN);
+    SetEndOfFile(h);
+    for (unsigned i = 0; i < depth; i++) {
+        if (slots[i].ov.hEvent) CloseHandle(slots[i].ov.hEvent);
+    }
+    CloseHandle(h);
+    _fseeki64(config->file, offset, SEEK_SET);
+
+    if (writer_segment_due(config)) {
+        return total_written;
+    }
+    /* Whatever could not be written unbuffered, usually only the partial last block */
+    return total_written + rb_writer_run_stdio(config);
+}
+
+#endif /* _WIN32 */
+
+/*-----------------------------------------------------------------------------
+ * Public API
+ *-----------------------------------------------------------------------------*/
+
+bool rb_writer_backend_available(rb_writer_backend_t backend)
+{
+    switch (backend) {
+    case RB_WRITER_STDIO:
+        return true;
+#ifdef RB_WRITER_HAVE_URING
+    case RB_WRITER_URING: {
+        writer_uring_t u;
+        if (uring_open(&u, 1) != 0) return false;
+        uring_close(&u);
+        return true;
+    }
+#endif
+#ifdef _WIN32
+    case RB_WRITER_OVERLAPPED:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+static size_t rb_writer_run_backend(rb_writer_config_t *config)
+{
+#ifdef RB_WRITER_HAVE_URING
+    if (config->backend == RB_WRITER_URING) {
+        size_t total_written = rb_writer_run_uring(config);
+        if (total_written != (size_t)-1) {
+            return total_written;
+        }
+    }
+#endif
+#ifdef _WIN32
+    if (config->backend == RB_WRITER_OVERLAPPED) {
+        size_t total_written = rb_writer_run_overlapped(config);
+        if (total_written != (size_t)-1) {
+            return total_written;
+        }
+    }
+#endif
+    return rb_writer_run_stdio(config);
+}
+
+size_t rb_writer_run(rb_writer_config_t *config)
+{
+    size_t total_written = 0;
+
+    while (1) {
+        total_written += rb_writer_run_backend(config);
+        if (!writer_segment_due(config)) {
+            break;
+        }
+        /* Everything is written, no point in starting an empty segment */
+        if (should_exit(config) && writer_available(config) == 0) {
+            break;
+        }
+        /* The backends stop between two reads, so no sample falls between the segments */
+        FILE *next = file_segment_next(config->segment);
+        if (next) {
+            config->file = next;
+            config->segment_written = 0;
+        }
+    }
+    return total_written;
+}
+
 int rb_writer_thread(void *ctx)
 {
     rb_writer_config_t *config = (rb_writer_config_t *)ctx;
@@ -15,6 +15,7 @@
 #include <stdatomic.h>
 
 #include "ringbuffer.h"
+#include "file_segment.h"
 
 /*-----------------------------------------------------------------------------
  * Callback Types
@@ -38,11 +39,39 @@ typedef void (*rb_writer_progress_cb_t)(void *user_ctx, size_t bytes_written);
  * Writer Configuration
  *-----------------------------------------------------------------------------*/
 
+/* How the data gets to the file */
+typedef enum {
+    RB_WRITER_STDIO = 0,        /* fwrite() through stdio and the page cache */
+    RB_WRITER_URING,            /* Linux io_uring, writes straight from the ringbuffer mapping */
+    RB_WRITER_OVERLAPPED,       /* Windows overlapped I/O, writes straight from the ringbuffer view */
+} rb_writer_backend_t;
+
+/* The asynchronous backend of this platform */
+#ifdef _WIN32
+#define RB_WRITER_ASYNC RB_WRITER_OVERLAPPED
+#else
+#define RB_WRITER_ASYNC RB_WRITER_URING
+#endif
+
+/* Default and maximum number of writes in flight for the asynchronous backends */
+#define RB_WRITER_QUEUE_DEPTH     8
+#define RB_WRITER_MAX_QUEUE_DEPTH 64
+
+/* File offset, length and buffer alignment needed for direct I/O */
+#define RB_WRITER_DIRECT_ALIGN    4096
+
 typedef struct {
     ringbuffer_t *rb;           /* Ringbuffer to read from */
     FILE *file;                 /* File to write to */
     size_t read_size;           /* Bytes to read per iteration */
-    int sleep_ms;               /* Milliseconds to sleep when no data available */
+    int reader;                 /* Fan-out reader id from rb_reader_add(), -1 for the primary reader */
+    int sleep_ms;               /* Max milliseconds to block waiting for data before rechecking exit */
+
+    /* I/O backend, falls back to RB_WRITER_STDIO if unavailable or the file is not a regular file */
+    rb_writer_backend_t backend;
+    int queue_depth;            /* Writes in flight, ring space is released as each one completes */
+    bool direct;                /* Bypass the page cache (O_DIRECT / FILE_FLAG_NO_BUFFERING),
+                                   read_size should be a multiple of RB_WRITER_DIRECT_ALIGN */
 
     /* Exit condition - use ONE of these methods: */
     atomic_bool *exit_flag;     /* Atomic flag to check (simple method) */
@@ -51,6 +80,11 @@ typedef struct {
     /* Optional callbacks */
     rb_writer_progress_cb_t progress_cb;  /* Called after each write */
     void *user_ctx;             /* User context for callbacks */
+
+    /* Optional rolling segments, file is then the current segment from file_segment_open()
+     * and gets replaced on every rollover: close with file_segment_close(), not fclose() */
+    file_segment_t *segment;
+    uint64_t segment_written;   /* Bytes in the current segment */
 } rb_writer_config_t;
 
 /*-----------------------------------------------------------------------------
@@ -76,9 +110,17 @@ void rb_writer_config_init(rb_writer_config_t *config,
  *
  * This function blocks until the exit condition is met.
  * On exit, it drains any remaining data from the ringbuffer.
+ * With segments, the file is switched between two reads once a segment is full.
  */
 size_t rb_writer_run(rb_writer_config_t *config);
 
+/* Check whether a backend can be used on this system
+ *
+ * @param backend       Backend to check
+ * @return true if rb_writer_run() will not fall back to stdio for it
+ */
+bool rb_writer_backend_available(rb_writer_backend_t backend);
+
 /* Thread entry point wrapper
  *
  * @param ctx           Pointer to rb_writer_config_t
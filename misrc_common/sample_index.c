@@ -0,0 +1,279 @@
+/*
+ * MISRC Common - Sidecar Sample Index Implementation
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE      /* clock_gettime() in threading.h */
+#endif
+
+#include "sample_index.h"
+#include "aux_events.h"
+#include "threading.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+
+struct sample_index {
+    FILE *f;
+    sample_index_header_t header;
+    atomic_flag lock;           /* Entries come from the capture and extraction threads */
+    uint64_t next_periodic;     /* Sample offset of the next periodic entry */
+    _Atomic uint16_t last_frame; /* Also read by the extraction thread */
+    bool frame_valid;           /* last_frame is set, reset when sync is lost */
+    _Atomic uint8_t aux;        /* Current aux bits, only the extraction thread changes them */
+    bool aux_valid;
+};
+
+/*-----------------------------------------------------------------------------
+ * Helpers
+ *-----------------------------------------------------------------------------*/
+
+/* Events are rare and an entry is a single buffered fwrite, a spinlock is plenty */
+static void index_write(sample_index_t *idx, uint8_t type, uint64_t sample,
+                        uint16_t frame, uint32_t arg, uint8_t aux, uint64_t time_ns)
+{
+    sample_index_entry_t e;
+    memset(&e, 0, sizeof(e));
+    e.sample = sample;
+    e.time_ns = time_ns;
+    e.arg = arg;
+    e.frame = frame;
+    e.type = type;
+    e.aux = aux;
+    while (atomic_flag_test_and_set_explicit(&idx->lock, memory_order_acquire)) {}
+    fwrite(&e, sizeof(e), 1, idx->f);
+    atomic_flag_clear_explicit(&idx->lock, memory_order_release);
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+    const sample_index_entry_t *ea = a, *eb = b;
+    if (ea->sample != eb->sample) return (ea->sample < eb->sample) ? -1 : 1;
+    /* Keep the periodic entry in front of events at the same sample */
+    if (ea->type != eb->type) return (ea->type < eb->type) ? -1 : 1;
+    return (ea->time_ns < eb->time_ns) ? -1 : (ea->time_ns > eb->time_ns);
+}
+
+/*-----------------------------------------------------------------------------
+ * Writing
+ *-----------------------------------------------------------------------------*/
+
+/* UTC at the monotonic time t, both clocks read back to back */
+static uint64_t wall_time_at(uint64_t t)
+{
+    struct timespec ts;
+    uint64_t now = get_time_ns();
+    if (timespec_get(&ts, TIME_UTC) != TIME_UTC) return 0;
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec - (now - t);
+}
+
+sample_index_t *sample_index_open(FILE *f, uint32_t sample_rate)
+{
+    return sample_index_open_timeline(f, sample_rate, 0, get_time_ns());
+}
+
+sample_index_t *sample_index_open_timeline(FILE *f, uint32_t sample_rate,
+                                           uint32_t device, uint64_t timeline_ns)
+{
+    sample_index_t *idx = calloc(1, sizeof(*idx));
+    if (!idx) {
+        fclose(f);
+        return NULL;
+    }
+    idx->f = f;
+    atomic_flag_clear(&idx->lock);
+    memcpy(idx->header.magic, SAMPLE_INDEX_MAGIC, sizeof(idx->header.magic));
+    idx->header.version = SAMPLE_INDEX_VERSION;
+    idx->header.entry_size = sizeof(sample_index_entry_t);
+    idx->header.interval = SAMPLE_INDEX_INTERVAL;
+    idx->header.sample_rate = sample_rate;
+    idx->header.start_time_ns = get_time_ns();
+    idx->header.header_size = sizeof(idx->header);
+    idx->header.device = device;
+    idx->header.timeline_ns = timeline_ns;
+    idx->header.wall_time_ns = wall_time_at(timeline_ns);
+    if (fwrite(&idx->header, sizeof(idx->header), 1, f) != 1) {
+        fprintf(stderr, "Failed to write sample index header\n");
+        fclose(f);
+        free(idx);
+        return NULL;
+    }
+    return idx;
+}
+
+void sample_index_frame(sample_index_t *idx, uint64_t sample, uint16_t frame, bool missed, uint64_t time_ns)
+{
+    if (missed && idx->frame_valid) {
+        index_write(idx, SAMPLE_INDEX_FRAME_MISSED, sample, frame,
+                    (uint16_t)(frame - idx->last_frame - 1), idx->aux, time_ns);
+    }
+    if (sample >= idx->next_periodic) {
+        index_write(idx, SAMPLE_INDEX_PERIODIC, sample, frame, 0, idx->aux, time_ns);
+        idx->next_periodic = (sample / SAMPLE_INDEX_INTERVAL + 1) * SAMPLE_INDEX_INTERVAL;
+    }
+    idx->last_frame = frame;
+    idx->frame_valid = true;
+}
+
+void sample_index_event(sample_index_t *idx, sample_index_type_t type,
+                        uint64_t sample, uint16_t frame, uint32_t arg)
+{
+    sample_index_event_at(idx, type, sample, frame, arg, get_time_ns());
+}
+
+void sample_index_event_at(sample_index_t *idx, sample_index_type_t type,
+                           uint64_t sample, uint16_t frame, uint32_t arg, uint64_t time_ns)
+{
+    if (type == SAMPLE_INDEX_SYNC_LOST) {
+        idx->frame_valid = false;
+    }
+    index_write(idx, (uint8_t)type, sample, frame, arg, idx->aux, time_ns);
+}
+
+void sample_index_aux(sample_index_t *idx, const uint8_t *aux, size_t len, uint64_t sample)
+{
+    size_t i = 0, first = 0;
+    uint32_t changes = 0;
+    uint8_t cur, first_val = 0;
+
+    if (len == 0) return;
+    if (!idx->aux_valid) {
+        idx->aux = aux[0];
+        idx->aux_valid = true;
+    }
+    cur = idx->aux;
+    while (i < len) {
+        i += aux_find_change(aux + i, len - i, cur);
+        if (i == len) break;
+        if (changes == 0) {
+            first = i;
+            first_val = aux[i];
+        }
+        changes++;
+        cur = aux[i];
+    }
+    if (changes > 0) {
+        index_write(idx, SAMPLE_INDEX_AUX, sample + first, idx->last_frame, changes, first_val, get_time_ns());
+    }
+    idx->aux = cur;
+}
+
+void sample_index_close(sample_index_t *idx)
+{
+    if (!idx) return;
+    fclose(idx->f);
+    free(idx);
+}
+
+/*-----------------------------------------------------------------------------
+ * Reading and Seeking
+ *-----------------------------------------------------------------------------*/
+
+int sample_index_load(const char *path, sample_index_header_t *header,
+                      sample_index_entry_t **entries, size_t *count)
+{
+    FILE *f = fopen(path, "rb");
+    sample_index_entry_t *e = NULL;
+    size_t n = 0, cap = 0, skip;
+    uint64_t start = 0;
+
+    if (!f) {
+        fprintf(stderr, "Failed to open sample index %s\n", path);
+        return -1;
+    }
+    /* Version 1 headers end after start_time_ns */
+    memset(header, 0, sizeof(*header));
+    if (fread(header, offsetof(sample_index_header_t, header_size), 1, f) != 1 ||
+        memcmp(header->magic, SAMPLE_INDEX_MAGIC, sizeof(header->magic)) != 0 ||
+        header->entry_size < sizeof(sample_index_entry_t)) {
+        fprintf(stderr, "%s is not a MISRC sample index\n", path);
+        fclose(f);
+        return -1;
+    }
+    if (header->version >= 2) {
+        size_t rest = sizeof(*header) - offsetof(sample_index_header_t, header_size);
+        if (fread(&header->header_size, rest, 1, f) != 1 || header->header_size < sizeof(*header)) {
+            fprintf(stderr, "%s is not a MISRC sample index\n", path);
+            fclose(f);
+            return -1;
+        }
+        fseek(f, (long)header->header_size, SEEK_SET);
+    } else {
+        header->header_size = offsetof(sample_index_header_t, header_size);
+        header->timeline_ns = header->start_time_ns;
+    }
+    skip = header->entry_size - sizeof(sample_index_entry_t);
+    while (1) {
+        if (n == cap) {
+            sample_index_entry_t *grown;
+            cap = cap ? cap * 2 : 4096;
+            grown = realloc(e, cap * sizeof(*e));
+            if (!grown) {
+                free(e);
+                fclose(f);
+                return -1;
+            }
+            e = grown;
+        }
+        if (fread(&e[n], sizeof(*e), 1, f) != 1) break;
+        if (skip > 0) fseek(f, (long)skip, SEEK_CUR);
+        if (e[n].type == SAMPLE_INDEX_START) {
+            start = e[n].sample;
+            continue;
+        }
+        n++;
+    }
+    fclose(f);
+
+    qsort(e, n, sizeof(*e), compare_entries);
+    /* Anything before the start of the outputs is not in the files */
+    skip = 0;
+    while (skip < n && e[skip].sample < start) skip++;
+    n -= skip;
+    memmove(e, e + skip, n * sizeof(*e));
+    for (size_t i = 0; i < n; i++) e[i].sample -= start;
+
+    *entries = e;
+    *count = n;
+    return 0;
+}
+
+uint64_t sample_index_find_time(const sample_index_header_t *header,
+                                const sample_index_entry_t *entries, size_t count,
+                                double seconds)
+{
+    uint64_t t = header->timeline_ns + (uint64_t)(seconds * 1e9);
+    const sample_index_entry_t *best = NULL;
+
+    /* Only periodic entries are stamped at capture time, the aux entries come
+     * from the extraction thread, later and out of order */
+    for (size_t i = 0; i < count; i++) {
+        if (entries[i].type != SAMPLE_INDEX_PERIODIC) continue;
+        if (entries[i].time_ns > t) break;
+        best = &entries[i];
+    }
+    if (!best) {
+        return (uint64_t)(seconds * header->sample_rate);
+    }
+    return best->sample + (uint64_t)((double)(t - best->time_ns) * 1e-9 * header->sample_rate);
+}
+
+long sample_index_find_event(const sample_index_entry_t *entries, size_t count, size_t n)
+{
+    for (size_t i = 0; i < count; i++) {
+        if (entries[i].type == SAMPLE_INDEX_PERIODIC) continue;
+        if (n-- == 0) return (long)i;
+    }
+    return -1;
+}
+
+const char *sample_index_type_name(uint8_t type)
+{
+    static const char *names[SAMPLE_INDEX_TYPE_COUNT] = {
+        "periodic", "start", "sync acquired", "sync lost", "frames missed", "frame errors", "aux", "frame dropped",
+        "frame late", "callback slow"
+    };
+    return (type < SAMPLE_INDEX_TYPE_COUNT) ? names[type] : "unknown";
+}
@@ -0,0 +1,198 @@
+/*
+ * MISRC Common - Sidecar Sample Index
+ *
+ * A small binary file written next to a capture that maps sample offsets to
+ * hsdaoh frame counters and host time, and marks where frames went missing,
+ * sync was lost, frames were dropped for errors and where the aux bits
+ * changed. Tools can jump straight to a time or event with it instead of
+ * scanning the whole capture. Frame entries carry the time the capture
+ * callback got the frame, and frames that came late or kept the callback
+ * busy for longer than a frame period are marked (frame_timing.h), to line
+ * drops up with USB and system activity.
+ *
+ * The file is a sample_index_header_t followed by sample_index_entry_t
+ * records, both little endian. Entries are appended by several threads, so
+ * they are only roughly ordered by sample; sample_index_load() sorts them.
+ *
+ * When several devices are captured by one process, all their indexes share
+ * one timeline: the same host monotonic origin and the UTC time at it, so
+ * the same host time means the same instant on every deck.
+ */
+
+#ifndef MISRC_SAMPLE_INDEX_H
+#define MISRC_SAMPLE_INDEX_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define SAMPLE_INDEX_MAGIC      "MISRCIDX"
+#define SAMPLE_INDEX_VERSION    2
+/* Samples between periodic entries, about 26 ms at 40 MSPS */
+#define SAMPLE_INDEX_INTERVAL   (1 << 20)
+
+typedef enum {
+    SAMPLE_INDEX_PERIODIC = 0,  /* Frame counter and time every interval */
+    SAMPLE_INDEX_START,         /* First sample in the output files, subtract from all offsets */
+    SAMPLE_INDEX_SYNC_ACQUIRED, /* Stream synchronized */
+    SAMPLE_INDEX_SYNC_LOST,     /* Sync lost, samples are missing until the next SYNC_ACQUIRED */
+    SAMPLE_INDEX_FRAME_MISSED,  /* arg frames missing before this frame */
+    SAMPLE_INDEX_FRAME_ERRORS,  /* A frame with arg CRC/idle errors was dropped here */
+    SAMPLE_INDEX_AUX,           /* Aux bits changed to aux here, arg changes within the block */
+    SAMPLE_INDEX_FRAME_DROPPED, /* A frame was dropped for lack of buffer space here */
+    SAMPLE_INDEX_FRAME_LATE,    /* The frame came arg us after the previous one, well over a frame period */
+    SAMPLE_INDEX_CALLBACK_SLOW, /* The capture callback spent arg us on the frame, more than a frame period */
+    SAMPLE_INDEX_TYPE_COUNT
+} sample_index_type_t;
+
+typedef struct {
+    char magic[8];              /* SAMPLE_INDEX_MAGIC, not terminated */
+    uint32_t version;           /* SAMPLE_INDEX_VERSION */
+    uint32_t entry_size;        /* sizeof(sample_index_entry_t), for later extensions */
+    uint32_t interval;          /* Samples between periodic entries */
+    uint32_t sample_rate;       /* Samples per second and channel */
+    uint64_t start_time_ns;     /* Host monotonic time at open */
+    /* Version 2, sample_index_load() fills them in for version 1 files */
+    uint32_t header_size;       /* sizeof(sample_index_header_t), entries start here */
+    uint32_t device;            /* Device number within the capture */
+    uint64_t timeline_ns;       /* Host monotonic time of the timeline origin, shared by all devices */
+    uint64_t wall_time_ns;      /* UTC at timeline_ns in ns since the epoch, 0 if unknown */
+} sample_index_header_t;
+
+typedef struct {
+    uint64_t sample;            /* Sample offset (per channel) from the start of the capture */
+    uint64_t time_ns;           /* Host monotonic time */
+    uint32_t arg;               /* Type specific, see sample_index_type_t */
+    uint16_t frame;             /* hsdaoh frame counter */
+    uint8_t type;               /* sample_index_type_t */
+    uint8_t aux;                /* Aux bits at this point */
+} sample_index_entry_t;
+
+typedef struct sample_index sample_index_t;
+
+/*-----------------------------------------------------------------------------
+ * Writing
+ *-----------------------------------------------------------------------------*/
+
+/* Start an index in an already opened file
+ *
+ * @param f             Index file, owned by the index afterwards
+ * @param sample_rate   Samples per second and channel
+ * @return Index state, or NULL on failure (f is closed)
+ */
+sample_index_t *sample_index_open(FILE *f, uint32_t sample_rate);
+
+/* Start an index on a timeline shared with other devices
+ *
+ * @param f             Index file, owned by the index afterwards
+ * @param sample_rate   Samples per second and channel
+ * @param device        Device number within the capture
+ * @param timeline_ns   Host monotonic time of the common origin, get_time_ns()
+ *                      taken once before any device is started
+ * @return Index state, or NULL on failure (f is closed)
+ *
+ * sample_index_open() is the single device case, a timeline starting now.
+ */
+sample_index_t *sample_index_open_timeline(FILE *f, uint32_t sample_rate,
+                                           uint32_t device, uint64_t timeline_ns);
+
+/* Record a frame that was written to the outputs, call from the capture callback
+ *
+ * @param idx           Index state
+ * @param sample        Sample offset of the first sample of the frame
+ * @param frame         Frame counter
+ * @param missed        Frames were missed before this one (FRAME_SYNC_MISSED)
+ * @param time_ns       Host monotonic time the frame arrived, get_time_ns()
+ *
+ * Adds a periodic entry whenever the frame crosses an interval boundary,
+ * and a SAMPLE_INDEX_FRAME_MISSED entry with the gap in frame counters.
+ */
+void sample_index_frame(sample_index_t *idx, uint64_t sample, uint16_t frame, bool missed, uint64_t time_ns);
+
+/* Record an event
+ *
+ * @param idx           Index state
+ * @param type          Event type
+ * @param sample        Sample offset where it happened
+ * @param frame         Frame counter
+ * @param arg           Type specific value
+ */
+void sample_index_event(sample_index_t *idx, sample_index_type_t type,
+                        uint64_t sample, uint16_t frame, uint32_t arg);
+
+/* Record an event at a time taken earlier, e.g. the arrival of a frame
+ *
+ * @param time_ns       Host monotonic time, get_time_ns()
+ *
+ * Otherwise the same as sample_index_event().
+ */
+void sample_index_event_at(sample_index_t *idx, sample_index_type_t type,
+                           uint64_t sample, uint16_t frame, uint32_t arg, uint64_t time_ns);
+
+/* Look for aux bit changes in a block of extracted aux bytes
+ *
+ * @param idx           Index state
+ * @param aux           Aux byte of every sample in the block
+ * @param len           Number of samples
+ * @param sample        Sample offset of the first sample of the block
+ *
+ * Adds one SAMPLE_INDEX_AUX entry at the first change in the block, arg
+ * counts the changes, so a toggling aux line costs one entry per block.
+ * Only one thread may call this.
+ */
+void sample_index_aux(sample_index_t *idx, const uint8_t *aux, size_t len, uint64_t sample);
+
+/* Flush and close the index
+ *
+ * @param idx           Index state, freed (NULL is ignored)
+ */
+void sample_index_close(sample_index_t *idx);
+
+/*-----------------------------------------------------------------------------
+ * Reading and Seeking
+ *-----------------------------------------------------------------------------*/
+
+/* Load a whole index, sorted by sample
+ *
+ * @param path          Index file
+ * @param header        Receives the header
+ * @param entries       Receives the entries, free() them afterwards
+ * @param count         Receives the number of entries
+ * @return 0 on success, -1 if the file cannot be read or is not an index
+ *
+ * Offsets are made relative to the output files: a SAMPLE_INDEX_START
+ * entry is subtracted from every entry and removed.
+ */
+int sample_index_load(const char *path, sample_index_header_t *header,
+                      sample_index_entry_t **entries, size_t *count);
+
+/* Sample offset at a host time on the timeline
+ *
+ * @param header        Index header
+ * @param entries       Sorted entries
+ * @param count         Number of entries
+ * @param seconds       Time since the timeline origin, the same instant for
+ *                      all devices of a capture
+ * @return Sample offset, interpolated from the last entry before that time
+ *         at the nominal rate
+ */
+uint64_t sample_index_find_time(const sample_index_header_t *header,
+                                const sample_index_entry_t *entries, size_t count,
+                                double seconds);
+
+/* Find the n-th event
+ *
+ * @param entries       Sorted entries
+ * @param count         Number of entries
+ * @param n             Event number, starting at 0
+ * @return Index of the entry, or -1 if there are not that many events
+ *
+ * Everything but SAMPLE_INDEX_PERIODIC counts as an event.
+ */
+long sample_index_find_event(const sample_index_entry_t *entries, size_t count, size_t n);
+
+/* Name of an entry type, for listings */
+const char *sample_index_type_name(uint8_t type);
+
+#endif /* MISRC_SAMPLE_INDEX_H */
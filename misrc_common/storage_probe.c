@@ -0,0 +1,163 @@
+/*
+ * MISRC Common - Storage Throughput Probe Implementation
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE      /* clock_gettime() in threading.h */
+#endif
+
+#include "storage_probe.h"
+#include "ringbuffer.h"
+#include "threading.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#define PROBE_NAME          ".misrc_probe.tmp"
+#define PROBE_RING_BLOCKS   8
+
+/*-----------------------------------------------------------------------------
+ * Helpers
+ *-----------------------------------------------------------------------------*/
+
+/* Length of the directory part of a path, including the separator */
+static size_t dir_len(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    const char *bslash = strrchr(path, '\\');
+    if (bslash && (!slash || bslash > slash)) slash = bslash;
+    return slash ? (size_t)(slash - path) + 1 : 0;
+}
+
+/* Page cache contents do not count, only what reached the disk */
+static void sync_file(FILE *f)
+{
+    fflush(f);
+#ifdef _WIN32
+    _commit(_fileno(f));
+#else
+    fsync(fileno(f));
+#endif
+}
+
+/* Incompressible data, some filesystems would make short work of zeros */
+static void fill_random(uint8_t *buf, size_t len, uint64_t *state)
+{
+    uint64_t x = *state;
+    for (size_t i = 0; i + sizeof(x) <= len; i += sizeof(x)) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        memcpy(buf + i, &x, sizeof(x));
+    }
+    *state = x;
+}
+
+/*-----------------------------------------------------------------------------
+ * Public API
+ *-----------------------------------------------------------------------------*/
+
+void storage_probe_config_init(storage_probe_config_t *config, const char *output, size_t block_size)
+{
+    memset(config, 0, sizeof(*config));
+    config->output = output;
+    config->block_size = block_size;
+    config->backend = RB_WRITER_STDIO;
+    config->queue_depth = RB_WRITER_QUEUE_DEPTH;
+}
+
+int storage_probe_run(const storage_probe_config_t *config, storage_probe_result_t *result)
+{
+    const uint64_t max_bytes = config->max_bytes ? config->max_bytes : STORAGE_PROBE_BYTES;
+    const double max_seconds = config->max_seconds > 0 ? config->max_seconds : STORAGE_PROBE_SECONDS;
+    size_t len = dir_len(config->output);
+    size_t ring_size = config->block_size * PROBE_RING_BLOCKS;
+    char *name;
+    FILE *f;
+    ringbuffer_t rb;
+    rb_writer_config_t writer;
+    atomic_bool exit_flag = false;
+    thrd_t thread;
+    uint64_t state = 0x9e3779b97f4a7c15ull, produced = 0, start;
+
+    memset(result, 0, sizeof(*result));
+    if (strcmp(config->output, "-") == 0) return -1;
+
+    name = malloc(len + sizeof(PROBE_NAME));
+    if (!name) return -1;
+    memcpy(name, config->output, len);
+    memcpy(name + len, PROBE_NAME, sizeof(PROBE_NAME));
+    f = fopen(name, "wb");
+    if (!f) {
+        fprintf(stderr, "Failed to create %s for the storage probe\n", name);
+        free(name);
+        return -1;
+    }
+    /* The ringbuffer maps in whole huge pages at most, 2M keeps it mappable everywhere */
+    ring_size = (ring_size + (2 << 20) - 1) & ~(size_t)((2 << 20) - 1);
+    if (rb_init(&rb, "storage_probe", ring_size) != 0) {
+        fclose(f);
+        remove(name);
+        free(name);
+        return -1;
+    }
+
+    rb_writer_config_init(&writer, &rb, f, config->block_size);
+    writer.backend = config->backend;
+    writer.queue_depth = config->queue_depth;
+    writer.direct = config->direct;
+    writer.exit_flag = &exit_flag;
+
+    start = get_time_ns();
+    if (thrd_create(&thread, &rb_writer_thread, &writer) != thrd_success) {
+        rb_close(&rb);
+        fclose(f);
+        remove(name);
+        free(name);
+        return -1;
+    }
+    /* Produce as fast as the writer drains, the data only has to be made once */
+    while (produced < max_bytes && (get_time_ns() - start) * 1e-9 < max_seconds) {
+        uint8_t *buf = rb_write_ptr_wait(&rb, config->block_size, 100);
+        if (!buf) continue;
+        if (produced < ring_size) fill_random(buf, config->block_size, &state);
+        rb_write_finished(&rb, config->block_size);
+        produced += config->block_size;
+    }
+    atomic_store(&exit_flag, true);
+    rb_wake(&rb);
+    thrd_join(thread, NULL);
+    sync_file(f);
+
+    result->bytes = produced;
+    result->seconds = (get_time_ns() - start) * 1e-9;
+    result->bytes_per_sec = result->seconds > 0 ? (double)produced / result->seconds : 0.0;
+
+    rb_close(&rb);
+    fclose(f);
+    remove(name);
+    free(name);
+    return 0;
+}
+
+storage_probe_verdict_t storage_probe_judge(const storage_probe_result_t *result, double required)
+{
+    if (!result || result->bytes == 0) return STORAGE_PROBE_FAILED;
+    if (result->bytes_per_sec < required) return STORAGE_PROBE_TOO_SLOW;
+    if (result->bytes_per_sec < required * STORAGE_PROBE_MARGIN) return STORAGE_PROBE_MARGINAL;
+    return STORAGE_PROBE_OK;
+}
+
+bool storage_probe_same_dir(const char *a, const char *b)
+{
+    size_t la = dir_len(a), lb = dir_len(b);
+    return la == lb && strncmp(a, b, la) == 0;
+}
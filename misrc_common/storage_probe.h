@@ -0,0 +1,84 @@
+/*
+ * MISRC Common - Storage Throughput Probe
+ *
+ * Writes a scratch file next to an output for a few seconds through the
+ * same ringbuffer writer, block size and backend the recording will use,
+ * and reports the throughput that actually reached the disk. Run before a
+ * capture to find out whether the destination keeps up, instead of
+ * finding out from dropped frames an hour in.
+ */
+
+#ifndef MISRC_STORAGE_PROBE_H
+#define MISRC_STORAGE_PROBE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ringbuffer_writer.h"
+
+/* Defaults, enough to get past most drive and page cache write bursts */
+#define STORAGE_PROBE_BYTES     (1024ull << 20)
+#define STORAGE_PROBE_SECONDS   3.0
+
+/* Measured rate must exceed the required one by this factor to pass without a warning */
+#define STORAGE_PROBE_MARGIN    1.25
+
+typedef struct {
+    const char *output;         /* Output the probe is for, the scratch file goes next to it */
+    size_t block_size;          /* Write size of the recording (read_size of its writer) */
+    rb_writer_backend_t backend;
+    int queue_depth;
+    bool direct;
+    uint64_t max_bytes;         /* Stop after this much, 0 = STORAGE_PROBE_BYTES */
+    double max_seconds;         /* Or after this long, 0 = STORAGE_PROBE_SECONDS */
+} storage_probe_config_t;
+
+typedef struct {
+    uint64_t bytes;             /* Written and synced */
+    double seconds;             /* Including the final sync */
+    double bytes_per_sec;
+} storage_probe_result_t;
+
+typedef enum {
+    STORAGE_PROBE_OK = 0,       /* Comfortably faster than required */
+    STORAGE_PROBE_MARGINAL,     /* Faster, but with less than STORAGE_PROBE_MARGIN headroom */
+    STORAGE_PROBE_TOO_SLOW,     /* Slower than required, expect drops */
+    STORAGE_PROBE_FAILED        /* Could not write the scratch file */
+} storage_probe_verdict_t;
+
+/* Initialize a probe config with defaults
+ *
+ * @param config        Config to initialize
+ * @param output        Output file the recording will write
+ * @param block_size    Write size of the recording
+ */
+void storage_probe_config_init(storage_probe_config_t *config, const char *output, size_t block_size);
+
+/* Run the probe (blocking, takes about max_seconds)
+ *
+ * @param config        Probe configuration
+ * @param result        Receives the measured throughput
+ * @return 0 on success, -1 if the scratch file could not be created or written
+ *
+ * The scratch file is removed again. Outputs to stdout cannot be probed.
+ */
+int storage_probe_run(const storage_probe_config_t *config, storage_probe_result_t *result);
+
+/* Compare a probe result against the rate a recording needs
+ *
+ * @param result        Probe result, NULL counts as failed
+ * @param required      Bytes per second all outputs on that storage write together
+ * @return Verdict
+ */
+storage_probe_verdict_t storage_probe_judge(const storage_probe_result_t *result, double required);
+
+/* Check whether two outputs are in the same directory, and so most likely on one disk
+ *
+ * @param a             First output path
+ * @param b             Second output path
+ * @return true if both have the same directory part
+ */
+bool storage_probe_same_dir(const char *a, const char *b);
+
+#endif /* MISRC_STORAGE_PROBE_H */
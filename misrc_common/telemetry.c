@@ -0,0 +1,429 @@
+/*
+ * MISRC Common - Live Telemetry Implementation
+ */
+
+#include "telemetry.h"
+#include "threading.h"
+#include "net_stream.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET net_socket_t;
+#define NET_INVALID_SOCKET INVALID_SOCKET
+#define net_close_socket closesocket
+#else
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+typedef int net_socket_t;
+#define NET_INVALID_SOCKET (-1)
+#define net_close_socket close
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/* Longest a stop or a snapshot waits for a request to finish */
+#define TELEMETRY_POLL_MS       200
+/* A client gets this long to send its request and take the answer */
+#define TELEMETRY_CLIENT_MS     1000
+/* Request line and headers, the rest is not looked at */
+#define TELEMETRY_REQUEST_SIZE  2048
+
+typedef struct {
+    char name[TELEMETRY_NAME_LEN];
+    char labels[TELEMETRY_LABELS_LEN];
+    const char *suffix;         /* Of the series of a histogram, "" otherwise */
+    telemetry_type_t type;
+    double value;
+} telemetry_metric_t;
+
+struct telemetry_snapshot {
+    telemetry_metric_t metrics[TELEMETRY_MAX_METRICS];
+    int count;
+};
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t size;
+} page_t;
+
+struct telemetry {
+    net_socket_t sock;
+    thrd_t thread;
+    atomic_int stop;
+    uint64_t interval_ms;
+    telemetry_collect_cb cb;
+    void *user;
+    telemetry_snapshot_t snap;  /* Only used by the thread */
+    page_t prom;                /* Rendered snapshot, served until the next one */
+    page_t json;
+};
+
+/*-----------------------------------------------------------------------------
+ * Helpers
+ *-----------------------------------------------------------------------------*/
+
+/* [host:]port, [v6]:port, *:port */
+static int parse_address(const char *address, char *host, size_t host_size, char *port, size_t port_size)
+{
+    const char *colon = strrchr(address, ':');
+    const char *p = colon ? colon + 1 : address;
+    size_t len;
+
+    if (p[0] == 0 || strlen(p) >= port_size || strspn(p, "0123456789") != strlen(p)) return -1;
+    strcpy(port, p);
+    if (!colon) {
+        strcpy(host, TELEMETRY_DEFAULT_HOST);
+        return 0;
+    }
+    len = (size_t)(colon - address);
+    if (len >= 2 && address[0] == '[' && address[len - 1] == ']') {
+        address++;
+        len -= 2;
+    }
+    if (len >= host_size) return -1;
+    memcpy(host, address, len);
+    host[len] = 0;
+    if (strcmp(host, "*") == 0) host[0] = 0;
+    return 0;
+}
+
+static net_socket_t telemetry_listen(const char *address)
+{
+    char host[256], port[16];
+    struct addrinfo hints, *res, *ai;
+    net_socket_t s = NET_INVALID_SOCKET;
+    int one = 1;
+
+    if (parse_address(address, host, sizeof(host), port, sizeof(port)) != 0) {
+        fprintf(stderr, "Telemetry: invalid address %s, expected [host:]port\n", address);
+        return NET_INVALID_SOCKET;
+    }
+    if (!net_startup()) return NET_INVALID_SOCKET;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    if (getaddrinfo(host[0] ? host : NULL, port, &hints, &res) != 0) {
+        fprintf(stderr, "Telemetry: cannot resolve %s\n", address);
+        return NET_INVALID_SOCKET;
+    }
+    for (ai = res; ai; ai = ai->ai_next) {
+        s = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (s == NET_INVALID_SOCKET) continue;
+        setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char *)&one, sizeof(one));
+        if (bind(s, ai->ai_addr, (int)ai->ai_addrlen) == 0 && listen(s, 8) == 0) break;
+        net_close_socket(s);
+        s = NET_INVALID_SOCKET;
+    }
+    freeaddrinfo(res);
+    if (s == NET_INVALID_SOCKET) fprintf(stderr, "Telemetry: cannot listen on %s\n", address);
+    return s;
+}
+
+/* Wait for a connection, false on timeout */
+static bool wait_readable(net_socket_t s, uint64_t ms)
+{
+    fd_set set;
+    struct timeval tv;
+
+    FD_ZERO(&set);
+    FD_SET(s, &set);
+    tv.tv_sec = (long)(ms / 1000);
+    tv.tv_usec = (long)(ms % 1000) * 1000;
+#ifdef _WIN32
+    return select(0, &set, NULL, NULL, &tv) > 0;
+#else
+    return select(s + 1, &set, NULL, NULL, &tv) > 0;
+#endif
+}
+
+static void set_client_timeouts(net_socket_t s)
+{
+#ifdef _WIN32
+    DWORD ms = TELEMETRY_CLIENT_MS;
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, (const char *)&ms, sizeof(ms));
+    setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, (const char *)&ms, sizeof(ms));
+#else
+    struct timeval tv = { TELEMETRY_CLIENT_MS / 1000, (TELEMETRY_CLIENT_MS % 1000) * 1000 };
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+#if defined(__APPLE__)
+    int one = 1;
+    setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+#endif
+}
+
+static bool send_all(net_socket_t s, const char *buf, size_t len)
+{
+    while (len > 0) {
+        int n = send(s, buf, (int)(len > (1 << 20) ? (1 << 20) : len), MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        buf += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+/*-----------------------------------------------------------------------------
+ * Rendering
+ *-----------------------------------------------------------------------------*/
+
+static void page_printf(page_t *p, const char *format, ...)
+{
+    va_list args;
+    int n;
+
+    va_start(args, format);
+    n = vsnprintf(p->data ? p->data + p->len : NULL, p->data ? p->size - p->len : 0, format, args);
+    va_end(args);
+    if (n < 0) return;
+    if (!p->data || p->len + (size_t)n >= p->size) {
+        size_t size = p->size ? p->size : 4096;
+        char *data;
+        while (p->len + (size_t)n >= size) size *= 2;
+        data = realloc(p->data, size);
+        if (!data) return;
+        p->data = data;
+        p->size = size;
+        va_start(args, format);
+        vsnprintf(p->data + p->len, p->size - p->len, format, args);
+        va_end(args);
+    }
+    p->len += (size_t)n;
+}
+
+static double finite_value(double v)
+{
+    return isfinite(v) ? v : 0.0;
+}
+
+static const char *type_name(telemetry_type_t type)
+{
+    return type == TELEMETRY_COUNTER ? "counter" : (type == TELEMETRY_HISTOGRAM) ? "histogram" : "gauge";
+}
+
+/* Text exposition format, one TYPE line in front of the first metric of each name */
+static void render_prometheus(page_t *p, const telemetry_snapshot_t *s)
+{
+    p->len = 0;
+    for (int i = 0; i < s->count; i++) {
+        const telemetry_metric_t *m = &s->metrics[i];
+        if (i == 0 || strcmp(m->name, s->metrics[i - 1].name) != 0)
+            page_printf(p, "# TYPE %s %s\n", m->name, type_name(m->type));
+        if (m->labels[0]) page_printf(p, "%s%s{%s} %.15g\n", m->name, m->suffix, m->labels, finite_value(m->value));
+        else page_printf(p, "%s%s %.15g\n", m->name, m->suffix, finite_value(m->value));
+    }
+}
+
+/* name="value",... becomes {"name":"value",...} */
+static void render_json_labels(page_t *p, const char *labels)
+{
+    bool key = true;
+
+    page_printf(p, "{");
+    if (labels[0]) page_printf(p, "\"");
+    for (const char *c = labels; *c; c++) {
+        if (key && *c == '=') {
+            page_printf(p, "\":");
+            key = false;
+        }
+        else if (!key && *c == ',' && c[-1] == '"') {
+            page_printf(p, ",\"");
+            key = true;
+        }
+        else page_printf(p, "%c", *c);
+    }
+    page_printf(p, "}");
+}
+
+static void render_json(page_t *p, const telemetry_snapshot_t *s, double interval)
+{
+    p->len = 0;
+    page_printf(p, "{\"timestamp\":%lld,\"interval\":%g,\"metrics\":[", (long long)time(NULL), interval);
+    for (int i = 0; i < s->count; i++) {
+        const telemetry_metric_t *m = &s->metrics[i];
+        page_printf(p, "%s\n{\"name\":\"%s%s\",\"type\":\"%s\",\"labels\":", i ? "," : "", m->name, m->suffix, type_name(m->type));
+        render_json_labels(p, m->labels);
+        page_printf(p, ",\"value\":%.15g}", finite_value(m->value));
+    }
+    page_printf(p, "\n]}\n");
+}
+
+static telemetry_metric_t *add_metric(telemetry_snapshot_t *s, const char *name, const char *suffix,
+                                      telemetry_type_t type, const char *labels, double value)
+{
+    telemetry_metric_t *m;
+
+    if (s->count >= TELEMETRY_MAX_METRICS) return NULL;
+    m = &s->metrics[s->count++];
+    snprintf(m->name, sizeof(m->name), "%s", name);
+    snprintf(m->labels, sizeof(m->labels), "%s", labels ? labels : "");
+    m->suffix = suffix;
+    m->type = type;
+    m->value = value;
+    return m;
+}
+
+void telemetry_add(telemetry_snapshot_t *s, const char *name, telemetry_type_t type, const char *labels, double value)
+{
+    add_metric(s, name, "", type, labels, value);
+}
+
+void telemetry_add_histogram(telemetry_snapshot_t *s, const char *name, const char *labels,
+                             const double *bounds, const uint64_t *counts, int buckets, double sum)
+{
+    char le[TELEMETRY_LABELS_LEN];
+    const char *sep = (labels && labels[0]) ? "," : "";
+    uint64_t total = 0;
+
+    if (!labels) labels = "";
+    for (int i = 0; i < buckets; i++) {
+        total += counts[i];
+        if (isinf(bounds[i])) snprintf(le, sizeof(le), "%s%sle=\"+Inf\"", labels, sep);
+        else snprintf(le, sizeof(le), "%s%sle=\"%g\"", labels, sep, bounds[i]);
+        add_metric(s, name, "_bucket", TELEMETRY_HISTOGRAM, le, (double)total);
+    }
+    /* Prometheus wants the +Inf bucket in any case */
+    if (buckets == 0 || !isinf(bounds[buckets - 1])) {
+        snprintf(le, sizeof(le), "%s%sle=\"+Inf\"", labels, sep);
+        add_metric(s, name, "_bucket", TELEMETRY_HISTOGRAM, le, (double)total);
+    }
+    add_metric(s, name, "_sum", TELEMETRY_HISTOGRAM, labels, sum);
+    add_metric(s, name, "_count", TELEMETRY_HISTOGRAM, labels, (double)total);
+}
+
+/*-----------------------------------------------------------------------------
+ * Serving
+ *-----------------------------------------------------------------------------*/
+
+static void respond(net_socket_t c, const char *status, const char *type, const page_t *body)
+{
+    char header[256];
+    const char *data = body && body->data ? body->data : "";
+    size_t len = body && body->data ? body->len : 0;
+    int n = snprintf(header, sizeof(header),
+                     "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+                     status, type, len);
+    if (send_all(c, header, (size_t)n)) send_all(c, data, len);
+}
+
+/* One request per connection, answered from the last snapshot */
+static void telemetry_serve(telemetry_t *t)
+{
+    char req[TELEMETRY_REQUEST_SIZE];
+    size_t len = 0, path_len;
+    const char *path;
+    net_socket_t c = accept(t->sock, NULL, NULL);
+
+    if (c == NET_INVALID_SOCKET) return;
+    set_client_timeouts(c);
+    while (len < sizeof(req) - 1) {
+        int n = recv(c, req + len, (int)(sizeof(req) - 1 - len), 0);
+        if (n <= 0) break;
+        len += (size_t)n;
+        req[len] = 0;
+        if (strstr(req, "\r\n\r\n") || strstr(req, "\n\n")) break;
+    }
+    req[len] = 0;
+
+    if (strncmp(req, "GET ", 4) != 0) {
+        respond(c, "405 Method Not Allowed", "text/plain", NULL);
+    }
+    else {
+        path = req + 4;
+        path_len = strcspn(path, " ?\r\n");
+        if ((path_len == 8 && strncmp(path, "/metrics", 8) == 0) || (path_len == 1 && path[0] == '/'))
+            respond(c, "200 OK", "text/plain; version=0.0.4", &t->prom);
+        else if (path_len == 5 && strncmp(path, "/json", 5) == 0)
+            respond(c, "200 OK", "application/json", &t->json);
+        else
+            respond(c, "404 Not Found", "text/plain", NULL);
+    }
+    net_close_socket(c);
+}
+
+static void telemetry_snapshot(telemetry_t *t, double elapsed)
+{
+    t->snap.count = 0;
+    t->cb(t->user, &t->snap, elapsed);
+    render_prometheus(&t->prom, &t->snap);
+    render_json(&t->json, &t->snap, (double)t->interval_ms / 1000.0);
+}
+
+static int telemetry_thread(void *ctx)
+{
+    telemetry_t *t = ctx;
+    uint64_t last = 0, next = get_time_ms();
+
+    while (!atomic_load(&t->stop)) {
+        uint64_t now = get_time_ms(), wait;
+        if (now >= next) {
+            telemetry_snapshot(t, last ? (double)(now - last) / 1000.0 : 0.0);
+            last = now;
+            next += t->interval_ms;
+            if (next <= now) next = now + t->interval_ms;
+        }
+        wait = next - now;
+        if (wait > TELEMETRY_POLL_MS) wait = TELEMETRY_POLL_MS;
+        if (wait_readable(t->sock, wait)) telemetry_serve(t);
+    }
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Public API
+ *-----------------------------------------------------------------------------*/
+
+telemetry_t *telemetry_start(const char *address, double interval, telemetry_collect_cb cb, void *user)
+{
+    telemetry_t *t = calloc(1, sizeof(telemetry_t));
+    if (!t) return NULL;
+
+    if (interval < TELEMETRY_MIN_INTERVAL) interval = TELEMETRY_MIN_INTERVAL;
+    t->interval_ms = (uint64_t)(interval * 1000.0 + 0.5);
+    t->cb = cb;
+    t->user = user;
+    atomic_init(&t->stop, 0);
+    t->sock = telemetry_listen(address);
+    if (t->sock == NET_INVALID_SOCKET) {
+        free(t);
+        return NULL;
+    }
+    if (thrd_create(&t->thread, &telemetry_thread, t) != thrd_success) {
+        fprintf(stderr, "Telemetry: failed to start the thread\n");
+        net_close_socket(t->sock);
+        free(t);
+        return NULL;
+    }
+    fprintf(stderr, "Telemetry: serving /metrics and /json on %s every %.1f s\n", address, (double)t->interval_ms / 1000.0);
+    return t;
+}
+
+void telemetry_stop(telemetry_t *t)
+{
+    if (!t) return;
+    atomic_store(&t->stop, 1);
+    thrd_join(t->thread, NULL);
+    net_close_socket(t->sock);
+    free(t->prom.data);
+    free(t->json.data);
+    free(t);
+}
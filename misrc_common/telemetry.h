@@ -0,0 +1,101 @@
+/*
+ * MISRC Common - Live Telemetry
+ *
+ * Serves the counters of a running capture over HTTP, for Prometheus
+ * (GET /metrics, text exposition format) and for anything that reads JSON
+ * (GET /json, one object with all metrics).
+ *
+ * A background thread takes a snapshot every interval through the collect
+ * callback and answers requests from the last snapshot, so a scrape never
+ * reaches into the capture. The callback only reads counters the capture
+ * threads keep in atomics anyway (ringbuffer positions and stalls, frame
+ * and sample counts). Each of those counters has a single writer, which
+ * adds with telemetry_count(), a relaxed load and store without a locked
+ * read-modify-write.
+ *
+ * Addresses are [host:]port, the port alone listens on TELEMETRY_DEFAULT_HOST
+ * only, "*:port" on all interfaces.
+ */
+
+#ifndef MISRC_TELEMETRY_H
+#define MISRC_TELEMETRY_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define TELEMETRY_DEFAULT_HOST      "127.0.0.1"
+#define TELEMETRY_DEFAULT_INTERVAL  1.0     /* Seconds between snapshots */
+#define TELEMETRY_MIN_INTERVAL      0.1
+#define TELEMETRY_MAX_METRICS       1024    /* Per snapshot, more are left out */
+#define TELEMETRY_NAME_LEN          64
+#define TELEMETRY_LABELS_LEN        96
+
+typedef enum {
+    TELEMETRY_COUNTER = 0,      /* Only ever grows */
+    TELEMETRY_GAUGE,            /* Current value, a fill, a ratio or a rate */
+    TELEMETRY_HISTOGRAM,        /* Buckets, sum and count, see telemetry_add_histogram() */
+} telemetry_type_t;
+
+typedef struct telemetry telemetry_t;
+typedef struct telemetry_snapshot telemetry_snapshot_t;
+
+/* Fill a snapshot with telemetry_add(), called from the telemetry thread
+ *
+ * @param user          User pointer of telemetry_start()
+ * @param s             Snapshot to fill
+ * @param elapsed       Seconds since the previous snapshot, 0 for the first, for rates
+ */
+typedef void (*telemetry_collect_cb)(void *user, telemetry_snapshot_t *s, double elapsed);
+
+/* Add to a counter that only this thread writes */
+static inline void telemetry_count(atomic_uint_fast64_t *c, uint64_t n)
+{
+    atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+/* Read a counter from any thread */
+static inline uint64_t telemetry_read(atomic_uint_fast64_t *c)
+{
+    return atomic_load_explicit(c, memory_order_relaxed);
+}
+
+/* Start serving on a local port
+ *
+ * @param address       [host:]port
+ * @param interval      Seconds between snapshots, at least TELEMETRY_MIN_INTERVAL
+ * @param cb            Fills the snapshots
+ * @param user          Passed to cb
+ * @return Telemetry state, or NULL if the address is malformed or cannot be bound
+ */
+telemetry_t *telemetry_start(const char *address, double interval, telemetry_collect_cb cb, void *user);
+
+/* Add one metric to a snapshot
+ *
+ * @param s             Snapshot, from the collect callback
+ * @param name          Metric name, metrics of one name should be added one after the other
+ * @param type          Counter or gauge
+ * @param labels        Prometheus labels without the braces, e.g. device="0",adc="A", or NULL
+ * @param value         Value
+ */
+void telemetry_add(telemetry_snapshot_t *s, const char *name, telemetry_type_t type, const char *labels, double value);
+
+/* Add a histogram to a snapshot, as name_bucket{le="..."}, name_sum and name_count
+ *
+ * @param s             Snapshot, from the collect callback
+ * @param name          Metric name, histograms of one name should be added one after the other
+ * @param labels        Prometheus labels without the braces, or NULL
+ * @param bounds        Upper bound of every bucket, ascending, the last one may be INFINITY
+ * @param counts        Observations in every bucket (not cumulative)
+ * @param buckets       Number of buckets
+ * @param sum           Sum of all observations
+ */
+void telemetry_add_histogram(telemetry_snapshot_t *s, const char *name, const char *labels,
+                             const double *bounds, const uint64_t *counts, int buckets, double sum);
+
+/* Stop the thread and close the port
+ *
+ * @param t             Telemetry state, NULL is ignored
+ */
+void telemetry_stop(telemetry_t *t);
+
+#endif /* MISRC_TELEMETRY_H */
@@ -0,0 +1,342 @@
+/*
+ * MISRC Common - CPU Affinity and Priority of the Pipeline Threads
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE  // pthread_setaffinity_np(), CPU_SET()
+#endif
+
+#include "thread_role.h"
+#include "trace.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <errno.h>
+#endif
+
+#define THREAD_ROLE_MAX_CPUS 1024
+#define THREAD_ROLE_MAX_NODES 64
+
+typedef struct {
+    bool pinned;
+    uint64_t cpus[THREAD_ROLE_MAX_CPUS / 64];
+} role_settings_t;
+
+static const char *s_role_names[THREAD_ROLE_COUNT] = {
+    [THREAD_ROLE_USB]      = "usb",
+    [THREAD_ROLE_PARSER]   = "parser",
+    [THREAD_ROLE_EXTRACT]  = "extract",
+    [THREAD_ROLE_WRITER_A] = "writer-a",
+    [THREAD_ROLE_WRITER_B] = "writer-b",
+    [THREAD_ROLE_FLAC]     = "flac",
+    [THREAD_ROLE_RENDER]   = "render",
+    [THREAD_ROLE_DISPLAY]  = "display",
+};
+
+static role_settings_t s_roles[THREAD_ROLE_COUNT];
+static bool s_any_pinned = false;
+static bool s_realtime = false;
+static int s_numa_node = -1;
+static uint64_t s_node_cpus[THREAD_ROLE_MAX_CPUS / 64];
+enum { SETTING_AFFINITY, SETTING_PRIORITY, SETTING_COUNT };
+
+static atomic_bool s_reported[THREAD_ROLE_COUNT][SETTING_COUNT];
+static _Thread_local bool s_applied = false;
+
+static bool role_is_realtime(thread_role_t role) {
+    return s_realtime && (role == THREAD_ROLE_USB || role == THREAD_ROLE_PARSER || role == THREAD_ROLE_EXTRACT);
+}
+
+// first failure of a role only, the threads of a role fail alike
+static void report_failure(thread_role_t role, int setting, int err) {
+    if (atomic_exchange(&s_reported[role][setting], true)) return;
+    fprintf(stderr, "Could not set the %s of the %s thread (error %d), continuing without\n",
+            setting == SETTING_AFFINITY ? "CPU affinity" : "real-time priority", s_role_names[role], err);
+}
+
+//-----------------------------------------------------------------------------
+// Option parsing
+//-----------------------------------------------------------------------------
+
+static int parse_cpu_list(const char *list, uint64_t *cpus) {
+    const char *p = list;
+    bool any = false;
+
+    memset(cpus, 0, THREAD_ROLE_MAX_CPUS / 8);
+    while (*p) {
+        char *end;
+        unsigned long first = strtoul(p, &end, 10);
+        unsigned long last = first;
+        if (end == p) return -1;
+        p = end;
+        if (*p == '-') {
+            p++;
+            last = strtoul(p, &end, 10);
+            if (end == p) return -1;
+            p = end;
+        }
+        if (first > last || last >= THREAD_ROLE_MAX_CPUS) return -1;
+        for (unsigned long c = first; c <= last; c++) {
+            cpus[c / 64] |= (uint64_t)1 << (c % 64);
+        }
+        any = true;
+        if (*p == ',') {
+            p++;
+        } else if (*p) {
+            return -1;
+        }
+    }
+    return any ? 0 : -1;
+}
+
+int thread_role_parse_affinity(const char *arg) {
+    const char *colon = arg ? strchr(arg, ':') : NULL;
+    if (!colon) return -1;
+
+    size_t len = (size_t)(colon - arg);
+    for (int r = 0; r < THREAD_ROLE_COUNT; r++) {
+        if (strlen(s_role_names[r]) == len && strncmp(arg, s_role_names[r], len) == 0) {
+            if (parse_cpu_list(colon + 1, s_roles[r].cpus) != 0) return -1;
+            s_roles[r].pinned = true;
+            s_any_pinned = true;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void thread_role_set_realtime(bool enable) {
+    s_realtime = enable;
+}
+
+//-----------------------------------------------------------------------------
+// NUMA nodes
+//-----------------------------------------------------------------------------
+
+// CPUs and memory of a node, -1 if there is no such node
+#if defined(_WIN32)
+
+static int node_info(int node, uint64_t *cpus, uint64_t *mem_kb) {
+    ULONG highest;
+    GROUP_AFFINITY affinity;
+    ULONGLONG available;
+
+    if (!GetNumaHighestNodeNumber(&highest) || (ULONG)node > highest) return -1;
+    if (!GetNumaNodeProcessorMaskEx((USHORT)node, &affinity)) return -1;
+    memset(cpus, 0, THREAD_ROLE_MAX_CPUS / 8);
+    // Like the affinity masks, processor group 0 only
+    if (affinity.Group == 0) cpus[0] = (uint64_t)affinity.Mask;
+    // Windows only tells the free memory of a node
+    *mem_kb = GetNumaAvailableMemoryNodeEx((USHORT)node, &available) ? available / 1024 : 0;
+    return 0;
+}
+
+#elif defined(__linux__)
+
+static int node_info(int node, uint64_t *cpus, uint64_t *mem_kb) {
+    char path[64], line[4096];
+    FILE *f;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    if (!(f = fopen(path, "r"))) return -1;
+    bool ok = fgets(line, sizeof(line), f) != NULL;
+    fclose(f);
+    if (!ok) return -1;
+    line[strcspn(line, "\n")] = '\0';
+    // Memory-only nodes have an empty list
+    if (line[0] == '\0') {
+        memset(cpus, 0, THREAD_ROLE_MAX_CPUS / 8);
+    } else if (parse_cpu_list(line, cpus) != 0) {
+        return -1;
+    }
+
+    *mem_kb = 0;
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/meminfo", node);
+    if ((f = fopen(path, "r"))) {
+        while (fgets(line, sizeof(line), f)) {
+            char *total = strstr(line, "MemTotal:");
+            if (total) {
+                *mem_kb = strtoull(total + 9, NULL, 10);
+                break;
+            }
+        }
+        fclose(f);
+    }
+    return 0;
+}
+
+#else
+
+static int node_info(int node, uint64_t *cpus, uint64_t *mem_kb) {
+    (void)node; (void)cpus; (void)mem_kb;
+    return -1;
+}
+
+#endif
+
+static bool cpu_in_set(const uint64_t *cpus, int c) {
+    return (cpus[c / 64] & ((uint64_t)1 << (c % 64))) != 0;
+}
+
+// "0-7,16-23", cut short if it does not fit
+static void format_cpu_list(const uint64_t *cpus, char *buf, size_t len) {
+    size_t n = 0;
+    buf[0] = '\0';
+    for (int c = 0; c < THREAD_ROLE_MAX_CPUS; c++) {
+        if (!cpu_in_set(cpus, c)) continue;
+        int last = c;
+        while (last + 1 < THREAD_ROLE_MAX_CPUS && cpu_in_set(cpus, last + 1)) last++;
+        int w = (last > c) ? snprintf(buf + n, len - n, "%s%d-%d", n ? "," : "", c, last)
+                           : snprintf(buf + n, len - n, "%s%d", n ? "," : "", c);
+        if (w < 0 || (size_t)w >= len - n) break;
+        n += (size_t)w;
+        c = last;
+    }
+}
+
+int thread_role_set_numa_node(int node) {
+    uint64_t mem_kb;
+    bool any = false;
+
+    if (node < 0 || node >= THREAD_ROLE_MAX_NODES || node_info(node, s_node_cpus, &mem_kb) != 0) return -1;
+    for (int i = 0; i < THREAD_ROLE_MAX_CPUS / 64; i++) {
+        if (s_node_cpus[i]) any = true;
+    }
+    if (!any) return -1;
+    s_numa_node = node;
+    return 0;
+}
+
+void thread_role_report_topology(void) {
+    uint64_t cpus[THREAD_ROLE_MAX_CPUS / 64];
+    uint64_t mem_kb;
+    char list[256];
+    int nodes = 0;
+
+    for (int n = 0; n < THREAD_ROLE_MAX_NODES; n++) {
+        if (node_info(n, cpus, &mem_kb) == 0) nodes++;
+    }
+    if (nodes < 2 && s_numa_node < 0) return;
+
+    fprintf(stderr, "NUMA topology: %d node%s\n", nodes, nodes == 1 ? "" : "s");
+    for (int n = 0; n < THREAD_ROLE_MAX_NODES; n++) {
+        if (node_info(n, cpus, &mem_kb) != 0) continue;
+        format_cpu_list(cpus, list, sizeof(list));
+        fprintf(stderr, "  node %d: CPUs %s, %llu MB%s\n", n, list[0] ? list : "none",
+                (unsigned long long)(mem_kb / 1024), n == s_numa_node ? " (capture)" : "");
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Applying
+//-----------------------------------------------------------------------------
+
+// New threads inherit affinity (and on POSIX the scheduling) of the thread that
+// creates them, so roles without settings are reset to the defaults once any
+// role has some. cpus is NULL for all CPUs the process may use.
+#ifdef _WIN32
+
+typedef HANDLE (WINAPI *av_set_mm_thread_characteristics_t)(LPCWSTR task, LPDWORD index);
+
+static void apply_affinity(thread_role_t role, const uint64_t *cpus) {
+    DWORD_PTR mask, system_mask;
+    // Without processor groups a thread runs on CPUs 0-63 only
+    if (cpus) {
+        mask = (DWORD_PTR)cpus[0];
+    } else if (!GetProcessAffinityMask(GetCurrentProcess(), &mask, &system_mask)) {
+        return;
+    }
+    if (mask == 0 || SetThreadAffinityMask(GetCurrentThread(), mask) == 0) {
+        report_failure(role, SETTING_AFFINITY, (int)GetLastError());
+    }
+}
+
+static void apply_priority(thread_role_t role, bool realtime) {
+    static av_set_mm_thread_characteristics_t set_task = NULL;
+    static atomic_bool looked_up = false;
+
+    // Windows threads start at the normal priority anyway
+    if (!realtime) return;
+
+    // avrt.dll is loaded on demand, it is not needed without real-time priority
+    if (!atomic_load(&looked_up)) {
+        HMODULE avrt = LoadLibraryW(L"avrt.dll");
+        if (avrt) {
+            set_task = (av_set_mm_thread_characteristics_t)(void (*)(void))
+                GetProcAddress(avrt, "AvSetMmThreadCharacteristicsW");
+        }
+        atomic_store(&looked_up, true);
+    }
+
+    DWORD task_index = 0;
+    if (set_task && set_task(L"Pro Audio", &task_index)) return;
+    // No MMCSS: the highest priority of the normal class
+    if (!SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL)) {
+        report_failure(role, SETTING_PRIORITY, (int)GetLastError());
+    }
+}
+
+#else
+
+static void apply_affinity(thread_role_t role, const uint64_t *cpus) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int c = 0; c < THREAD_ROLE_MAX_CPUS && c < CPU_SETSIZE; c++) {
+        // the kernel limits the set to the CPUs the process may use
+        if (!cpus || cpu_in_set(cpus, c)) CPU_SET(c, &set);
+    }
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err != 0) report_failure(role, SETTING_AFFINITY, err);
+#else
+    // macOS and the BSDs only have affinity hints or other interfaces
+    if (cpus) report_failure(role, SETTING_AFFINITY, ENOTSUP);
+#endif
+}
+
+static void apply_priority(thread_role_t role, bool realtime) {
+    struct sched_param param = { .sched_priority = 0 };
+    int policy = SCHED_OTHER;
+
+    if (realtime) {
+        int min = sched_get_priority_min(SCHED_FIFO);
+        int max = sched_get_priority_max(SCHED_FIFO);
+        // Midrange, the USB callback above the extraction it feeds
+        policy = SCHED_FIFO;
+        param.sched_priority = (min + max) / 2;
+        if (role != THREAD_ROLE_USB) param.sched_priority--;
+    }
+
+    int err = pthread_setschedparam(pthread_self(), policy, &param);
+    if (err != 0) report_failure(role, SETTING_PRIORITY, err);
+}
+
+#endif
+
+void thread_role_apply(thread_role_t role) {
+    if (s_applied || (int)role < 0 || role >= THREAD_ROLE_COUNT) return;
+    s_applied = true;
+    trace_thread_name(s_role_names[role]);
+
+    if (s_roles[role].pinned) {
+        apply_affinity(role, s_roles[role].cpus);
+    } else if (s_numa_node >= 0) {
+        apply_affinity(role, s_node_cpus);
+    } else if (s_any_pinned) {
+        apply_affinity(role, NULL);
+    }
+    if (role_is_realtime(role)) {
+        apply_priority(role, true);
+    } else if (s_realtime) {
+        apply_priority(role, false);
+    }
+}
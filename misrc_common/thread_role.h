@@ -0,0 +1,67 @@
+/*
+ * MISRC Common - CPU Affinity and Priority of the Pipeline Threads
+ *
+ * Every pipeline thread calls thread_role_apply() with its role when it
+ * starts (the USB callback on its first call, it runs on a library thread).
+ * Roles can be pinned to CPU sets, and the latency-critical USB, frame
+ * parser and extraction threads can request real-time scheduling: SCHED_FIFO on POSIX,
+ * the MMCSS "Pro Audio" task on Windows. Writers and encoders always keep
+ * the normal priority, so a slow disk or a high FLAC level cannot starve
+ * the capture. As new threads inherit both from their creator, roles without
+ * settings are reset to all CPUs and the normal priority.
+ *
+ * On multi-socket machines thread_role_set_numa_node() keeps all roles
+ * without their own CPU set on the CPUs of one node. Together with
+ * rb_set_numa_node() for the ringbuffers, and the MISRC attached to a USB
+ * controller of that socket, no sample crosses the interconnect, so one
+ * capture per node can run side by side.
+ *
+ * Settings are made while parsing options, before any thread is started.
+ * Failures (e.g. missing CAP_SYS_NICE) are reported once per role and the
+ * thread continues with the normal settings.
+ */
+
+#ifndef MISRC_THREAD_ROLE_H
+#define MISRC_THREAD_ROLE_H
+
+#include <stdbool.h>
+
+typedef enum {
+    THREAD_ROLE_USB,        /* Capture callback (hsdaoh / libusb thread) */
+    THREAD_ROLE_PARSER,     /* Frame parser behind the capture callback */
+    THREAD_ROLE_EXTRACT,    /* Sample extraction */
+    THREAD_ROLE_WRITER_A,   /* Channel A writer */
+    THREAD_ROLE_WRITER_B,   /* Channel B writer */
+    THREAD_ROLE_FLAC,       /* Block-parallel FLAC encoder workers */
+    THREAD_ROLE_RENDER,     /* GUI render thread */
+    THREAD_ROLE_DISPLAY,    /* GUI display thread: oscilloscope, FFT and histogram feed */
+    THREAD_ROLE_COUNT
+} thread_role_t;
+
+/* Role names accepted by thread_role_parse_affinity(), for usage texts */
+#define THREAD_ROLE_NAMES "usb, parser, extract, writer-a, writer-b, flac, render, display"
+
+/* Parse "ROLE:CPUS" and pin the role to the CPUs, e.g. "usb:2" or "flac:4-7,12"
+ * @return 0 on success, -1 if the role or CPU list is invalid
+ */
+int thread_role_parse_affinity(const char *arg);
+
+/* Request real-time priority for the USB, frame parser and extraction threads */
+void thread_role_set_realtime(bool enable);
+
+/* Keep all roles without their own CPU set on the CPUs of a NUMA node
+ * @return 0 on success, -1 if the node does not exist or has no usable CPUs
+ */
+int thread_role_set_numa_node(int node);
+
+/* Print the NUMA nodes with their CPUs and memory to stderr, only on machines
+ * with more than one node or if a node was chosen
+ */
+void thread_role_report_topology(void);
+
+/* Apply the settings of a role to the calling thread, only the first call
+ * per thread has an effect
+ */
+void thread_role_apply(thread_role_t role);
+
+#endif /* MISRC_THREAD_ROLE_H */
@@ -60,6 +60,44 @@
     return (uint64_t)GetTickCount();
   }
 
+  /* Get monotonic time in nanoseconds (for timestamps) */
+  static inline uint64_t get_time_ns(void) {
+    extern __declspec(dllimport) int __stdcall QueryPerformanceCounter(long long*);
+    extern __declspec(dllimport) int __stdcall QueryPerformanceFrequency(long long*);
+    long long c, f;
+    QueryPerformanceCounter(&c);
+    QueryPerformanceFrequency(&f);
+    return (uint64_t)(c / f) * 1000000000ull + (uint64_t)(c % f) * 1000000000ull / (uint64_t)f;
+  }
+
+  /* CPU time (user + system) of the calling thread / the whole process in
+   * nanoseconds, FILETIMEs are read as 64-bit counts of 100 ns */
+  struct _FILETIME;
+  static inline uint64_t get_thread_cpu_ns(void) {
+    extern __declspec(dllimport) void* __stdcall GetCurrentThread(void);
+    extern __declspec(dllimport) int __stdcall GetThreadTimes(void*, struct _FILETIME*, struct _FILETIME*, struct _FILETIME*, struct _FILETIME*);
+    unsigned long long t[4];  /* creation, exit, kernel, user */
+    if (!GetThreadTimes(GetCurrentThread(), (struct _FILETIME*)&t[0], (struct _FILETIME*)&t[1],
+                        (struct _FILETIME*)&t[2], (struct _FILETIME*)&t[3])) return 0;
+    return (t[2] + t[3]) * 100;
+  }
+
+  static inline uint64_t get_process_cpu_ns(void) {
+    extern __declspec(dllimport) void* __stdcall GetCurrentProcess(void);
+    extern __declspec(dllimport) int __stdcall GetProcessTimes(void*, struct _FILETIME*, struct _FILETIME*, struct _FILETIME*, struct _FILETIME*);
+    unsigned long long t[4];
+    if (!GetProcessTimes(GetCurrentProcess(), (struct _FILETIME*)&t[0], (struct _FILETIME*)&t[1],
+                         (struct _FILETIME*)&t[2], (struct _FILETIME*)&t[3])) return 0;
+    return (t[2] + t[3]) * 100;
+  }
+
+  /* Number of logical processors (all processor groups) */
+  static inline unsigned get_cpu_count(void) {
+    extern __declspec(dllimport) unsigned long __stdcall GetActiveProcessorCount(unsigned short);
+    unsigned long n = GetActiveProcessorCount(0xffff);  /* ALL_PROCESSOR_GROUPS */
+    return n > 0 ? (unsigned)n : 1;
+  }
+
 #else
   /* POSIX implementation */
   #include <pthread.h>
@@ -90,6 +128,32 @@
     return (uint64_t)(tv.tv_sec * 1000 + tv.tv_usec / 1000);
   }
 
+  /* Get monotonic time in nanoseconds (for timestamps) */
+  static inline uint64_t get_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+  }
+
+  /* CPU time (user + system) of the calling thread / the whole process in nanoseconds */
+  static inline uint64_t get_thread_cpu_ns(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) return 0;
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+  }
+
+  static inline uint64_t get_process_cpu_ns(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) != 0) return 0;
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+  }
+
+  /* Number of online logical processors */
+  static inline unsigned get_cpu_count(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (unsigned)n : 1;
+  }
+
 #endif
 
 #endif /* MISRC_THREADING_H */
@@ -0,0 +1,174 @@
+/*
+ * MISRC Common - Hot Path Tracing Implementation
+ */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L  // nanosleep() in threading.h with -std=c11
+#endif
+
+#include "trace.h"
+
+#if TRACE_ENABLED == 1
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "threading.h"
+
+/* How often the dump thread looks for requests */
+#define TRACE_POLL_MS   100
+
+typedef struct {
+    uint64_t ts;                /* get_time_ns() */
+    const char *name;
+    char phase;
+} trace_event_t;
+
+typedef struct trace_buf {
+    struct trace_buf *next;     /* Registered buffers, newest first */
+    unsigned tid;
+    _Atomic(const char *) name; /* Thread name, NULL if never named */
+    atomic_uint_fast64_t count; /* Events recorded, the slot is count % TRACE_BUFFER_EVENTS */
+    trace_event_t events[TRACE_BUFFER_EVENTS];
+} trace_buf_t;
+
+static _Atomic(trace_buf_t *) s_buffers = NULL;
+static atomic_uint s_next_tid = 1;
+static atomic_uint_fast64_t s_origin = 0;
+static _Thread_local trace_buf_t *s_buf = NULL;
+
+static const char *s_path = NULL;
+static thrd_t s_thread;
+static bool s_started = false;
+static atomic_int s_requests = 0;
+static atomic_int s_stop = 0;
+
+/*-----------------------------------------------------------------------------
+ * Recording
+ *-----------------------------------------------------------------------------*/
+
+/* First event of a thread, the buffer is pushed onto the list without a lock */
+static trace_buf_t *trace_register(void)
+{
+    trace_buf_t *b = calloc(1, sizeof(trace_buf_t));
+    uint_fast64_t zero = 0;
+
+    if (!b) return NULL;
+    b->tid = atomic_fetch_add(&s_next_tid, 1);
+    atomic_compare_exchange_strong(&s_origin, &zero, get_time_ns());
+    b->next = atomic_load(&s_buffers);
+    while (!atomic_compare_exchange_weak(&s_buffers, &b->next, b)) {}
+    s_buf = b;
+    return b;
+}
+
+void trace_event(const char *name, char phase)
+{
+    trace_buf_t *b = s_buf ? s_buf : trace_register();
+    uint64_t n;
+    trace_event_t *e;
+
+    if (!b) return;
+    n = atomic_load_explicit(&b->count, memory_order_relaxed);
+    e = &b->events[n & (TRACE_BUFFER_EVENTS - 1)];
+    e->ts = get_time_ns();
+    e->name = name;
+    e->phase = phase;
+    atomic_store_explicit(&b->count, n + 1, memory_order_release);
+}
+
+void trace_thread_name(const char *name)
+{
+    trace_buf_t *b = s_buf ? s_buf : trace_register();
+    if (b) atomic_store(&b->name, name);
+}
+
+/*-----------------------------------------------------------------------------
+ * Writing
+ *-----------------------------------------------------------------------------*/
+
+int trace_dump(const char *path)
+{
+    FILE *f = fopen(path, "w");
+    uint64_t origin = atomic_load(&s_origin), written = 0;
+    bool first = true;
+
+    if (!f) {
+        fprintf(stderr, "Trace: cannot write %s\n", path);
+        return -1;
+    }
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    for (trace_buf_t *b = atomic_load(&s_buffers); b; b = b->next) {
+        const char *name = atomic_load(&b->name);
+        uint64_t end = atomic_load_explicit(&b->count, memory_order_acquire);
+        uint64_t start = end > TRACE_BUFFER_EVENTS ? end - TRACE_BUFFER_EVENTS : 0;
+
+        fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s%s%u\"}}",
+                first ? "" : ",", b->tid, name ? name : "thread", name ? "-" : " ", b->tid);
+        first = false;
+        for (uint64_t i = start; i < end; i++) {
+            trace_event_t e = b->events[i & (TRACE_BUFFER_EVENTS - 1)];
+            // the thread may have lapped this slot while it was copied
+            if (atomic_load_explicit(&b->count, memory_order_acquire) - i > TRACE_BUFFER_EVENTS) continue;
+            fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u%s}",
+                    e.name, e.phase, (double)(e.ts - origin) / 1000.0, b->tid, e.phase == 'i' ? ",\"s\":\"t\"" : "");
+            written++;
+        }
+    }
+    fprintf(f, "\n]}\n");
+    if (fclose(f) != 0) {
+        fprintf(stderr, "Trace: failed writing %s\n", path);
+        return -1;
+    }
+    fprintf(stderr, "Trace: %llu events written to %s\n", (unsigned long long)written, path);
+    return 0;
+}
+
+/* Requested dumps are written here, away from the threads being traced */
+static int trace_thread(void *ctx)
+{
+    unsigned n = 0;
+    (void)ctx;
+
+    trace_thread_name("trace");
+    while (!atomic_load(&s_stop)) {
+        if (atomic_exchange(&s_requests, 0) > 0) {
+            char path[4096];
+            snprintf(path, sizeof(path), "%s.%u", s_path, ++n);
+            trace_dump(path);
+        }
+        thrd_sleep_ms(TRACE_POLL_MS);
+    }
+    return 0;
+}
+
+int trace_start(const char *path)
+{
+    s_path = path;
+    if (thrd_create(&s_thread, &trace_thread, NULL) != thrd_success) {
+        fprintf(stderr, "Trace: failed to start the dump thread\n");
+        return -1;
+    }
+    s_started = true;
+    return 0;
+}
+
+void trace_request_dump(void)
+{
+    atomic_fetch_add(&s_requests, 1);
+}
+
+void trace_stop(void)
+{
+    if (!s_started) return;
+    atomic_store(&s_stop, 1);
+    thrd_join(s_thread, NULL);
+    s_started = false;
+    trace_dump(s_path);
+}
+
+#endif
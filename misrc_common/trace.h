@@ -0,0 +1,83 @@
+/*
+ * MISRC Common - Hot Path Tracing
+ *
+ * A timeline of the capture chain for finding what stalled when a frame was
+ * missed: the USB callback, frame processing, ringbuffer waits, extraction
+ * blocks, resampling, FLAC encoding and file writes record begin and end
+ * events, written out as Chrome trace JSON (chrome://tracing, Perfetto).
+ *
+ * Only built with TRACE_ENABLED=1 (meson -Dtrace=true), otherwise the
+ * macros are empty and nothing of it is compiled in.
+ *
+ * Every thread records into a buffer of its own, registered on its first
+ * event and kept until the process ends, so recording takes no lock and
+ * costs a clock read and a store. A buffer holds the last
+ * TRACE_BUFFER_EVENTS events of its thread, older ones are overwritten.
+ *
+ * Event names must be string literals, only the pointer is kept.
+ */
+
+#ifndef MISRC_TRACE_H
+#define MISRC_TRACE_H
+
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 0
+#endif
+
+#define TRACE_BUFFER_EVENTS     (1 << 16)   /* Per thread, a power of two */
+
+#if TRACE_ENABLED == 1
+
+#define TRACE_BEGIN(name)       trace_event(name, 'B')
+#define TRACE_END(name)         trace_event(name, 'E')
+#define TRACE_INSTANT(name)     trace_event(name, 'i')
+
+/* Record an event on the calling thread
+ *
+ * @param name          String literal
+ * @param phase         'B' begin, 'E' end, 'i' instant
+ */
+void trace_event(const char *name, char phase);
+
+/* Name the calling thread in the trace
+ *
+ * @param name          String literal
+ */
+void trace_thread_name(const char *name);
+
+/* Start the thread that writes the trace when asked to
+ *
+ * @param path          Trace file, written on trace_stop(), requested
+ *                      dumps go to path.1, path.2, ...
+ * @return 0 on success, -1 if the thread cannot be started
+ */
+int trace_start(const char *path);
+
+/* Ask for a dump, safe to call from a signal handler */
+void trace_request_dump(void);
+
+/* Write the final trace and stop the thread, nothing if not started */
+void trace_stop(void);
+
+/* Write the events recorded so far
+ *
+ * Threads go on recording meanwhile, events they overwrite during the
+ * dump are left out.
+ *
+ * @param path          Trace file
+ * @return 0 on success, -1 if the file cannot be written
+ */
+int trace_dump(const char *path);
+
+#else
+
+#define TRACE_BEGIN(name)       ((void)0)
+#define TRACE_END(name)         ((void)0)
+#define TRACE_INSTANT(name)     ((void)0)
+#define trace_thread_name(name) ((void)0)
+#define trace_request_dump()    ((void)0)
+#define trace_stop()            ((void)0)
+
+#endif
+
+#endif /* MISRC_TRACE_H */
@@ -5,6 +5,10 @@
 #include <stdbool.h>
 #include <stdatomic.h>
 #include "raylib.h"
+#include "../misrc_common/overload_policy.h"
+#include "../misrc_common/buffer_sizing.h"
+#include "../misrc_common/record_trigger.h"
+#include "gui_triple.h"
 
 // Forward declarations
 typedef struct hsdaoh_dev hsdaoh_dev_t;
@@ -20,8 +24,10 @@ typedef enum {
     PANEL_VIEW_WAVEFORM_LINE,      // Simple line oscilloscope (fast)
     PANEL_VIEW_WAVEFORM_PHOSPHOR,  // Digital phosphor with persistence
     PANEL_VIEW_FFT,                // FFT spectrum analysis
+    PANEL_VIEW_SPECTROGRAM,        // Scrolling spectrogram (waterfall)
+    PANEL_VIEW_HISTOGRAM,          // ADC code histogram with signal quality figures
     PANEL_VIEW_COUNT
-    // Future: PANEL_VIEW_XY, PANEL_VIEW_SPECTROGRAM
+    // Future: PANEL_VIEW_XY
 } panel_view_type_t;
 
 // Per-Channel Panel Configuration
@@ -38,12 +44,34 @@ typedef struct channel_panel_config {
 #define MAX_DEVICES 16
 #define MAX_FILENAME_LEN 256
 
-// Waveform display sample - resampled via libsoxr with anti-aliasing
+// Waveform display sample - one pixel column of the min/max envelope pyramid
 // Values are normalized floats in range -1.0 to 1.0
 typedef struct {
-    float value;              // Resampled waveform value (via libsoxr)
+    float value;              // Mean of the samples in the column
+    float min;                // Smallest sample in the column
+    float max;                // Largest sample in the column
 } waveform_sample_t;
 
+// One oscilloscope frame of a channel, with the metadata it was built with
+typedef struct {
+    waveform_sample_t samples[DISPLAY_BUFFER_SIZE];
+    size_t count;             // Valid entries in samples (0 = nothing to show)
+    int trigger_display_pos;  // Column of the trigger point (-1 if not triggered)
+    float decimation;         // Raw samples per column
+    uint32_t sample_rate;     // Sample rate of the raw samples
+} display_frame_t;
+
+// Lock-free triple buffer of display frames (managed by gui_oscilloscope.c)
+// The display thread fills `back` and publishes it through `middle`, the
+// render thread takes the newest frame from `middle` into `front`
+// A frame is only built when the last one was taken and the waveform was
+// drawn recently, so hidden channels and FFT-only panels cost no display work
+typedef struct {
+    display_frame_t slots[3];
+    gui_triple_t idx;         // Display thread writes, render thread draws
+    atomic_uint_fast64_t acquire_ms;  // Time of the last acquire (0 = never drawn)
+} display_triple_t;
+
 // VU meter state - tracks positive and negative separately for AC signals
 typedef struct vu_meter_state {
     float level_pos;          // Current smoothed positive level (0-1)
@@ -58,7 +86,7 @@ typedef struct vu_meter_state {
 typedef enum {
     SCOPE_MODE_LINE,      // Basic line waveform (fast, simple)
     SCOPE_MODE_PHOSPHOR,  // Digital phosphor with heatmap persistence
-    SCOPE_MODE_SPLIT,     // Split view: waveform left, FFT waterfall right
+    SCOPE_MODE_SPLIT,     // Split view: waveform left, FFT right
     SCOPE_MODE_COUNT      // Number of modes (for cycling)
 } scope_display_mode_t;
 
@@ -77,20 +105,32 @@ typedef enum {
     TRIGGER_MODE_COUNT
 } trigger_mode_t;
 
+// CVBS signal levels (derived in gui_trigger.c, defined here to avoid circular includes)
+typedef struct {
+    int16_t sig_min;           // Signal minimum (sync tip level)
+    int16_t sig_max;           // Signal maximum (white level)
+    int16_t range;             // sig_max - sig_min
+    int16_t sync_threshold;    // Threshold for sync detection
+    int16_t black_level;       // Calculated black level (~30% above min)
+    int16_t white_level;       // Calculated white level (near max)
+} cvbs_levels_t;
+
 // Per-channel trigger configuration and state
 typedef struct {
     bool enabled;              // Trigger enabled for this channel
     int16_t level;             // Trigger level (-2048 to +2047, 12-bit range)
     float zoom_scale;          // Samples per pixel (1.0 = max zoom, higher = more zoomed out)
-    int trigger_display_pos;   // Where trigger appears in display buffer (-1 if not triggered)
-    atomic_int display_width;  // Actual pixel width of oscilloscope display (updated by renderer, read by extraction thread)
+    atomic_int display_width;  // Actual pixel width of oscilloscope display (updated by renderer, read by display thread)
     scope_display_mode_t scope_mode;       // Display mode for this channel (line or phosphor)
     trigger_mode_t trigger_mode;           // Trigger mode (rising edge, falling edge, CVBS)
     phosphor_color_mode_t phosphor_color;  // Phosphor color mode (heatmap or opacity)
 
-    // Resampler state (managed by gui_oscilloscope.c)
-    void *resampler;           // soxr_t handle (NULL if not initialized)
-    float resampler_ratio;     // Current decimation ratio the resampler is configured for
+    // Envelope state (managed by gui_oscilloscope.c)
+    struct minmax_pyramid *pyramid;  // Min/max levels of the displayed window (NULL until first use)
+
+    // CVBS levels of the current block, set from the block stats by the display thread
+    // before the display update (range 0 = not known, the trigger scans the block instead)
+    cvbs_levels_t cvbs_levels;
 } channel_trigger_t;
 
 // Zoom limits
@@ -112,7 +152,8 @@ typedef struct {
 typedef enum {
     DEVICE_TYPE_HSDAOH,         // Hardware device via hsdaoh
     DEVICE_TYPE_SIMPLE_CAPTURE, // OS video capture
-    DEVICE_TYPE_SIMULATED       // Simulated device for testing
+    DEVICE_TYPE_SIMULATED,      // Simulated device for testing
+    DEVICE_TYPE_REPLAY          // Recorded capture fed through the capture callback
 } device_type_t;
 
 typedef struct {
@@ -130,10 +171,38 @@ typedef struct {
     bool capture_a;
     bool capture_b;
     bool use_flac;
-    int flac_level;           // 0-8
+    int flac_level;           // 0-8, the lowest level when adaptive
+    int flac_level_max;       // Adaptive level between flac_level and this when higher
     bool show_grid;
     float time_scale;         // Time per division (ms)
     float amplitude_scale;    // Amplitude scale factor
+    size_t huge_page_size;    // Capture ringbuffer huge page size (0 = normal pages)
+    bool async_io;            // RAW recording with io_uring / overlapped I/O
+    bool direct_io;           // RAW recording bypasses the page cache (with async_io)
+    uint64_t segment_bytes;   // Split recordings into files of this size (0 = off)
+    uint64_t segment_seconds; // Split recordings into files of this length (0 = off)
+    bool packed_12bit;        // RAW recording packs 2 samples into 3 bytes
+    bool delta_coding;        // RAW recording is delta coded (misrc_extract -D decodes it)
+    bool write_index;         // Write a sample index next to channel A (name.idx)
+    char preview_path[MAX_FILENAME_LEN]; // Low rate preview while recording: file, tcp:// or shm:// (empty = none)
+    uint32_t preview_decimation; // Capture samples per preview envelope entry
+    bool trigger_on;          // Record only around trigger events, a segment each
+    record_trigger_cond_t trigger; // What starts an event
+    double pre_roll;          // Seconds before the trigger, held in the capture ringbuffer
+    double post_roll;         // Seconds after the trigger
+    bool preflight;           // Probe the output storage before every recording
+    unsigned decimation;      // Record at 1/n of the sample rate with the half-band decimators (0 = off, 2, 4, 8)
+    int fft_size;             // Spectrum FFT size (power of 2, up to 65536)
+    float fft_overlap;        // Welch segment overlap (0-0.9)
+    int fft_averages;         // Welch segments averaged per spectrum
+    bool fft_patient;         // Measure FFT plans with FFTW_PATIENT (first launch only, kept as wisdom)
+    float sim_speed;          // Simulated device: 0 = feeds the display, N = hsdaoh frames at N x real time, < 0 = as fast as possible
+    char replay_path[MAX_FILENAME_LEN]; // Raw capture or frame dump offered as a replay device (empty = none)
+    float replay_speed;       // Replay at N x real time, < 0 = as fast as possible
+    bool replay_loop;         // Start the replay over at the end of the file
+    overload_policy_t overload; // What the capture gives up when recording falls behind, before RF frames
+    buffer_sizing_t buffers;  // Target buffering time, memory budget or low memory profile of the ringbuffers
+    unsigned parser_depth;    // Frames queued between the USB callback and the parser thread (0 = parse in the callback)
 } gui_settings_t;
 
 // Main application state
@@ -146,6 +215,10 @@ typedef struct gui_app {
     void *sim_thread;          // Simulated capture thread handle
     atomic_bool sim_running;   // Flag to stop simulated capture
 
+    // Replay device state
+    struct replay *replay;     // Running replay, NULL if none
+    bool replay_done_reported; // "Replay finished" was shown
+
     // Capture state
     bool is_capturing;
     bool is_recording;
@@ -154,12 +227,21 @@ typedef struct gui_app {
     device_info_t devices[MAX_DEVICES];
     int device_count;
     int selected_device;
+    device_info_t active_device;              // Device of the running capture, the list may change meanwhile
+
+    // Background enumeration (gui_app_enumerate_devices_async)
+    void *enum_thread;                        // Enumeration thread handle, NULL if none
+    atomic_bool enum_done;                    // Set by the thread once enum_devices is complete
+    bool enum_again;                          // Devices changed while it ran, enumerate once more
+    device_info_t enum_devices[MAX_DEVICES];  // Written by the thread only
+    int enum_count;                           // -1 if enumeration failed
+
+    // Device hotplug watcher, NULL if not available (reconnects poll then)
+    struct hotplug *hotplug;
 
-    // Per-channel display buffers for waveform
-    waveform_sample_t display_samples_a[DISPLAY_BUFFER_SIZE];
-    waveform_sample_t display_samples_b[DISPLAY_BUFFER_SIZE];
-    size_t display_samples_available_a;
-    size_t display_samples_available_b;
+    // Per-channel display frames for waveform (display thread -> render thread)
+    display_triple_t display_a;
+    display_triple_t display_b;
 
     // VU meter state (updated on main thread from atomic values)
     vu_meter_state_t vu_a;
@@ -170,6 +252,10 @@ typedef struct gui_app {
     atomic_uint_fast16_t peak_a_neg;  // Maximum negative sample (0-2048, stored as positive)
     atomic_uint_fast16_t peak_b_pos;
     atomic_uint_fast16_t peak_b_neg;
+    atomic_uint_fast16_t rms_a;       // RMS level of the last block (0-2048)
+    atomic_uint_fast16_t rms_b;
+    atomic_int_fast16_t dc_a;         // DC offset of the last block
+    atomic_int_fast16_t dc_b;
 
     // Statistics (atomic, updated by capture thread)
     atomic_uint_fast64_t total_samples;
@@ -193,6 +279,8 @@ typedef struct gui_app {
 
     // Recording state
     double recording_start_time;
+    double recording_target_rate;   // Bytes/s the recording needs per preflight (0 = not probed)
+    double recording_probe_rate;    // Bytes/s the slowest output directory managed
     atomic_uint_fast64_t recording_bytes;        // Legacy: total raw bytes
     atomic_uint_fast64_t recording_raw_a;        // Raw input bytes channel A
     atomic_uint_fast64_t recording_raw_b;        // Raw input bytes channel B
@@ -242,6 +330,14 @@ void gui_app_cleanup(gui_app_t *app);
 
 // Device management
 void gui_app_enumerate_devices(gui_app_t *app);
+// Enumerate on a thread of its own, so the window shows before USB probing is done
+void gui_app_enumerate_devices_async(gui_app_t *app);
+// Take over the result of the background enumeration, call once per frame
+// Returns true in the frame the device list became available
+bool gui_app_enumeration_poll(gui_app_t *app);
+// Index of a device in the current list, matched by type, name and serial
+// Returns -1 if it is not there (e.g. unplugged)
+int gui_app_find_device(const gui_app_t *app, const device_info_t *dev);
 int gui_app_start_capture(gui_app_t *app);
 void gui_app_stop_capture(gui_app_t *app);
 int gui_app_start_recording(gui_app_t *app);
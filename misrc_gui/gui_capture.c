@@ -12,8 +12,10 @@
 #include "gui_oscilloscope.h"
 #include "gui_phosphor_rt.h"
 #include "gui_fft.h"
+#include "gui_fft_worker.h"
 #include "gui_simulated.h"
 #include "gui_panel.h"
+#include "gui_perf.h"
 
 #include <hsdaoh.h>
 #include <hsdaoh_raw.h>
@@ -24,6 +26,12 @@
 #include "../misrc_common/frame_parser.h"
 #include "../misrc_common/capture_handler.h"
 #include "../misrc_common/device_enum.h"
+#include "../misrc_common/hotplug.h"
+#include "../misrc_common/thread_role.h"
+#include "../misrc_common/replay.h"
+#include "../misrc_common/frame_timing.h"
+#include "../misrc_common/frame_queue.h"
+#include "../misrc_common/buffer_pool.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -38,7 +46,8 @@
 
 // Buffer sizes - match reference implementation
 #define BUFFER_READ_SIZE 65536
-#define BUFFER_TOTAL_SIZE (65536 * 1024)  // Same as reference: 64MB
+#define BUFFER_TOTAL_SIZE (65536 * 1024)  // Same as reference: 64MB, by default
+#define BUFFER_FRAME_MAX (4 << 20)       // Largest frame the callback reserves space for
 
 // Ringbuffer for raw capture data (written by callback, read by main thread)
 static ringbuffer_t s_capture_rb;
@@ -75,6 +84,23 @@ static void gui_message_callback(void *ctx, enum hsdaoh_msg_level level, const c
 // Debug counter
 static int s_callback_count = 0;
 
+// Samples committed to the capture ringbuffer, sample index offsets count these
+static uint64_t s_rb_samples = 0;
+
+// Arrival time of the frame in the callback, and the interval and callback histograms
+static uint64_t s_arrival_ns = 0;
+static uint16_t s_last_frame = 0;
+static frame_timing_t s_timing;
+
+// --parser-thread: the callback only queues the frames, the parser thread runs
+// capture_callback() on them
+static buffer_pool_t *s_frame_pool = NULL;
+static frame_queue_t *s_frame_queue = NULL;
+static thrd_t s_parser_thread;
+static bool s_parser_running = false;
+static atomic_bool s_parser_stop;
+static bool s_queue_dropping = false;    // The callback dropped the last frame
+
 /*-----------------------------------------------------------------------------
  * GUI-Specific Capture Handler Callbacks
  *-----------------------------------------------------------------------------*/
@@ -106,12 +132,118 @@ static void gui_sync_event_cb(void *user_ctx, frame_sync_result_t result,
     }
 }
 
+/*-----------------------------------------------------------------------------
+ * Ringbuffer Sizing
+ *-----------------------------------------------------------------------------*/
+
+// Size the capture and record ringbuffers from --buffer-time, --buffer-memory and --low-memory
+// Returns the capture ringbuffer size, hands the record size to the extraction
+static size_t gui_size_ringbuffers(gui_app_t *app) {
+    // The capture ringbuffer holds at least four frames, the record ones 8MB (64 writer reads)
+    // The trigger pre-roll waits in the capture ringbuffer on top of that
+    size_t pre_roll = app->settings.trigger_on ? gui_extract_trigger_held_bytes(app) : 0;
+    buffer_stream_t streams[3] = {
+        { "capture", 160000000.0, 4 * BUFFER_FRAME_MAX + pre_roll, BUFFER_TOTAL_SIZE + pre_roll, 0 },
+        { "A", 80000000.0, 8 << 20, BUFFER_TOTAL_SIZE, 0 },
+        { "B", 80000000.0, 8 << 20, BUFFER_TOTAL_SIZE, 0 },
+    };
+    buffer_sizing_t cfg = app->settings.buffers;
+    bool sized = cfg.seconds > 0.0 || cfg.budget > 0 || cfg.low_memory;
+
+    cfg.granularity = app->settings.huge_page_size;
+    if (buffer_sizing_compute(&cfg, streams, 3, 0) == 0) {
+        fprintf(stderr, "[CAPTURE] Not enough memory for the ringbuffers, using the smallest ones\n");
+        for (int i = 0; i < 3; i++) {
+            streams[i].size = streams[i].min_size;
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        sized |= streams[i].size != streams[i].default_size;
+    }
+    if (sized) {
+        buffer_sizing_report("[CAPTURE] ", streams, 3);
+    }
+    gui_extract_set_record_size(streams[1].size);
+    return streams[0].size;
+}
+
 /*-----------------------------------------------------------------------------
  * Main Capture Callback
  *-----------------------------------------------------------------------------*/
 
-// Main capture callback - writes raw data to ringbuffer (like reference implementation)
-void gui_capture_callback(void *data_info_ptr) {
+// Wait for ringbuffer space with event-based waiting
+// Returns NULL if the frame has to be dropped due to backpressure
+static uint8_t *reserve_capture_space(gui_app_t *app, size_t bytes) {
+    uint8_t *buf_out = rb_write_ptr(&s_capture_rb, bytes);
+    if (buf_out) return buf_out;
+
+    // Buffer full - wait with timeout using space event
+    rb_event_t *space_event = gui_extract_get_space_event();
+    int wait_attempts = 0;
+    const int max_wait_attempts = (int)(overload_rf_wait_ms(gui_extract_get_overload()) / 5);  // 5ms each
+
+    while ((buf_out = rb_write_ptr(&s_capture_rb, bytes)) == NULL) {
+        if (atomic_load(&do_exit)) return NULL;
+
+        wait_attempts++;
+        if (wait_attempts == 1) {
+            // Log on first wait (backpressure occurring)
+            uint32_t wait_count = atomic_fetch_add(&app->rb_wait_count, 1) + 1;
+            if (wait_count <= 5 || (wait_count % 10) == 0) {
+                fprintf(stderr, "[CB] Ringbuffer backpressure - waiting for space (wait #%u)\n", wait_count);
+            }
+        }
+
+        if (wait_attempts > max_wait_attempts) {
+            // Timeout - drop frame
+            atomic_fetch_add(&app->rb_drop_count, 1);
+            if (atomic_load(&app->rb_drop_count) <= 5) {
+                fprintf(stderr, "[CB] Dropped frame due to ringbuffer backpressure\n");
+            }
+            return NULL;
+        }
+
+        // Wait on space event with short timeout
+        if (space_event) {
+            rb_event_wait_timeout(space_event, 5);
+        } else {
+            thrd_sleep_ms(5);
+        }
+    }
+    return buf_out;
+}
+
+
+// Add the frame to the sample index of the recording
+static void gui_index_frame(sample_index_t *index, const metadata_t *meta,
+                            const frame_process_result_t *result, bool was_synced, bool reserved) {
+    switch (result->sync_result) {
+        case FRAME_SYNC_ACQUIRED:
+            sample_index_event(index, SAMPLE_INDEX_SYNC_ACQUIRED, s_rb_samples, meta->framecounter, 0);
+            return;
+        case FRAME_SYNC_LOST:
+            if (was_synced) {
+                sample_index_event(index, SAMPLE_INDEX_SYNC_LOST, s_rb_samples, meta->framecounter, 0);
+            }
+            return;
+        case FRAME_SYNC_DUPLICATE:
+            return;
+        default:
+            break;
+    }
+    if (result->error_count > 0 && result->report_errors) {
+        sample_index_event(index, SAMPLE_INDEX_FRAME_ERRORS, s_rb_samples, meta->framecounter,
+                           (uint32_t)result->error_count);
+    } else if (!reserved) {
+        sample_index_event(index, SAMPLE_INDEX_FRAME_DROPPED, s_rb_samples, meta->framecounter, 1);
+    } else if (result->valid && result->stream0_copied > 0) {
+        sample_index_frame(index, s_rb_samples, meta->framecounter,
+                           result->sync_result == FRAME_SYNC_MISSED, s_arrival_ns);
+    }
+}
+
+// Capture callback body - writes raw data to ringbuffer (like reference implementation)
+static void capture_callback(void *data_info_ptr) {
     hsdaoh_data_info_t *data_info = (hsdaoh_data_info_t *)data_info_ptr;
     gui_app_t *app = (gui_app_t *)data_info->ctx;
 
@@ -131,15 +263,33 @@ void gui_capture_callback(void *data_info_ptr) {
     // Extract metadata from frame
     metadata_t meta;
     hsdaoh_extract_metadata(data_info->buf, &meta, data_info->width);
+    s_last_frame = meta.framecounter;
 
     bool was_synced = s_capture_handler.frame_state.sync.stream_synced;
 
-    // Process frame using shared parser
-    frame_process_result_t result = frame_process(&s_capture_handler.frame_state,
-                                                   data_info->buf,
-                                                   data_info->width,
-                                                   data_info->height,
-                                                   &meta, 4);
+    // Reserve space for a whole frame up front, payloads are scattered into it
+    // while the frame is validated. Nothing is copied before sync.
+    uint8_t *buf_out = NULL;
+    if (was_synced) {
+        buf_out = reserve_capture_space(app, data_info->width * data_info->height * sizeof(uint16_t));
+    }
+
+    // Process frame and copy payload (stream 0 only for GUI) using shared parser
+    uint64_t t_parse = gui_perf_begin();
+    frame_process_result_t result = frame_process_and_copy(&s_capture_handler.frame_state,
+                                                           data_info->buf,
+                                                           data_info->width,
+                                                           data_info->height,
+                                                           &meta, 4,
+                                                           buf_out, NULL, NULL, NULL);
+    gui_perf_end(PERF_STAGE_PARSE, t_parse);
+
+    // Backpressure drops show up in the index as well
+    sample_index_t *index = gui_record_index_acquire();
+    if (index) {
+        gui_index_frame(index, &meta, &result, was_synced, buf_out != NULL || !was_synced);
+        gui_record_index_release();
+    }
 
     // Handle sync state changes using shared handler
     if (!capture_handler_process_sync_event(&s_capture_handler, result.sync_result,
@@ -168,57 +318,26 @@ void gui_capture_callback(void *data_info_ptr) {
             fprintf(stderr, "[CB] %d frame errors\n", result.error_count);
             atomic_fetch_add(&app->error_count, result.error_count);
         }
-        return;  // Discard frame with errors
+        return;  // Discard frame with errors, reserved space is not committed
     }
 
-    // Don't process if no payload
-    if (!result.valid || result.stream0_bytes == 0) {
-        return;
+    // A frame dropped for backpressure is a gap in the recording
+    if (!buf_out && result.valid && result.stream0_bytes > 0) {
+        overload_gap(gui_extract_get_overload(), OVERLOAD_STREAM_RF, s_rb_samples, result.stream0_bytes / 4);
     }
 
-    // Wait for ringbuffer space with event-based waiting
-    uint8_t *buf_out = rb_write_ptr(&s_capture_rb, result.stream0_bytes);
-    if (!buf_out) {
-        // Buffer full - wait with timeout using space event
-        rb_event_t *space_event = gui_extract_get_space_event();
-        int wait_attempts = 0;
-        const int max_wait_attempts = 10;  // 10 x 5ms = 50ms max wait
-
-        while ((buf_out = rb_write_ptr(&s_capture_rb, result.stream0_bytes)) == NULL) {
-            if (atomic_load(&do_exit)) return;
-
-            wait_attempts++;
-            if (wait_attempts == 1) {
-                // Log on first wait (backpressure occurring)
-                uint32_t wait_count = atomic_fetch_add(&app->rb_wait_count, 1) + 1;
-                if (wait_count <= 5 || (wait_count % 10) == 0) {
-                    fprintf(stderr, "[CB] Ringbuffer backpressure - waiting for space (wait #%u)\n", wait_count);
-                }
-            }
-
-            if (wait_attempts > max_wait_attempts) {
-                // Timeout - drop frame
-                atomic_fetch_add(&app->rb_drop_count, 1);
-                if (atomic_load(&app->rb_drop_count) <= 5) {
-                    fprintf(stderr, "[CB] Dropped frame due to ringbuffer backpressure\n");
-                }
-                return;
-            }
-
-            // Wait on space event with short timeout
-            if (space_event) {
-                rb_event_wait_timeout(space_event, 5);
-            } else {
-                thrd_sleep_ms(5);
-            }
-        }
+    if (result.valid) {
+        frame_timing_set_period(&s_timing, result.stream0_bytes / 4, meta.stream_info[0].srate);
     }
 
-    // Copy payload data to ringbuffer (stream 0 only for GUI)
-    frame_copy_payloads(data_info->buf, data_info->width, data_info->height,
-                        &meta, buf_out, NULL);
+    // Don't process if no payload (or the frame was dropped for backpressure)
+    if (!result.valid || result.stream0_copied == 0) {
+        return;
+    }
 
-    rb_write_finished(&s_capture_rb, result.stream0_bytes);
+    rb_write_finished(&s_capture_rb, result.stream0_copied);
+    overload_resume(gui_extract_get_overload(), OVERLOAD_STREAM_RF);
+    s_rb_samples += result.stream0_copied / 4;
 
     // Signal that new data is available
     rb_event_t *data_event = gui_extract_get_data_event();
@@ -227,17 +346,140 @@ void gui_capture_callback(void *data_info_ptr) {
     }
 
     if (s_callback_count <= 3) {
-        fprintf(stderr, "[CB] Wrote %zu bytes to ringbuffer\n", result.stream0_bytes);
+        fprintf(stderr, "[CB] Wrote %zu bytes to ringbuffer\n", result.stream0_copied);
+    }
+}
+
+// Late frames and slow callbacks go into the index of the recording
+static void gui_index_timing(uint64_t sample, unsigned flags, uint64_t interval_ns,
+                             uint64_t duration_ns, uint64_t arrival_ns) {
+    if (flags == 0) return;
+
+    sample_index_t *index = gui_record_index_acquire();
+    if (!index) return;
+    if (flags & FRAME_TIMING_LATE) {
+        sample_index_event_at(index, SAMPLE_INDEX_FRAME_LATE, sample, s_last_frame,
+                              (uint32_t)(interval_ns / 1000), arrival_ns);
+    }
+    if (flags & FRAME_TIMING_SLOW) {
+        sample_index_event_at(index, SAMPLE_INDEX_CALLBACK_SLOW, sample, s_last_frame,
+                              (uint32_t)(duration_ns / 1000), arrival_ns);
+    }
+    gui_record_index_release();
+}
+
+static void gui_frame_timing(uint64_t sample) {
+    unsigned flags = frame_timing_add(&s_timing, s_arrival_ns, get_time_ns());
+    if (s_timing.interval_ns) gui_perf_record(PERF_STAGE_FRAME_INTERVAL, s_timing.interval_ns);
+    gui_index_timing(sample, flags, s_timing.interval_ns, s_timing.duration_ns, s_arrival_ns);
+}
+
+// Copy the frame for the parser thread. A full queue drops it right away, the
+// parser is waiting for ringbuffer space then and drops frames itself.
+static void queue_frame(hsdaoh_data_info_t *data_info, uint64_t arrival) {
+    frame_queue_slot_t *slot = NULL;
+    if (data_info->len <= frame_queue_slot_size(s_frame_queue)) {
+        slot = frame_queue_write_slot(s_frame_queue, data_info->len, 0);
+    }
+    if (slot) {
+        if (data_info->buf && data_info->len) memcpy(slot->buf, data_info->buf, data_info->len);
+        slot->len = data_info->buf ? data_info->len : 0;
+        slot->width = data_info->width;
+        slot->height = data_info->height;
+        slot->arrival_ns = arrival;
+        slot->device_error = data_info->device_error;
+        s_queue_dropping = false;
+    } else {
+        frame_queue_drop(s_frame_queue);
+        if (!s_queue_dropping) fprintf(stderr, "[CB] Frame queue full, dropping frames\n");
+        s_queue_dropping = true;
+    }
+
+    // The callback's own times go with the frame, the parser puts the outliers into the index
+    unsigned flags = frame_timing_add(&s_timing, arrival, get_time_ns());
+    if (s_timing.interval_ns) gui_perf_record(PERF_STAGE_FRAME_INTERVAL, s_timing.interval_ns);
+    if (slot) {
+        slot->timing_flags = flags;
+        slot->interval_ns = s_timing.interval_ns;
+        slot->duration_ns = s_timing.duration_ns;
+        frame_queue_write_finished(s_frame_queue);
+    }
+}
+
+// Main capture callback
+void gui_capture_callback(void *data_info_ptr) {
+    thread_role_apply(THREAD_ROLE_USB);
+    uint64_t arrival = get_time_ns();
+    uint64_t t0 = gui_perf_begin();
+    if (s_frame_queue) {
+        if (!atomic_load(&do_exit)) queue_frame((hsdaoh_data_info_t *)data_info_ptr, arrival);
+        gui_perf_end(PERF_STAGE_CALLBACK, t0);
+        return;
+    }
+    s_arrival_ns = arrival;
+    uint64_t sample = s_rb_samples;
+    capture_callback(data_info_ptr);
+    gui_perf_end(PERF_STAGE_CALLBACK, t0);
+    if (!atomic_load(&do_exit)) gui_frame_timing(sample);
+}
+
+// Parser thread - sync, CRC and payload copy of the queued frames
+static int parser_thread(void *ctx) {
+    gui_app_t *app = (gui_app_t *)ctx;
+    thread_role_apply(THREAD_ROLE_PARSER);
+
+    while (!atomic_load(&do_exit) && !atomic_load(&s_parser_stop)) {
+        frame_queue_slot_t *slot = frame_queue_read_slot_wait(s_frame_queue, 100);
+        if (!slot) continue;
+
+        hsdaoh_data_info_t info;
+        memset(&info, 0, sizeof(info));
+        info.ctx = app;
+        info.buf = slot->len ? slot->buf : NULL;
+        info.len = slot->len;
+        info.width = slot->width;
+        info.height = slot->height;
+        info.device_error = slot->device_error;
+
+        uint64_t sample = s_rb_samples;
+        s_arrival_ns = slot->arrival_ns;
+        capture_callback(&info);
+        gui_index_timing(sample, slot->timing_flags, slot->interval_ns, slot->duration_ns, slot->arrival_ns);
+        frame_queue_read_finished(s_frame_queue);
+    }
+    return 0;
+}
+
+// Start the parser before the first frame can be queued
+static int parser_start(gui_app_t *app) {
+    if (!s_frame_queue) return 0;
+    atomic_store(&s_parser_stop, false);
+    s_queue_dropping = false;
+    if (thrd_create(&s_parser_thread, parser_thread, app) != thrd_success) {
+        fprintf(stderr, "[GUI] Failed to start the frame parser thread\n");
+        return -1;
+    }
+    s_parser_running = true;
+    return 0;
+}
+
+// Stop the parser once nothing queues frames anymore, what is left is stale
+static void parser_stop(void) {
+    if (!s_parser_running) return;
+    atomic_store(&s_parser_stop, true);
+    frame_queue_wake(s_frame_queue);
+    thrd_join(s_parser_thread, NULL);
+    s_parser_running = false;
+    while (frame_queue_read_slot_wait(s_frame_queue, 0)) {
+        frame_queue_read_finished(s_frame_queue);
     }
 }
 
 // Initialize application
 void gui_app_init(gui_app_t *app) {
-    // Initialize per-channel display buffers
-    memset(app->display_samples_a, 0, sizeof(app->display_samples_a));
-    memset(app->display_samples_b, 0, sizeof(app->display_samples_b));
-    app->display_samples_available_a = 0;
-    app->display_samples_available_b = 0;
+    // Initialize per-channel display frames
+    display_triple_init(&app->display_a);
+    display_triple_init(&app->display_b);
 
     // Initialize simulated device state
     app->sim_thread = NULL;
@@ -267,7 +509,6 @@ void gui_app_init(gui_app_t *app) {
     app->trigger_a.enabled = false;
     app->trigger_a.level = 0;
     app->trigger_a.zoom_scale = ZOOM_SCALE_DEFAULT;
-    app->trigger_a.trigger_display_pos = -1;
     atomic_store(&app->trigger_a.display_width, DISPLAY_BUFFER_SIZE);  // Will be updated by renderer
     app->trigger_a.scope_mode = SCOPE_MODE_PHOSPHOR;  // Phosphor mode by default
     app->trigger_a.trigger_mode = TRIGGER_MODE_RISING;  // Rising edge by default
@@ -277,7 +518,6 @@ void gui_app_init(gui_app_t *app) {
     app->trigger_b.enabled = false;
     app->trigger_b.level = 0;
     app->trigger_b.zoom_scale = ZOOM_SCALE_DEFAULT;
-    app->trigger_b.trigger_display_pos = -1;
     atomic_store(&app->trigger_b.display_width, DISPLAY_BUFFER_SIZE);  // Will be updated by renderer
     app->trigger_b.scope_mode = SCOPE_MODE_PHOSPHOR;  // Phosphor mode by default
     app->trigger_b.trigger_mode = TRIGGER_MODE_RISING;  // Rising edge by default
@@ -305,27 +545,55 @@ void gui_app_init(gui_app_t *app) {
     app->fft_a = NULL;
     app->fft_b = NULL;
 
+    // Spectra are computed from full-rate samples on the FFT worker thread,
+    // started by the first FFT or spectrogram panel that is drawn
+    if (gui_fft_available()) {
+        gui_fft_worker_configure(app->settings.fft_size, app->settings.fft_overlap,
+                                 app->settings.fft_averages);
+        gui_fft_worker_set_patient(app->settings.fft_patient);
+    }
+
     // Initialize panel configuration (new panel abstraction system)
     app->panel_config_a.split = true;
     app->panel_config_a.left_view = PANEL_VIEW_WAVEFORM_PHOSPHOR;
     app->panel_config_a.right_view = PANEL_VIEW_FFT;
     app->panel_config_a.left_state = NULL;
-    app->panel_config_a.right_state = panel_create_view_state(PANEL_VIEW_FFT);
+    app->panel_config_a.right_state = NULL;  // Created when the panel is first drawn
 
     app->panel_config_b.split = true;
     app->panel_config_b.left_view = PANEL_VIEW_WAVEFORM_PHOSPHOR;
     app->panel_config_b.right_view = PANEL_VIEW_FFT;
     app->panel_config_b.left_state = NULL;
-    app->panel_config_b.right_state = panel_create_view_state(PANEL_VIEW_FFT);
+    app->panel_config_b.right_state = NULL;  // Created when the panel is first drawn
 
     // Initialize capture ringbuffer
     if (!s_rb_initialized) {
-        int r = rb_init(&s_capture_rb, "gui_capture", BUFFER_TOTAL_SIZE);
+        size_t capture_size = gui_size_ringbuffers(app);
+        int r = rb_init_pages(&s_capture_rb, "gui_capture", capture_size, app->settings.huge_page_size);
         if (r != 0) {
             fprintf(stderr, "Failed to initialize capture ringbuffer: %d\n", r);
         } else {
             s_rb_initialized = true;
-            fprintf(stderr, "Capture ringbuffer initialized (%d bytes)\n", BUFFER_TOTAL_SIZE);
+            fprintf(stderr, "Capture ringbuffer initialized (%zu bytes)\n", capture_size);
+            if (app->settings.huge_page_size != 0 && s_capture_rb.huge_page_size == 0) {
+                fprintf(stderr, "[CAPTURE] Warning: huge pages not available, using normal pages\n");
+            }
+        }
+    }
+
+    // --parser-thread: the queue slots are mapped and touched once, like the scratch buffers
+    if (app->settings.parser_depth && !s_frame_queue) {
+        s_frame_pool = buffer_pool_create(app->settings.huge_page_size);
+        if (s_frame_pool && buffer_pool_reserve(s_frame_pool, BUFFER_FRAME_MAX, app->settings.parser_depth) == 0 &&
+            buffer_pool_commit(s_frame_pool) == 0) {
+            s_frame_queue = frame_queue_create(app->settings.parser_depth, BUFFER_FRAME_MAX, s_frame_pool);
+        }
+        if (s_frame_queue) {
+            fprintf(stderr, "Frame queue initialized (%u frames)\n", app->settings.parser_depth);
+        } else {
+            fprintf(stderr, "[CAPTURE] Failed to allocate the frame queue, parsing in the USB callback\n");
+            buffer_pool_free(s_frame_pool);
+            s_frame_pool = NULL;
         }
     }
 
@@ -347,15 +615,32 @@ void gui_app_cleanup(gui_app_t *app) {
         gui_app_stop_capture(app);
     }
 
+    hotplug_stop(app->hotplug);
+    app->hotplug = NULL;
+
+    // A window closed during startup may leave the enumeration running
+    if (app->enum_thread) {
+        thrd_t thread = (thrd_t)(uintptr_t)app->enum_thread;
+        thrd_join(thread, NULL);
+        app->enum_thread = NULL;
+    }
+
     // Close ringbuffer
     if (s_rb_initialized) {
         rb_close(&s_capture_rb);
         s_rb_initialized = false;
     }
+    frame_queue_free(s_frame_queue);
+    s_frame_queue = NULL;
+    buffer_pool_free(s_frame_pool);
+    s_frame_pool = NULL;
 
     // Cleanup extraction subsystem
     gui_extract_cleanup();
 
+    // Stop the FFT worker (after extraction, which pushes to it)
+    gui_fft_worker_stop();
+
     // Cleanup phosphor buffers and textures
     if (app->phosphor_a) {
         phosphor_rt_cleanup(app->phosphor_a);
@@ -380,30 +665,28 @@ void gui_app_cleanup(gui_app_t *app) {
         app->fft_b = NULL;
     }
 
-    // Cleanup oscilloscope resources (static state and resamplers)
-    gui_oscilloscope_cleanup_resamplers(app);
+    // Cleanup oscilloscope resources (static state and envelope pyramids)
+    gui_oscilloscope_cleanup_pyramids(app);
     gui_oscilloscope_cleanup();
 }
 
-// Enumerate available capture devices
-void gui_app_enumerate_devices(gui_app_t *app) {
-    app->device_count = 0;
+// Fill list with the available capture devices
+// Returns the number of devices, -1 if enumeration failed
+static int enumerate_devices(const gui_app_t *app, device_info_t *list) {
+    int count = 0;
 
     // Use shared device enumeration (hsdaoh + simple_capture)
     misrc_device_list_t devices;
     misrc_device_list_init(&devices);
-    int count = misrc_device_enumerate(&devices, true, true);
-
-    if (count < 0) {
-        gui_app_set_status(app, "Device enumeration failed");
+    if (misrc_device_enumerate(&devices, true, true) < 0) {
         misrc_device_list_free(&devices);
-        return;
+        return -1;
     }
 
     // Copy devices to GUI format
-    for (size_t i = 0; i < devices.count && app->device_count < MAX_DEVICES; i++) {
+    for (size_t i = 0; i < devices.count && count < MAX_DEVICES; i++) {
         misrc_device_info_t *src = &devices.devices[i];
-        device_info_t *dst = &app->devices[app->device_count];
+        device_info_t *dst = &list[count];
 
         // Format name with type prefix for simple_capture devices
         if (src->type == MISRC_DEVICE_TYPE_SIMPLE_CAPTURE) {
@@ -420,20 +703,70 @@ void gui_app_enumerate_devices(gui_app_t *app) {
             dst->serial[0] = '\0';
         }
 
-        app->device_count++;
+        count++;
     }
 
     misrc_device_list_free(&devices);
 
     // Always add simulated device at the end
-    if (app->device_count < MAX_DEVICES) {
-        device_info_t *dst = &app->devices[app->device_count];
+    if (count < MAX_DEVICES) {
+        device_info_t *dst = &list[count];
         snprintf(dst->name, sizeof(dst->name), "[Simulated] Test Signal");
         snprintf(dst->serial, sizeof(dst->serial), "SIM001");
         dst->type = DEVICE_TYPE_SIMULATED;
         dst->index = -1;
-        app->device_count++;
+        count++;
+    }
+
+    // A capture given with --replay comes after it
+    if (app->settings.replay_path[0] != '\0' && count < MAX_DEVICES) {
+        device_info_t *dst = &list[count];
+        const char *name = app->settings.replay_path;
+        for (const char *p = name; *p; p++) {
+            if (*p == '/' || *p == '\\') name = p + 1;
+        }
+        snprintf(dst->name, sizeof(dst->name), "[Replay] %.*s", (int)(sizeof(dst->name) - sizeof("[Replay] ")), name);
+        snprintf(dst->serial, sizeof(dst->serial), "REPLAY");
+        dst->type = DEVICE_TYPE_REPLAY;
+        dst->index = -1;
+        count++;
+    }
+
+    return count;
+}
+
+// Same device in two enumerations (hsdaoh indices shift when others come and go)
+static bool same_device(const device_info_t *a, const device_info_t *b) {
+    return a->type == b->type && strcmp(a->name, b->name) == 0 && strcmp(a->serial, b->serial) == 0;
+}
+
+static int find_device(const device_info_t *list, int count, const device_info_t *dev) {
+    for (int i = 0; i < count; i++) {
+        if (same_device(&list[i], dev)) return i;
+    }
+    return -1;
+}
+
+int gui_app_find_device(const gui_app_t *app, const device_info_t *dev) {
+    return find_device(app->devices, app->device_count, dev);
+}
+
+// Take over an enumerated device list and report it in the status line
+// The selected device stays selected if it is still there
+static void set_device_list(gui_app_t *app, const device_info_t *list, int count) {
+    if (count < 0) {
+        app->device_count = 0;
+        gui_app_set_status(app, "Device enumeration failed");
+        return;
+    }
+
+    int selected = -1;
+    if (app->selected_device < app->device_count) {
+        selected = find_device(list, count, &app->devices[app->selected_device]);
     }
+    memcpy(app->devices, list, (size_t)count * sizeof(device_info_t));
+    app->device_count = count;
+    app->selected_device = (selected >= 0) ? selected : 0;
 
     if (app->device_count == 0) {
         gui_app_set_status(app, "No capture devices found");
@@ -444,6 +777,113 @@ void gui_app_enumerate_devices(gui_app_t *app) {
     }
 }
 
+// Enumerate available capture devices
+void gui_app_enumerate_devices(gui_app_t *app) {
+    device_info_t list[MAX_DEVICES];
+    set_device_list(app, list, enumerate_devices(app, list));
+}
+
+static int enumerate_thread(void *ctx) {
+    gui_app_t *app = (gui_app_t *)ctx;
+    app->enum_count = enumerate_devices(app, app->enum_devices);
+    atomic_store(&app->enum_done, true);
+    return 0;
+}
+
+void gui_app_enumerate_devices_async(gui_app_t *app) {
+    if (app->enum_thread) {
+        app->enum_again = true;
+        return;
+    }
+
+    atomic_store(&app->enum_done, false);
+    thrd_t thread;
+    if (thrd_create(&thread, enumerate_thread, app) != thrd_success) {
+        fprintf(stderr, "[GUI] Failed to create enumeration thread, enumerating in place\n");
+        gui_app_enumerate_devices(app);
+        atomic_store(&app->enum_done, true);
+        return;
+    }
+    app->enum_thread = (void *)(uintptr_t)thread;
+    if (app->device_count == 0) {
+        gui_app_set_status(app, "Searching for devices...");
+    }
+}
+
+bool gui_app_enumeration_poll(gui_app_t *app) {
+    if (!atomic_load(&app->enum_done)) return false;
+    atomic_store(&app->enum_done, false);
+
+    if (app->enum_thread) {
+        thrd_t thread = (thrd_t)(uintptr_t)app->enum_thread;
+        thrd_join(thread, NULL);
+        app->enum_thread = NULL;
+        set_device_list(app, app->enum_devices, app->enum_count);
+    }
+    if (app->enum_again) {
+        app->enum_again = false;
+        gui_app_enumerate_devices_async(app);
+    }
+    return true;
+}
+
+// Open the hsdaoh device and start streaming into the capture callback
+static int open_device(gui_app_t *app, const device_info_t *dev) {
+    fprintf(stderr, "[GUI] Allocating device...\n");
+    int r = hsdaoh_alloc(&app->hs_dev);
+    if (r < 0) {
+        fprintf(stderr, "[GUI] hsdaoh_alloc failed: %d\n", r);
+        gui_app_set_status(app, "Failed to allocate device");
+        return -1;
+    }
+
+    hsdaoh_set_msg_callback(app->hs_dev, gui_message_callback, app);
+    hsdaoh_raw_callback(app->hs_dev, true);
+
+    fprintf(stderr, "[GUI] Opening device index %d...\n", dev->index);
+    r = hsdaoh_open2(app->hs_dev, dev->index);
+    if (r < 0) {
+        fprintf(stderr, "[GUI] hsdaoh_open2 failed: %d\n", r);
+        gui_app_set_status(app, "Failed to open device");
+        // Note: hsdaoh_open2 frees dev on failure, so DON'T call hsdaoh_close
+        app->hs_dev = NULL;
+        return -1;
+    }
+
+    fprintf(stderr, "[GUI] Starting stream...\n");
+    r = hsdaoh_start_stream(app->hs_dev, (hsdaoh_read_cb_t)gui_capture_callback, app);
+    if (r < 0) {
+        fprintf(stderr, "[GUI] hsdaoh_start_stream failed: %d\n", r);
+        gui_app_set_status(app, "Failed to start stream");
+        hsdaoh_close(app->hs_dev);
+        app->hs_dev = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+// Start replaying the --replay file into the capture callback
+static int open_replay(gui_app_t *app) {
+    replay_config_t cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.path = app->settings.replay_path;
+    cfg.speed = app->settings.replay_speed;
+    cfg.loop = app->settings.replay_loop;
+    cfg.callback = (replay_frame_cb_t)gui_capture_callback;
+    cfg.ctx = app;
+    cfg.rb = &s_capture_rb;
+    cfg.tag = "[GUI] ";
+
+    app->replay_done_reported = false;
+    app->replay = replay_start(&cfg);
+    if (!app->replay) {
+        gui_app_set_status(app, "Failed to open replay file");
+        return -1;
+    }
+    return 0;
+}
+
 // Start capture
 int gui_app_start_capture(gui_app_t *app) {
     fprintf(stderr, "[GUI] gui_app_start_capture called\n");
@@ -453,6 +893,11 @@ int gui_app_start_capture(gui_app_t *app) {
         return 0;
     }
 
+    if (app->enum_thread && app->device_count == 0) {
+        gui_app_set_status(app, "Still searching for devices...");
+        return -1;
+    }
+
     if (app->device_count == 0) {
         fprintf(stderr, "[GUI] No devices available\n");
         gui_app_set_status(app, "No devices available");
@@ -461,9 +906,10 @@ int gui_app_start_capture(gui_app_t *app) {
 
     device_info_t *dev = &app->devices[app->selected_device];
     fprintf(stderr, "[GUI] Selected device: %s (type %d, index %d)\n", dev->name, dev->type, dev->index);
+    app->active_device = *dev;
 
-    // Handle simulated device separately
-    if (dev->type == DEVICE_TYPE_SIMULATED) {
+    // The simulated device feeds the display directly unless it sends frames
+    if (dev->type == DEVICE_TYPE_SIMULATED && !gui_simulated_feeds_frames(app)) {
         return gui_simulated_start(app);
     }
 
@@ -488,16 +934,19 @@ int gui_app_start_capture(gui_app_t *app) {
     atomic_store(&app->clip_count_b_neg, 0);
     atomic_store(&app->rb_wait_count, 0);
     atomic_store(&app->rb_drop_count, 0);
+    rb_reset_high_water(&s_capture_rb);
     atomic_store(&app->stream_synced, false);
     atomic_store(&app->sample_rate, DEFAULT_SAMPLE_RATE);
     atomic_store(&app->last_callback_time_ms, get_time_ms());
 
-    // Reset display buffers (per-channel)
-    app->display_samples_available_a = 0;
-    app->display_samples_available_b = 0;
+    // Reset display frames (per-channel)
+    display_triple_clear(&app->display_a);
+    display_triple_clear(&app->display_b);
 
     // Reset callback counter and capture handler state
     s_callback_count = 0;
+    s_rb_samples = 0;
+    frame_timing_init(&s_timing);
     capture_handler_init(&s_capture_handler);
     s_capture_handler.rb_rf = &s_capture_rb;
     s_capture_handler.capture_rf = true;
@@ -505,35 +954,21 @@ int gui_app_start_capture(gui_app_t *app) {
     s_capture_handler.sync_event_cb = gui_sync_event_cb;
     s_capture_handler.user_ctx = app;
 
-    // Open device
-    fprintf(stderr, "[GUI] Allocating device...\n");
-    int r = hsdaoh_alloc(&app->hs_dev);
+    int r = parser_start(app);
     if (r < 0) {
-        fprintf(stderr, "[GUI] hsdaoh_alloc failed: %d\n", r);
-        gui_app_set_status(app, "Failed to allocate device");
+        gui_app_set_status(app, "Failed to start the frame parser");
         return -1;
     }
-
-    hsdaoh_set_msg_callback(app->hs_dev, gui_message_callback, app);
-    hsdaoh_raw_callback(app->hs_dev, true);
-
-    fprintf(stderr, "[GUI] Opening device index %d...\n", dev->index);
-    r = hsdaoh_open2(app->hs_dev, dev->index);
-    if (r < 0) {
-        fprintf(stderr, "[GUI] hsdaoh_open2 failed: %d\n", r);
-        gui_app_set_status(app, "Failed to open device");
-        // Note: hsdaoh_open2 frees dev on failure, so DON'T call hsdaoh_close
-        app->hs_dev = NULL;
-        return -1;
+    if (dev->type == DEVICE_TYPE_SIMULATED) {
+        // Simulated frames take the same callback, parser and extraction as a device
+        r = gui_simulated_start(app);
+    } else if (dev->type == DEVICE_TYPE_REPLAY) {
+        r = open_replay(app);
+    } else {
+        r = open_device(app, dev);
     }
-
-    fprintf(stderr, "[GUI] Starting stream...\n");
-    r = hsdaoh_start_stream(app->hs_dev, (hsdaoh_read_cb_t)gui_capture_callback, app);
     if (r < 0) {
-        fprintf(stderr, "[GUI] hsdaoh_start_stream failed: %d\n", r);
-        gui_app_set_status(app, "Failed to start stream");
-        hsdaoh_close(app->hs_dev);
-        app->hs_dev = NULL;
+        parser_stop();
         return -1;
     }
 
@@ -544,9 +979,17 @@ int gui_app_start_capture(gui_app_t *app) {
     if (r < 0) {
         fprintf(stderr, "[GUI] Failed to start extraction thread\n");
         gui_app_set_status(app, "Failed to start extraction");
-        hsdaoh_stop_stream(app->hs_dev);
-        hsdaoh_close(app->hs_dev);
-        app->hs_dev = NULL;
+        if (dev->type == DEVICE_TYPE_SIMULATED) {
+            gui_simulated_stop(app);
+        } else if (dev->type == DEVICE_TYPE_REPLAY) {
+            replay_stop(app->replay);
+            app->replay = NULL;
+        } else {
+            hsdaoh_stop_stream(app->hs_dev);
+            hsdaoh_close(app->hs_dev);
+            app->hs_dev = NULL;
+        }
+        parser_stop();
         app->is_capturing = false;
         return -1;
     }
@@ -566,12 +1009,14 @@ void gui_app_stop_capture(gui_app_t *app) {
         gui_app_stop_recording(app);
     }
 
-    // Check if this is a simulated capture
-    device_info_t *dev = &app->devices[app->selected_device];
-    if (dev->type == DEVICE_TYPE_SIMULATED) {
+    // Check if this is a simulated capture, frames from it went through extraction
+    if (app->active_device.type == DEVICE_TYPE_SIMULATED) {
         gui_simulated_stop(app);
-        gui_app_clear_display(app);
-        return;
+        if (!gui_extract_is_running()) {
+            parser_stop();
+            gui_app_clear_display(app);
+            return;
+        }
     }
 
     // Set is_capturing to false BEFORE stopping extraction thread
@@ -586,6 +1031,11 @@ void gui_app_stop_capture(gui_app_t *app) {
         hsdaoh_close(app->hs_dev);
         app->hs_dev = NULL;
     }
+    if (app->replay) {
+        replay_stop(app->replay);
+        app->replay = NULL;
+    }
+    parser_stop();
 
     atomic_store(&app->stream_synced, false);
 
@@ -597,6 +1047,11 @@ void gui_app_stop_capture(gui_app_t *app) {
     uint32_t drops = atomic_load(&app->rb_drop_count);
     fprintf(stderr, "[GUI] Capture stopped: %u frames, %u missed, %u errors, %u waits, %u drops\n",
             frames, missed, errors, waits, drops);
+    if (s_frame_queue) {
+        fprintf(stderr, "[GUI] Frame queue: up to %u of %u frames queued, %llu dropped\n",
+                frame_queue_high_water(s_frame_queue), frame_queue_depth(s_frame_queue),
+                (unsigned long long)frame_queue_dropped(s_frame_queue));
+    }
 
     // Clear display to show "No Signal"
     gui_app_clear_display(app);
@@ -670,19 +1125,17 @@ void gui_app_update_vu_meters(gui_app_t *app, float dt) {
 }
 
 // Update display buffer (called from main thread)
-// Note: Display is now updated by the continuous extraction thread
+// Note: Display is now updated by the display thread
 void gui_app_update_display_buffer(gui_app_t *app) {
     (void)app;
-    // No-op: extraction thread handles display updates continuously
+    // No-op: the display thread handles display updates continuously
 }
 
 // Clear display buffer and reset VU meters (called when device disconnects)
 void gui_app_clear_display(gui_app_t *app) {
-    // Clear display samples (per-channel)
-    memset(app->display_samples_a, 0, sizeof(app->display_samples_a));
-    memset(app->display_samples_b, 0, sizeof(app->display_samples_b));
-    app->display_samples_available_a = 0;
-    app->display_samples_available_b = 0;
+    // Clear display frames (per-channel)
+    display_triple_clear(&app->display_a);
+    display_triple_clear(&app->display_b);
 
     // Reset VU meters
     app->vu_a.level_pos = 0;
@@ -704,6 +1157,10 @@ void gui_app_clear_display(gui_app_t *app) {
     atomic_store(&app->peak_a_neg, 0);
     atomic_store(&app->peak_b_pos, 0);
     atomic_store(&app->peak_b_neg, 0);
+    atomic_store(&app->rms_a, 0);
+    atomic_store(&app->rms_b, 0);
+    atomic_store(&app->dc_a, 0);
+    atomic_store(&app->dc_b, 0);
 
     // Reset stream sync status
     atomic_store(&app->stream_synced, false);
@@ -720,6 +1177,15 @@ void gui_app_set_status(gui_app_t *app, const char *message) {
 bool gui_capture_device_timeout(gui_app_t *app, uint32_t timeout_ms) {
     if (!app->is_capturing) return false;
 
+    // A replay that reached the end is not a lost device, reconnecting would start it over
+    if (app->replay) {
+        if (replay_finished(app->replay) && !app->replay_done_reported) {
+            gui_app_set_status(app, "Replay finished");
+            app->replay_done_reported = true;
+        }
+        if (app->replay_done_reported) return false;
+    }
+
     uint64_t last_cb = atomic_load(&app->last_callback_time_ms);
     uint64_t now = get_time_ms();
 
@@ -1,44 +1,73 @@
 /*
  * MISRC GUI - Sample Extraction and Display Processing
  *
- * Continuous extraction thread that runs from capture start to capture stop.
- * - Always reads from capture ringbuffer
- * - Always updates display buffers for GUI
- * - When recording enabled, also writes to record ringbuffers
+ * Two threads run from capture start to capture stop, both reading the
+ * capture ringbuffer:
+ * - The extraction thread is its primary reader. It extracts every block,
+ *   keeps the level meters and, when recording is enabled, writes the
+ *   samples to the record ringbuffers, where the writer threads of the two
+ *   channels convert and encode them.
+ * - The display thread is a lossy fan-out reader. It extracts the blocks
+ *   once more for the oscilloscope, FFT and histogram views, and skips
+ *   blocks when it falls behind, so display work never holds up recording.
  */
 
 #include "gui_extract.h"
 #include "gui_app.h"
 #include "gui_oscilloscope.h"
+#include "gui_trigger.h"
+#include "gui_record.h"
+#include "gui_fft_worker.h"
+#include "gui_histogram.h"
+#include "gui_perf.h"
 #include "../misrc_common/extract.h"
 #include "../misrc_common/ringbuffer.h"
 #include "../misrc_common/rb_event.h"
 #include "../misrc_common/threading.h"
-#include "../misrc_common/buffer.h"
+#include "../misrc_common/buffer_pool.h"
+#include "../misrc_common/thread_role.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdatomic.h>
+#include <math.h>
 
 // External do_exit flag from ringbuffer.h
 extern atomic_int do_exit;
 
 // Buffer sizes
 #define BUFFER_READ_SIZE 65536
-#define BUFFER_RECORD_SIZE (65536 * 1024)  // 64MB per channel
+#define BUFFER_RECORD_SIZE (65536 * 1024)  // 64MB per channel, 16-bit samples for RAW and FLAC, by default
+#define TRIGGER_SAMPLE_RATE 40000000.0      // Capture samples per second, for the pre-roll and post-roll
+
+// Scratch buffers of extraction, display and the packed record writers
+#define POOL_WRITER_BLOCKS 2                // Packing buffers, one per record channel
+static buffer_pool_t *s_pool = NULL;
 
 // Extraction buffers (page-aligned for SSE/AVX)
 static int16_t *s_buf_a = NULL;
 static int16_t *s_buf_b = NULL;
 static uint8_t *s_buf_aux = NULL;
 static conv_function_t s_extract_fn = NULL;
+static conv_stats_t s_stats_fn = NULL;     // 16-bit output, gathers stats in the same pass
+static conv_stats_t s_stats_fn_p = NULL;   // padded 16-bit output for FLAC recording
+static extract_envelope_t s_envelope[BUFFER_READ_SIZE / EXTRACT_STATS_BLOCK];  // Block extremes for the preview
 static bool s_initialized = false;
 
+// Display thread buffers, its own extraction of the blocks it shows
+static int16_t *s_view_a = NULL;
+static int16_t *s_view_b = NULL;
+static uint8_t *s_view_aux = NULL;
+
 // Recording ringbuffers (extracted samples -> file writers)
 static ringbuffer_t s_record_rb_a;
 static ringbuffer_t s_record_rb_b;
 static bool s_record_rb_initialized = false;
+static size_t s_record_size = BUFFER_RECORD_SIZE;
+
+// Capture bytes the trigger pre-roll holds back, not a backlog for the overload policy
+static size_t s_trigger_held = 0;
 
 // Extraction thread state
 static thrd_t s_extract_thread;
@@ -46,6 +75,16 @@ static bool s_extract_thread_running = false;
 static ringbuffer_t *s_capture_rb = NULL;
 static gui_app_t *s_extract_app = NULL;
 
+// Display thread state, a lossy fan-out reader of the capture ringbuffer
+static thrd_t s_display_thread;
+static bool s_display_thread_running = false;
+static atomic_bool s_display_run = false;
+static int s_display_reader = -1;
+
+// Overload policy, created on the first start and kept until cleanup since
+// the capture callback may still run after the extraction thread stopped
+static _Atomic(overload_t *) s_overload = NULL;
+
 // Recording state (atomic for thread-safe access)
 static atomic_bool s_recording_enabled = false;
 static atomic_bool s_use_flac = false;
@@ -55,15 +94,66 @@ static rb_event_t s_data_event;       // Signaled when new data is available in
 static rb_event_t s_space_event;      // Signaled when space becomes available in ringbuffer
 static bool s_events_initialized = false;
 
+// Fill of the fullest buffer between capture and writers, the overload pressure
+static double extract_fill(bool recording) {
+    rb_stats_t stats;
+    double fill = 0.0;
+    ringbuffer_t *rbs[3] = { s_capture_rb, recording ? &s_record_rb_a : NULL, recording ? &s_record_rb_b : NULL };
+    for (int i = 0; i < 3; i++) {
+        if (!rbs[i]) continue;
+        rb_get_stats(rbs[i], &stats);
+        if (i == 0) {
+            stats.fill -= (stats.fill > s_trigger_held) ? s_trigger_held : stats.fill;
+        }
+        if (stats.size && (double)stats.fill / (double)stats.size > fill) {
+            fill = (double)stats.fill / (double)stats.size;
+        }
+    }
+    return fill;
+}
+
+// Set up a trigger from the settings, the rolls are rounded up to whole blocks
+static int trigger_init(record_trigger_t *t, const gui_app_t *app) {
+    return record_trigger_init(t, &app->settings.trigger, BUFFER_READ_SIZE,
+                               (uint64_t)(app->settings.pre_roll * TRIGGER_SAMPLE_RATE),
+                               (uint64_t)(app->settings.post_roll * TRIGGER_SAMPLE_RATE));
+}
+
+// Wait for space in both record ringbuffers - never drop recording data
+// (the capture callback drops RF frames meanwhile, the overload policy sheds the rest)
+// Returns false if exit was requested while waiting
+static bool wait_record_space(size_t bytes, void **write_a, void **write_b) {
+    while ((*write_a = rb_write_ptr(&s_record_rb_a, bytes)) == NULL ||
+           (*write_b = rb_write_ptr(&s_record_rb_b, bytes)) == NULL) {
+        if (atomic_load(&do_exit)) {
+            return false;
+        }
+        overload_update(atomic_load(&s_overload), extract_fill(true));
+        thrd_sleep_ms(1);
+    }
+    return true;
+}
+
 // Extraction thread - runs continuously from capture start to stop
-// Always updates display/stats, conditionally writes to record ringbuffers
+// Always updates the stats, conditionally writes to record ringbuffers.
+// While recording, the kernel writes straight into the record ringbuffers.
+// With a trigger, recording leaves the pre-roll unread in the capture ringbuffer:
+// only the newest block is extracted until an event starts, then the held
+// blocks are extracted once more into the record ringbuffers.
 static int extraction_thread(void *ctx) {
     (void)ctx;
     size_t read_size = BUFFER_READ_SIZE * 4;  // 4 bytes per sample pair
     size_t clip[2] = {0, 0};
-    uint16_t peak[2] = {0, 0};
-
+    extract_stats_t stats;
+    uint64_t read_samples = 0;      // Same count as the capture callback keeps for the index
+    bool index_started = false;
+    record_trigger_t trigger;
+    bool trigger_tried = false;     // Set up for this recording (or failed to)
+    bool triggered = false;         // trigger holds the state
+
+    memset(&trigger, 0, sizeof(trigger));
     fprintf(stderr, "[EXTRACT] Continuous extraction thread started\n");
+    thread_role_apply(THREAD_ROLE_EXTRACT);
 
     while (1) {
         // Check for exit
@@ -71,8 +161,28 @@ static int extraction_thread(void *ctx) {
             break;
         }
 
+        // The trigger starts afresh with every recording, the pre-roll is let go when it stops
+        bool recording = atomic_load(&s_recording_enabled);
+        bool trigger_wanted = recording && s_extract_app && s_extract_app->settings.trigger_on;
+        if (trigger_wanted && !trigger_tried) {
+            trigger_tried = true;
+            triggered = trigger_init(&trigger, s_extract_app) == 0;
+            if (!triggered) {
+                fprintf(stderr, "[EXTRACT] No memory for the trigger, recording everything\n");
+            }
+        } else if (!trigger_wanted && trigger_tried) {
+            if (triggered) {
+                rb_read_finished(s_capture_rb, record_trigger_held_samples(&trigger) * 4);
+                fprintf(stderr, "[EXTRACT] Triggered recording: %llu events\n", (unsigned long long)trigger.events);
+            }
+            record_trigger_free(&trigger);
+            s_trigger_held = 0;
+            trigger_tried = triggered = false;
+        }
+
         // Try to read from capture ringbuffer
-        void *buf = rb_read_ptr(s_capture_rb, read_size);
+        size_t want = triggered ? record_trigger_wanted(&trigger) : BUFFER_READ_SIZE;
+        void *buf = rb_read_ptr(s_capture_rb, want * 4);
         if (!buf) {
             // No data available yet - check if we should exit
             if (!s_extract_app || !s_extract_app->is_capturing) {
@@ -87,89 +197,196 @@ static int extraction_thread(void *ctx) {
             continue;
         }
 
-        // Extract samples
-        s_extract_fn((uint32_t*)buf, BUFFER_READ_SIZE, clip, s_buf_aux, s_buf_a, s_buf_b, peak);
+        overload_update(atomic_load(&s_overload), extract_fill(recording));
+        const uint32_t *words = buf;    // The block extracted this round
+        bool fresh = true;              // Not counted in the stats before
+        size_t consumed = read_size;
+        if (triggered) {
+            if (trigger.remaining) {
+                // The held blocks were counted while the trigger waited
+                fresh = trigger.held == 0;
+            } else {
+                // Waiting for a trigger only the newest block is counted, nothing is recorded
+                words += (size_t)trigger.held * BUFFER_READ_SIZE;
+                recording = false;
+            }
+            record_trigger_action_t action = record_trigger_step(&trigger, buf, read_samples);
+            if (action == RECORD_TRIGGER_START) {
+                fprintf(stderr, "[EXTRACT] Trigger %llu at sample %llu\n",
+                        (unsigned long long)trigger.events, (unsigned long long)trigger.trigger_sample);
+            }
+            if (action == RECORD_TRIGGER_WAIT || action == RECORD_TRIGGER_START) {
+                consumed = 0;
+            }
+            s_trigger_held = record_trigger_held_samples(&trigger) * 4;
+        }
+        bool use_flac = recording && atomic_load(&s_use_flac);
+        size_t record_bytes = 0;
+
+        extract_stats_reset(&stats);
+        if (recording) {
+            void *write_a;
+            void *write_b;
+            // FLAC gets 12-bit to 16-bit extension (padded kernel), RAW the samples as they are,
+            // both stay 16-bit in the ringbuffer and the FLAC writer widens them per block
+            record_bytes = BUFFER_READ_SIZE * sizeof(int16_t);
+            if (!wait_record_space(record_bytes, &write_a, &write_b)) {
+                goto exit_thread;
+            }
+            stats.envelope = s_envelope;
+            uint64_t t_extract = gui_perf_begin();
+            if (use_flac) {
+                s_stats_fn_p((uint32_t*)words, BUFFER_READ_SIZE, clip, s_buf_aux, write_a, write_b, &stats);
+            } else {
+                s_stats_fn((uint32_t*)words, BUFFER_READ_SIZE, clip, s_buf_aux, write_a, write_b, &stats);
+            }
+            gui_perf_end(PERF_STAGE_EXTRACT, t_extract);
+            rb_write_finished(&s_record_rb_a, record_bytes);
+            rb_write_finished(&s_record_rb_b, record_bytes);
+            // The first recorded block is sample 0 of the files
+            sample_index_t *index = gui_record_index_acquire();
+            if (index) {
+                if (!index_started) {
+                    sample_index_event(index, SAMPLE_INDEX_START, read_samples, 0, 0);
+                    index_started = true;
+                }
+                sample_index_aux(index, s_buf_aux, BUFFER_READ_SIZE, read_samples);
+                gui_record_index_release();
+            }
+            // The preview takes the block extremes the kernel kept, and now and then raw words for a spectrum
+            preview_t *preview = gui_record_preview_acquire();
+            if (preview) {
+                preview_push(preview, read_samples, words, s_envelope, BUFFER_READ_SIZE);
+                gui_record_preview_release();
+            }
+        } else {
+            uint64_t t_extract = gui_perf_begin();
+            s_stats_fn((uint32_t*)words, BUFFER_READ_SIZE, clip, s_buf_aux, s_buf_a, s_buf_b, &stats);
+            gui_perf_end(PERF_STAGE_EXTRACT, t_extract);
+            index_started = false;
+        }
+        read_samples += consumed / 4;
 
         // Mark capture buffer as consumed
-        rb_read_finished(s_capture_rb, read_size);
+        if (consumed) {
+            rb_read_finished(s_capture_rb, consumed);
 
-        // Signal that space is now available (for callback waiting on full buffer)
-        if (s_events_initialized) {
-            rb_event_signal(&s_space_event);
+            // Signal that space is now available (for callback waiting on full buffer)
+            if (s_events_initialized) {
+                rb_event_signal(&s_space_event);
+            }
+        }
+        if (!fresh) {
+            continue;
         }
 
-        // Always update stats and display
-        gui_extract_update_stats(s_extract_app, s_buf_a, s_buf_b, BUFFER_READ_SIZE);
-        gui_oscilloscope_update_display(s_extract_app, s_buf_a, s_buf_b, BUFFER_READ_SIZE);
+        // The meters count every sample, the display thread only shows some
+        gui_extract_update_stats(s_extract_app, &stats);
         atomic_fetch_add(&s_extract_app->total_samples, BUFFER_READ_SIZE);
         atomic_fetch_add(&s_extract_app->samples_a, BUFFER_READ_SIZE);
         atomic_fetch_add(&s_extract_app->samples_b, BUFFER_READ_SIZE);
+    }
 
-        // Note: FFT is now processed from display samples in the render thread
-        // (see gui_oscilloscope.c render_oscilloscope_channel split mode)
-
-        // Conditionally write to record ringbuffers
-        if (atomic_load(&s_recording_enabled)) {
-            if (atomic_load(&s_use_flac)) {
-                // FLAC needs 32-bit samples with 12-bit to 16-bit extension
-                size_t sample_bytes = BUFFER_READ_SIZE * sizeof(int32_t);
-
-                // Wait for space in record ringbuffers - never drop recording data
-                int32_t *write_a;
-                int32_t *write_b;
-                while ((write_a = (int32_t *)rb_write_ptr(&s_record_rb_a, sample_bytes)) == NULL ||
-                       (write_b = (int32_t *)rb_write_ptr(&s_record_rb_b, sample_bytes)) == NULL) {
-                    if (atomic_load(&do_exit)) {
-                        goto exit_thread;
-                    }
-                    thrd_sleep_ms(1);
-                }
+exit_thread:
+    record_trigger_free(&trigger);
+    s_trigger_held = 0;
+    fprintf(stderr, "[EXTRACT] Continuous extraction thread exiting\n");
+    return 0;
+}
 
-                // Convert 12-bit samples to 16-bit by left-shifting 4 bits
-                for (size_t i = 0; i < BUFFER_READ_SIZE; i++) {
-                    write_a[i] = (int32_t)s_buf_a[i] << 4;
-                    write_b[i] = (int32_t)s_buf_b[i] << 4;
-                }
-                rb_write_finished(&s_record_rb_a, sample_bytes);
-                rb_write_finished(&s_record_rb_b, sample_bytes);
-            } else {
-                // RAW uses 16-bit samples directly
-                size_t sample_bytes = BUFFER_READ_SIZE * sizeof(int16_t);
-
-                // Wait for space in record ringbuffers - never drop recording data
-                void *write_a;
-                void *write_b;
-                while ((write_a = rb_write_ptr(&s_record_rb_a, sample_bytes)) == NULL ||
-                       (write_b = rb_write_ptr(&s_record_rb_b, sample_bytes)) == NULL) {
-                    if (atomic_load(&do_exit)) {
-                        goto exit_thread;
-                    }
-                    thrd_sleep_ms(1);
-                }
+// Display thread - runs from capture start to stop next to the extraction thread.
+// As a lossy reader of the capture ringbuffer it never makes the capture or the
+// extraction wait, when the views take too long it skips ahead in whole blocks.
+// The overload policy can still give the display up to free the CPU.
+static int display_thread(void *ctx) {
+    (void)ctx;
+    size_t read_size = BUFFER_READ_SIZE * 4;  // 4 bytes per sample pair
+    size_t clip[2] = {0, 0};
+    extract_stats_t stats;
 
-                memcpy(write_a, s_buf_a, sample_bytes);
-                memcpy(write_b, s_buf_b, sample_bytes);
-                rb_write_finished(&s_record_rb_a, sample_bytes);
-                rb_write_finished(&s_record_rb_b, sample_bytes);
-            }
+    thread_role_apply(THREAD_ROLE_DISPLAY);
+
+    while (atomic_load(&s_display_run) && !atomic_load(&do_exit)) {
+        void *buf = rb_reader_read_ptr_wait(s_capture_rb, s_display_reader, read_size, 100);
+        if (!buf) {
+            continue;
+        }
+        if (overload_shed(atomic_load(&s_overload), OVERLOAD_DISPLAY)) {
+            rb_reader_read_finished(s_capture_rb, s_display_reader, read_size);
+            continue;
         }
-    }
 
-exit_thread:
-    fprintf(stderr, "[EXTRACT] Continuous extraction thread exiting\n");
+        extract_stats_reset(&stats);
+        s_stats_fn(buf, BUFFER_READ_SIZE, clip, s_view_aux, s_view_a, s_view_b, &stats);
+        // The capture overwrote the block while it was read, don't show or count it
+        if (rb_reader_read_finished(s_capture_rb, s_display_reader, read_size) == 2) {
+            continue;
+        }
+        gui_histogram_push(s_view_a, s_view_b, BUFFER_READ_SIZE, &stats);
+
+        // CVBS trigger levels of this block, read by the display update that follows
+        trigger_cvbs_levels_from_minmax(stats.min[0], stats.max[0], &s_extract_app->trigger_a.cvbs_levels);
+        trigger_cvbs_levels_from_minmax(stats.min[1], stats.max[1], &s_extract_app->trigger_b.cvbs_levels);
+        gui_oscilloscope_update_display(s_extract_app, s_view_a, s_view_b, BUFFER_READ_SIZE);
+        gui_fft_worker_push(s_view_a, s_view_b, BUFFER_READ_SIZE, atomic_load(&s_extract_app->sample_rate));
+    }
     return 0;
 }
 
+// Start the display thread, the capture runs on without it if that fails
+static void display_start(void) {
+    s_display_reader = rb_reader_add(s_capture_rb, 1);
+    if (s_display_reader < 0) {
+        fprintf(stderr, "[EXTRACT] No free capture ringbuffer reader, no display\n");
+        return;
+    }
+    atomic_store(&s_display_run, true);
+    if (thrd_create(&s_display_thread, display_thread, NULL) != thrd_success) {
+        fprintf(stderr, "[EXTRACT] Failed to create display thread, no display\n");
+        rb_reader_remove(s_capture_rb, s_display_reader);
+        s_display_reader = -1;
+        return;
+    }
+    s_display_thread_running = true;
+}
+
+static void display_stop(void) {
+    if (!s_display_thread_running) {
+        return;
+    }
+    atomic_store(&s_display_run, false);
+    rb_wake(s_capture_rb);
+    thrd_join(s_display_thread, NULL);
+    s_display_thread_running = false;
+    rb_reader_remove(s_capture_rb, s_display_reader);
+    s_display_reader = -1;
+}
+
 void gui_extract_init(void) {
     if (s_initialized) return;
 
-    // Allocate 32-byte aligned buffers for SSE/AVX
-    s_buf_a = (int16_t *)aligned_alloc(32, BUFFER_READ_SIZE * sizeof(int16_t));
-    s_buf_b = (int16_t *)aligned_alloc(32, BUFFER_READ_SIZE * sizeof(int16_t));
-    s_buf_aux = aligned_alloc(16, BUFFER_READ_SIZE);
+    // All scratch buffers in one page-aligned arena, touched once here, recordings
+    // only take the packing buffers from it and hand them back
+    s_pool = buffer_pool_create(0);
+    if (s_pool) {
+        buffer_pool_reserve(s_pool, BUFFER_READ_SIZE * sizeof(int16_t), 4);
+        buffer_pool_reserve(s_pool, BUFFER_READ_SIZE, 2);
+        buffer_pool_reserve(s_pool, PACKED12_SIZE(BUFFER_READ_SIZE), POOL_WRITER_BLOCKS);
+    }
+    if (!s_pool || buffer_pool_commit(s_pool) != 0) {
+        fprintf(stderr, "[EXTRACT] Failed to allocate the scratch buffers\n");
+    }
+    s_buf_a = buffer_pool_get(s_pool, BUFFER_READ_SIZE * sizeof(int16_t));
+    s_buf_b = buffer_pool_get(s_pool, BUFFER_READ_SIZE * sizeof(int16_t));
+    s_buf_aux = buffer_pool_get(s_pool, BUFFER_READ_SIZE);
+    s_view_a = buffer_pool_get(s_pool, BUFFER_READ_SIZE * sizeof(int16_t));
+    s_view_b = buffer_pool_get(s_pool, BUFFER_READ_SIZE * sizeof(int16_t));
+    s_view_aux = buffer_pool_get(s_pool, BUFFER_READ_SIZE);
 
     // Get extraction function (AB mode)
     s_extract_fn = get_conv_function(0, 0, 0, 0, (void*)1, (void*)1);
+    s_stats_fn = get_conv_stats_function(0, 0, (void*)1, (void*)1);
+    s_stats_fn_p = get_conv_stats_function(1, 0, (void*)1, (void*)1);
 
     // Initialize synchronization events
     if (!s_events_initialized) {
@@ -187,6 +404,8 @@ void gui_extract_init(void) {
 void gui_extract_cleanup(void) {
     // Stop extraction thread if running
     gui_extract_stop();
+    gui_histogram_cleanup();
+    overload_free(atomic_exchange(&s_overload, NULL));
 
     // Close record ringbuffers
     if (s_record_rb_initialized) {
@@ -202,20 +421,12 @@ void gui_extract_cleanup(void) {
         s_events_initialized = false;
     }
 
-    // Free extraction buffers
+    // Free extraction buffers, the record writers gave theirs back when they stopped
     if (s_initialized) {
-        if (s_buf_a) {
-            aligned_free(s_buf_a);
-            s_buf_a = NULL;
-        }
-        if (s_buf_b) {
-            aligned_free(s_buf_b);
-            s_buf_b = NULL;
-        }
-        if (s_buf_aux) {
-            aligned_free(s_buf_aux);
-            s_buf_aux = NULL;
-        }
+        buffer_pool_free(s_pool);
+        s_pool = NULL;
+        s_buf_a = s_buf_b = s_view_a = s_view_b = NULL;
+        s_buf_aux = s_view_aux = NULL;
         s_initialized = false;
     }
 }
@@ -230,13 +441,22 @@ int gui_extract_start(gui_app_t *app, ringbuffer_t *capture_rb) {
 
     // Initialize record ringbuffers if needed
     if (!s_record_rb_initialized) {
-        rb_init(&s_record_rb_a, "record_a_rb", BUFFER_RECORD_SIZE);
-        rb_init(&s_record_rb_b, "record_b_rb", BUFFER_RECORD_SIZE);
+        rb_init(&s_record_rb_a, "record_a_rb", s_record_size);
+        rb_init(&s_record_rb_b, "record_b_rb", s_record_size);
         s_record_rb_initialized = true;
     }
 
     // Store context
     s_capture_rb = capture_rb;
+    gui_histogram_clear();
+    if (!atomic_load(&s_overload)) {
+        overload_t *overload = overload_create(&app->settings.overload, "[EXTRACT] ");
+        if (!overload) {
+            fprintf(stderr, "[EXTRACT] No memory for the overload policy, frames are dropped after %d ms\n",
+                    OVERLOAD_RF_WAIT_MS);
+        }
+        atomic_store(&s_overload, overload);
+    }
     s_extract_app = app;
     atomic_store(&s_recording_enabled, false);
     atomic_store(&s_use_flac, false);
@@ -248,7 +468,8 @@ int gui_extract_start(gui_app_t *app, ringbuffer_t *capture_rb) {
     }
 
     s_extract_thread_running = true;
-    fprintf(stderr, "[EXTRACT] Started continuous extraction thread\n");
+    display_start();
+    fprintf(stderr, "[EXTRACT] Started continuous extraction and display threads\n");
     return 0;
 }
 
@@ -260,7 +481,8 @@ void gui_extract_stop(void) {
     // Disable recording first
     atomic_store(&s_recording_enabled, false);
 
-    // Wait for thread to exit
+    // Wait for the threads to exit, the display one does not drain the ringbuffer
+    display_stop();
     thrd_join(s_extract_thread, NULL);
     s_extract_thread_running = false;
     s_extract_app = NULL;
@@ -281,6 +503,19 @@ ringbuffer_t *gui_extract_get_record_rb_b(void) {
     return &s_record_rb_b;
 }
 
+overload_t *gui_extract_get_overload(void) {
+    return atomic_load(&s_overload);
+}
+
+buffer_pool_t *gui_extract_get_pool(void) {
+    if (!s_initialized) gui_extract_init();
+    return s_pool;
+}
+
+ringbuffer_t *gui_extract_get_capture_rb(void) {
+    return s_capture_rb;
+}
+
 void gui_extract_set_recording(bool enabled, bool use_flac) {
     atomic_store(&s_use_flac, use_flac);
     atomic_store(&s_recording_enabled, enabled);
@@ -291,22 +526,43 @@ void gui_extract_set_recording(bool enabled, bool use_flac) {
 
 void gui_extract_reset_record_rbs(void) {
     if (s_record_rb_initialized) {
-        atomic_store(&s_record_rb_a.head, 0);
-        atomic_store(&s_record_rb_a.tail, 0);
-        atomic_store(&s_record_rb_b.head, 0);
-        atomic_store(&s_record_rb_b.tail, 0);
+        rb_reset(&s_record_rb_a);
+        rb_reset(&s_record_rb_b);
+    }
+}
+
+void gui_extract_set_record_size(size_t bytes) {
+    if (!s_record_rb_initialized) {
+        s_record_size = bytes;
     }
 }
 
 void gui_extract_init_record_rbs(void) {
     if (!s_record_rb_initialized) {
-        rb_init(&s_record_rb_a, "record_a_rb", BUFFER_RECORD_SIZE);
-        rb_init(&s_record_rb_b, "record_b_rb", BUFFER_RECORD_SIZE);
+        rb_init(&s_record_rb_a, "record_a_rb", s_record_size);
+        rb_init(&s_record_rb_b, "record_b_rb", s_record_size);
         s_record_rb_initialized = true;
         fprintf(stderr, "[EXTRACT] Record ringbuffers initialized (for simulated capture)\n");
     }
 }
 
+uint64_t gui_extract_trigger_event_samples(const gui_app_t *app) {
+    record_trigger_t t;
+    if (trigger_init(&t, app) != 0) {
+        record_trigger_free(&t);
+        return 0;
+    }
+    uint64_t samples = record_trigger_event_samples(&t);
+    record_trigger_free(&t);
+    return samples;
+}
+
+size_t gui_extract_trigger_held_bytes(const gui_app_t *app) {
+    // The block looked at comes on top of the pre-roll
+    uint64_t pre = (uint64_t)(app->settings.pre_roll * TRIGGER_SAMPLE_RATE);
+    return (size_t)((pre + BUFFER_READ_SIZE - 1) / BUFFER_READ_SIZE + 1) * BUFFER_READ_SIZE * 4;
+}
+
 bool gui_extract_is_recording(bool *use_flac) {
     if (use_flac) {
         *use_flac = atomic_load(&s_use_flac);
@@ -334,44 +590,30 @@ uint8_t *gui_extract_get_buf_aux(void) {
     return s_buf_aux;
 }
 
-void gui_extract_update_stats(gui_app_t *app, const int16_t *buf_a,
-                              const int16_t *buf_b, size_t num_samples) {
-    size_t clip_a_pos = 0, clip_a_neg = 0;
-    size_t clip_b_pos = 0, clip_b_neg = 0;
-    uint16_t peak_a_pos = 0, peak_a_neg = 0;
-    uint16_t peak_b_pos = 0, peak_b_neg = 0;
-
-    // Peak detection uses first 1000 samples
-    size_t peak_samples = (num_samples < 1000) ? num_samples : 1000;
-
-    for (size_t i = 0; i < num_samples; i++) {
-        int16_t sa = buf_a[i];
-        int16_t sb = buf_b[i];
-
-        // Clipping detection (12-bit ADC: +2047 is positive clip, -2048 is negative clip)
-        if (sa >= 2047) clip_a_pos++;
-        else if (sa <= -2048) clip_a_neg++;
-        if (sb >= 2047) clip_b_pos++;
-        else if (sb <= -2048) clip_b_neg++;
-
-        // Peak detection (first N samples only)
-        if (i < peak_samples) {
-            if (sa > 0 && (uint16_t)sa > peak_a_pos) peak_a_pos = (uint16_t)sa;
-            if (sb > 0 && (uint16_t)sb > peak_b_pos) peak_b_pos = (uint16_t)sb;
-            if (sa < 0 && (uint16_t)(-sa) > peak_a_neg) peak_a_neg = (uint16_t)(-sa);
-            if (sb < 0 && (uint16_t)(-sb) > peak_b_neg) peak_b_neg = (uint16_t)(-sb);
-        }
+void gui_extract_update_stats(gui_app_t *app, const extract_stats_t *stats) {
+    int16_t rms[2] = {0, 0};
+    int16_t dc[2] = {0, 0};
+
+    if (stats->count == 0) return;
+
+    for (int c = 0; c < 2; c++) {
+        rms[c] = (int16_t)lrint(sqrt((double)stats->sum_sq[c] / (double)stats->count));
+        dc[c] = (int16_t)lrint((double)stats->sum[c] / (double)stats->count);
     }
 
     // Update atomic counters
-    atomic_fetch_add(&app->clip_count_a_pos, clip_a_pos);
-    atomic_fetch_add(&app->clip_count_a_neg, clip_a_neg);
-    atomic_fetch_add(&app->clip_count_b_pos, clip_b_pos);
-    atomic_fetch_add(&app->clip_count_b_neg, clip_b_neg);
-    atomic_store(&app->peak_a_pos, peak_a_pos);
-    atomic_store(&app->peak_a_neg, peak_a_neg);
-    atomic_store(&app->peak_b_pos, peak_b_pos);
-    atomic_store(&app->peak_b_neg, peak_b_neg);
+    atomic_fetch_add(&app->clip_count_a_pos, stats->clip_pos[0]);
+    atomic_fetch_add(&app->clip_count_a_neg, stats->clip_neg[0]);
+    atomic_fetch_add(&app->clip_count_b_pos, stats->clip_pos[1]);
+    atomic_fetch_add(&app->clip_count_b_neg, stats->clip_neg[1]);
+    atomic_store(&app->peak_a_pos, (uint16_t)(stats->max[0] > 0 ? stats->max[0] : 0));
+    atomic_store(&app->peak_a_neg, (uint16_t)(stats->min[0] < 0 ? -stats->min[0] : 0));
+    atomic_store(&app->peak_b_pos, (uint16_t)(stats->max[1] > 0 ? stats->max[1] : 0));
+    atomic_store(&app->peak_b_neg, (uint16_t)(stats->min[1] < 0 ? -stats->min[1] : 0));
+    atomic_store(&app->rms_a, (uint16_t)rms[0]);
+    atomic_store(&app->rms_b, (uint16_t)rms[1]);
+    atomic_store(&app->dc_a, dc[0]);
+    atomic_store(&app->dc_b, dc[1]);
 }
 
 rb_event_t *gui_extract_get_data_event(void) {
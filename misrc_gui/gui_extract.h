@@ -1,10 +1,12 @@
 /*
  * MISRC GUI - Sample Extraction and Display Processing
  *
- * Continuous extraction thread that runs from capture start to capture stop.
- * - Always reads from capture ringbuffer
- * - Always updates display buffers for GUI
- * - When recording enabled, also writes to record ringbuffers
+ * Extraction and display threads that run from capture start to capture stop.
+ * - The extraction thread reads every block of the capture ringbuffer,
+ *   updates the meters and, when recording is enabled, writes to the record
+ *   ringbuffers
+ * - The display thread reads the same blocks as a lossy fan-out reader and
+ *   updates the views, falling behind it skips blocks instead of stalling
  */
 
 #ifndef GUI_EXTRACT_H
@@ -15,6 +17,9 @@
 #include <stdbool.h>
 #include "../misrc_common/ringbuffer.h"
 #include "../misrc_common/rb_event.h"
+#include "../misrc_common/extract.h"
+#include "../misrc_common/overload_policy.h"
+#include "../misrc_common/buffer_pool.h"
 
 // Forward declarations
 typedef struct gui_app gui_app_t;
@@ -25,11 +30,11 @@ void gui_extract_init(void);
 // Cleanup extraction subsystem
 void gui_extract_cleanup(void);
 
-// Start the extraction thread (call after capture starts)
+// Start the extraction and display threads (call after capture starts)
 // Returns 0 on success, -1 on error
 int gui_extract_start(gui_app_t *app, ringbuffer_t *capture_rb);
 
-// Stop the extraction thread (call before capture stops)
+// Stop the extraction and display threads (call before capture stops)
 void gui_extract_stop(void);
 
 // Check if extraction thread is running
@@ -39,16 +44,31 @@ bool gui_extract_is_running(void);
 ringbuffer_t *gui_extract_get_record_rb_a(void);
 ringbuffer_t *gui_extract_get_record_rb_b(void);
 
+// Get the scratch buffer pool, it holds a packing buffer per record channel
+buffer_pool_t *gui_extract_get_pool(void);
+
+// Get the capture ringbuffer the extraction thread reads from (NULL when stopped)
+ringbuffer_t *gui_extract_get_capture_rb(void);
+
 // Enable/disable recording mode
 // When enabled, extraction thread writes to record ringbuffers
 void gui_extract_set_recording(bool enabled, bool use_flac);
 
+// Set the size of each record ringbuffer, before they are first initialized
+void gui_extract_set_record_size(size_t bytes);
+
 // Reset record ringbuffers (call before starting writer threads)
 void gui_extract_reset_record_rbs(void);
 
 // Initialize record ringbuffers (for simulated capture that doesn't use extraction thread)
 void gui_extract_init_record_rbs(void);
 
+// Capture samples written per trigger event with the trigger settings of app
+uint64_t gui_extract_trigger_event_samples(const gui_app_t *app);
+
+// Capture ringbuffer bytes the trigger pre-roll holds back at most
+size_t gui_extract_trigger_held_bytes(const gui_app_t *app);
+
 // Check if recording is enabled and get FLAC mode
 bool gui_extract_is_recording(bool *use_flac);
 
@@ -63,16 +83,19 @@ int16_t *gui_extract_get_buf_a(void);
 int16_t *gui_extract_get_buf_b(void);
 uint8_t *gui_extract_get_buf_aux(void);
 
-// Update clip counts and peak values from extracted samples
-// Processes sample buffers and updates app's atomic counters
-void gui_extract_update_stats(gui_app_t *app, const int16_t *buf_a,
-                              const int16_t *buf_b, size_t num_samples);
+// Update clip counts, peak, RMS and DC values from the statistics gathered
+// by the extraction kernel and updates app's atomic counters
+void gui_extract_update_stats(gui_app_t *app, const extract_stats_t *stats);
 
 // Update display buffer with min/max decimation
 // Decimates samples to fit display width while preserving peaks
 void gui_extract_update_display(gui_app_t *app, const int16_t *buf_a,
                                 const int16_t *buf_b, size_t num_samples);
 
+// Get the overload policy state of the capture (NULL before the first capture start)
+// The capture callback drops RF frames with it, the FLAC writers step their level down
+overload_t *gui_extract_get_overload(void);
+
 // Get the "data available" event (callback signals this after writing to ringbuffer)
 // Returns NULL if extraction is not initialized
 rb_event_t *gui_extract_get_data_event(void);
@@ -1,7 +1,7 @@
 /*
  * MISRC GUI - FFT Line Spectrum Display with GPU Phosphor Persistence
  *
- * Computes FFT of resampled display waveform and displays as a line-based spectrum
+ * Displays the background FFT worker's spectra as a line-based spectrum
  * using GPU-accelerated phosphor persistence (shared module).
  *
  * Copyright (C) 2024-2025 vrunk11, stefan_o
@@ -18,15 +18,6 @@
 #include <math.h>
 #include <stdio.h>
 
-// Define M_PI if not available (Windows compatibility)
-#ifndef M_PI
-#define M_PI 3.14159265358979323846
-#endif
-
-#if LIBFFTW_ENABLED
-#include <fftw3.h>
-#endif
-
 //-----------------------------------------------------------------------------
 // Availability Check
 //-----------------------------------------------------------------------------
@@ -43,132 +34,6 @@ bool gui_fft_available(void) {
 // FFT Lifecycle Management
 //-----------------------------------------------------------------------------
 
-// Helper: Find smallest power of 2 >= n
-static int ceil_power_of_2(int n) {
-    if (n <= 0) return 1;
-    int power = 1;
-    while (power < n) {
-        power *= 2;
-    }
-    return power;
-}
-
-// Helper: Resize FFT buffers and recreate plan for new size
-static bool fft_resize(fft_state_t *state, int new_size) {
-#if LIBFFTW_ENABLED
-    if (!state) return false;
-
-    // Round up to power of 2 first
-    new_size = ceil_power_of_2(new_size);
-
-    // Clamp to valid range
-    if (new_size < FFT_SIZE_MIN) new_size = FFT_SIZE_MIN;
-    if (new_size > FFT_SIZE_MAX) new_size = FFT_SIZE_MAX;
-
-    // Already the right size?
-    if (state->allocated_size == new_size && state->fftw_plan) {
-        return true;
-    }
-
-    int new_bins = new_size / 2 + 1;
-
-    // Free old resources
-    if (state->fftw_plan) {
-        fftwf_destroy_plan((fftwf_plan)state->fftw_plan);
-        state->fftw_plan = NULL;
-    }
-    if (state->fftw_input) {
-        fftwf_free(state->fftw_input);
-        state->fftw_input = NULL;
-    }
-    if (state->fftw_output) {
-        fftwf_free(state->fftw_output);
-        state->fftw_output = NULL;
-    }
-    if (state->window) {
-        free(state->window);
-        state->window = NULL;
-    }
-    if (state->magnitude) {
-        free(state->magnitude);
-        state->magnitude = NULL;
-    }
-
-    // Allocate new buffers
-    state->fftw_input = (float *)fftwf_malloc(sizeof(float) * new_size);
-    if (!state->fftw_input) {
-        fprintf(stderr, "[FFT] Failed to allocate FFTW input buffer (%d)\n", new_size);
-        return false;
-    }
-
-    state->fftw_output = fftwf_malloc(sizeof(fftwf_complex) * new_bins);
-    if (!state->fftw_output) {
-        fprintf(stderr, "[FFT] Failed to allocate FFTW output buffer (%d bins)\n", new_bins);
-        fftwf_free(state->fftw_input);
-        state->fftw_input = NULL;
-        return false;
-    }
-
-    // Create new FFTW plan
-    state->fftw_plan = fftwf_plan_dft_r2c_1d(new_size, state->fftw_input,
-                                              (fftwf_complex *)state->fftw_output,
-                                              FFTW_ESTIMATE);  // Use ESTIMATE for faster plan creation
-    if (!state->fftw_plan) {
-        fprintf(stderr, "[FFT] Failed to create FFTW plan for size %d\n", new_size);
-        fftwf_free(state->fftw_input);
-        fftwf_free(state->fftw_output);
-        state->fftw_input = NULL;
-        state->fftw_output = NULL;
-        return false;
-    }
-
-    // Allocate Hanning window
-    state->window = (float *)malloc(sizeof(float) * new_size);
-    if (!state->window) {
-        fprintf(stderr, "[FFT] Failed to allocate window buffer (%d)\n", new_size);
-        fftwf_destroy_plan((fftwf_plan)state->fftw_plan);
-        fftwf_free(state->fftw_input);
-        fftwf_free(state->fftw_output);
-        state->fftw_plan = NULL;
-        state->fftw_input = NULL;
-        state->fftw_output = NULL;
-        return false;
-    }
-
-    // Precompute Hanning window coefficients
-    for (int i = 0; i < new_size; i++) {
-        state->window[i] = 0.5f * (1.0f - cosf(2.0f * (float)M_PI * i / (new_size - 1)));
-    }
-
-    // Allocate magnitude buffer
-    state->magnitude = (float *)malloc(sizeof(float) * new_bins);
-    if (!state->magnitude) {
-        fprintf(stderr, "[FFT] Failed to allocate magnitude buffer (%d bins)\n", new_bins);
-        fftwf_destroy_plan((fftwf_plan)state->fftw_plan);
-        fftwf_free(state->fftw_input);
-        fftwf_free(state->fftw_output);
-        free(state->window);
-        state->fftw_plan = NULL;
-        state->fftw_input = NULL;
-        state->fftw_output = NULL;
-        state->window = NULL;
-        return false;
-    }
-    memset(state->magnitude, 0, sizeof(float) * new_bins);
-
-    state->fft_size = new_size;
-    state->fft_bins = new_bins;
-    state->allocated_size = new_size;
-
-    fprintf(stderr, "[FFT] Resized to %d samples (%d bins)\n", new_size, new_bins);
-    return true;
-#else
-    (void)state;
-    (void)new_size;
-    return false;
-#endif
-}
-
 bool gui_fft_init(fft_state_t *state) {
     if (!state) return false;
 
@@ -176,8 +41,10 @@ bool gui_fft_init(fft_state_t *state) {
     memset(state, 0, sizeof(fft_state_t));
 
 #if LIBFFTW_ENABLED
-    // Initialize with minimum size - will be resized on first process call
-    if (!fft_resize(state, FFT_SIZE_MIN)) {
+    // Sized for the largest worker frame, so size changes need no reallocation
+    state->magnitude = (float *)calloc(FFT_WORKER_SIZE_MAX / 2 + 1, sizeof(float));
+    if (!state->magnitude) {
+        fprintf(stderr, "[FFT] Failed to allocate magnitude buffer\n");
         return false;
     }
 
@@ -192,9 +59,6 @@ bool gui_fft_init(fft_state_t *state) {
     state->data_ready = false;
     state->initialized = true;
 
-    fprintf(stderr, "[FFT] Initialized with dynamic sizing (%d-%d samples)\n",
-            FFT_SIZE_MIN, FFT_SIZE_MAX);
-
     return true;
 #else
     fprintf(stderr, "[FFT] FFTW not available, FFT support disabled\n");
@@ -222,26 +86,6 @@ void gui_fft_cleanup(fft_state_t *state) {
     if (!state) return;
 
 #if LIBFFTW_ENABLED
-    if (state->fftw_plan) {
-        fftwf_destroy_plan((fftwf_plan)state->fftw_plan);
-        state->fftw_plan = NULL;
-    }
-
-    if (state->fftw_input) {
-        fftwf_free(state->fftw_input);
-        state->fftw_input = NULL;
-    }
-
-    if (state->fftw_output) {
-        fftwf_free(state->fftw_output);
-        state->fftw_output = NULL;
-    }
-
-    if (state->window) {
-        free(state->window);
-        state->window = NULL;
-    }
-
     if (state->magnitude) {
         free(state->magnitude);
         state->magnitude = NULL;
@@ -254,81 +98,23 @@ void gui_fft_cleanup(fft_state_t *state) {
 }
 
 //-----------------------------------------------------------------------------
-// FFT Processing - Compute FFT from display samples
+// FFT Update - Take over frames from the background worker
 //-----------------------------------------------------------------------------
 
-void gui_fft_process_display(fft_state_t *state, const waveform_sample_t *samples,
-                             size_t count, float display_sample_rate) {
+void gui_fft_update(fft_state_t *state, int channel) {
 #if LIBFFTW_ENABLED
-    if (!state || !state->initialized || !samples) return;
-
-    (void)display_sample_rate; // Used only for frequency axis in render
-
-    // Need minimum samples
-    if (count < FFT_SIZE_MIN) return;
-
-    // Determine FFT size: round UP sample count to nearest power of 2 for zero-padding
-    int target_size = ceil_power_of_2((int)count);
-    if (target_size > FFT_SIZE_MAX) target_size = FFT_SIZE_MAX;
-    if (target_size < FFT_SIZE_MIN) target_size = FFT_SIZE_MIN;
-
-    // Resize if needed
-    if (target_size != state->fft_size) {
-        if (!fft_resize(state, target_size)) {
-            return;  // Resize failed
-        }
-    }
-
-    int fft_size = state->fft_size;
-    int fft_bins = state->fft_bins;
-
-    // Use all available samples (up to fft_size, but typically count < fft_size due to zero-padding)
-    size_t samples_to_use = (count > (size_t)fft_size) ? (size_t)fft_size : count;
-
-    // Calculate DC offset (mean of actual samples) to remove from signal
-    float dc_offset = 0.0f;
-    for (size_t i = 0; i < samples_to_use; i++) {
-        dc_offset += samples[i].value;
-    }
-    dc_offset /= (float)samples_to_use;
-
-    // Zero-pad symmetrically: place windowed data in center of FFT buffer
-    // This preserves phase characteristics better than one-sided padding
-    int pad_total = fft_size - (int)samples_to_use;
-    int pad_left = pad_total / 2;
-    int pad_right = pad_total - pad_left;
-
-    // Zero-pad left side
-    for (int i = 0; i < pad_left; i++) {
-        state->fftw_input[i] = 0.0f;
-    }
-
-    // Apply Hanning window to actual sample data and place in center
-    for (size_t i = 0; i < samples_to_use; i++) {
-        float window_val = 0.5f * (1.0f - cosf(2.0f * (float)M_PI * (float)i / (float)(samples_to_use - 1)));
-        state->fftw_input[pad_left + (int)i] = (samples[i].value - dc_offset) * window_val;
-    }
+    if (!state || !state->initialized) return;
 
-    // Zero-pad right side
-    for (int i = 0; i < pad_right; i++) {
-        state->fftw_input[pad_left + (int)samples_to_use + i] = 0.0f;
+    fft_frame_t frame;
+    if (!gui_fft_worker_acquire(channel, &frame) || frame.seq == state->last_seq) {
+        return;
     }
 
-    // Execute FFT
-    fftwf_execute((fftwf_plan)state->fftw_plan);
-
-    // Compute magnitude in dB, then normalize to 0-1, then apply EMA smoothing
-    fftwf_complex *output = (fftwf_complex *)state->fftw_output;
-    for (int j = 0; j < fft_bins; j++) {
-        float real = output[j][0];
-        float imag = output[j][1];
-        float mag = sqrtf(real * real + imag * imag);
-
-        // Normalize by actual sample count (not padded size) for correct amplitude
-        mag /= (float)samples_to_use;
+    // A new size has nothing to smooth against
+    bool restart = (frame.bins != state->fft_bins);
 
-        // Convert to dB (with small epsilon to avoid log(0))
-        float db = 20.0f * log10f(mag + 1e-10f);
+    for (int j = 0; j < frame.bins; j++) {
+        float db = frame.power_db[j];
 
         // Clamp to dB range
         if (db < FFT_DB_MIN) db = FFT_DB_MIN;
@@ -338,16 +124,18 @@ void gui_fft_process_display(fft_state_t *state, const waveform_sample_t *sample
         float current = (db - FFT_DB_MIN) / (FFT_DB_MAX - FFT_DB_MIN);
 
         // Apply EMA smoothing: smoothed = alpha * previous + (1 - alpha) * current
-        float previous = state->magnitude[j];
+        float previous = restart ? current : state->magnitude[j];
         state->magnitude[j] = FFT_EMA_ALPHA * previous + (1.0f - FFT_EMA_ALPHA) * current;
     }
 
+    state->fft_size = frame.fft_size;
+    state->fft_bins = frame.bins;
+    state->sample_rate = frame.sample_rate;
+    state->last_seq = frame.seq;
     state->data_ready = true;
 #else
     (void)state;
-    (void)samples;
-    (void)count;
-    (void)display_sample_rate;
+    (void)channel;
 #endif
 }
 
@@ -420,13 +208,15 @@ static int fft_measure_text(Font *fonts, const char *text, int fontSize) {
 }
 
 void gui_fft_render(fft_state_t *state, float x, float y,
-                    float width, float height, float display_sample_rate,
+                    float width, float height,
                     Color color, Font *fonts) {
 #if LIBFFTW_ENABLED
     if (!state || !state->initialized) return;
 
     (void)color; // Not used currently
 
+    float display_sample_rate = (float)state->sample_rate;
+
     int rt_width = (int)width;
     int rt_height = (int)height;
 
@@ -447,23 +237,30 @@ void gui_fft_render(fft_state_t *state, float x, float y,
 
         int fft_bins = state->fft_bins;
 
-        // Map FFT bins to render texture width
-        float bin_width = (float)rt_width / (float)(fft_bins - 1);
-
-        for (int bin = 0; bin < fft_bins - 1; bin++) {
-            float intensity1 = state->magnitude[bin];
-            float intensity2 = state->magnitude[bin + 1];
-
-            // X positions for this segment
-            float x1 = bin * bin_width;
-            float x2 = (bin + 1) * bin_width;
+        // Full-rate frames have far more bins than pixels, draw one point per
+        // column from the largest bin it covers so narrow carriers stay visible
+        int points = fft_bins;
+        if (points > rt_width + 1) points = rt_width + 1;
+        float point_width = (float)rt_width / (float)(points - 1);
+
+        float prev_y = 0.0f;
+        for (int p = 0; p < points; p++) {
+            int lo = (int)((int64_t)p * fft_bins / points);
+            int hi = (int)((int64_t)(p + 1) * fft_bins / points);
+            float intensity = state->magnitude[lo];
+            for (int bin = lo + 1; bin < hi; bin++) {
+                if (state->magnitude[bin] > intensity) intensity = state->magnitude[bin];
+            }
 
-            // Y positions based on intensity (0 = bottom, 1 = top)
-            float y1 = rt_height - (intensity1 * rt_height);
-            float y2 = rt_height - (intensity2 * rt_height);
+            // Y position based on intensity (0 = bottom, 1 = top)
+            float py = rt_height - (intensity * rt_height);
 
-            // Draw line segment
-            DrawLineEx((Vector2){x1, y1}, (Vector2){x2, y2}, 1.5f, lineColor);
+            // Draw line segment from the previous point
+            if (p > 0) {
+                DrawLineEx((Vector2){(p - 1) * point_width, prev_y}, (Vector2){p * point_width, py},
+                           1.5f, lineColor);
+            }
+            prev_y = py;
         }
     }
 
@@ -570,7 +367,6 @@ void gui_fft_render(fft_state_t *state, float x, float y,
     (void)y;
     (void)width;
     (void)height;
-    (void)display_sample_rate;
     (void)color;
     (void)fonts;
 #endif
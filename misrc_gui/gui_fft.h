@@ -1,8 +1,10 @@
 /*
  * MISRC GUI - FFT Line Spectrum Display with GPU Phosphor Persistence
  *
- * Computes FFT of resampled display waveform and displays as a line-based spectrum
- * using GPU-accelerated phosphor persistence (same as oscilloscope phosphor).
+ * Displays the spectra published by the background FFT worker (gui_fft_worker.c)
+ * as a line-based spectrum using GPU-accelerated phosphor persistence (same as
+ * oscilloscope phosphor). The FFT itself runs on full-rate samples off the
+ * render thread, this module only smooths and draws the newest frame.
  *
  * Requires FFTW3 single-precision library (fftw3f).
  */
@@ -15,21 +17,16 @@
 #include <stddef.h>
 #include <stdint.h>
 
-// Include gui_app.h for waveform_sample_t definition
-// (it's an anonymous struct so can't be forward-declared)
 #include "gui_app.h"
 #include "gui_phosphor_rt.h"
+#include "gui_fft_worker.h"
 
 //-----------------------------------------------------------------------------
 // FFT Configuration Constants
 //-----------------------------------------------------------------------------
 
-// FFT size limits (dynamically sized based on available samples)
-#define FFT_SIZE_MIN          128    // Minimum FFT size
-#define FFT_SIZE_MAX          4096   // Maximum FFT size (must be <= DISPLAY_BUFFER_SIZE)
-
-// dB range for magnitude normalization
-#define FFT_DB_MIN           -100.0f   // Minimum dB (bottom of display)
+// dB range for magnitude normalization (dBFS, the worker's 64K FFT floor is below -110)
+#define FFT_DB_MIN           -120.0f   // Minimum dB (bottom of display)
 #define FFT_DB_MAX             0.0f   // Maximum dB (top of display)
 
 #define FFT_DECAY_RATE        0.6f   // Per-frame decay (higher = slower fade)
@@ -42,21 +39,14 @@
 //-----------------------------------------------------------------------------
 
 typedef struct fft_state {
-    // FFTW state (opaque pointers to avoid requiring fftw3.h in header)
-    void *fftw_plan;           // fftwf_plan
-    float *fftw_input;         // Input buffer (fft_size floats)
-    void *fftw_output;         // Output buffer (fftwf_complex, fft_bins)
-
-    // Current FFT size (power of 2, dynamically adjusted)
-    int fft_size;              // Current FFT window size
+    // Size of the worker frames currently shown
+    int fft_size;              // FFT window size of the last frame
     int fft_bins;              // Output bins (fft_size/2 + 1)
-    int allocated_size;        // Size of allocated buffers (to know when to reallocate)
-
-    // Hanning window coefficients (precomputed for current size)
-    float *window;             // fft_size floats
+    uint32_t sample_rate;      // Input sample rate of the last frame (for freq axis)
+    uint64_t last_seq;         // Worker frame last taken over
 
     // Current FFT magnitude output (normalized 0-1)
-    float *magnitude;          // fft_bins floats, latest FFT result normalized
+    float *magnitude;          // FFT_WORKER_SIZE_MAX/2+1 floats, smoothed worker frames
 
     // GPU phosphor render texture (shared module)
     phosphor_rt_t phosphor;    // Reusable phosphor persistence effect
@@ -79,7 +69,7 @@ bool gui_fft_available(void);
 // FFT Lifecycle Management
 //-----------------------------------------------------------------------------
 
-// Initialize FFT state with FFTW plan and buffers
+// Initialize FFT state and its magnitude buffer
 // Returns true on success, false on failure or if FFTW not available
 bool gui_fft_init(fft_state_t *state);
 
@@ -90,18 +80,12 @@ void gui_fft_clear(fft_state_t *state);
 void gui_fft_cleanup(fft_state_t *state);
 
 //-----------------------------------------------------------------------------
-// FFT Processing (called from render thread with display samples)
+// FFT Update (called from render thread)
 //-----------------------------------------------------------------------------
 
-// Compute FFT from resampled display waveform samples
-// Called each frame with the current display buffer
-// Parameters:
-//   state: FFT state structure
-//   samples: Resampled waveform samples (from display buffer)
-//   count: Number of samples available
-//   display_sample_rate: Effective sample rate of display data (pixels/sec)
-void gui_fft_process_display(fft_state_t *state, const waveform_sample_t *samples,
-                             size_t count, float display_sample_rate);
+// Take over the newest worker frame of a channel (0 = A, 1 = B)
+// Smooths it into the magnitude buffer, does nothing if no new frame is published
+void gui_fft_update(fft_state_t *state, int channel);
 
 //-----------------------------------------------------------------------------
 // FFT Rendering (called from main/render thread)
@@ -113,11 +97,10 @@ void gui_fft_process_display(fft_state_t *state, const waveform_sample_t *sample
 //   state: FFT state structure
 //   x, y: Screen position
 //   width, height: Display size
-//   display_sample_rate: Effective sample rate of display data (for freq axis)
 //   color: Line color for spectrum
 //   fonts: Font array (index 0 = Inter, index 1 = Space Mono), NULL for default
 void gui_fft_render(fft_state_t *state, float x, float y,
-                    float width, float height, float display_sample_rate,
+                    float width, float height,
                     Color color, Font *fonts);
 
 #endif // GUI_FFT_H
@@ -0,0 +1,588 @@
+/*
+ * MISRC GUI - Background FFT Worker Implementation
+ *
+ * Frame collection is a small handshake between the display thread and
+ * the worker: the worker sets the number of samples it needs and switches
+ * to FILLING, the display thread copies blocks while FILLING and
+ * switches to READY once enough samples are collected. Only one side
+ * touches the collect buffers at a time, so no lock is needed.
+ *
+ * Plans are cached per size and never destroyed while the worker runs.
+ * FFTW's planner is not thread-safe, so the worker and the wisdom thread
+ * share it through a flag. The worker only ever tries to take that flag,
+ * so a long FFTW_PATIENT measurement never stalls a spectrum that already
+ * has a plan.
+ */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L  // nanosleep() in threading.h with -std=c11
+#endif
+
+#include "gui_fft_worker.h"
+#include "gui_perf.h"
+#include "gui_triple.h"
+#include "../misrc_common/rb_event.h"
+#include "../misrc_common/threading.h"
+#include "../misrc_common/buffer.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#if LIBFFTW_ENABLED
+#include <fftw3.h>
+#endif
+
+#ifdef _WIN32
+#include <direct.h>
+#define fft_mkdir(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#define fft_mkdir(path) mkdir(path, 0755)
+#endif
+
+#define FFT_WORKER_LOG2_MIN 10
+#define FFT_WORKER_LOG2_MAX 16
+#define FFT_WORKER_SIZES (FFT_WORKER_LOG2_MAX - FFT_WORKER_LOG2_MIN + 1)
+#define FFT_WISDOM_FILE "fftw3f_wisdom.txt"
+#define FFT_WISDOM_TIMELIMIT 10.0   // Seconds FFTW may spend measuring one size
+
+#define FFT_WORKER_BINS_MAX (FFT_WORKER_SIZE_MAX / 2 + 1)
+#define FFT_WORKER_COLLECT_MAX ((size_t)FFT_WORKER_SIZE_MAX * FFT_WORKER_AVERAGES_MAX)
+
+// Collection handshake states
+enum {
+    COLLECT_IDLE,      // Worker is busy or waiting for the next frame time
+    COLLECT_FILLING,   // Display thread copies blocks into the collect buffers
+    COLLECT_READY      // Collect buffers hold a complete frame for the worker
+};
+
+typedef struct {
+    float *power_db;
+    int bins;
+    int fft_size;
+    int averages;
+    uint32_t sample_rate;
+    uint64_t seq;
+} fft_slot_t;
+
+// Per-channel triple buffer: the worker writes, the renderer reads
+typedef struct {
+    fft_slot_t slots[3];
+    gui_triple_t idx;
+    uint64_t seq;
+} fft_triple_t;
+
+static fft_triple_t s_out[2];
+
+// Collect buffers, owned by whoever the collect state says
+static int16_t *s_collect[2] = { NULL, NULL };
+static size_t s_collect_need = 0;
+static size_t s_collect_have = 0;
+static uint32_t s_collect_rate = 0;
+static atomic_int s_collect_state = COLLECT_IDLE;
+
+// Requested configuration, applied at the start of every frame
+static atomic_int s_cfg_size = FFT_WORKER_SIZE_DEFAULT;
+static atomic_int s_cfg_overlap_pm = (int)(FFT_WORKER_OVERLAP_DEFAULT * 1000.0f);  // per mille
+static atomic_int s_cfg_averages = FFT_WORKER_AVERAGES_DEFAULT;
+
+// Worker thread state
+static thrd_t s_thread;
+static atomic_bool s_running = false;  // Started lazily, extraction may already be pushing
+static atomic_bool s_exit = false;
+static rb_event_t s_event;
+
+// Wisdom thread state
+static thrd_t s_wisdom_thread;
+static bool s_wisdom_running = false;
+static bool s_patient = false;
+#if LIBFFTW_ENABLED
+static atomic_uint s_wisdom_sizes = 0;                 // Bit n: wisdom for size 2^(LOG2_MIN + n)
+static atomic_flag s_planner_busy = ATOMIC_FLAG_INIT;  // Held while the FFTW planner is in use
+#endif
+
+// Helper: Find smallest power of 2 >= n
+static int ceil_power_of_2(int n) {
+    if (n <= 0) return 1;
+    int power = 1;
+    while (power < n) {
+        power *= 2;
+    }
+    return power;
+}
+
+//-----------------------------------------------------------------------------
+// Triple Buffer
+//-----------------------------------------------------------------------------
+
+static void triple_free(fft_triple_t *t) {
+    for (int i = 0; i < 3; i++) {
+        free(t->slots[i].power_db);
+        t->slots[i].power_db = NULL;
+    }
+}
+
+#if LIBFFTW_ENABLED
+
+static bool triple_init(fft_triple_t *t) {
+    memset(t, 0, sizeof(*t));
+    for (int i = 0; i < 3; i++) {
+        t->slots[i].power_db = (float *)calloc(FFT_WORKER_BINS_MAX, sizeof(float));
+        if (!t->slots[i].power_db) return false;
+    }
+    gui_triple_init(&t->idx);
+    return true;
+}
+
+// Writer: make the back slot the newest frame and take over the old middle slot
+static void triple_publish(fft_triple_t *t) {
+    t->slots[t->idx.back].seq = ++t->seq;
+    gui_triple_publish(&t->idx);
+}
+
+//-----------------------------------------------------------------------------
+// Planner Access and Wisdom File
+//-----------------------------------------------------------------------------
+
+static int size_index(int size) {
+    int i = 0;
+    while ((FFT_WORKER_SIZE_MIN << i) < size) i++;
+    return i;
+}
+
+static bool planner_trylock(void) {
+    return !atomic_flag_test_and_set_explicit(&s_planner_busy, memory_order_acquire);
+}
+
+static void planner_lock(void) {
+    while (!planner_trylock()) {
+        thrd_sleep_ms(1);
+    }
+}
+
+static void planner_unlock(void) {
+    atomic_flag_clear_explicit(&s_planner_busy, memory_order_release);
+}
+
+// Build <user config dir>/misrc/fftw3f_wisdom.txt, creating the directory
+// Returns false if no config directory is known
+static bool wisdom_path(char *path, size_t size) {
+    const char *base;
+    const char *sub;
+#ifdef _WIN32
+    base = getenv("APPDATA");
+    sub = "";
+#elif defined(__APPLE__)
+    base = getenv("HOME");
+    sub = "/Library/Application Support";
+#else
+    base = getenv("XDG_CONFIG_HOME");
+    sub = "";
+    if (!base || !base[0]) {
+        base = getenv("HOME");
+        sub = "/.config";
+    }
+#endif
+    if (!base || !base[0]) return false;
+
+    // The parent (e.g. ~/.config) may not exist yet either
+    int n = snprintf(path, size, "%s%s", base, sub);
+    if (n < 0 || (size_t)n >= size) return false;
+    fft_mkdir(path);
+    n = snprintf(path, size, "%s%s/misrc", base, sub);
+    if (n < 0 || (size_t)n >= size) return false;
+    if (fft_mkdir(path) != 0 && errno != EEXIST) {
+        fprintf(stderr, "[FFT] Cannot create config directory %s\n", path);
+        return false;
+    }
+    n = snprintf(path, size, "%s%s/misrc/" FFT_WISDOM_FILE, base, sub);
+    return n >= 0 && (size_t)n < size;
+}
+
+//-----------------------------------------------------------------------------
+// Welch Spectrum
+//-----------------------------------------------------------------------------
+
+typedef struct {
+    int size;
+    fftwf_plan plan;
+    bool wisdom_tried;         // Replanned from wisdom (or wisdom had no plan for this size)
+    float *in;                 // size floats
+    fftwf_complex *out;        // size / 2 + 1 bins
+    float *window;             // Hann window
+    double *acc;               // Accumulated power per bin
+    float gain_db;             // Converts power to dBFS
+} welch_t;
+
+static void welch_free(welch_t *w) {
+    if (w->plan) {
+        planner_lock();
+        fftwf_destroy_plan(w->plan);
+        planner_unlock();
+    }
+    if (w->in) fftwf_free(w->in);
+    if (w->out) fftwf_free(w->out);
+    free(w->window);
+    free(w->acc);
+    memset(w, 0, sizeof(*w));
+}
+
+// Set up a cache entry for a size, planned with FFTW_ESTIMATE until wisdom is there
+// Returns false if the planner is busy or allocation failed, the caller skips the frame
+static bool welch_setup(welch_t *w, int size) {
+    int bins = size / 2 + 1;
+    if (!w->in) {
+        w->in = (float *)fftwf_malloc(sizeof(float) * size);
+        w->out = (fftwf_complex *)fftwf_malloc(sizeof(fftwf_complex) * bins);
+        w->window = (float *)malloc(sizeof(float) * size);
+        w->acc = (double *)malloc(sizeof(double) * bins);
+        if (!w->in || !w->out || !w->window || !w->acc) {
+            fprintf(stderr, "[FFT] Failed to allocate worker buffers (%d)\n", size);
+            welch_free(w);
+            return false;
+        }
+
+        // Precompute Hanning window, a full-scale sine then has |X| = sum(w) / 2
+        double sum = 0.0;
+        for (int i = 0; i < size; i++) {
+            w->window[i] = 0.5f * (1.0f - cosf(2.0f * (float)M_PI * i / (size - 1)));
+            sum += w->window[i];
+        }
+        w->gain_db = (float)(-20.0 * log10(sum / 2.0));
+        w->size = size;
+    }
+
+    if (!planner_trylock()) return false;
+    w->plan = fftwf_plan_dft_r2c_1d(size, w->in, w->out, FFTW_ESTIMATE);
+    planner_unlock();
+    if (!w->plan) {
+        fprintf(stderr, "[FFT] Failed to create FFTW plan for size %d\n", size);
+        return false;
+    }
+    return true;
+}
+
+// Get the cache entry for a size, upgrading it once measured wisdom is available
+static welch_t *welch_get(welch_t *cache, int size) {
+    int idx = size_index(size);
+    welch_t *w = &cache[idx];
+
+    if (!w->plan && !welch_setup(w, size)) {
+        return NULL;
+    }
+
+    if (!w->wisdom_tried && (atomic_load(&s_wisdom_sizes) & (1u << idx)) && planner_trylock()) {
+        // Wisdom makes this instant, nothing is measured and the buffers are not touched
+        unsigned flags = (s_patient ? FFTW_PATIENT : FFTW_MEASURE) | FFTW_WISDOM_ONLY;
+        fftwf_plan p = fftwf_plan_dft_r2c_1d(size, w->in, w->out, flags);
+        if (p) {
+            fftwf_destroy_plan(w->plan);
+            w->plan = p;
+        }
+        planner_unlock();
+        w->wisdom_tried = true;
+    }
+    return w;
+}
+
+// Average the power of `averages` segments `hop` apart into a dBFS spectrum
+static void welch_run(welch_t *w, const int16_t *buf, int hop, int averages, float *power_db) {
+    int size = w->size;
+    int bins = size / 2 + 1;
+    size_t total = (size_t)size + (size_t)(averages - 1) * hop;
+
+    // Remove DC so the window does not smear it into the low bins
+    int64_t sum = 0;
+    for (size_t i = 0; i < total; i++) {
+        sum += buf[i];
+    }
+    float dc = (float)sum / (float)total;
+    const float scale = 1.0f / 2048.0f;
+
+    memset(w->acc, 0, sizeof(double) * bins);
+    for (int s = 0; s < averages; s++) {
+        const int16_t *seg = buf + (size_t)s * hop;
+        for (int i = 0; i < size; i++) {
+            w->in[i] = ((float)seg[i] - dc) * scale * w->window[i];
+        }
+        fftwf_execute(w->plan);
+        for (int j = 0; j < bins; j++) {
+            float re = w->out[j][0];
+            float im = w->out[j][1];
+            w->acc[j] += (double)(re * re + im * im);
+        }
+    }
+
+    double norm = 1.0 / (double)averages;
+    for (int j = 0; j < bins; j++) {
+        power_db[j] = (float)(10.0 * log10(w->acc[j] * norm + 1e-20)) + w->gain_db;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Worker Thread
+//-----------------------------------------------------------------------------
+
+static int fft_worker_thread(void *ctx) {
+    (void)ctx;
+    welch_t cache[FFT_WORKER_SIZES];
+    memset(cache, 0, sizeof(cache));
+    int size = 0, hop = 0, averages = 0;
+    uint64_t next_frame_ms = 0;
+
+    fprintf(stderr, "[FFT] Worker thread started\n");
+
+    while (!atomic_load(&s_exit)) {
+        int state = atomic_load_explicit(&s_collect_state, memory_order_acquire);
+
+        if (state == COLLECT_IDLE) {
+            uint64_t now = get_time_ms();
+            if (now < next_frame_ms) {
+                thrd_sleep_ms((int)(next_frame_ms - now));
+                continue;
+            }
+
+            // Apply the configuration and ask for the next frame
+            size = atomic_load(&s_cfg_size);
+            averages = atomic_load(&s_cfg_averages);
+            hop = size - (int)((int64_t)size * atomic_load(&s_cfg_overlap_pm) / 1000);
+            if (hop < 1) hop = 1;
+            s_collect_need = (size_t)size + (size_t)(averages - 1) * hop;
+            s_collect_have = 0;
+            atomic_store_explicit(&s_collect_state, COLLECT_FILLING, memory_order_release);
+            continue;
+        }
+
+        if (state == COLLECT_FILLING) {
+            rb_event_wait_timeout(&s_event, 100);
+            continue;
+        }
+
+        // COLLECT_READY: the collect buffers are ours until we go back to IDLE
+        next_frame_ms = get_time_ms() + FFT_WORKER_FRAME_MS;
+        welch_t *welch = welch_get(cache, size);
+        if (welch) {
+            for (int c = 0; c < 2; c++) {
+                fft_triple_t *t = &s_out[c];
+                fft_slot_t *slot = &t->slots[t->idx.back];
+                uint64_t t0 = gui_perf_begin();
+                welch_run(welch, s_collect[c], hop, averages, slot->power_db);
+                gui_perf_end(PERF_STAGE_FFT, t0);
+                slot->bins = size / 2 + 1;
+                slot->fft_size = size;
+                slot->averages = averages;
+                slot->sample_rate = s_collect_rate;
+                triple_publish(t);
+            }
+        }
+        atomic_store_explicit(&s_collect_state, COLLECT_IDLE, memory_order_release);
+    }
+
+    for (int i = 0; i < FFT_WORKER_SIZES; i++) {
+        welch_free(&cache[i]);
+    }
+    fprintf(stderr, "[FFT] Worker thread exiting\n");
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+// Wisdom Thread
+//-----------------------------------------------------------------------------
+
+// Load the wisdom file, measure every size it has no plan for and save it
+// again, so only the first launch (or a new FFTW version) pays for measuring
+static int fft_wisdom_thread(void *ctx) {
+    (void)ctx;
+    char path[1024];
+    bool have_path = wisdom_path(path, sizeof(path));
+    unsigned flags = s_patient ? FFTW_PATIENT : FFTW_MEASURE;
+    int measured = 0;
+
+    planner_lock();
+    if (have_path && fftwf_import_wisdom_from_filename(path)) {
+        fprintf(stderr, "[FFT] Loaded wisdom from %s\n", path);
+    }
+    fftwf_set_timelimit(FFT_WISDOM_TIMELIMIT);
+    planner_unlock();
+
+    // Scratch buffers, measuring overwrites them
+    float *in = (float *)fftwf_malloc(sizeof(float) * FFT_WORKER_SIZE_MAX);
+    fftwf_complex *out = (fftwf_complex *)fftwf_malloc(sizeof(fftwf_complex) * FFT_WORKER_BINS_MAX);
+    if (!in || !out) {
+        fprintf(stderr, "[FFT] Failed to allocate wisdom buffers\n");
+        goto done;
+    }
+
+    for (int i = 0; i < FFT_WORKER_SIZES && !atomic_load(&s_exit); i++) {
+        int size = FFT_WORKER_SIZE_MIN << i;
+
+        // One size per lock, so the worker gets the planner in between
+        planner_lock();
+        fftwf_plan p = fftwf_plan_dft_r2c_1d(size, in, out, flags | FFTW_WISDOM_ONLY);
+        if (!p) {
+            if (measured++ == 0) {
+                fprintf(stderr, "[FFT] Measuring FFT plans (%s), spectra use estimated plans until done\n",
+                        s_patient ? "FFTW_PATIENT" : "FFTW_MEASURE");
+            }
+            p = fftwf_plan_dft_r2c_1d(size, in, out, flags);
+        }
+        if (p) {
+            fftwf_destroy_plan(p);
+            atomic_fetch_or(&s_wisdom_sizes, 1u << i);
+        }
+        planner_unlock();
+    }
+
+    if (measured > 0 && have_path && !atomic_load(&s_exit)) {
+        planner_lock();
+        if (fftwf_export_wisdom_to_filename(path)) {
+            fprintf(stderr, "[FFT] Saved wisdom for %d sizes to %s\n", measured, path);
+        } else {
+            fprintf(stderr, "[FFT] Failed to save wisdom to %s\n", path);
+        }
+        planner_unlock();
+    }
+
+done:
+    if (in) fftwf_free(in);
+    if (out) fftwf_free(out);
+    return 0;
+}
+
+#endif // LIBFFTW_ENABLED
+
+//-----------------------------------------------------------------------------
+// Public API
+//-----------------------------------------------------------------------------
+
+int gui_fft_worker_start(void) {
+#if LIBFFTW_ENABLED
+    if (s_running) return 0;
+
+    for (int c = 0; c < 2; c++) {
+        s_collect[c] = (int16_t *)aligned_alloc(ALIGN_AVX, FFT_WORKER_COLLECT_MAX * sizeof(int16_t));
+        if (!s_collect[c] || !triple_init(&s_out[c])) {
+            fprintf(stderr, "[FFT] Failed to allocate worker buffers\n");
+            gui_fft_worker_stop();
+            return -1;
+        }
+    }
+    if (rb_event_init(&s_event) != 0) {
+        fprintf(stderr, "[FFT] Failed to initialize worker event\n");
+        gui_fft_worker_stop();
+        return -1;
+    }
+
+    atomic_store(&s_collect_state, COLLECT_IDLE);
+    atomic_store(&s_exit, false);
+    if (thrd_create(&s_thread, fft_worker_thread, NULL) != thrd_success) {
+        fprintf(stderr, "[FFT] Failed to create worker thread\n");
+        rb_event_destroy(&s_event);
+        gui_fft_worker_stop();
+        return -1;
+    }
+    atomic_store(&s_running, true);
+
+    // Plans of sizes already in the wisdom file are ready right after the import
+    if (thrd_create(&s_wisdom_thread, fft_wisdom_thread, NULL) == thrd_success) {
+        s_wisdom_running = true;
+    } else {
+        fprintf(stderr, "[FFT] Failed to create wisdom thread, using estimated plans\n");
+    }
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+void gui_fft_worker_stop(void) {
+    if (s_running) {
+        atomic_store(&s_exit, true);
+        rb_event_signal(&s_event);
+        if (s_wisdom_running) {
+            thrd_join(s_wisdom_thread, NULL);
+            s_wisdom_running = false;
+        }
+        thrd_join(s_thread, NULL);
+        rb_event_destroy(&s_event);
+        atomic_store(&s_running, false);
+    }
+
+    atomic_store(&s_collect_state, COLLECT_IDLE);
+    for (int c = 0; c < 2; c++) {
+        if (s_collect[c]) {
+            aligned_free(s_collect[c]);
+            s_collect[c] = NULL;
+        }
+        triple_free(&s_out[c]);
+    }
+}
+
+void gui_fft_worker_set_patient(bool patient) {
+    if (!s_running) s_patient = patient;
+}
+
+bool gui_fft_worker_running(void) {
+    return s_running;
+}
+
+void gui_fft_worker_configure(int fft_size, float overlap, int averages) {
+    fft_size = ceil_power_of_2(fft_size);
+    if (fft_size < FFT_WORKER_SIZE_MIN) fft_size = FFT_WORKER_SIZE_MIN;
+    if (fft_size > FFT_WORKER_SIZE_MAX) fft_size = FFT_WORKER_SIZE_MAX;
+    if (!(overlap >= 0.0f)) overlap = 0.0f;
+    if (overlap > FFT_WORKER_OVERLAP_MAX) overlap = FFT_WORKER_OVERLAP_MAX;
+    if (averages < 1) averages = 1;
+    if (averages > FFT_WORKER_AVERAGES_MAX) averages = FFT_WORKER_AVERAGES_MAX;
+
+    atomic_store(&s_cfg_size, fft_size);
+    atomic_store(&s_cfg_overlap_pm, (int)(overlap * 1000.0f + 0.5f));
+    atomic_store(&s_cfg_averages, averages);
+}
+
+void gui_fft_worker_push(const int16_t *buf_a, const int16_t *buf_b,
+                         size_t num_samples, uint32_t sample_rate) {
+    if (!s_running) return;
+    if (atomic_load_explicit(&s_collect_state, memory_order_acquire) != COLLECT_FILLING) return;
+
+    // A frame has to be contiguous, start over if the rate changed mid-frame
+    if (s_collect_have > 0 && s_collect_rate != sample_rate) {
+        s_collect_have = 0;
+    }
+    s_collect_rate = sample_rate;
+
+    size_t n = s_collect_need - s_collect_have;
+    if (n > num_samples) n = num_samples;
+    memcpy(s_collect[0] + s_collect_have, buf_a, n * sizeof(int16_t));
+    memcpy(s_collect[1] + s_collect_have, buf_b, n * sizeof(int16_t));
+    s_collect_have += n;
+
+    if (s_collect_have == s_collect_need) {
+        atomic_store_explicit(&s_collect_state, COLLECT_READY, memory_order_release);
+        rb_event_signal(&s_event);
+    }
+}
+
+bool gui_fft_worker_acquire(int channel, fft_frame_t *frame) {
+    if (!s_running || channel < 0 || channel > 1) return false;
+
+    fft_triple_t *t = &s_out[channel];
+    const fft_slot_t *slot = &t->slots[gui_triple_acquire(&t->idx)];
+    if (slot->seq == 0) return false;
+
+    frame->power_db = slot->power_db;
+    frame->bins = slot->bins;
+    frame->fft_size = slot->fft_size;
+    frame->averages = slot->averages;
+    frame->sample_rate = slot->sample_rate;
+    frame->seq = slot->seq;
+    return true;
+}
@@ -0,0 +1,86 @@
+/*
+ * MISRC GUI - Background FFT Worker
+ *
+ * Computes the spectrum of both channels from full-rate samples on a
+ * thread of its own, so the FFT no longer costs render time and is no
+ * longer limited to the decimated display buffer.
+ *
+ * The display thread hands over raw 12-bit blocks with
+ * gui_fft_worker_push(). Whenever the worker wants a new frame, the pushed
+ * blocks are copied until a Welch frame is complete: `averages` Hann
+ * windowed segments of `fft_size` samples, `overlap` apart. The averaged
+ * power is published per channel through a lock-free triple buffer, the
+ * renderer always gets the newest complete frame and neither side waits.
+ * Frames are produced at most every FFT_WORKER_FRAME_MS, blocks arriving
+ * while the worker is busy or idle are skipped.
+ *
+ * Plans are kept for every size in use, so zooming between sizes costs
+ * nothing after the first frame. A background thread loads FFTW wisdom
+ * from the user config directory (misrc/fftw3f_wisdom.txt), measures any
+ * size the file has no plan for and saves it again. Spectra use
+ * FFTW_ESTIMATE plans until then and switch to the measured plans without
+ * a gap, so only the first launch pays for measuring.
+ *
+ * Requires FFTW3 single-precision library (fftw3f), without it the
+ * worker does not start and no frames are published.
+ */
+
+#ifndef GUI_FFT_WORKER_H
+#define GUI_FFT_WORKER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// FFT sizes (power of 2)
+#define FFT_WORKER_SIZE_MIN        1024
+#define FFT_WORKER_SIZE_MAX        65536
+#define FFT_WORKER_SIZE_DEFAULT    16384
+
+// Welch averaging
+#define FFT_WORKER_AVERAGES_MAX     16
+#define FFT_WORKER_AVERAGES_DEFAULT 8
+#define FFT_WORKER_OVERLAP_DEFAULT  0.5f   // Fraction of a segment shared with the next one
+#define FFT_WORKER_OVERLAP_MAX      0.9f
+
+// Minimum time between two frames of a channel (~60 fps)
+#define FFT_WORKER_FRAME_MS         16
+
+// A published spectrum, valid until the next gui_fft_worker_acquire() of the channel
+typedef struct {
+    const float *power_db;     // bins values, averaged power in dBFS (full-scale sine = 0 dB)
+    int bins;                  // fft_size / 2 + 1
+    int fft_size;
+    int averages;              // Segments averaged into this frame
+    uint32_t sample_rate;      // Sample rate of the input, the last bin is sample_rate / 2
+    uint64_t seq;              // Increments with every published frame of the channel
+} fft_frame_t;
+
+// Measure plans with FFTW_PATIENT instead of FFTW_MEASURE (call before start)
+// Plans only get measured for sizes the wisdom file does not have yet
+void gui_fft_worker_set_patient(bool patient);
+
+// Start the worker thread and the wisdom thread (no-op if running or FFTW is not available)
+// Returns 0 on success, -1 on error
+int gui_fft_worker_start(void);
+
+// Stop the worker thread and free its buffers
+void gui_fft_worker_stop(void);
+
+// Check if the worker thread is running
+bool gui_fft_worker_running(void);
+
+// Set FFT size, segment overlap (0 .. FFT_WORKER_OVERLAP_MAX) and number of
+// averaged segments, values are clamped; takes effect with the next frame
+void gui_fft_worker_configure(int fft_size, float overlap, int averages);
+
+// Hand over a block of extracted samples (called from the display thread)
+// Never blocks, the block is only copied while the worker is collecting a frame
+void gui_fft_worker_push(const int16_t *buf_a, const int16_t *buf_b,
+                         size_t num_samples, uint32_t sample_rate);
+
+// Get the newest frame of a channel (0 = A, 1 = B), called from the render thread
+// Returns false if no frame was published yet
+bool gui_fft_worker_acquire(int channel, fft_frame_t *frame);
+
+#endif // GUI_FFT_WORKER_H
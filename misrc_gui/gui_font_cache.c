@@ -0,0 +1,248 @@
+/*
+ * MISRC GUI - Font Atlas Cache
+ *
+ * Cache file: header, one record per glyph, then the atlas pixels in the
+ * pixel format of the header. All values in host byte order, a file from a
+ * machine of the other byte order fails the magic check and is replaced.
+ */
+
+#include "gui_font_cache.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#define font_mkdir(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#define font_mkdir(path) mkdir(path, 0755)
+#endif
+
+#define FONT_CACHE_MAGIC    "MISRCFNT"
+#define FONT_CACHE_VERSION  1
+#define FONT_CACHE_PADDING  4       // Same glyph padding as LoadFontFromMemory()
+#define FONT_CACHE_PATH_MAX 1024
+
+typedef struct {
+    char magic[8];              // FONT_CACHE_MAGIC, not terminated
+    uint32_t version;
+    uint32_t raylib_version;    // The rasterizer may change between raylib releases
+    uint64_t data_hash;         // FNV-1a of the TTF data
+    uint32_t data_size;
+    int32_t font_size;
+    int32_t glyph_count;
+    int32_t glyph_padding;
+    int32_t atlas_width;
+    int32_t atlas_height;
+    int32_t atlas_format;
+    int32_t reserved;
+} font_cache_header_t;
+
+typedef struct {
+    int32_t value;
+    int32_t offset_x;
+    int32_t offset_y;
+    int32_t advance_x;
+    float rec[4];               // x, y, width, height in the atlas
+} font_cache_glyph_t;
+
+static uint64_t fnv1a(const unsigned char *data, int size) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (int i = 0; i < size; i++) {
+        h ^= data[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+// Build <user cache dir>/misrc/font_<name>_<size>.bin, creating the directory
+// Returns false if no cache directory is known
+static bool cache_path(char *path, size_t size, const char *name, int font_size) {
+    const char *base;
+    const char *sub;
+#ifdef _WIN32
+    base = getenv("LOCALAPPDATA");
+    sub = "";
+#elif defined(__APPLE__)
+    base = getenv("HOME");
+    sub = "/Library/Caches";
+#else
+    base = getenv("XDG_CACHE_HOME");
+    sub = "";
+    if (!base || !base[0]) {
+        base = getenv("HOME");
+        sub = "/.cache";
+    }
+#endif
+    if (!base || !base[0]) return false;
+
+    // The parent (e.g. ~/.cache) may not exist yet either
+    int n = snprintf(path, size, "%s%s", base, sub);
+    if (n < 0 || (size_t)n >= size) return false;
+    font_mkdir(path);
+    n = snprintf(path, size, "%s%s/misrc", base, sub);
+    if (n < 0 || (size_t)n >= size) return false;
+    if (font_mkdir(path) != 0 && errno != EEXIST) {
+        fprintf(stderr, "[FONT] Cannot create cache directory %s\n", path);
+        return false;
+    }
+    n = snprintf(path, size, "%s%s/misrc/font_%s_%d.bin", base, sub, name, font_size);
+    return n >= 0 && (size_t)n < size;
+}
+
+static void header_init(font_cache_header_t *h, const unsigned char *data, int data_size,
+                        int font_size, int glyph_count) {
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, FONT_CACHE_MAGIC, sizeof(h->magic));
+    h->version = FONT_CACHE_VERSION;
+    h->raylib_version = RAYLIB_VERSION_MAJOR * 100 + RAYLIB_VERSION_MINOR;
+    h->data_hash = fnv1a(data, data_size);
+    h->data_size = (uint32_t)data_size;
+    h->font_size = font_size;
+    h->glyph_count = glyph_count;
+    h->glyph_padding = FONT_CACHE_PADDING;
+}
+
+// Load the font from the cache file if its key matches
+static bool cache_read(const char *path, const font_cache_header_t *key, Font *font) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return false;
+
+    font_cache_header_t h;
+    GlyphInfo *glyphs = NULL;
+    Rectangle *recs = NULL;
+    unsigned char *pixels = NULL;
+    bool ok = false;
+
+    if (fread(&h, sizeof(h), 1, f) != 1) goto done;
+    // Everything up to the atlas size has to match what would be rasterized
+    if (memcmp(&h, key, offsetof(font_cache_header_t, atlas_width)) != 0) goto done;
+    if (h.atlas_width <= 0 || h.atlas_height <= 0 || h.atlas_width > 16384 || h.atlas_height > 16384) goto done;
+    int pixel_bytes = GetPixelDataSize(h.atlas_width, h.atlas_height, h.atlas_format);
+    if (pixel_bytes <= 0) goto done;
+
+    glyphs = (GlyphInfo *)MemAlloc((unsigned int)(h.glyph_count * sizeof(GlyphInfo)));
+    recs = (Rectangle *)MemAlloc((unsigned int)(h.glyph_count * sizeof(Rectangle)));
+    pixels = (unsigned char *)MemAlloc((unsigned int)pixel_bytes);
+    if (!glyphs || !recs || !pixels) goto done;
+
+    for (int i = 0; i < h.glyph_count; i++) {
+        font_cache_glyph_t g;
+        if (fread(&g, sizeof(g), 1, f) != 1) goto done;
+        glyphs[i] = (GlyphInfo){ .value = g.value, .offsetX = g.offset_x, .offsetY = g.offset_y,
+                                 .advanceX = g.advance_x };
+        recs[i] = (Rectangle){ g.rec[0], g.rec[1], g.rec[2], g.rec[3] };
+    }
+    if (fread(pixels, 1, (size_t)pixel_bytes, f) != (size_t)pixel_bytes || fgetc(f) != EOF) goto done;
+
+    Image atlas = { .data = pixels, .width = h.atlas_width, .height = h.atlas_height,
+                    .mipmaps = 1, .format = h.atlas_format };
+    font->texture = LoadTextureFromImage(atlas);
+    if (font->texture.id == 0) goto done;
+
+    font->baseSize = h.font_size;
+    font->glyphCount = h.glyph_count;
+    font->glyphPadding = h.glyph_padding;
+    font->glyphs = glyphs;
+    font->recs = recs;
+    glyphs = NULL;
+    recs = NULL;
+    ok = true;
+
+done:
+    fclose(f);
+    MemFree(glyphs);
+    MemFree(recs);
+    MemFree(pixels);
+    return ok;
+}
+
+// Write the cache file through a temporary file, so a reader never sees half of it
+static void cache_write(const char *path, const font_cache_header_t *key, const Font *font, Image atlas) {
+    char tmp[FONT_CACHE_PATH_MAX + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "wb");
+    if (!f) {
+        fprintf(stderr, "[FONT] Cannot write font cache %s\n", tmp);
+        return;
+    }
+
+    font_cache_header_t h = *key;
+    h.atlas_width = atlas.width;
+    h.atlas_height = atlas.height;
+    h.atlas_format = atlas.format;
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+
+    for (int i = 0; ok && i < font->glyphCount; i++) {
+        font_cache_glyph_t g = {
+            .value = font->glyphs[i].value,
+            .offset_x = font->glyphs[i].offsetX,
+            .offset_y = font->glyphs[i].offsetY,
+            .advance_x = font->glyphs[i].advanceX,
+            .rec = { font->recs[i].x, font->recs[i].y, font->recs[i].width, font->recs[i].height },
+        };
+        ok = fwrite(&g, sizeof(g), 1, f) == 1;
+    }
+    size_t pixel_bytes = (size_t)GetPixelDataSize(atlas.width, atlas.height, atlas.format);
+    if (ok) ok = fwrite(atlas.data, 1, pixel_bytes, f) == pixel_bytes;
+    if (fclose(f) != 0) ok = false;
+
+#ifdef _WIN32
+    // rename() does not replace an existing file on Windows
+    if (ok) remove(path);
+#endif
+    if (!ok || rename(tmp, path) != 0) {
+        fprintf(stderr, "[FONT] Failed to write font cache %s\n", path);
+        remove(tmp);
+        return;
+    }
+    fprintf(stderr, "[FONT] Saved font atlas to %s\n", path);
+}
+
+Font gui_font_cache_load(const char *name, const unsigned char *data, int data_size,
+                         int font_size, int glyph_count) {
+    Font font = { 0 };
+    font_cache_header_t key;
+    header_init(&key, data, data_size, font_size, glyph_count);
+
+    char path[FONT_CACHE_PATH_MAX];
+    bool have_path = cache_path(path, sizeof(path), name, font_size);
+    if (have_path && cache_read(path, &key, &font)) {
+        return font;
+    }
+
+    // Rasterize like LoadFontFromMemory(), codepoints from 32 on
+    font.baseSize = font_size;
+    font.glyphCount = glyph_count;
+    font.glyphPadding = FONT_CACHE_PADDING;
+    font.glyphs = LoadFontData(data, data_size, font_size, NULL, glyph_count, FONT_DEFAULT);
+    if (!font.glyphs) {
+        return (Font){ 0 };
+    }
+    Image atlas = GenImageFontAtlas(font.glyphs, &font.recs, glyph_count, font_size, FONT_CACHE_PADDING, 0);
+    font.texture = LoadTextureFromImage(atlas);
+    if (font.texture.id == 0) {
+        UnloadImage(atlas);
+        UnloadFontData(font.glyphs, font.glyphCount);
+        MemFree(font.recs);
+        return (Font){ 0 };
+    }
+
+    // The atlas has everything that is drawn, the glyph images are not needed
+    for (int i = 0; i < glyph_count; i++) {
+        UnloadImage(font.glyphs[i].image);
+        font.glyphs[i].image = (Image){ 0 };
+    }
+
+    if (have_path) {
+        cache_write(path, &key, &font, atlas);
+    }
+    UnloadImage(atlas);
+    return font;
+}
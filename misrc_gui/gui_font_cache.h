@@ -0,0 +1,28 @@
+/*
+ * MISRC GUI - Font Atlas Cache
+ *
+ * Rasterizing the embedded TTF fonts is the largest part of the startup
+ * time on slow machines. The glyph atlas and metrics of each font are kept
+ * in the user cache directory (misrc/font_<name>_<size>.bin), later
+ * launches only upload the atlas texture. The cache file is keyed by a
+ * hash of the font data and the rasterization parameters, a stale or
+ * damaged file is rasterized again and overwritten.
+ *
+ * Glyph images are not kept (they are only used by raylib's ImageText*
+ * functions), the atlas texture and the glyph rectangles and metrics are.
+ */
+
+#ifndef GUI_FONT_CACHE_H
+#define GUI_FONT_CACHE_H
+
+#include "raylib.h"
+
+// Load a TTF font from memory like LoadFontFromMemory() (glyph_count codepoints
+// from 32 on, at font_size), from the atlas cache when it matches (needs an
+// OpenGL context)
+// name: part of the cache file name, unique per font
+// Returns a font with texture.id == 0 on error, free it with UnloadFont()
+Font gui_font_cache_load(const char *name, const unsigned char *data, int data_size,
+                         int font_size, int glyph_count);
+
+#endif // GUI_FONT_CACHE_H
@@ -0,0 +1,43 @@
+/*
+ * MISRC GUI - GLSL Version Macros
+ *
+ * Lets the embedded shaders be written once for desktop OpenGL 3.3,
+ * OpenGL ES 2 and OpenGL ES 3 (raylib's GRAPHICS_API_* defines).
+ */
+
+#ifndef GUI_GLSL_H
+#define GUI_GLSL_H
+
+#if defined(GRAPHICS_API_OPENGL_ES2)
+    #define GLSL_VERSION_STRING "#version 100\n"
+    #define GLSL_PRECISION "precision mediump float;\n"
+    #define GLSL_IN "attribute "
+    #define GLSL_OUT "varying "
+    #define GLSL_FRAG_IN "varying "
+    #define GLSL_FRAG_OUT ""
+    #define GLSL_FRAG_COLOR "gl_FragColor"
+    #define GLSL_TEXTURE "texture2D"
+    #define GLSL_HAS_TEXEL_FETCH 0     // Vertex texture fetch is optional on ES 2
+#elif defined(GRAPHICS_API_OPENGL_ES3)
+    #define GLSL_VERSION_STRING "#version 300 es\n"
+    #define GLSL_PRECISION "precision mediump float;\n"
+    #define GLSL_IN "in "
+    #define GLSL_OUT "out "
+    #define GLSL_FRAG_IN "in "
+    #define GLSL_FRAG_OUT "out vec4 finalColor;\n"
+    #define GLSL_FRAG_COLOR "finalColor"
+    #define GLSL_TEXTURE "texture"
+    #define GLSL_HAS_TEXEL_FETCH 1
+#else  // Desktop OpenGL 3.3+
+    #define GLSL_VERSION_STRING "#version 330\n"
+    #define GLSL_PRECISION ""
+    #define GLSL_IN "in "
+    #define GLSL_OUT "out "
+    #define GLSL_FRAG_IN "in "
+    #define GLSL_FRAG_OUT "out vec4 finalColor;\n"
+    #define GLSL_FRAG_COLOR "finalColor"
+    #define GLSL_TEXTURE "texture"
+    #define GLSL_HAS_TEXEL_FETCH 1
+#endif
+
+#endif // GUI_GLSL_H
@@ -0,0 +1,242 @@
+/*
+ * MISRC GUI - ADC Code Histogram Display Implementation
+ */
+
+#include "gui_histogram.h"
+#include "gui_ui.h"
+#include "gui_triple.h"
+#include "../misrc_common/code_histogram.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <math.h>
+
+//-----------------------------------------------------------------------------
+// Published Histograms (display thread -> render thread)
+//-----------------------------------------------------------------------------
+
+typedef struct {
+    uint64_t bins[2][CODE_HIST_BINS];
+    code_hist_metrics_t metrics[2];
+} histogram_snapshot_t;
+
+static histogram_snapshot_t s_slots[3];
+static gui_triple_t s_triple = GUI_TRIPLE_INIT;  // Display thread writes, render thread reads
+
+// Display thread side
+static code_hist_t *s_hist = NULL;
+static extract_stats_t s_hist_stats;
+static int s_blocks = 0;
+static bool s_counting = false;
+static bool s_alloc_failed = false;
+
+static atomic_int s_views = 0;          // Open histogram views
+static atomic_bool s_clear = false;
+
+static void histogram_publish(void) {
+    histogram_snapshot_t *snap = &s_slots[s_triple.back];
+    for (int ch = 0; ch < 2; ch++) {
+        code_hist_metrics(s_hist, ch, &s_hist_stats, &snap->metrics[ch]);
+    }
+    memcpy(snap->bins, s_hist->bins, sizeof(snap->bins));
+    gui_triple_publish(&s_triple);
+}
+
+static const histogram_snapshot_t *histogram_acquire(void) {
+    return &s_slots[gui_triple_acquire(&s_triple)];
+}
+
+void gui_histogram_push(const int16_t *a, const int16_t *b, size_t num_samples, const extract_stats_t *stats) {
+    if (atomic_load(&s_views) == 0) {
+        s_counting = false;
+        return;
+    }
+    if (!s_hist) {
+        if (s_alloc_failed) return;
+        s_hist = code_hist_new(GUI_HISTOGRAM_STRIDE);
+        if (!s_hist) {
+            fprintf(stderr, "[HIST] No memory for the code histogram\n");
+            s_alloc_failed = true;
+            return;
+        }
+    }
+    // A histogram started before the view was opened or the capture restarted is stale
+    if (atomic_exchange(&s_clear, false) || !s_counting) {
+        code_hist_reset(s_hist);
+        extract_stats_reset(&s_hist_stats);
+        s_blocks = 0;
+        s_counting = true;
+    }
+
+    code_hist_add_samples(s_hist, a, b, num_samples);
+    extract_stats_merge(&s_hist_stats, stats);
+    if (++s_blocks < GUI_HISTOGRAM_PERIOD_BLOCKS) return;
+
+    histogram_publish();
+    code_hist_reset(s_hist);
+    extract_stats_reset(&s_hist_stats);
+    s_blocks = 0;
+}
+
+void gui_histogram_clear(void) {
+    atomic_store(&s_clear, true);
+}
+
+void gui_histogram_cleanup(void) {
+    code_hist_free(s_hist);
+    s_hist = NULL;
+    s_counting = false;
+    s_alloc_failed = false;
+}
+
+//-----------------------------------------------------------------------------
+// Views
+//-----------------------------------------------------------------------------
+
+histogram_view_t *gui_histogram_view_create(void) {
+    histogram_view_t *view = calloc(1, sizeof(histogram_view_t));
+    if (view) atomic_fetch_add(&s_views, 1);
+    return view;
+}
+
+void gui_histogram_view_destroy(histogram_view_t *view) {
+    if (!view) return;
+    atomic_fetch_sub(&s_views, 1);
+    free(view->columns);
+    free(view);
+}
+
+//-----------------------------------------------------------------------------
+// Rendering
+//-----------------------------------------------------------------------------
+
+// Helper to draw text with font (index 0 = Inter, 1 = Space Mono)
+static void histogram_draw_text(Font *fonts, int font, const char *text, float px, float py,
+                                int fontSize, Color color) {
+    if (fonts) {
+        DrawTextEx(fonts[font], text, (Vector2){px, py}, (float)fontSize, 1.0f, color);
+    } else {
+        DrawText(text, (int)px, (int)py, fontSize, color);
+    }
+}
+
+// Helper to measure text with font
+static int histogram_measure_text(Font *fonts, const char *text, int fontSize) {
+    if (fonts) {
+        return (int)MeasureTextEx(fonts[0], text, (float)fontSize, 1.0f).x;
+    }
+    return MeasureText(text, fontSize);
+}
+
+// Code range shown: the occupied range with a margin, at least GUI_HISTOGRAM_MIN_CODES wide
+static void histogram_code_range(const code_hist_metrics_t *m, int *lo, int *hi) {
+    int margin = (m->max - m->min) / 16 + 1;
+    int a = m->min - margin;
+    int b = m->max + margin;
+    if (b - a + 1 < GUI_HISTOGRAM_MIN_CODES) {
+        int mid = (a + b) / 2;
+        a = mid - GUI_HISTOGRAM_MIN_CODES / 2;
+        b = a + GUI_HISTOGRAM_MIN_CODES - 1;
+    }
+    if (a < -CODE_HIST_BINS / 2) a = -CODE_HIST_BINS / 2;
+    if (b > CODE_HIST_BINS / 2 - 1) b = CODE_HIST_BINS / 2 - 1;
+    *lo = a;
+    *hi = b;
+}
+
+void gui_histogram_render(histogram_view_t *view, int channel, float x, float y,
+                          float width, float height, Color color, Font *fonts) {
+    const histogram_snapshot_t *snap = histogram_acquire();
+    const code_hist_metrics_t *m = &snap->metrics[channel];
+    const uint64_t *bins = snap->bins[channel];
+    const float mark_h = 6.0f;   // Strip below the bars for the missing code marks
+
+    DrawRectangle((int)x, (int)y, (int)width, (int)height, COLOR_METER_BG);
+
+    if (m->samples == 0 || !view) {
+        const char *text = "Collecting Histogram...";
+        int text_width = histogram_measure_text(fonts, text, FONT_SIZE_OSC_MSG);
+        histogram_draw_text(fonts, 0, text, x + width / 2 - text_width / 2, y + height / 2 - 12,
+                            FONT_SIZE_OSC_MSG, COLOR_TEXT_DIM);
+    } else {
+        int lo, hi;
+        histogram_code_range(m, &lo, &hi);
+        int codes = hi - lo + 1;
+        int columns = (int)width < codes ? (int)width : codes;
+        if (columns < 1) columns = 1;
+
+        if (view->num_columns < columns) {
+            float *c = realloc(view->columns, (size_t)columns * sizeof(float));
+            if (!c) return;
+            view->columns = c;
+            view->num_columns = columns;
+        }
+
+        // Largest count per column, so single codes never disappear when zoomed out
+        uint64_t peak = 1;
+        for (int c = 0; c < columns; c++) {
+            int first = lo + (int)((int64_t)c * codes / columns);
+            int last = lo + (int)((int64_t)(c + 1) * codes / columns);
+            uint64_t v = 0;
+            for (int code = first; code < last; code++) {
+                uint64_t n = bins[code + CODE_HIST_BINS / 2];
+                if (n > v) v = n;
+            }
+            if (v > peak) peak = v;
+            view->columns[c] = (float)v;
+        }
+
+        // Log scale, the tails of a signal are orders of magnitude below its peak
+        float plot_h = height - mark_h;
+        float col_w = width / (float)columns;
+        float log_peak = log10f(1.0f + (float)peak);
+        Color bar = color;
+        bar.a = 200;
+        for (int c = 0; c < columns; c++) {
+            if (view->columns[c] <= 0.0f) continue;
+            float bh = plot_h * log10f(1.0f + view->columns[c]) / log_peak;
+            DrawRectangleV((Vector2){x + c * col_w, y + plot_h - bh}, (Vector2){col_w, bh}, bar);
+        }
+
+        // Missing codes inside the signal range
+        float code_w = width / (float)codes;
+        for (int code = m->min; code <= m->max; code++) {
+            if (bins[code + CODE_HIST_BINS / 2] != 0) continue;
+            float mx = x + (float)(code - lo) * code_w;
+            DrawRectangleV((Vector2){mx, y + plot_h}, (Vector2){code_w < 1.0f ? 1.0f : code_w, mark_h},
+                           COLOR_CLIP_RED);
+        }
+
+        // Code range at the bottom corners
+        char buf[96];
+        snprintf(buf, sizeof(buf), "%d", lo);
+        histogram_draw_text(fonts, 1, buf, x + 5, y + plot_h - 18, FONT_SIZE_OSC_SCALE, COLOR_TEXT_DIM);
+        snprintf(buf, sizeof(buf), "%d", hi);
+        int hi_w = histogram_measure_text(fonts, buf, FONT_SIZE_OSC_SCALE);
+        histogram_draw_text(fonts, 1, buf, x + width - hi_w - 5, y + plot_h - 18, FONT_SIZE_OSC_SCALE,
+                            COLOR_TEXT_DIM);
+
+        // Signal quality figures
+        float ty = y + 6;
+        snprintf(buf, sizeof(buf), "DC %+.1f  RMS %.1f  Crest %.2f", m->dc, m->rms, m->crest);
+        histogram_draw_text(fonts, 1, buf, x + 8, ty, FONT_SIZE_STATS, COLOR_TEXT);
+        ty += FONT_SIZE_STATS + 4;
+        snprintf(buf, sizeof(buf), "%.2f effective bits, %u codes used", m->effective_bits, m->codes_used);
+        histogram_draw_text(fonts, 1, buf, x + 8, ty, FONT_SIZE_STATS, COLOR_TEXT);
+        ty += FONT_SIZE_STATS + 4;
+        snprintf(buf, sizeof(buf), "%u missing in %d .. %d", m->codes_missing, m->min, m->max);
+        histogram_draw_text(fonts, 1, buf, x + 8, ty, FONT_SIZE_STATS,
+                            m->codes_missing ? COLOR_CLIP_RED : COLOR_TEXT);
+    }
+
+    // Border (same as oscilloscope)
+    DrawRectangleLinesEx((Rectangle){x, y, width, height}, 1, COLOR_GRID_MAJOR);
+
+    // Label in top-right corner (matching oscilloscope channel label style)
+    const char *label = "Histogram";
+    int label_width = histogram_measure_text(fonts, label, FONT_SIZE_OSC_LABEL);
+    histogram_draw_text(fonts, 0, label, x + width - label_width - 8, y + 4,
+                        FONT_SIZE_OSC_LABEL, COLOR_TEXT);
+}
@@ -0,0 +1,57 @@
+/*
+ * MISRC GUI - ADC Code Histogram Display
+ *
+ * Shows how often every 12-bit code occurs on a channel, with the signal
+ * quality figures derived from it (code_histogram.h): DC offset, RMS, crest
+ * factor, effective bits and missing codes. Missing codes are marked in red
+ * below the bars.
+ *
+ * The display thread counts every GUI_HISTOGRAM_STRIDE-th block while a
+ * histogram view is open and publishes the histogram of both channels every
+ * GUI_HISTOGRAM_PERIOD_BLOCKS blocks through a lock-free triple buffer, the
+ * same way the FFT worker hands over spectra. DC and RMS come from the
+ * statistics the extraction kernel gathers in the same pass, so they cover
+ * every sample of the period.
+ */
+
+#ifndef GUI_HISTOGRAM_H
+#define GUI_HISTOGRAM_H
+
+#include "raylib.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "../misrc_common/extract.h"
+
+#define GUI_HISTOGRAM_STRIDE         4      // Count one block in this many
+#define GUI_HISTOGRAM_PERIOD_BLOCKS  256    // Blocks per published histogram (~0.4 s at 40 MSPS)
+#define GUI_HISTOGRAM_MIN_CODES      64     // Narrowest code range the view zooms to
+
+// Per-panel state, one per open histogram view
+typedef struct histogram_view {
+    float *columns;            // Largest count per screen column
+    int num_columns;
+} histogram_view_t;
+
+// Open a view; the display thread counts while at least one is open
+histogram_view_t *gui_histogram_view_create(void);
+
+// Close a view and free it (NULL is ignored)
+void gui_histogram_view_destroy(histogram_view_t *view);
+
+// Drop the current histogram, the next one starts empty (e.g. on capture start)
+void gui_histogram_clear(void);
+
+// Count a block of extracted samples of both ADCs (called from the display thread,
+// only for blocks that were not overwritten while they were read)
+// stats are the kernel statistics of the same block
+void gui_histogram_push(const int16_t *a, const int16_t *b, size_t num_samples, const extract_stats_t *stats);
+
+// Free the display thread's histogram (after the thread stopped)
+void gui_histogram_cleanup(void);
+
+// Render the newest published histogram of a channel
+void gui_histogram_render(histogram_view_t *view, int channel, float x, float y,
+                          float width, float height, Color color, Font *fonts);
+
+#endif // GUI_HISTOGRAM_H
@@ -0,0 +1,226 @@
+/*
+ * MISRC GUI - Min/Max Envelope Pyramid Implementation
+ *
+ * Every level comes from one pair reduction of the level below: entry i is
+ * min/max/mean of entries 2i and 2i+1. The vector kernels widen the pairs
+ * to 32 bit lanes, reduce and pack back, the scalar code does the tail with
+ * the same arithmetic, so every implementation gives identical levels.
+ */
+
+#include "gui_minmax.h"
+#include "../misrc_common/extract.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #include <emmintrin.h>
+    #include <immintrin.h>
+    #define MINMAX_HAVE_X86 1
+#elif defined(__aarch64__) || defined(__arm64__)
+    #include <arm_neon.h>
+    #define MINMAX_HAVE_NEON 1
+#endif
+
+// Reduce 2 * n entries of min/max/avg to n entries each
+typedef void (*pair_reduce_fn_t)(const int16_t *mn, const int16_t *mx, const int16_t *av, size_t n,
+                                 int16_t *out_mn, int16_t *out_mx, int16_t *out_av);
+
+struct minmax_pyramid {
+    int16_t *storage;         // Levels 1..MINMAX_MAX_LEVEL, three arrays each
+    size_t capacity;          // Input samples the storage is sized for
+    int levels;               // Levels of the last build
+    minmax_level_t level[MINMAX_MAX_LEVEL + 1];
+};
+
+static pair_reduce_fn_t s_reduce_fn = NULL;
+static const char *s_impl_name = "C";
+static atomic_bool s_ready = false;
+
+//-----------------------------------------------------------------------------
+// Pair Reduction Kernels
+//-----------------------------------------------------------------------------
+
+static void pair_reduce_C(const int16_t *mn, const int16_t *mx, const int16_t *av, size_t n,
+                          int16_t *out_mn, int16_t *out_mx, int16_t *out_av) {
+    for (size_t i = 0; i < n; i++) {
+        int16_t a = mn[2 * i], b = mn[2 * i + 1];
+        int16_t c = mx[2 * i], d = mx[2 * i + 1];
+        out_mn[i] = (a < b) ? a : b;
+        out_mx[i] = (c > d) ? c : d;
+        out_av[i] = (int16_t)(((int32_t)av[2 * i] + av[2 * i + 1]) >> 1);
+    }
+}
+
+#ifdef MINMAX_HAVE_X86
+
+#if defined(__GNUC__)
+#define MINMAX_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define MINMAX_TARGET_AVX2
+#endif
+
+// Even samples of v sign extended to 32 bit lanes, the odd ones are v >> 16
+static inline __m128i even_sse2(__m128i v) {
+    return _mm_srai_epi32(_mm_slli_epi32(v, 16), 16);
+}
+
+// Per 32 bit lane: op(even, odd) in the low word, sign extended
+#define PAIR_OP_SSE2(op, v) even_sse2(op((v), _mm_srli_epi32((v), 16)))
+#define PAIR_AVG_SSE2(v) _mm_srai_epi32(_mm_add_epi32(even_sse2(v), _mm_srai_epi32((v), 16)), 1)
+
+static void pair_reduce_sse2(const int16_t *mn, const int16_t *mx, const int16_t *av, size_t n,
+                             int16_t *out_mn, int16_t *out_mx, int16_t *out_av) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i n0 = _mm_loadu_si128((const __m128i *)(mn + 2 * i));
+        __m128i n1 = _mm_loadu_si128((const __m128i *)(mn + 2 * i + 8));
+        __m128i x0 = _mm_loadu_si128((const __m128i *)(mx + 2 * i));
+        __m128i x1 = _mm_loadu_si128((const __m128i *)(mx + 2 * i + 8));
+        __m128i a0 = _mm_loadu_si128((const __m128i *)(av + 2 * i));
+        __m128i a1 = _mm_loadu_si128((const __m128i *)(av + 2 * i + 8));
+        _mm_storeu_si128((__m128i *)(out_mn + i),
+                         _mm_packs_epi32(PAIR_OP_SSE2(_mm_min_epi16, n0), PAIR_OP_SSE2(_mm_min_epi16, n1)));
+        _mm_storeu_si128((__m128i *)(out_mx + i),
+                         _mm_packs_epi32(PAIR_OP_SSE2(_mm_max_epi16, x0), PAIR_OP_SSE2(_mm_max_epi16, x1)));
+        _mm_storeu_si128((__m128i *)(out_av + i),
+                         _mm_packs_epi32(PAIR_AVG_SSE2(a0), PAIR_AVG_SSE2(a1)));
+    }
+    pair_reduce_C(mn + 2 * i, mx + 2 * i, av + 2 * i, n - i, out_mn + i, out_mx + i, out_av + i);
+}
+
+MINMAX_TARGET_AVX2
+static inline __m256i even_avx2(__m256i v) {
+    return _mm256_srai_epi32(_mm256_slli_epi32(v, 16), 16);
+}
+
+#define PAIR_OP_AVX2(op, v) even_avx2(op((v), _mm256_srli_epi32((v), 16)))
+#define PAIR_AVG_AVX2(v) _mm256_srai_epi32(_mm256_add_epi32(even_avx2(v), _mm256_srai_epi32((v), 16)), 1)
+// packs works per 128 bit lane, put the 64 bit quarters back in order
+#define PACK_AVX2(a, b) _mm256_permute4x64_epi64(_mm256_packs_epi32((a), (b)), 0xD8)
+
+MINMAX_TARGET_AVX2
+static void pair_reduce_avx2(const int16_t *mn, const int16_t *mx, const int16_t *av, size_t n,
+                             int16_t *out_mn, int16_t *out_mx, int16_t *out_av) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i n0 = _mm256_loadu_si256((const __m256i *)(mn + 2 * i));
+        __m256i n1 = _mm256_loadu_si256((const __m256i *)(mn + 2 * i + 16));
+        __m256i x0 = _mm256_loadu_si256((const __m256i *)(mx + 2 * i));
+        __m256i x1 = _mm256_loadu_si256((const __m256i *)(mx + 2 * i + 16));
+        __m256i a0 = _mm256_loadu_si256((const __m256i *)(av + 2 * i));
+        __m256i a1 = _mm256_loadu_si256((const __m256i *)(av + 2 * i + 16));
+        _mm256_storeu_si256((__m256i *)(out_mn + i),
+                            PACK_AVX2(PAIR_OP_AVX2(_mm256_min_epi16, n0), PAIR_OP_AVX2(_mm256_min_epi16, n1)));
+        _mm256_storeu_si256((__m256i *)(out_mx + i),
+                            PACK_AVX2(PAIR_OP_AVX2(_mm256_max_epi16, x0), PAIR_OP_AVX2(_mm256_max_epi16, x1)));
+        _mm256_storeu_si256((__m256i *)(out_av + i),
+                            PACK_AVX2(PAIR_AVG_AVX2(a0), PAIR_AVG_AVX2(a1)));
+    }
+    pair_reduce_sse2(mn + 2 * i, mx + 2 * i, av + 2 * i, n - i, out_mn + i, out_mx + i, out_av + i);
+}
+
+#endif // MINMAX_HAVE_X86
+
+#ifdef MINMAX_HAVE_NEON
+
+static void pair_reduce_neon(const int16_t *mn, const int16_t *mx, const int16_t *av, size_t n,
+                             int16_t *out_mn, int16_t *out_mx, int16_t *out_av) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        // vld2 splits even and odd entries, vhadd is (a + b) >> 1 without overflow
+        int16x8x2_t vn = vld2q_s16(mn + 2 * i);
+        int16x8x2_t vx = vld2q_s16(mx + 2 * i);
+        int16x8x2_t va = vld2q_s16(av + 2 * i);
+        vst1q_s16(out_mn + i, vminq_s16(vn.val[0], vn.val[1]));
+        vst1q_s16(out_mx + i, vmaxq_s16(vx.val[0], vx.val[1]));
+        vst1q_s16(out_av + i, vhaddq_s16(va.val[0], va.val[1]));
+    }
+    pair_reduce_C(mn + 2 * i, mx + 2 * i, av + 2 * i, n - i, out_mn + i, out_mx + i, out_av + i);
+}
+
+#endif // MINMAX_HAVE_NEON
+
+static void minmax_init(void) {
+    if (atomic_load_explicit(&s_ready, memory_order_acquire)) {
+        return;
+    }
+    s_reduce_fn = pair_reduce_C;
+    s_impl_name = "C";
+#if defined(MINMAX_HAVE_X86)
+    // SSE2 is part of x86_64, no check needed
+    s_reduce_fn = pair_reduce_sse2;
+    s_impl_name = "SSE2";
+    if (check_cpu_feat() >= 3) {
+        s_reduce_fn = pair_reduce_avx2;
+        s_impl_name = "AVX2";
+    }
+#elif defined(MINMAX_HAVE_NEON)
+    s_reduce_fn = pair_reduce_neon;
+    s_impl_name = "NEON";
+#endif
+    atomic_store_explicit(&s_ready, true, memory_order_release);
+}
+
+//-----------------------------------------------------------------------------
+// Public API
+//-----------------------------------------------------------------------------
+
+minmax_pyramid_t *minmax_pyramid_create(void) {
+    minmax_init();
+    return calloc(1, sizeof(minmax_pyramid_t));
+}
+
+void minmax_pyramid_free(minmax_pyramid_t *pyr) {
+    if (!pyr) return;
+    free(pyr->storage);
+    free(pyr);
+}
+
+int minmax_pyramid_build(minmax_pyramid_t *pyr, const int16_t *buf, size_t count, int levels) {
+    if (!pyr || !buf) return -1;
+    if (levels > MINMAX_MAX_LEVEL) levels = MINMAX_MAX_LEVEL;
+    if (levels < 0) levels = 0;
+
+    // Levels 1.. together hold less than count entries per array
+    if (levels > 0 && count > pyr->capacity) {
+        int16_t *storage = realloc(pyr->storage, 3 * count * sizeof(int16_t));
+        if (storage) {
+            pyr->storage = storage;
+            pyr->capacity = count;
+        }
+    }
+
+    pyr->level[0] = (minmax_level_t){ buf, buf, buf, count };
+    int16_t *next = pyr->storage;
+    int built = 0;
+    while (built < levels) {
+        const minmax_level_t *src = &pyr->level[built];
+        size_t n = src->count >> 1;
+        if (n == 0 || count > pyr->capacity) break;
+        int16_t *mn = next, *mx = next + n, *av = next + 2 * n;
+        s_reduce_fn(src->min, src->max, src->avg, n, mn, mx, av);
+        next += 3 * n;
+        pyr->level[++built] = (minmax_level_t){ mn, mx, av, n };
+    }
+    pyr->levels = built;
+    return built;
+}
+
+minmax_level_t minmax_pyramid_level(const minmax_pyramid_t *pyr, int level) {
+    if (level > pyr->levels) level = pyr->levels;
+    if (level < 0) level = 0;
+    return pyr->level[level];
+}
+
+int minmax_level_for_zoom(float samples_per_pixel) {
+    int level = 0;
+    while (level < MINMAX_MAX_LEVEL && (float)(2 << level) <= samples_per_pixel) level++;
+    return level;
+}
+
+const char *minmax_impl_name(void) {
+    minmax_init();
+    return s_impl_name;
+}
@@ -0,0 +1,54 @@
+/*
+ * MISRC GUI - Min/Max Envelope Pyramid
+ *
+ * Mip levels of a sample window for the oscilloscope: level L holds, for
+ * every 2^L input samples, their minimum, maximum and mean. Level 1 is
+ * built from the samples, every further level from the one below, so all
+ * levels together cost about two passes over the input and no zoom factor
+ * needs a filter of its own. Any zoom is then drawn from the nearest level
+ * below it, with at most a few entries per pixel, and short peaks stay
+ * visible at every zoom instead of being filtered or sampled away.
+ *
+ * The pair reductions run with SSE2 or AVX2 on x86_64 and NEON on AArch64.
+ */
+
+#ifndef GUI_MINMAX_H
+#define GUI_MINMAX_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Level 7 is 128 samples per entry, the largest zoom (ZOOM_SCALE_MAX)
+#define MINMAX_MAX_LEVEL 7
+
+typedef struct minmax_pyramid minmax_pyramid_t;
+
+// One level of the pyramid, level 0 is the input itself
+typedef struct {
+    const int16_t *min;
+    const int16_t *max;
+    const int16_t *avg;       // Mean of the 2^L samples, rounded down pairwise
+    size_t count;             // Entries, the input length >> L
+} minmax_level_t;
+
+// Create an empty pyramid, storage grows with the first build
+minmax_pyramid_t *minmax_pyramid_create(void);
+
+// Free a pyramid (NULL is ignored)
+void minmax_pyramid_free(minmax_pyramid_t *pyr);
+
+// Build levels 1..levels over buf[0..count), replacing the previous window
+// The input has to stay valid while levels are read, level 0 points into it
+// Returns the number of levels built (fewer if out of memory), -1 on error
+int minmax_pyramid_build(minmax_pyramid_t *pyr, const int16_t *buf, size_t count, int levels);
+
+// Get a level of the last build, level must be <= the levels built
+minmax_level_t minmax_pyramid_level(const minmax_pyramid_t *pyr, int level);
+
+// Level for a zoom: the largest L with 2^L <= samples_per_pixel
+int minmax_level_for_zoom(float samples_per_pixel);
+
+// Name of the pair reduction in use, for log messages
+const char *minmax_impl_name(void);
+
+#endif // GUI_MINMAX_H
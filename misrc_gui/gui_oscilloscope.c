@@ -12,16 +12,14 @@
 #include "gui_text.h"
 #include "gui_ui.h"
 #include "gui_panel.h"
+#include "gui_minmax.h"
+#include "gui_perf.h"
+#include "../misrc_common/threading.h"
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
-#if LIBSOXR_ENABLED
-#include <soxr.h>
-// Forward declaration for cleanup function
-static void gui_oscilloscope_cleanup_resampler(channel_trigger_t *trig);
-#endif
+#include <stdatomic.h>
 
 //-----------------------------------------------------------------------------
 // Grid Settings
@@ -73,16 +71,61 @@ void gui_oscilloscope_cleanup(void) {
     // No static resources to clean up - phosphor cleanup is in gui_phosphor module
 }
 
-// Cleanup per-channel resampler resources
-void gui_oscilloscope_cleanup_resamplers(gui_app_t *app) {
-#if LIBSOXR_ENABLED
+// Cleanup per-channel envelope pyramids
+void gui_oscilloscope_cleanup_pyramids(gui_app_t *app) {
     if (app) {
-        gui_oscilloscope_cleanup_resampler(&app->trigger_a);
-        gui_oscilloscope_cleanup_resampler(&app->trigger_b);
+        minmax_pyramid_free(app->trigger_a.pyramid);
+        app->trigger_a.pyramid = NULL;
+        minmax_pyramid_free(app->trigger_b.pyramid);
+        app->trigger_b.pyramid = NULL;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Display Frame Handoff (triple buffer)
+//-----------------------------------------------------------------------------
+
+// A channel counts as on screen for this long after its last acquire
+#define DISPLAY_DEMAND_MS 250
+
+void display_triple_init(display_triple_t *t) {
+    for (int i = 0; i < 3; i++) {
+        t->slots[i].count = 0;
+        t->slots[i].trigger_display_pos = -1;
+        t->slots[i].decimation = 0.0f;
+        t->slots[i].sample_rate = 0;
+    }
+    gui_triple_init(&t->idx);
+    atomic_store(&t->acquire_ms, 0);
+}
+
+void display_triple_clear(display_triple_t *t) {
+    // Drop a pending frame too, only frames published after this are shown
+    display_triple_acquire(t);
+    t->slots[t->idx.front].count = 0;
+    t->slots[t->idx.front].trigger_display_pos = -1;
+}
+
+display_frame_t *display_triple_back(display_triple_t *t) {
+    return &t->slots[t->idx.back];
+}
+
+void display_triple_publish(display_triple_t *t) {
+    gui_triple_publish(&t->idx);
+}
+
+const display_frame_t *display_triple_acquire(display_triple_t *t) {
+    atomic_store_explicit(&t->acquire_ms, get_time_ms(), memory_order_relaxed);
+    return &t->slots[gui_triple_acquire(&t->idx)];
+}
+
+// Writer: is a new frame wanted? (the last one was taken and the waveform is on screen)
+static bool display_triple_wanted(display_triple_t *t, uint64_t now_ms) {
+    if (gui_triple_pending(&t->idx)) {
+        return false;
     }
-#else
-    (void)app;
-#endif
+    uint64_t last = atomic_load_explicit(&t->acquire_ms, memory_order_relaxed);
+    return last != 0 && now_ms - last <= DISPLAY_DEMAND_MS;
 }
 
 //-----------------------------------------------------------------------------
@@ -256,7 +299,8 @@ void draw_channel_grid(float x, float y, float width, float height,
 //-----------------------------------------------------------------------------
 
 static void draw_trigger_markers(float x, float y, float w, float h,
-                                  channel_trigger_t *trig, float amplitude_scale, Color color) {
+                                  channel_trigger_t *trig, int trigger_display_pos,
+                                  float amplitude_scale, Color color) {
     if (!trig->enabled) return;
 
     float center_y = y + h / 2.0f;
@@ -288,8 +332,8 @@ static void draw_trigger_markers(float x, float y, float w, float h,
     DrawTriangle(arrow_tip, arrow_bot, arrow_top, trig_color);
 
     // Draw vertical trigger position marker at actual trigger position (if triggered)
-    if (trig->trigger_display_pos >= 0 && trig->trigger_display_pos < (int)w) {
-        float trigger_x = x + (float)trig->trigger_display_pos;
+    if (trigger_display_pos >= 0 && trigger_display_pos < (int)w) {
+        float trigger_x = x + (float)trigger_display_pos;
 
         Color marker_color = { color.r, color.g, color.b, 80 };
         DrawLineEx((Vector2){trigger_x, y}, (Vector2){trigger_x, y + h}, 1.0f, marker_color);
@@ -301,6 +345,39 @@ static void draw_trigger_markers(float x, float y, float w, float h,
     }
 }
 
+// Draw display samples as a connected line through the column means, plus
+// a vertical min..max bar wherever a column covers more than one sample
+static void draw_waveform_trace(const waveform_sample_t *samples, int count,
+                                float x, float y, float h,
+                                float amplitude_scale, Color color) {
+    float center_y = y + h / 2.0f;
+    float scale = (h / 2.0f) * amplitude_scale;
+    float prev_py = center_y;
+
+    for (int px = 0; px < count; px++) {
+        float px_x = x + px;
+        float py = center_y - samples[px].value * scale;
+
+        // Clamp to bounds
+        if (py < y) py = y;
+        if (py > y + h) py = y + h;
+
+        if (samples[px].max > samples[px].min) {
+            float top = center_y - samples[px].max * scale;
+            float bottom = center_y - samples[px].min * scale;
+            if (top < y) top = y;
+            if (bottom > y + h) bottom = y + h;
+            if (bottom > top) {
+                DrawLineEx((Vector2){px_x, top}, (Vector2){px_x, bottom}, 1.0f, color);
+            }
+        }
+        if (px > 0) {
+            DrawLineEx((Vector2){px_x - 1, prev_py}, (Vector2){px_x, py}, 1.0f, color);
+        }
+        prev_py = py;
+    }
+}
+
 //-----------------------------------------------------------------------------
 // Waveform Panel Rendering (Line Mode)
 //-----------------------------------------------------------------------------
@@ -313,25 +390,21 @@ void render_waveform_line(gui_app_t *app, int channel,
     // Register bounds for mouse interaction (trigger level drag)
     register_waveform_bounds(channel, x, y, w, h);
 
+    // Newest display frame, the grid and markers use the settings it was built with
+    const display_frame_t *frame = display_triple_acquire((channel == 0) ? &app->display_a : &app->display_b);
+    const waveform_sample_t *samples = frame->samples;
+    size_t samples_available = frame->count;
+    float zoom_scale = (frame->count > 0) ? frame->decimation : trig->zoom_scale;
+    uint32_t sample_rate = (frame->count > 0) ? frame->sample_rate : atomic_load(&app->sample_rate);
+
     // Draw grid with labels first
-    uint32_t sample_rate = atomic_load(&app->sample_rate);
     draw_channel_grid(x, y, w, h, label, color, app->settings.show_grid,
-                      trig->zoom_scale, sample_rate,
-                      trig->enabled, trig->trigger_display_pos);
+                      zoom_scale, sample_rate,
+                      trig->enabled, frame->trigger_display_pos);
 
     // Draw trigger level and position markers
-    draw_trigger_markers(x, y, w, h, trig, app->settings.amplitude_scale, color);
-
-    // Get display samples
-    waveform_sample_t *samples;
-    size_t samples_available;
-    if (channel == 0) {
-        samples = app->display_samples_a;
-        samples_available = app->display_samples_available_a;
-    } else {
-        samples = app->display_samples_b;
-        samples_available = app->display_samples_available_b;
-    }
+    draw_trigger_markers(x, y, w, h, trig, frame->trigger_display_pos,
+                         app->settings.amplitude_scale, color);
 
     if (samples_available == 0) return;
 
@@ -340,24 +413,9 @@ void render_waveform_line(gui_app_t *app, int channel,
     int samples_to_draw = (samples_available < (size_t)display_width) ?
                           (int)samples_available : display_width;
 
-    float center_y = y + h / 2.0f;
-    float scale = (h / 2.0f) * app->settings.amplitude_scale;
-
-    // Draw waveform as connected line
-    float prev_py = center_y;
-    for (int px = 0; px < samples_to_draw; px++) {
-        float px_x = x + px;
-        float py = center_y - samples[px].value * scale;
-
-        // Clamp to bounds
-        if (py < y) py = y;
-        if (py > y + h) py = y + h;
-
-        if (px > 0) {
-            DrawLineEx((Vector2){px_x - 1, prev_py}, (Vector2){px_x, py}, 1.0f, color);
-        }
-        prev_py = py;
-    }
+    // Draw waveform as min/max envelope with connected mean line
+    draw_waveform_trace(samples, samples_to_draw, x, y, h,
+                        app->settings.amplitude_scale, color);
 }
 
 //-----------------------------------------------------------------------------
@@ -372,25 +430,21 @@ void render_waveform_phosphor(gui_app_t *app, int channel,
     // Register bounds for mouse interaction (trigger level drag)
     register_waveform_bounds(channel, x, y, w, h);
 
+    // Newest display frame, the grid and markers use the settings it was built with
+    const display_frame_t *frame = display_triple_acquire((channel == 0) ? &app->display_a : &app->display_b);
+    const waveform_sample_t *samples = frame->samples;
+    size_t samples_available = frame->count;
+    float zoom_scale = (frame->count > 0) ? frame->decimation : trig->zoom_scale;
+    uint32_t sample_rate = (frame->count > 0) ? frame->sample_rate : atomic_load(&app->sample_rate);
+
     // Draw grid with labels first
-    uint32_t sample_rate = atomic_load(&app->sample_rate);
     draw_channel_grid(x, y, w, h, label, color, app->settings.show_grid,
-                      trig->zoom_scale, sample_rate,
-                      trig->enabled, trig->trigger_display_pos);
+                      zoom_scale, sample_rate,
+                      trig->enabled, frame->trigger_display_pos);
 
     // Draw trigger level and position markers
-    draw_trigger_markers(x, y, w, h, trig, app->settings.amplitude_scale, color);
-
-    // Get display samples
-    waveform_sample_t *samples;
-    size_t samples_available;
-    if (channel == 0) {
-        samples = app->display_samples_a;
-        samples_available = app->display_samples_available_a;
-    } else {
-        samples = app->display_samples_b;
-        samples_available = app->display_samples_available_b;
-    }
+    draw_trigger_markers(x, y, w, h, trig, frame->trigger_display_pos,
+                         app->settings.amplitude_scale, color);
 
     if (samples_available == 0) return;
 
@@ -421,23 +475,9 @@ void render_waveform_phosphor(gui_app_t *app, int channel,
     }
 
     // Draw line overlay on phosphor (semi-transparent)
-    float center_y = y + h / 2.0f;
-    float scale = (h / 2.0f) * app->settings.amplitude_scale;
-    float prev_py = center_y;
     Color waveform_color = {color.r, color.g, color.b, 200};
-
-    for (int px = 0; px < samples_to_draw; px++) {
-        float px_x = x + px;
-        float py = center_y - samples[px].value * scale;
-
-        if (py < y) py = y;
-        if (py > y + h) py = y + h;
-
-        if (px > 0) {
-            DrawLineEx((Vector2){px_x - 1, prev_py}, (Vector2){px_x, py}, 1.0f, waveform_color);
-        }
-        prev_py = py;
-    }
+    draw_waveform_trace(samples, samples_to_draw, x, y, h,
+                        app->settings.amplitude_scale, waveform_color);
 }
 
 //-----------------------------------------------------------------------------
@@ -595,68 +635,16 @@ ssize_t find_trigger_point(const int16_t *buf, size_t count,
 }
 
 //-----------------------------------------------------------------------------
-// Decimation and Display Buffer Processing (with libsoxr resampling)
+// Decimation and Display Buffer Processing (min/max envelope pyramid)
 //-----------------------------------------------------------------------------
 
-#if LIBSOXR_ENABLED
-// Ensure resampler is initialized with correct decimation ratio
-// Returns the resampler handle, creating/recreating if needed
-// decimation: the zoom_scale value (samples per pixel, continuous)
-static soxr_t ensure_resampler(channel_trigger_t *trig, float decimation) {
-    // Check if we need to create or recreate the resampler
-    // Recreate if ratio changed by more than 0.1% (to avoid floating point noise)
-    float ratio_diff = fabsf(trig->resampler_ratio - decimation);
-    bool need_recreate = (trig->resampler == NULL) ||
-                         (ratio_diff > decimation * 0.001f);
-
-    if (!need_recreate) {
-        return (soxr_t)trig->resampler;
-    }
-
-    // Destroy old resampler if exists
-    if (trig->resampler) {
-        soxr_delete((soxr_t)trig->resampler);
-        trig->resampler = NULL;
-    }
-
-    // Create new resampler for this decimation ratio
-    // in_rate:out_rate = decimation:1
-    // printf("Creating soxr resampler for decimation %.3f\n", decimation);
-    const double in_rate = (double)decimation;
-    const double out_rate = 1.0;
-
-    soxr_error_t soxr_err = NULL;
-    soxr_io_spec_t io_spec = soxr_io_spec(SOXR_FLOAT32_I, SOXR_FLOAT32_I);
-    // Use SOXR_LQ - low latency works better for non-streaming frame-by-frame processing
-    soxr_quality_spec_t qual_spec = soxr_quality_spec(SOXR_QQ, 0);
-
-    soxr_t resampler = soxr_create(in_rate, out_rate, 1, &soxr_err, &io_spec, &qual_spec, NULL);
-    if (!resampler || soxr_err) {
-        return NULL;
-    }
-
-    trig->resampler = resampler;
-    trig->resampler_ratio = decimation;
-
-    return resampler;
-}
-
-// Cleanup resampler for a channel (call on shutdown)
-static void gui_oscilloscope_cleanup_resampler(channel_trigger_t *trig) {
-    if (trig && trig->resampler) {
-        soxr_delete((soxr_t)trig->resampler);
-        trig->resampler = NULL;
-        trig->resampler_ratio = 0.0f;
-    }
-}
-#endif
-
-// Resample a single channel from source buffer to display buffer using libsoxr
-// Proper anti-alias filtering is applied during resampling
-static size_t resample_to_buffer_smooth(channel_trigger_t *trig, waveform_sample_t *dest,
-                                         const int16_t *buf, size_t num_samples,
-                                         size_t start_idx, float decimation,
-                                         size_t target_width) {
+// Fill the display buffer from the envelope of buf[start_idx..]
+// Builds the pyramid levels up to the one nearest below the zoom, each pixel
+// then combines the one to three entries of that level it overlaps
+static size_t envelope_to_buffer(channel_trigger_t *trig, waveform_sample_t *dest,
+                                 const int16_t *buf, size_t num_samples,
+                                 size_t start_idx, float decimation,
+                                 size_t target_width) {
     const float scale = 1.0f / 2048.0f;
 
     // Clamp target width to buffer size
@@ -676,74 +664,42 @@ static size_t resample_to_buffer_smooth(channel_trigger_t *trig, waveform_sample
     size_t source_samples_needed = (size_t)ceilf((float)display_count * decimation);
     if (source_samples_needed > available) source_samples_needed = available;
 
-#if LIBSOXR_ENABLED
-    // Bypass soxr for 1:1 ratio (no resampling needed)
-    // Use small epsilon to handle floating point imprecision
-    if (decimation >= 0.999f && decimation <= 1.001f) {
-        size_t count = (display_count < source_samples_needed) ? display_count : source_samples_needed;
-        for (size_t i = 0; i < count; i++) {
-            dest[i].value = (float)buf[start_idx + i] * scale;
-        }
-        return count;
-    }
-
-    // Temporary buffers for float conversion
-    static float temp_input[DISPLAY_BUFFER_SIZE * 256];  // Max ~256x decimation
-    static float temp_output[DISPLAY_BUFFER_SIZE];
-
-    // Limit input size to our temp buffer
-    size_t max_input = sizeof(temp_input) / sizeof(temp_input[0]);
-    if (source_samples_needed > max_input) {
-        source_samples_needed = max_input;
-        display_count = (size_t)((float)source_samples_needed / decimation);
-        if (display_count == 0) display_count = 1;
-    }
-
-    // Convert input to float with scaling
-    for (size_t i = 0; i < source_samples_needed; i++) {
-        temp_input[i] = (float)buf[start_idx + i] * scale;
+    if (!trig->pyramid) {
+        trig->pyramid = minmax_pyramid_create();
+        if (!trig->pyramid) return 0;
     }
+    int level = minmax_pyramid_build(trig->pyramid, buf + start_idx, source_samples_needed,
+                                     minmax_level_for_zoom(decimation));
+    if (level < 0) return 0;
+    minmax_level_t lv = minmax_pyramid_level(trig->pyramid, level);
+    if (lv.count == 0) return 0;
 
-    // Get or create resampler for this decimation ratio
-    soxr_t resampler = ensure_resampler(trig, decimation);
-    if (!resampler) {
-        return 0;
-    }
-
-    // Clear resampler state for fresh data each frame
-    // (we're not doing continuous streaming, each frame is independent)
-    soxr_clear(resampler);
-
-    // Process through resampler
-    size_t in_done = 0, out_done = 0;
-    soxr_error_t soxr_err = soxr_process(resampler,
-                                          temp_input, source_samples_needed, &in_done,
-                                          temp_output, display_count, &out_done);
-
-    if (soxr_err || out_done == 0) {
-        return 0;
-    }
-
-    // Copy to destination
-    for (size_t i = 0; i < out_done; i++) {
-        dest[i].value = temp_output[i];
-    }
-
-    return out_done;
-#else
-    // No libsoxr: simple point sampling (no anti-aliasing)
+    const size_t step = (size_t)1 << level;
+    size_t count = 0;
     for (size_t i = 0; i < display_count; i++) {
-        size_t src_idx = start_idx + (size_t)((float)i * decimation);
-        if (src_idx >= num_samples) src_idx = num_samples - 1;
-        dest[i].value = (float)buf[src_idx] * scale;
+        size_t first = (size_t)((float)i * decimation) >> level;
+        size_t last = ((size_t)((float)(i + 1) * decimation) + step - 1) >> level;
+        if (first >= lv.count) break;
+        if (last > lv.count) last = lv.count;
+        if (last <= first) last = first + 1;
+
+        int16_t mn = lv.min[first], mx = lv.max[first];
+        int32_t sum = 0;
+        for (size_t j = first; j < last; j++) {
+            if (lv.min[j] < mn) mn = lv.min[j];
+            if (lv.max[j] > mx) mx = lv.max[j];
+            sum += lv.avg[j];
+        }
+        dest[i].value = (float)sum / (float)(last - first) * scale;
+        dest[i].min = (float)mn * scale;
+        dest[i].max = (float)mx * scale;
+        count++;
     }
-    return display_count;
-#endif
+    return count;
 }
 
 bool process_channel_display(gui_app_t *app, const int16_t *buf, size_t num_samples,
-                             waveform_sample_t *display_buf, size_t *display_count,
-                             channel_trigger_t *trig, int channel) {
+                             display_frame_t *frame, channel_trigger_t *trig, int channel) {
     (void)app;      // Unused parameter
     (void)channel;  // Unused parameter (kept for API compatibility)
 
@@ -762,19 +718,20 @@ bool process_channel_display(gui_app_t *app, const int16_t *buf, size_t num_samp
 
     // How many raw samples we need for the full display at this zoom
     float display_window = (float)display_width * decimation;
+    frame->decimation = decimation;
 
     // If trigger is disabled, just show the start of the buffer
     if (!trig->enabled) {
-        trig->trigger_display_pos = -1;
-        *display_count = resample_to_buffer_smooth(trig, display_buf, buf, num_samples, 0, decimation, display_width);
+        frame->trigger_display_pos = -1;
+        frame->count = envelope_to_buffer(trig, frame->samples, buf, num_samples, 0, decimation, display_width);
         return true;
     }
 
     // When zoomed out so far that display_window >= 90% of buffer,
     // there's no room for trigger positioning - just show from start
     if (display_window >= (float)num_samples * 0.9f) {
-        trig->trigger_display_pos = -1;
-        *display_count = resample_to_buffer_smooth(trig, display_buf, buf, num_samples, 0, decimation, display_width);
+        frame->trigger_display_pos = -1;
+        frame->count = envelope_to_buffer(trig, frame->samples, buf, num_samples, 0, decimation, display_width);
         return true;
     }
 
@@ -792,8 +749,8 @@ bool process_channel_display(gui_app_t *app, const int16_t *buf, size_t num_samp
     // Check if there's a valid search range
     if (min_trig_pos >= max_trig_pos) {
         // No valid range - display window too large for this buffer
-        trig->trigger_display_pos = -1;
-        *display_count = resample_to_buffer_smooth(trig, display_buf, buf, num_samples, 0, decimation, display_width);
+        frame->trigger_display_pos = -1;
+        frame->count = envelope_to_buffer(trig, frame->samples, buf, num_samples, 0, decimation, display_width);
         return true;
     }
 
@@ -807,24 +764,34 @@ bool process_channel_display(gui_app_t *app, const int16_t *buf, size_t num_samp
 
     // Trigger found in valid range - place it at desired position
     size_t start_pos = (size_t)((float)trig_pos - pre_trigger_raw_samples);
-    trig->trigger_display_pos = (int)trigger_display_pos;
-    *display_count = resample_to_buffer_smooth(trig, display_buf, buf, num_samples, start_pos, decimation, display_width);
+    frame->trigger_display_pos = (int)trigger_display_pos;
+    frame->count = envelope_to_buffer(trig, frame->samples, buf, num_samples, start_pos, decimation, display_width);
     return true;
 }
 
 void gui_oscilloscope_update_display(gui_app_t *app, const int16_t *buf_a,
                                       const int16_t *buf_b, size_t num_samples) {
-    // Process channel A
-    size_t count_a = app->display_samples_available_a;
-    if (process_channel_display(app, buf_a, num_samples,
-                                app->display_samples_a, &count_a, &app->trigger_a, 0)) {
-        app->display_samples_available_a = count_a;
+    uint64_t t0 = gui_perf_begin();
+    uint32_t sample_rate = atomic_load(&app->sample_rate);
+    uint64_t now_ms = get_time_ms();
+
+    // Process channel A (not published while held, the renderer keeps the last frame)
+    if (display_triple_wanted(&app->display_a, now_ms)) {
+        display_frame_t *frame_a = display_triple_back(&app->display_a);
+        frame_a->sample_rate = sample_rate;
+        if (process_channel_display(app, buf_a, num_samples, frame_a, &app->trigger_a, 0)) {
+            display_triple_publish(&app->display_a);
+        }
     }
 
     // Process channel B
-    size_t count_b = app->display_samples_available_b;
-    if (process_channel_display(app, buf_b, num_samples,
-                                app->display_samples_b, &count_b, &app->trigger_b, 1)) {
-        app->display_samples_available_b = count_b;
+    if (display_triple_wanted(&app->display_b, now_ms)) {
+        display_frame_t *frame_b = display_triple_back(&app->display_b);
+        frame_b->sample_rate = sample_rate;
+        if (process_channel_display(app, buf_b, num_samples, frame_b, &app->trigger_b, 1)) {
+            display_triple_publish(&app->display_b);
+        }
     }
+
+    gui_perf_end(PERF_STAGE_DISPLAY, t0);
 }
@@ -27,9 +27,29 @@
 // Call on application exit
 void gui_oscilloscope_cleanup(void);
 
-// Cleanup per-channel resampler resources
+// Cleanup per-channel envelope pyramids
 // Call when app is being destroyed
-void gui_oscilloscope_cleanup_resamplers(gui_app_t *app);
+void gui_oscilloscope_cleanup_pyramids(gui_app_t *app);
+
+//-----------------------------------------------------------------------------
+// Display Frame Handoff (display thread -> render thread, nobody blocks)
+//-----------------------------------------------------------------------------
+
+// Reset all slots (only while no extraction or simulation thread runs)
+void display_triple_init(display_triple_t *t);
+
+// Show nothing until the next published frame (render thread)
+void display_triple_clear(display_triple_t *t);
+
+// Frame to fill next (display thread)
+display_frame_t *display_triple_back(display_triple_t *t);
+
+// Make the filled back frame the newest one (display thread)
+void display_triple_publish(display_triple_t *t);
+
+// Newest published frame, valid until the next acquire (render thread)
+// Also tells the display thread that the channel's waveform is on screen
+const display_frame_t *display_triple_acquire(display_triple_t *t);
 
 //-----------------------------------------------------------------------------
 // Oscilloscope Rendering
@@ -73,14 +93,14 @@ void handle_oscilloscope_interaction(gui_app_t *app);
 ssize_t find_trigger_point(const int16_t *buf, size_t count,
                            const channel_trigger_t *trig);
 
-// Process a single channel: find trigger, resample, update display buffer
-// Returns true if display was updated, false if held (Normal mode, no trigger)
-// Note: trig is non-const because trigger_display_pos is updated
+// Process a single channel: find trigger, resample, fill a display frame
+// Returns true if the frame was filled, false if held (Normal mode, no trigger)
+// Note: trig is non-const because its envelope pyramid is updated
 bool process_channel_display(gui_app_t *app, const int16_t *buf, size_t num_samples,
-                             waveform_sample_t *display_buf, size_t *display_count,
-                             channel_trigger_t *trig, int channel);
+                             display_frame_t *frame, channel_trigger_t *trig, int channel);
 
-// Update display buffers for both channels (called from extraction thread)
+// Update display frames for both channels (called from display thread)
+// Skips a channel while its last frame is not taken yet or its waveform is not drawn
 void gui_oscilloscope_update_display(gui_app_t *app, const int16_t *buf_a,
                                       const int16_t *buf_b, size_t num_samples);
 
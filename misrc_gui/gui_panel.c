@@ -8,7 +8,11 @@
 #include "gui_app.h"
 #include "gui_oscilloscope.h"
 #include "gui_fft.h"
+#include "gui_fft_worker.h"
+#include "gui_spectrogram.h"
+#include "gui_histogram.h"
 #include "gui_ui.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdatomic.h>
 
@@ -20,6 +24,8 @@ static const char* s_view_names[] = {
     [PANEL_VIEW_WAVEFORM_LINE] = "Line",
     [PANEL_VIEW_WAVEFORM_PHOSPHOR] = "Phosphor",
     [PANEL_VIEW_FFT] = "FFT",
+    [PANEL_VIEW_SPECTROGRAM] = "Spectrogram",
+    [PANEL_VIEW_HISTOGRAM] = "Histogram",
 };
 
 const char* panel_view_type_name(panel_view_type_t type) {
@@ -31,8 +37,10 @@ bool panel_view_type_available(panel_view_type_t type) {
     switch (type) {
         case PANEL_VIEW_WAVEFORM_LINE:
         case PANEL_VIEW_WAVEFORM_PHOSPHOR:
+        case PANEL_VIEW_HISTOGRAM:
             return true;
         case PANEL_VIEW_FFT:
+        case PANEL_VIEW_SPECTROGRAM:
             return gui_fft_available();
         default:
             return false;
@@ -43,6 +51,13 @@ bool panel_view_type_available(panel_view_type_t type) {
 // View State Management
 //-----------------------------------------------------------------------------
 
+// The FFT worker and its wisdom thread only start once a view needs spectra
+static void panel_start_fft_worker(void) {
+    if (!gui_fft_worker_running() && gui_fft_worker_start() != 0) {
+        fprintf(stderr, "[FFT] Worker not started, FFT panels stay empty\n");
+    }
+}
+
 void* panel_create_view_state(panel_view_type_t type) {
     switch (type) {
         case PANEL_VIEW_WAVEFORM_LINE:
@@ -53,12 +68,27 @@ void* panel_create_view_state(panel_view_type_t type) {
             fft_state_t *fft = malloc(sizeof(fft_state_t));
             if (fft) {
                 if (gui_fft_init(fft)) {
+                    panel_start_fft_worker();
                     return fft;
                 }
                 free(fft);
             }
             return NULL;
         }
+        case PANEL_VIEW_SPECTROGRAM: {
+            spectrogram_state_t *spec = malloc(sizeof(spectrogram_state_t));
+            if (spec) {
+                if (gui_spectrogram_init(spec)) {
+                    panel_start_fft_worker();
+                    return spec;
+                }
+                free(spec);
+            }
+            return NULL;
+        }
+        case PANEL_VIEW_HISTOGRAM:
+            // The display thread only counts while a histogram view exists
+            return gui_histogram_view_create();
         default:
             return NULL;
     }
@@ -78,6 +108,15 @@ void panel_destroy_view_state(panel_view_type_t type, void *state) {
             free(fft);
             break;
         }
+        case PANEL_VIEW_SPECTROGRAM: {
+            spectrogram_state_t *spec = (spectrogram_state_t*)state;
+            gui_spectrogram_cleanup(spec);
+            free(spec);
+            break;
+        }
+        case PANEL_VIEW_HISTOGRAM:
+            gui_histogram_view_destroy((histogram_view_t*)state);
+            break;
         default:
             break;
     }
@@ -95,6 +134,11 @@ void panel_clear_view_state(panel_view_type_t type, void *state) {
             gui_fft_clear(fft);
             break;
         }
+        case PANEL_VIEW_SPECTROGRAM: {
+            spectrogram_state_t *spec = (spectrogram_state_t*)state;
+            gui_spectrogram_clear(spec);
+            break;
+        }
         default:
             break;
     }
@@ -111,12 +155,18 @@ static void render_waveform_phosphor_panel(gui_app_t *app, int channel,
     float x, float y, float w, float h, void *state, Color color);
 static void render_fft_panel(gui_app_t *app, int channel,
     float x, float y, float w, float h, void *state, Color color);
+static void render_spectrogram_panel(gui_app_t *app, int channel,
+    float x, float y, float w, float h, void *state, Color color);
+static void render_histogram_panel(gui_app_t *app, int channel,
+    float x, float y, float w, float h, void *state, Color color);
 
 // Render function table
 static panel_render_fn s_render_fns[] = {
     [PANEL_VIEW_WAVEFORM_LINE] = render_waveform_line_panel,
     [PANEL_VIEW_WAVEFORM_PHOSPHOR] = render_waveform_phosphor_panel,
     [PANEL_VIEW_FFT] = render_fft_panel,
+    [PANEL_VIEW_SPECTROGRAM] = render_spectrogram_panel,
+    [PANEL_VIEW_HISTOGRAM] = render_histogram_panel,
 };
 
 panel_render_fn panel_get_render_fn(panel_view_type_t type) {
@@ -167,33 +217,57 @@ static void render_fft_panel(gui_app_t *app, int channel,
         return;
     }
 
-    channel_trigger_t *trig = (channel == 0) ? &app->trigger_a : &app->trigger_b;
+    // Take over the newest full-rate spectrum from the worker and render it
+    gui_fft_update(fft, channel);
+    gui_fft_render(fft, x, y, w, h, color, app->fonts);
+}
 
-    // Get display samples
-    waveform_sample_t *samples;
-    size_t samples_available;
-    if (channel == 0) {
-        samples = app->display_samples_a;
-        samples_available = app->display_samples_available_a;
-    } else {
-        samples = app->display_samples_b;
-        samples_available = app->display_samples_available_b;
+//-----------------------------------------------------------------------------
+// Spectrogram Panel Rendering
+//-----------------------------------------------------------------------------
+
+static void render_spectrogram_panel(gui_app_t *app, int channel,
+    float x, float y, float w, float h, void *state, Color color) {
+    (void)color;  // Uses the heatmap palette
+
+    spectrogram_state_t *spec = (spectrogram_state_t*)state;
+
+    if (!spec || !spec->initialized) {
+        const char *text = gui_fft_available() ? "Spectrogram Initializing..." : "Spectrogram Not Available";
+        int text_width = MeasureText(text, FONT_SIZE_OSC_MSG);
+        DrawText(text, (int)(x + w/2 - text_width/2), (int)(y + h/2 - 12),
+                 FONT_SIZE_OSC_MSG, COLOR_TEXT_DIM);
+        return;
     }
 
-    // Calculate display sample rate
-    uint32_t sr = atomic_load(&app->sample_rate);
-    float display_sample_rate = (trig->zoom_scale > 0 && sr > 0) ?
-                                (float)sr / trig->zoom_scale : 0;
+    // Add the newest worker spectrum to the history and render it
+    gui_spectrogram_update(spec, channel);
+    gui_spectrogram_render(spec, x, y, w, h, app->fonts);
+}
+
+//-----------------------------------------------------------------------------
+// Histogram Panel Rendering
+//-----------------------------------------------------------------------------
 
-    // Process and render FFT
-    gui_fft_process_display(fft, samples, samples_available, display_sample_rate);
-    gui_fft_render(fft, x, y, w, h, display_sample_rate, color, app->fonts);
+static void render_histogram_panel(gui_app_t *app, int channel,
+    float x, float y, float w, float h, void *state, Color color) {
+    gui_histogram_render((histogram_view_t*)state, channel, x, y, w, h, color, app->fonts);
 }
 
 //-----------------------------------------------------------------------------
 // Channel Panel Rendering (Main Entry Point)
 //-----------------------------------------------------------------------------
 
+// State of a shown view, created the first time the panel is drawn
+static void *panel_view_state(panel_view_type_t type, void **state) {
+    if (!*state && (type == PANEL_VIEW_FFT || type == PANEL_VIEW_SPECTROGRAM ||
+                    type == PANEL_VIEW_HISTOGRAM) &&
+        panel_view_type_available(type)) {
+        *state = panel_create_view_state(type);
+    }
+    return *state;
+}
+
 void render_channel_panels(gui_app_t *app, int channel,
                            float x, float y, float width, float height,
                            Color channel_color) {
@@ -207,14 +281,16 @@ void render_channel_panels(gui_app_t *app, int channel,
         split = app->panel_config_a.split;
         left_view = (panel_view_type_t)app->panel_config_a.left_view;
         right_view = (panel_view_type_t)app->panel_config_a.right_view;
-        left_state = app->panel_config_a.left_state;
-        right_state = app->panel_config_a.right_state;
+        left_state = panel_view_state(left_view, &app->panel_config_a.left_state);
+        right_state = split ? panel_view_state(right_view, &app->panel_config_a.right_state)
+                            : app->panel_config_a.right_state;
     } else {
         split = app->panel_config_b.split;
         left_view = (panel_view_type_t)app->panel_config_b.left_view;
         right_view = (panel_view_type_t)app->panel_config_b.right_view;
-        left_state = app->panel_config_b.left_state;
-        right_state = app->panel_config_b.right_state;
+        left_state = panel_view_state(left_view, &app->panel_config_b.left_state);
+        right_state = split ? panel_view_state(right_view, &app->panel_config_b.right_state)
+                            : app->panel_config_b.right_state;
     }
 
     if (!split) {
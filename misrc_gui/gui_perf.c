@@ -0,0 +1,292 @@
+/*
+ * MISRC GUI - Pipeline Performance HUD
+ *
+ * Durations go into log-linear histograms (4 buckets per octave, so
+ * percentiles are within about 12%), one per stage.
+ */
+
+#include "gui_perf.h"
+#include "gui_extract.h"
+#include "gui_text.h"
+#include "gui_ui.h"
+#include "../misrc_common/ringbuffer.h"
+#include "../misrc_common/threading.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+// Histogram buckets: 0-3 ns exact, then 4 per octave up to ~17 s
+#define PERF_BUCKETS      136
+#define PERF_WINDOW_MS    1000    // Statistics window
+#define PERF_FILL_PERIOD_MS 100   // Ringbuffer fill sample interval
+#define PERF_FILL_HISTORY 120     // Fill samples shown (12 s)
+
+// Ringbuffers in the fill history
+enum { FILL_CAPTURE, FILL_RECORD_A, FILL_RECORD_B, FILL_COUNT };
+
+// One stage, written by one thread only (own cache lines)
+typedef struct {
+    _Alignas(64) atomic_uint_fast32_t counts[PERF_BUCKETS];
+    atomic_uint_fast64_t max_ns;
+} perf_hist_t;
+
+// Statistics of the last window (render thread)
+typedef struct {
+    uint64_t count;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t max_ns;
+} perf_summary_t;
+
+static const char *s_stage_names[PERF_STAGE_COUNT] = {
+    [PERF_STAGE_CALLBACK] = "USB callback",
+    [PERF_STAGE_PARSE]    = "Frame parse",
+    [PERF_STAGE_EXTRACT]  = "Extraction",
+    [PERF_STAGE_DISPLAY]  = "Display update",
+    [PERF_STAGE_FFT]      = "FFT",
+    [PERF_STAGE_RENDER]   = "Render",
+    [PERF_STAGE_WRITER_A] = "Writer A",
+    [PERF_STAGE_WRITER_B] = "Writer B",
+    [PERF_STAGE_FRAME_INTERVAL] = "Frame interval",
+};
+
+static atomic_bool s_enabled = false;
+static perf_hist_t s_hist[PERF_STAGE_COUNT];
+
+// Render thread state
+static uint32_t s_prev[PERF_STAGE_COUNT][PERF_BUCKETS];
+static perf_summary_t s_summary[PERF_STAGE_COUNT];
+static uint64_t s_window_start_ms = 0;
+static uint64_t s_window_samples = 0;
+static double s_achieved_rate = 0.0;
+static uint64_t s_last_fill_ms = 0;
+static uint8_t s_fill[FILL_COUNT][PERF_FILL_HISTORY];  // Percent, oldest first
+static int s_fill_count = 0;
+
+//-----------------------------------------------------------------------------
+// Recording (any thread, one thread per stage)
+//-----------------------------------------------------------------------------
+
+static unsigned bucket_of(uint64_t ns) {
+    if (ns < 4) return (unsigned)ns;
+    unsigned e = 63u - (unsigned)__builtin_clzll(ns);
+    unsigned b = 4u * (e - 1u) + (unsigned)((ns >> (e - 2u)) & 3u);
+    return (b < PERF_BUCKETS) ? b : PERF_BUCKETS - 1;
+}
+
+// Representative duration of a bucket (middle of its range)
+static uint64_t bucket_ns(unsigned b) {
+    if (b < 4) return b;
+    unsigned e = b / 4u + 1u;
+    uint64_t lo = (uint64_t)(4u + b % 4u) << (e - 2u);
+    return lo + (lo >> 3);
+}
+
+void gui_perf_set_enabled(bool enabled) {
+    atomic_store(&s_enabled, enabled);
+}
+
+bool gui_perf_enabled(void) {
+    return atomic_load_explicit(&s_enabled, memory_order_relaxed);
+}
+
+uint64_t gui_perf_begin(void) {
+    return gui_perf_enabled() ? get_time_ns() : 0;
+}
+
+void gui_perf_end(perf_stage_t stage, uint64_t t0) {
+    if (t0 == 0) return;
+    gui_perf_record(stage, get_time_ns() - t0);
+}
+
+void gui_perf_record(perf_stage_t stage, uint64_t ns) {
+    if (stage >= PERF_STAGE_COUNT || !gui_perf_enabled()) return;
+
+    // Single writer per stage: plain increments, the reader tolerates a stale count
+    perf_hist_t *h = &s_hist[stage];
+    atomic_uint_fast32_t *c = &h->counts[bucket_of(ns)];
+    atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + 1, memory_order_relaxed);
+    if (ns > atomic_load_explicit(&h->max_ns, memory_order_relaxed)) {
+        atomic_store_explicit(&h->max_ns, ns, memory_order_relaxed);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Statistics (render thread)
+//-----------------------------------------------------------------------------
+
+static void summarize_stage(int stage) {
+    uint32_t diff[PERF_BUCKETS];
+    uint64_t total = 0;
+
+    for (unsigned b = 0; b < PERF_BUCKETS; b++) {
+        uint32_t now = (uint32_t)atomic_load_explicit(&s_hist[stage].counts[b], memory_order_relaxed);
+        diff[b] = now - s_prev[stage][b];
+        s_prev[stage][b] = now;
+        total += diff[b];
+    }
+
+    perf_summary_t *sum = &s_summary[stage];
+    sum->count = total;
+    sum->max_ns = atomic_exchange_explicit(&s_hist[stage].max_ns, 0, memory_order_relaxed);
+    sum->p50_ns = sum->p99_ns = 0;
+    if (total == 0) return;
+
+    uint64_t rank50 = (total + 1) / 2;
+    uint64_t rank99 = total - total / 100;
+    uint64_t seen = 0;
+    for (unsigned b = 0; b < PERF_BUCKETS; b++) {
+        seen += diff[b];
+        if (sum->p50_ns == 0 && seen >= rank50) sum->p50_ns = bucket_ns(b);
+        if (seen >= rank99) {
+            sum->p99_ns = bucket_ns(b);
+            break;
+        }
+    }
+    // The histogram resolution must not report a p99 above the real maximum
+    if (sum->max_ns > 0 && sum->p99_ns > sum->max_ns) sum->p99_ns = sum->max_ns;
+    if (sum->max_ns > 0 && sum->p50_ns > sum->max_ns) sum->p50_ns = sum->max_ns;
+}
+
+static uint8_t rb_fill_percent(ringbuffer_t *rb) {
+    if (!rb) return 0;
+    rb_stats_t st;
+    rb_get_stats(rb, &st);
+    if (st.size == 0) return 0;
+    return (uint8_t)(st.fill * 100 / st.size);
+}
+
+void gui_perf_update(gui_app_t *app) {
+    if (!gui_perf_enabled()) return;
+
+    uint64_t now = get_time_ms();
+
+    // Ringbuffer fill history
+    if (now - s_last_fill_ms >= PERF_FILL_PERIOD_MS) {
+        s_last_fill_ms = now;
+        if (s_fill_count == PERF_FILL_HISTORY) {
+            for (int r = 0; r < FILL_COUNT; r++) {
+                memmove(s_fill[r], s_fill[r] + 1, PERF_FILL_HISTORY - 1);
+            }
+            s_fill_count--;
+        }
+        s_fill[FILL_CAPTURE][s_fill_count] = app->is_capturing ? rb_fill_percent(gui_extract_get_capture_rb()) : 0;
+        s_fill[FILL_RECORD_A][s_fill_count] = app->is_recording ? rb_fill_percent(gui_extract_get_record_rb_a()) : 0;
+        s_fill[FILL_RECORD_B][s_fill_count] = app->is_recording ? rb_fill_percent(gui_extract_get_record_rb_b()) : 0;
+        s_fill_count++;
+    }
+
+    // Roll the statistics window
+    uint64_t samples = atomic_load(&app->total_samples);
+    if (s_window_start_ms == 0) {
+        s_window_start_ms = now;
+        s_window_samples = samples;
+        return;
+    }
+    if (now - s_window_start_ms < PERF_WINDOW_MS) return;
+
+    for (int s = 0; s < PERF_STAGE_COUNT; s++) {
+        summarize_stage(s);
+    }
+    s_achieved_rate = (double)(samples - s_window_samples) * 1000.0 / (double)(now - s_window_start_ms);
+    s_window_start_ms = now;
+    s_window_samples = samples;
+}
+
+//-----------------------------------------------------------------------------
+// Overlay
+//-----------------------------------------------------------------------------
+
+static void format_duration(char *buf, size_t size, uint64_t ns) {
+    if (ns == 0) {
+        snprintf(buf, size, "-");
+    } else if (ns < 1000000) {
+        snprintf(buf, size, "%.1fus", (double)ns / 1000.0);
+    } else {
+        snprintf(buf, size, "%.2fms", (double)ns / 1000000.0);
+    }
+}
+
+void gui_perf_draw(gui_app_t *app) {
+    if (!gui_perf_enabled()) return;
+
+    const int font = FONT_SIZE_STATS;
+    const float row_h = 20.0f;
+    const float col_x[5] = { 0.0f, 150.0f, 220.0f, 310.0f, 400.0f };
+    const float pad = 10.0f;
+    const float width = 500.0f;
+    const float graph_h = 60.0f;
+    const float height = pad * 2 + row_h * (PERF_STAGE_COUNT + 3) + graph_h + 8.0f;
+    const float x = 10.0f;
+    const float y = 60.0f;
+    char buf[48];
+
+    DrawRectangle((int)x, (int)y, (int)width, (int)height, (Color){ 15, 15, 20, 220 });
+    DrawRectangleLines((int)x, (int)y, (int)width, (int)height, COLOR_GRID_MAJOR);
+
+    // Stage table
+    float cx = x + pad;
+    float cy = y + pad;
+    const char *headers[5] = { "Stage (1s)", "n/s", "p50", "p99", "max" };
+    for (int c = 0; c < 5; c++) {
+        gui_text_draw(headers[c], cx + col_x[c], cy, font, COLOR_TEXT_DIM);
+    }
+    cy += row_h;
+
+    for (int s = 0; s < PERF_STAGE_COUNT; s++) {
+        const perf_summary_t *sum = &s_summary[s];
+        Color color = (sum->count > 0) ? COLOR_TEXT : COLOR_TEXT_DIM;
+        gui_text_draw(s_stage_names[s], cx, cy, font, color);
+        snprintf(buf, sizeof(buf), "%llu", (unsigned long long)sum->count);
+        gui_text_draw_mono(buf, cx + col_x[1], cy, font, color);
+        format_duration(buf, sizeof(buf), sum->p50_ns);
+        gui_text_draw_mono(buf, cx + col_x[2], cy, font, color);
+        format_duration(buf, sizeof(buf), sum->p99_ns);
+        gui_text_draw_mono(buf, cx + col_x[3], cy, font, color);
+        format_duration(buf, sizeof(buf), sum->max_ns);
+        gui_text_draw_mono(buf, cx + col_x[4], cy, font, color);
+        cy += row_h;
+    }
+
+    // Achieved vs. nominal sample rate
+    uint32_t nominal = atomic_load(&app->sample_rate);
+    double ratio = (nominal > 0) ? s_achieved_rate / (double)nominal * 100.0 : 0.0;
+    snprintf(buf, sizeof(buf), "%.3f / %.3f MSPS (%.1f%%)",
+             s_achieved_rate / 1e6, (double)nominal / 1e6, ratio);
+    gui_text_draw("Sample rate", cx, cy, font, COLOR_TEXT);
+    gui_text_draw_mono(buf, cx + col_x[1], cy, font,
+                       (app->is_capturing && ratio < 99.0) ? COLOR_METER_YELLOW : COLOR_TEXT);
+    cy += row_h;
+
+    // Ringbuffer fill history (0-100%, newest on the right)
+    const Color fill_colors[FILL_COUNT] = {
+        { 120, 170, 255, 255 }, COLOR_CHANNEL_A, COLOR_CHANNEL_B
+    };
+    static const char *fill_names[FILL_COUNT] = { "Capture", "Rec A", "Rec B" };
+    float lx = cx;
+    gui_text_draw("Buffer fill", lx, cy, font, COLOR_TEXT);
+    lx = cx + col_x[1];
+    for (int r = 0; r < FILL_COUNT; r++) {
+        uint8_t last = (s_fill_count > 0) ? s_fill[r][s_fill_count - 1] : 0;
+        snprintf(buf, sizeof(buf), "%s %u%%", fill_names[r], last);
+        gui_text_draw_mono(buf, lx, cy, font, fill_colors[r]);
+        lx += (float)gui_text_measure_mono(buf, font) + 16.0f;
+    }
+    cy += row_h + 4.0f;
+
+    float gx = cx;
+    float gw = width - pad * 2;
+    DrawRectangle((int)gx, (int)cy, (int)gw, (int)graph_h, COLOR_METER_BG);
+    DrawLine((int)gx, (int)(cy + graph_h * 0.5f), (int)(gx + gw), (int)(cy + graph_h * 0.5f), COLOR_GRID);
+    float step = gw / (float)(PERF_FILL_HISTORY - 1);
+    float x0 = gx + gw - step * (float)(s_fill_count - 1);
+    for (int r = 0; r < FILL_COUNT; r++) {
+        for (int i = 1; i < s_fill_count; i++) {
+            float ya = cy + graph_h - graph_h * (float)s_fill[r][i - 1] / 100.0f;
+            float yb = cy + graph_h - graph_h * (float)s_fill[r][i] / 100.0f;
+            DrawLineV((Vector2){ x0 + step * (float)(i - 1), ya }, (Vector2){ x0 + step * (float)i, yb },
+                      fill_colors[r]);
+        }
+    }
+}
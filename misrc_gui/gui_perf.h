@@ -0,0 +1,55 @@
+/*
+ * MISRC GUI - Pipeline Performance HUD
+ *
+ * Per-stage timing histograms for the capture pipeline, shown as an overlay
+ * (F3 or --perf-hud) with p50/p99/max over the last second, the ringbuffer
+ * fill history and the achieved vs. nominal sample rate.
+ *
+ * Every stage is timed by exactly one thread, which only does relaxed
+ * load/store increments on its own histogram (no locked instructions, no
+ * shared cache lines between stages). The render thread reads the counters
+ * once per second. While the HUD is off, gui_perf_begin() returns 0 without
+ * reading the clock and nothing is recorded.
+ */
+
+#ifndef GUI_PERF_H
+#define GUI_PERF_H
+
+#include "gui_app.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Pipeline stages (each one is timed by a single thread)
+typedef enum {
+    PERF_STAGE_CALLBACK,    // USB callback (gui_capture_callback), capture thread
+    PERF_STAGE_PARSE,       // Frame parse and payload copy, in the callback or on the --parser-thread thread
+    PERF_STAGE_EXTRACT,     // Extraction kernel per block, extraction thread
+    PERF_STAGE_DISPLAY,     // Display frame update per block, display thread
+    PERF_STAGE_FFT,         // Welch spectrum of one channel, FFT worker thread
+    PERF_STAGE_RENDER,      // Layout and drawing of one frame (without vsync wait)
+    PERF_STAGE_WRITER_A,    // Record writer channel A per block
+    PERF_STAGE_WRITER_B,    // Record writer channel B per block
+    PERF_STAGE_FRAME_INTERVAL, // Time between USB frame arrivals, not a cost
+    PERF_STAGE_COUNT
+} perf_stage_t;
+
+// Show/hide the overlay, timing is only collected while it is shown
+void gui_perf_set_enabled(bool enabled);
+bool gui_perf_enabled(void);
+
+// Start timing a stage, returns 0 while disabled
+uint64_t gui_perf_begin(void);
+
+// Record the time since gui_perf_begin() (ignored if t0 is 0)
+void gui_perf_end(perf_stage_t stage, uint64_t t0);
+
+// Record a duration measured elsewhere (nanoseconds)
+void gui_perf_record(perf_stage_t stage, uint64_t ns);
+
+// Sample ringbuffer fill and roll the statistics window (render thread, every frame)
+void gui_perf_update(gui_app_t *app);
+
+// Draw the overlay in the top-left corner of the window (render thread)
+void gui_perf_draw(gui_app_t *app);
+
+#endif // GUI_PERF_H
@@ -5,42 +5,15 @@
  */
 
 #include "gui_phosphor_rt.h"
+#include "gui_glsl.h"
 #include "rlgl.h"
 #include <stdlib.h>
+#include <stdint.h>
 
 //-----------------------------------------------------------------------------
 // Shader Code (embedded GLSL)
 //-----------------------------------------------------------------------------
 
-#if defined(GRAPHICS_API_OPENGL_ES2)
-    #define GLSL_VERSION_STRING "#version 100\n"
-    #define GLSL_PRECISION "precision mediump float;\n"
-    #define GLSL_IN "attribute "
-    #define GLSL_OUT "varying "
-    #define GLSL_FRAG_IN "varying "
-    #define GLSL_FRAG_OUT ""
-    #define GLSL_FRAG_COLOR "gl_FragColor"
-    #define GLSL_TEXTURE "texture2D"
-#elif defined(GRAPHICS_API_OPENGL_ES3)
-    #define GLSL_VERSION_STRING "#version 300 es\n"
-    #define GLSL_PRECISION "precision mediump float;\n"
-    #define GLSL_IN "in "
-    #define GLSL_OUT "out "
-    #define GLSL_FRAG_IN "in "
-    #define GLSL_FRAG_OUT "out vec4 finalColor;\n"
-    #define GLSL_FRAG_COLOR "finalColor"
-    #define GLSL_TEXTURE "texture"
-#else  // Desktop OpenGL 3.3+
-    #define GLSL_VERSION_STRING "#version 330\n"
-    #define GLSL_PRECISION ""
-    #define GLSL_IN "in "
-    #define GLSL_OUT "out "
-    #define GLSL_FRAG_IN "in "
-    #define GLSL_FRAG_OUT "out vec4 finalColor;\n"
-    #define GLSL_FRAG_COLOR "finalColor"
-    #define GLSL_TEXTURE "texture"
-#endif
-
 // Vertex shader - standard passthrough
 static const char *phosphor_vs =
     GLSL_VERSION_STRING
@@ -188,6 +161,72 @@ static const char *phosphor_decay_fs =
     "    " GLSL_FRAG_COLOR " = vec4(intensity, 0.0, 0.0, 1.0);\n"
     "}\n";
 
+#if GLSL_HAS_TEXEL_FETCH
+// Waveform vertex shader - expands the display samples into 1 pixel wide line quads
+// Every column has 12 static vertices: x = column, y = quad corner (0-5),
+// z = 0 for the segment to the next column, 1 for the column's min/max envelope.
+// The samples (value, min, max) are read from a PHOSPHOR_MAX_WIDTH x 1 float texture,
+// quads that are not needed collapse to a point outside the viewport.
+static const char *phosphor_wave_vs =
+    GLSL_VERSION_STRING
+    "precision highp float;\n"
+    GLSL_IN "vec3 vertexPosition;\n"
+    "uniform highp sampler2D samples;\n"
+    "uniform float sampleCount;\n"
+    "uniform vec2 targetSize;\n"
+    "uniform float pixelScale;\n"
+    "\n"
+    "void main() {\n"
+    "    float col = vertexPosition.x;\n"
+    "    float corner = vertexPosition.y;\n"
+    "    float centerY = targetSize.y * 0.5;\n"
+    "    vec3 s0 = texelFetch(samples, ivec2(int(col), 0), 0).rgb;\n"
+    "    vec2 p0;\n"
+    "    vec2 p1;\n"
+    "    if (vertexPosition.z < 0.5) {\n"
+    "        if (col + 1.0 >= sampleCount) {\n"
+    "            gl_Position = vec4(-2.0, -2.0, 0.0, 1.0);\n"
+    "            return;\n"
+    "        }\n"
+    "        float v1 = texelFetch(samples, ivec2(int(col) + 1, 0), 0).r;\n"
+    "        p0 = vec2(col, centerY - s0.r * pixelScale);\n"
+    "        p1 = vec2(col + 1.0, centerY - v1 * pixelScale);\n"
+    "    } else {\n"
+    "        if (col >= sampleCount || s0.b <= s0.g) {\n"
+    "            gl_Position = vec4(-2.0, -2.0, 0.0, 1.0);\n"
+    "            return;\n"
+    "        }\n"
+    "        p0 = vec2(col, centerY - s0.b * pixelScale);\n"
+    "        p1 = vec2(col, centerY - s0.g * pixelScale);\n"
+    "    }\n"
+    "\n"
+    "    // Same quad as DrawLineEx() with thickness 1\n"
+    "    vec2 d = p1 - p0;\n"
+    "    float len = length(d);\n"
+    "    vec2 dir = (len > 0.0) ? d / len : vec2(1.0, 0.0);\n"
+    "    vec2 n = vec2(-dir.y, dir.x) * 0.5;\n"
+    "    float along = (corner == 2.0 || corner == 4.0 || corner == 5.0) ? 1.0 : 0.0;\n"
+    "    float side = (corner == 1.0 || corner == 2.0 || corner == 4.0) ? 1.0 : -1.0;\n"
+    "    vec2 p = mix(p0, p1, along) + n * side;\n"
+    "\n"
+    "    // Same projection as BeginTextureMode() (origin top-left)\n"
+    "    gl_Position = vec4(p.x / targetSize.x * 2.0 - 1.0, 1.0 - p.y / targetSize.y * 2.0, 0.0, 1.0);\n"
+    "}\n";
+
+// Waveform fragment shader - constant hit intensity, accumulated by additive blending
+static const char *phosphor_wave_fs =
+    GLSL_VERSION_STRING
+    GLSL_PRECISION
+    GLSL_FRAG_OUT
+    "uniform float hitIntensity;\n"
+    "\n"
+    "void main() {\n"
+    "    " GLSL_FRAG_COLOR " = vec4(hitIntensity, 0.0, 0.0, 1.0);\n"
+    "}\n";
+
+#define PHOSPHOR_WAVE_VERTS_PER_COLUMN 12
+#endif
+
 //-----------------------------------------------------------------------------
 // Shader State (shared across all instances)
 //-----------------------------------------------------------------------------
@@ -204,6 +243,26 @@ static int s_opacity_channelColor_loc = -1;
 static int s_opacity_bloomIntensity_loc = -1;
 static int s_decay_decayRate_loc = -1;
 
+#if GLSL_HAS_TEXEL_FETCH
+// GPU waveform path (created on first draw, falls back to DrawLineEx() if unavailable)
+static Shader s_wave_shader = {0};
+static unsigned int s_wave_vao = 0;
+static unsigned int s_wave_vbo = 0;
+static unsigned int s_wave_texture = 0;
+static bool s_wave_loaded = false;
+static bool s_wave_failed = false;
+
+static int s_wave_samples_loc = -1;
+static int s_wave_sampleCount_loc = -1;
+static int s_wave_targetSize_loc = -1;
+static int s_wave_pixelScale_loc = -1;
+static int s_wave_hitIntensity_loc = -1;
+
+// Display samples are uploaded as they are, one RGB32F texel per column
+_Static_assert(sizeof(waveform_sample_t) == 3 * sizeof(float),
+               "waveform_sample_t must be three packed floats");
+#endif
+
 //-----------------------------------------------------------------------------
 // Shader Management
 //-----------------------------------------------------------------------------
@@ -246,7 +305,85 @@ bool phosphor_rt_init_shaders(void) {
     return true;
 }
 
+#if GLSL_HAS_TEXEL_FETCH
+static void phosphor_rt_unload_wave(void) {
+    if (s_wave_vao) rlUnloadVertexArray(s_wave_vao);
+    if (s_wave_vbo) rlUnloadVertexBuffer(s_wave_vbo);
+    if (s_wave_texture) rlUnloadTexture(s_wave_texture);
+    if (s_wave_shader.id) UnloadShader(s_wave_shader);
+    s_wave_vao = 0;
+    s_wave_vbo = 0;
+    s_wave_texture = 0;
+    s_wave_shader.id = 0;
+    s_wave_loaded = false;
+}
+
+// Create the waveform shader, the static column vertices and the sample texture
+static bool phosphor_rt_init_wave(void) {
+    if (s_wave_loaded) return true;
+    if (s_wave_failed) return false;
+
+    s_wave_failed = true;  // Until everything is created
+
+    s_wave_shader = LoadShaderFromMemory(phosphor_wave_vs, phosphor_wave_fs);
+    if (s_wave_shader.id == 0) {
+        TraceLog(LOG_WARNING, "PHOSPHOR_RT: Failed to load waveform shader, drawing lines on the CPU");
+        return false;
+    }
+    s_wave_samples_loc = GetShaderLocation(s_wave_shader, "samples");
+    s_wave_sampleCount_loc = GetShaderLocation(s_wave_shader, "sampleCount");
+    s_wave_targetSize_loc = GetShaderLocation(s_wave_shader, "targetSize");
+    s_wave_pixelScale_loc = GetShaderLocation(s_wave_shader, "pixelScale");
+    s_wave_hitIntensity_loc = GetShaderLocation(s_wave_shader, "hitIntensity");
+
+    // Static (column, corner, kind) vertices for the widest phosphor buffer
+    size_t vert_count = (size_t)PHOSPHOR_MAX_WIDTH * PHOSPHOR_WAVE_VERTS_PER_COLUMN;
+    float *verts = malloc(vert_count * 3 * sizeof(float));
+    if (!verts) {
+        phosphor_rt_unload_wave();
+        return false;
+    }
+    float *v = verts;
+    for (int col = 0; col < PHOSPHOR_MAX_WIDTH; col++) {
+        for (int kind = 0; kind < 2; kind++) {
+            for (int corner = 0; corner < 6; corner++) {
+                *v++ = (float)col;
+                *v++ = (float)corner;
+                *v++ = (float)kind;
+            }
+        }
+    }
+
+    s_wave_vao = rlLoadVertexArray();
+    if (s_wave_vao) {
+        rlEnableVertexArray(s_wave_vao);
+        s_wave_vbo = rlLoadVertexBuffer(verts, (int)(vert_count * 3 * sizeof(float)), false);
+        rlSetVertexAttribute(0, 3, RL_FLOAT, false, 0, 0);
+        rlEnableVertexAttribute(0);
+        rlDisableVertexArray();
+    }
+    free(verts);
+
+    s_wave_texture = rlLoadTexture(NULL, PHOSPHOR_MAX_WIDTH, 1, RL_PIXELFORMAT_UNCOMPRESSED_R32G32B32, 1);
+
+    if (!s_wave_vao || !s_wave_vbo || !s_wave_texture) {
+        TraceLog(LOG_WARNING, "PHOSPHOR_RT: Failed to create waveform buffers, drawing lines on the CPU");
+        phosphor_rt_unload_wave();
+        return false;
+    }
+
+    s_wave_failed = false;
+    s_wave_loaded = true;
+    TraceLog(LOG_INFO, "PHOSPHOR_RT: Waveforms are rasterized on the GPU");
+    return true;
+}
+#endif
+
 void phosphor_rt_cleanup_shaders(void) {
+#if GLSL_HAS_TEXEL_FETCH
+    phosphor_rt_unload_wave();
+    s_wave_failed = false;
+#endif
     if (s_shaders_loaded) {
         UnloadShader(s_composite_shader);
         UnloadShader(s_opacity_shader);
@@ -465,11 +602,10 @@ const float PHOSPHOR_CHANNEL_COLOR_B[3] = { 220.0f/255.0f, 200.0f/255.0f, 80.0f/
 // Waveform Drawing Helpers
 //-----------------------------------------------------------------------------
 
-void phosphor_rt_draw_waveform(phosphor_rt_t *prt,
-                               const waveform_sample_t *samples, size_t sample_count,
-                               float amplitude_scale) {
-    if (!prt || !prt->valid || !samples || sample_count < 2) return;
-
+// Draw waveform with one DrawLineEx() per segment (fallback path)
+static void phosphor_rt_draw_waveform_cpu(phosphor_rt_t *prt,
+                                          const waveform_sample_t *samples, size_t sample_count,
+                                          float amplitude_scale) {
     int buf_height = prt->height;
 
     // Scale factor: half height = full amplitude
@@ -489,4 +625,63 @@ void phosphor_rt_draw_waveform(phosphor_rt_t *prt,
 
         DrawLineEx((Vector2){x0, y0}, (Vector2){x1, y1}, 1.0f, waveColor);
     }
+
+    // Min/max envelope of columns that cover more than one sample
+    for (size_t i = 0; i < sample_count; i++) {
+        if (samples[i].max <= samples[i].min) continue;
+        float top = center_y - samples[i].max * scale * buf_height;
+        float bottom = center_y - samples[i].min * scale * buf_height;
+        DrawLineEx((Vector2){(float)i, top}, (Vector2){(float)i, bottom}, 1.0f, waveColor);
+    }
+}
+
+#if GLSL_HAS_TEXEL_FETCH
+// Draw waveform with one texture upload and one draw call, the vertex shader
+// builds the same quads as the CPU path from the sample texture
+static bool phosphor_rt_draw_waveform_gpu(phosphor_rt_t *prt,
+                                          const waveform_sample_t *samples, size_t sample_count,
+                                          float amplitude_scale) {
+    if (sample_count > PHOSPHOR_MAX_WIDTH || !phosphor_rt_init_wave()) return false;
+
+    // Draw the decayed previous frame queued by phosphor_rt_begin_frame() first
+    rlDrawRenderBatchActive();
+
+    rlUpdateTexture(s_wave_texture, 0, 0, (int)sample_count, 1,
+                    RL_PIXELFORMAT_UNCOMPRESSED_R32G32B32, samples);
+
+    float count = (float)sample_count;
+    float target[2] = {(float)prt->width, (float)prt->height};
+    float pixel_scale = amplitude_scale * 0.5f * prt->height;
+    float hit = prt->config.hit_increment;
+    int slot = 0;
+
+    rlEnableShader(s_wave_shader.id);
+    rlSetUniform(s_wave_sampleCount_loc, &count, RL_SHADER_UNIFORM_FLOAT, 1);
+    rlSetUniform(s_wave_targetSize_loc, target, RL_SHADER_UNIFORM_VEC2, 1);
+    rlSetUniform(s_wave_pixelScale_loc, &pixel_scale, RL_SHADER_UNIFORM_FLOAT, 1);
+    rlSetUniform(s_wave_hitIntensity_loc, &hit, RL_SHADER_UNIFORM_FLOAT, 1);
+    rlSetUniform(s_wave_samples_loc, &slot, RL_SHADER_UNIFORM_INT, 1);
+    rlActiveTextureSlot(0);
+    rlEnableTexture(s_wave_texture);
+
+    // Additive blending is active from phosphor_rt_begin_frame()
+    rlEnableVertexArray(s_wave_vao);
+    rlDrawVertexArray(0, (int)sample_count * PHOSPHOR_WAVE_VERTS_PER_COLUMN);
+    rlDisableVertexArray();
+
+    rlDisableTexture();
+    rlDisableShader();
+    return true;
+}
+#endif
+
+void phosphor_rt_draw_waveform(phosphor_rt_t *prt,
+                               const waveform_sample_t *samples, size_t sample_count,
+                               float amplitude_scale) {
+    if (!prt || !prt->valid || !samples || sample_count < 2) return;
+
+#if GLSL_HAS_TEXEL_FETCH
+    if (phosphor_rt_draw_waveform_gpu(prt, samples, sample_count, amplitude_scale)) return;
+#endif
+    phosphor_rt_draw_waveform_cpu(prt, samples, sample_count, amplitude_scale);
 }
@@ -11,10 +11,24 @@
 #include "gui_app.h"
 #include "gui_extract.h"
 #include "gui_popup.h"
+#include "gui_perf.h"
+#include "gui_simulated.h"
 
 #include "../misrc_common/ringbuffer.h"
+#include "../misrc_common/buffer.h"
+#include "../misrc_common/ringbuffer_writer.h"
 #include "../misrc_common/flac_writer.h"
+#include "../misrc_common/delta_codec.h"
+#include "../misrc_common/thread_role.h"
 #include "../misrc_common/threading.h"
+#include "../misrc_common/file_segment.h"
+#include "../misrc_common/file_utils.h"
+#include "../misrc_common/storage_probe.h"
+#include "../misrc_common/net_stream.h"
+#include "../misrc_common/rb_shm.h"
+#include "../misrc_common/preview.h"
+#include "../misrc_common/extract.h"
+#include "../misrc_common/resample_stage.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -53,6 +67,14 @@ static void format_file_size(off_t size, char *buf, size_t buf_size) {
 // External do_exit flag from ringbuffer.h
 extern atomic_int do_exit;
 
+// Sample index, closed only once no thread holds it
+static _Atomic(sample_index_t *) s_index = NULL;
+static atomic_int s_index_users = 0;
+
+// Preview stream, closed the same way
+static _Atomic(preview_t *) s_preview = NULL;
+static atomic_int s_preview_users = 0;
+
 // Writer threads
 static thrd_t s_writer_thread_a;
 static thrd_t s_writer_thread_b;
@@ -74,10 +96,14 @@ static uint32_t s_start_drop_count = 0;
 // File writer context
 typedef struct {
     ringbuffer_t *rb;
-    FILE *file;
+    FILE *file;      // Current segment when split, updated by the writer thread
+    file_segment_t *segment;  // NULL if not split
+    net_sink_t *net;  // tcp:// target instead of a file (RAW only)
+    resample_stage_t *stage;  // Decimation in front of the writer, rb is its output (NULL if off)
     int channel;  // 0 = A, 1 = B
 #if LIBFLAC_ENABLED == 1
     flac_writer_t *writer;
+    flac_writer_config_t flac_config;  // For the writers of later segments
     atomic_uint_fast64_t *compressed_bytes;
 #endif
     gui_app_t *app;  // For error reporting
@@ -86,6 +112,35 @@ typedef struct {
 static writer_ctx_t s_ctx_a;
 static writer_ctx_t s_ctx_b;
 
+// Decimation input ends, set by gui_record_stop() (the stages start before is_recording is set)
+static atomic_bool s_stage_input_done = false;
+
+static bool record_stage_input_done(void *ctx) {
+    (void)ctx;
+    return atomic_load(&do_exit) || atomic_load(&s_stage_input_done);
+}
+
+// Writer exit condition, remaining data is drained by the writer
+static bool raw_writer_should_exit(void *ctx) {
+    writer_ctx_t *wctx = (writer_ctx_t *)ctx;
+    // A decimation stage still converts what it has after the recording stopped
+    if (wctx->stage) {
+        return resample_stage_done(wctx->stage);
+    }
+    return atomic_load(&do_exit) || !s_recording_app || !s_recording_app->is_recording;
+}
+
+// Sample rate of the recorded channels, 1/n of the capture rate with decimation
+static uint32_t record_sample_rate(gui_app_t *app) {
+    uint32_t rate = atomic_load(&app->sample_rate);
+    return app->settings.decimation ? rate / app->settings.decimation : rate;
+}
+
+// Affinity and priority of the channel's writer role
+static void writer_apply_role(const writer_ctx_t *wctx) {
+    thread_role_apply(wctx->channel == 0 ? THREAD_ROLE_WRITER_A : THREAD_ROLE_WRITER_B);
+}
+
 #if LIBFLAC_ENABLED == 1
 // FLAC writers (managed by shared library)
 static flac_writer_t *s_flac_writer_a = NULL;
@@ -102,6 +157,16 @@ static void gui_flac_error_callback(void *user_data, flac_writer_error_t error,
 }
 
 // Bytes written callback for compression ratio tracking
+// Record ringbuffer fill for the adaptive level
+static double gui_flac_backlog_callback(void *user_data) {
+    writer_ctx_t *wctx = (writer_ctx_t *)user_data;
+    rb_stats_t stats;
+    // The flac step of the overload policy reports a full buffer, which steps the level down
+    if (overload_shed(gui_extract_get_overload(), OVERLOAD_FLAC)) return 1.0;
+    rb_get_stats(wctx->rb, &stats);
+    return stats.size ? (double)stats.fill / (double)stats.size : 0.0;
+}
+
 static void gui_flac_bytes_callback(void *user_data, size_t bytes_written) {
     writer_ctx_t *wctx = (writer_ctx_t *)user_data;
     if (wctx && wctx->compressed_bytes) {
@@ -109,27 +174,50 @@ static void gui_flac_bytes_callback(void *user_data, size_t bytes_written) {
     }
 }
 
+// Finish the current FLAC stream and start the next one in a new segment
+static void flac_next_segment(writer_ctx_t *wctx) {
+    if (!file_segment_wait_next(wctx->segment)) {
+        return;
+    }
+    flac_writer_finish(wctx->writer);
+    wctx->file = file_segment_next(wctx->segment);
+    wctx->writer = flac_writer_create_stream(wctx->file, &wctx->flac_config);
+    if (!wctx->writer) {
+        fprintf(stderr, "[FLAC] Failed to create encoder for segment %u of channel %c\n",
+                file_segment_index(wctx->segment), wctx->channel == 0 ? 'A' : 'B');
+    }
+}
+
 // FLAC file writer thread
 static int flac_writer_thread(void *ctx) {
     writer_ctx_t *wctx = (writer_ctx_t *)ctx;
-    size_t len = BUFFER_READ_SIZE * sizeof(int32_t);
-    size_t raw_bytes_per_block = BUFFER_READ_SIZE * sizeof(int16_t);
+    size_t len = BUFFER_READ_SIZE * sizeof(int16_t);
+    uint64_t segment_input = 0;
     void *buf;
 
     fprintf(stderr, "[FLAC] Writer thread %c started\n", wctx->channel == 0 ? 'A' : 'B');
+    writer_apply_role(wctx);
 
     while (1) {
+        if (wctx->segment && wctx->writer &&
+            file_segment_due(wctx->segment, flac_writer_get_bytes_written(wctx->writer), segment_input)) {
+            flac_next_segment(wctx);
+            segment_input = 0;
+        }
+        if (!wctx->writer) {
+            break;
+        }
         buf = rb_read_ptr(wctx->rb, len);
         if (!buf) {
             // No data available - check if we should exit
-            if (atomic_load(&do_exit) || !s_recording_app || !s_recording_app->is_recording) {
+            if (raw_writer_should_exit(wctx)) {
                 // Drain any remaining partial data before exiting
-                size_t remaining = wctx->rb->tail - wctx->rb->head;
+                size_t remaining = rb_available(wctx->rb);
                 if (remaining > 0 && remaining < len) {
-                    size_t remaining_samples = remaining / sizeof(int32_t);
+                    size_t remaining_samples = remaining / sizeof(int16_t);
                     buf = rb_read_ptr(wctx->rb, remaining);
                     if (buf && remaining_samples > 0) {
-                        flac_writer_process(wctx->writer, (const int32_t *)buf, remaining_samples);
+                        flac_writer_process_int16(wctx->writer, (const int16_t *)buf, remaining_samples);
                         rb_read_finished(wctx->rb, remaining);
                     }
                 }
@@ -139,19 +227,22 @@ static int flac_writer_thread(void *ctx) {
             continue;
         }
 
-        int result = flac_writer_process(wctx->writer, (const int32_t *)buf, BUFFER_READ_SIZE);
+        uint64_t t0 = gui_perf_begin();
+        int result = flac_writer_process_int16(wctx->writer, (const int16_t *)buf, BUFFER_READ_SIZE);
+        gui_perf_end(wctx->channel == 0 ? PERF_STAGE_WRITER_A : PERF_STAGE_WRITER_B, t0);
         if (result < 0) {
             fprintf(stderr, "FLAC encoder error on channel %c\n", wctx->channel == 0 ? 'A' : 'B');
         }
 
         rb_read_finished(wctx->rb, len);
+        segment_input += len;
 
         if (s_recording_app) {
             atomic_fetch_add(&s_recording_app->recording_bytes, len);
             if (wctx->channel == 0) {
-                atomic_fetch_add(&s_recording_app->recording_raw_a, raw_bytes_per_block);
+                atomic_fetch_add(&s_recording_app->recording_raw_a, len);
             } else {
-                atomic_fetch_add(&s_recording_app->recording_raw_b, raw_bytes_per_block);
+                atomic_fetch_add(&s_recording_app->recording_raw_b, len);
             }
         }
     }
@@ -161,25 +252,91 @@ static int flac_writer_thread(void *ctx) {
 }
 #endif
 
+
+static void raw_writer_progress(void *ctx, size_t written) {
+    writer_ctx_t *wctx = (writer_ctx_t *)ctx;
+    if (s_recording_app) {
+        atomic_fetch_add(&s_recording_app->recording_bytes, written);
+        if (wctx->channel == 0) {
+            atomic_fetch_add(&s_recording_app->recording_raw_a, written);
+        } else {
+            atomic_fetch_add(&s_recording_app->recording_raw_b, written);
+        }
+    }
+}
+
 // RAW file writer thread
 static int raw_writer_thread(void *ctx) {
     writer_ctx_t *wctx = (writer_ctx_t *)ctx;
-    size_t len = BUFFER_READ_SIZE * sizeof(int16_t);
+    rb_writer_config_t cfg;
 
     fprintf(stderr, "[RAW] Writer thread %c started\n", wctx->channel == 0 ? 'A' : 'B');
+    writer_apply_role(wctx);
+
+    rb_writer_config_init(&cfg, wctx->rb, wctx->file, BUFFER_READ_SIZE * sizeof(int16_t));
+    cfg.should_exit_cb = raw_writer_should_exit;
+    cfg.progress_cb = raw_writer_progress;
+    cfg.user_ctx = wctx;
+    if (wctx->app && wctx->app->settings.async_io) {
+        cfg.backend = RB_WRITER_ASYNC;
+        cfg.direct = wctx->app->settings.direct_io;
+    }
+    cfg.segment = wctx->segment;
+    rb_writer_run(&cfg);
+    wctx->file = cfg.file;
+
+    fprintf(stderr, "[RAW] Writer thread %c exiting\n", wctx->channel == 0 ? 'A' : 'B');
+    return 0;
+}
+
+// Network writer thread, a slow link backs up into the record ringbuffer like a slow disk
+static int net_writer_thread(void *ctx) {
+    writer_ctx_t *wctx = (writer_ctx_t *)ctx;
+
+    fprintf(stderr, "[NET] Writer thread %c started\n", wctx->channel == 0 ? 'A' : 'B');
+    writer_apply_role(wctx);
+    net_sink_run(wctx->net, wctx->rb, BUFFER_READ_SIZE * sizeof(int16_t),
+                 raw_writer_should_exit, raw_writer_progress, wctx, NULL);
+    if (net_sink_failed(wctx->net) && wctx->app) {
+        gui_app_set_status(wctx->app, "Network target lost");
+    }
+    net_sink_close(wctx->net);
+    wctx->net = NULL;
+
+    fprintf(stderr, "[NET] Writer thread %c exiting\n", wctx->channel == 0 ? 'A' : 'B');
+    return 0;
+}
+
+// Packed 12-bit RAW writer thread, 2 samples in 3 bytes (misrc_extract -u restores 16-bit)
+static int packed_writer_thread(void *ctx) {
+    writer_ctx_t *wctx = (writer_ctx_t *)ctx;
+    size_t len = BUFFER_READ_SIZE * sizeof(int16_t);
+    uint64_t segment_input = 0, segment_output = 0;
+    conv_16to12p_t pack = get_16to12p_function();
+    uint8_t *pack_buf = buffer_pool_get(gui_extract_get_pool(), PACKED12_SIZE(BUFFER_READ_SIZE));
+    void *buf;
+
+    fprintf(stderr, "[RAW] Packed 12-bit writer thread %c started\n", wctx->channel == 0 ? 'A' : 'B');
+    writer_apply_role(wctx);
+    if (!pack_buf) {
+        fprintf(stderr, "[RAW] Failed to allocate packing buffer\n");
+        return -1;
+    }
 
     while (1) {
-        void *buf = rb_read_ptr(wctx->rb, len);
+        buf = rb_read_ptr(wctx->rb, len);
         if (!buf) {
-            // No data available - check if we should exit
-            if (atomic_load(&do_exit) || !s_recording_app || !s_recording_app->is_recording) {
+            if (raw_writer_should_exit(wctx)) {
                 // Drain any remaining partial data before exiting
-                size_t remaining = wctx->rb->tail - wctx->rb->head;
+                size_t remaining = rb_available(wctx->rb);
                 if (remaining > 0 && remaining < len) {
                     buf = rb_read_ptr(wctx->rb, remaining);
                     if (buf) {
-                        fwrite(buf, 1, remaining, wctx->file);
+                        size_t out_len = PACKED12_SIZE(remaining / sizeof(int16_t));
+                        pack((int16_t *)buf, pack_buf, remaining / sizeof(int16_t));
                         rb_read_finished(wctx->rb, remaining);
+                        fwrite(pack_buf, 1, out_len, wctx->file);
+                        raw_writer_progress(wctx, out_len);
                     }
                 }
                 break;
@@ -187,20 +344,95 @@ static int raw_writer_thread(void *ctx) {
             thrd_sleep_ms(1);
             continue;
         }
+        if (wctx->segment && file_segment_due(wctx->segment, segment_output, segment_input)) {
+            FILE *next = file_segment_next(wctx->segment);
+            if (next) {
+                wctx->file = next;
+                segment_input = segment_output = 0;
+            }
+        }
 
-        size_t written = fwrite(buf, 1, len, wctx->file);
+        uint64_t t0 = gui_perf_begin();
+        pack((int16_t *)buf, pack_buf, BUFFER_READ_SIZE);
         rb_read_finished(wctx->rb, len);
+        if (fwrite(pack_buf, 1, PACKED12_SIZE(BUFFER_READ_SIZE), wctx->file) != PACKED12_SIZE(BUFFER_READ_SIZE)) {
+            fprintf(stderr, "[RAW] Write error on channel %c\n", wctx->channel == 0 ? 'A' : 'B');
+        }
+        gui_perf_end(wctx->channel == 0 ? PERF_STAGE_WRITER_A : PERF_STAGE_WRITER_B, t0);
+        raw_writer_progress(wctx, PACKED12_SIZE(BUFFER_READ_SIZE));
+        segment_input += len;
+        segment_output += PACKED12_SIZE(BUFFER_READ_SIZE);
+    }
 
-        if (s_recording_app) {
-            atomic_fetch_add(&s_recording_app->recording_bytes, written);
-            if (wctx->channel == 0) {
-                atomic_fetch_add(&s_recording_app->recording_raw_a, written);
-            } else {
-                atomic_fetch_add(&s_recording_app->recording_raw_b, written);
+    buffer_pool_put(gui_extract_get_pool(), pack_buf);
+    fprintf(stderr, "[RAW] Writer thread %c exiting\n", wctx->channel == 0 ? 'A' : 'B');
+    return 0;
+}
+
+// Delta coded RAW writer thread, every segment is a complete stream (misrc_extract -D restores 16-bit)
+static int delta_writer_thread(void *ctx) {
+    writer_ctx_t *wctx = (writer_ctx_t *)ctx;
+    size_t len = BUFFER_READ_SIZE * sizeof(int16_t);
+    uint64_t segment_input = 0;
+    uint32_t rate = record_sample_rate(wctx->app);
+    delta_writer_t *writer;
+    void *buf;
+
+    fprintf(stderr, "[RAW] Delta coding writer thread %c started\n", wctx->channel == 0 ? 'A' : 'B');
+    writer_apply_role(wctx);
+    writer = delta_writer_create(wctx->file, rate);
+    if (!writer) {
+        return -1;
+    }
+
+    while (1) {
+        if (wctx->segment && file_segment_due(wctx->segment, delta_writer_get_bytes_written(writer), segment_input) &&
+            file_segment_wait_next(wctx->segment)) {
+            delta_writer_finish(writer);
+            wctx->file = file_segment_next(wctx->segment);
+            segment_input = 0;
+            writer = delta_writer_create(wctx->file, rate);
+            if (!writer) {
+                fprintf(stderr, "[RAW] Failed to start segment %u of channel %c\n",
+                        file_segment_index(wctx->segment), wctx->channel == 0 ? 'A' : 'B');
+                return -1;
+            }
+        }
+        buf = rb_read_ptr(wctx->rb, len);
+        if (!buf) {
+            if (raw_writer_should_exit(wctx)) {
+                // Drain any remaining partial data before exiting
+                size_t remaining = rb_available(wctx->rb) & ~(size_t)1;
+                if (remaining > 0 && remaining < len) {
+                    buf = rb_read_ptr(wctx->rb, remaining);
+                    if (buf) {
+                        uint64_t before = delta_writer_get_bytes_written(writer);
+                        delta_writer_process(writer, (const int16_t *)buf, remaining / sizeof(int16_t));
+                        rb_read_finished(wctx->rb, remaining);
+                        raw_writer_progress(wctx, delta_writer_get_bytes_written(writer) - before);
+                    }
+                }
+                break;
             }
+            thrd_sleep_ms(1);
+            continue;
+        }
+
+        uint64_t t0 = gui_perf_begin();
+        uint64_t before = delta_writer_get_bytes_written(writer);
+        if (delta_writer_process(writer, (const int16_t *)buf, BUFFER_READ_SIZE) != 0) {
+            fprintf(stderr, "[RAW] Write error on channel %c\n", wctx->channel == 0 ? 'A' : 'B');
         }
+        rb_read_finished(wctx->rb, len);
+        gui_perf_end(wctx->channel == 0 ? PERF_STAGE_WRITER_A : PERF_STAGE_WRITER_B, t0);
+        raw_writer_progress(wctx, delta_writer_get_bytes_written(writer) - before);
+        segment_input += len;
     }
 
+    // The file itself is closed by gui_record_stop()
+    if (delta_writer_finish(writer) != 0) {
+        fprintf(stderr, "[RAW] Write error on channel %c\n", wctx->channel == 0 ? 'A' : 'B');
+    }
     fprintf(stderr, "[RAW] Writer thread %c exiting\n", wctx->channel == 0 ? 'A' : 'B');
     return 0;
 }
@@ -225,6 +457,191 @@ bool gui_record_is_pending(void) {
     return s_overwrite_pending;
 }
 
+// Open a recording file, split into segments if configured or one per trigger event
+// flac: the segment input is 16-bit samples either way, FLAC and delta coded files end up at about half
+static FILE *open_record_file(gui_app_t *app, const char *name, bool flac, file_segment_t **segment) {
+    file_segment_config_t cfg;
+    FILE *f = NULL;
+
+    *segment = NULL;
+    if (app->settings.segment_bytes == 0 && app->settings.segment_seconds == 0 && !app->settings.trigger_on) {
+        return fopen(name, "wb");
+    }
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.path = name;
+    cfg.max_bytes = app->settings.segment_bytes;
+    cfg.max_input = app->settings.segment_seconds * record_sample_rate(app) * sizeof(int16_t);
+    if (app->settings.trigger_on) {
+        // Events are counted in capture samples, the files may be decimated
+        cfg.max_input = gui_extract_trigger_event_samples(app) / (app->settings.decimation ? app->settings.decimation : 1) * sizeof(int16_t);
+    }
+    cfg.overwrite = true;  // Confirmed by the popup
+    cfg.preallocate = cfg.max_bytes ? cfg.max_bytes : (flac ? cfg.max_input / 2 : cfg.max_input);
+    *segment = file_segment_open(&cfg, &f);
+    return f;
+}
+
+// Connect a tcp:// target, blocks until the receiver is there
+static net_sink_t *open_record_sink(gui_app_t *app, const char *name, int channel) {
+    net_stream_header_t header;
+    net_stream_header_init(&header, record_sample_rate(app), NET_FORMAT_S16, (uint8_t)channel,
+                           BUFFER_READ_SIZE * sizeof(int16_t));
+    return net_sink_open(name, &header);
+}
+
+// Decimation runs on a stage thread between a record ringbuffer and its writer
+// Returns the ringbuffer the writer reads, NULL if the stage could not start
+static ringbuffer_t *start_record_stage(gui_app_t *app, writer_ctx_t *wctx, ringbuffer_t *rb) {
+    resample_stage_config_t cfg;
+
+    wctx->stage = NULL;
+    if (app->settings.decimation == 0) {
+        return rb;
+    }
+    resample_stage_config_init(&cfg, rb, BUFFER_READ_SIZE * sizeof(int16_t), 1.0, 1.0);
+    cfg.decimation = app->settings.decimation;
+    cfg.should_exit = record_stage_input_done;
+    atomic_store(&s_stage_input_done, false);
+    wctx->stage = resample_stage_start(&cfg);
+    return wctx->stage ? resample_stage_output(wctx->stage) : NULL;
+}
+
+// The writers have to be done with the stage outputs
+static void stop_record_stages(void) {
+    resample_stage_stop(s_ctx_a.stage);
+    resample_stage_stop(s_ctx_b.stage);
+    s_ctx_a.stage = s_ctx_b.stage = NULL;
+}
+
+static void close_record_file(FILE *f, file_segment_t *segment) {
+    if (segment) {
+        file_segment_close(segment);
+    } else if (f) {
+        fclose(f);
+    }
+}
+
+sample_index_t *gui_record_index_acquire(void) {
+    atomic_fetch_add(&s_index_users, 1);
+    sample_index_t *index = atomic_load(&s_index);
+    if (!index) {
+        atomic_fetch_sub(&s_index_users, 1);
+    }
+    return index;
+}
+
+void gui_record_index_release(void) {
+    atomic_fetch_sub(&s_index_users, 1);
+}
+
+// The index sits next to channel A, offsets are the same for both channels
+static void open_record_index(gui_app_t *app) {
+    char name[sizeof(app->settings.output_filename_a) + 4];
+    FILE *f = NULL;
+    snprintf(name, sizeof(name), "%s.idx", app->settings.output_filename_a);
+    if (file_open_write(&f, name, true, false) != 0) {
+        fprintf(stderr, "[REC] Failed to open sample index %s, recording without\n", name);
+        return;
+    }
+    atomic_store(&s_index, sample_index_open(f, atomic_load(&app->sample_rate)));
+}
+
+static void close_record_index(void) {
+    sample_index_t *index = atomic_exchange(&s_index, NULL);
+    if (!index) return;
+    while (atomic_load(&s_index_users) > 0) {
+        thrd_sleep_ms(1);
+    }
+    sample_index_close(index);
+}
+
+preview_t *gui_record_preview_acquire(void) {
+    atomic_fetch_add(&s_preview_users, 1);
+    preview_t *preview = atomic_load(&s_preview);
+    if (!preview) {
+        atomic_fetch_sub(&s_preview_users, 1);
+    }
+    return preview;
+}
+
+void gui_record_preview_release(void) {
+    atomic_fetch_sub(&s_preview_users, 1);
+}
+
+// Recording goes on without a preview that cannot be opened
+static void open_record_preview(gui_app_t *app) {
+    const char *dest = app->settings.preview_path;
+    preview_config_t cfg;
+    FILE *f = NULL;
+    if (dest[0] == '\0') return;
+    if (!net_stream_is_url(dest) && !rb_shm_is_url(dest) && file_open_write(&f, dest, true, false) != 0) {
+        fprintf(stderr, "[REC] Failed to open preview %s, recording without\n", dest);
+        return;
+    }
+    preview_config_init(&cfg, atomic_load(&app->sample_rate));
+    cfg.decimation = app->settings.preview_decimation;
+    preview_t *preview = preview_open(dest, f, &cfg);
+    if (!preview) {
+        if (f) fclose(f);
+        fprintf(stderr, "[REC] Failed to start preview %s, recording without\n", dest);
+        return;
+    }
+    atomic_store(&s_preview, preview);
+}
+
+static void close_record_preview(void) {
+    preview_t *preview = atomic_exchange(&s_preview, NULL);
+    if (!preview) return;
+    while (atomic_load(&s_preview_users) > 0) {
+        thrd_sleep_ms(1);
+    }
+    preview_close(preview);
+}
+
+// Probe where the recording goes with the writer it will use, false if it cannot keep up
+static bool record_preflight(gui_app_t *app, bool flac) {
+    const char *names[2] = { app->settings.output_filename_a, app->settings.output_filename_b };
+    double ratio = flac ? 0.5 : (app->settings.delta_coding ? 0.6 : (app->settings.packed_12bit ? 0.75 : 1.0));  // FLAC and delta coding are guesses
+    double channel_rate = record_sample_rate(app) * sizeof(int16_t) * ratio;
+    bool same = storage_probe_same_dir(names[0], names[1]);
+    double slowest = 0.0;
+    bool probed = false;
+    storage_probe_verdict_t worst = STORAGE_PROBE_OK;
+
+    app->recording_target_rate = channel_rate * 2;
+    for (int i = 0; i < (same ? 1 : 2); i++) {
+        storage_probe_config_t cfg;
+        storage_probe_result_t res;
+        double required = same ? channel_rate * 2 : channel_rate;
+        if (net_stream_is_url(names[i])) continue;
+        storage_probe_config_init(&cfg, names[i], BUFFER_READ_SIZE * sizeof(int16_t));
+        if (!flac && !app->settings.packed_12bit && !app->settings.delta_coding && app->settings.async_io) {
+            cfg.backend = RB_WRITER_ASYNC;
+            cfg.direct = app->settings.direct_io;
+        }
+        storage_probe_verdict_t v = (storage_probe_run(&cfg, &res) == 0) ? storage_probe_judge(&res, required)
+                                                                         : STORAGE_PROBE_FAILED;
+        fprintf(stderr, "[REC] Preflight %s: %.1f MB/s measured, %.1f MB/s needed\n",
+                names[i], res.bytes_per_sec / 1e6, required / 1e6);
+        if (!probed || res.bytes_per_sec < slowest) slowest = res.bytes_per_sec;
+        probed = true;
+        if (v > worst) worst = v;
+    }
+    app->recording_probe_rate = slowest;
+
+    if (worst >= STORAGE_PROBE_TOO_SLOW) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "Storage too slow: %.0f MB/s, recording needs %.0f MB/s",
+                 slowest / 1e6, app->recording_target_rate / 1e6);
+        gui_app_set_status(app, msg);
+        return false;
+    }
+    if (worst == STORAGE_PROBE_MARGINAL) {
+        fprintf(stderr, "[REC] WARNING: storage has little headroom, expect backpressure waits\n");
+    }
+    return true;
+}
+
 // Forward declaration of actual recording start (after confirmation)
 static int gui_record_start_confirmed(gui_app_t *app);
 
@@ -312,11 +729,9 @@ void gui_record_check_popup(gui_app_t *app) {
 // Internal: Start recording after confirmation
 static int gui_record_start_confirmed(gui_app_t *app) {
 
-    // Check if using simulated device (doesn't use extraction thread)
-    bool is_simulated = false;
-    if (app->device_count > 0 && app->selected_device < app->device_count) {
-        is_simulated = (app->devices[app->selected_device].type == DEVICE_TYPE_SIMULATED);
-    }
+    // Check if the simulated device feeds the display (doesn't use extraction thread)
+    bool is_simulated = app->is_capturing && app->active_device.type == DEVICE_TYPE_SIMULATED &&
+                        !gui_simulated_feeds_frames(app);
 
     // Verify extraction thread is running (or simulated capture)
     if (!gui_extract_is_running() && !is_simulated) {
@@ -345,20 +760,55 @@ static int gui_record_start_confirmed(gui_app_t *app) {
     atomic_store(&app->recording_compressed_a, 0);
     atomic_store(&app->recording_compressed_b, 0);
 
+    // Network targets take the samples as they are, FLAC needs a file to seek back into
+    if (LIBFLAC_ENABLED == 1 && app->settings.use_flac &&
+        (net_stream_is_url(app->settings.output_filename_a) || net_stream_is_url(app->settings.output_filename_b))) {
+        gui_app_set_status(app, "Network targets need RAW recording");
+        return RECORD_ERROR;
+    }
+
+    // Refuse before any file is touched if the disk cannot keep up
+    app->recording_target_rate = 0.0;
+    if (app->settings.preflight) {
+        gui_app_set_status(app, "Probing storage...");
+        if (!record_preflight(app, LIBFLAC_ENABLED == 1 && app->settings.use_flac)) {
+            return RECORD_ERROR;
+        }
+    }
+
     // Reset record ringbuffers before starting
     gui_extract_reset_record_rbs();
 
+    // Only hardware capture has frame counters to index, and only a continuous recording can be
+    if (app->settings.write_index && !is_simulated && !app->settings.trigger_on &&
+        !net_stream_is_url(app->settings.output_filename_a)) {
+        open_record_index(app);
+    }
+
+    // With decimation the writers read the stage outputs instead
+    rb_a = start_record_stage(app, &s_ctx_a, rb_a);
+    rb_b = start_record_stage(app, &s_ctx_b, rb_b);
+    if (!rb_a || !rb_b) {
+        gui_app_set_status(app, "Failed to start decimation");
+        stop_record_stages();
+        close_record_index();
+        return RECORD_ERROR;
+    }
+
 #if LIBFLAC_ENABLED == 1
     if (app->settings.use_flac) {
         // Open FLAC files
-        s_file_a = fopen(app->settings.output_filename_a, "wb");
-        s_file_b = fopen(app->settings.output_filename_b, "wb");
+        s_ctx_a.net = s_ctx_b.net = NULL;
+        s_file_a = open_record_file(app, app->settings.output_filename_a, true, &s_ctx_a.segment);
+        s_file_b = open_record_file(app, app->settings.output_filename_b, true, &s_ctx_b.segment);
 
         if (!s_file_a || !s_file_b) {
             gui_app_set_status(app, "Failed to open output files");
-            if (s_file_a) fclose(s_file_a);
-            if (s_file_b) fclose(s_file_b);
+            close_record_file(s_file_a, s_ctx_a.segment);
+            close_record_file(s_file_b, s_ctx_b.segment);
             s_file_a = s_file_b = NULL;
+            stop_record_stages();
+            close_record_index();
             return RECORD_ERROR;
         }
 
@@ -377,37 +827,52 @@ static int gui_record_start_confirmed(gui_app_t *app) {
 
         // Configure FLAC writers using shared library
         flac_writer_config_t config = flac_writer_default_config();
-        config.sample_rate = 40000;
+        config.sample_rate = 40000 / (app->settings.decimation ? app->settings.decimation : 1);
         config.bits_per_sample = 16;  // TODO: Make configurable for 12-bit support
         config.compression_level = app->settings.flac_level;
         config.verify = false;
         config.num_threads = 0;  // Auto-detect
         config.enable_seektable = true;
+        if (app->settings.flac_level_max > app->settings.flac_level) {
+            config.adaptive_level = true;
+            config.compression_level_min = app->settings.flac_level;
+            config.compression_level_max = app->settings.flac_level_max;
+            config.realtime_rate = record_sample_rate(app);
+            config.backlog_cb = gui_flac_backlog_callback;
+        }
 
         // Create writer for channel A
         config.error_cb = gui_flac_error_callback;
         config.bytes_cb = gui_flac_bytes_callback;
         config.callback_user_data = &s_ctx_a;
+        s_ctx_a.flac_config = config;
 
         s_flac_writer_a = flac_writer_create_stream(s_file_a, &config);
         if (!s_flac_writer_a) {
             gui_app_set_status(app, "Failed to create FLAC encoder A");
-            fclose(s_file_a); fclose(s_file_b);
+            close_record_file(s_file_a, s_ctx_a.segment);
+            close_record_file(s_file_b, s_ctx_b.segment);
             s_file_a = s_file_b = NULL;
+            stop_record_stages();
+            close_record_index();
             return RECORD_ERROR;
         }
         s_ctx_a.writer = s_flac_writer_a;
 
         // Create writer for channel B
         config.callback_user_data = &s_ctx_b;
+        s_ctx_b.flac_config = config;
 
         s_flac_writer_b = flac_writer_create_stream(s_file_b, &config);
         if (!s_flac_writer_b) {
             gui_app_set_status(app, "Failed to create FLAC encoder B");
             flac_writer_abort(s_flac_writer_a);
             s_flac_writer_a = NULL;
-            fclose(s_file_a); fclose(s_file_b);
+            close_record_file(s_file_a, s_ctx_a.segment);
+            close_record_file(s_file_b, s_ctx_b.segment);
             s_file_a = s_file_b = NULL;
+            stop_record_stages();
+            close_record_index();
             return RECORD_ERROR;
         }
         s_ctx_b.writer = s_flac_writer_b;
@@ -431,25 +896,43 @@ static int gui_record_start_confirmed(gui_app_t *app) {
     } else
 #endif
     {
-        // RAW recording
-        s_file_a = fopen(app->settings.output_filename_a, "wb");
-        s_file_b = fopen(app->settings.output_filename_b, "wb");
+        // RAW recording, a tcp:// name streams the channel instead
+        const char *name_a = app->settings.output_filename_a;
+        const char *name_b = app->settings.output_filename_b;
+        if ((app->settings.packed_12bit || app->settings.delta_coding) && (net_stream_is_url(name_a) || net_stream_is_url(name_b))) {
+            gui_app_set_status(app, "Network targets send 16-bit samples, turn off packing and delta coding");
+            stop_record_stages();
+            close_record_index();
+            return RECORD_ERROR;
+        }
+        s_ctx_a.segment = s_ctx_b.segment = NULL;
+        s_ctx_a.net = net_stream_is_url(name_a) ? open_record_sink(app, name_a, 0) : NULL;
+        s_ctx_b.net = net_stream_is_url(name_b) ? open_record_sink(app, name_b, 1) : NULL;
+        s_file_a = s_ctx_a.net ? NULL : open_record_file(app, name_a, app->settings.delta_coding, &s_ctx_a.segment);
+        s_file_b = s_ctx_b.net ? NULL : open_record_file(app, name_b, app->settings.delta_coding, &s_ctx_b.segment);
 
-        if (!s_file_a || !s_file_b) {
+        if ((!s_file_a && !s_ctx_a.net) || (!s_file_b && !s_ctx_b.net)) {
             gui_app_set_status(app, "Failed to open output files");
-            if (s_file_a) fclose(s_file_a);
-            if (s_file_b) fclose(s_file_b);
+            close_record_file(s_file_a, s_ctx_a.segment);
+            close_record_file(s_file_b, s_ctx_b.segment);
+            net_sink_close(s_ctx_a.net);
+            net_sink_close(s_ctx_b.net);
+            s_ctx_a.net = s_ctx_b.net = NULL;
             s_file_a = s_file_b = NULL;
+            stop_record_stages();
+            close_record_index();
             return RECORD_ERROR;
         }
 
         s_ctx_a.rb = rb_a;
         s_ctx_a.file = s_file_a;
         s_ctx_a.channel = 0;
+        s_ctx_a.app = app;
 
         s_ctx_b.rb = rb_b;
         s_ctx_b.file = s_file_b;
         s_ctx_b.channel = 1;
+        s_ctx_b.app = app;
 
         // Capture backpressure stats at recording start
         s_start_wait_count = atomic_load(&app->rb_wait_count);
@@ -462,13 +945,21 @@ static int gui_record_start_confirmed(gui_app_t *app) {
         // Enable recording in extraction thread
         gui_extract_set_recording(true, false);
 
-        thrd_create(&s_writer_thread_a, raw_writer_thread, &s_ctx_a);
-        thrd_create(&s_writer_thread_b, raw_writer_thread, &s_ctx_b);
+        int (*writer)(void *) = app->settings.delta_coding ? delta_writer_thread
+                              : app->settings.packed_12bit ? packed_writer_thread : raw_writer_thread;
+        int (*writer_a)(void *) = s_ctx_a.net ? net_writer_thread : writer;
+        int (*writer_b)(void *) = s_ctx_b.net ? net_writer_thread : writer;
+        thrd_create(&s_writer_thread_a, writer_a, &s_ctx_a);
+        thrd_create(&s_writer_thread_b, writer_b, &s_ctx_b);
         s_writer_threads_running = true;
 
-        gui_app_set_status(app, "Recording (RAW)...");
+        gui_app_set_status(app, app->settings.delta_coding ? "Recording (RAW, delta coded)..."
+                              : app->settings.packed_12bit ? "Recording (RAW, packed 12-bit)..." : "Recording (RAW)...");
     }
 
+    // Once the recording runs, a preview that cannot be opened leaves it alone
+    open_record_preview(app);
+
     return RECORD_OK;
 }
 
@@ -484,6 +975,7 @@ void gui_record_stop(gui_app_t *app) {
 
     // Signal threads to stop
     app->is_recording = false;
+    atomic_store(&s_stage_input_done, true);
 
     // Wait for writer threads to drain and exit
     if (s_writer_threads_running) {
@@ -491,29 +983,36 @@ void gui_record_stop(gui_app_t *app) {
         thrd_join(s_writer_thread_b, NULL);
         s_writer_threads_running = false;
     }
+    stop_record_stages();
 
 #if LIBFLAC_ENABLED == 1
-    // Finalize FLAC writers (this also cleans them up)
+    // Finalize FLAC writers (this also cleans them up), the threads replace them per segment
     if (s_flac_writer_a) {
-        flac_writer_finish(s_flac_writer_a);
+        if (s_ctx_a.writer) flac_writer_finish(s_ctx_a.writer);
         s_flac_writer_a = NULL;
     }
     if (s_flac_writer_b) {
-        flac_writer_finish(s_flac_writer_b);
+        if (s_ctx_b.writer) flac_writer_finish(s_ctx_b.writer);
         s_flac_writer_b = NULL;
     }
 #endif
 
-    // Close files
+    // Close files, the writer threads may have moved on to later segments
     if (s_file_a) {
-        fclose(s_file_a);
+        close_record_file(s_ctx_a.file, s_ctx_a.segment);
+        s_ctx_a.segment = NULL;
         s_file_a = NULL;
     }
     if (s_file_b) {
-        fclose(s_file_b);
+        close_record_file(s_ctx_b.file, s_ctx_b.segment);
+        s_ctx_b.segment = NULL;
         s_file_b = NULL;
     }
 
+    // The extraction thread is done with it, the capture callback lets go quickly
+    close_record_index();
+    close_record_preview();
+
     // Print recording summary with backpressure stats
     double duration = GetTime() - app->recording_start_time;
     uint64_t raw_a = atomic_load(&app->recording_raw_a);
@@ -533,6 +1032,11 @@ void gui_record_stop(gui_app_t *app) {
     if (rec_drops > 0) {
         fprintf(stderr, "[REC] WARNING: %u frames were dropped during recording due to backpressure!\n", rec_drops);
     }
+    if (app->recording_target_rate > 0.0) {
+        fprintf(stderr, "[REC] Preflight target %.1f MB/s, storage managed %.1f MB/s, achieved %.1f MB/s\n",
+                app->recording_target_rate / 1e6, app->recording_probe_rate / 1e6,
+                duration > 0 ? (raw_a + raw_b) / duration / 1e6 : 0.0);
+    }
 
     s_recording_app = NULL;
     gui_app_set_status(app, "Recording stopped");
@@ -12,6 +12,9 @@
 
 #include <stdbool.h>
 
+#include "../misrc_common/sample_index.h"
+#include "../misrc_common/preview.h"
+
 // Forward declarations
 typedef struct gui_app gui_app_t;
 
@@ -43,4 +46,16 @@ void gui_record_stop(gui_app_t *app);
 // Check if recording is active
 bool gui_record_is_active(void);
 
+// Sample index of the current recording, shared by the capture callback and
+// the extraction thread. Returns NULL if none is written, otherwise
+// gui_record_index_release() must follow once the caller is done with it.
+sample_index_t *gui_record_index_acquire(void);
+void gui_record_index_release(void);
+
+// Preview stream of the current recording (--preview), fed by the extraction
+// thread. Returns NULL if there is none, otherwise
+// gui_record_preview_release() must follow once the caller is done with it.
+preview_t *gui_record_preview_acquire(void);
+void gui_record_preview_release(void);
+
 #endif // GUI_RECORD_H
@@ -26,10 +26,18 @@
 
 #include "gui_simulated.h"
 #include "gui_app.h"
+#include "gui_capture.h"
 #include "gui_oscilloscope.h"
+#include "gui_trigger.h"
 #include "gui_extract.h"
+#include "gui_fft_worker.h"
 #include "../misrc_common/ringbuffer.h"
 #include "../misrc_common/threading.h"
+#include "../misrc_common/extract.h"
+#include "../misrc_common/replay.h"
+
+#include <hsdaoh.h>
+#include <hsdaoh_raw.h>
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -38,6 +46,15 @@
 #include <math.h>
 #include <stdatomic.h>
 
+#if defined(__x86_64__) || defined(_M_X64)
+    #include <emmintrin.h>
+    #include <immintrin.h>
+    #define SIM_HAVE_X86 1
+#elif defined(__aarch64__) || defined(__arm64__)
+    #include <arm_neon.h>
+    #define SIM_HAVE_NEON 1
+#endif
+
 // Define M_PI if not available (Windows compatibility)
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -578,6 +595,362 @@ static double sim_generate_vhs_rf(double cvbs_luma, double chroma_u, double chro
     return fm_signal + chroma_under + head_noise + tracking_noise;
 }
 
+//-----------------------------------------------------------------------------
+// Noise and Packing Kernels
+//-----------------------------------------------------------------------------
+
+// Noise amplitudes, peak to peak in counts of the 12-bit output
+#define SIM_CVBS_NOISE_AMP  (SIM_ENABLE_CVBS_NOISE ? 56 : 0)    // +-0.02 of the CVBS scale
+#define SIM_RF_NOISE_AMP    (SIM_ENABLE_VHS_RF_NOISE ? 61 : 0)  // +-0.03 of the RF scale
+
+// Eight xorshift32 generators side by side, one step of all of them gives 16
+// noise samples: low half of lane 0, high half of lane 0, low half of lane 1...
+// The vector kernels step the lanes in the same order, so every
+// implementation gives the same noise.
+#define SIM_NOISE_LANES 8
+
+typedef struct {
+    uint32_t s[SIM_NOISE_LANES];
+} sim_noise_state_t;
+
+// out[i] = in[i] + noise in [-amp / 2, amp / 2), saturated
+typedef void (*sim_noise_fn_t)(sim_noise_state_t *st, const int16_t *in, int16_t *out, size_t n, int16_t amp);
+
+// Pack both channels into 32-bit hsdaoh payload words, the inverse of extract_AB
+typedef void (*sim_pack_fn_t)(const int16_t *a, const int16_t *b, uint32_t *out, size_t n);
+
+static sim_noise_fn_t s_noise_fn = NULL;
+static sim_pack_fn_t s_pack_fn = NULL;
+static sim_noise_state_t s_noise;
+
+static inline int16_t sim_sat16(int32_t v) {
+    return (int16_t)(v > INT16_MAX ? INT16_MAX : (v < INT16_MIN ? INT16_MIN : v));
+}
+
+static inline uint32_t sim_offset12(int16_t v) {
+    if (v > 2047) v = 2047;
+    if (v < -2048) v = -2048;
+    return (uint32_t)(2047 - v);
+}
+
+static void add_noise_C(sim_noise_state_t *st, const int16_t *in, int16_t *out, size_t n, int16_t amp) {
+    size_t i = 0;
+    while (i < n) {
+        int16_t noise[2 * SIM_NOISE_LANES];
+        for (int l = 0; l < SIM_NOISE_LANES; l++) {
+            uint32_t x = st->s[l];
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            st->s[l] = x;
+            noise[2 * l] = (int16_t)(x & 0xFFFF);
+            noise[2 * l + 1] = (int16_t)(x >> 16);
+        }
+        for (int k = 0; k < 2 * SIM_NOISE_LANES && i < n; k++, i++) {
+            out[i] = sim_sat16(in[i] + (((int32_t)noise[k] * amp) >> 16));
+        }
+    }
+}
+
+static void pack_raw_C(const int16_t *a, const int16_t *b, uint32_t *out, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = sim_offset12(a[i]) | (sim_offset12(b[i]) << 20);
+    }
+}
+
+#ifdef SIM_HAVE_X86
+
+#if defined(__GNUC__)
+#define SIM_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define SIM_TARGET_AVX2
+#endif
+
+static inline __m128i xorshift_sse2(__m128i x) {
+    x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+    return _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+}
+
+static void add_noise_sse2(sim_noise_state_t *st, const int16_t *in, int16_t *out, size_t n, int16_t amp) {
+    __m128i s0 = _mm_loadu_si128((const __m128i *)&st->s[0]);
+    __m128i s1 = _mm_loadu_si128((const __m128i *)&st->s[4]);
+    const __m128i va = _mm_set1_epi16(amp);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        s0 = xorshift_sse2(s0);
+        s1 = xorshift_sse2(s1);
+        // mulhi is (noise * amp) >> 16 per 16-bit half, like the C kernel
+        __m128i v0 = _mm_loadu_si128((const __m128i *)(in + i));
+        __m128i v1 = _mm_loadu_si128((const __m128i *)(in + i + 8));
+        _mm_storeu_si128((__m128i *)(out + i), _mm_adds_epi16(v0, _mm_mulhi_epi16(s0, va)));
+        _mm_storeu_si128((__m128i *)(out + i + 8), _mm_adds_epi16(v1, _mm_mulhi_epi16(s1, va)));
+    }
+    _mm_storeu_si128((__m128i *)&st->s[0], s0);
+    _mm_storeu_si128((__m128i *)&st->s[4], s1);
+    add_noise_C(st, in + i, out + i, n - i, amp);
+}
+
+// 2047 - clamp(v) per 16-bit lane
+static inline __m128i offset12_sse2(__m128i v) {
+    v = _mm_max_epi16(_mm_min_epi16(v, _mm_set1_epi16(2047)), _mm_set1_epi16(-2048));
+    return _mm_sub_epi16(_mm_set1_epi16(2047), v);
+}
+
+static void pack_raw_sse2(const int16_t *a, const int16_t *b, uint32_t *out, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        // B goes to bit 20, that is bit 4 of the upper half word
+        __m128i va = offset12_sse2(_mm_loadu_si128((const __m128i *)(a + i)));
+        __m128i vb = _mm_slli_epi16(offset12_sse2(_mm_loadu_si128((const __m128i *)(b + i))), 4);
+        _mm_storeu_si128((__m128i *)(out + i), _mm_unpacklo_epi16(va, vb));
+        _mm_storeu_si128((__m128i *)(out + i + 4), _mm_unpackhi_epi16(va, vb));
+    }
+    pack_raw_C(a + i, b + i, out + i, n - i);
+}
+
+SIM_TARGET_AVX2
+static inline __m256i xorshift_avx2(__m256i x) {
+    x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 13));
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 17));
+    return _mm256_xor_si256(x, _mm256_slli_epi32(x, 5));
+}
+
+SIM_TARGET_AVX2
+static void add_noise_avx2(sim_noise_state_t *st, const int16_t *in, int16_t *out, size_t n, int16_t amp) {
+    __m256i s = _mm256_loadu_si256((const __m256i *)st->s);
+    const __m256i va = _mm256_set1_epi16(amp);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        s = xorshift_avx2(s);
+        __m256i v = _mm256_loadu_si256((const __m256i *)(in + i));
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_adds_epi16(v, _mm256_mulhi_epi16(s, va)));
+    }
+    _mm256_storeu_si256((__m256i *)st->s, s);
+    add_noise_C(st, in + i, out + i, n - i, amp);
+}
+
+SIM_TARGET_AVX2
+static inline __m256i offset12_avx2(__m256i v) {
+    v = _mm256_max_epi16(_mm256_min_epi16(v, _mm256_set1_epi16(2047)), _mm256_set1_epi16(-2048));
+    return _mm256_sub_epi16(_mm256_set1_epi16(2047), v);
+}
+
+SIM_TARGET_AVX2
+static void pack_raw_avx2(const int16_t *a, const int16_t *b, uint32_t *out, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        // unpack works per 128-bit lane, put the 64-bit quarters in order 0 2 1 3 first
+        __m256i va = _mm256_permute4x64_epi64(offset12_avx2(_mm256_loadu_si256((const __m256i *)(a + i))), 0xD8);
+        __m256i vb = _mm256_permute4x64_epi64(
+            _mm256_slli_epi16(offset12_avx2(_mm256_loadu_si256((const __m256i *)(b + i))), 4), 0xD8);
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_unpacklo_epi16(va, vb));
+        _mm256_storeu_si256((__m256i *)(out + i + 8), _mm256_unpackhi_epi16(va, vb));
+    }
+    pack_raw_sse2(a + i, b + i, out + i, n - i);
+}
+
+#endif // SIM_HAVE_X86
+
+#ifdef SIM_HAVE_NEON
+
+static inline uint32x4_t xorshift_neon(uint32x4_t x) {
+    x = veorq_u32(x, vshlq_n_u32(x, 13));
+    x = veorq_u32(x, vshrq_n_u32(x, 17));
+    return veorq_u32(x, vshlq_n_u32(x, 5));
+}
+
+static void add_noise_neon(sim_noise_state_t *st, const int16_t *in, int16_t *out, size_t n, int16_t amp) {
+    uint32x4_t s0 = vld1q_u32(&st->s[0]);
+    uint32x4_t s1 = vld1q_u32(&st->s[4]);
+    const int16x8_t va = vdupq_n_s16(amp);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        s0 = xorshift_neon(s0);
+        s1 = xorshift_neon(s1);
+        // vqdmulh is (2 * noise * amp) >> 16, halve it for the C kernel's >> 16
+        int16x8_t n0 = vshrq_n_s16(vqdmulhq_s16(vreinterpretq_s16_u32(s0), va), 1);
+        int16x8_t n1 = vshrq_n_s16(vqdmulhq_s16(vreinterpretq_s16_u32(s1), va), 1);
+        vst1q_s16(out + i, vqaddq_s16(vld1q_s16(in + i), n0));
+        vst1q_s16(out + i + 8, vqaddq_s16(vld1q_s16(in + i + 8), n1));
+    }
+    vst1q_u32(&st->s[0], s0);
+    vst1q_u32(&st->s[4], s1);
+    add_noise_C(st, in + i, out + i, n - i, amp);
+}
+
+static inline uint16x8_t offset12_neon(int16x8_t v) {
+    v = vmaxq_s16(vminq_s16(v, vdupq_n_s16(2047)), vdupq_n_s16(-2048));
+    return vreinterpretq_u16_s16(vsubq_s16(vdupq_n_s16(2047), v));
+}
+
+static void pack_raw_neon(const int16_t *a, const int16_t *b, uint32_t *out, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        // Interleaving store, A in the low and B << 4 in the high half word
+        uint16x8x2_t v;
+        v.val[0] = offset12_neon(vld1q_s16(a + i));
+        v.val[1] = vshlq_n_u16(offset12_neon(vld1q_s16(b + i)), 4);
+        vst2q_u16((uint16_t *)(out + i), v);
+    }
+    pack_raw_C(a + i, b + i, out + i, n - i);
+}
+
+#endif // SIM_HAVE_NEON
+
+static void sim_kernels_init(void) {
+    if (s_noise_fn) return;
+    const char *name = "C";
+    s_noise_fn = add_noise_C;
+    s_pack_fn = pack_raw_C;
+#if defined(SIM_HAVE_X86)
+    // SSE2 is part of x86_64, no check needed
+    s_noise_fn = add_noise_sse2;
+    s_pack_fn = pack_raw_sse2;
+    name = "SSE2";
+    if (check_cpu_feat() >= 3) {
+        s_noise_fn = add_noise_avx2;
+        s_pack_fn = pack_raw_avx2;
+        name = "AVX2";
+    }
+#elif defined(SIM_HAVE_NEON)
+    s_noise_fn = add_noise_neon;
+    s_pack_fn = pack_raw_neon;
+    name = "NEON";
+#endif
+    fprintf(stderr, "[SIM] Noise and packing kernels: %s\n", name);
+}
+
+//-----------------------------------------------------------------------------
+// Signal Template
+//-----------------------------------------------------------------------------
+
+// The colour carrier restarts every line, so one frame of the generator above
+// repeats exactly. It is rendered once, the capture threads only copy it and
+// add noise. Only the FM phase on channel B jumps where the template wraps,
+// in the vertical sync like a head switch.
+static int16_t *s_tmpl_a = NULL;
+static int16_t *s_tmpl_b = NULL;
+static uint32_t *s_tmpl_raw = NULL;   // Both channels packed like the hsdaoh payload
+
+static int sim_build_template(void) {
+    if (s_tmpl_raw) return 0;  // Kept from an earlier start
+
+    sim_kernels_init();
+    init_colour_lookup();
+    if (!s_colour_lookup_i || !s_colour_lookup_q) return -1;
+
+    s_tmpl_a = (int16_t *)malloc(FRAME_SAMPLES * sizeof(int16_t));
+    s_tmpl_b = (int16_t *)malloc(FRAME_SAMPLES * sizeof(int16_t));
+    s_tmpl_raw = (uint32_t *)malloc(FRAME_SAMPLES * sizeof(uint32_t));
+    if (!s_tmpl_a || !s_tmpl_b || !s_tmpl_raw) {
+        fprintf(stderr, "[SIM] Failed to allocate the signal template\n");
+        free(s_tmpl_a);
+        free(s_tmpl_b);
+        free(s_tmpl_raw);
+        s_tmpl_a = s_tmpl_b = NULL;
+        s_tmpl_raw = NULL;
+        return -1;
+    }
+
+    uint64_t t0 = get_time_ms();
+    s_vhs_fm_phase = 0.0;
+    s_current_line = -1;
+    s_line_lookup_offset = 0;
+
+    for (uint64_t i = 0; i < FRAME_SAMPLES; i++) {
+        int line_in_frame = 0;
+        int field = 0;
+        double chroma_u = 0.0;
+        double chroma_v = 0.0;
+        double subcarrier_phase = 0.0;
+
+        // Generate CVBS signal and get U/V chroma components for VHS
+        double cvbs = sim_generate_cvbs(i, &line_in_frame, &field,
+                                        &chroma_u, &chroma_v, &subcarrier_phase);
+
+        // For VHS, compute luma from CVBS (subtract the chroma we added)
+        // Chroma was: cos(phase) * V + sin(phase) * U
+        double chroma_at_sample = cos(subcarrier_phase) * chroma_v
+                                + sin(subcarrier_phase) * chroma_u;
+        double cvbs_luma = cvbs - chroma_at_sample;
+
+        // Get sample_in_line for VHS RF generation
+        int field_tmp, line_in_field_tmp, sample_in_line;
+        bool is_half_line_tmp;
+        sim_get_line_type(i, &field_tmp, &line_in_field_tmp, &sample_in_line, &is_half_line_tmp);
+
+        // Generate VHS RF with U/V quadrature chroma at 629 kHz
+        double vhs_rf = sim_generate_vhs_rf(cvbs_luma, chroma_u, chroma_v, line_in_frame, field, sample_in_line);
+
+#if SIM_ENABLE_SOFT_CLIPPING
+        // Soft clipping - analog-style saturation near limits
+        if (cvbs > 0.95) cvbs = 0.95 + 0.05 * tanh((cvbs - 0.95) * 10.0);
+        if (cvbs < -0.95) cvbs = -0.95 + 0.05 * tanh((cvbs + 0.95) * 10.0);
+        if (vhs_rf > 0.95) vhs_rf = 0.95 + 0.05 * tanh((vhs_rf - 0.95) * 10.0);
+        if (vhs_rf < -0.95) vhs_rf = -0.95 + 0.05 * tanh((vhs_rf + 0.95) * 10.0);
+#endif
+
+        s_tmpl_a[i] = (int16_t)(cvbs * 1400.0);
+        s_tmpl_b[i] = (int16_t)(vhs_rf * 1024.0);  // 50% of full scale
+    }
+    s_pack_fn(s_tmpl_a, s_tmpl_b, s_tmpl_raw, FRAME_SAMPLES);
+
+    // Only the template needs the carrier table
+    cleanup_colour_lookup();
+
+    fprintf(stderr, "[SIM] Signal template: %d lines, %.1f MB, built in %llu ms\n",
+            LINES_PER_FRAME, FRAME_SAMPLES * 8.0 / (1024.0 * 1024.0),
+            (unsigned long long)(get_time_ms() - t0));
+    return 0;
+}
+
+static void sim_copy_noisy(const int16_t *in, int16_t *out, size_t n, int16_t amp) {
+    if (amp > 0) {
+        s_noise_fn(&s_noise, in, out, n, amp);
+    } else {
+        memcpy(out, in, n * sizeof(int16_t));
+    }
+}
+
+// Next n samples of both channels
+static void sim_fill(int16_t *out_a, int16_t *out_b, size_t n) {
+    size_t done = 0;
+    while (done < n) {
+        size_t pos = (size_t)(s_sim_sample_count % FRAME_SAMPLES);
+        size_t len = (size_t)FRAME_SAMPLES - pos;
+        if (len > n - done) len = n - done;
+        sim_copy_noisy(s_tmpl_a + pos, out_a + done, len, SIM_CVBS_NOISE_AMP);
+        sim_copy_noisy(s_tmpl_b + pos, out_b + done, len, SIM_RF_NOISE_AMP);
+        done += len;
+        s_sim_sample_count += len;
+    }
+}
+
+// Next n samples in the hsdaoh payload format, tmp_a and tmp_b hold SIM_BUFFER_SIZE samples
+static void sim_fill_raw(uint32_t *out, size_t n, int16_t *tmp_a, int16_t *tmp_b) {
+    size_t done = 0;
+    if (SIM_CVBS_NOISE_AMP == 0 && SIM_RF_NOISE_AMP == 0) {
+        // Nothing random, copy the packed template
+        while (done < n) {
+            size_t pos = (size_t)(s_sim_sample_count % FRAME_SAMPLES);
+            size_t len = (size_t)FRAME_SAMPLES - pos;
+            if (len > n - done) len = n - done;
+            memcpy(out + done, s_tmpl_raw + pos, len * sizeof(uint32_t));
+            done += len;
+            s_sim_sample_count += len;
+        }
+        return;
+    }
+    while (done < n) {
+        size_t len = n - done;
+        if (len > SIM_BUFFER_SIZE) len = SIM_BUFFER_SIZE;
+        sim_fill(tmp_a, tmp_b, len);
+        s_pack_fn(tmp_a, tmp_b, out + done, len);
+        done += len;
+    }
+}
+
 //-----------------------------------------------------------------------------
 // Simulated Capture Thread
 //-----------------------------------------------------------------------------
@@ -601,67 +974,28 @@ static int simulated_capture_thread(void *ctx) {
 
     gui_extract_init_record_rbs();
 
-#if SIM_ENABLE_CVBS_NOISE
-    double cvbs_noise = 0.02;
-#endif
-#if SIM_ENABLE_VHS_RF_NOISE
-    double rf_noise = 0.03;
-#endif
-
-    s_sim_rng_state = (uint32_t)get_time_ms();
-
     atomic_store(&app->stream_synced, true);
     atomic_store(&app->sample_rate, SIM_SAMPLE_RATE);
 
     uint64_t batch_count = 0;
 
     while (atomic_load(&app->sim_running)) {
-        for (int i = 0; i < SIM_BUFFER_SIZE; i++) {
-            int line_in_frame = 0;
-            int field = 0;
-            double chroma_u = 0.0;
-            double chroma_v = 0.0;
-            double subcarrier_phase = 0.0;
-
-            // Generate CVBS signal and get U/V chroma components for VHS
-            double cvbs = sim_generate_cvbs(s_sim_sample_count, &line_in_frame, &field,
-                                            &chroma_u, &chroma_v, &subcarrier_phase);
-#if SIM_ENABLE_CVBS_NOISE
-            cvbs += sim_noise() * cvbs_noise;
-#endif
-
-            // For VHS, compute luma from CVBS (subtract the chroma we added)
-            // Chroma was: cos(phase) * V + sin(phase) * U
-            double chroma_at_sample = cos(subcarrier_phase) * chroma_v
-                                    + sin(subcarrier_phase) * chroma_u;
-            double cvbs_luma = cvbs - chroma_at_sample;
-
-            // Get sample_in_line for VHS RF generation
-            int field_tmp, line_in_field_tmp, sample_in_line;
-            bool is_half_line_tmp;
-            sim_get_line_type(s_sim_sample_count, &field_tmp, &line_in_field_tmp, &sample_in_line, &is_half_line_tmp);
-
-            // Generate VHS RF with U/V quadrature chroma at 629 kHz
-            double vhs_rf = sim_generate_vhs_rf(cvbs_luma, chroma_u, chroma_v, line_in_frame, field, sample_in_line);
-#if SIM_ENABLE_VHS_RF_NOISE
-            vhs_rf += sim_noise() * rf_noise;
-#endif
+        sim_fill(buf_a, buf_b, SIM_BUFFER_SIZE);
 
-#if SIM_ENABLE_SOFT_CLIPPING
-            // Soft clipping - analog-style saturation near limits
-            if (cvbs > 0.95) cvbs = 0.95 + 0.05 * tanh((cvbs - 0.95) * 10.0);
-            if (cvbs < -0.95) cvbs = -0.95 + 0.05 * tanh((cvbs + 0.95) * 10.0);
-            if (vhs_rf > 0.95) vhs_rf = 0.95 + 0.05 * tanh((vhs_rf - 0.95) * 10.0);
-            if (vhs_rf < -0.95) vhs_rf = -0.95 + 0.05 * tanh((vhs_rf + 0.95) * 10.0);
-#endif
-
-            buf_a[i] = (int16_t)(cvbs * 1400.0);
-            buf_b[i] = (int16_t)(vhs_rf * 1024.0);  // 50% of full scale
-
-            s_sim_sample_count++;
+        // Block min/max for the VU meters and the CVBS trigger levels
+        int16_t min_a = buf_a[0], max_a = buf_a[0];
+        int16_t min_b = buf_b[0], max_b = buf_b[0];
+        for (int i = 0; i < SIM_BUFFER_SIZE; i += 16) {
+            if (buf_a[i] > max_a) max_a = buf_a[i];
+            if (buf_a[i] < min_a) min_a = buf_a[i];
+            if (buf_b[i] > max_b) max_b = buf_b[i];
+            if (buf_b[i] < min_b) min_b = buf_b[i];
         }
+        trigger_cvbs_levels_from_minmax(min_a, max_a, &app->trigger_a.cvbs_levels);
+        trigger_cvbs_levels_from_minmax(min_b, max_b, &app->trigger_b.cvbs_levels);
 
         gui_oscilloscope_update_display(app, buf_a, buf_b, SIM_BUFFER_SIZE);
+        gui_fft_worker_push(buf_a, buf_b, SIM_BUFFER_SIZE, atomic_load(&app->sample_rate));
 
         atomic_fetch_add(&app->total_samples, SIM_BUFFER_SIZE);
         atomic_fetch_add(&app->samples_a, SIM_BUFFER_SIZE);
@@ -670,18 +1004,10 @@ static int simulated_capture_thread(void *ctx) {
         atomic_store(&app->last_callback_time_ms, get_time_ms());
 
         // Update peak values for VU meters
-        int16_t peak_a_pos = 0, peak_a_neg = 0;
-        int16_t peak_b_pos = 0, peak_b_neg = 0;
-        for (int i = 0; i < SIM_BUFFER_SIZE; i += 16) {
-            if (buf_a[i] > peak_a_pos) peak_a_pos = buf_a[i];
-            if (buf_a[i] < peak_a_neg) peak_a_neg = buf_a[i];
-            if (buf_b[i] > peak_b_pos) peak_b_pos = buf_b[i];
-            if (buf_b[i] < peak_b_neg) peak_b_neg = buf_b[i];
-        }
-        atomic_store(&app->peak_a_pos, (uint16_t)peak_a_pos);
-        atomic_store(&app->peak_a_neg, (uint16_t)(-peak_a_neg));
-        atomic_store(&app->peak_b_pos, (uint16_t)peak_b_pos);
-        atomic_store(&app->peak_b_neg, (uint16_t)(-peak_b_neg));
+        atomic_store(&app->peak_a_pos, (uint16_t)(max_a > 0 ? max_a : 0));
+        atomic_store(&app->peak_a_neg, (uint16_t)(min_a < 0 ? -min_a : 0));
+        atomic_store(&app->peak_b_pos, (uint16_t)(max_b > 0 ? max_b : 0));
+        atomic_store(&app->peak_b_neg, (uint16_t)(min_b < 0 ? -min_b : 0));
 
         // Write to record ringbuffers if recording is enabled
         bool use_flac = false;
@@ -691,15 +1017,16 @@ static int simulated_capture_thread(void *ctx) {
 
             if (rb_a && rb_b) {
                 if (use_flac) {
-                    size_t sample_bytes = SIM_BUFFER_SIZE * sizeof(int32_t);
+                    // FLAC takes 12-bit samples padded to 16 bit, like the padded extraction kernel
+                    size_t sample_bytes = SIM_BUFFER_SIZE * sizeof(int16_t);
 
-                    int32_t *write_a = (int32_t *)rb_write_ptr(rb_a, sample_bytes);
-                    int32_t *write_b = (int32_t *)rb_write_ptr(rb_b, sample_bytes);
+                    int16_t *write_a = (int16_t *)rb_write_ptr(rb_a, sample_bytes);
+                    int16_t *write_b = (int16_t *)rb_write_ptr(rb_b, sample_bytes);
 
                     if (write_a && write_b) {
                         for (int i = 0; i < SIM_BUFFER_SIZE; i++) {
-                            write_a[i] = (int32_t)buf_a[i] << 4;
-                            write_b[i] = (int32_t)buf_b[i] << 4;
+                            write_a[i] = (int16_t)(buf_a[i] * 16);
+                            write_b[i] = (int16_t)(buf_b[i] * 16);
                         }
                         rb_write_finished(rb_a, sample_bytes);
                         rb_write_finished(rb_b, sample_bytes);
@@ -733,6 +1060,104 @@ static int simulated_capture_thread(void *ctx) {
     return 0;
 }
 
+// Frame modes: the template goes out in raw hsdaoh frames through the
+// capture callback, so parsing, extraction and recording run as with a device
+static int simulated_frame_thread(void *ctx) {
+    gui_app_t *app = (gui_app_t *)ctx;
+    float speed = app->settings.sim_speed;
+
+    const size_t line_words = SIM_FRAME_WIDTH - 1;
+    const size_t frame_samples = line_words * SIM_FRAME_HEIGHT / 2;
+    const size_t frame_bytes = (size_t)SIM_FRAME_WIDTH * SIM_FRAME_HEIGHT * sizeof(uint16_t);
+    const uint32_t rate = (speed > 0.0f) ? (uint32_t)(SIM_SAMPLE_RATE * (double)speed) : SIM_SAMPLE_RATE;
+
+    uint16_t *frame = (uint16_t *)malloc(frame_bytes);
+    uint32_t *payload = (uint32_t *)malloc(frame_samples * sizeof(uint32_t));
+    int16_t *tmp_a = (int16_t *)malloc(SIM_BUFFER_SIZE * sizeof(int16_t));
+    int16_t *tmp_b = (int16_t *)malloc(SIM_BUFFER_SIZE * sizeof(int16_t));
+
+    if (!frame || !payload || !tmp_a || !tmp_b) {
+        fprintf(stderr, "[SIM] Failed to allocate frame buffers\n");
+        free(frame);
+        free(payload);
+        free(tmp_a);
+        free(tmp_b);
+        return -1;
+    }
+
+    // No CRC or stream IDs, every line is payload up to the length word
+    metadata_t meta;
+    memset(&meta, 0, sizeof(meta));
+    meta.magic = HSDAOH_MAGIC;
+    meta.crc_config = CRC_NONE;
+    meta.stream_info[0].srate = rate;
+
+    hsdaoh_data_info_t info;
+    memset(&info, 0, sizeof(info));
+    info.ctx = app;
+    info.buf = (uint8_t *)frame;
+    info.len = frame_bytes;
+    info.width = SIM_FRAME_WIDTH;
+    info.height = SIM_FRAME_HEIGHT;
+
+    if (speed > 0.0f) {
+        fprintf(stderr, "[SIM] Feeding %dx%d hsdaoh frames at %.1f MSPS (%.2fx real time)\n",
+                SIM_FRAME_WIDTH, SIM_FRAME_HEIGHT, rate / 1e6, speed);
+    } else {
+        fprintf(stderr, "[SIM] Feeding %dx%d hsdaoh frames as fast as the capture chain takes them\n",
+                SIM_FRAME_WIDTH, SIM_FRAME_HEIGHT);
+    }
+
+    const uint64_t frame_ns = (uint64_t)(frame_samples * 1e9 / rate);
+    uint64_t t_start = get_time_ns();
+    uint64_t frames = 0;
+    bool late_reported = false;
+
+    while (atomic_load(&app->sim_running)) {
+        if (speed > 0.0f) {
+            uint64_t due = t_start + frames * frame_ns;
+            uint64_t now = get_time_ns();
+            if (due > now) {
+                int ms = (int)((due - now) / 1000000);
+                if (ms > 0) thrd_sleep_ms(ms);
+            } else if (now - due > 10 * frame_ns && !late_reported) {
+                // Frames go out back to back from here on, the generator is the limit
+                fprintf(stderr, "[SIM] Generator falls behind %.2fx real time\n", speed);
+                late_reported = true;
+            }
+        } else {
+            // Never more than the extraction drains, a full ringbuffer would
+            // drop frames in the callback like a device outrunning the host
+            ringbuffer_t *rb = gui_extract_get_capture_rb();
+            if (!rb) {
+                thrd_sleep_ms(1);
+                continue;
+            }
+            if (!rb_write_ptr_wait(rb, frame_bytes, 100)) continue;
+        }
+
+        meta.framecounter = (uint16_t)(frames + 1);
+        sim_fill_raw(payload, frame_samples, tmp_a, tmp_b);
+
+        replay_pack_frame(frame, SIM_FRAME_WIDTH, SIM_FRAME_HEIGHT, (const uint16_t *)payload, &meta);
+
+        gui_capture_callback(&info);
+        frames++;
+    }
+
+    double seconds = (double)(get_time_ns() - t_start) / 1e9;
+    fprintf(stderr, "[SIM] Frame thread exiting after %llu frames (%.1f MSPS average)\n",
+            (unsigned long long)frames,
+            seconds > 0.0 ? (double)(frames * frame_samples) / seconds / 1e6 : 0.0);
+
+    free(frame);
+    free(payload);
+    free(tmp_a);
+    free(tmp_b);
+
+    return 0;
+}
+
 //-----------------------------------------------------------------------------
 // Public API
 //-----------------------------------------------------------------------------
@@ -759,23 +1184,28 @@ int gui_simulated_start(gui_app_t *app) {
     atomic_store(&app->sample_rate, SIM_SAMPLE_RATE);
     atomic_store(&app->last_callback_time_ms, get_time_ms());
 
-    // Reset display buffers
-    app->display_samples_available_a = 0;
-    app->display_samples_available_b = 0;
+    // Reset display frames
+    display_triple_clear(&app->display_a);
+    display_triple_clear(&app->display_b);
 
-    // Initialize color carrier lookup table
-    init_colour_lookup();
+    // Render the signal template on the first start
+    if (sim_build_template() != 0) {
+        gui_app_set_status(app, "Failed to build simulated signal");
+        return -1;
+    }
 
     // Reset signal generation state
     s_sim_sample_count = 0;
-    s_vhs_fm_phase = 0.0;
-    s_current_line = -1;
-    s_line_lookup_offset = 0;
+    s_sim_rng_state = (uint32_t)get_time_ms() | 1;
+    for (int l = 0; l < SIM_NOISE_LANES; l++) {
+        s_noise.s[l] = sim_rand();
+    }
 
     // Start thread
     atomic_store(&app->sim_running, true);
     thrd_t thread;
-    if (thrd_create(&thread, simulated_capture_thread, app) != thrd_success) {
+    int (*entry)(void *) = gui_simulated_feeds_frames(app) ? simulated_frame_thread : simulated_capture_thread;
+    if (thrd_create(&thread, entry, app) != thrd_success) {
         fprintf(stderr, "[SIM] Failed to create simulated capture thread\n");
         atomic_store(&app->sim_running, false);
         return -1;
@@ -810,3 +1240,17 @@ void gui_simulated_stop(gui_app_t *app) {
 bool gui_simulated_is_running(gui_app_t *app) {
     return atomic_load(&app->sim_running);
 }
+
+bool gui_simulated_feeds_frames(const gui_app_t *app) {
+    return app->settings.sim_speed != 0.0f;
+}
+
+int gui_simulated_parse_speed(const char *arg, float *speed) {
+    // Same syntax and limit as the replay speed, "max" gives SIM_SPEED_MAX
+    double v;
+    if (replay_parse_speed(arg, &v) != 0) {
+        return -1;
+    }
+    *speed = (float)v;
+    return 0;
+}
@@ -10,6 +10,8 @@
  * - VHS RF signal with FM luminance and 629 kHz chroma-under
  * - Head switching noise simulation at field boundaries
  * - Recording support (RAW and FLAC)
+ * - Frame modes at N x real time or as fast as possible, for stress testing
+ *   the capture/extract/record chain without hardware
  */
 
 #ifndef GUI_SIMULATED_H
@@ -29,6 +31,13 @@ typedef struct gui_app gui_app_t;
 #define SIM_BUFFER_SIZE      65536       // Samples per batch
 #define SIM_UPDATE_INTERVAL_MS  2        // Time between batches
 
+// Frame modes (settings.sim_speed != 0) build raw hsdaoh frames of this size
+// and hand them to the capture callback, like a device would
+#define SIM_FRAME_WIDTH      1920        // 16-bit words per line, the last one holds length and metadata
+#define SIM_FRAME_HEIGHT     1080
+#define SIM_SPEED_MAX        (-1.0f)     // As fast as the capture chain takes the frames
+#define SIM_SPEED_LIMIT      100.0f      // Highest N x real time, keeps the rate in the 32-bit metadata
+
 //-----------------------------------------------------------------------------
 // Simulated Device API
 //-----------------------------------------------------------------------------
@@ -43,4 +52,12 @@ void gui_simulated_stop(gui_app_t *app);
 // Check if simulated capture is running
 bool gui_simulated_is_running(gui_app_t *app);
 
+// True when the simulated device feeds hsdaoh frames through the capture
+// callback and extraction thread instead of the display directly
+bool gui_simulated_feeds_frames(const gui_app_t *app);
+
+// Parse a simulation speed: N (x real time, fractions allowed) or "max"
+// Returns 0 on success, -1 on error
+int gui_simulated_parse_speed(const char *arg, float *speed);
+
 #endif // GUI_SIMULATED_H
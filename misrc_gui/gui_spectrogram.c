@@ -0,0 +1,367 @@
+/*
+ * MISRC GUI - Scrolling Spectrogram (Waterfall) Display
+ *
+ * Keeps the history in a circular texture and lets the fragment shader
+ * unwrap it, so scrolling never moves texture data (shared heatmap palette
+ * with the phosphor displays).
+ *
+ * Copyright (C) 2024-2025 vrunk11, stefan_o
+ * Licensed under GNU GPL v3 or later
+ */
+
+#include "gui_spectrogram.h"
+#include "gui_fft.h"
+#include "gui_fft_worker.h"
+#include "gui_glsl.h"
+#include "gui_ui.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdio.h>
+
+//-----------------------------------------------------------------------------
+// Shader Code (embedded GLSL)
+//-----------------------------------------------------------------------------
+
+// Vertex shader - standard passthrough
+static const char *spectrogram_vs =
+    GLSL_VERSION_STRING
+    GLSL_PRECISION
+    GLSL_IN "vec3 vertexPosition;\n"
+    GLSL_IN "vec2 vertexTexCoord;\n"
+    GLSL_OUT "vec2 fragTexCoord;\n"
+    "uniform mat4 mvp;\n"
+    "void main() {\n"
+    "    fragTexCoord = vertexTexCoord;\n"
+    "    gl_Position = mvp * vec4(vertexPosition, 1.0);\n"
+    "}\n";
+
+// Fragment shader - unwraps the row ring (newest row at the top) and maps levels to the heatmap
+static const char *spectrogram_fs =
+    GLSL_VERSION_STRING
+    GLSL_PRECISION
+    GLSL_FRAG_IN "vec2 fragTexCoord;\n"
+    GLSL_FRAG_OUT
+    "uniform sampler2D texture0;\n"
+    "uniform float headRow;\n"
+    "uniform float rows;\n"
+    "uniform float filledRows;\n"
+    "\n"
+    "vec3 levelToHeatmap(float level) {\n"
+    "    if (level < 0.25) {\n"
+    "        float t = level / 0.25;\n"
+    "        return vec3(0.0, 0.078 * t, 0.392 * t);\n"
+    "    } else if (level < 0.5) {\n"
+    "        float t = (level - 0.25) / 0.25;\n"
+    "        return vec3(0.0, 0.078 + 0.922 * t, 0.392 + 0.608 * t - 0.784 * t * t);\n"
+    "    } else if (level < 0.75) {\n"
+    "        float t = (level - 0.5) / 0.25;\n"
+    "        return vec3(t, 1.0, 0.216 - 0.216 * t);\n"
+    "    }\n"
+    "    float t = (level - 0.75) / 0.25;\n"
+    "    return vec3(1.0, 1.0 - 0.706 * t, 0.0);\n"
+    "}\n"
+    "\n"
+    "void main() {\n"
+    "    float age = floor(fragTexCoord.y * rows);\n"
+    "    if (age >= filledRows) {\n"
+    "        " GLSL_FRAG_COLOR " = vec4(0.0, 0.0, 0.0, 0.0);\n"
+    "        return;\n"
+    "    }\n"
+    "    float row = mod(headRow - 1.0 - age, rows);\n"
+    "    float level = " GLSL_TEXTURE "(texture0, vec2(fragTexCoord.x, (row + 0.5) / rows)).r;\n"
+    "    " GLSL_FRAG_COLOR " = vec4(levelToHeatmap(level), 1.0);\n"
+    "}\n";
+
+//-----------------------------------------------------------------------------
+// Shader State (shared across all instances)
+//-----------------------------------------------------------------------------
+
+static Shader s_shader = {0};
+static bool s_shader_loaded = false;
+static bool s_shader_failed = false;
+static int s_headRow_loc = -1;
+static int s_rows_loc = -1;
+static int s_filledRows_loc = -1;
+
+static bool spectrogram_init_shader(void) {
+    if (s_shader_loaded) return true;
+    if (s_shader_failed) return false;
+
+    s_shader = LoadShaderFromMemory(spectrogram_vs, spectrogram_fs);
+    if (s_shader.id == 0) {
+        TraceLog(LOG_WARNING, "SPECTROGRAM: Failed to load shader");
+        s_shader_failed = true;
+        return false;
+    }
+    s_headRow_loc = GetShaderLocation(s_shader, "headRow");
+    s_rows_loc = GetShaderLocation(s_shader, "rows");
+    s_filledRows_loc = GetShaderLocation(s_shader, "filledRows");
+    s_shader_loaded = true;
+    return true;
+}
+
+// Create the ring texture (needs OpenGL context)
+static bool spectrogram_init_texture(spectrogram_state_t *state) {
+    if (state->texture_valid) return true;
+    if (!spectrogram_init_shader()) return false;
+
+    uint8_t *zero = (uint8_t *)calloc((size_t)SPECTROGRAM_COLUMNS * SPECTROGRAM_ROWS, 1);
+    if (!zero) return false;
+
+    Image img = {
+        .data = zero,
+        .width = SPECTROGRAM_COLUMNS,
+        .height = SPECTROGRAM_ROWS,
+        .mipmaps = 1,
+        .format = PIXELFORMAT_UNCOMPRESSED_GRAYSCALE
+    };
+    state->texture = LoadTextureFromImage(img);
+    free(zero);
+    if (state->texture.id == 0) {
+        TraceLog(LOG_WARNING, "SPECTROGRAM: Failed to create %dx%d texture",
+                 SPECTROGRAM_COLUMNS, SPECTROGRAM_ROWS);
+        return false;
+    }
+
+    // Rows are always sampled at their centers, so filtering only blends columns
+    SetTextureFilter(state->texture, TEXTURE_FILTER_BILINEAR);
+    state->texture_valid = true;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// Spectrogram Lifecycle Management
+//-----------------------------------------------------------------------------
+
+bool gui_spectrogram_init(spectrogram_state_t *state) {
+    if (!state) return false;
+
+    memset(state, 0, sizeof(spectrogram_state_t));
+
+    if (!gui_fft_available()) {
+        fprintf(stderr, "[SPECTROGRAM] FFTW not available, spectrogram disabled\n");
+        return false;
+    }
+
+    state->row_acc = (float *)calloc(SPECTROGRAM_COLUMNS, sizeof(float));
+    state->row_pixels = (uint8_t *)calloc(SPECTROGRAM_COLUMNS, 1);
+    state->row_time = (double *)calloc(SPECTROGRAM_ROWS, sizeof(double));
+    if (!state->row_acc || !state->row_pixels || !state->row_time) {
+        fprintf(stderr, "[SPECTROGRAM] Failed to allocate row buffers\n");
+        gui_spectrogram_cleanup(state);
+        return false;
+    }
+
+    state->initialized = true;
+    return true;
+}
+
+void gui_spectrogram_clear(spectrogram_state_t *state) {
+    if (!state || !state->initialized) return;
+
+    // Rows beyond rows_written are not drawn, no need to touch the texture
+    state->head = 0;
+    state->rows_written = 0;
+    state->row_frames = 0;
+}
+
+void gui_spectrogram_cleanup(spectrogram_state_t *state) {
+    if (!state) return;
+
+    if (state->texture_valid) {
+        UnloadTexture(state->texture);
+        state->texture_valid = false;
+    }
+    free(state->row_acc);
+    free(state->row_pixels);
+    free(state->row_time);
+    state->row_acc = NULL;
+    state->row_pixels = NULL;
+    state->row_time = NULL;
+
+    state->initialized = false;
+}
+
+//-----------------------------------------------------------------------------
+// Spectrogram Update - One row per SPECTROGRAM_FRAMES_PER_ROW worker frames
+//-----------------------------------------------------------------------------
+
+void gui_spectrogram_update(spectrogram_state_t *state, int channel) {
+    if (!state || !state->initialized || !state->texture_valid) return;
+
+    fft_frame_t frame;
+    if (!gui_fft_worker_acquire(channel, &frame) || frame.seq == state->last_seq) {
+        return;
+    }
+    state->last_seq = frame.seq;
+
+    // Older rows are on a different frequency axis
+    if (frame.sample_rate != state->sample_rate) {
+        gui_spectrogram_clear(state);
+        state->sample_rate = frame.sample_rate;
+    }
+
+    // Largest bin per column so narrow carriers stay visible at any FFT size
+    for (int col = 0; col < SPECTROGRAM_COLUMNS; col++) {
+        int lo = (int)((int64_t)col * frame.bins / SPECTROGRAM_COLUMNS);
+        int hi = (int)((int64_t)(col + 1) * frame.bins / SPECTROGRAM_COLUMNS);
+        if (hi <= lo) hi = lo + 1;
+        float db = frame.power_db[lo];
+        for (int bin = lo + 1; bin < hi; bin++) {
+            if (frame.power_db[bin] > db) db = frame.power_db[bin];
+        }
+        if (db < SPECTROGRAM_DB_MIN) db = SPECTROGRAM_DB_MIN;
+        if (db > SPECTROGRAM_DB_MAX) db = SPECTROGRAM_DB_MAX;
+        state->row_acc[col] = (state->row_frames == 0) ? db : state->row_acc[col] + db;
+    }
+    if (++state->row_frames < SPECTROGRAM_FRAMES_PER_ROW) {
+        return;
+    }
+
+    // Average in dB, map to 0-255 and upload just this row
+    const float scale = 255.0f / ((SPECTROGRAM_DB_MAX - SPECTROGRAM_DB_MIN) * state->row_frames);
+    const float offset = SPECTROGRAM_DB_MIN * state->row_frames;
+    for (int col = 0; col < SPECTROGRAM_COLUMNS; col++) {
+        state->row_pixels[col] = (uint8_t)((state->row_acc[col] - offset) * scale + 0.5f);
+    }
+    UpdateTextureRec(state->texture, (Rectangle){0, (float)state->head, SPECTROGRAM_COLUMNS, 1},
+                     state->row_pixels);
+
+    state->row_time[state->head] = GetTime();
+    state->head = (state->head + 1) % SPECTROGRAM_ROWS;
+    if (state->rows_written < SPECTROGRAM_ROWS) state->rows_written++;
+    state->row_frames = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Spectrogram Rendering
+//-----------------------------------------------------------------------------
+
+// Grid settings (matching FFT display)
+#define SPECTROGRAM_GRID_MIN_SPACING_PX 80
+#define SPECTROGRAM_GRID_MAX_DIVISIONS 12
+
+// Snap to 1-2-5 log scale sequence (same as oscilloscope)
+static double spectrogram_snap_to_125(double value) {
+    if (value <= 0) return 1.0;
+
+    double magnitude = pow(10.0, floor(log10(value)));
+    double normalized = value / magnitude;
+
+    double snapped;
+    if (normalized < 1.5) {
+        snapped = 1.0;
+    } else if (normalized < 3.5) {
+        snapped = 2.0;
+    } else if (normalized < 7.5) {
+        snapped = 5.0;
+    } else {
+        snapped = 10.0;
+    }
+
+    return snapped * magnitude;
+}
+
+// Format frequency value with appropriate unit (Hz, kHz, MHz)
+static void spectrogram_format_freq(char *buf, size_t buf_size, double hz) {
+    if (hz >= 1000000.0) {
+        snprintf(buf, buf_size, "%.3gMHz", hz / 1000000.0);
+    } else if (hz >= 1000.0) {
+        snprintf(buf, buf_size, "%.3gkHz", hz / 1000.0);
+    } else {
+        snprintf(buf, buf_size, "%.3gHz", hz);
+    }
+}
+
+// Helper to draw text with font (index 0 = Inter, 1 = Space Mono)
+static void spectrogram_draw_text(Font *fonts, int font, const char *text, float px, float py,
+                                  int fontSize, Color color) {
+    if (fonts) {
+        DrawTextEx(fonts[font], text, (Vector2){px, py}, (float)fontSize, 1.0f, color);
+    } else {
+        DrawText(text, (int)px, (int)py, fontSize, color);
+    }
+}
+
+// Helper to measure text with font
+static int spectrogram_measure_text(Font *fonts, const char *text, int fontSize) {
+    if (fonts) {
+        return (int)MeasureTextEx(fonts[0], text, (float)fontSize, 1.0f).x;
+    }
+    return MeasureText(text, fontSize);
+}
+
+void gui_spectrogram_render(spectrogram_state_t *state, float x, float y,
+                            float width, float height, Font *fonts) {
+    if (!state || !state->initialized) return;
+
+    DrawRectangle((int)x, (int)y, (int)width, (int)height, COLOR_METER_BG);
+
+    if (!spectrogram_init_texture(state)) {
+        spectrogram_draw_text(fonts, 0, "Spectrogram: GPU init failed", x + 10, y + 10,
+                              FONT_SIZE_OSC_SCALE, (Color){255, 80, 80, 255});
+        return;
+    }
+
+    // History, newest row at the top; the shader leaves unwritten rows transparent
+    float head = (float)state->head;
+    float rows = (float)SPECTROGRAM_ROWS;
+    float filled = (float)state->rows_written;
+    SetShaderValue(s_shader, s_headRow_loc, &head, SHADER_UNIFORM_FLOAT);
+    SetShaderValue(s_shader, s_rows_loc, &rows, SHADER_UNIFORM_FLOAT);
+    SetShaderValue(s_shader, s_filledRows_loc, &filled, SHADER_UNIFORM_FLOAT);
+    BeginShaderMode(s_shader);
+    DrawTexturePro(state->texture,
+                   (Rectangle){0, 0, SPECTROGRAM_COLUMNS, SPECTROGRAM_ROWS},
+                   (Rectangle){x, y, width, height},
+                   (Vector2){0, 0}, 0.0f, WHITE);
+    EndShaderMode();
+
+    // Frequency grid with 1-2-5 snapping (matching FFT display)
+    if (state->sample_rate > 0) {
+        float nyquist = (float)state->sample_rate / 2.0f;
+        float freq_per_pixel = nyquist / width;
+        float freq_division = (float)spectrogram_snap_to_125(
+            (double)(freq_per_pixel * (float)SPECTROGRAM_GRID_MIN_SPACING_PX));
+
+        char freq_buf[32];
+        int div_count = 0;
+        for (float freq = freq_division; freq < nyquist && div_count < SPECTROGRAM_GRID_MAX_DIVISIONS;
+             freq += freq_division) {
+            float line_x = x + (freq / nyquist) * width;
+
+            DrawLineV((Vector2){line_x, y}, (Vector2){line_x, y + height}, COLOR_GRID);
+
+            if (line_x > x + 30 && line_x < x + width - 30) {
+                spectrogram_format_freq(freq_buf, sizeof(freq_buf), freq);
+                int label_w = spectrogram_measure_text(fonts, freq_buf, FONT_SIZE_OSC_SCALE);
+                spectrogram_draw_text(fonts, 1, freq_buf, line_x - label_w / 2, y + height - 14,
+                                      FONT_SIZE_OSC_SCALE, COLOR_TEXT_DIM);
+            }
+            div_count++;
+        }
+    }
+
+    // History length of the full panel height
+    if (state->rows_written > 1) {
+        int newest = (state->head + SPECTROGRAM_ROWS - 1) % SPECTROGRAM_ROWS;
+        int oldest = (state->head + SPECTROGRAM_ROWS - state->rows_written) % SPECTROGRAM_ROWS;
+        double span = state->row_time[newest] - state->row_time[oldest];
+        double per_row = span / (double)(state->rows_written - 1);
+        char span_label[32];
+        snprintf(span_label, sizeof(span_label), "%.0fs", per_row * SPECTROGRAM_ROWS);
+        spectrogram_draw_text(fonts, 1, span_label, x + 5, y + height - 32,
+                              FONT_SIZE_OSC_SCALE, COLOR_TEXT_DIM);
+    }
+
+    // Border (same as oscilloscope)
+    DrawRectangleLinesEx((Rectangle){x, y, width, height}, 1, COLOR_GRID_MAJOR);
+
+    // Label in top-right corner (matching oscilloscope channel label style)
+    const char *label = "Spectrogram";
+    int label_width = spectrogram_measure_text(fonts, label, FONT_SIZE_OSC_LABEL);
+    spectrogram_draw_text(fonts, 0, label, x + width - label_width - 8, y + 4,
+                          FONT_SIZE_OSC_LABEL, COLOR_TEXT);
+}
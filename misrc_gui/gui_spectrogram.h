@@ -0,0 +1,89 @@
+/*
+ * MISRC GUI - Scrolling Spectrogram (Waterfall) Display
+ *
+ * Shows the history of the background FFT worker's spectra (gui_fft_worker.c)
+ * as a waterfall, newest row at the top. The history lives in a circular
+ * 8-bit GPU texture: every update uploads one row at the head and the
+ * fragment shader unwraps the ring with the head offset and maps levels to
+ * the heatmap palette, so the cost per frame is one row upload and one
+ * textured quad, independent of the history length.
+ *
+ * A row averages SPECTROGRAM_FRAMES_PER_ROW worker frames, which stretches
+ * the history to about a minute at 60 frames per second.
+ *
+ * Requires FFTW3 single-precision library (fftw3f).
+ */
+
+#ifndef GUI_SPECTROGRAM_H
+#define GUI_SPECTROGRAM_H
+
+#include "raylib.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+//-----------------------------------------------------------------------------
+// Spectrogram Configuration Constants
+//-----------------------------------------------------------------------------
+
+#define SPECTROGRAM_COLUMNS         1024   // Frequency columns of the texture (bins are max-reduced)
+#define SPECTROGRAM_ROWS            1024   // Rows of history in the texture ring
+#define SPECTROGRAM_FRAMES_PER_ROW  4      // Worker frames averaged into one row
+
+// dB range mapped to the palette (dBFS)
+#define SPECTROGRAM_DB_MIN        -110.0f
+#define SPECTROGRAM_DB_MAX         -10.0f
+
+//-----------------------------------------------------------------------------
+// Spectrogram State Structure
+//-----------------------------------------------------------------------------
+
+typedef struct spectrogram_state {
+    Texture2D texture;          // SPECTROGRAM_COLUMNS x SPECTROGRAM_ROWS, 8-bit levels
+    bool texture_valid;         // Texture is created (needs OpenGL context, done on first render)
+
+    int head;                   // Row the next update writes (the newest row is head - 1)
+    int rows_written;           // Rows holding data, up to SPECTROGRAM_ROWS
+
+    float *row_acc;             // SPECTROGRAM_COLUMNS dB sums of the row being collected
+    int row_frames;             // Worker frames summed into row_acc
+    uint8_t *row_pixels;        // SPECTROGRAM_COLUMNS levels of the row to upload
+    double *row_time;           // GetTime() of every row, for the history length label
+
+    uint64_t last_seq;          // Worker frame last taken over
+    uint32_t sample_rate;       // Input sample rate of the last frame (for freq axis)
+
+    bool initialized;
+} spectrogram_state_t;
+
+//-----------------------------------------------------------------------------
+// Spectrogram Lifecycle Management
+//-----------------------------------------------------------------------------
+
+// Initialize spectrogram state (the texture is created on first render)
+// Returns true on success, false on failure or if FFTW not available
+bool gui_spectrogram_init(spectrogram_state_t *state);
+
+// Clear the history
+void gui_spectrogram_clear(spectrogram_state_t *state);
+
+// Free all spectrogram resources
+void gui_spectrogram_cleanup(spectrogram_state_t *state);
+
+//-----------------------------------------------------------------------------
+// Spectrogram Update and Rendering (called from render thread)
+//-----------------------------------------------------------------------------
+
+// Take over the newest worker frame of a channel (0 = A, 1 = B)
+// Uploads a row to the texture every SPECTROGRAM_FRAMES_PER_ROW frames
+void gui_spectrogram_update(spectrogram_state_t *state, int channel);
+
+// Render the spectrogram with frequency grid and history length label
+// Parameters:
+//   state: Spectrogram state structure
+//   x, y: Screen position
+//   width, height: Display size
+//   fonts: Font array (index 0 = Inter, index 1 = Space Mono), NULL for default
+void gui_spectrogram_render(spectrogram_state_t *state, float x, float y,
+                            float width, float height, Font *fonts);
+
+#endif // GUI_SPECTROGRAM_H
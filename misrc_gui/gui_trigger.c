@@ -6,6 +6,38 @@
 
 #include "gui_trigger.h"
 
+//-----------------------------------------------------------------------------
+// Sync Pulse Search
+//-----------------------------------------------------------------------------
+
+// First sync pulse starting in [start, search_limit) that stays at or below
+// threshold for min_width..max_width samples; returns its start and end
+static bool find_sync_pulse(const int16_t *buf, size_t count, size_t start, size_t search_limit,
+                            int16_t threshold, size_t min_width, size_t max_width,
+                            size_t *pulse_start, size_t *pulse_end) {
+    size_t i = start;
+    while (i < search_limit) {
+        // Falling edge into sync (entering sync pulse)
+        ssize_t edge = trigger_find_falling_edge(buf, search_limit, threshold, i);
+        if (edge < 0) break;
+        i = (size_t)edge;
+
+        // Measure how long signal stays below threshold
+        ssize_t above = trigger_find_above(buf, count, threshold, i);
+        size_t sync_end = (above < 0) ? count : (size_t)above;
+        size_t pulse_width = sync_end - i;
+        if (pulse_width >= min_width && pulse_width <= max_width) {
+            *pulse_start = i;
+            *pulse_end = sync_end;
+            return true;
+        }
+
+        // Skip past this pulse (sync_end is above threshold, no edge there)
+        i = sync_end + 1;
+    }
+    return false;
+}
+
 //-----------------------------------------------------------------------------
 // CVBS Signal Level Analysis
 //-----------------------------------------------------------------------------
@@ -23,6 +55,13 @@ void trigger_analyze_cvbs_levels(const int16_t *buf, size_t count,
         if (buf[i] > sig_max) sig_max = buf[i];
     }
 
+    trigger_cvbs_levels_from_minmax(sig_min, sig_max, levels);
+}
+
+void trigger_cvbs_levels_from_minmax(int16_t sig_min, int16_t sig_max,
+                                     cvbs_levels_t *levels) {
+    if (!levels) return;
+
     levels->sig_min = sig_min;
     levels->sig_max = sig_max;
     levels->range = sig_max - sig_min;
@@ -38,48 +77,6 @@ void trigger_analyze_cvbs_levels(const int16_t *buf, size_t count,
     levels->white_level = sig_min + (int16_t)((float)levels->range * 0.95f);
 }
 
-//-----------------------------------------------------------------------------
-// Edge Trigger Detection
-//-----------------------------------------------------------------------------
-
-ssize_t trigger_find_rising_edge(const int16_t *buf, size_t count,
-                                  int16_t level, size_t min_index) {
-    if (!buf || count < 2) return -1;
-
-    size_t start = (min_index > 1) ? min_index : 1;
-
-    for (size_t i = start; i < count; i++) {
-        int16_t prev = buf[i - 1];
-        int16_t curr = buf[i];
-
-        // Rising edge: cross from below to at-or-above level
-        if (prev < level && curr >= level) {
-            return (ssize_t)i;
-        }
-    }
-
-    return -1;
-}
-
-ssize_t trigger_find_falling_edge(const int16_t *buf, size_t count,
-                                   int16_t level, size_t min_index) {
-    if (!buf || count < 2) return -1;
-
-    size_t start = (min_index > 1) ? min_index : 1;
-
-    for (size_t i = start; i < count; i++) {
-        int16_t prev = buf[i - 1];
-        int16_t curr = buf[i];
-
-        // Falling edge: cross from above to at-or-below level
-        if (prev > level && curr <= level) {
-            return (ssize_t)i;
-        }
-    }
-
-    return -1;
-}
-
 //-----------------------------------------------------------------------------
 // CVBS Sync Detection
 //-----------------------------------------------------------------------------
@@ -90,30 +87,15 @@ ssize_t trigger_find_cvbs_hsync_with_levels(const int16_t *buf, size_t count,
     if (!buf || !levels || count < CVBS_HSYNC_MAX_WIDTH + 2) return -1;
     if (levels->range < 100) return -1;  // Signal too weak
 
-    int16_t sync_threshold = levels->sync_threshold;
     size_t start = (min_index > 1) ? min_index : 1;
     size_t search_limit = count - CVBS_HSYNC_MAX_WIDTH;
+    size_t sync_start, sync_end;
 
-    for (size_t i = start; i < search_limit; i++) {
-        // Check for falling edge into sync (entering sync pulse)
-        if (buf[i - 1] > sync_threshold && buf[i] <= sync_threshold) {
-            // Measure how long signal stays below threshold
-            size_t sync_end = i;
-            while (sync_end < count && buf[sync_end] <= sync_threshold) {
-                sync_end++;
-            }
-
-            size_t pulse_width = sync_end - i;
-
-            // Valid H-sync pulse width? (not too short = noise, not too long = vsync)
-            if (pulse_width >= CVBS_HSYNC_MIN_WIDTH && pulse_width <= CVBS_HSYNC_MAX_WIDTH) {
-                // Trigger at rising edge (end of sync pulse = start of back porch)
-                return (ssize_t)sync_end;
-            }
-
-            // Skip past this pulse for next iteration
-            i = sync_end;
-        }
+    // Valid H-sync pulse width (not too short = noise, not too long = vsync)
+    if (find_sync_pulse(buf, count, start, search_limit, levels->sync_threshold,
+                        CVBS_HSYNC_MIN_WIDTH, CVBS_HSYNC_MAX_WIDTH, &sync_start, &sync_end)) {
+        // Trigger at rising edge (end of sync pulse = start of back porch)
+        return (ssize_t)sync_end;
     }
 
     return -1;
@@ -136,30 +118,15 @@ ssize_t trigger_find_cvbs_vsync(const int16_t *buf, size_t count,
     if (!buf || !levels || count < CVBS_VSYNC_MAX_WIDTH + 2) return -1;
     if (levels->range < 100) return -1;  // Signal too weak
 
-    int16_t sync_threshold = levels->sync_threshold;
     size_t start = (min_index > 1) ? min_index : 1;
     size_t search_limit = count - CVBS_VSYNC_MAX_WIDTH;
+    size_t sync_start, sync_end;
 
-    for (size_t i = start; i < search_limit; i++) {
-        // Check for falling edge into sync
-        if (buf[i - 1] > sync_threshold && buf[i] <= sync_threshold) {
-            // Measure pulse width
-            size_t sync_end = i;
-            while (sync_end < count && buf[sync_end] <= sync_threshold) {
-                sync_end++;
-            }
-
-            size_t pulse_width = sync_end - i;
-
-            // V-sync broad pulse? (longer than H-sync)
-            if (pulse_width >= CVBS_VSYNC_MIN_WIDTH && pulse_width <= CVBS_VSYNC_MAX_WIDTH) {
-                // Return start of V-sync pulse
-                return (ssize_t)i;
-            }
-
-            // Skip past this pulse
-            i = sync_end;
-        }
+    // V-sync broad pulse (longer than H-sync)
+    if (find_sync_pulse(buf, count, start, search_limit, levels->sync_threshold,
+                        CVBS_VSYNC_MIN_WIDTH, CVBS_VSYNC_MAX_WIDTH, &sync_start, &sync_end)) {
+        // Return start of V-sync pulse
+        return (ssize_t)sync_start;
     }
 
     return -1;
@@ -192,6 +159,12 @@ ssize_t trigger_find(const int16_t *buf, size_t count,
 ssize_t trigger_find_from_config(const int16_t *buf, size_t count,
                                   const channel_trigger_t *trig, size_t min_index) {
     if (!trig) return -1;
+
+    // Levels from the block stats save the analysis pass over the samples
+    if (trig->enabled && trig->trigger_mode == TRIGGER_MODE_CVBS_HSYNC && trig->cvbs_levels.range > 0) {
+        return trigger_find_cvbs_hsync_with_levels(buf, count, min_index, &trig->cvbs_levels);
+    }
+
     return trigger_find(buf, count, trig->level, trig->trigger_mode,
                         trig->enabled, min_index);
 }
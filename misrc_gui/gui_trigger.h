@@ -3,12 +3,18 @@
  *
  * Centralized trigger detection for oscilloscope and CVBS decoder.
  * Supports edge triggers (rising/falling) and CVBS sync detection.
+ *
+ * Edge searches (trigger_find_rising_edge() and trigger_find_falling_edge())
+ * live in misrc_common/edge_search.h, shared with misrc_capture. Sync pulse
+ * widths are measured the same way, 8 samples at a time, as the run up to
+ * the next sample above the threshold.
  */
 
 #ifndef GUI_TRIGGER_H
 #define GUI_TRIGGER_H
 
 #include "gui_app.h"
+#include "../misrc_common/edge_search.h"
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
@@ -37,33 +43,17 @@
 // CVBS Signal Level Analysis
 //-----------------------------------------------------------------------------
 
-typedef struct {
-    int16_t sig_min;           // Signal minimum (sync tip level)
-    int16_t sig_max;           // Signal maximum (white level)
-    int16_t range;             // sig_max - sig_min
-    int16_t sync_threshold;    // Threshold for sync detection
-    int16_t black_level;       // Calculated black level (~30% above min)
-    int16_t white_level;       // Calculated white level (near max)
-} cvbs_levels_t;
+// cvbs_levels_t is defined in gui_app.h (kept per channel in channel_trigger_t)
 
 // Analyze CVBS signal levels from a buffer
 // Samples every 8th value for efficiency
 void trigger_analyze_cvbs_levels(const int16_t *buf, size_t count,
                                   cvbs_levels_t *levels);
 
-//-----------------------------------------------------------------------------
-// Edge Trigger Detection
-//-----------------------------------------------------------------------------
-
-// Find rising edge crossing level, starting search from min_index
-// Returns sample index of crossing, or -1 if not found
-ssize_t trigger_find_rising_edge(const int16_t *buf, size_t count,
-                                  int16_t level, size_t min_index);
-
-// Find falling edge crossing level, starting search from min_index
-// Returns sample index of crossing, or -1 if not found
-ssize_t trigger_find_falling_edge(const int16_t *buf, size_t count,
-                                   int16_t level, size_t min_index);
+// Derive CVBS levels from the min/max of a block (e.g. the extraction stats),
+// avoids another pass over the samples
+void trigger_cvbs_levels_from_minmax(int16_t sig_min, int16_t sig_max,
+                                     cvbs_levels_t *levels);
 
 //-----------------------------------------------------------------------------
 // CVBS Sync Detection
@@ -98,6 +88,7 @@ ssize_t trigger_find(const int16_t *buf, size_t count,
                      bool enabled, size_t min_index);
 
 // Convenience wrapper that takes channel_trigger_t pointer
+// CVBS mode uses the block levels in trig->cvbs_levels when they are set
 ssize_t trigger_find_from_config(const int16_t *buf, size_t count,
                                   const channel_trigger_t *trig, size_t min_index);
 
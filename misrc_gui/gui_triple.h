@@ -0,0 +1,59 @@
+/*
+ * MISRC GUI - Lock-Free Triple Buffer
+ *
+ * Hands the newest of a stream of frames from one writer thread to one
+ * reader thread without either side waiting. The owner keeps three slots of
+ * its own frame type and this keeps track of which one is which: the writer
+ * fills `back` and publishes it through `middle`, the reader swaps the newest
+ * frame from `middle` into `front`. A frame the reader did not take in time
+ * is overwritten by the next one.
+ */
+
+#ifndef GUI_TRIPLE_H
+#define GUI_TRIPLE_H
+
+#include <stdbool.h>
+#include <stdatomic.h>
+
+// Set in middle while the reader has not taken the slot yet
+#define GUI_TRIPLE_FRESH 4
+
+typedef struct {
+    int back;                 // Slot being written (writer only)
+    atomic_int middle;        // Last published slot, GUI_TRIPLE_FRESH if not taken yet
+    int front;                // Slot being read (reader only)
+} gui_triple_t;
+
+#define GUI_TRIPLE_INIT { .back = 0, .middle = 1, .front = 2 }
+
+// Start with nothing published (only while neither side runs)
+static inline void gui_triple_init(gui_triple_t *t) {
+    t->back = 0;
+    atomic_store(&t->middle, 1);
+    t->front = 2;
+}
+
+// Writer: make the back slot the newest frame and take over the old middle slot
+// Release orders the frame contents before the slot index, acquire orders the
+// reader's last use of the returned slot before the writer fills it again
+static inline int gui_triple_publish(gui_triple_t *t) {
+    t->back = atomic_exchange_explicit(&t->middle, t->back | GUI_TRIPLE_FRESH,
+                                       memory_order_acq_rel) & 3;
+    return t->back;
+}
+
+// Reader: take the newest frame if one was published since the last acquire
+// Returns the front slot, valid until the next acquire
+static inline int gui_triple_acquire(gui_triple_t *t) {
+    if (atomic_load_explicit(&t->middle, memory_order_relaxed) & GUI_TRIPLE_FRESH) {
+        t->front = atomic_exchange_explicit(&t->middle, t->front, memory_order_acq_rel) & 3;
+    }
+    return t->front;
+}
+
+// Writer: is the last published frame still waiting for the reader?
+static inline bool gui_triple_pending(gui_triple_t *t) {
+    return (atomic_load_explicit(&t->middle, memory_order_relaxed) & GUI_TRIPLE_FRESH) != 0;
+}
+
+#endif // GUI_TRIPLE_H
@@ -10,6 +10,7 @@
 #include "gui_fft.h"
 #include "gui_panel.h"
 #include "gui_custom_elements.h"
+#include "gui_extract.h"
 #include "version.h"
 #include <clay.h>
 #include <stdio.h>
@@ -41,17 +42,22 @@ static char temp_buf5[64];
 static char temp_buf6[64];
 static char temp_buf7[64];
 static char temp_buf8[64];
+static char temp_buf9[64];
 static char device_dropdown_buf[64];
 static char temp_title_buf[64];
 
 // Per-channel stat buffers (separate for A and B to avoid overwrite)
 static char stat_a_peak_pos[16];
 static char stat_a_peak_neg[16];
+static char stat_a_rms[16];
+static char stat_a_dc[16];
 static char stat_a_clip_pos[16];
 static char stat_a_clip_neg[16];
 static char stat_a_errors[16];
 static char stat_b_peak_pos[16];
 static char stat_b_peak_neg[16];
+static char stat_b_rms[16];
+static char stat_b_dc[16];
 static char stat_b_clip_pos[16];
 static char stat_b_clip_neg[16];
 static char stat_b_errors[16];
@@ -104,8 +110,8 @@ static void render_toolbar(gui_app_t *app) {
             .backgroundColor = to_clay_color(dropdown_color),
             .cornerRadius = CLAY_CORNER_RADIUS(4)
         }) {
-            const char *device_name = app->device_count > 0 ?
-                app->devices[app->selected_device].name : "No devices";
+            const char *device_name = app->device_count > 0 ? app->devices[app->selected_device].name :
+                                      app->enum_thread ? "Searching..." : "No devices";
             snprintf(device_dropdown_buf, sizeof(device_dropdown_buf), "%s", device_name);
             CLAY_TEXT(make_string(device_dropdown_buf),
                 CLAY_TEXT_CONFIG({ .fontSize = FONT_SIZE_NORMAL, .textColor = to_clay_color(COLOR_TEXT) }));
@@ -177,9 +183,10 @@ static char trig_level_b_buf[16];
 static void render_channel_stats(gui_app_t *app, int channel) {
     // Get per-channel stats and trigger
     uint32_t clip_pos, clip_neg, errors;
-    float peak_pos, peak_neg;
+    float peak_pos, peak_neg, rms;
+    int dc;
     Color channel_color;
-    char *buf_peak_pos, *buf_peak_neg, *buf_clip_pos, *buf_clip_neg, *buf_errors;
+    char *buf_peak_pos, *buf_peak_neg, *buf_rms, *buf_dc, *buf_clip_pos, *buf_clip_neg, *buf_errors;
     channel_trigger_t *trig;
     char *trig_level_buf;
 
@@ -189,9 +196,13 @@ static void render_channel_stats(gui_app_t *app, int channel) {
         errors = atomic_load(&app->error_count_a);
         peak_pos = app->vu_a.peak_pos;
         peak_neg = app->vu_a.peak_neg;
+        rms = (float)atomic_load(&app->rms_a) / 2048.0f;
+        dc = (int)atomic_load(&app->dc_a);
         channel_color = COLOR_CHANNEL_A;
         buf_peak_pos = stat_a_peak_pos;
         buf_peak_neg = stat_a_peak_neg;
+        buf_rms = stat_a_rms;
+        buf_dc = stat_a_dc;
         buf_clip_pos = stat_a_clip_pos;
         buf_clip_neg = stat_a_clip_neg;
         buf_errors = stat_a_errors;
@@ -203,9 +214,13 @@ static void render_channel_stats(gui_app_t *app, int channel) {
         errors = atomic_load(&app->error_count_b);
         peak_pos = app->vu_b.peak_pos;
         peak_neg = app->vu_b.peak_neg;
+        rms = (float)atomic_load(&app->rms_b) / 2048.0f;
+        dc = (int)atomic_load(&app->dc_b);
         channel_color = COLOR_CHANNEL_B;
         buf_peak_pos = stat_b_peak_pos;
         buf_peak_neg = stat_b_peak_neg;
+        buf_rms = stat_b_rms;
+        buf_dc = stat_b_dc;
         buf_clip_pos = stat_b_clip_pos;
         buf_clip_neg = stat_b_clip_neg;
         buf_errors = stat_b_errors;
@@ -213,10 +228,12 @@ static void render_channel_stats(gui_app_t *app, int channel) {
         trig_level_buf = trig_level_b_buf;
     }
 
-    // Format stats (peak/clip/errors)
+    // Format stats (peak/rms/dc/clip/errors)
 
     snprintf(buf_peak_pos, 16, "+%.0f%%", peak_pos * 100.0f);
     snprintf(buf_peak_neg, 16, "-%.0f%%", peak_neg * 100.0f);
+    snprintf(buf_rms, 16, "%.0f%%", rms * 100.0f);
+    snprintf(buf_dc, 16, "DC %+d", dc);
     snprintf(buf_clip_pos, 16, "+%u", clip_pos);
     snprintf(buf_clip_neg, 16, "-%u", clip_neg);
     snprintf(buf_errors, 16, "%u", errors);
@@ -250,6 +267,16 @@ static void render_channel_stats(gui_app_t *app, int channel) {
                 CLAY_TEXT_CONFIG({ .fontSize = FONT_SIZE_STATS, .textColor = to_clay_color(peak_neg > 0.95f ? COLOR_CLIP_RED : COLOR_TEXT) }));
         }
 
+        // RMS row (RMS level and DC offset from the extraction statistics)
+        CLAY(CLAY_IDI("StatRms", channel), { .layout = STAT_ROW_LAYOUT }) {
+            CLAY_TEXT(CLAY_STRING("RMS:"),
+                CLAY_TEXT_CONFIG({ .fontSize = FONT_SIZE_STATS, .textColor = to_clay_color(COLOR_TEXT_DIM) }));
+            CLAY_TEXT(make_string(buf_rms),
+                CLAY_TEXT_CONFIG({ .fontSize = FONT_SIZE_STATS, .textColor = to_clay_color(COLOR_TEXT) }));
+            CLAY_TEXT(make_string(buf_dc),
+                CLAY_TEXT_CONFIG({ .fontSize = FONT_SIZE_STATS, .textColor = to_clay_color(COLOR_TEXT) }));
+        }
+
         // Clip row (shows both + and -)
         CLAY(CLAY_IDI("StatClip", channel), { .layout = STAT_ROW_LAYOUT }) {
             CLAY_TEXT(CLAY_STRING("Clip:"),
@@ -484,7 +511,7 @@ static void render_channel_stats(gui_app_t *app, int channel) {
             bool left_dropdown_open = gui_dropdown_is_open(DROPDOWN_LEFT_VIEW, channel);
             CLAY(CLAY_IDI("LeftViewBtn", channel), {
                 .layout = {
-                    .sizing = { CLAY_SIZING_FIXED(65), CLAY_SIZING_FIXED(18) },
+                    .sizing = { CLAY_SIZING_FIXED(85), CLAY_SIZING_FIXED(18) },
                     .childAlignment = { .x = CLAY_ALIGN_X_CENTER, .y = CLAY_ALIGN_Y_CENTER }
                 },
                 .backgroundColor = to_clay_color(left_dropdown_open ? COLOR_BUTTON_HOVER : COLOR_BUTTON),
@@ -499,7 +526,7 @@ static void render_channel_stats(gui_app_t *app, int channel) {
         if (gui_dropdown_is_open(DROPDOWN_LEFT_VIEW, channel)) {
             CLAY(CLAY_IDI("LeftViewOpts", channel), {
                 .layout = {
-                    .sizing = { CLAY_SIZING_FIXED(65), CLAY_SIZING_FIT(0) },
+                    .sizing = { CLAY_SIZING_FIXED(85), CLAY_SIZING_FIT(0) },
                     .layoutDirection = CLAY_TOP_TO_BOTTOM
                 },
                 .floating = {
@@ -546,7 +573,7 @@ static void render_channel_stats(gui_app_t *app, int channel) {
                 bool right_dropdown_open = gui_dropdown_is_open(DROPDOWN_RIGHT_VIEW, channel);
                 CLAY(CLAY_IDI("RightViewBtn", channel), {
                     .layout = {
-                        .sizing = { CLAY_SIZING_FIXED(65), CLAY_SIZING_FIXED(18) },
+                        .sizing = { CLAY_SIZING_FIXED(85), CLAY_SIZING_FIXED(18) },
                         .childAlignment = { .x = CLAY_ALIGN_X_CENTER, .y = CLAY_ALIGN_Y_CENTER }
                     },
                     .backgroundColor = to_clay_color(right_dropdown_open ? COLOR_BUTTON_HOVER : COLOR_BUTTON),
@@ -561,7 +588,7 @@ static void render_channel_stats(gui_app_t *app, int channel) {
             if (gui_dropdown_is_open(DROPDOWN_RIGHT_VIEW, channel)) {
                 CLAY(CLAY_IDI("RightViewOpts", channel), {
                     .layout = {
-                        .sizing = { CLAY_SIZING_FIXED(65), CLAY_SIZING_FIT(0) },
+                        .sizing = { CLAY_SIZING_FIXED(85), CLAY_SIZING_FIT(0) },
                         .layoutDirection = CLAY_TOP_TO_BOTTOM
                     },
                     .floating = {
@@ -679,7 +706,23 @@ static void render_channels_panel(gui_app_t *app) {
     }
 }
 
+// Capture ringbuffer fill and high-water mark, shown next to the backpressure counters
+static void render_capture_rb_usage(void) {
+    ringbuffer_t *rb = gui_extract_get_capture_rb();
+    if (!rb) return;
+
+    rb_stats_t st;
+    rb_get_stats(rb, &st);
+    unsigned fill = (unsigned)(st.fill * 100 / st.size);
+    unsigned peak = (unsigned)(st.high_water * 100 / st.size);
+    snprintf(temp_buf9, sizeof(temp_buf9), "Buf:%u%% Peak:%u%%", fill, peak);
+    Color color = (peak >= 90) ? COLOR_CLIP_RED : (peak >= 50) ? COLOR_METER_YELLOW : COLOR_TEXT_DIM;
+    CLAY_TEXT(make_string(temp_buf9),
+        CLAY_TEXT_CONFIG({ .fontSize = FONT_SIZE_STATUS, .fontId = 1, .textColor = to_clay_color(color) }));
+}
+
 // Render status bar
+
 static void render_status_bar(gui_app_t *app) {
     CLAY(CLAY_ID("StatusBar"), {
         .layout = {
@@ -748,6 +791,8 @@ static void render_status_bar(gui_app_t *app) {
                         CLAY_TEXT_CONFIG({ .fontSize = FONT_SIZE_STATUS, .fontId = 1, .textColor = to_clay_color(COLOR_TEXT_DIM) }));
                 }
 
+                render_capture_rb_usage();
+
                 // Show backpressure stats if any waits/drops occurred
                 uint32_t wait_count = atomic_load(&app->rb_wait_count);
                 uint32_t drop_count = atomic_load(&app->rb_drop_count);
@@ -765,6 +810,7 @@ static void render_status_bar(gui_app_t *app) {
 
                 // Show backpressure stats during capture even when not recording
                 if (app->is_capturing) {
+                    render_capture_rb_usage();
                     uint32_t wait_count = atomic_load(&app->rb_wait_count);
                     uint32_t drop_count = atomic_load(&app->rb_drop_count);
                     if (wait_count > 0 || drop_count > 0) {
@@ -18,11 +18,23 @@
 #include "gui_app.h"
 #include "gui_ui.h"
 #include "gui_text.h"
+#include "gui_font_cache.h"
 #include "gui_capture.h"
 #include "gui_oscilloscope.h"
 #include "gui_dropdown.h"
 #include "gui_popup.h"
 #include "gui_record.h"
+#include "gui_fft_worker.h"
+#include "gui_perf.h"
+#include "gui_simulated.h"
+#include "../misrc_common/ringbuffer.h"
+#include "../misrc_common/file_segment.h"
+#include "../misrc_common/decimate.h"
+#include "../misrc_common/flac_writer.h"
+#include "../misrc_common/thread_role.h"
+#include "../misrc_common/hotplug.h"
+#include "../misrc_common/preview.h"
+#include "../misrc_common/frame_queue.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -36,17 +48,66 @@ volatile atomic_int do_exit = 0;
 #define FONT_COUNT 2
 static Font fonts[FONT_COUNT];
 
+// Seconds between reconnect attempts while hotplug events are available
+#define RECONNECT_FALLBACK_S 5.0
+
 // Clay error handler
 void clay_error_handler(Clay_ErrorData error) {
     fprintf(stderr, "Clay Error: %s\n", error.errorText.chars);
 }
 
+// Stop a capture whose device went away and wait for it to come back
+static void connection_lost(gui_app_t *app, const char *status) {
+    gui_app_stop_capture(app);
+    gui_app_clear_display(app);
+    app->reconnect_pending = true;
+    app->reconnect_attempt_time = GetTime();
+    app->reconnect_attempts = 0;
+    gui_app_set_status(app, status);
+}
+
+// Restart the capture on the device it was lost on, if it is listed again
+static void reconnect_attempt(gui_app_t *app) {
+    char status_buf[128];
+    app->reconnect_attempts++;
+
+    int index = gui_app_find_device(app, &app->active_device);
+    if (index < 0) {
+        snprintf(status_buf, sizeof(status_buf), "No device found (attempt %d)", app->reconnect_attempts);
+        gui_app_set_status(app, status_buf);
+        return;
+    }
+
+    app->selected_device = index;
+    snprintf(status_buf, sizeof(status_buf), "Reconnecting (attempt %d)...", app->reconnect_attempts);
+    gui_app_set_status(app, status_buf);
+    if (gui_app_start_capture(app) == 0) {
+        app->reconnect_pending = false;
+        app->reconnect_attempts = 0;
+        gui_app_set_status(app, "Reconnected");
+    }
+}
+
+// A background enumeration after startup finished: notice a removed
+// capture device right away and reconnect as soon as it is back
+static void device_list_changed(gui_app_t *app) {
+    if (!app->auto_reconnect_enabled) return;
+
+    // Only hsdaoh devices are listed reliably while in use, a busy capture
+    // card may fail its format query and is left to the callback timeout
+    if (app->is_capturing && app->active_device.type == DEVICE_TYPE_HSDAOH &&
+        gui_app_find_device(app, &app->active_device) < 0) {
+        fprintf(stderr, "[GUI] Device removed, disconnecting...\n");
+        connection_lost(app, "Device removed. Waiting for it to come back...");
+    } else if (app->reconnect_pending && !app->is_capturing) {
+        reconnect_attempt(app);
+    }
+}
+
 int main(int argc, char **argv) {
-    (void)argc;
-    (void)argv;
 
-    // Initialize application state
-    gui_app_t app = {0};
+    // Initialize application state (static, the display triple buffers are too large for the stack)
+    static gui_app_t app = {0};
     app.fonts = fonts;
 
     // Initialize sample rate early (before any capture/rendering can occur)
@@ -57,11 +118,165 @@ int main(int argc, char **argv) {
     app.settings.capture_b = true;
     app.settings.use_flac = true;
     app.settings.flac_level = 4;
+    app.settings.flac_level_max = 4;
     app.settings.show_grid = true;
     app.settings.time_scale = 1.0f;
     app.settings.amplitude_scale = 1.0f;
     strcpy(app.settings.output_filename_a, "capture_a.flac");
     strcpy(app.settings.output_filename_b, "capture_b.flac");
+    app.settings.fft_size = FFT_WORKER_SIZE_DEFAULT;
+    app.settings.fft_overlap = FFT_WORKER_OVERLAP_DEFAULT;
+    app.settings.fft_averages = FFT_WORKER_AVERAGES_DEFAULT;
+    app.settings.replay_speed = 1.0f;
+    app.settings.preview_decimation = PREVIEW_DEFAULT_DECIMATION;
+    app.settings.pre_roll = RECORD_TRIGGER_DEFAULT_PRE_ROLL;
+    app.settings.post_roll = RECORD_TRIGGER_DEFAULT_POST_ROLL;
+    overload_policy_default(&app.settings.overload);
+
+    // Command line options
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--hugepages") == 0 || strcmp(argv[i], "--hugepages=2M") == 0) {
+            app.settings.huge_page_size = RB_HUGE_2M;
+        } else if (strcmp(argv[i], "--hugepages=1G") == 0) {
+            app.settings.huge_page_size = RB_HUGE_1G;
+        } else if (strcmp(argv[i], "--async-io") == 0) {
+            app.settings.async_io = true;
+        } else if (strcmp(argv[i], "--packed-12bit") == 0) {
+            app.settings.packed_12bit = true;
+        } else if (strcmp(argv[i], "--delta") == 0) {
+            app.settings.delta_coding = true;
+        } else if (strcmp(argv[i], "--index") == 0) {
+            app.settings.write_index = true;
+        } else if (strncmp(argv[i], "--preview=", 10) == 0) {
+            snprintf(app.settings.preview_path, sizeof(app.settings.preview_path), "%s", argv[i] + 10);
+        } else if (strncmp(argv[i], "--preview-decimation=", 21) == 0) {
+            if (preview_parse_decimation(argv[i] + 21, &app.settings.preview_decimation) != 0) {
+                fprintf(stderr, "[GUI] Invalid preview decimation: %s (power of two from %u to %u)\n",
+                        argv[i] + 21, PREVIEW_MIN_DECIMATION, PREVIEW_MAX_DECIMATION);
+                app.settings.preview_decimation = PREVIEW_DEFAULT_DECIMATION;
+            }
+        } else if (strncmp(argv[i], "--trigger=", 10) == 0) {
+            app.settings.trigger_on = record_trigger_parse(argv[i] + 10, &app.settings.trigger) == 0;
+            if (!app.settings.trigger_on) {
+                fprintf(stderr, "[GUI] Invalid trigger: %s (a>LEVEL, a<LEVEL, b>LEVEL, b<LEVEL, auxN+, auxN-, auxN or manual)\n", argv[i] + 10);
+            }
+        } else if (strncmp(argv[i], "--pre-roll=", 11) == 0) {
+            if (record_trigger_parse_roll(argv[i] + 11, &app.settings.pre_roll) != 0) {
+                fprintf(stderr, "[GUI] Invalid pre-roll: %s (0 to %.0f seconds)\n", argv[i] + 11, RECORD_TRIGGER_MAX_ROLL);
+            }
+        } else if (strncmp(argv[i], "--post-roll=", 12) == 0) {
+            if (record_trigger_parse_roll(argv[i] + 12, &app.settings.post_roll) != 0) {
+                fprintf(stderr, "[GUI] Invalid post-roll: %s (0 to %.0f seconds)\n", argv[i] + 12, RECORD_TRIGGER_MAX_ROLL);
+            }
+        } else if (strcmp(argv[i], "--preflight") == 0) {
+            app.settings.preflight = true;
+        } else if (strncmp(argv[i], "--decimate=", 11) == 0) {
+            app.settings.decimation = (unsigned)atoi(argv[i] + 11);
+            if (!decimator_factor_valid(app.settings.decimation)) {
+                fprintf(stderr, "[GUI] Invalid decimation factor: %s (2, 4 or 8)\n", argv[i] + 11);
+                app.settings.decimation = 0;
+            }
+        } else if (strncmp(argv[i], "--fft-size=", 11) == 0) {
+            app.settings.fft_size = atoi(argv[i] + 11);
+        } else if (strncmp(argv[i], "--fft-overlap=", 14) == 0) {
+            app.settings.fft_overlap = (float)atoi(argv[i] + 14) / 100.0f;
+        } else if (strncmp(argv[i], "--fft-averages=", 15) == 0) {
+            app.settings.fft_averages = atoi(argv[i] + 15);
+        } else if (strcmp(argv[i], "--fft-patient") == 0) {
+            app.settings.fft_patient = true;
+        } else if (strncmp(argv[i], "--flac-level=", 13) == 0) {
+            flac_writer_config_t levels = flac_writer_default_config();
+            if (flac_writer_parse_level(argv[i] + 13, &levels) != 0) {
+                fprintf(stderr, "[GUI] Invalid FLAC level: %s (0-8, auto or MIN-MAX)\n", argv[i] + 13);
+            } else {
+                app.settings.flac_level = levels.compression_level;
+                app.settings.flac_level_max = levels.adaptive_level ? levels.compression_level_max
+                                                                    : levels.compression_level;
+            }
+        } else if (strncmp(argv[i], "--affinity=", 11) == 0) {
+            if (thread_role_parse_affinity(argv[i] + 11) != 0) {
+                fprintf(stderr, "[GUI] Invalid affinity: %s (role:cpus, roles: " THREAD_ROLE_NAMES ")\n", argv[i] + 11);
+            }
+        } else if (strcmp(argv[i], "--realtime") == 0) {
+            thread_role_set_realtime(true);
+        } else if (strncmp(argv[i], "--numa-node=", 12) == 0) {
+            if (thread_role_set_numa_node(atoi(argv[i] + 12)) != 0) {
+                fprintf(stderr, "[GUI] Invalid NUMA node: %s (no such node with CPUs)\n", argv[i] + 12);
+            } else {
+                rb_set_numa_node(atoi(argv[i] + 12));
+            }
+        } else if (strcmp(argv[i], "--perf-hud") == 0) {
+            gui_perf_set_enabled(true);
+        } else if (strncmp(argv[i], "--sim-speed=", 12) == 0) {
+            if (gui_simulated_parse_speed(argv[i] + 12, &app.settings.sim_speed) != 0) {
+                fprintf(stderr, "[GUI] Invalid simulation speed: %s (N x real time up to %.0f, or max)\n",
+                        argv[i] + 12, SIM_SPEED_LIMIT);
+            }
+        } else if (strncmp(argv[i], "--replay=", 9) == 0) {
+            snprintf(app.settings.replay_path, sizeof(app.settings.replay_path), "%s", argv[i] + 9);
+        } else if (strncmp(argv[i], "--replay-speed=", 15) == 0) {
+            if (gui_simulated_parse_speed(argv[i] + 15, &app.settings.replay_speed) != 0) {
+                fprintf(stderr, "[GUI] Invalid replay speed: %s (N x real time up to %.0f, or max)\n",
+                        argv[i] + 15, SIM_SPEED_LIMIT);
+            }
+        } else if (strcmp(argv[i], "--replay-loop") == 0) {
+            app.settings.replay_loop = true;
+        } else if (strcmp(argv[i], "--direct-io") == 0) {
+            app.settings.async_io = true;
+            app.settings.direct_io = true;
+        } else if (strncmp(argv[i], "--segment-size=", 15) == 0) {
+            if (file_segment_parse_size(argv[i] + 15, &app.settings.segment_bytes) != 0) {
+                fprintf(stderr, "[GUI] Invalid segment size: %s\n", argv[i] + 15);
+            }
+        } else if (strncmp(argv[i], "--buffer-time=", 14) == 0) {
+            app.settings.buffers.seconds = atof(argv[i] + 14);
+            if (app.settings.buffers.seconds <= 0.0 || app.settings.buffers.seconds > BUFFER_SIZING_MAX_SECONDS) {
+                fprintf(stderr, "[GUI] Invalid buffer time: %s (up to %.0f seconds)\n", argv[i] + 14, BUFFER_SIZING_MAX_SECONDS);
+                app.settings.buffers.seconds = 0.0;
+            }
+        } else if (strncmp(argv[i], "--buffer-memory=", 16) == 0) {
+            if (file_segment_parse_size(argv[i] + 16, &app.settings.buffers.budget) != 0) {
+                fprintf(stderr, "[GUI] Invalid buffer memory: %s\n", argv[i] + 16);
+                app.settings.buffers.budget = 0;
+            }
+        } else if (strcmp(argv[i], "--parser-thread") == 0) {
+            app.settings.parser_depth = FRAME_QUEUE_DEFAULT_DEPTH;
+        } else if (strncmp(argv[i], "--parser-thread=", 16) == 0) {
+            int depth = atoi(argv[i] + 16);
+            if (!frame_queue_depth_valid((unsigned)depth)) {
+                fprintf(stderr, "[GUI] Invalid frame queue depth: %s (power of two, 2 to %d frames)\n", argv[i] + 16, FRAME_QUEUE_MAX_DEPTH);
+            } else {
+                app.settings.parser_depth = (unsigned)depth;
+            }
+        } else if (strcmp(argv[i], "--low-memory") == 0) {
+            app.settings.buffers.low_memory = true;
+        } else if (strncmp(argv[i], "--overload=", 11) == 0) {
+            if (overload_policy_parse(argv[i] + 11, &app.settings.overload) != 0) {
+                fprintf(stderr, "[GUI] Invalid overload policy: %s (display or flac=PERCENT or off, rf-wait=MS)\n", argv[i] + 11);
+            }
+        } else if (strncmp(argv[i], "--segment-time=", 15) == 0) {
+            if (file_segment_parse_time(argv[i] + 15, &app.settings.segment_seconds) != 0) {
+                fprintf(stderr, "[GUI] Invalid segment time: %s\n", argv[i] + 15);
+            }
+        } else {
+            fprintf(stderr, "[GUI] Ignoring unknown option: %s (usage: %s [--hugepages[=2M|1G]] [--async-io] [--direct-io]"
+                    " [--segment-size=SIZE] [--segment-time=TIME] [--packed-12bit] [--delta] [--index] [--preview=DEST] [--preview-decimation=N] [--trigger=CONDITION] [--pre-roll=SECONDS] [--post-roll=SECONDS] [--preflight] [--decimate=2|4|8]"
+                    " [--fft-size=N] [--fft-overlap=PERCENT] [--fft-averages=N] [--fft-patient] [--flac-level=N|auto|MIN-MAX] [--affinity=ROLE:CPUS] [--realtime] [--numa-node=N] [--perf-hud]"
+                    " [--sim-speed=N|max] [--replay=FILE] [--replay-speed=N|max] [--replay-loop] [--overload=POLICY]"
+                    " [--buffer-time=SECONDS] [--buffer-memory=SIZE] [--low-memory] [--parser-thread[=DEPTH]])\n",
+                    argv[i], argv[0]);
+        }
+    }
+    // Every event is a segment of its own
+    if (app.settings.trigger_on && (app.settings.segment_bytes != 0 || app.settings.segment_seconds != 0)) {
+        fprintf(stderr, "[GUI] --trigger writes a segment per event, ignoring --segment-size and --segment-time\n");
+        app.settings.segment_bytes = app.settings.segment_seconds = 0;
+    }
+
+    thread_role_report_topology();
+
+    // The render thread starts all others, they apply their own roles
+    thread_role_apply(THREAD_ROLE_RENDER);
 
     // Initialize raylib window
     SetConfigFlags(FLAG_WINDOW_RESIZABLE | FLAG_MSAA_4X_HINT | FLAG_VSYNC_HINT);
@@ -72,7 +287,8 @@ int main(int argc, char **argv) {
 
     // Load embedded Inter font directly from memory (Apache 2.0 licensed)
     // Font data is ~342KB and embedded as a C array for complete portability
-    fonts[0] = LoadFontFromMemory(".ttf", inter_font_data, inter_font_data_size, 32, NULL, 256);
+    // The rasterized atlas is cached, only the first launch pays for it
+    fonts[0] = gui_font_cache_load("inter", inter_font_data, inter_font_data_size, 32, 256);
     if (fonts[0].texture.id == 0) {
         fprintf(stderr, "Error: Failed to load embedded Inter font data\n");
         CloseWindow();
@@ -82,7 +298,7 @@ int main(int argc, char **argv) {
 
     // Load embedded Space Mono font directly from memory (SIL Open Font License)
     // Font data is embedded as a C array for complete portability
-    fonts[1] = LoadFontFromMemory(".ttf", space_mono_font_data, space_mono_font_data_size, 32, NULL, 256);
+    fonts[1] = gui_font_cache_load("space_mono", space_mono_font_data, space_mono_font_data_size, 32, 256);
     if (fonts[1].texture.id == 0) {
         fprintf(stderr, "Error: Failed to load embedded Space Mono font data\n");
         CloseWindow();
@@ -110,30 +326,47 @@ int main(int argc, char **argv) {
     // Set app for text rendering font access
     gui_text_set_app(&app);
 
-    // Enumerate available devices
-    gui_app_enumerate_devices(&app);
+    // Enumerate available devices in the background, USB probing can take a while
+    gui_app_enumerate_devices_async(&app);
+    bool startup_enumeration = true;
+
+    // Devices coming and going update the list and reconnect right away,
+    // without hotplug events reconnects poll
+    app.hotplug = hotplug_start("[GUI] ");
 
     // Enable auto-reconnect by default
     app.auto_reconnect_enabled = true;
 
-    // Autoconnect if a device is found
-    if (app.device_count > 0) {
-        gui_app_set_status(&app, "Connecting...");
-        if (gui_app_start_capture(&app) == 0) {
-            gui_app_set_status(&app, "Connected");
-        } else {
-            gui_app_set_status(&app, "Failed to connect. Click Connect to retry.");
-            app.reconnect_pending = true;
-            app.reconnect_attempt_time = GetTime();
-        }
-    } else {
-        gui_app_set_status(&app, "No devices found. Connect a device and restart.");
-    }
-
     // Main loop
     while (!WindowShouldClose() && !atomic_load(&do_exit)) {
         float dt = GetFrameTime();
 
+        // Devices were plugged in or removed, enumerate again in the background
+        if (hotplug_poll(app.hotplug)) {
+            gui_app_enumerate_devices_async(&app);
+        }
+
+        if (gui_app_enumeration_poll(&app)) {
+            if (startup_enumeration) {
+                // Autoconnect once the startup enumeration found a device
+                startup_enumeration = false;
+                if (app.device_count > 0) {
+                    gui_app_set_status(&app, "Connecting...");
+                    if (gui_app_start_capture(&app) == 0) {
+                        gui_app_set_status(&app, "Connected");
+                    } else {
+                        gui_app_set_status(&app, "Failed to connect. Click Connect to retry.");
+                        app.reconnect_pending = true;
+                        app.reconnect_attempt_time = GetTime();
+                    }
+                } else {
+                    gui_app_set_status(&app, "No devices found. Connect a device and restart.");
+                }
+            } else {
+                device_list_changed(&app);
+            }
+        }
+
         // Handle window resize
         if (IsWindowResized()) {
             Clay_SetLayoutDimensions((Clay_Dimensions){
@@ -171,6 +404,11 @@ int main(int argc, char **argv) {
                 }
             }
 
+            // F3 toggles the performance overlay
+            if (IsKeyPressed(KEY_F3)) {
+                gui_perf_set_enabled(!gui_perf_enabled());
+            }
+
             if (IsKeyPressed(KEY_R) && app.is_capturing && !app.settings_panel_open) {
                 if (app.is_recording) {
                     gui_app_stop_recording(&app);
@@ -197,38 +435,23 @@ int main(int argc, char **argv) {
             if (app.is_capturing && gui_capture_device_timeout(&app, 2000)) {
                 // Device was disconnected unexpectedly - clean up properly
                 fprintf(stderr, "[GUI] Device timeout detected, disconnecting...\n");
-                gui_app_stop_capture(&app);
-                gui_app_clear_display(&app);
-                app.reconnect_pending = true;
-                app.reconnect_attempt_time = now;
-                app.reconnect_attempts = 0;
-                gui_app_set_status(&app, "Connection lost. Reconnecting...");
+                connection_lost(&app, "Connection lost. Reconnecting...");
             }
 
             // Attempt reconnection if pending
             if (app.reconnect_pending && !app.is_capturing) {
-                double retry_delay = (app.reconnect_attempts < 3) ? 1.0 : 3.0;  // 1s for first 3, then 3s
+                // With hotplug events the device coming back triggers the attempt,
+                // the timer is only a fallback and enumerates in the background
+                double retry_delay = app.hotplug ? RECONNECT_FALLBACK_S :
+                                     (app.reconnect_attempts < 3) ? 1.0 : 3.0;  // 1s for first 3, then 3s
                 if (now - app.reconnect_attempt_time >= retry_delay) {
                     app.reconnect_attempt_time = now;
-                    app.reconnect_attempts++;
-
-                    // Re-enumerate devices in case device was reconnected
-                    gui_app_enumerate_devices(&app);
-
-                    if (app.device_count > 0) {
-                        char status_buf[128];
-                        snprintf(status_buf, sizeof(status_buf), "Reconnecting (attempt %d)...", app.reconnect_attempts);
-                        gui_app_set_status(&app, status_buf);
-
-                        if (gui_app_start_capture(&app) == 0) {
-                            app.reconnect_pending = false;
-                            app.reconnect_attempts = 0;
-                            gui_app_set_status(&app, "Reconnected");
-                        }
+                    if (app.hotplug) {
+                        gui_app_enumerate_devices_async(&app);
                     } else {
-                        char status_buf[128];
-                        snprintf(status_buf, sizeof(status_buf), "No device found (attempt %d)", app.reconnect_attempts);
-                        gui_app_set_status(&app, status_buf);
+                        // Re-enumerate devices in case device was reconnected
+                        gui_app_enumerate_devices(&app);
+                        reconnect_attempt(&app);
                     }
                 }
             }
@@ -241,6 +464,7 @@ int main(int argc, char **argv) {
         gui_app_update_display_buffer(&app);
 
         // Build UI layout
+        uint64_t t_render = gui_perf_begin();
         Clay_BeginLayout();
         gui_render_layout(&app);
         Clay_RenderCommandArray render_commands = Clay_EndLayout();
@@ -263,6 +487,11 @@ int main(int argc, char **argv) {
         DrawFPS(10, 10);
         #endif
 
+        // Performance overlay (not part of the timed render)
+        gui_perf_end(PERF_STAGE_RENDER, t_render);
+        gui_perf_update(&app);
+        gui_perf_draw(&app);
+
         EndDrawing();
     }
 
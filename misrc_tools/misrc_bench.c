@@ -0,0 +1,868 @@
+/*
+* MISRC bench
+* Copyright (C) 2024-2025  vrunk11, stefan_o
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// end-to-end throughput of the capture chain on this machine: synthetic hsdaoh frames go
+// through the frame parser, the extraction kernels, the resampler and the writers of
+// misrc_capture at rising sample rates until one of the stages cannot keep up
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+#define _FILE_OFFSET_BITS 64
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "../misrc_common/buffer.h"
+#include "../misrc_common/threading.h"
+
+#ifndef _WIN32
+	#include <getopt.h>
+#else
+	#include <windows.h>
+	#if defined(__MINGW32__)
+		#include <getopt.h>
+	#else
+		#include "getopt/getopt.h"
+	#endif
+#endif
+
+#include <hsdaoh.h>
+#include <hsdaoh_raw.h>
+
+#include "version.h"
+#include "../misrc_common/ringbuffer.h"
+#include "../misrc_common/ringbuffer_writer.h"
+#include "../misrc_common/flac_writer.h"
+#include "../misrc_common/frame_parser.h"
+#include "../misrc_common/capture_handler.h"
+#include "../misrc_common/crc16.h"
+#include "../misrc_common/extract.h"
+#include "../misrc_common/decimate.h"
+#include "../misrc_common/resample_stage.h"
+
+// the sizes misrc_capture uses, so every stage sees the same blocks and backlogs
+#define BUFFER_AUDIO_TOTAL_SIZE 65536*256
+#define BUFFER_AUDIO_READ_SIZE 65536*3
+#define BUFFER_TOTAL_SIZE 65536*1024
+#define BUFFER_READ_SIZE 65536*32
+#define RESAMPLE_WRITE_SIZE (1024*1024)
+#define RB_WAIT_MS 100
+
+// frames like the MISRC sends them, with a stream id and the CRC of the line before in every line
+#define FRAME_WIDTH   1920
+#define FRAME_HEIGHT  1080
+#define FRAME_BYTES   (FRAME_WIDTH*FRAME_HEIGHT*2)
+#define LINE_PAYLOAD  (FRAME_WIDTH-3)
+// distinct frames the generator cycles through
+#define POOL_FRAMES   4
+// 78125 Hz of 4 channels with 24 bit, whatever the RF rate
+#define RATE_AUDIO_BYTES 937500
+
+// a step is sustained above this share of the target rate with no ringbuffer peaking above this fill
+#define SUSTAINED_RATE 0.97
+#define SUSTAINED_FILL 75
+
+#define OPT_FLAC_12BIT 256
+#define OPT_AUDIO      257
+#define OPT_RESAMPLE   258
+#define OPT_DECIMATE   259
+
+#if defined(__GNUC__)
+# define UNUSED(x) x __attribute__((unused))
+#else
+# define UNUSED(x) x
+#endif
+
+// stages with a thread of their own, the CPU of the rest of the process goes to other
+enum {
+	STAGE_GEN,      // frame generator, stands in for the device and the USB transfers
+	STAGE_PARSE,    // frame parser, what the capture callback does
+	STAGE_EXTRACT,
+	STAGE_OUT_A,
+	STAGE_OUT_B,
+	STAGE_AUDIO,
+	STAGE_OTHER,    // FLAC encoder and resampler threads
+	STAGE_COUNT
+};
+
+static char stage_names[STAGE_COUNT][16] = { "generator", "parser", "extract", "write A", "write B", "audio", "other" };
+
+typedef struct {
+	bool out[2];             // RF channels written
+	bool aux;
+	bool audio;
+	bool flac;
+	flac_writer_config_t flac_cfg;
+	double resample_rate;    // kHz, 0 = off
+	unsigned decimation;     // 2, 4 or 8, 0 = off
+	const char *dir;         // NULL for the null device
+	double rate_start;       // MSPS
+	double rate_step;
+	double rate_max;
+	unsigned seconds;        // per step
+} bench_opts_t;
+
+// a writer with its ringbuffer: RF channel A, B or the audio
+typedef struct {
+	ringbuffer_t rb;
+	bool used;
+	FILE *f;
+	int stage;
+	resample_stage_t *resample;   // between rb and the writer, NULL if not resampling
+	flac_writer_config_t flac;
+	uint64_t cpu_start;
+	uint64_t cpu_ns;              // thread CPU when the step ended, 0 before
+} bench_out_t;
+
+typedef struct {
+	const bench_opts_t *o;
+	double rate;                  // target samples per second of each channel
+	uint16_t *pool;               // POOL_FRAMES frames, metadata and CRC are stamped per frame sent
+	uint64_t pool_samples[POOL_FRAMES];  // RF samples in each of them
+	ringbuffer_t rb_frames;       // generator to parser, what the USB transfers fill
+	ringbuffer_t rb_cap;
+	bench_out_t out[3];           // A, B and audio
+	capture_handler_ctx_t handler;
+	FILE *aux;
+	uint64_t t_start;
+	uint64_t t_first, t_last;     // commits of the first and the last frame after sync
+	uint64_t first_bytes;         // RF bytes of the first
+	uint64_t committed;           // RF bytes the parser committed
+	uint64_t frame_errors;
+	uint64_t cpu_ns[STAGE_COUNT];
+} bench_step_t;
+
+typedef struct {
+	double achieved;              // samples per second of each channel
+	const char *bottleneck;       // NULL if the rate was sustained
+	char fill[160];               // ringbuffer peaks
+	double cpu[STAGE_COUNT];      // percent of one core
+} bench_result_t;
+
+static atomic_bool step_stop;
+static atomic_bool do_exit;
+static conv_function_t conv_function = NULL;
+
+static struct option getopt_long_options[] =
+{
+  {"adc-a",        no_argument,       0, 'a'},
+  {"adc-b",        no_argument,       0, 'b'},
+  {"aux",          no_argument,       0, 'x'},
+  {"audio",        no_argument,       0, OPT_AUDIO},
+  {"flac",         no_argument,       0, 'f'},
+  {"flac-level",   required_argument, 0, 'l'},
+  {"flac-threads", required_argument, 0, 'c'},
+  {"flac-12bit",   no_argument,       0, OPT_FLAC_12BIT},
+  {"resample",     required_argument, 0, OPT_RESAMPLE},
+  {"decimate",     required_argument, 0, OPT_DECIMATE},
+  {"output-dir",   required_argument, 0, 'o'},
+  {"rate",         required_argument, 0, 'r'},
+  {"step",         required_argument, 0, 's'},
+  {"max-rate",     required_argument, 0, 'm'},
+  {"time",         required_argument, 0, 't'},
+  {"help",         no_argument,       0, 'h'},
+  {0, 0, 0, 0}
+};
+
+void usage(void)
+{
+	fprintf(stderr,
+		"Runs synthetic frames through the capture chain of misrc_capture at rising sample rates,\n"
+		"reports the highest rate this machine sustains, the stage that limits it and the CPU per stage\n\n"
+		"Usage:\n"
+		"\t[-a write ADC A (default: A and B unless one is given)]\n"
+		"\t[-b write ADC B]\n"
+		"\t[-x write the AUX output]\n"
+		"\t[--audio write the 4 channel audio]\n"
+#if LIBFLAC_ENABLED == 1
+		"\t[-f compress the RF outputs as FLAC]\n"
+		"\t[-l FLAC compression level (0-8, default: 1), auto or MIN-MAX]\n"
+		"\t[-c FLAC encoding threads per output (default: auto)]\n"
+		"\t[--flac-12bit set the FLAC sample width to 12 instead of 16 bit]\n"
+#endif
+#if LIBSOXR_ENABLED == 1
+		"\t[--resample resample the RF outputs to this rate (in kHz)]\n"
+#endif
+		"\t[--decimate decimate the RF outputs by 2, 4 or 8]\n"
+		"\t[-o directory to write to (default: the null device, only the CPU counts then)]\n"
+		"\t[-r sample rate to start at (MSPS, default: 40)]\n"
+		"\t[-s rate increase per step (MSPS, default: 20)]\n"
+		"\t[-m highest rate to try (MSPS, default: 400)]\n"
+		"\t[-t seconds per step (default: 5)]\n"
+	);
+	exit(1);
+}
+
+static void sighandler(int UNUSED(signum))
+{
+	fprintf(stderr, "Signal caught, exiting!\n");
+	atomic_store(&do_exit, true);
+	atomic_store(&step_stop, true);
+}
+
+/*-----------------------------------------------------------------------------
+ * Synthetic frames
+ *-----------------------------------------------------------------------------*/
+
+static uint32_t xorshift32(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+// ADC A and B packed like the MISRC does, a carrier near the VHS luma band with some noise,
+// so FLAC has to work for its ratio
+static uint32_t capture_word(uint64_t n, uint32_t *rng)
+{
+	uint32_t r = xorshift32(rng);
+	double carrier = sin((double)n * 0.6);
+	int a = (int)(1200.0 * carrier) + (int)(r & 0x7f) - 64;
+	int b = (int)(900.0 * carrier) + (int)((r >> 8) & 0x7f) - 64;
+	return (uint32_t)(2047 - a) | ((uint32_t)(2047 - b) << 20);
+}
+
+// payloads, stream ids and lengths of the pool, audio lines are spread in at the share
+// the audio has at this rate. Every line is full, there are no idle counters to keep going.
+static int build_pool(bench_step_t *s)
+{
+	const size_t frame_words = (size_t)FRAME_WIDTH * FRAME_HEIGHT;
+	const double audio_share = RATE_AUDIO_BYTES / (s->rate * 4.0);
+	double audio_due = 0.0;
+	uint32_t rng = 0x2545f491;
+	uint32_t word = 0;
+	uint64_t n = 0;
+	bool high = false;
+
+	s->pool = aligned_alloc(ALIGN_PAGE, frame_words * POOL_FRAMES * sizeof(uint16_t));
+	if (!s->pool) return -1;
+	for (int f = 0; f < POOL_FRAMES; f++) {
+		uint64_t rf_words = 0;
+		for (size_t line = 0; line < FRAME_HEIGHT; line++) {
+			uint16_t *words = s->pool + f * frame_words + line * FRAME_WIDTH;
+			bool audio = audio_due >= LINE_PAYLOAD;
+			for (size_t i = 0; i < LINE_PAYLOAD; i++) {
+				if (audio) {
+					words[i] = (uint16_t)xorshift32(&rng);
+					continue;
+				}
+				// capture words run on over the line ends
+				if (!high) word = capture_word(n++, &rng);
+				words[i] = high ? (uint16_t)(word >> 16) : (uint16_t)word;
+				high = !high;
+			}
+			if (audio) {
+				audio_due -= LINE_PAYLOAD;
+			} else {
+				audio_due += LINE_PAYLOAD * audio_share;
+				rf_words += LINE_PAYLOAD;
+			}
+			words[FRAME_WIDTH - 3] = audio ? 1 : 0;
+			words[FRAME_WIDTH - 2] = 0;
+			words[FRAME_WIDTH - 1] = LINE_PAYLOAD;
+		}
+		s->pool_samples[f] = rf_words / 2;
+	}
+	return 0;
+}
+
+// metadata nibbles into the length words, then the CRC chain, which runs on from the frame before
+static void stamp_frame(uint16_t *frame, const metadata_t *meta, uint16_t *crc)
+{
+	const uint8_t *meta_bytes = (const uint8_t *)meta;
+	for (size_t line = 0; line < FRAME_HEIGHT; line++) {
+		uint16_t *words = frame + line * FRAME_WIDTH;
+		if (line < 2 * sizeof(*meta)) {
+			uint16_t nibble = (line & 1) ? (meta_bytes[line / 2] >> 4) : (meta_bytes[line / 2] & 0x0F);
+			words[FRAME_WIDTH - 1] = (uint16_t)((nibble << 12) | LINE_PAYLOAD);
+		}
+		words[FRAME_WIDTH - 2] = *crc;
+		*crc = crc16_ccitt_fast((const uint8_t *)words, FRAME_WIDTH * sizeof(uint16_t));
+	}
+}
+
+/*-----------------------------------------------------------------------------
+ * Stage threads
+ *-----------------------------------------------------------------------------*/
+
+// the device sends at the sample rate, a parser falling behind fills the frame ringbuffer
+// and the waits for it show up as a lower rate
+static int generator_thread(void *ctx)
+{
+	bench_step_t *s = ctx;
+	uint64_t cpu_start = get_thread_cpu_ns();
+	uint64_t sent = 0;
+	uint16_t crc = 0xffff;
+	metadata_t meta;
+
+	memset(&meta, 0, sizeof(meta));
+	meta.magic = HSDAOH_MAGIC;
+	meta.crc_config = CRC16_1_LINE;
+	meta.flags = FLAG_STREAM_ID_PRESENT;
+	meta.stream_info[0].srate = (uint32_t)s->rate;
+
+	for (uint64_t n = 0; !atomic_load(&step_stop); n++) {
+		const unsigned k = n % POOL_FRAMES;
+		uint64_t due = s->t_start + (uint64_t)((double)sent * 1e9 / s->rate);
+		uint64_t now = get_time_ns();
+		uint16_t *frame;
+		if (due > now + 1000000) thrd_sleep_ms((int)((due - now) / 1000000));
+		while ((frame = rb_write_ptr_wait(&s->rb_frames, FRAME_BYTES, RB_WAIT_MS)) == NULL) {
+			if (atomic_load(&step_stop)) goto done;
+		}
+		memcpy(frame, s->pool + k * (size_t)FRAME_WIDTH * FRAME_HEIGHT, FRAME_BYTES);
+		meta.framecounter = (uint16_t)(n + 1);
+		stamp_frame(frame, &meta, &crc);
+		rb_write_finished(&s->rb_frames, FRAME_BYTES);
+		sent += s->pool_samples[k];
+	}
+done:
+	s->cpu_ns[STAGE_GEN] = get_thread_cpu_ns() - cpu_start;
+	return 0;
+}
+
+// what the capture callback of misrc_capture does with a frame
+static void parse_frame(bench_step_t *s, uint8_t *buf)
+{
+	capture_handler_ctx_t *handler = &s->handler;
+	uint8_t *buf_out = NULL;
+	uint8_t *buf_out_audio = NULL;
+	metadata_t meta;
+
+	hsdaoh_extract_metadata(buf, &meta, FRAME_WIDTH);
+	bool was_synced = handler->frame_state.sync.stream_synced;
+	if (was_synced) {
+		while ((buf_out = rb_write_ptr_wait(handler->rb_rf, FRAME_BYTES, RB_WAIT_MS)) == NULL) {
+			if (atomic_load(&step_stop)) return;
+		}
+		if (handler->capture_audio) {
+			while ((buf_out_audio = rb_write_ptr_wait(handler->rb_audio, FRAME_BYTES, RB_WAIT_MS)) == NULL) {
+				if (atomic_load(&step_stop)) return;
+			}
+		}
+	}
+
+	frame_process_result_t result = frame_process_and_copy(&handler->frame_state, buf,
+	                                                       FRAME_WIDTH, FRAME_HEIGHT, &meta, 4,
+	                                                       buf_out, buf_out_audio,
+	                                                       capture_handler_audio_filter, handler);
+	if (!capture_handler_process_sync_event(handler, result.sync_result, &meta, was_synced))
+		return;
+	if (result.error_count > 0 && result.report_errors) {
+		s->frame_errors++;
+		return;
+	}
+	if (!result.valid)
+		return;
+	if (buf_out) {
+		rb_write_finished(handler->rb_rf, result.stream0_copied);
+		s->t_last = get_time_ns();
+		if (s->committed == 0) {
+			s->t_first = s->t_last;
+			s->first_bytes = result.stream0_copied;
+		}
+		s->committed += result.stream0_copied;
+	}
+	if (buf_out_audio)
+		rb_write_finished(handler->rb_audio, result.stream1_copied);
+}
+
+static int parser_thread(void *ctx)
+{
+	bench_step_t *s = ctx;
+	uint64_t cpu_start = get_thread_cpu_ns();
+	while (!atomic_load(&step_stop)) {
+		uint8_t *buf = rb_read_ptr_wait(&s->rb_frames, FRAME_BYTES, RB_WAIT_MS);
+		if (!buf) continue;
+		parse_frame(s, buf);
+		rb_read_finished(&s->rb_frames, FRAME_BYTES);
+	}
+	s->cpu_ns[STAGE_PARSE] = get_thread_cpu_ns() - cpu_start;
+	return 0;
+}
+
+// the extraction loop of misrc_capture, without the level meter and progress output
+static int extract_thread(void *ctx)
+{
+	bench_step_t *s = ctx;
+	uint64_t cpu_start = get_thread_cpu_ns();
+	uint8_t *buf_aux = aligned_alloc(16, BUFFER_READ_SIZE);
+	size_t clip[2] = {0, 0};
+	uint16_t peak_level[2] = {0, 0};
+
+	if (!buf_aux) {
+		fprintf(stderr, "ERROR: failed allocating the AUX buffer\n");
+		atomic_store(&do_exit, true);
+		return 0;
+	}
+	while (!atomic_load(&step_stop)) {
+		void *buf, *buf_out1 = NULL, *buf_out2 = NULL;
+		if ((buf = rb_read_ptr_wait(&s->rb_cap, BUFFER_READ_SIZE*4, RB_WAIT_MS)) == NULL) continue;
+		while (s->out[0].used && !atomic_load(&step_stop) &&
+		       (buf_out1 = rb_write_ptr_wait(&s->out[0].rb, BUFFER_READ_SIZE*2, RB_WAIT_MS)) == NULL) {}
+		while (s->out[1].used && !atomic_load(&step_stop) &&
+		       (buf_out2 = rb_write_ptr_wait(&s->out[1].rb, BUFFER_READ_SIZE*2, RB_WAIT_MS)) == NULL) {}
+		if (atomic_load(&step_stop)) break;
+		conv_function((uint32_t*)buf, BUFFER_READ_SIZE, clip, buf_aux, buf_out1, buf_out2, peak_level);
+		rb_read_finished(&s->rb_cap, BUFFER_READ_SIZE*4);
+		if (s->aux) fwrite(buf_aux, 1, BUFFER_READ_SIZE, s->aux);
+		if (s->out[0].used) rb_write_finished(&s->out[0].rb, BUFFER_READ_SIZE*2);
+		if (s->out[1].used) rb_write_finished(&s->out[1].rb, BUFFER_READ_SIZE*2);
+	}
+	s->cpu_ns[STAGE_EXTRACT] = get_thread_cpu_ns() - cpu_start;
+	aligned_free(buf_aux);
+	return 0;
+}
+
+// the writer CPU counts up to the end of the step, not the draining after it
+static void out_stopped(bench_out_t *w)
+{
+	if (w->cpu_ns == 0) w->cpu_ns = get_thread_cpu_ns() - w->cpu_start;
+}
+
+static bool out_should_exit(void *ctx)
+{
+	bench_out_t *w = ctx;
+	if (!atomic_load(&step_stop)) return false;
+	out_stopped(w);
+	return true;
+}
+
+static bool step_should_stop(void *UNUSED(ctx))
+{
+	return atomic_load(&step_stop);
+}
+
+static int raw_writer_thread(void *ctx)
+{
+	bench_out_t *w = ctx;
+	rb_writer_config_t cfg;
+	w->cpu_start = get_thread_cpu_ns();
+	if (w->resample) rb_writer_config_init(&cfg, resample_stage_output(w->resample), w->f, RESAMPLE_WRITE_SIZE);
+	else rb_writer_config_init(&cfg, &w->rb, w->f, w->stage == STAGE_AUDIO ? BUFFER_AUDIO_READ_SIZE : BUFFER_READ_SIZE);
+	cfg.should_exit_cb = out_should_exit;
+	cfg.user_ctx = w;
+	rb_writer_run(&cfg);
+	out_stopped(w);
+	return 0;
+}
+
+#if LIBFLAC_ENABLED == 1
+// the FLAC loop of misrc_capture, the backlog left at the end of the step is not encoded
+static int flac_writer_thread(void *ctx)
+{
+	bench_out_t *w = ctx;
+	ringbuffer_t *rb = w->resample ? resample_stage_output(w->resample) : &w->rb;
+	size_t len = BUFFER_READ_SIZE;
+	w->cpu_start = get_thread_cpu_ns();
+
+	flac_writer_t *writer = flac_writer_create_file(w->f, &w->flac);
+	if (!writer) {
+		fprintf(stderr, "ERROR: failed to create FLAC writer\n");
+		atomic_store(&do_exit, true);
+		atomic_store(&step_stop, true);
+		return 0;
+	}
+	while (!atomic_load(&step_stop)) {
+		void *buf = rb_read_ptr_wait(rb, len, RB_WAIT_MS);
+		if (!buf) continue;
+		if (flac_writer_process_int16(writer, (const int16_t*)buf, len>>1) < 0) {
+			fprintf(stderr, "ERROR: FLAC encoder could not process data\n");
+		}
+		rb_read_finished(rb, len);
+	}
+	out_stopped(w);
+	if (flac_writer_finish(writer) != FLAC_WRITER_OK) {
+		fprintf(stderr, "ERROR: FLAC encoder did not finish correctly\n");
+	}
+	return 0;
+}
+#endif
+
+/*-----------------------------------------------------------------------------
+ * One step of the sweep
+ *-----------------------------------------------------------------------------*/
+
+static FILE *open_bench_output(const bench_opts_t *o, const char *name)
+{
+#ifdef _WIN32
+	const char *null_device = "NUL";
+#else
+	const char *null_device = "/dev/null";
+#endif
+	char path[4096];
+	FILE *f;
+	if (o->dir) snprintf(path, sizeof(path), "%s/%s", o->dir, name);
+	else snprintf(path, sizeof(path), "%s", null_device);
+	if ((f = fopen(path, "wb")) == NULL) fprintf(stderr, "Failed to open %s\n", path);
+	return f;
+}
+
+static unsigned peak_percent(const rb_stats_t *st)
+{
+	return st->size ? (unsigned)(st->high_water * 100 / st->size) : 0;
+}
+
+// the peak fill of a ringbuffer, the most downstream full one names the bottleneck
+static void check_fill(bench_result_t *res, const char *name, const rb_stats_t *st, const char *consumer)
+{
+	size_t len = strlen(res->fill);
+	unsigned peak = peak_percent(st);
+	snprintf(res->fill + len, sizeof(res->fill) - len, "%s%s %u%%", len ? " " : "", name, peak);
+	if (res->bottleneck == NULL && peak >= SUSTAINED_FILL) res->bottleneck = consumer;
+}
+
+static int run_step(const bench_opts_t *o, double rate, bench_result_t *res)
+{
+	static char resample_names[2][16] = { "resample A", "resample B" };
+	static const char *file_names[2][2] = { { "bench_a.raw", "bench_a.flac" }, { "bench_b.raw", "bench_b.flac" } };
+	bench_step_t *s = calloc(1, sizeof(*s));
+	thrd_t threads[STAGE_COUNT];
+	bool started[STAGE_COUNT] = { false };
+	rb_stats_t st;
+	int r = -1;
+
+	if (!s) return -1;
+	s->o = o;
+	s->rate = rate;
+	memset(res, 0, sizeof(*res));
+	if (build_pool(s) != 0) {
+		fprintf(stderr, "ERROR: failed allocating the frames\n");
+		goto cleanup;
+	}
+	if (rb_init(&s->rb_frames, "bench_frames_rb", BUFFER_TOTAL_SIZE) != 0 ||
+	    rb_init(&s->rb_cap, "bench_capture_rb", BUFFER_TOTAL_SIZE) != 0) {
+		fprintf(stderr, "ERROR: failed to create ringbuffers\n");
+		goto cleanup;
+	}
+
+	capture_handler_init(&s->handler);
+	s->handler.rb_rf = &s->rb_cap;
+	s->handler.capture_rf = true;
+
+	for (int i = 0; i < 2; i++) {
+		bench_out_t *w = &s->out[i];
+		if (!o->out[i]) continue;
+		w->stage = STAGE_OUT_A + i;
+		if (rb_init(&w->rb, i ? "bench_b_rb" : "bench_a_rb", BUFFER_TOTAL_SIZE) != 0) {
+			fprintf(stderr, "ERROR: failed to create ringbuffers\n");
+			goto cleanup;
+		}
+		w->used = true;
+		if ((w->f = open_bench_output(o, file_names[i][o->flac])) == NULL) goto cleanup;
+		if (o->resample_rate != 0.0 || o->decimation != 0) {
+			resample_stage_config_t cfg;
+			double out_rate = o->resample_rate != 0.0 ? o->resample_rate : rate / 1000.0 / o->decimation;
+			resample_stage_config_init(&cfg, &w->rb, BUFFER_READ_SIZE, rate / 1000.0, out_rate);
+			cfg.decimation = o->decimation;
+			cfg.should_exit = step_should_stop;
+			if ((w->resample = resample_stage_start(&cfg)) == NULL) {
+				fprintf(stderr, "ERROR: failed setting up resampling\n");
+				goto cleanup;
+			}
+		}
+		if (o->flac) {
+			// FLAC takes the rate in kHz like misrc_capture writes it, 40 MSPS do not fit
+			double out_rate = o->resample_rate != 0.0 ? o->resample_rate * 1000.0
+			                : rate / (o->decimation ? o->decimation : 1);
+			w->flac = o->flac_cfg;
+			w->flac.sample_rate = (uint32_t)(out_rate / 1000.0);
+			w->flac.realtime_rate = out_rate;
+		}
+	}
+	if (o->audio) {
+		bench_out_t *w = &s->out[2];
+		w->stage = STAGE_AUDIO;
+		if (rb_init(&w->rb, "bench_audio_rb", BUFFER_AUDIO_TOTAL_SIZE) != 0) {
+			fprintf(stderr, "ERROR: failed to create ringbuffers\n");
+			goto cleanup;
+		}
+		w->used = true;
+		if ((w->f = open_bench_output(o, "bench_audio.raw")) == NULL) goto cleanup;
+		s->handler.rb_audio = &w->rb;
+		s->handler.capture_audio = true;
+	}
+	if (o->aux && (s->aux = open_bench_output(o, "bench_aux.raw")) == NULL) goto cleanup;
+
+	atomic_store(&step_stop, false);
+	uint64_t cpu_start = get_process_cpu_ns();
+	s->t_start = get_time_ns();
+
+	for (int i = 0; i < 3; i++) {
+		bench_out_t *w = &s->out[i];
+		int (*func)(void *) = raw_writer_thread;
+		if (!w->used) continue;
+#if LIBFLAC_ENABLED == 1
+		if (o->flac && i < 2) func = flac_writer_thread;
+#endif
+		if (thrd_create(&threads[w->stage], func, w) != thrd_success) goto start_failed;
+		started[w->stage] = true;
+	}
+	if (thrd_create(&threads[STAGE_EXTRACT], extract_thread, s) != thrd_success) goto start_failed;
+	started[STAGE_EXTRACT] = true;
+	if (thrd_create(&threads[STAGE_PARSE], parser_thread, s) != thrd_success) goto start_failed;
+	started[STAGE_PARSE] = true;
+	if (thrd_create(&threads[STAGE_GEN], generator_thread, s) != thrd_success) goto start_failed;
+	started[STAGE_GEN] = true;
+
+	for (unsigned ms = 0; ms < o->seconds * 1000 && !atomic_load(&step_stop); ms += 100) thrd_sleep_ms(100);
+	r = 0;
+
+start_failed:
+	if (r != 0) fprintf(stderr, "ERROR: failed to create the stage threads\n");
+	uint64_t wall_ns = get_time_ns() - s->t_start;
+	uint64_t cpu_process = get_process_cpu_ns() - cpu_start;
+	atomic_store(&step_stop, true);
+	for (int i = 0; i < STAGE_COUNT; i++) {
+		if (started[i]) thrd_join(threads[i], NULL);
+	}
+	if (r != 0) goto cleanup;
+
+	// the CPU of the encoder and resampler threads is what the stage threads leave of the process
+	uint64_t cpu_stages = 0;
+	for (int i = 0; i < 3; i++) if (s->out[i].used) s->cpu_ns[s->out[i].stage] = s->out[i].cpu_ns;
+	for (int i = 0; i < STAGE_OTHER; i++) cpu_stages += s->cpu_ns[i];
+	s->cpu_ns[STAGE_OTHER] = cpu_process > cpu_stages ? cpu_process - cpu_stages : 0;
+	for (int i = 0; i < STAGE_COUNT; i++) res->cpu[i] = 100.0 * (double)s->cpu_ns[i] / (double)wall_ns;
+
+	// the frames before sync are not committed, the rate counts from the first one that is
+	uint64_t parse_ns = s->t_last - s->t_first;
+	res->achieved = parse_ns ? (double)(s->committed - s->first_bytes) / 4.0 * 1e9 / (double)parse_ns : 0.0;
+	if (s->frame_errors > 0) fprintf(stderr, "%" PRIu64 " frames with errors, the generator is broken\n", s->frame_errors);
+
+	// downstream first, a stage that falls behind backs up everything before it
+	for (int i = 0; i < 2; i++) {
+		if (!s->out[i].resample) continue;
+		rb_get_stats(resample_stage_output(s->out[i].resample), &st);
+		check_fill(res, i ? "B out" : "A out", &st, stage_names[STAGE_OUT_A + i]);
+	}
+	for (int i = 0; i < 2; i++) {
+		if (!s->out[i].used) continue;
+		rb_get_stats(&s->out[i].rb, &st);
+		check_fill(res, i ? "B" : "A", &st, s->out[i].resample ? resample_names[i] : stage_names[STAGE_OUT_A + i]);
+	}
+	if (s->out[2].used) {
+		rb_get_stats(&s->out[2].rb, &st);
+		check_fill(res, "aud", &st, stage_names[STAGE_AUDIO]);
+	}
+	rb_get_stats(&s->rb_cap, &st);
+	check_fill(res, "cap", &st, stage_names[STAGE_EXTRACT]);
+	rb_get_stats(&s->rb_frames, &st);
+	check_fill(res, "frames", &st, stage_names[STAGE_PARSE]);
+	// nothing backed up, the frames were not even generated in time
+	if (res->bottleneck == NULL && res->achieved < rate * SUSTAINED_RATE) res->bottleneck = stage_names[STAGE_GEN];
+
+cleanup:
+	for (int i = 0; i < 3; i++) {
+		bench_out_t *w = &s->out[i];
+		if (w->resample) resample_stage_stop(w->resample);
+		if (w->f) fclose(w->f);
+		if (w->used) rb_close(&w->rb);
+	}
+	if (s->aux) fclose(s->aux);
+	rb_close(&s->rb_cap);
+	rb_close(&s->rb_frames);
+	if (s->pool) aligned_free(s->pool);
+	free(s);
+	return r;
+}
+
+static void print_cpu(const bench_result_t *res, const bench_opts_t *o)
+{
+	fprintf(stderr, "           CPU %%");
+	for (int i = 0; i < STAGE_COUNT; i++) {
+		if ((i == STAGE_OUT_A && !o->out[0]) || (i == STAGE_OUT_B && !o->out[1]) || (i == STAGE_AUDIO && !o->audio)) continue;
+		fprintf(stderr, " %s %.0f", stage_names[i], res->cpu[i]);
+	}
+	fprintf(stderr, "\n");
+}
+
+int main(int argc, char **argv)
+{
+	bench_opts_t o;
+	bench_result_t res, last_ok;
+	double sustained = 0.0;
+	const char *limit = NULL;
+	double limit_rate = 0.0;
+	int opt;
+	int flac_threads = 0;
+	bool flac_12bit = false;
+
+	memset(&o, 0, sizeof(o));
+	memset(&last_ok, 0, sizeof(last_ok));
+	o.flac_cfg = flac_writer_default_config();
+	o.rate_start = 40.0;
+	o.rate_step = 20.0;
+	o.rate_max = 400.0;
+	o.seconds = 5;
+
+	fprintf(stderr,
+		"MISRC bench " MIRSC_TOOLS_VERSION "\n"
+		MIRSC_TOOLS_COPYRIGHT "\n\n"
+	);
+
+	while ((opt = getopt_long(argc, argv, "abxfl:c:o:r:s:m:t:h", getopt_long_options, NULL)) != -1) {
+		switch (opt) {
+		case 'a':
+			o.out[0] = true;
+			break;
+		case 'b':
+			o.out[1] = true;
+			break;
+		case 'x':
+			o.aux = true;
+			break;
+		case OPT_AUDIO:
+			o.audio = true;
+			break;
+#if LIBFLAC_ENABLED == 1
+		case 'f':
+			o.flac = true;
+			break;
+		case 'l':
+			if (flac_writer_parse_level(optarg, &o.flac_cfg) != 0) {
+				fprintf(stderr, "Invalid FLAC level %s, use 0-8, auto or MIN-MAX\n", optarg);
+				usage();
+			}
+			break;
+		case 'c':
+			flac_threads = atoi(optarg);
+			break;
+		case OPT_FLAC_12BIT:
+			flac_12bit = true;
+			break;
+#endif
+#if LIBSOXR_ENABLED == 1
+		case OPT_RESAMPLE:
+			o.resample_rate = atof(optarg);
+			break;
+#endif
+		case OPT_DECIMATE:
+			o.decimation = (unsigned)atoi(optarg);
+			if (!decimator_factor_valid(o.decimation)) {
+				fprintf(stderr, "ERROR: Decimation factor has to be 2, 4 or 8!\n");
+				usage();
+			}
+			break;
+		case 'o':
+			o.dir = optarg;
+			break;
+		case 'r':
+			o.rate_start = atof(optarg);
+			break;
+		case 's':
+			o.rate_step = atof(optarg);
+			break;
+		case 'm':
+			o.rate_max = atof(optarg);
+			break;
+		case 't':
+			o.seconds = (unsigned)atoi(optarg);
+			break;
+		case 'h':
+		default:
+			usage();
+			break;
+		}
+	}
+
+	if (!o.out[0] && !o.out[1]) o.out[0] = o.out[1] = true;
+	if (o.rate_start <= 0.0 || o.rate_step <= 0.0 || o.rate_max < o.rate_start || o.seconds == 0) usage();
+	if (o.resample_rate != 0.0 && o.decimation != 0) {
+		fprintf(stderr, "ERROR: Use either --resample or --decimate\n");
+		usage();
+	}
+	if (o.flac && !flac_writer_available()) {
+		fprintf(stderr, "ERROR: FLAC support is not available\n");
+		return -EINVAL;
+	}
+	if (o.flac) {
+		int outputs = o.out[0] + o.out[1];
+		// like misrc_capture: the cores the other threads leave, shared by the outputs
+		if (flac_threads <= 0) flac_threads = ((int)get_cpu_count() - 3 - outputs) / outputs;
+		if (flac_threads < 1) flac_threads = 1;
+		o.flac_cfg.num_threads = (uint32_t)flac_threads;
+		o.flac_cfg.bits_per_sample = flac_12bit ? 12 : 16;
+		o.flac_cfg.enable_seektable = true;
+		snprintf(stage_names[STAGE_OUT_A], sizeof(stage_names[0]), "flac A");
+		snprintf(stage_names[STAGE_OUT_B], sizeof(stage_names[0]), "flac B");
+	}
+
+#ifndef _WIN32
+	struct sigaction sigact = {0};
+	sigact.sa_handler = sighandler;
+	sigemptyset(&sigact.sa_mask);
+	sigaction(SIGINT, &sigact, NULL);
+	sigaction(SIGTERM, &sigact, NULL);
+#else
+	signal(SIGINT, sighandler);
+	signal(SIGTERM, sighandler);
+#endif
+
+	// only whether the outputs are NULL picks the kernel
+	conv_function = get_conv_function(0, 0, 0, 0, o.out[0] ? (void*)&o : NULL, o.out[1] ? (void*)&o : NULL);
+
+	fprintf(stderr, "Outputs: ADC%s%s %s", o.out[0] ? " A" : "", o.out[1] ? " B" : "", o.flac ? "FLAC" : "raw");
+	if (o.flac) fprintf(stderr, " (%u bit, %u threads each)", o.flac_cfg.bits_per_sample, o.flac_cfg.num_threads);
+	if (o.resample_rate != 0.0) fprintf(stderr, ", resampled to %.0f kHz", o.resample_rate);
+	if (o.decimation) fprintf(stderr, ", decimated by %u", o.decimation);
+	fprintf(stderr, "%s%s, to %s\n", o.aux ? ", AUX" : "", o.audio ? ", audio" : "", o.dir ? o.dir : "the null device");
+	fprintf(stderr, "Running %u s per step from %.0f to %.0f MSPS\n\n", o.seconds, o.rate_start, o.rate_max);
+
+	for (double rate = o.rate_start; rate <= o.rate_max + 1e-9 && !atomic_load(&do_exit); rate += o.rate_step) {
+		if (run_step(&o, rate * 1e6, &res) != 0) return -EIO;
+		if (atomic_load(&do_exit)) break;
+		fprintf(stderr, "%6.1f MSPS: %6.1f MSPS, peak fill %s%s\n", rate, res.achieved / 1e6, res.fill,
+		        res.bottleneck ? ", falls behind" : "");
+		print_cpu(&res, &o);
+		if (res.bottleneck) {
+			limit = res.bottleneck;
+			limit_rate = rate;
+			break;
+		}
+		sustained = rate;
+		last_ok = res;
+	}
+	if (atomic_load(&do_exit)) {
+		fprintf(stderr, "\nCancelled\n");
+		return 0;
+	}
+
+	fprintf(stderr, "\n");
+	if (sustained == 0.0) {
+		fprintf(stderr, "Not sustained at %.1f MSPS, limited by %s\n", limit_rate, limit);
+		return 1;
+	}
+	fprintf(stderr, "Maximum sustained rate: %d x %.1f MSPS\n", o.out[0] + o.out[1], sustained);
+	if (limit) fprintf(stderr, "Bottleneck at %.1f MSPS: %s\n", limit_rate, limit);
+	else fprintf(stderr, "No stage saturated up to %.1f MSPS\n", sustained);
+	fprintf(stderr, "Per stage CPU at %.1f MSPS (%% of one core):\n", sustained);
+	print_cpu(&last_ok, &o);
+	return 0;
+}
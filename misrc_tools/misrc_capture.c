@@ -39,6 +39,7 @@
 #include <inttypes.h>
 #include <stdbool.h>
 #include <stdarg.h>
+#include <stddef.h>
 #if __STDC_VERSION__ >= 201112L && ! __STDC_NO_THREADS__ && ! _WIN32
 #include <threads.h>
 #else
@@ -103,6 +104,7 @@ static const char* const _FLAC_StreamEncoderSetNumThreadsStatusString[] = {
 
 #include "version.h"
 #include "../misrc_common/ringbuffer.h"
+#include "../misrc_common/ringbuffer_writer.h"
 #include "../misrc_common/flac_writer.h"
 #include "../misrc_common/frame_parser.h"
 #include "../misrc_common/capture_handler.h"
@@ -110,8 +112,29 @@ static const char* const _FLAC_StreamEncoderSetNumThreadsStatusString[] = {
 #include "../misrc_common/extract.h"
 #include "../misrc_common/wave.h"
 #include "../misrc_common/file_utils.h"
+#include "../misrc_common/file_segment.h"
+#include "../misrc_common/sample_index.h"
+#include "../misrc_common/aux_events.h"
+#include "../misrc_common/delta_codec.h"
+#include "../misrc_common/code_histogram.h"
+#include "../misrc_common/overload_policy.h"
+#include "../misrc_common/buffer_sizing.h"
+#include "../misrc_common/storage_probe.h"
+#include "../misrc_common/net_stream.h"
+#include "../misrc_common/rb_shm.h"
+#include "../misrc_common/decimate.h"
+#include "../misrc_common/resample_stage.h"
+#include "../misrc_common/thread_role.h"
+#include "../misrc_common/replay.h"
+#include "../misrc_common/frame_queue.h"
+#include "../misrc_common/telemetry.h"
+#include "../misrc_common/preview.h"
+#include "../misrc_common/record_trigger.h"
+#include "../misrc_common/frame_timing.h"
+#include "../misrc_common/buffer_pool.h"
+#include "../misrc_common/trace.h"
 
-#if LIBFLAC_ENABLED == 1 && defined(FLAC_API_VERSION_CURRENT) && FLAC_API_VERSION_CURRENT >= 14
+#if LIBFLAC_ENABLED == 1
 #include "numcores.h"
 #endif
 
@@ -119,6 +142,22 @@ static const char* const _FLAC_StreamEncoderSetNumThreadsStatusString[] = {
 #define BUFFER_AUDIO_READ_SIZE 65536*3
 #define BUFFER_TOTAL_SIZE 65536*1024
 #define BUFFER_READ_SIZE 65536*32
+// write size of resampled outputs, their blocks shrink with the rate
+#define RESAMPLE_WRITE_SIZE (1024*1024)
+// upper bound for blocking ringbuffer waits, so do_exit is noticed in time
+#define RB_WAIT_MS 100
+
+#define PARSER_FRAME_MAX (4 << 20)   // largest frame the --parser-thread queue holds, 1080p frames fit
+// STREAMINFO rewrites of FLAC RF outputs with --rf-flac-seek-sidecar
+#define FLAC_CHECKPOINT_SECONDS 10
+// devices captured by one process, -d repeated
+#define MAX_CAPTURE_DEVICES 8
+// samples between the progress lines of several devices, about 6.7 seconds
+#define PROGRESS_MULTI_SAMPLES ((uint64_t)BUFFER_READ_SIZE << 7)
+// --histogram counts one block in this many, DC and RMS still cover every sample
+#define HISTOGRAM_BLOCK_STRIDE 4
+// outputs --preflight can probe, all outputs of all devices
+#define PREFLIGHT_MAX_OUTPUTS (16 * MAX_CAPTURE_DEVICES)
 
 #define _FILE_OFFSET_BITS 64
 
@@ -139,6 +178,50 @@ static const char* const _FLAC_StreamEncoderSetNumThreadsStatusString[] = {
 #define OPT_RESAMPLE_GAIN_B  270
 #define OPT_8BIT_A           271
 #define OPT_8BIT_B           272
+#define OPT_HUGEPAGES        273
+#define OPT_ASYNC_IO         274
+#define OPT_DIRECT_IO        275
+#define OPT_RF_FLAC_PARALLEL 276
+#define OPT_SEGMENT_SIZE     277
+#define OPT_SEGMENT_TIME     278
+#define OPT_RF_PACKED_12BIT  279
+#define OPT_INDEX            280
+#define OPT_PREFLIGHT        281
+#define OPT_DECIMATE_A       282
+#define OPT_DECIMATE_B       283
+#define OPT_AFFINITY         284
+#define OPT_REALTIME         285
+#define OPT_NUMA_NODE        286
+#define OPT_CAPTURE_BUFFERS  287
+#define OPT_REPLAY           288
+#define OPT_REPLAY_SPEED     289
+#define OPT_REPLAY_LOOP      290
+#define OPT_DUMP_FRAMES      291
+#define OPT_AUX_EVENTS       292
+#define OPT_AUDIO_FLAC       293
+#define OPT_HISTOGRAM        294
+#define OPT_OVERLOAD         295
+#define OPT_BUFFER_TIME      296
+#define OPT_BUFFER_MEMORY    297
+#define OPT_LOW_MEMORY       298
+#define OPT_RF_DELTA         299
+#define OPT_RF_FLAC_SIDECAR  300
+#define OPT_TELEMETRY        301
+#define OPT_TELEMETRY_INTERVAL 302
+#define OPT_TRACE            303
+#define OPT_PREVIEW          304
+#define OPT_PREVIEW_DECIMATION 305
+#define OPT_TRIGGER          306
+#define OPT_PRE_ROLL         307
+#define OPT_POST_ROLL        308
+#define OPT_RF_FLOAT         309
+#define OPT_RF_FLOAT_DC      310
+#define OPT_PARSER_THREAD    311
+
+// bytes per second each output reads from its ringbuffer, for --segment-time
+#define RATE_RAW_INPUT   160000000  // 40 Msps of 32 bit capture words
+#define RATE_RF_INPUT     80000000  // 40 Msps of 16 bit samples
+#define RATE_AUDIO_INPUT    937500  // 78125 Hz of 4 channels with 24 bit
 #if defined(__GNUC__)
 # define UNUSED(x) x __attribute__((unused))
 #else
@@ -150,14 +233,46 @@ typedef struct {
 	capture_handler_ctx_t handler;    /* Shared capture handler context */
 	ringbuffer_t rb;                  /* RF ringbuffer (handler.rb_rf points here) */
 	ringbuffer_t rb_audio;            /* Audio ringbuffer (handler.rb_audio points here) */
+	sample_index_t *index;            /* Sidecar index, NULL if not written */
+	uint64_t rf_samples;              /* Samples committed to the RF ringbuffer so far */
+	uint64_t audio_samples;           /* Audio samples (all channels) committed so far */
+	overload_t *overload;             /* --overload state, NULL waits for ringbuffer space */
+	atomic_uint last_frame;           /* Frame counter of the last committed frame, for network chunks */
+	const char *tag;                  /* Put in front of messages, "[N] " with several devices */
+	bool video_device;                /* Captured through simple_capture */
+	FILE *dump;                       /* Frame dump for --replay, NULL if not written */
+	uint16_t dump_width;              /* Frame size in the dump header, 0 before the first frame */
+	uint16_t dump_height;
+	/* --telemetry counters, each has one writer thread (see telemetry.h) */
+	atomic_uint_fast64_t frames;        /* Valid frames, by the callback */
+	atomic_uint_fast64_t frames_missed; /* Jumps in the frame counter, by the callback */
+	atomic_uint_fast64_t frame_errors;  /* CRC and frame errors, by the callback */
+	atomic_uint_fast64_t sync_lost;     /* By the callback */
+	atomic_uint_fast64_t samples;       /* RF samples extracted, by the extraction thread */
+	atomic_uint_fast64_t clipped[2];    /* Clipped samples of ADC A and B, by the extraction thread */
+	frame_timing_t timing;              /* Frame arrival and callback times, by the callback */
+	uint64_t arrival_ns;                /* When the callback got the current frame */
+	frame_queue_t *queue;               /* --parser-thread, NULL parses in the callback */
+	bool queue_dropping;                /* The callback dropped the last frame, by the callback */
 } cli_capture_ctx_t;
 
 
 typedef struct {
 	ringbuffer_t rb;
 	FILE *f;
+	file_segment_t *seg;   // NULL if the output is not split
+	net_sink_t *net;       // tcp:// output instead of f
+	atomic_uint *frame;    // frame counter for the network chunk headers
+	rb_writer_backend_t io_backend;
+	int io_depth;
+	bool io_direct;
+	bool packed_12bit;
+	unsigned decimation;   // 2, 4 or 8 with the half-band decimators, 0 = off
+	thread_role_t role;    // writer role of the channel
+	buffer_pool_t *pool;   // scratch buffers of the device
+	atomic_uint_fast64_t coded_in;   // bytes the FLAC or delta encoder took, for --telemetry
+	atomic_uint_fast64_t coded_out;  // bytes it wrote, all segments together
 #if LIBSOXR_ENABLED == 1
-	conv_16to32_t conv_func;
 	double init_scale;
 	double resample_rate;
 	uint32_t resample_qual;
@@ -165,10 +280,17 @@ typedef struct {
 	bool reduce_8bit;
 #endif
 #if LIBFLAC_ENABLED == 1
-	uint32_t flac_level;
+	conv_16to32_t conv_func;   // resampled or decimated samples to the FLAC sample width
+	flac_writer_config_t flac_levels;  // compression level fields of --rf-flac-level
 	bool flac_verify;
 	uint32_t flac_threads;
+	bool flac_block_parallel;
+	bool flac_shared_pool;     // encode on the pool shared by all devices
+	bool flac_sidecar;         // seek points go to <file>.seek, the header is checkpointed
+	bool flac_count_bytes;     // stream mode for the byte count of --telemetry
+	const char *name;          // output name, for the sidecar
 	uint8_t flac_bits;
+	overload_t *overload;      // its flac step makes the adaptive level step down
 #endif
 } filewriter_ctx_t;
 
@@ -177,19 +299,142 @@ typedef struct {
 	FILE *f_4ch;
 	FILE *f_2ch[2];
 	FILE *f_1ch[4];
-	uint64_t total_bytes;
+	file_segment_t *seg_4ch;
+	file_segment_t *seg_2ch[2];
+	file_segment_t *seg_1ch[4];
+	uint64_t total_bytes;  // in the current segment
 	bool non_4ch;
+	bool flac;             // FLAC instead of WAV/RF64, one encoder per output
+	flac_writer_config_t flac_config;  // level, verification and threads of the RF outputs
+	flac_writer_t *flac_4ch;
+	flac_writer_t *flac_2ch[2];
+	flac_writer_t *flac_1ch[4];
+	int32_t *flac_buf;     // samples of a block widened for the encoders
+	buffer_pool_t *pool;   // scratch buffers of the device
 } audiowriter_ctx_t;
 
+// what the options ask for, the same for every device but the output names
+typedef struct {
+	int pad;
+	int plevel;
+	unsigned histogram_s;    // seconds between code histogram reports, 0 = none
+	char *output_names[2];
+	char *output_name_aux;
+	bool aux_events;         // the aux output holds changes only
+	char *output_name_raw;
+	char *output_name_index;
+	char *output_name_frames;
+	char *output_name_preview;
+	uint32_t preview_decimation;
+	bool trigger_on;         // --trigger, only events are extracted and written
+	record_trigger_cond_t trigger;
+	uint64_t pre_roll;       // capture samples
+	uint64_t post_roll;
+	char *output_name_4ch_audio;
+	char *output_names_2ch_audio[2];
+	char *output_names_1ch_audio[4];
+	bool suppress_a_clipping;
+	bool suppress_b_clipping;
+	bool overwrite_files;
+	bool packed_12bit;
+	bool rf_float;           // --rf-float, the channel ringbuffers hold float samples
+	bool rf_float_dc;        // --rf-float-dc
+	unsigned decimation[2];
+	size_t huge_size;        // huge page size for the ringbuffers, 0 for normal pages
+	unsigned parser_depth;   // --parser-thread, frames queued for the parser, 0 parses in the callback
+	rb_writer_backend_t io_backend;
+	int io_depth;
+	bool io_direct;
+	uint64_t total_samples_before_exit;
+	thrd_start_t output_thread_func;
+	double rf_ratio[2];      // file bytes per ringbuffer byte of the RF outputs
+	bool rf_async[2];
+	uint64_t rf_seg_rate[2]; // bytes per second the RF writers read, the resampling stage output when resampling
+	bool rf_plain[2];        // the channel ringbuffer goes out as it is, which network and shared memory outputs need
+	uint64_t timeline_ns;    // common origin of the sample indexes
+	const char *replay_path; // raw capture or frame dump replayed instead of a device
+	double replay_speed;     // x real time, REPLAY_SPEED_MAX for unthrottled
+	bool replay_loop;
+	bool rf_delta;           // --rf-delta, delta coded RF outputs
+	bool telemetry;          // --telemetry, the encoders keep their byte counts
+	bool overload_on;        // --overload, otherwise the callback waits for the outputs
+	overload_policy_t overload;
+	buffer_sizing_t buffers; // --buffer-time, --buffer-memory and --low-memory
+	size_t rb_size_capture;  // ringbuffer sizes of each device, see size_ringbuffers()
+	size_t rb_size_out;
+	size_t rb_size_audio;
+#if LIBSOXR_ENABLED == 1
+	double resample_rate[2];
+	uint32_t resample_qual[2];
+	float resample_gain[2];
+	bool reduce_8bit[2];
+#endif
+#if LIBFLAC_ENABLED == 1
+	bool rf_flac;
+	flac_writer_config_t flac_levels;
+	bool flac_verify;
+	bool flac_12bit;
+	uint32_t flac_threads;
+	bool flac_block_parallel;
+	bool flac_shared_pool;
+	bool flac_sidecar;
+	bool audio_flac;
+#endif
+} capture_opts_t;
+
+// output name fields of capture_opts_t, incl. the index
+#define CAPTURE_OUTPUT_NAMES 14
+
+// one MISRC with its own callback, ringbuffers, writers and extraction
+typedef struct {
+	capture_opts_t o;        // with the output names of this device
+	int num;                 // position on the command line, the device number in names and indexes
+	char tag[8];
+	uint32_t dev_index;      // hsdaoh device
+	char *sc_name;           // simple_capture device instead, NULL if none
+	hsdaoh_dev_t *hs_dev;
+	sc_handle_t *sc_dev;
+	replay_t *replay;        // replay instead, NULL if none
+	int result;              // of starting the stream
+	cli_capture_ctx_t cap_ctx;
+	thrd_t thread;           // extraction, with several devices
+	thrd_t thread_out[2];
+	thrd_t thread_audio;
+	thrd_t thread_raw;
+	thrd_t thread_parser;    // with --parser-thread
+	atomic_bool parser_stop; // the stream is stopped, the parser finishes the queued frames
+	rb_writer_config_t raw_writer_cfg;
+	filewriter_ctx_t thread_out_ctx[2];
+	audiowriter_ctx_t thread_audio_ctx;
+	FILE *output_aux;
+	aux_encoder_t *aux_events;   // encodes output_aux with --aux-events, owns it then
+	FILE *output_raw;
+	file_segment_t *segment_raw;
+	preview_t *preview;                // --preview, NULL if none
+	record_trigger_t trigger;          // with --trigger
+	file_segment_t *segment_aux;       // the aux output is split per event with --trigger
+	uint64_t telemetry_samples;        // at the last snapshot, for the rates
+	uint64_t telemetry_out_bytes[2];
+	buffer_pool_t *pool;               // scratch buffers of the capture loop and the writers
+} capture_dev_t;
+
 
 static int do_exit;
 static int new_line = 1;
-static hsdaoh_dev_t *hs_dev = NULL;
-static sc_handle_t *sc_dev = NULL;
+static capture_dev_t *capture_devs = NULL;
+static int num_capture_devs = 0;
+#if LIBFLAC_ENABLED == 1
 static conv_16to32_t conv_16to32 = NULL;
 static conv_16to32_t conv_16to8to32 = NULL;
 static conv_16to32_t conv_16to12to32 = NULL;
+#endif
 static conv_16to8_t conv_16to8 = NULL;
+static conv_16to12p_t conv_16to12p = NULL;
+static conv_16tof32_t conv_16tof32 = NULL;
+// rolling segments, 0 = no limit
+static uint64_t segment_bytes = 0;
+static uint64_t segment_seconds = 0;
+static uint64_t segment_samples = 0;  // capture samples, one event of --trigger
 
 static struct option getopt_long_options[] =
 {
@@ -201,11 +446,18 @@ static struct option getopt_long_options[] =
   {"rf-adc-a",             required_argument, 0, 'a'},
   {"rf-adc-b",             required_argument, 0, 'b'},
   {"aux",                  required_argument, 0, 'x'},
+  {"aux-events",           no_argument,       0, OPT_AUX_EVENTS},
   {"raw",                  required_argument, 0, 'r'},
   {"pad",                  no_argument,       0, 'p'},
+  {"rf-12bit-packed",      no_argument,       0, OPT_RF_PACKED_12BIT},
+  {"rf-float",             no_argument,       0, OPT_RF_FLOAT},
+  {"rf-float-dc",          no_argument,       0, OPT_RF_FLOAT_DC},
   {"level",                no_argument,       0, 'L'},
+  {"histogram",            required_argument, 0, OPT_HISTOGRAM},
   {"suppress-clip-rf-a",   no_argument,       0, 'A'},
   {"suppress-clip-rf-b",   no_argument,       0, 'B'},
+  {"decimate-rf-a",        required_argument, 0, OPT_DECIMATE_A},
+  {"decimate-rf-b",        required_argument, 0, OPT_DECIMATE_B},
 #if LIBSOXR_ENABLED == 1
   {"8bit-a",               no_argument,       0, OPT_8BIT_A},
   {"8bit-b",               no_argument,       0, OPT_8BIT_B},
@@ -221,10 +473,12 @@ static struct option getopt_long_options[] =
   {"rf-flac-12bit",        no_argument,       0, OPT_RF_FLAC_12BIT},
   {"rf-flac-level",        required_argument, 0, 'l'},
   {"rf-flac-verification", no_argument,       0, 'v'},
-#if defined(FLAC_API_VERSION_CURRENT) && FLAC_API_VERSION_CURRENT >= 14
   {"rf-flac-threads",      required_argument, 0, 'c'},
+  {"rf-flac-block-parallel", no_argument,     0, OPT_RF_FLAC_PARALLEL},
+  {"rf-flac-seek-sidecar", no_argument,       0, OPT_RF_FLAC_SIDECAR},
+  {"audio-flac",           no_argument,       0, OPT_AUDIO_FLAC},
 #endif
-#endif
+  {"rf-delta",             no_argument,       0, OPT_RF_DELTA},
   {"audio-4ch",            required_argument, 0, OPT_AUDIO_4CH_OUT},
   {"audio-2ch-12",         required_argument, 0, OPT_AUDIO_2CH_12_OUT},
   {"audio-2ch-34",         required_argument, 0, OPT_AUDIO_2CH_34_OUT},
@@ -232,6 +486,36 @@ static struct option getopt_long_options[] =
   {"audio-1ch-2",          required_argument, 0, OPT_AUDIO_1CH_2_OUT},
   {"audio-1ch-3",          required_argument, 0, OPT_AUDIO_1CH_3_OUT},
   {"audio-1ch-4",          required_argument, 0, OPT_AUDIO_1CH_4_OUT},
+  {"hugepages",            optional_argument, 0, OPT_HUGEPAGES},
+  {"async-io",             optional_argument, 0, OPT_ASYNC_IO},
+  {"direct-io",            no_argument,       0, OPT_DIRECT_IO},
+  {"segment-size",         required_argument, 0, OPT_SEGMENT_SIZE},
+  {"segment-time",         required_argument, 0, OPT_SEGMENT_TIME},
+  {"index",                required_argument, 0, OPT_INDEX},
+  {"preflight",            no_argument,       0, OPT_PREFLIGHT},
+  {"affinity",             required_argument, 0, OPT_AFFINITY},
+  {"realtime",             no_argument,       0, OPT_REALTIME},
+  {"numa-node",            required_argument, 0, OPT_NUMA_NODE},
+  {"capture-buffers",      required_argument, 0, OPT_CAPTURE_BUFFERS},
+  {"parser-thread",        optional_argument, 0, OPT_PARSER_THREAD},
+  {"overload",             optional_argument, 0, OPT_OVERLOAD},
+  {"buffer-time",          required_argument, 0, OPT_BUFFER_TIME},
+  {"buffer-memory",        required_argument, 0, OPT_BUFFER_MEMORY},
+  {"low-memory",           no_argument,       0, OPT_LOW_MEMORY},
+  {"replay",               required_argument, 0, OPT_REPLAY},
+  {"replay-speed",         required_argument, 0, OPT_REPLAY_SPEED},
+  {"replay-loop",          no_argument,       0, OPT_REPLAY_LOOP},
+  {"dump-frames",          required_argument, 0, OPT_DUMP_FRAMES},
+  {"preview",              required_argument, 0, OPT_PREVIEW},
+  {"preview-decimation",   required_argument, 0, OPT_PREVIEW_DECIMATION},
+  {"trigger",              required_argument, 0, OPT_TRIGGER},
+  {"pre-roll",             required_argument, 0, OPT_PRE_ROLL},
+  {"post-roll",            required_argument, 0, OPT_POST_ROLL},
+  {"telemetry",            required_argument, 0, OPT_TELEMETRY},
+  {"telemetry-interval",   required_argument, 0, OPT_TELEMETRY_INTERVAL},
+#if TRACE_ENABLED == 1
+  {"trace",                required_argument, 0, OPT_TRACE},
+#endif
   {0, 0, 0, 0}
 };
 
@@ -239,19 +523,26 @@ static char* yesno[] = {"no", "yes"};
 
 static char* usage_options[][2] =
 {
-  { "device index (default: 0)", "[device index]" },
+  { "device index (default: 0), repeat to capture several devices, output names then need a %d for the device number", "[device index]" },
   { "list available devices", NULL },
   { "number of samples to read (default: 0, infinite)", "[samples]" },
   { "time to capture (seconds, m:s or h:m:s; -n takes priority, assumes 40msps)", "[time]" },
   { "overwrite any files without asking", NULL },
-  { "ADC A output file (use '-' to write on stdout)", "[filename]" },
-  { "ADC B output file (use '-' to write on stdout)", "[filename]" },
+  { "ADC A output file (use '-' to write on stdout, tcp://host:port or tcp://:port to stream, shm://name to share with local decoders)", "[filename]" },
+  { "ADC B output file (use '-' to write on stdout, tcp://host:port or tcp://:port to stream, shm://name to share with local decoders)", "[filename]" },
   { "AUX output file (use '-' to write on stdout)", "[filename]" },
+  { "write the AUX output as changes only (sample, new value), expand with misrc_extract -X", NULL },
   { "raw data output file (use '-' to write on stdout)", "[filename]" },
   { "pad lower 4 bits of 16 bit output with 0 instead of upper 4", NULL },
-  { "display peak level of RF ADCs", NULL },
+  { "store RF ADC outputs as packed 12 bit, 2 samples in 3 bytes (unpack with misrc_extract -u)", NULL },
+  { "RF ADC outputs (files, tcp:// and shm://) as 32 bit float normalized to [-1, 1), for decoders that work in float", NULL },
+  { "remove the DC offset from the --rf-float outputs, tracked over about 0.4 s", NULL },
+  { "display peak level of RF ADCs and ringbuffer usage", NULL },
+  { "report DC, RMS, crest factor, effective bits and missing codes of the RF ADCs every [seconds]", "[seconds]" },
   { "suppress clipping messages for ADC A (need to specify -a or -r as well)", NULL },
   { "suppress clipping messages for ADC B (need to specify -b or -r as well)", NULL },
+  { "decimate ADC A by 2, 4 or 8 with the built-in half-band filter (no libsoxr needed)", "[factor]" },
+  { "decimate ADC B by 2, 4 or 8 with the built-in half-band filter (no libsoxr needed)", "[factor]" },
 #if LIBSOXR_ENABLED == 1
   { "reduce output from 12 bit to 8 bit for ADC A", NULL },
   { "reduce output from 12 bit to 8 bit for ADC B", NULL },
@@ -265,12 +556,14 @@ static char* usage_options[][2] =
 #if LIBFLAC_ENABLED == 1
   { "compress RF ADC output as FLAC", NULL },
   { "set RF FLAC sample width to 12 instead of 16 bit", NULL },
-  { "set RF flac compression level (0-8, default: 1)", "[level]" },
+  { "set RF flac compression level (0-8, default: 1), auto or MIN-MAX adapts it to the encoder headroom", "[level]" },
   { "enable verification of RF flac encoder output", NULL },
-#if defined(FLAC_API_VERSION_CURRENT) && FLAC_API_VERSION_CURRENT >= 14
   { "number of RF flac encoding threads per file (default: auto)", "[threads]" },
+  { "encode independent blocks on the RF flac threads instead of using libflac's threading (always on with libflac < 1.5)", NULL },
+  { "write the RF flac seek points to name.flac.seek as they come and update the header every few seconds, instead of fixing up a seektable at the end", NULL },
+  { "write the audio outputs as 24 bit FLAC instead of WAV, with the level, verification and threads of the RF flac options", NULL },
 #endif
-#endif
+  { "store RF ADC outputs delta coded, lossless at a fraction of the CPU time of FLAC (decode with misrc_extract -D)", NULL },
   { "4 channel audio output (use '-' to write on stdout)", "[filename]" },
   { "stereo audio output of input 1/2 (use '-' to write on stdout)", "[filename]" },
   { "stereo audio output of input 3/4 (use '-' to write on stdout)", "[filename]" },
@@ -278,6 +571,36 @@ static char* usage_options[][2] =
   { "mono audio output of input 2 (use '-' to write on stdout)", "[filename]" },
   { "mono audio output of input 3 (use '-' to write on stdout)", "[filename]" },
   { "mono audio output of input 4 (use '-' to write on stdout)", "[filename]" },
+  { "back the ringbuffers and scratch buffers with huge pages (2M or 1G, default: 2M)", "[=size]" },
+  { "write raw and unresampled RF outputs with io_uring (Linux) or overlapped I/O (Windows), keeping depth writes in flight (default: 8)", "[=depth]" },
+  { "bypass the page cache for raw and unresampled RF outputs (implies --async-io)", NULL },
+  { "split raw, RF and audio outputs into name_000.ext, name_001.ext, ... of at most this size (k, M or G suffix)", "[size]" },
+  { "split raw, RF and audio outputs into segments of this length (seconds, m:s or h:m:s)", "[time]" },
+  { "write a sidecar index of frame counters, timestamps, missed frames and aux changes (for misrc_extract -j)", "[filename]" },
+  { "measure the write throughput of the output directories before capturing, refuse to start if too slow", NULL },
+  { "pin a thread role to CPUs, e.g. usb:2 or flac:4-7 (roles: " THREAD_ROLE_NAMES "), can be repeated", "[role:cpus]" },
+  { "run the USB callback, frame parser and extraction threads with real-time priority (SCHED_FIFO, MMCSS Pro Audio on Windows)", NULL },
+  { "keep the ringbuffers and all threads without --affinity on this NUMA node (the one of the USB controller)", "[node]" },
+  { "driver buffers (V4L2, default: 8) or outstanding reads (Media Foundation, default: 4) of a video capture device, more absorb longer stalls", "[count]" },
+  { "only copy each frame in the capture callback and check and unpack it on a parser thread, queueing up to depth frames, a power of two (default: 8)", "[=depth]" },
+  { "when the outputs fall behind give up display, aux, audio and higher FLAC levels in turn before dropping RF frames, e.g. display=30,audio=off,rf-wait=100 (default: display=50,aux=60,audio=70,flac=80 percent buffer fill, rf-wait=50 ms)", "[=policy]" },
+  { "size the ringbuffers to ride out output stalls of this long (default: 64 MB each, about 0.4 s)", "[seconds]" },
+  { "share this much memory out among the ringbuffers by data rate, caps --buffer-time (k, M or G suffix)", "[size]" },
+  { "smallest working ringbuffers, for boards with little RAM", NULL },
+  { "replay a raw capture (-r) or frame dump (--dump-frames) through the capture chain instead of a device", "[filename]" },
+  { "replay at N x real time (default: 1) or max for as fast as the outputs take it", "[speed]" },
+  { "start the replay over at the end of the file until stopped", NULL },
+  { "write the frames as the device sends them, for replaying with the CRC, stream ids and missed frames of the capture", "[filename]" },
+  { "low rate preview of both ADCs, min/max envelope and a spectrum every second (file, tcp://host:port, tcp://:port or shm://name)", "[filename]" },
+  { "capture samples per preview envelope entry, a power of two from 256 (default: 4096)", "[samples]" },
+  { "write -a, -b and -x only around events, one segment each: a>LEVEL, a<LEVEL, b>LEVEL, b<LEVEL, auxN+, auxN-, auxN or manual (SIGUSR2 triggers as well, not on Windows)", "[condition]" },
+  { "seconds before the trigger written with each event, kept in the capture ringbuffer (default: 1)", "[seconds]" },
+  { "seconds after the trigger written with each event (default: 5)", "[seconds]" },
+  { "serve live counters over HTTP, Prometheus at /metrics and JSON at /json (port alone binds to localhost, *:port to all interfaces)", "[[host:]port]" },
+  { "seconds between telemetry snapshots (default: 1)", "[seconds]" },
+#if TRACE_ENABLED == 1
+  { "write a timeline of the callback, ringbuffer waits, extraction, resampling, FLAC and file writes as Chrome trace JSON on exit (SIGUSR1 writes one to name.N meanwhile)", "[filename]" },
+#endif
   { 0, 0 }
 };
 
@@ -326,6 +649,20 @@ void usage(void)
 	exit(1);
 }
 
+static bool raw_writer_should_exit(void *UNUSED(user_ctx))
+{
+	return do_exit;
+}
+
+// all devices stop together, so their captures keep covering the same time
+static void close_devices(void)
+{
+	for (int i = 0; i < num_capture_devs; i++) {
+		if (capture_devs[i].hs_dev) { hsdaoh_close(capture_devs[i].hs_dev); capture_devs[i].hs_dev = NULL; }
+		if (capture_devs[i].sc_dev) { sc_stop_capture(capture_devs[i].sc_dev); capture_devs[i].sc_dev = NULL; }
+	}
+}
+
 #ifdef _WIN32
 BOOL WINAPI
 sighandler(int signum)
@@ -333,8 +670,7 @@ sighandler(int signum)
 	if (CTRL_C_EVENT == signum) {
 		fprintf(stderr, "Signal caught, exiting!\n");
 		do_exit = 1;
-		if (hs_dev) { hsdaoh_close(hs_dev); hs_dev = NULL; }
-		if (sc_dev) { sc_stop_capture(sc_dev); sc_dev = NULL; }
+		close_devices();
 		return true;
 	}
 	return FALSE;
@@ -345,14 +681,30 @@ static void sighandler(int UNUSED(signum))
 	signal(SIGPIPE, SIG_IGN);
 	fprintf(stderr, "Signal caught, exiting!\n");
 	do_exit = 1;
-	if (hs_dev) { hsdaoh_close(hs_dev); hs_dev = NULL; }
-	if (sc_dev) { sc_stop_capture(sc_dev); sc_dev = NULL; }
+	close_devices();
+}
+
+// --trigger: an event starts on every device, whatever the condition
+static void trigger_sighandler(int UNUSED(signum))
+{
+	for (int i = 0; i < num_capture_devs; i++)
+		if (capture_devs[i].o.trigger_on) record_trigger_fire(&capture_devs[i].trigger);
+}
+
+#if TRACE_ENABLED == 1
+// the dump is written on the trace thread
+static void trace_sighandler(int UNUSED(signum))
+{
+	trace_request_dump();
 }
 #endif
+#endif
 
-static void print_capture_message(void UNUSED(*ctx), enum hsdaoh_msg_level UNUSED(level), const char *format, ...)
+// ctx is the device tag, NULL with a single device
+static void print_capture_message(void *ctx, enum hsdaoh_msg_level UNUSED(level), const char *format, ...)
 {
 	va_list args;
+	if (ctx) fputs(ctx, stderr);
 	va_start(args, format);
 	vfprintf(stderr, format, args);
 	va_end(args);
@@ -362,10 +714,10 @@ static void print_capture_message(void UNUSED(*ctx), enum hsdaoh_msg_level UNUSE
 /* CLI sync progress callback - extends default with simple_capture warning */
 static void cli_sync_progress_cb(void *user_ctx, unsigned int non_sync_cnt)
 {
-	(void)user_ctx;
+	cli_capture_ctx_t *ctx = (cli_capture_ctx_t *)user_ctx;
 	capture_handler_default_progress(NULL, non_sync_cnt);
-	if (non_sync_cnt == 500 && sc_dev) {
-		print_capture_message(NULL, HSDAOH_ERROR, "Verify that your device does not modify the video data!\n");
+	if (non_sync_cnt == 500 && ctx->video_device) {
+		print_capture_message((void *)ctx->tag, HSDAOH_ERROR, "Verify that your device does not modify the video data!\n");
 	}
 }
 
@@ -377,24 +729,28 @@ static void cli_sync_event_cb(void *user_ctx, frame_sync_result_t result,
 
 	switch (result) {
 		case FRAME_SYNC_LOST:
-			if (was_synced)
-				print_capture_message(NULL, HSDAOH_ERROR, "Lost sync to HDMI input stream\n");
+			if (was_synced) {
+				telemetry_count(&ctx->sync_lost, 1);
+				print_capture_message((void *)ctx->tag, HSDAOH_ERROR, "Lost sync to HDMI input stream\n");
+			}
 			break;
 		case FRAME_SYNC_DUPLICATE:
 			break;
 		case FRAME_SYNC_MISSED:
-			print_capture_message(NULL, HSDAOH_ERROR, "Missed at least one frame, fcnt %d, expected %d!\n",
+			telemetry_count(&ctx->frames_missed, 1);
+			TRACE_INSTANT("frame_missed");
+			print_capture_message((void *)ctx->tag, HSDAOH_ERROR, "Missed at least one frame, fcnt %d, expected %d!\n",
 			                      meta->framecounter, ((ctx->handler.frame_state.sync.last_frame_cnt) & 0xffff));
 			break;
 		case FRAME_SYNC_ACQUIRED:
-			print_capture_message(NULL, HSDAOH_INFO, "Syncronized to HDMI input stream\n MISRC uses CRC: %s\n MISRC uses stream ids: %s\n",
+			print_capture_message((void *)ctx->tag, HSDAOH_INFO, "Syncronized to HDMI input stream\n MISRC uses CRC: %s\n MISRC uses stream ids: %s\n",
 			                      yesno[((meta->crc_config == CRC_NONE) ? 0 : 1)],
 			                      yesno[((meta->flags & FLAG_STREAM_ID_PRESENT) ? 1 : 0)]);
 			if (ctx->handler.capture_audio) {
 				if ((meta->flags & FLAG_STREAM_ID_PRESENT)) {
-					print_capture_message(NULL, HSDAOH_INFO, "Wait for RF and audio syncronisation...\n");
+					print_capture_message((void *)ctx->tag, HSDAOH_INFO, "Wait for RF and audio syncronisation...\n");
 				} else {
-					print_capture_message(NULL, HSDAOH_CRITICAL, "MISRC does not transmit audio, cannot capture audio!\n");
+					print_capture_message((void *)ctx->tag, HSDAOH_CRITICAL, "MISRC does not transmit audio, cannot capture audio!\n");
 					do_exit = 1;
 				}
 			}
@@ -407,13 +763,78 @@ static void cli_sync_event_cb(void *user_ctx, frame_sync_result_t result,
 /* CLI audio sync callback - notifies when audio is synced */
 static void cli_audio_sync_cb(void *user_ctx, bool synced)
 {
-	(void)user_ctx;
+	cli_capture_ctx_t *ctx = (cli_capture_ctx_t *)user_ctx;
 	if (synced) {
-		print_capture_message(NULL, HSDAOH_INFO, "Audio and RF now in sync\n");
+		print_capture_message((void *)ctx->tag, HSDAOH_INFO, "Audio and RF now in sync\n");
 	}
 }
 
-static void hsdaoh_callback(hsdaoh_data_info_t *data_info)
+/* Feed the sidecar index, sample offsets count the RF data committed so far */
+static void cli_index_frame(cli_capture_ctx_t *ctx, const metadata_t *meta,
+                            const frame_process_result_t *result, bool was_synced)
+{
+	switch (result->sync_result) {
+		case FRAME_SYNC_ACQUIRED:
+			sample_index_event(ctx->index, SAMPLE_INDEX_SYNC_ACQUIRED, ctx->rf_samples, meta->framecounter, 0);
+			break;
+		case FRAME_SYNC_LOST:
+			if (was_synced)
+				sample_index_event(ctx->index, SAMPLE_INDEX_SYNC_LOST, ctx->rf_samples, meta->framecounter, 0);
+			return;
+		case FRAME_SYNC_DUPLICATE:
+			return;
+		default:
+			break;
+	}
+	if (result->error_count > 0 && result->report_errors) {
+		sample_index_event(ctx->index, SAMPLE_INDEX_FRAME_ERRORS, ctx->rf_samples, meta->framecounter, (uint32_t)result->error_count);
+		return;
+	}
+	if (result->valid && result->stream0_copied > 0)
+		sample_index_frame(ctx->index, ctx->rf_samples, meta->framecounter, result->sync_result == FRAME_SYNC_MISSED, ctx->arrival_ns);
+}
+
+/* Late frames and slow callbacks go into the index at the sample the frame
+ * starts at, by whichever thread writes the index */
+static void cli_index_timing(cli_capture_ctx_t *ctx, uint64_t sample, unsigned flags,
+                             uint64_t interval_ns, uint64_t duration_ns, uint64_t arrival_ns)
+{
+	if (flags == 0 || ctx->index == NULL)
+		return;
+	uint16_t frame = (uint16_t)atomic_load_explicit(&ctx->last_frame, memory_order_relaxed);
+	if (flags & FRAME_TIMING_LATE)
+		sample_index_event_at(ctx->index, SAMPLE_INDEX_FRAME_LATE, sample, frame,
+		                      (uint32_t)(interval_ns / 1000), arrival_ns);
+	if (flags & FRAME_TIMING_SLOW)
+		sample_index_event_at(ctx->index, SAMPLE_INDEX_CALLBACK_SLOW, sample, frame,
+		                      (uint32_t)(duration_ns / 1000), arrival_ns);
+}
+
+/* Interval since the previous frame and time in the callback */
+static void cli_frame_timing(cli_capture_ctx_t *ctx, uint64_t sample)
+{
+	unsigned flags = frame_timing_add(&ctx->timing, ctx->arrival_ns, get_time_ns());
+	cli_index_timing(ctx, sample, flags, ctx->timing.interval_ns, ctx->timing.duration_ns, ctx->arrival_ns);
+}
+
+/* Frames are dumped as they arrive, before the parser sees them. The header
+ * takes the size of the first one, frames of another size are left out. */
+static void cli_dump_frame(cli_capture_ctx_t *ctx, const hsdaoh_data_info_t *data_info)
+{
+	if (ctx->dump_width == 0) {
+		ctx->dump_width = data_info->width;
+		ctx->dump_height = data_info->height;
+		if (replay_dump_header(ctx->dump, ctx->dump_width, ctx->dump_height) != 0) goto fail;
+	}
+	if (data_info->width != ctx->dump_width || data_info->height != ctx->dump_height) return;
+	if (fwrite(data_info->buf, (size_t)data_info->width * data_info->height * sizeof(uint16_t), 1, ctx->dump) == 1) return;
+fail:
+	print_capture_message((void *)ctx->tag, HSDAOH_ERROR, "Failed to write the frame dump, it ends here\n");
+	if (ctx->dump != stdout) fclose(ctx->dump);
+	ctx->dump = NULL;
+}
+
+static void capture_frame(hsdaoh_data_info_t *data_info)
 {
 	cli_capture_ctx_t *ctx = data_info->ctx;
 	if (do_exit || !ctx)
@@ -421,6 +842,8 @@ static void hsdaoh_callback(hsdaoh_data_info_t *data_info)
 
 	capture_handler_ctx_t *handler = &ctx->handler;
 
+	if (ctx->dump) cli_dump_frame(ctx, data_info);
+
 	metadata_t meta;
 	hsdaoh_extract_metadata(data_info->buf, &meta, data_info->width);
 
@@ -428,217 +851,523 @@ static void hsdaoh_callback(hsdaoh_data_info_t *data_info)
 	if (!was_synced && handler->progress_cb)
 		handler->progress_cb(handler->user_ctx, handler->frame_state.sync.non_sync_cnt);
 
-	/* Process frame */
-	frame_process_result_t result = frame_process(&handler->frame_state,
-	                                               data_info->buf,
-	                                               data_info->width,
-	                                               data_info->height,
-	                                               &meta, 4);
+	/* Reserve ringbuffer space up front, payloads are scattered while the
+	 * frame is validated. Nothing is copied before sync, so only then. */
+	uint8_t *buf_out = NULL;
+	uint8_t *buf_out_audio = NULL;
+	bool drop_rf = false, drop_audio = false;
+
+	/* With --overload a frame that finds no space is dropped instead, the
+	 * device keeps being drained and the gap is logged */
+	if (was_synced && handler->capture_rf) {
+		if (ctx->overload) {
+			buf_out = rb_write_ptr_wait(&ctx->rb, data_info->len, overload_rf_wait_ms(ctx->overload));
+			drop_rf = (buf_out == NULL);
+		}
+		else while ((buf_out = rb_write_ptr_wait(&ctx->rb, data_info->len, RB_WAIT_MS)) == NULL) {
+			if (do_exit) return;
+			print_capture_message((void *)ctx->tag, HSDAOH_WARNING, "Cannot get space in ringbuffer for next frame (RF)\n");
+		}
+	}
+
+	if (was_synced && handler->capture_audio) {
+		if (ctx->overload) {
+			if (!overload_shed(ctx->overload, OVERLOAD_AUDIO))
+				buf_out_audio = rb_write_ptr_wait(&ctx->rb_audio, data_info->len, overload_rf_wait_ms(ctx->overload));
+			drop_audio = (buf_out_audio == NULL);
+		}
+		else while ((buf_out_audio = rb_write_ptr_wait(&ctx->rb_audio, data_info->len, RB_WAIT_MS)) == NULL) {
+			if (do_exit) return;
+			print_capture_message((void *)ctx->tag, HSDAOH_WARNING, "Cannot get space in ringbuffer for next frame (audio)\n");
+		}
+	}
+
+	/* Process frame and copy payloads with audio sync filtering in one pass */
+	TRACE_BEGIN("frame_process");
+	frame_process_result_t result = frame_process_and_copy(&handler->frame_state,
+	                                                       data_info->buf,
+	                                                       data_info->width,
+	                                                       data_info->height,
+	                                                       &meta, 4,
+	                                                       buf_out, buf_out_audio,
+	                                                       capture_handler_audio_filter, handler);
+	TRACE_END("frame_process");
+
+	if (ctx->index && handler->capture_rf)
+		cli_index_frame(ctx, &meta, &result, was_synced);
 
 	/* Handle sync events using shared module */
 	if (!capture_handler_process_sync_event(handler, result.sync_result, &meta, was_synced))
 		return;
 
-	/* Handle errors */
+	/* Handle errors, the reserved space is simply not committed */
 	if (result.error_count > 0 && result.report_errors) {
-		print_capture_message(NULL, HSDAOH_ERROR, "%d frame errors, %d frames since last error\n",
+		telemetry_count(&ctx->frame_errors, (uint64_t)result.error_count);
+		print_capture_message((void *)ctx->tag, HSDAOH_ERROR, "%d frame errors, %d frames since last error\n",
 		                      result.error_count, handler->frame_state.frames_since_error);
 		return;
 	}
 
 	if (!result.valid)
 		return;
+	telemetry_count(&ctx->frames, 1);
+	frame_timing_set_period(&ctx->timing, result.stream0_bytes / 4, meta.stream_info[0].srate);
 
-	/* Allocate ringbuffer space */
-	uint8_t *buf_out = NULL;
-	uint8_t *buf_out_audio = NULL;
+	/* Commit to ringbuffers */
+	if (buf_out) {
+		rb_write_finished(&ctx->rb, result.stream0_copied);
+		overload_resume(ctx->overload, OVERLOAD_STREAM_RF);
+		ctx->rf_samples += result.stream0_copied / 4;
+		atomic_store_explicit(&ctx->last_frame, meta.framecounter, memory_order_relaxed);
+	}
+	else if (drop_rf && result.stream0_bytes > 0) {
+		TRACE_INSTANT("frame_dropped");
+		overload_gap(ctx->overload, OVERLOAD_STREAM_RF, ctx->rf_samples, result.stream0_bytes / 4);
+		if (ctx->index)
+			sample_index_event(ctx->index, SAMPLE_INDEX_FRAME_DROPPED, ctx->rf_samples, meta.framecounter, 1);
+	}
+	if (buf_out_audio) {
+		rb_write_finished(&ctx->rb_audio, result.stream1_copied);
+		overload_resume(ctx->overload, OVERLOAD_STREAM_AUDIO);
+		ctx->audio_samples += result.stream1_copied / 12;
+	}
+	else if (drop_audio && result.stream1_bytes > 0) {
+		overload_gap(ctx->overload, OVERLOAD_STREAM_AUDIO, ctx->audio_samples, result.stream1_bytes / 12);
+	}
+}
 
-	if (handler->capture_rf) {
-		while ((buf_out = rb_write_ptr(&ctx->rb, data_info->len)) == NULL) {
-			if (do_exit) return;
-			print_capture_message(NULL, HSDAOH_WARNING, "Cannot get space in ringbuffer for next frame (RF)\n");
-			sleep_ms(4);
-		}
+// --parser-thread: the callback only copies the frame into the queue. Without
+// --overload it waits for a free slot like capture_frame() waits for ringbuffer
+// space, with it the frame is dropped and the parser sees the missed frame.
+static void queue_frame(cli_capture_ctx_t *ctx, hsdaoh_data_info_t *data_info, uint64_t arrival)
+{
+	frame_queue_slot_t *slot;
+	if (do_exit)
+		return;
+
+	TRACE_BEGIN("usb_callback");
+	if (data_info->len > frame_queue_slot_size(ctx->queue))
+		slot = NULL;
+	else if (ctx->overload)
+		slot = frame_queue_write_slot(ctx->queue, data_info->len, 0);
+	else while ((slot = frame_queue_write_slot(ctx->queue, data_info->len, RB_WAIT_MS)) == NULL) {
+		if (do_exit) break;
+		print_capture_message((void *)ctx->tag, HSDAOH_WARNING, "Cannot get space in frame queue for next frame\n");
+	}
+	if (slot) {
+		if (data_info->len) memcpy(slot->buf, data_info->buf, data_info->len);
+		slot->len = data_info->len;
+		slot->width = data_info->width;
+		slot->height = data_info->height;
+		slot->arrival_ns = arrival;
+		slot->device_error = data_info->device_error;
+		ctx->queue_dropping = false;
+	}
+	else if (!do_exit) {
+		TRACE_INSTANT("frame_dropped");
+		frame_queue_drop(ctx->queue);
+		if (!ctx->queue_dropping)
+			print_capture_message((void *)ctx->tag, HSDAOH_WARNING, "Frame queue full, dropping frames\n");
+		ctx->queue_dropping = true;
+	}
+	TRACE_END("usb_callback");
+
+	// the callback's own times go with the frame, the parser puts the outliers into the index
+	unsigned flags = frame_timing_add(&ctx->timing, arrival, get_time_ns());
+	if (slot) {
+		slot->timing_flags = flags;
+		slot->interval_ns = ctx->timing.interval_ns;
+		slot->duration_ns = ctx->timing.duration_ns;
+		frame_queue_write_finished(ctx->queue);
 	}
+}
 
-	if (handler->capture_audio) {
-		while ((buf_out_audio = rb_write_ptr(&ctx->rb_audio, data_info->len)) == NULL) {
-			if (do_exit) return;
-			print_capture_message(NULL, HSDAOH_WARNING, "Cannot get space in ringbuffer for next frame (audio)\n");
-			sleep_ms(4);
+// hsdaoh and simple_capture callback, one span per frame in --trace
+// every frame is timestamped on arrival, before anything else is done with it
+static void hsdaoh_callback(hsdaoh_data_info_t *data_info)
+{
+	uint64_t arrival = get_time_ns();
+	cli_capture_ctx_t *ctx = data_info->ctx;
+	thread_role_apply(THREAD_ROLE_USB);
+	if (ctx && ctx->queue) {
+		queue_frame(ctx, data_info, arrival);
+		return;
+	}
+	uint64_t sample = ctx ? ctx->rf_samples : 0;
+	if (ctx) ctx->arrival_ns = arrival;
+	TRACE_BEGIN("usb_callback");
+	capture_frame(data_info);
+	TRACE_END("usb_callback");
+	if (ctx && !do_exit) cli_frame_timing(ctx, sample);
+}
+
+// --parser-thread: sync, CRC, idle checks and the payload scatter of the queued
+// frames, everything the callback does without it, one span per frame in --trace
+static int frame_parser_thread(void *arg)
+{
+	capture_dev_t *dev = arg;
+	cli_capture_ctx_t *ctx = &dev->cap_ctx;
+	thread_role_apply(THREAD_ROLE_PARSER);
+
+	while (!do_exit) {
+		frame_queue_slot_t *slot = frame_queue_read_slot_wait(ctx->queue, RB_WAIT_MS);
+		if (slot == NULL) {
+			if (atomic_load(&dev->parser_stop)) break;
+			continue;
 		}
+		hsdaoh_data_info_t info;
+		memset(&info, 0, sizeof(info));
+		info.ctx = ctx;
+		info.buf = slot->buf;
+		info.len = slot->len;
+		info.width = slot->width;
+		info.height = slot->height;
+		info.device_error = slot->device_error;
+
+		uint64_t start = get_time_ns();
+		uint64_t sample = ctx->rf_samples;
+		ctx->arrival_ns = slot->arrival_ns;
+		TRACE_BEGIN("frame_parse");
+		capture_frame(&info);
+		TRACE_END("frame_parse");
+		frame_timing_add_parse(&ctx->timing, get_time_ns() - start);
+		cli_index_timing(ctx, sample, slot->timing_flags, slot->interval_ns, slot->duration_ns, slot->arrival_ns);
+		frame_queue_read_finished(ctx->queue);
 	}
+	return 0;
+}
+
+// fill in the placeholder header at the start of a wave file
+static void finish_wave_file(FILE *f, uint64_t total_bytes, uint16_t channels)
+{
+	wave_header_t h;
+	fseek(f, 0, SEEK_SET);
+	create_wave_header(&h, total_bytes/12, 78125, channels, 24);
+	fwrite(&h, 1, sizeof(wave_header_t), f);
+}
 
-	/* Copy payloads with audio sync filtering using shared module */
-	frame_copy_payloads_cb(data_info->buf, data_info->width, data_info->height,
-	                        &meta, buf_out, buf_out_audio,
-	                        capture_handler_audio_filter, handler);
+static void close_output(FILE *f, file_segment_t *seg)
+{
+	if (seg) file_segment_close(seg);
+	else if (f != stdout) fclose(f);
+}
 
-	/* Commit to ringbuffers */
-	if (handler->capture_rf)
-		rb_write_finished(&ctx->rb, result.stream0_bytes);
-	if (handler->capture_audio)
-		rb_write_finished(&ctx->rb_audio, result.stream1_bytes);
+// start an audio output: a placeholder wave header (not on a pipe) filled in
+// by audio_output_finish(), or a FLAC stream
+static bool audio_output_start(audiowriter_ctx_t *audio_ctx, FILE *f, file_segment_t *seg,
+                               flac_writer_t **flac, uint8_t channels)
+{
+	wave_header_t h;
+	if (!audio_ctx->flac) {
+		memset(&h,0,sizeof(wave_header_t));
+		if (f != stdout) fwrite(&h, 1, sizeof(wave_header_t), f);
+		return true;
+	}
+	flac_writer_config_t config = audio_ctx->flac_config;
+	config.channels = channels;
+	// segment sizes need the byte count only the stream mode keeps
+	*flac = seg ? flac_writer_create_stream(f, &config) : flac_writer_create_file(f, &config);
+	if (*flac == NULL) {
+		fprintf(stderr, "ERROR: failed to create FLAC writer for audio\n");
+		return false;
+	}
+	return true;
+}
+
+// write a block of 24 bit samples, interleaved if there are several channels
+static void audio_output_write(audiowriter_ctx_t *audio_ctx, FILE *f, flac_writer_t *flac,
+                               const uint8_t *buf, size_t len, uint8_t channels)
+{
+	if (!audio_ctx->flac) {
+		fwrite(buf, 1, len, f);
+		return;
+	}
+	size_t samples = len / (3 * channels);
+	int32_t *out = audio_ctx->flac_buf;
+	if (flac == NULL || samples == 0) return;
+	// sign extended from the top byte
+	for (size_t i = 0; i < samples * channels; i++, buf += 3)
+		out[i] = (int32_t)((uint32_t)buf[0] << 8 | (uint32_t)buf[1] << 16 | (uint32_t)buf[2] << 24) >> 8;
+	if (flac_writer_process(flac, out, (uint32_t)samples) < 0) {
+		fprintf(stderr, "ERROR: audio FLAC encoder could not process data\n");
+		new_line = 1;
+	}
+}
+
+// complete an audio output before it is closed or replaced by the next segment
+static void audio_output_finish(audiowriter_ctx_t *audio_ctx, FILE *f, flac_writer_t **flac, uint16_t channels)
+{
+	if (!audio_ctx->flac) {
+		if (f != stdout) finish_wave_file(f, audio_ctx->total_bytes, channels);
+		return;
+	}
+	if (*flac != NULL && flac_writer_finish(*flac) != FLAC_WRITER_OK) {
+		fprintf(stderr, "ERROR: audio FLAC encoder did not finish correctly\n");
+		new_line = 1;
+	}
+	*flac = NULL;
+}
+
+// all audio outputs roll over together, at the size of the largest one
+static bool audio_segment_due(audiowriter_ctx_t *audio_ctx)
+{
+	uint64_t file_bytes = audio_ctx->total_bytes;
+	bool due = false;
+	if (audio_ctx->flac) {
+		file_bytes = flac_writer_get_bytes_written(audio_ctx->flac_4ch);
+		for (int i=0; i<2; i++) if (flac_writer_get_bytes_written(audio_ctx->flac_2ch[i]) > file_bytes) file_bytes = flac_writer_get_bytes_written(audio_ctx->flac_2ch[i]);
+		for (int i=0; i<4; i++) if (flac_writer_get_bytes_written(audio_ctx->flac_1ch[i]) > file_bytes) file_bytes = flac_writer_get_bytes_written(audio_ctx->flac_1ch[i]);
+	}
+	else if (audio_ctx->f_4ch == NULL) file_bytes /= (audio_ctx->f_2ch[0] || audio_ctx->f_2ch[1]) ? 2 : 4;
+	if (audio_ctx->seg_4ch) due |= file_segment_due(audio_ctx->seg_4ch, file_bytes, audio_ctx->total_bytes);
+	for (int i=0; i<2; i++) if (audio_ctx->seg_2ch[i]) due |= file_segment_due(audio_ctx->seg_2ch[i], file_bytes, audio_ctx->total_bytes);
+	for (int i=0; i<4; i++) if (audio_ctx->seg_1ch[i]) due |= file_segment_due(audio_ctx->seg_1ch[i], file_bytes, audio_ctx->total_bytes);
+	return due;
+}
+
+static void audio_next_segment(audiowriter_ctx_t *audio_ctx)
+{
+	// only switch if every output can, so they keep covering the same samples
+	bool ready = true;
+	if (audio_ctx->seg_4ch) ready &= file_segment_wait_next(audio_ctx->seg_4ch);
+	for (int i=0; i<2; i++) if (audio_ctx->seg_2ch[i]) ready &= file_segment_wait_next(audio_ctx->seg_2ch[i]);
+	for (int i=0; i<4; i++) if (audio_ctx->seg_1ch[i]) ready &= file_segment_wait_next(audio_ctx->seg_1ch[i]);
+	if (!ready) return;
+	if (audio_ctx->seg_4ch) {
+		audio_output_finish(audio_ctx, audio_ctx->f_4ch, &audio_ctx->flac_4ch, 4);
+		audio_ctx->f_4ch = file_segment_next(audio_ctx->seg_4ch);
+		audio_output_start(audio_ctx, audio_ctx->f_4ch, audio_ctx->seg_4ch, &audio_ctx->flac_4ch, 4);
+	}
+	for (int i=0; i<2; i++) {
+		if (audio_ctx->seg_2ch[i]) {
+			audio_output_finish(audio_ctx, audio_ctx->f_2ch[i], &audio_ctx->flac_2ch[i], 2);
+			audio_ctx->f_2ch[i] = file_segment_next(audio_ctx->seg_2ch[i]);
+			audio_output_start(audio_ctx, audio_ctx->f_2ch[i], audio_ctx->seg_2ch[i], &audio_ctx->flac_2ch[i], 2);
+		}
+	}
+	for (int i=0; i<4; i++) {
+		if (audio_ctx->seg_1ch[i]) {
+			audio_output_finish(audio_ctx, audio_ctx->f_1ch[i], &audio_ctx->flac_1ch[i], 1);
+			audio_ctx->f_1ch[i] = file_segment_next(audio_ctx->seg_1ch[i]);
+			audio_output_start(audio_ctx, audio_ctx->f_1ch[i], audio_ctx->seg_1ch[i], &audio_ctx->flac_1ch[i], 1);
+		}
+	}
+	audio_ctx->total_bytes = 0;
 }
 
+// the audio ringbuffer into the WAV or FLAC outputs, the FLAC encoders run on
+// this thread (and the flac threads of the RF options)
 int audio_file_writer(void *ctx)
 {
 	audiowriter_ctx_t *audio_ctx = ctx;
 	size_t len = BUFFER_AUDIO_READ_SIZE;
 	void *buf;
-	wave_header_t h;
+	bool ok = true;
 	bool convert_1ch = false;
 	bool convert_2ch = false;
 	uint8_t* buffer_1ch[4];
 	uint8_t* buffer_2ch[2];
-	memset(&h,0,sizeof(wave_header_t));
+	conv_audio_t conv_audio = NULL;
 	audio_ctx->total_bytes = 0;
-	if (audio_ctx->f_4ch != NULL && audio_ctx->f_4ch != stdout) fwrite(&h, 1, sizeof(wave_header_t), audio_ctx->f_4ch);
+	if (audio_ctx->flac && (audio_ctx->flac_buf = malloc(BUFFER_AUDIO_READ_SIZE / 3 * sizeof(int32_t))) == NULL) {
+		do_exit = 1;
+		return -1;
+	}
+	if (audio_ctx->f_4ch != NULL) ok &= audio_output_start(audio_ctx, audio_ctx->f_4ch, audio_ctx->seg_4ch, &audio_ctx->flac_4ch, 4);
 	for (int i=0; i<2; i++) {
 		if (audio_ctx->f_2ch[i] != NULL) {
-			if (audio_ctx->f_2ch[i] != stdout) fwrite(&h, 1, sizeof(wave_header_t), audio_ctx->f_2ch[i]);
+			ok &= audio_output_start(audio_ctx, audio_ctx->f_2ch[i], audio_ctx->seg_2ch[i], &audio_ctx->flac_2ch[i], 2);
 			convert_2ch = true;
 		}
 	}
 	for (int i=0; i<4; i++) {
 		if (audio_ctx->f_1ch[i] != NULL) {
-			if (audio_ctx->f_1ch[i] != stdout) fwrite(&h, 1, sizeof(wave_header_t), audio_ctx->f_1ch[i]);
+			ok &= audio_output_start(audio_ctx, audio_ctx->f_1ch[i], audio_ctx->seg_1ch[i], &audio_ctx->flac_1ch[i], 1);
 			convert_1ch = true;
 		}
 	}
+	if (!ok) do_exit = 1;
 	if (convert_1ch) {
-		if ((buffer_1ch[0] = aligned_alloc(32, BUFFER_AUDIO_READ_SIZE)) == NULL) {
+		if ((buffer_1ch[0] = buffer_pool_get(audio_ctx->pool, BUFFER_AUDIO_READ_SIZE)) == NULL) {
 			do_exit = 1;
 			return -1;
 		}
 		for (int i=1; i<4; i++) buffer_1ch[i] = buffer_1ch[0] + (BUFFER_AUDIO_READ_SIZE/4)*i;
 	}
 	if (convert_2ch) {
-		if ((buffer_2ch[0] = aligned_alloc(32, BUFFER_AUDIO_READ_SIZE)) == NULL) {
+		if ((buffer_2ch[0] = buffer_pool_get(audio_ctx->pool, BUFFER_AUDIO_READ_SIZE)) == NULL) {
 			do_exit = 1;
 			return -1;
 		}
 		buffer_2ch[1] = buffer_2ch[0] + (BUFFER_AUDIO_READ_SIZE/2);
 	}
+	if (convert_1ch || convert_2ch) conv_audio = get_audio_function();
+	bool segmented = audio_ctx->seg_4ch || audio_ctx->seg_2ch[0] || audio_ctx->seg_2ch[1] ||
+	                 audio_ctx->seg_1ch[0] || audio_ctx->seg_1ch[1] || audio_ctx->seg_1ch[2] || audio_ctx->seg_1ch[3];
 	while(true) {
-		while(((buf = rb_read_ptr(audio_ctx->rb, len)) == NULL) && !do_exit) {
-			thrd_sleep(&(struct timespec){.tv_nsec=10000000}, NULL);
-		}
+		while(((buf = rb_read_ptr_wait(audio_ctx->rb, len, RB_WAIT_MS)) == NULL) && !do_exit) {}
 		if (do_exit) {
-			len = audio_ctx->rb->tail - audio_ctx->rb->head;
+			len = rb_available(audio_ctx->rb);
 			if (len == 0) break;
+			if (len > BUFFER_AUDIO_READ_SIZE) len = BUFFER_AUDIO_READ_SIZE;
 			buf = rb_read_ptr(audio_ctx->rb, len);
 		}
-		if (audio_ctx->f_4ch != NULL) fwrite(buf, 1, len, audio_ctx->f_4ch);
-		if (convert_1ch) extract_audio_1ch_C(buf, len, buffer_1ch[0], buffer_1ch[1], buffer_1ch[2], buffer_1ch[3]);
-		if (convert_2ch) extract_audio_2ch_C(buf, len, (uint16_t*)buffer_2ch[0], (uint16_t*)buffer_2ch[1]);
+		if (segmented && audio_segment_due(audio_ctx)) audio_next_segment(audio_ctx);
+		if (audio_ctx->f_4ch != NULL) audio_output_write(audio_ctx, audio_ctx->f_4ch, audio_ctx->flac_4ch, buf, len, 4);
+		// single pass over the block for both the 2ch and 1ch outputs
+		if (conv_audio != NULL) conv_audio(buf, len, convert_2ch ? buffer_2ch : NULL, convert_1ch ? buffer_1ch : NULL);
 		rb_read_finished(audio_ctx->rb, len);
-		for (int i=0; i<2; i++) if (audio_ctx->f_2ch[i] != NULL) fwrite(buffer_2ch[i], 1, len/2, audio_ctx->f_2ch[i]);
-		for (int i=0; i<4; i++) if (audio_ctx->f_1ch[i] != NULL) fwrite(buffer_1ch[i], 1, len/4, audio_ctx->f_1ch[i]);
+		for (int i=0; i<2; i++) if (audio_ctx->f_2ch[i] != NULL) audio_output_write(audio_ctx, audio_ctx->f_2ch[i], audio_ctx->flac_2ch[i], buffer_2ch[i], len/2, 2);
+		for (int i=0; i<4; i++) if (audio_ctx->f_1ch[i] != NULL) audio_output_write(audio_ctx, audio_ctx->f_1ch[i], audio_ctx->flac_1ch[i], buffer_1ch[i], len/4, 1);
 		audio_ctx->total_bytes += len;
 	}
-	if (audio_ctx->f_4ch != NULL && audio_ctx->f_4ch != stdout) {
-		fseek(audio_ctx->f_4ch, 0, SEEK_SET);
-		create_wave_header(&h, audio_ctx->total_bytes/12, 78125, 4, 24);
-		fwrite(&h, 1, sizeof(wave_header_t), audio_ctx->f_4ch);
-		fclose(audio_ctx->f_4ch);
+	if (audio_ctx->f_4ch != NULL) {
+		audio_output_finish(audio_ctx, audio_ctx->f_4ch, &audio_ctx->flac_4ch, 4);
+		if (audio_ctx->f_4ch != stdout) close_output(audio_ctx->f_4ch, audio_ctx->seg_4ch);
 	}
 	for (int i=0; i<2; i++) {
-		if (audio_ctx->f_2ch[i] != NULL && audio_ctx->f_2ch[i] != stdout) {
-			fseek(audio_ctx->f_2ch[i], 0, SEEK_SET);
-			create_wave_header(&h, audio_ctx->total_bytes/12, 78125, 2, 24);
-			fwrite(&h, 1, sizeof(wave_header_t), audio_ctx->f_2ch[i]);
-			fclose(audio_ctx->f_2ch[i]);
+		if (audio_ctx->f_2ch[i] != NULL) {
+			audio_output_finish(audio_ctx, audio_ctx->f_2ch[i], &audio_ctx->flac_2ch[i], 2);
+			if (audio_ctx->f_2ch[i] != stdout) close_output(audio_ctx->f_2ch[i], audio_ctx->seg_2ch[i]);
 		}
 	}
 	for (int i=0; i<4; i++) {
-		if (audio_ctx->f_1ch[i] != NULL && audio_ctx->f_1ch[i] != stdout) {
-			fseek(audio_ctx->f_1ch[i], 0, SEEK_SET);
-			create_wave_header(&h, audio_ctx->total_bytes/12, 78125, 1, 24);
-			fwrite(&h, 1, sizeof(wave_header_t), audio_ctx->f_1ch[i]);
-			fclose(audio_ctx->f_1ch[i]);
+		if (audio_ctx->f_1ch[i] != NULL) {
+			audio_output_finish(audio_ctx, audio_ctx->f_1ch[i], &audio_ctx->flac_1ch[i], 1);
+			if (audio_ctx->f_1ch[i] != stdout) close_output(audio_ctx->f_1ch[i], audio_ctx->seg_1ch[i]);
 		}
 	}
-	if (convert_1ch) aligned_free(buffer_1ch[0]);
-	if (convert_2ch) aligned_free(buffer_2ch[0]);
+	if (convert_1ch) buffer_pool_put(audio_ctx->pool, buffer_1ch[0]);
+	if (convert_2ch) buffer_pool_put(audio_ctx->pool, buffer_2ch[0]);
+	free(audio_ctx->flac_buf);
 	return 0;
 }
 
 
-int raw_file_writer(void *ctx)
+// 12 bit samples packed into 3 bytes per pair, 25% less to write than the 16 bit ringbuffer
+static int packed_file_writer(filewriter_ctx_t *file_ctx)
 {
-	filewriter_ctx_t *file_ctx = ctx;
 	size_t len = BUFFER_READ_SIZE;
 	void *buf;
-#if LIBSOXR_ENABLED == 1
-	/* setup resampling */
-	uint8_t *resample_buffer;
-	uint8_t *resample_buffer_b;
-	soxr_t resampler = NULL;
-	soxr_error_t soxr_err;
-	if (file_ctx->resample_rate!=0.0) {
-		soxr_io_spec_t io_spec = soxr_io_spec(SOXR_INT16_S, SOXR_INT16_S);
-		soxr_quality_spec_t qual_spec = soxr_quality_spec(file_ctx->resample_qual, 0);
-		io_spec.scale = file_ctx->init_scale;
-		io_spec.scale *= pow(10.0,file_ctx->resample_gain/20.0);
-		resample_buffer = aligned_alloc(32, BUFFER_READ_SIZE);
-		resample_buffer_b = aligned_alloc(32, BUFFER_READ_SIZE);
-		if (!resample_buffer || !resample_buffer_b) {
-			fprintf(stderr, "ERROR: failed allocating resampling buffer\n");
-			do_exit = 1;
-			return 0;
-		}
-		resampler = soxr_create(40000.0, file_ctx->resample_rate, 1, &soxr_err, &io_spec, &qual_spec, NULL);
-		if (!resampler || soxr_err!=0) {
-			fprintf(stderr, "ERROR: failed allocating resampling context: %s\n", soxr_err);
-			do_exit = 1;
-			return 0;
-		}
+	uint8_t *pack_buffer = buffer_pool_get(file_ctx->pool, PACKED12_SIZE(BUFFER_READ_SIZE/2));
+	uint64_t seg_in = 0, seg_out = 0;
+	if (!pack_buffer) {
+		fprintf(stderr, "ERROR: failed allocating packing buffer\n");
+		do_exit = 1;
+		return 0;
 	}
-#endif
 	while(true) {
-		while(((buf = rb_read_ptr(&file_ctx->rb, len)) == NULL) && !do_exit) {
-			//ms_sleep(10);
-			thrd_sleep(&(struct timespec){.tv_nsec=10000000}, NULL);
-		}
+		size_t out_len;
+		while(((buf = rb_read_ptr_wait(&file_ctx->rb, len, RB_WAIT_MS)) == NULL) && !do_exit) {}
 		if (do_exit) {
-			len = file_ctx->rb.tail - file_ctx->rb.head;
+			len = rb_available(&file_ctx->rb);
 			if (len == 0) break;
+			if (len > BUFFER_READ_SIZE) len = BUFFER_READ_SIZE;
 			buf = rb_read_ptr(&file_ctx->rb, len);
 		}
-#if LIBSOXR_ENABLED == 1
-		if (file_ctx->resample_rate!=0) {
-			size_t out_len;
-			soxr_err = soxr_process(resampler, &buf, len>>1, &len, &resample_buffer, len>>1, &out_len);
-			len<<=1;
-			if (soxr_err != 0) {
-				fprintf(stderr, "Error while converting: %s\n", soxr_err);
-				do_exit = 1;
-				return 0;
-			}
-			if (file_ctx->reduce_8bit) {
-				conv_16to8((int16_t*)resample_buffer, (int8_t*)resample_buffer_b, out_len);
-				fwrite(resample_buffer_b, 1, out_len, file_ctx->f);
-			}
-			else {
-				fwrite(resample_buffer, 1, out_len<<1, file_ctx->f);
+		if (file_ctx->seg && file_segment_due(file_ctx->seg, seg_out, seg_in)) {
+			FILE *next = file_segment_next(file_ctx->seg);
+			if (next) {
+				file_ctx->f = next;
+				seg_in = seg_out = 0;
 			}
-		} else {
-			fwrite(buf, 1, len, file_ctx->f);
 		}
-#else
-		fwrite(buf, 1, len, file_ctx->f);
-#endif
+		out_len = PACKED12_SIZE(len>>1);
+		conv_16to12p((int16_t*)buf, pack_buffer, len>>1);
 		rb_read_finished(&file_ctx->rb, len);
+		fwrite(pack_buffer, 1, out_len, file_ctx->f);
+		seg_in += len;
+		seg_out += out_len;
 	}
-	if (file_ctx->f != stdout) fclose(file_ctx->f);
+	close_output(file_ctx->f, file_ctx->seg);
+	buffer_pool_put(file_ctx->pool, pack_buffer);
+	return 0;
+}
+
+// whether an RF output goes through the resampling stage (soxr or the decimators)
+static bool rf_resampled(const filewriter_ctx_t *file_ctx)
+{
+#if LIBSOXR_ENABLED == 1
+	if (file_ctx->resample_rate != 0.0) return true;
+#endif
+	return file_ctx->decimation != 0;
+}
+
+// output sample rate of an RF output in kHz
+static double rf_output_rate(const filewriter_ctx_t *file_ctx)
+{
+#if LIBSOXR_ENABLED == 1
+	if (file_ctx->resample_rate != 0.0) return file_ctx->resample_rate;
+#endif
+	return 40000.0 / (file_ctx->decimation ? file_ctx->decimation : 1);
+}
+
+// the resampling stage between the channel ringbuffer and a writer
+static resample_stage_t *start_resample_stage(filewriter_ctx_t *file_ctx, conv_16to8_t conv_8bit)
+{
+	resample_stage_config_t cfg;
+	resample_stage_config_init(&cfg, &file_ctx->rb, BUFFER_READ_SIZE, 40000.0, rf_output_rate(file_ctx));
+	cfg.decimation = file_ctx->decimation;
 #if LIBSOXR_ENABLED == 1
-	if (file_ctx->resample_rate!=0) {
-		aligned_free(resample_buffer);
-		aligned_free(resample_buffer_b);
-		soxr_delete(resampler);
+	cfg.quality = file_ctx->resample_qual;
+	cfg.scale = file_ctx->init_scale * pow(10.0,file_ctx->resample_gain/20.0);
+#endif
+	cfg.conv_8bit = conv_8bit;
+	cfg.should_exit = raw_writer_should_exit;
+	return resample_stage_start(&cfg);
+}
+
+int raw_file_writer(void *ctx)
+{
+	filewriter_ctx_t *file_ctx = ctx;
+	size_t len = BUFFER_READ_SIZE;
+	thread_role_apply(file_ctx->role);
+	if (file_ctx->packed_12bit) return packed_file_writer(file_ctx);
+	if (file_ctx->net) {
+		// the ringbuffer is sent as is, a slow link backs up into it like a slow disk
+		net_sink_run(file_ctx->net, &file_ctx->rb, len, raw_writer_should_exit, NULL, NULL, file_ctx->frame);
+		if (net_sink_failed(file_ctx->net)) {
+			fprintf(stderr, "Network output lost, stopping the capture\n");
+			do_exit = true;
+		}
+		net_sink_close(file_ctx->net);
+		return 0;
+	}
+	if (!rf_resampled(file_ctx)) {
+		// nothing to convert, the ringbuffer goes to the file as is
+		rb_writer_config_t writer_cfg;
+		rb_writer_config_init(&writer_cfg, &file_ctx->rb, file_ctx->f, len);
+		writer_cfg.should_exit_cb = raw_writer_should_exit;
+		writer_cfg.backend = file_ctx->io_backend;
+		writer_cfg.queue_depth = file_ctx->io_depth;
+		writer_cfg.direct = file_ctx->io_direct;
+		writer_cfg.segment = file_ctx->seg;
+		rb_writer_run(&writer_cfg);
+		close_output(file_ctx->f, file_ctx->seg);
+		return 0;
 	}
+	/* resampling runs as a stage of its own, this thread only writes its output */
+	rb_writer_config_t writer_cfg;
+	conv_16to8_t conv_8bit = NULL;
+#if LIBSOXR_ENABLED == 1
+	if (file_ctx->reduce_8bit) conv_8bit = conv_16to8;
 #endif
+	resample_stage_t *stage = start_resample_stage(file_ctx, conv_8bit);
+	if (!stage) {
+		do_exit = 1;
+		return 0;
+	}
+	rb_writer_config_init(&writer_cfg, resample_stage_output(stage), file_ctx->f, RESAMPLE_WRITE_SIZE);
+	writer_cfg.should_exit_cb = resample_stage_done;
+	writer_cfg.user_ctx = stage;
+	writer_cfg.backend = file_ctx->io_backend;
+	writer_cfg.queue_depth = file_ctx->io_depth;
+	writer_cfg.direct = file_ctx->io_direct;
+	writer_cfg.segment = file_ctx->seg;
+	rb_writer_run(&writer_cfg);
+	if (resample_stage_failed(stage)) do_exit = 1;
+	resample_stage_stop(stage);
+	close_output(file_ctx->f, file_ctx->seg);
 	return 0;
 }
 
@@ -650,128 +1379,244 @@ static void cli_flac_error_callback(void *user_data, flac_writer_error_t error,
 	fprintf(stderr, "FLAC ERROR: %s\n", message);
 }
 
+// Backlog callback for the adaptive level, the channel ringbuffer fills when the encoder falls behind
+// the flac step of --overload reports a full buffer, which steps the level down
+static double cli_flac_backlog_callback(void *user_data) {
+	filewriter_ctx_t *file_ctx = user_data;
+	rb_stats_t stats;
+	if (overload_shed(file_ctx->overload, OVERLOAD_FLAC)) return 1.0;
+	rb_get_stats(&file_ctx->rb, &stats);
+	return stats.size ? (double)stats.fill / (double)stats.size : 0.0;
+}
+
+// the seek points of every file (or segment) go next to it as name.flac.seek, stdout has none
+static const char *flac_sidecar_name(filewriter_ctx_t *file_ctx, char *buf, size_t size)
+{
+	if (file_ctx->seg) file_segment_name(file_ctx->seg, buf, size);
+	else if (strcmp(file_ctx->name, "-") != 0) snprintf(buf, size, "%s", file_ctx->name);
+	else return NULL;
+	size_t len = strlen(buf);
+	snprintf(buf + len, size - len, ".seek");
+	return buf;
+}
+
 int flac_file_writer(void *ctx)
 {
 	filewriter_ctx_t *file_ctx = ctx;
 	size_t len = BUFFER_READ_SIZE;
+	thread_role_apply(file_ctx->role);
 	void *buf;
 	uint32_t srate = 40000;
 	int result;
-#if LIBSOXR_ENABLED == 1
-	uint8_t *resample_buffer = NULL;
-	uint8_t *resample_buffer_b = NULL;
-	soxr_t resampler = NULL;
-	soxr_error_t soxr_err;
-	if (file_ctx->resample_rate!=0.0) {
-		srate = (uint32_t)(file_ctx->resample_rate);
-		resample_buffer = aligned_alloc(32, BUFFER_READ_SIZE);
-		resample_buffer_b = aligned_alloc(32, BUFFER_READ_SIZE);
-		soxr_io_spec_t io_spec = soxr_io_spec(SOXR_INT32_S, SOXR_INT16_S);
-		soxr_quality_spec_t qual_spec = soxr_quality_spec(file_ctx->resample_qual, 0);
-		io_spec.scale = file_ctx->init_scale;
-		io_spec.scale *= pow(10.0,file_ctx->resample_gain/20.0);
-		if (!resample_buffer || !resample_buffer_b) {
-			fprintf(stderr, "ERROR: failed allocating resampling buffer\n");
-			do_exit = 1;
-			return 0;
-		}
-		resampler = soxr_create(40000.0, file_ctx->resample_rate, 1, &soxr_err, &io_spec, &qual_spec, NULL);
-		if (!resampler || soxr_err!=0) {
-			fprintf(stderr, "ERROR: failed allocating resampling context: %s\n", soxr_err);
+	ringbuffer_t *rb = &file_ctx->rb;
+	bool (*input_done)(void *) = raw_writer_should_exit;
+	void *input_ctx = NULL;
+	// the encoder reads the resampled samples, the resampler runs on the stage thread meanwhile
+	uint8_t *conv_buffer = NULL;
+	resample_stage_t *stage = NULL;
+	if (rf_resampled(file_ctx)) {
+		srate = (uint32_t)rf_output_rate(file_ctx);
+		conv_buffer = buffer_pool_get(file_ctx->pool, BUFFER_READ_SIZE*2);
+		if (!conv_buffer || (stage = start_resample_stage(file_ctx, NULL)) == NULL) {
+			fprintf(stderr, "ERROR: failed setting up resampling\n");
+			buffer_pool_put(file_ctx->pool, conv_buffer);
 			do_exit = 1;
 			return 0;
 		}
+		rb = resample_stage_output(stage);
+		input_done = resample_stage_done;
+		input_ctx = stage;
 	}
-#endif
 
 	// Configure FLAC writer using shared library
 	flac_writer_config_t config = flac_writer_default_config();
 	config.sample_rate = srate;
 	config.bits_per_sample = file_ctx->flac_bits;
-	config.compression_level = file_ctx->flac_level;
+	config.compression_level = file_ctx->flac_levels.compression_level;
+	config.adaptive_level = file_ctx->flac_levels.adaptive_level;
+	config.compression_level_min = file_ctx->flac_levels.compression_level_min;
+	config.compression_level_max = file_ctx->flac_levels.compression_level_max;
+	config.realtime_rate = rf_output_rate(file_ctx) * 1000.0;
+	config.backlog_cb = cli_flac_backlog_callback;
 	config.verify = file_ctx->flac_verify;
 	config.num_threads = file_ctx->flac_threads;
+	config.block_parallel = file_ctx->flac_block_parallel;
+	config.shared_pool = file_ctx->flac_shared_pool;
 	config.enable_seektable = true;
 	config.error_cb = cli_flac_error_callback;
 	config.callback_user_data = file_ctx;
+	char sidecar[4096];
+	if (file_ctx->flac_sidecar) {
+		config.checkpoint_seconds = FLAC_CHECKPOINT_SECONDS;
+		config.seek_sidecar = flac_sidecar_name(file_ctx, sidecar, sizeof(sidecar));
+	}
 
-	flac_writer_t *writer = flac_writer_create_file(file_ctx->f, &config);
+	// segment sizes and the telemetry need the byte count only the stream mode keeps
+	bool stream = file_ctx->seg || file_ctx->flac_count_bytes;
+	flac_writer_t *writer = stream ? flac_writer_create_stream(file_ctx->f, &config)
+	                               : flac_writer_create_file(file_ctx->f, &config);
 	if (!writer) {
 		fprintf(stderr, "ERROR: failed to create FLAC writer\n");
 		do_exit = 1;
 		return 0;
 	}
 
+	uint64_t seg_in = 0, done_out = 0;
 	while(true) {
-		while(((buf = rb_read_ptr(&file_ctx->rb, len)) == NULL) && !do_exit) {
-			thrd_sleep(&(struct timespec){.tv_nsec=10000000}, NULL);
-		}
-		if (do_exit) {
-			len = file_ctx->rb.tail - file_ctx->rb.head;
+		while(((buf = rb_read_ptr_wait(rb, len, RB_WAIT_MS)) == NULL) && !input_done(input_ctx)) {}
+		if (buf == NULL) {
+			len = rb_available(rb) & ~(size_t)1;
 			if (len == 0) break;
-			buf = rb_read_ptr(&file_ctx->rb, len);
+			buf = rb_read_ptr(rb, len);
 		}
-#if LIBSOXR_ENABLED == 1
-		if (file_ctx->resample_rate!=0) {
-			size_t out_len;
-			soxr_err = soxr_process(resampler, &buf, len>>2, &len, &resample_buffer, len>>1, &out_len);
-			len<<=2;
-			if (soxr_err != 0) {
-				fprintf(stderr, "Error while converting: %s\n", soxr_err);
+		// every segment is a complete FLAC stream of its own
+		if (file_ctx->seg && file_segment_due(file_ctx->seg, flac_writer_get_bytes_written(writer), seg_in) &&
+		    file_segment_wait_next(file_ctx->seg)) {
+			done_out += flac_writer_get_bytes_written(writer);
+			if (flac_writer_finish(writer) != FLAC_WRITER_OK) {
+				fprintf(stderr, "ERROR: FLAC encoder did not finish correctly\n");
+				new_line = 1;
+			}
+			file_ctx->f = file_segment_next(file_ctx->seg);
+			seg_in = 0;
+			if (config.seek_sidecar) config.seek_sidecar = flac_sidecar_name(file_ctx, sidecar, sizeof(sidecar));
+			writer = flac_writer_create_stream(file_ctx->f, &config);
+			if (!writer) {
+				fprintf(stderr, "ERROR: failed to create FLAC writer\n");
 				do_exit = 1;
-				flac_writer_abort(writer);
-				return 0;
+				break;
 			}
-			file_ctx->conv_func((int16_t*)resample_buffer, (int32_t*)resample_buffer_b, out_len);
-			result = flac_writer_process(writer, (const int32_t*)resample_buffer_b, out_len);
+		}
+		if (stage) {
+			file_ctx->conv_func((int16_t*)buf, (int32_t*)conv_buffer, len>>1);
+			result = flac_writer_process(writer, (const int32_t*)conv_buffer, len>>1);
 		} else {
-			result = flac_writer_process(writer, (const int32_t*)buf, len>>2);
+			result = flac_writer_process_int16(writer, (const int16_t*)buf, len>>1);
 		}
-#else
-		result = flac_writer_process(writer, (const int32_t*)buf, len>>2);
-#endif
 		if (result < 0) {
 			fprintf(stderr, "ERROR: (%p) FLAC encoder could not process data\n", (void*)file_ctx->f);
 			new_line = 1;
 		}
-		rb_read_finished(&file_ctx->rb, len);
+		rb_read_finished(rb, len);
+		seg_in += len;
+		telemetry_count(&file_ctx->coded_in, len);
+		atomic_store_explicit(&file_ctx->coded_out, done_out + flac_writer_get_bytes_written(writer), memory_order_relaxed);
 	}
 
-	flac_writer_error_t err = flac_writer_finish(writer);
-	if (err != FLAC_WRITER_OK) {
-		fprintf(stderr, "ERROR: FLAC encoder did not finish correctly\n");
-		new_line = 1;
+	if (writer) {
+		flac_writer_error_t err = flac_writer_finish(writer);
+		if (err != FLAC_WRITER_OK) {
+			fprintf(stderr, "ERROR: FLAC encoder did not finish correctly\n");
+			new_line = 1;
+		}
 	}
+	if (file_ctx->seg) file_segment_close(file_ctx->seg);
 
-#if LIBSOXR_ENABLED == 1
-	if (file_ctx->resample_rate!=0) {
-		aligned_free(resample_buffer);
-		aligned_free(resample_buffer_b);
-		soxr_delete(resampler);
+	if (stage) {
+		if (resample_stage_failed(stage)) do_exit = 1;
+		resample_stage_stop(stage);
+		buffer_pool_put(file_ctx->pool, conv_buffer);
 	}
-#endif
 	return 0;
 }
 #endif
 
-
-static bool str_starts_with(const char *restrict prefixA, const char *restrict prefixB, size_t *prefixLen, const char *restrict string)
+// delta coded RF output, every segment is a complete stream with its own index
+int delta_file_writer(void *ctx)
 {
-	while(*prefixA) {
-		if(prefixLen) (*prefixLen)++;
-		if(*prefixA++ != *string++)
-			return false;
-	}
-	if (prefixB) while(*prefixB) {
-		if(prefixLen) (*prefixLen)++;
-		if(*prefixB++ != *string++)
-			return false;
+	filewriter_ctx_t *file_ctx = ctx;
+	size_t len = BUFFER_READ_SIZE;
+	thread_role_apply(file_ctx->role);
+	void *buf;
+	uint32_t srate = 40000000;
+	ringbuffer_t *rb = &file_ctx->rb;
+	bool (*input_done)(void *) = raw_writer_should_exit;
+	void *input_ctx = NULL;
+	resample_stage_t *stage = NULL;
+	if (rf_resampled(file_ctx)) {
+		srate = (uint32_t)(rf_output_rate(file_ctx) * 1000.0);
+		if ((stage = start_resample_stage(file_ctx, NULL)) == NULL) {
+			fprintf(stderr, "ERROR: failed setting up resampling\n");
+			do_exit = 1;
+			return 0;
+		}
+		rb = resample_stage_output(stage);
+		input_done = resample_stage_done;
+		input_ctx = stage;
 	}
-	return true;
-}
 
-void list_devices() {
-	misrc_device_list_t devices;
+	delta_writer_t *writer = delta_writer_create(file_ctx->f, srate);
+	if (!writer) {
+		do_exit = 1;
+		close_output(file_ctx->f, file_ctx->seg);
+		if (stage) resample_stage_stop(stage);
+		return 0;
+	}
+
+	uint64_t seg_in = 0, done_out = 0;
+	while(true) {
+		while(((buf = rb_read_ptr_wait(rb, len, RB_WAIT_MS)) == NULL) && !input_done(input_ctx)) {}
+		if (buf == NULL) {
+			len = rb_available(rb) & ~(size_t)1;
+			if (len == 0) break;
+			buf = rb_read_ptr(rb, len);
+		}
+		if (file_ctx->seg && file_segment_due(file_ctx->seg, delta_writer_get_bytes_written(writer), seg_in) &&
+		    file_segment_wait_next(file_ctx->seg)) {
+			done_out += delta_writer_get_bytes_written(writer);
+			if (delta_writer_finish(writer) != 0) {
+				fprintf(stderr, "ERROR: failed writing delta coded output\n");
+				new_line = 1;
+			}
+			file_ctx->f = file_segment_next(file_ctx->seg);
+			seg_in = 0;
+			writer = delta_writer_create(file_ctx->f, srate);
+			if (!writer) {
+				do_exit = 1;
+				break;
+			}
+		}
+		if (delta_writer_process(writer, (const int16_t*)buf, len>>1) != 0) {
+			fprintf(stderr, "ERROR: (%p) failed writing delta coded output\n", (void*)file_ctx->f);
+			new_line = 1;
+		}
+		rb_read_finished(rb, len);
+		seg_in += len;
+		telemetry_count(&file_ctx->coded_in, len);
+		atomic_store_explicit(&file_ctx->coded_out, done_out + delta_writer_get_bytes_written(writer), memory_order_relaxed);
+	}
+
+	if (writer && delta_writer_finish(writer) != 0) {
+		fprintf(stderr, "ERROR: failed writing delta coded output\n");
+		new_line = 1;
+	}
+	close_output(file_ctx->f, file_ctx->seg);
+
+	if (stage) {
+		if (resample_stage_failed(stage)) do_exit = 1;
+		resample_stage_stop(stage);
+	}
+	return 0;
+}
+
+
+static bool str_starts_with(const char *restrict prefixA, const char *restrict prefixB, size_t *prefixLen, const char *restrict string)
+{
+	while(*prefixA) {
+		if(prefixLen) (*prefixLen)++;
+		if(*prefixA++ != *string++)
+			return false;
+	}
+	if (prefixB) while(*prefixB) {
+		if(prefixLen) (*prefixLen)++;
+		if(*prefixB++ != *string++)
+			return false;
+	}
+	return true;
+}
+
+void list_devices() {
+	misrc_device_list_t devices;
 	misrc_device_list_init(&devices);
 	misrc_device_enumerate(&devices, true, true);
 	misrc_device_list_print(&devices);
@@ -779,96 +1624,806 @@ void list_devices() {
 	exit(1);
 }
 
-void print_level(char ch, uint16_t level) {
+void print_level(char ch, const extract_stats_t *stats, int c) {
+	uint16_t level = extract_stats_peak(stats, c);
 	float db_level = 20.0f * log10((float)level / 2048.0f);
+	double dc = 0.0, rms_db = -INFINITY;
+	if (stats->count > 0) {
+		dc = (double)stats->sum[c] / (double)stats->count;
+		rms_db = 20.0 * log10(sqrt((double)stats->sum_sq[c] / (double)stats->count) / 2048.0);
+	}
 	// the idea is a non-linear scale similar to vu meters
 	uint8_t count = (uint8_t) lroundf( 70.0f/(1.0f + exp(0.163f*(-15.0f - db_level))));
 	char full[] = "################################################################";
 	char none[] = "                                                                ";
 	full[count] = 0;
 	none[64-count] = 0;
-	fprintf(stderr, "\33[2K\r RF %c [%s%s] %5.1f dB\n", ch, full, none, db_level);
+	fprintf(stderr, "\33[2K\r RF %c [%s%s] %5.1f dB, RMS %5.1f dB, DC %+6.1f\n", ch, full, none, db_level, rms_db, dc);
 }
 
-int main(int argc, char **argv)
+void print_histogram(const char *tag, char ch, code_hist_t *hist, const extract_stats_t *stats, int c) {
+	code_hist_metrics_t m;
+	code_hist_metrics(hist, c, stats, &m);
+	if (m.samples == 0) return;
+	fprintf(stderr, "\33[2K\r%sADC %c : DC %+6.1f, RMS %6.1f, crest %4.2f, %5.2f effective bits, %u of %d codes missing in %d .. %d\n",
+	        tag, ch, m.dc, m.rms, m.crest, m.effective_bits, m.codes_missing, m.max - m.min + 1, m.min, m.max);
+}
+
+// ringbuffer with optional huge page backing, warns when falling back to normal pages
+void init_ringbuffer(ringbuffer_t *rb, char *name, size_t size, size_t huge_size) {
+	rb_init_pages(rb, name, size, huge_size);
+	if (huge_size != 0 && rb->huge_page_size != huge_size) {
+		fprintf(stderr, "Warning: no %s huge pages available for %s, using normal pages\n",
+			(huge_size == RB_HUGE_1G) ? "1G" : "2M", name);
+	}
+}
+
+// fill level, high-water mark and full stalls since the last print
+void print_rb_stats(const char *name, ringbuffer_t *rb) {
+	rb_stats_t st;
+	rb_get_stats(rb, &st);
+	fprintf(stderr, " %s: %3u%% peak %3u%% full %" PRIu64, name,
+		(unsigned)(st.fill * 100 / st.size), (unsigned)(st.high_water * 100 / st.size), st.full_count);
+	rb_reset_high_water(rb);
+}
+
+// ringbuffers in the telemetry: capture, A, B, audio, NULL if the device does not use it
+static ringbuffer_t *telemetry_rb(capture_dev_t *dev, int i) {
+	switch (i) {
+		case 0: return dev->cap_ctx.handler.capture_rf ? &dev->cap_ctx.rb : NULL;
+		case 1:
+		case 2: return dev->o.output_names[i - 1] != NULL ? &dev->thread_out_ctx[i - 1].rb : NULL;
+		default: return dev->cap_ctx.handler.capture_audio ? &dev->cap_ctx.rb_audio : NULL;
+	}
+}
+
+// one counter of cli_capture_ctx_t for every device, Prometheus wants the metrics of a name together
+static void telemetry_devices(telemetry_snapshot_t *s, const char *name, size_t offset) {
+	char labels[TELEMETRY_LABELS_LEN];
+	for (int d = 0; d < num_capture_devs; d++) {
+		snprintf(labels, sizeof(labels), "device=\"%d\"", d);
+		telemetry_add(s, name, TELEMETRY_COUNTER, labels,
+			(double)telemetry_read((atomic_uint_fast64_t *)((char *)&capture_devs[d].cap_ctx + offset)));
+	}
+}
+
+// --telemetry snapshot, on the telemetry thread, only reads counters the capture threads keep anyway
+static void capture_telemetry(void *UNUSED(user), telemetry_snapshot_t *s, double elapsed) {
+	static const char *const rb_names[4] = { "capture", "A", "B", "audio" };
+	rb_stats_t st[MAX_CAPTURE_DEVICES][4];
+	bool used[MAX_CAPTURE_DEVICES][4];
+	char labels[TELEMETRY_LABELS_LEN];
+	int d, i;
+
+	for (d = 0; d < num_capture_devs; d++) {
+		for (i = 0; i < 4; i++) {
+			ringbuffer_t *rb = telemetry_rb(&capture_devs[d], i);
+			used[d][i] = (rb != NULL);
+			if (rb) rb_get_stats(rb, &st[d][i]);
+		}
+	}
+
+	telemetry_devices(s, "misrc_samples_total", offsetof(cli_capture_ctx_t, samples));
+	for (d = 0; d < num_capture_devs; d++) {
+		uint64_t samples = telemetry_read(&capture_devs[d].cap_ctx.samples);
+		snprintf(labels, sizeof(labels), "device=\"%d\"", d);
+		telemetry_add(s, "misrc_sample_rate_hz", TELEMETRY_GAUGE, labels,
+			elapsed > 0.0 ? (double)(samples - capture_devs[d].telemetry_samples) / elapsed : 0.0);
+		capture_devs[d].telemetry_samples = samples;
+	}
+	telemetry_devices(s, "misrc_frames_total", offsetof(cli_capture_ctx_t, frames));
+	telemetry_devices(s, "misrc_frames_missed_total", offsetof(cli_capture_ctx_t, frames_missed));
+	telemetry_devices(s, "misrc_frame_errors_total", offsetof(cli_capture_ctx_t, frame_errors));
+	telemetry_devices(s, "misrc_sync_lost_total", offsetof(cli_capture_ctx_t, sync_lost));
+
+	// USB delivery: time between frames and in the callback, against the frame period of the metadata
+	double bounds[FRAME_TIMING_BUCKETS];
+	uint64_t counts[FRAME_TIMING_BUCKETS];
+	for (i = 0; i < FRAME_TIMING_BUCKETS; i++) bounds[i] = frame_timing_bucket_bound(i);
+	for (d = 0; d < num_capture_devs; d++) {
+		double sum = frame_timing_read(&capture_devs[d].cap_ctx.timing, FRAME_TIMING_INTERVAL, counts);
+		snprintf(labels, sizeof(labels), "device=\"%d\"", d);
+		telemetry_add_histogram(s, "misrc_frame_interval_seconds", labels, bounds, counts, FRAME_TIMING_BUCKETS, sum);
+	}
+	for (d = 0; d < num_capture_devs; d++) {
+		double sum = frame_timing_read(&capture_devs[d].cap_ctx.timing, FRAME_TIMING_DURATION, counts);
+		snprintf(labels, sizeof(labels), "device=\"%d\"", d);
+		telemetry_add_histogram(s, "misrc_callback_duration_seconds", labels, bounds, counts, FRAME_TIMING_BUCKETS, sum);
+	}
+	for (d = 0; d < num_capture_devs; d++) {
+		snprintf(labels, sizeof(labels), "device=\"%d\"", d);
+		telemetry_add(s, "misrc_frame_period_seconds", TELEMETRY_GAUGE, labels, (double)telemetry_read(&capture_devs[d].cap_ctx.timing.period_ns) * 1e-9);
+	}
+	for (d = 0; d < num_capture_devs; d++) {
+		snprintf(labels, sizeof(labels), "device=\"%d\"", d);
+		telemetry_add(s, "misrc_frame_interval_max_seconds", TELEMETRY_GAUGE, labels, (double)telemetry_read(&capture_devs[d].cap_ctx.timing.max_ns[FRAME_TIMING_INTERVAL]) * 1e-9);
+	}
+	for (d = 0; d < num_capture_devs; d++) {
+		snprintf(labels, sizeof(labels), "device=\"%d\"", d);
+		telemetry_add(s, "misrc_callback_duration_max_seconds", TELEMETRY_GAUGE, labels, (double)telemetry_read(&capture_devs[d].cap_ctx.timing.max_ns[FRAME_TIMING_DURATION]) * 1e-9);
+	}
+	// --parser-thread: time on the parser and the queue in front of it
+	for (d = 0; d < num_capture_devs; d++) {
+		if (capture_devs[d].cap_ctx.queue == NULL) continue;
+		double sum = frame_timing_read(&capture_devs[d].cap_ctx.timing, FRAME_TIMING_PARSE, counts);
+		snprintf(labels, sizeof(labels), "device=\"%d\"", d);
+		telemetry_add_histogram(s, "misrc_frame_parse_seconds", labels, bounds, counts, FRAME_TIMING_BUCKETS, sum);
+	}
+	for (d = 0; d < num_capture_devs; d++) {
+		if (capture_devs[d].cap_ctx.queue == NULL) continue;
+		snprintf(labels, sizeof(labels), "device=\"%d\"", d);
+		telemetry_add(s, "misrc_frame_parse_max_seconds", TELEMETRY_GAUGE, labels, (double)telemetry_read(&capture_devs[d].cap_ctx.timing.max_ns[FRAME_TIMING_PARSE]) * 1e-9);
+	}
+	for (d = 0; d < num_capture_devs; d++) {
+		frame_queue_t *q = capture_devs[d].cap_ctx.queue;
+		if (q == NULL) continue;
+		snprintf(labels, sizeof(labels), "device=\"%d\"", d);
+		telemetry_add(s, "misrc_frame_queue_fill_ratio", TELEMETRY_GAUGE, labels, (double)frame_queue_fill(q) / (double)frame_queue_depth(q));
+	}
+	for (d = 0; d < num_capture_devs; d++) {
+		if (capture_devs[d].cap_ctx.queue == NULL) continue;
+		snprintf(labels, sizeof(labels), "device=\"%d\"", d);
+		telemetry_add(s, "misrc_frame_queue_dropped_total", TELEMETRY_COUNTER, labels, (double)frame_queue_dropped(capture_devs[d].cap_ctx.queue));
+	}
+	telemetry_devices(s, "misrc_frames_late_total", offsetof(cli_capture_ctx_t, timing.late));
+	telemetry_devices(s, "misrc_callbacks_slow_total", offsetof(cli_capture_ctx_t, timing.slow));
+	for (d = 0; d < num_capture_devs; d++) {
+		for (i = 0; i < 2; i++) {
+			snprintf(labels, sizeof(labels), "device=\"%d\",adc=\"%c\"", d, 'A' + i);
+			telemetry_add(s, "misrc_clipped_samples_total", TELEMETRY_COUNTER, labels, (double)telemetry_read(&capture_devs[d].cap_ctx.clipped[i]));
+		}
+	}
+
+	for (d = 0; d < num_capture_devs; d++) {
+		for (i = 0; i < 4; i++) {
+			if (!used[d][i]) continue;
+			snprintf(labels, sizeof(labels), "device=\"%d\",buffer=\"%s\"", d, rb_names[i]);
+			telemetry_add(s, "misrc_ringbuffer_fill_ratio", TELEMETRY_GAUGE, labels, (double)st[d][i].fill / (double)st[d][i].size);
+		}
+	}
+	for (d = 0; d < num_capture_devs; d++) {
+		for (i = 0; i < 4; i++) {
+			if (!used[d][i]) continue;
+			snprintf(labels, sizeof(labels), "device=\"%d\",buffer=\"%s\"", d, rb_names[i]);
+			telemetry_add(s, "misrc_ringbuffer_stalls_total", TELEMETRY_COUNTER, labels, (double)st[d][i].full_count);
+		}
+	}
+	for (d = 0; d < num_capture_devs; d++) {
+		for (i = 0; i < 4; i++) {
+			if (!used[d][i]) continue;
+			snprintf(labels, sizeof(labels), "device=\"%d\",buffer=\"%s\"", d, rb_names[i]);
+			telemetry_add(s, "misrc_ringbuffer_underruns_total", TELEMETRY_COUNTER, labels, (double)st[d][i].empty_count);
+		}
+	}
+
+	// the RF writers: what they took from their ringbuffers, and what the encoders made of it
+	for (d = 0; d < num_capture_devs; d++) {
+		for (i = 0; i < 2; i++) {
+			if (!used[d][i + 1]) continue;
+			snprintf(labels, sizeof(labels), "device=\"%d\",output=\"%c\"", d, 'A' + i);
+			telemetry_add(s, "misrc_writer_bytes_total", TELEMETRY_COUNTER, labels, (double)st[d][i + 1].bytes_out);
+		}
+	}
+	for (d = 0; d < num_capture_devs; d++) {
+		for (i = 0; i < 2; i++) {
+			uint64_t bytes;
+			if (!used[d][i + 1]) continue;
+			bytes = st[d][i + 1].bytes_out;
+			snprintf(labels, sizeof(labels), "device=\"%d\",output=\"%c\"", d, 'A' + i);
+			telemetry_add(s, "misrc_writer_bytes_per_second", TELEMETRY_GAUGE, labels,
+				elapsed > 0.0 ? (double)(bytes - capture_devs[d].telemetry_out_bytes[i]) / elapsed : 0.0);
+			capture_devs[d].telemetry_out_bytes[i] = bytes;
+		}
+	}
+	for (d = 0; d < num_capture_devs; d++) {
+		for (i = 0; i < 2; i++) {
+			uint64_t out = telemetry_read(&capture_devs[d].thread_out_ctx[i].coded_out);
+			if (!used[d][i + 1] || out == 0) continue;
+			snprintf(labels, sizeof(labels), "device=\"%d\",output=\"%c\"", d, 'A' + i);
+			telemetry_add(s, "misrc_encoded_bytes_total", TELEMETRY_COUNTER, labels, (double)out);
+		}
+	}
+	for (d = 0; d < num_capture_devs; d++) {
+		for (i = 0; i < 2; i++) {
+			uint64_t in = telemetry_read(&capture_devs[d].thread_out_ctx[i].coded_in);
+			uint64_t out = telemetry_read(&capture_devs[d].thread_out_ctx[i].coded_out);
+			if (!used[d][i + 1] || in == 0 || out == 0) continue;
+			snprintf(labels, sizeof(labels), "device=\"%d\",output=\"%c\"", d, 'A' + i);
+			telemetry_add(s, "misrc_compression_ratio", TELEMETRY_GAUGE, labels, (double)in / (double)out);
+		}
+	}
+}
+
+// an output for --preflight: what it writes per second and how
+typedef struct {
+	const char *name;
+	double rate;
+	size_t block_size;
+	bool async;           // written through the --async-io/--direct-io backend
+} preflight_output_t;
+
+// probe every output directory once with the sum of what goes there
+// returns the slowest verdict, prints the target rates for judging the ringbuffer stalls
+storage_probe_verdict_t run_preflight(preflight_output_t *outs, int n, rb_writer_backend_t backend, int depth, bool direct) {
+	storage_probe_verdict_t worst = STORAGE_PROBE_OK;
+	bool done[PREFLIGHT_MAX_OUTPUTS] = { false };
+	for (int i = 0; i < n; i++) {
+		storage_probe_config_t cfg;
+		storage_probe_result_t res;
+		storage_probe_verdict_t v;
+		double required = 0.0;
+		size_t block = 0;
+		bool async = false;
+		if (done[i]) continue;
+		if (strcmp(outs[i].name, "-") == 0 || net_stream_is_url(outs[i].name) || rb_shm_is_url(outs[i].name)) {
+			fprintf(stderr, "Preflight: skipping %s\n", outs[i].name);
+			continue;
+		}
+		for (int j = i; j < n; j++) {
+			if (done[j] || strcmp(outs[j].name, "-") == 0 || net_stream_is_url(outs[j].name) || rb_shm_is_url(outs[j].name) || !storage_probe_same_dir(outs[i].name, outs[j].name)) continue;
+			done[j] = true;
+			required += outs[j].rate;
+			if (outs[j].block_size > block) block = outs[j].block_size;
+			async |= outs[j].async;
+		}
+		storage_probe_config_init(&cfg, outs[i].name, block);
+		if (async) {
+			cfg.backend = backend;
+			cfg.queue_depth = depth;
+			cfg.direct = direct;
+		}
+		fprintf(stderr, "Preflight: probing the directory of %s for %.1f seconds...\n", outs[i].name, STORAGE_PROBE_SECONDS);
+		v = (storage_probe_run(&cfg, &res) == 0) ? storage_probe_judge(&res, required) : STORAGE_PROBE_FAILED;
+		if (v == STORAGE_PROBE_FAILED) {
+			fprintf(stderr, "Preflight: could not write next to %s\n", outs[i].name);
+		}
+		else {
+			fprintf(stderr, "Preflight: %.1f MB/s measured, target %.1f MB/s (%.1f MB/s with margin)%s\n",
+				res.bytes_per_sec / 1e6, required / 1e6, required * STORAGE_PROBE_MARGIN / 1e6,
+				(v == STORAGE_PROBE_OK) ? "" : (v == STORAGE_PROBE_MARGINAL) ? ", little headroom" : ", TOO SLOW");
+		}
+		if (v > worst) worst = v;
+	}
+	return worst;
+}
+
+// open an output, split into rolling segments with --segment-size/--segment-time or per --trigger event
+// input_rate: bytes per second the output reads, out_ratio: file bytes per input byte (roughly)
+int open_output(FILE **f, file_segment_t **seg, const char *name, bool overwrite, uint64_t input_rate, double out_ratio) {
+	file_segment_config_t cfg;
+	uint64_t expected;
+	*seg = NULL;
+	if (segment_bytes == 0 && segment_seconds == 0 && segment_samples == 0) return file_open_write(f, name, overwrite, true);
+	if (strcmp(name, "-") == 0) {
+		fprintf(stderr, "Warning: cannot split stdout, writing it as one stream\n");
+		return file_open_write(f, name, overwrite, true);
+	}
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.path = name;
+	cfg.max_bytes = segment_bytes;
+	cfg.max_input = segment_samples ? segment_samples * input_rate / (RATE_RF_INPUT/sizeof(int16_t)) : segment_seconds * input_rate;
+	cfg.overwrite = overwrite;
+	cfg.interactive = true;
+	// reserve what the segment will most likely end up with
+	expected = (uint64_t)((double)cfg.max_input * out_ratio);
+	cfg.preallocate = (cfg.max_bytes != 0 && (expected == 0 || cfg.max_bytes < expected)) ? cfg.max_bytes : expected;
+	*seg = file_segment_open(&cfg, f);
+	return (*seg == NULL) ? -1 : 0;
+}
+
+// audio file bytes per ringbuffer byte of the 4 channel output
+static double audio_file_ratio(const capture_opts_t *o)
 {
-//set pipe mode to binary in windows
-#if defined(_WIN32) || defined(_WIN64)
-	_setmode(_fileno(stdout), O_BINARY);
-	_setmode(_fileno(stdin), O_BINARY);
+#if LIBFLAC_ENABLED == 1
+	// a guess, about what 24 bit audio compresses to
+	if (o->audio_flac) return 0.5;
 #else
-	struct sigaction sigact;
+	(void)o;
 #endif
+	return 1.0;
+}
+
+// ringbuffer sizes of one device from --buffer-time, --buffer-memory and --low-memory,
+// the smallest hold four of the largest reads or writes on them (a whole frame for audio)
+static int size_ringbuffers(capture_opts_t *o, int devices)
+{
+	buffer_stream_t streams[4];
+	int n = 0, out[2] = {-1, -1}, audio = -1;
+	bool sized = o->buffers.seconds > 0.0 || o->buffers.budget > 0 || o->buffers.low_memory;
+	buffer_sizing_t cfg = o->buffers;
+	uint64_t ram = buffer_sizing_system_memory();
+	uint64_t total;
+
+	// the pre-roll waits in the capture ringbuffer on top of what it buffers anyway
+	size_t pre_roll = o->trigger_on ? (size_t)((o->pre_roll + BUFFER_READ_SIZE - 1) / BUFFER_READ_SIZE + 1) * BUFFER_READ_SIZE*4 : 0;
+	streams[n++] = (buffer_stream_t){ "capture", RATE_RAW_INPUT, BUFFER_READ_SIZE*4*4 + pre_roll, BUFFER_TOTAL_SIZE + pre_roll, 0 };
+	// with --rf-float the channel ringbuffers hold 32 bit samples, they keep the same time
+	size_t rf_scale = o->rf_float ? 2 : 1;
+	for (int i = 0; i < 2; i++) {
+		if (o->output_names[i] == NULL) continue;
+		out[i] = n;
+		streams[n++] = (buffer_stream_t){ i ? "B" : "A", RATE_RF_INPUT * rf_scale, BUFFER_READ_SIZE*2*4 * rf_scale, BUFFER_TOTAL_SIZE * rf_scale, 0 };
+	}
+	bool audio_out = o->output_name_4ch_audio != NULL;
+	for (int i = 0; i < 2; i++) audio_out |= o->output_names_2ch_audio[i] != NULL;
+	for (int i = 0; i < 4; i++) audio_out |= o->output_names_1ch_audio[i] != NULL;
+	if (audio_out) {
+		audio = n;
+		streams[n++] = (buffer_stream_t){ "audio", RATE_AUDIO_INPUT, BUFFER_AUDIO_TOTAL_SIZE, BUFFER_AUDIO_TOTAL_SIZE, 0 };
+	}
+
+	// the devices share the budget and the memory
+	cfg.budget /= (uint64_t)devices;
+	cfg.granularity = o->huge_size;
+	total = buffer_sizing_compute(&cfg, streams, n, ram ? (uint64_t)(ram * BUFFER_SIZING_RAM_SHARE) / (uint64_t)devices : 0);
+	if (total == 0) {
+		fprintf(stderr, "ERROR: Not enough memory for the ringbuffers, use fewer outputs or devices\n");
+		return -1;
+	}
+	o->rb_size_capture = streams[0].size;
+	o->rb_size_out = BUFFER_TOTAL_SIZE;
+	for (int i = 0; i < 2; i++) if (out[i] >= 0) o->rb_size_out = streams[out[i]].size;
+	o->rb_size_audio = audio >= 0 ? streams[audio].size : BUFFER_AUDIO_TOTAL_SIZE;
+
+	for (int i = 0; i < n; i++) sized |= streams[i].size != streams[i].default_size;
+	if (sized) buffer_sizing_report(devices > 1 ? "Each device: " : NULL, streams, n);
+	return 0;
+}
+
+// the output name fields of a set of options, the index last
+static void output_name_ptrs(capture_opts_t *o, char **names[CAPTURE_OUTPUT_NAMES])
+{
+	int n = 0;
+	names[n++] = &o->output_names[0];
+	names[n++] = &o->output_names[1];
+	names[n++] = &o->output_name_aux;
+	names[n++] = &o->output_name_raw;
+	names[n++] = &o->output_name_4ch_audio;
+	names[n++] = &o->output_names_2ch_audio[0];
+	names[n++] = &o->output_names_2ch_audio[1];
+	for (int i = 0; i < 4; i++) names[n++] = &o->output_names_1ch_audio[i];
+	names[n++] = &o->output_name_frames;
+	names[n++] = &o->output_name_preview;
+	names[n++] = &o->output_name_index;
+}
+
+// the name of an output of one device, %d is replaced by the device number
+static char *device_output_name(const char *name, int num)
+{
+	const char *p = strstr(name, "%d");
+	size_t len = strlen(name) + 16;
+	char *s = malloc(len);
+	if (s) snprintf(s, len, "%.*s%d%s", (int)(p - name), name, num, p + 2);
+	return s;
+}
+
+// open the outputs and start the writers of a device, before any device streams
+// the scratch buffers the capture loop and the writer threads of a device will take,
+// mapped and touched in one go before any of them starts
+static int capture_device_pool(capture_dev_t *dev)
+{
+	const capture_opts_t *o = &dev->o;
+	bool audio_2ch = false, audio_1ch = false;
 
-	int r, opt, pad=0, plevel=0, dev_index=0, out_size = 2;
+	if ((dev->pool = buffer_pool_create(o->huge_size)) == NULL) return -ENOMEM;
+	buffer_pool_reserve(dev->pool, BUFFER_READ_SIZE, 1);
+	for (int i=0; i<2; i++) {
+		// --rf-float extracts into these and converts from them into the channel ringbuffers
+		if (o->rf_float && o->output_names[i] != NULL) buffer_pool_reserve(dev->pool, BUFFER_READ_SIZE*2, 1);
+		if (o->output_names[i] == NULL || net_stream_is_url(o->output_names[i]) || rb_shm_is_url(o->output_names[i])) continue;
+		if (o->packed_12bit) buffer_pool_reserve(dev->pool, PACKED12_SIZE(BUFFER_READ_SIZE/2), 1);
 #if LIBFLAC_ENABLED == 1
-	int flac_level = 1;
-	bool flac_verify = false;
-	bool flac_12bit = false;
-	uint32_t flac_threads = 0;
-#endif
+		if (o->rf_flac && (o->decimation[i] != 0
 #if LIBSOXR_ENABLED == 1
-	double resample_rate[] = {0.0,0.0};
-	uint32_t resample_qual[] = {3,3};
-	float resample_gain[] = {.0f,.0f};
-	bool reduce_8bit[] = {false, false};
+		                   || o->resample_rate[i] != 0.0
 #endif
-	thrd_start_t output_thread_func = (thrd_start_t)raw_file_writer;
-	cli_capture_ctx_t cap_ctx;
-	memset(&cap_ctx, 0, sizeof(cap_ctx));
-	capture_handler_init(&cap_ctx.handler);
+		   )) buffer_pool_reserve(dev->pool, BUFFER_READ_SIZE*2, 1);
+#endif
+	}
+	for (int i=0; i<2; i++) audio_2ch |= o->output_names_2ch_audio[i] != NULL;
+	for (int i=0; i<4; i++) audio_1ch |= o->output_names_1ch_audio[i] != NULL;
+	if (audio_2ch) buffer_pool_reserve(dev->pool, BUFFER_AUDIO_READ_SIZE, 1);
+	if (audio_1ch) buffer_pool_reserve(dev->pool, BUFFER_AUDIO_READ_SIZE, 1);
+	// the slots of the --parser-thread queue
+	if (o->parser_depth) buffer_pool_reserve(dev->pool, PARSER_FRAME_MAX, o->parser_depth);
+	if (buffer_pool_commit(dev->pool) != 0) {
+		fprintf(stderr, "%sFailed to allocate the scratch buffers\n", dev->tag);
+		return -ENOMEM;
+	}
+	if (o->huge_size != 0 && buffer_pool_huge_size(dev->pool) != o->huge_size) {
+		fprintf(stderr, "Warning: no %s huge pages available for the scratch buffers, using normal pages\n",
+			(o->huge_size == RB_HUGE_1G) ? "1G" : "2M");
+	}
+	for (int i=0; i<2; i++) dev->thread_out_ctx[i].pool = dev->pool;
+	dev->thread_audio_ctx.pool = dev->pool;
+	return 0;
+}
+
+static int capture_device_setup(capture_dev_t *dev)
+{
+	const capture_opts_t *o = &dev->o;
+	cli_capture_ctx_t *cap_ctx = &dev->cap_ctx;
+	filewriter_ctx_t *thread_out_ctx = dev->thread_out_ctx;
+	audiowriter_ctx_t *thread_audio_ctx = &dev->thread_audio_ctx;
+	char outbuffer_name[] = "outX_ringbuffer";
+	int r;
+
+	capture_handler_init(&cap_ctx->handler);
+	frame_timing_init(&cap_ctx->timing);
 	/* Set up CLI-specific callbacks */
-	cap_ctx.handler.progress_cb = cli_sync_progress_cb;
-	cap_ctx.handler.sync_event_cb = cli_sync_event_cb;
-	cap_ctx.handler.audio_sync_cb = cli_audio_sync_cb;
-	cap_ctx.handler.user_ctx = &cap_ctx;
+	cap_ctx->handler.progress_cb = cli_sync_progress_cb;
+	cap_ctx->handler.sync_event_cb = cli_sync_event_cb;
+	cap_ctx->handler.audio_sync_cb = cli_audio_sync_cb;
+	cap_ctx->handler.user_ctx = cap_ctx;
+	cap_ctx->handler.capture_rf = true;
+	cap_ctx->tag = dev->tag;
+	cap_ctx->video_device = dev->sc_name != NULL;
+	if (o->overload_on && (cap_ctx->overload = overload_create(&o->overload, dev->tag)) == NULL) return -ENOMEM;
+	if ((r = capture_device_pool(dev)) != 0) return r;
+	if (o->parser_depth && (cap_ctx->queue = frame_queue_create(o->parser_depth, PARSER_FRAME_MAX, dev->pool)) == NULL) return -ENOMEM;
+	if (o->trigger_on) {
+		if (record_trigger_init(&dev->trigger, &o->trigger, BUFFER_READ_SIZE, o->pre_roll, o->post_roll) != 0) return -ENOMEM;
+		// every event goes into a segment of its own
+		segment_samples = record_trigger_event_samples(&dev->trigger);
+	}
 
-	// getopt string
-	char getopt_string[256];
+	for(int i=0; i<2; i++) {
+		thread_out_ctx[i].net = NULL;
+		thread_out_ctx[i].frame = NULL;
+		if (o->output_names[i] != NULL && net_stream_is_url(o->output_names[i])) {
+			net_stream_header_t net_header;
+			if (!o->rf_plain[i]) {
+				fprintf(stderr, "ERROR: network outputs send the samples as they are, without packing, FLAC, delta coding, resampling or decimation\n");
+				return -EINVAL;
+			}
+			net_stream_header_init(&net_header, RATE_RF_INPUT/sizeof(int16_t), o->rf_float ? NET_FORMAT_F32 : o->pad ? NET_FORMAT_S16_PADDED : NET_FORMAT_S16, (uint8_t)i, BUFFER_READ_SIZE);
+			if ((thread_out_ctx[i].net = net_sink_open(o->output_names[i], &net_header)) == NULL) return -ENOENT;
+			thread_out_ctx[i].frame = &cap_ctx->last_frame;
+		}
+		else if (o->output_names[i] != NULL && rb_shm_is_url(o->output_names[i])) {
+			// the channel ringbuffer itself is the output, consumers attach to it
+			rb_shm_info_t shm_info = { RATE_RF_INPUT/sizeof(int16_t), o->rf_float ? RB_SHM_FORMAT_F32 : o->pad ? RB_SHM_FORMAT_S16_PADDED : RB_SHM_FORMAT_S16, (uint8_t)i, 12 };
+			if (!o->rf_plain[i]) {
+				fprintf(stderr, "ERROR: shared memory outputs hold the samples as they are, without packing, FLAC, delta coding, resampling or decimation\n");
+				return -EINVAL;
+			}
+			r = rb_init_shm(&thread_out_ctx[i].rb, o->output_names[i] + strlen(RB_SHM_PREFIX), o->rb_size_out, &shm_info);
+			if (r != 0) {
+				fprintf(stderr, "Failed to create shared memory output %s%s\n", o->output_names[i], (r == 8) ? ", another capture is using it" : "");
+				return -ENOENT;
+			}
+			fprintf(stderr, "%sSharing ADC %c as %s\n", dev->tag, i ? 'B' : 'A', o->output_names[i]);
+			continue;
+		}
+		else if (o->output_names[i] != NULL) {
+			if (open_output(&(thread_out_ctx[i].f), &(thread_out_ctx[i].seg), o->output_names[i], o->overwrite_files, o->rf_seg_rate[i], o->rf_ratio[i] * RATE_RF_INPUT / o->rf_seg_rate[i])) return -ENOENT;
+		}
+		if (o->output_names[i] != NULL) {
+			thread_out_ctx[i].io_backend = o->io_backend;
+			thread_out_ctx[i].io_depth = o->io_depth;
+			thread_out_ctx[i].io_direct = o->io_direct;
+			thread_out_ctx[i].packed_12bit = o->packed_12bit;
+			thread_out_ctx[i].decimation = o->decimation[i];
+			thread_out_ctx[i].role = i ? THREAD_ROLE_WRITER_B : THREAD_ROLE_WRITER_A;
+#if LIBSOXR_ENABLED == 1
+			thread_out_ctx[i].reduce_8bit = o->reduce_8bit[i];
+			thread_out_ctx[i].init_scale = (o->reduce_8bit[i]) ? ((o->pad==1) ? 0.00390625 : 0.0625) : 1.0;
+#endif
+#if LIBFLAC_ENABLED == 1
+			thread_out_ctx[i].flac_levels = o->flac_levels;
+			thread_out_ctx[i].flac_verify = o->flac_verify;
+			thread_out_ctx[i].flac_threads = o->flac_threads;
+			thread_out_ctx[i].flac_block_parallel = o->flac_block_parallel;
+			thread_out_ctx[i].flac_shared_pool = o->flac_shared_pool;
+			thread_out_ctx[i].flac_sidecar = o->flac_sidecar;
+			thread_out_ctx[i].flac_count_bytes = o->telemetry && strcmp(o->output_names[i], "-") != 0;
+			thread_out_ctx[i].name = o->output_names[i];
+			thread_out_ctx[i].overload = cap_ctx->overload;
+#if LIBSOXR_ENABLED == 1
+			thread_out_ctx[i].flac_bits = o->reduce_8bit[i] ? 8 : (o->flac_12bit ? 12 : 16);
+			thread_out_ctx[i].conv_func = o->reduce_8bit[i] ? conv_16to8to32 : (o->flac_12bit ? conv_16to12to32 : conv_16to32);
+#else
+			thread_out_ctx[i].flac_bits = o->flac_12bit ? 12 : 16;
+			thread_out_ctx[i].conv_func = o->flac_12bit ? conv_16to12to32 : conv_16to32;
+#endif
+#endif
+#if LIBSOXR_ENABLED == 1
+			thread_out_ctx[i].resample_rate = o->resample_rate[i];
+			thread_out_ctx[i].resample_qual = o->resample_qual[i];
+			thread_out_ctx[i].resample_gain = o->resample_gain[i];
+#endif
+			outbuffer_name[3] = (char)(i+48);
+			init_ringbuffer(&thread_out_ctx[i].rb, outbuffer_name, o->rb_size_out, o->huge_size);
+			r = thrd_create(&dev->thread_out[i], o->output_thread_func, &thread_out_ctx[i]);
+			if (r != thrd_success) {
+				fprintf(stderr, "Failed to create thread for output processing\n");
+				return -ENOENT;
+			}
+		}
+	}
 
-	// device names
-	char dev_manufact[256];
-	char dev_product[256];
-	char dev_serial[256];
+#if LIBFLAC_ENABLED == 1
+	if(o->audio_flac)
+	{
+		flac_writer_config_t *config = &thread_audio_ctx->flac_config;
+		*config = flac_writer_default_config();
+		config->sample_rate = 78125;
+		config->bits_per_sample = 24;
+		config->compression_level = o->flac_levels.compression_level;
+		config->adaptive_level = o->flac_levels.adaptive_level;
+		config->compression_level_min = o->flac_levels.compression_level_min;
+		config->compression_level_max = o->flac_levels.compression_level_max;
+		config->realtime_rate = 78125.0;
+		config->verify = o->flac_verify;
+		// auto (0) is only resolved with RF FLAC outputs, one thread is plenty for the audio alone
+		config->num_threads = o->flac_threads ? o->flac_threads : 1;
+		config->block_parallel = o->flac_block_parallel;
+		config->shared_pool = o->flac_shared_pool;
+		config->enable_seektable = true;
+		config->error_cb = cli_flac_error_callback;
+		thread_audio_ctx->flac = true;
+	}
+#endif
 
-	char *sc_dev_name = NULL;
+	if(o->output_name_4ch_audio != NULL)
+	{
+		//opening output file audio
+		if (open_output(&(thread_audio_ctx->f_4ch), &(thread_audio_ctx->seg_4ch), o->output_name_4ch_audio, o->overwrite_files, RATE_AUDIO_INPUT, audio_file_ratio(o))) return -ENOENT;
+		cap_ctx->handler.capture_audio = true;
+	}
 
-	//output threads
-	// out 1, 2
-	thrd_t thread_out[2] = { 0, 0 };
-	thrd_t thread_audio = 0;
-	filewriter_ctx_t thread_out_ctx[2];
-	audiowriter_ctx_t thread_audio_ctx;
-	char outbuffer_name[] = "outX_ringbuffer";
+	for(int i=0; i<2; i++) {
+		if(o->output_names_2ch_audio[i] != NULL)
+		{
+			//opening output file audio
+			if (open_output(&(thread_audio_ctx->f_2ch[i]), &(thread_audio_ctx->seg_2ch[i]), o->output_names_2ch_audio[i], o->overwrite_files, RATE_AUDIO_INPUT, 0.5 * audio_file_ratio(o))) return -ENOENT;
+			cap_ctx->handler.capture_audio = true;
+		}
+	}
 
-	//file adress
-	// out 1, 2
-	char *output_names[2] = { NULL, NULL };
-	char *output_name_aux = NULL;
-	char *output_name_raw = NULL;
+	for(int i=0; i<4; i++) {
+		if(o->output_names_1ch_audio[i] != NULL)
+		{
+			//opening output file audio
+			if (open_output(&(thread_audio_ctx->f_1ch[i]), &(thread_audio_ctx->seg_1ch[i]), o->output_names_1ch_audio[i], o->overwrite_files, RATE_AUDIO_INPUT, 0.25 * audio_file_ratio(o))) return -ENOENT;
+			cap_ctx->handler.capture_audio = true;
+		}
+	}
 
-	char *output_name_4ch_audio = NULL;
-	char *output_names_2ch_audio[2] = { NULL, NULL };
-	char *output_names_1ch_audio[4] = { NULL, NULL, NULL, NULL };
+	if(o->output_name_aux != NULL)
+	{
+		//opening output file aux
+		if (o->trigger_on ? open_output(&dev->output_aux, &dev->segment_aux, o->output_name_aux, o->overwrite_files, RATE_RF_INPUT/sizeof(int16_t), 1.0)
+		                  : file_open_write(&dev->output_aux, o->output_name_aux, o->overwrite_files, true)) return -ENOENT;
+		if (o->aux_events) {
+			dev->aux_events = aux_encoder_open(dev->output_aux, RATE_RF_INPUT/sizeof(int16_t));
+			dev->output_aux = NULL;
+			if (dev->aux_events == NULL) return -ENOENT;
+		}
+	}
 
-	//show clipping messages
-	bool suppress_a_clipping = false;
-	bool suppress_b_clipping = false;
+	if(o->output_name_raw != NULL)
+	{
+		//opening output file raw
+		if (open_output(&dev->output_raw, &dev->segment_raw, o->output_name_raw, o->overwrite_files, RATE_RAW_INPUT, 1.0)) return -ENOENT;
+	}
 
-	//overwrite option
-	bool overwrite_files = false;
+	if(o->output_name_index != NULL)
+	{
+		FILE *f_index;
+		if (file_open_write(&f_index, o->output_name_index, o->overwrite_files, true)) return -ENOENT;
+		if (f_index == stdout) {
+			fprintf(stderr, "ERROR: The sample index needs a file, it cannot be written to stdout\n");
+			return -EINVAL;
+		}
+		// all devices share the timeline, their entries can be matched by host time
+		cap_ctx->index = sample_index_open_timeline(f_index, RATE_RF_INPUT/sizeof(int16_t), (uint32_t)dev->num, o->timeline_ns);
+		if (cap_ctx->index == NULL) return -ENOENT;
+	}
 
-	//number of samples to take
-	uint64_t total_samples_before_exit = 0;
+	if(o->output_name_frames != NULL)
+	{
+		if (file_open_write(&cap_ctx->dump, o->output_name_frames, o->overwrite_files, true)) return -ENOENT;
+	}
+
+	if(o->output_name_preview != NULL)
+	{
+		FILE *f_preview = NULL;
+		preview_config_t preview_cfg;
+		preview_config_init(&preview_cfg, RATE_RF_INPUT/sizeof(int16_t));
+		if (o->preview_decimation) preview_cfg.decimation = o->preview_decimation;
+		if (!net_stream_is_url(o->output_name_preview) && !rb_shm_is_url(o->output_name_preview)) {
+			if (file_open_write(&f_preview, o->output_name_preview, o->overwrite_files, true)) return -ENOENT;
+		}
+		dev->preview = preview_open(o->output_name_preview, f_preview, &preview_cfg);
+		if (dev->preview == NULL) {
+			if (f_preview && f_preview != stdout) fclose(f_preview);
+			return -ENOENT;
+		}
+	}
+
+	if(cap_ctx->handler.capture_audio) {
+		init_ringbuffer(&cap_ctx->rb_audio,"capture_audio_ringbuffer",o->rb_size_audio,o->huge_size);
+		cap_ctx->handler.rb_audio = &cap_ctx->rb_audio;
+		thread_audio_ctx->rb = &cap_ctx->rb_audio;
+		r = thrd_create(&dev->thread_audio, &audio_file_writer, thread_audio_ctx);
+		if (r != thrd_success) {
+			fprintf(stderr, "Failed to create thread for output processing\n");
+			return -ENOENT;
+		}
+	}
+
+	init_ringbuffer(&cap_ctx->rb,"capture_ringbuffer",o->rb_size_capture,o->huge_size);
+	cap_ctx->handler.rb_rf = &cap_ctx->rb;
+
+	// the raw output reads the capture ringbuffer directly as a second reader
+	if(dev->output_raw != NULL) {
+		rb_writer_config_t *raw_writer_cfg = &dev->raw_writer_cfg;
+		rb_writer_config_init(raw_writer_cfg, &cap_ctx->rb, dev->output_raw, BUFFER_READ_SIZE*4);
+		raw_writer_cfg->reader = rb_reader_add(&cap_ctx->rb, 0);
+		raw_writer_cfg->should_exit_cb = raw_writer_should_exit;
+		raw_writer_cfg->backend = o->io_backend;
+		raw_writer_cfg->queue_depth = o->io_depth;
+		raw_writer_cfg->direct = o->io_direct;
+		raw_writer_cfg->segment = dev->segment_raw;
+		r = thrd_create(&dev->thread_raw, &rb_writer_thread, raw_writer_cfg);
+		if (r != thrd_success) {
+			fprintf(stderr, "Failed to create thread for raw output\n");
+			return -ENOENT;
+		}
+	}
+	return 0;
+}
+
+// open a device and start its stream, the callback fills the capture ringbuffer from here on
+static int capture_device_open(capture_dev_t *dev)
+{
+	int r;
+	// the parser waits for the first frame before the stream starts
+	if (dev->cap_ctx.queue) {
+		atomic_init(&dev->parser_stop, false);
+		r = thrd_create(&dev->thread_parser, &frame_parser_thread, dev);
+		if (r != thrd_success) {
+			fprintf(stderr, "%sFailed to create frame parser thread\n", dev->tag);
+			dev->thread_parser = 0;
+			return -ENOMEM;
+		}
+	}
+	if (dev->o.replay_path) {
+		replay_config_t cfg;
+		memset(&cfg, 0, sizeof(cfg));
+		cfg.path = dev->o.replay_path;
+		cfg.speed = dev->o.replay_speed;
+		cfg.loop = dev->o.replay_loop;
+		cfg.callback = hsdaoh_callback;
+		cfg.ctx = &dev->cap_ctx;
+		cfg.rb = &dev->cap_ctx.rb;
+		cfg.tag = dev->tag;
+		dev->replay = replay_start(&cfg);
+		if (dev->replay == NULL) return -ENODEV;
+	}
+	else if (dev->sc_name) {
+		r = sc_start_capture(dev->sc_name, 1920, 1080, SC_CODEC_YUYV, 60, 1, (sc_frame_callback_t)hsdaoh_callback, &dev->cap_ctx, &dev->sc_dev);
+		if (r < 0) {
+			fprintf(stderr, "%sFailed to open %s device %s.\n", dev->tag, sc_get_impl_name(), dev->sc_name);
+			return -ENODEV;
+		}
+		sc_stats_t sc_stats;
+		if (sc_get_stats(dev->sc_dev, &sc_stats) == 0)
+			fprintf(stderr, "%sOpened %s device %s with %u buffers.\n", dev->tag, sc_get_impl_name(), dev->sc_name, sc_stats.buffers);
+		else
+			fprintf(stderr, "%sOpened %s device %s.\n", dev->tag, sc_get_impl_name(), dev->sc_name);
+	}
+	else {
+		// device names
+		char dev_manufact[256];
+		char dev_product[256];
+		char dev_serial[256];
 
-	//output files
-	FILE *output_aux = NULL;
-	FILE *output_raw = NULL;
+		r = hsdaoh_alloc(&dev->hs_dev);
+		if (r < 0) {
+			fprintf(stderr, "Failed to allocate hsdaoh device.\n");
+			return -ENODEV;
+		}
+
+		hsdaoh_raw_callback(dev->hs_dev, true);
+		hsdaoh_set_msg_callback(dev->hs_dev, &print_capture_message, dev->tag);
+
+		r = hsdaoh_open2(dev->hs_dev, dev->dev_index);
+		if (r < 0) {
+			fprintf(stderr, "%sFailed to open hsdaoh device #%u.\n", dev->tag, dev->dev_index);
+			return -ENODEV;
+		}
+
+		dev_manufact[0] = 0;
+		dev_product[0] = 0;
+		dev_serial[0] = 0;
+		r = hsdaoh_get_usb_strings(dev->hs_dev, dev_manufact, dev_product, dev_serial);
+		if (r < 0)
+			fprintf(stderr, "%sFailed to identify hsdaoh device #%u.\n", dev->tag, dev->dev_index);
+		else
+			fprintf(stderr, "%sOpened device #%u: %s %s, serial: %s\n", dev->tag, dev->dev_index, dev_manufact, dev_product, dev_serial);
+
+		fprintf(stderr, "%sReading samples...\n", dev->tag);
+		dev->result = hsdaoh_start_stream(dev->hs_dev, hsdaoh_callback, &dev->cap_ctx);
+	}
+	return 0;
+}
+
+// USB delivery over the whole capture, the histograms are in --telemetry
+static void print_frame_timing(const char *tag, frame_timing_t *t, frame_queue_t *queue)
+{
+	uint64_t counts[FRAME_TIMING_BUCKETS];
+	uint64_t n[FRAME_TIMING_KINDS] = { 0 };
+	double sum[FRAME_TIMING_KINDS];
+	for (int k = 0; k < FRAME_TIMING_KINDS; k++) {
+		sum[k] = frame_timing_read(t, (frame_timing_kind_t)k, counts);
+		for (int i = 0; i < FRAME_TIMING_BUCKETS; i++) n[k] += counts[i];
+	}
+	if (n[FRAME_TIMING_INTERVAL] == 0) return;
+	fprintf(stderr, "%sFrame interval %.3f ms avg, %.3f ms max (period %.3f ms), callback %.3f ms avg, %.3f ms max, %" PRIu64 " late, %" PRIu64 " slow\n",
+	        tag, sum[FRAME_TIMING_INTERVAL] * 1e3 / (double)n[FRAME_TIMING_INTERVAL],
+	        (double)telemetry_read(&t->max_ns[FRAME_TIMING_INTERVAL]) / 1e6, (double)telemetry_read(&t->period_ns) / 1e6,
+	        sum[FRAME_TIMING_DURATION] * 1e3 / (double)n[FRAME_TIMING_DURATION],
+	        (double)telemetry_read(&t->max_ns[FRAME_TIMING_DURATION]) / 1e6,
+	        telemetry_read(&t->late), telemetry_read(&t->slow));
+	if (queue == NULL || n[FRAME_TIMING_PARSE] == 0) return;
+	fprintf(stderr, "%sFrame parser %.3f ms avg, %.3f ms max, up to %u of %u frames queued, %" PRIu64 " dropped\n",
+	        tag, sum[FRAME_TIMING_PARSE] * 1e3 / (double)n[FRAME_TIMING_PARSE],
+	        (double)telemetry_read(&t->max_ns[FRAME_TIMING_PARSE]) / 1e6,
+	        frame_queue_high_water(queue), frame_queue_depth(queue), frame_queue_dropped(queue));
+}
+
+// extract the samples of a device into its outputs until the capture ends, then close them
+// pressure for --overload: the fill of the fullest buffer between the stages
+static double capture_fill(capture_dev_t *dev)
+{
+	rb_stats_t stats;
+	double fill = 0.0;
+	ringbuffer_t *rbs[4] = { &dev->cap_ctx.rb, NULL, NULL, NULL };
+	for (int i = 0; i < 2; i++)
+		if (dev->o.output_names[i] != NULL) rbs[1 + i] = &dev->thread_out_ctx[i].rb;
+	if (dev->cap_ctx.handler.capture_audio) rbs[3] = &dev->cap_ctx.rb_audio;
+	for (int i = 0; i < 4; i++) {
+		if (rbs[i] == NULL) continue;
+		rb_get_stats(rbs[i], &stats);
+		// the pre-roll held back by --trigger is not a backlog
+		if (i == 0 && dev->o.trigger_on) stats.fill -= record_trigger_held_samples(&dev->trigger)*4;
+		if (stats.size && (double)stats.fill / (double)stats.size > fill) fill = (double)stats.fill / (double)stats.size;
+	}
+	return fill;
+}
+
+static int capture_device_run(void *ctx)
+{
+	capture_dev_t *dev = ctx;
+	const capture_opts_t *o = &dev->o;
+	cli_capture_ctx_t *cap_ctx = &dev->cap_ctx;
+	filewriter_ctx_t *thread_out_ctx = dev->thread_out_ctx;
+	char *const *output_names = o->output_names;
+	bool multi = num_capture_devs > 1;
+	bool replay_done = false;
+	int r;
 
 	//buffer
-	uint8_t  *buf_aux = aligned_alloc(16,sizeof(uint8_t) *BUFFER_READ_SIZE);
+	uint8_t  *buf_aux = buffer_pool_get(dev->pool, sizeof(uint8_t) *BUFFER_READ_SIZE);
+
+	// with --rf-float the kernels extract into scratch buffers and the float conversion fills the channel ringbuffers
+	size_t out_size = o->rf_float ? BUFFER_READ_SIZE*sizeof(float) : BUFFER_READ_SIZE*sizeof(int16_t);
+	int16_t *buf_i16[2] = {NULL, NULL};
+	f32_out_t f32[2];
+	for (int i = 0; i < 2 && o->rf_float; i++) {
+		if (output_names[i] == NULL) continue;
+		f32_out_init(&f32[i], conv_16tof32, o->pad, o->rf_float_dc);
+		if ((buf_i16[i] = buffer_pool_get(dev->pool, BUFFER_READ_SIZE*sizeof(int16_t))) == NULL) {
+			fprintf(stderr, "%sERROR: failed allocating the float conversion buffer\n", dev->tag);
+			do_exit = 1;
+		}
+	}
 
 	uint64_t total_samples = 0;
+	uint64_t aux_samples = 0;  // in the raw aux output, behind total_samples after --overload gaps
+	uint64_t aux_seg = 0;      // aux bytes in the current --trigger event
 
 	//clipping state
 	size_t clip[2] = {0, 0};
@@ -877,9 +2432,322 @@ int main(int argc, char **argv)
 	uint16_t peak_level[2] = {0, 0};
 
 	// conversion function
-	conv_function_t conv_function;
+	conv_function_t conv_function = NULL;
+	conv_stats_t conv_stats = NULL;
+	extract_stats_t stats, block_stats, hist_stats;
+
+	// code histogram for --histogram, reported every histogram_s seconds
+	code_hist_t *hist = NULL;
+	uint64_t hist_period = (uint64_t)o->histogram_s * (RATE_RF_INPUT/sizeof(int16_t));
+	uint64_t hist_next = hist_period;
+	if (o->histogram_s) {
+		hist = code_hist_new(HISTOGRAM_BLOCK_STRIDE);
+		if (hist == NULL) fprintf(stderr, "%sNo memory for the code histogram, no reports\n", dev->tag);
+	}
 
-	memset(&thread_audio_ctx, 0, sizeof(audiowriter_ctx_t));
+	// the preview envelope is made of the per block extremes of the stats kernels
+	extract_envelope_t *envelope = NULL;
+	if (dev->preview) {
+		envelope = malloc(sizeof(extract_envelope_t) * (BUFFER_READ_SIZE / EXTRACT_STATS_BLOCK));
+		if (envelope == NULL) {
+			fprintf(stderr, "%sNo memory for the preview envelope, no preview\n", dev->tag);
+			preview_close(dev->preview);
+			dev->preview = NULL;
+		}
+	}
+
+	// the other threads of the device are started and apply their own roles
+	thread_role_apply(THREAD_ROLE_EXTRACT);
+
+	// the level meter, the histogram report and the preview use the kernels that gather statistics in the same pass
+	// the output ringbuffers always hold 16-bit samples, the FLAC writer widens them per block
+	if (o->plevel || hist || dev->preview) conv_stats = get_conv_stats_function(o->pad, 0, o->output_names[0], o->output_names[1]);
+	else conv_function = get_conv_function(0, o->pad, 0, 0, o->output_names[0], o->output_names[1]);
+	extract_stats_reset(&stats);
+	extract_stats_reset(&hist_stats);
+
+	while (!do_exit) {
+		void *buf, *buf_out1 = NULL, *buf_out2 = NULL;
+		// with --trigger the pre-roll stays unread behind the block that is looked at
+		size_t want = o->trigger_on ? record_trigger_wanted(&dev->trigger) : BUFFER_READ_SIZE;
+		// block until input is available, then until both outputs have room
+		while(((buf = rb_read_ptr_wait(&cap_ctx->rb, want*4, RB_WAIT_MS)) == NULL) && !do_exit) {
+			// the end of a replay leaves less than a block behind, the last frame may just have come in
+			// (and been parsed, with --parser-thread)
+			if (dev->replay && replay_finished(dev->replay) && (cap_ctx->queue == NULL || frame_queue_fill(cap_ctx->queue) == 0)) {
+				buf = rb_read_ptr(&cap_ctx->rb, want*4);
+				break;
+			}
+		}
+		if (buf == NULL && !do_exit) {
+			replay_done = true;
+			do_exit = true;
+			break;
+		}
+		if (do_exit) break;
+		if (o->trigger_on) {
+			record_trigger_action_t action = record_trigger_step(&dev->trigger, (const uint32_t*)buf, total_samples);
+			if (action == RECORD_TRIGGER_WAIT) continue;
+			if (action == RECORD_TRIGGER_START) {
+				fprintf(stderr, "%sTrigger %" PRIu64 " at sample %" PRIu64 "\n", dev->tag, dev->trigger.events, dev->trigger.trigger_sample);
+				new_line = 1;
+				continue;
+			}
+			// outside an event the oldest block goes back to the capture unextracted
+			if (action == RECORD_TRIGGER_DISCARD) {
+				rb_read_finished(&cap_ctx->rb, BUFFER_READ_SIZE*4);
+				goto block_done;
+			}
+		}
+		// while waiting for the writers the policy keeps shedding, the callback drops RF frames meanwhile
+		while(output_names[0] != NULL && !do_exit &&
+			  ((buf_out1 = rb_write_ptr_wait(&thread_out_ctx[0].rb, out_size, RB_WAIT_MS)) == NULL))
+			overload_update(cap_ctx->overload, capture_fill(dev));
+		while(output_names[1] != NULL && !do_exit &&
+			  ((buf_out2 = rb_write_ptr_wait(&thread_out_ctx[1].rb, out_size, RB_WAIT_MS)) == NULL))
+			overload_update(cap_ctx->overload, capture_fill(dev));
+		if (do_exit) break;
+		if (cap_ctx->overload) overload_update(cap_ctx->overload, capture_fill(dev));
+		void *ext_out1 = o->rf_float ? buf_i16[0] : buf_out1;
+		void *ext_out2 = o->rf_float ? buf_i16[1] : buf_out2;
+		TRACE_BEGIN("extract");
+		if (conv_stats) {
+			// each meter resets on its own schedule
+			extract_stats_reset(&block_stats);
+			block_stats.envelope = envelope;
+			conv_stats((uint32_t*)buf, BUFFER_READ_SIZE, clip, buf_aux, ext_out1, ext_out2, &block_stats);
+			extract_stats_merge(&stats, &block_stats);
+			extract_stats_merge(&hist_stats, &block_stats);
+		}
+		else conv_function((uint32_t*)buf, BUFFER_READ_SIZE, clip, buf_aux, ext_out1, ext_out2, peak_level);
+		TRACE_END("extract");
+		if (o->rf_float) {
+			TRACE_BEGIN("float");
+			if (buf_out1) f32_out_convert(&f32[0], buf_i16[0], buf_out1, BUFFER_READ_SIZE);
+			if (buf_out2) f32_out_convert(&f32[1], buf_i16[1], buf_out2, BUFFER_READ_SIZE);
+			TRACE_END("float");
+		}
+		if (hist && !overload_shed(cap_ctx->overload, OVERLOAD_DISPLAY)) code_hist_add(hist, (const uint32_t*)buf, BUFFER_READ_SIZE);
+		// a shed block leaves a gap in the preview, it starts a new envelope entry after it
+		if (dev->preview && !overload_shed(cap_ctx->overload, OVERLOAD_DISPLAY)) preview_push(dev->preview, total_samples, (const uint32_t*)buf, envelope, BUFFER_READ_SIZE);
+		rb_read_finished(&cap_ctx->rb, BUFFER_READ_SIZE*4);
+		if(cap_ctx->index) sample_index_aux(cap_ctx->index, buf_aux, BUFFER_READ_SIZE, total_samples);
+		// the changes are found while the block is still in the cache
+		if(dev->aux_events != NULL) aux_encoder_write(dev->aux_events, buf_aux, BUFFER_READ_SIZE);
+		if(dev->output_aux != NULL) {
+			if (overload_shed(cap_ctx->overload, OVERLOAD_AUX)) {
+				overload_gap(cap_ctx->overload, OVERLOAD_STREAM_AUX, aux_samples, BUFFER_READ_SIZE);
+			}
+			else {
+				if (dev->segment_aux && file_segment_due(dev->segment_aux, aux_seg, aux_seg)) {
+					FILE *next = file_segment_next(dev->segment_aux);
+					if (next) {
+						dev->output_aux = next;
+						aux_seg = 0;
+					}
+				}
+				fwrite(buf_aux,1,BUFFER_READ_SIZE,dev->output_aux);
+				aux_seg += BUFFER_READ_SIZE;
+				overload_resume(cap_ctx->overload, OVERLOAD_STREAM_AUX);
+				aux_samples += BUFFER_READ_SIZE;
+			}
+		}
+		if(output_names[0] != NULL) rb_write_finished(&thread_out_ctx[0].rb, out_size);
+		if(output_names[1] != NULL) rb_write_finished(&thread_out_ctx[1].rb, out_size);
+
+block_done:
+		total_samples += BUFFER_READ_SIZE;
+		telemetry_count(&cap_ctx->samples, BUFFER_READ_SIZE);
+
+		// the suppressed messages still count for the telemetry
+		if(clip[0] > 0)
+		{
+			telemetry_count(&cap_ctx->clipped[0], clip[0]);
+			if(!o->suppress_a_clipping) {
+				fprintf(stderr,"%sADC A : %zu samples clipped\n",dev->tag,clip[0]);
+				new_line = 1;
+			}
+			clip[0] = 0;
+		}
+
+		if(clip[1] > 0)
+		{
+			telemetry_count(&cap_ctx->clipped[1], clip[1]);
+			if(!o->suppress_b_clipping) {
+				fprintf(stderr,"%sADC B : %zu samples clipped\n",dev->tag,clip[1]);
+				new_line = 1;
+			}
+			clip[1] = 0;
+		}
+		if (hist && total_samples >= hist_next) {
+			print_histogram(dev->tag, 'A', hist, &hist_stats, 0);
+			print_histogram(dev->tag, 'B', hist, &hist_stats, 1);
+			code_hist_reset(hist);
+			extract_stats_reset(&hist_stats);
+			hist_next += hist_period;
+			new_line = 1;
+		}
+		// the devices print in turn, without moving the cursor over each other's lines
+		if (multi && total_samples % PROGRESS_MULTI_SAMPLES == 0) {
+			fprintf(stderr,"%sProgress: %13" PRIu64 " samples, %2uh %2um %2us\n", dev->tag, total_samples, (uint32_t)(total_samples/(144000000000)), (uint32_t)((total_samples/(2400000000)) % 60), (uint32_t)((total_samples/(40000000)) % 60));
+		}
+		else if (!multi && total_samples % (BUFFER_READ_SIZE<<(2 - o->plevel)) == 0 && !overload_shed(cap_ctx->overload, OVERLOAD_DISPLAY)) {
+			if(new_line) {
+				fprintf(stderr,"\n");
+				if(o->plevel) fprintf(stderr,"\n\n\n");
+			}
+			new_line = 0;
+			if(o->plevel) {
+				fprintf(stderr,"\033[A\033[A\033[A\033[A");
+
+				print_level('A', &stats, 0);
+				print_level('B', &stats, 1);
+				extract_stats_reset(&stats);
+				fprintf(stderr,"\33[2K\r RB");
+				print_rb_stats("cap", &cap_ctx->rb);
+				if(output_names[0] != NULL) print_rb_stats("A", &thread_out_ctx[0].rb);
+				if(output_names[1] != NULL) print_rb_stats("B", &thread_out_ctx[1].rb);
+				if(cap_ctx->handler.capture_audio) print_rb_stats("aud", &cap_ctx->rb_audio);
+				fprintf(stderr,"\n");
+			}
+			else {
+				fprintf(stderr,"\033[A");
+			}
+			// \033[A = move cursor up
+			// \33[2K = erase line
+
+
+			fprintf(stderr,"\33[2K\r Progress: %13" PRIu64 " samples, %2uh %2um %2us\n", total_samples, (uint32_t)(total_samples/(144000000000)), (uint32_t)((total_samples/(2400000000)) % 60), (uint32_t)((total_samples/(40000000)) % 60));
+			fflush(stderr);
+		}
+		if (total_samples >= o->total_samples_before_exit && o->total_samples_before_exit != 0) {
+			fprintf(stderr, "%s%" PRIu64 " total samples have been collected, exiting early!\n", dev->tag, total_samples);
+			do_exit = true;
+		}
+	}
+
+	if (replay_done)
+		fprintf(stderr, "\n%sEnd of replay after %" PRIu64 " samples, exiting...\n", dev->tag, total_samples);
+	else if (do_exit)
+		fprintf(stderr, "\n%sUser cancel, exiting...\n", dev->tag);
+	else
+		fprintf(stderr, "\n%sLibrary error %d, exiting...\n", dev->tag, dev->result);
+
+	if (dev->hs_dev) { hsdaoh_close(dev->hs_dev); dev->hs_dev = NULL; }
+	if (dev->replay) { replay_stop(dev->replay); dev->replay = NULL; }
+	if (dev->sc_dev) {
+		sc_stats_t sc_stats;
+		if (sc_get_stats(dev->sc_dev, &sc_stats) == 0) {
+			fprintf(stderr, "%sCapture device: %" PRIu64 " frames, %" PRIu64 " dropped by the driver, dequeue latency %.2f ms avg, %.2f ms max (%u buffers)\n",
+			        dev->tag, sc_stats.frames, sc_stats.dropped, sc_stats.latency_avg_ns / 1e6, sc_stats.latency_max_ns / 1e6, sc_stats.buffers);
+		}
+		sc_stop_capture(dev->sc_dev);
+		dev->sc_dev = NULL;
+	}
+	if (o->trigger_on) fprintf(stderr, "%sTriggered recording: %" PRIu64 " events\n", dev->tag, dev->trigger.events);
+	// the stream is stopped, nothing is queued anymore
+	if (dev->thread_parser != 0) {
+		atomic_store(&dev->parser_stop, true);
+		frame_queue_wake(cap_ctx->queue);
+		r = thrd_join(dev->thread_parser, NULL);
+		if (r != thrd_success) fprintf(stderr, "Failed to join frame parser thread.\n");
+		dev->thread_parser = 0;
+	}
+	print_frame_timing(dev->tag, &cap_ctx->timing, cap_ctx->queue);
+
+////ending of the device
+
+	buffer_pool_put(dev->pool, buf_aux);
+	buffer_pool_put(dev->pool, buf_i16[0]);
+	buffer_pool_put(dev->pool, buf_i16[1]);
+	code_hist_free(hist);
+	preview_close(dev->preview);
+	dev->preview = NULL;
+	free(envelope);
+	record_trigger_free(&dev->trigger);
+	// the capture callback is stopped, nothing adds entries anymore
+	sample_index_close(cap_ctx->index);
+	if (cap_ctx->dump && cap_ctx->dump != stdout) fclose(cap_ctx->dump);
+
+	if (dev->thread_raw!=0) {
+		r = thrd_join(dev->thread_raw, NULL);
+		if (r != thrd_success) fprintf(stderr, "Failed to join raw output thread.\n");
+	}
+
+	if (dev->output_aux) close_output(dev->output_aux, dev->segment_aux);
+	if (aux_encoder_close(dev->aux_events) != 0) fprintf(stderr, "%sFailed to write the aux events\n", dev->tag);
+	// the raw writer may have moved on to later segments
+	if (dev->output_raw) close_output(dev->raw_writer_cfg.file, dev->segment_raw);
+
+	for(int i=0;i<2;i++) {
+		if (dev->thread_out[i]!=0) {
+			r = thrd_join(dev->thread_out[i], NULL);
+			if (r != thrd_success) fprintf(stderr, "Failed to join thread %d.\n", i);
+		}
+		// consumers see the export stop, the name is free again
+		else if (output_names[i] != NULL && rb_shm_is_url(output_names[i])) rb_close(&thread_out_ctx[i].rb);
+	}
+
+	if (dev->thread_audio!=0) {
+		r = thrd_join(dev->thread_audio, NULL);
+		if (r != thrd_success) fprintf(stderr, "Failed to join audio thread.\n");
+	}
+
+	// the writers are done with it, the gaps still open are logged now
+	overload_free(cap_ctx->overload);
+	cap_ctx->overload = NULL;
+	frame_queue_free(cap_ctx->queue);
+	cap_ctx->queue = NULL;
+	buffer_pool_free(dev->pool);
+	dev->pool = NULL;
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+//set pipe mode to binary in windows
+#if defined(_WIN32) || defined(_WIN64)
+	_setmode(_fileno(stdout), O_BINARY);
+	_setmode(_fileno(stdin), O_BINARY);
+#else
+	struct sigaction sigact;
+#endif
+
+	int r, opt;
+	capture_opts_t opts;
+	const char *telemetry_address = NULL;
+	double telemetry_interval = TELEMETRY_DEFAULT_INTERVAL;
+	telemetry_t *telemetry = NULL;
+#if TRACE_ENABLED == 1
+	const char *trace_path = NULL;
+#endif
+	memset(&opts, 0, sizeof(opts));
+#if LIBFLAC_ENABLED == 1
+	opts.flac_levels = flac_writer_default_config();
+#endif
+#if LIBSOXR_ENABLED == 1
+	opts.resample_qual[0] = opts.resample_qual[1] = 3;
+#endif
+	opts.output_thread_func = (thrd_start_t)raw_file_writer;
+	//file output backend for raw and unresampled RF outputs
+	opts.io_backend = RB_WRITER_STDIO;
+	opts.io_depth = RB_WRITER_QUEUE_DEPTH;
+	opts.replay_speed = 1.0;
+	opts.pre_roll = (uint64_t)(RECORD_TRIGGER_DEFAULT_PRE_ROLL * (RATE_RF_INPUT/sizeof(int16_t)));
+	opts.post_roll = (uint64_t)(RECORD_TRIGGER_DEFAULT_POST_ROLL * (RATE_RF_INPUT/sizeof(int16_t)));
+	bool roll_set = false;
+	double roll;
+
+	// getopt string
+	char getopt_string[256];
+
+	// devices in the order of -d, device 0 if none is given
+	uint32_t dev_indexes[MAX_CAPTURE_DEVICES] = { 0 };
+	char *sc_dev_names[MAX_CAPTURE_DEVICES] = { NULL };
+	int dev_count = 0;
+
+	bool preflight = false;
 
 	fprintf(stderr,
 		"MISRC capture " MIRSC_TOOLS_VERSION"\n"
@@ -893,124 +2761,333 @@ int main(int argc, char **argv)
 	while ((opt = getopt_long(argc, argv, getopt_string, getopt_long_options, &index_ptr)) != -1) {
 		switch (opt) {
 		case 'd':
+			if (dev_count == MAX_CAPTURE_DEVICES) {
+				fprintf(stderr, "ERROR: at most %d devices can be captured at once\n", MAX_CAPTURE_DEVICES);
+				usage();
+			}
+			str_cnt = 0;
 			if (str_starts_with(sc_get_impl_name_short(), "://", &str_cnt, optarg)) {
-				sc_dev_name = strdup(&(optarg[str_cnt]));
+				sc_dev_names[dev_count] = strdup(&(optarg[str_cnt]));
 			}
 			else
-				dev_index = (uint32_t)atoi(optarg);
+				dev_indexes[dev_count] = (uint32_t)atoi(optarg);
+			dev_count++;
 			break;
 		case 'a':
-			output_names[0] = optarg;
+			opts.output_names[0] = optarg;
 			break;
 		case 'b':
-			output_names[1] = optarg;
+			opts.output_names[1] = optarg;
 			break;
 #if LIBFLAC_ENABLED == 1
-#if defined(FLAC_API_VERSION_CURRENT) && FLAC_API_VERSION_CURRENT >= 14
 		case 'c':
-			flac_threads = (uint32_t)atoi(optarg);
+			opts.flac_threads = (uint32_t)atoi(optarg);
+			break;
+		case OPT_RF_FLAC_PARALLEL:
+			opts.flac_block_parallel = true;
+			break;
+		case OPT_RF_FLAC_SIDECAR:
+			opts.flac_sidecar = true;
+			break;
+		case OPT_AUDIO_FLAC:
+			opts.audio_flac = true;
+			break;
+		case OPT_RF_FLAC_12BIT:
+			opts.flac_12bit = true;
+			break;
+		case 'f':
+			opts.output_thread_func = (thrd_start_t)flac_file_writer;
+			opts.rf_flac = true;
+			break;
+		case 'l':
+			if (flac_writer_parse_level(optarg, &opts.flac_levels) != 0) {
+				fprintf(stderr, "Invalid FLAC level %s, use 0-8, auto or MIN-MAX\n", optarg);
+				usage();
+			}
+			break;
+		case 'v':
+			opts.flac_verify = true;
+			break;
+#endif
+		case OPT_RF_DELTA:
+			opts.output_thread_func = (thrd_start_t)delta_file_writer;
+			opts.rf_delta = true;
+			break;
+		case 'x':
+			opts.output_name_aux = optarg;
+			break;
+		case OPT_AUX_EVENTS:
+			opts.aux_events = true;
+			break;
+		case 'r':
+			opts.output_name_raw = optarg;
+			break;
+		case 'p':
+			opts.pad = 1;
+			break;
+		case OPT_RF_PACKED_12BIT:
+			opts.packed_12bit = true;
+			break;
+		case OPT_RF_FLOAT:
+			opts.rf_float = true;
+			break;
+		case OPT_RF_FLOAT_DC:
+			opts.rf_float_dc = true;
+			break;
+		case OPT_INDEX:
+			opts.output_name_index = optarg;
+			break;
+		case OPT_PREFLIGHT:
+			preflight = true;
+			break;
+		case OPT_AFFINITY:
+			if (thread_role_parse_affinity(optarg) != 0) {
+				fprintf(stderr, "Invalid affinity %s, use role:cpus with a role of " THREAD_ROLE_NAMES "\n", optarg);
+				usage();
+			}
+			break;
+		case OPT_REALTIME:
+			thread_role_set_realtime(true);
+			break;
+		case OPT_NUMA_NODE:
+			if (thread_role_set_numa_node(atoi(optarg)) != 0) {
+				fprintf(stderr, "Invalid NUMA node %s, there is no such node with CPUs\n", optarg);
+				usage();
+			}
+			rb_set_numa_node(atoi(optarg));
 			break;
-#endif
-		case OPT_RF_FLAC_12BIT:
-			flac_12bit = true;
+		case OPT_CAPTURE_BUFFERS:
+			if (atoi(optarg) < 2) {
+				fprintf(stderr, "Invalid number of capture buffers %s, use at least 2\n", optarg);
+				usage();
+			}
+			sc_set_buffer_count((uint32_t)atoi(optarg));
 			break;
-		case 'f':
-			output_thread_func = (thrd_start_t)flac_file_writer;
-			out_size = 4;
+		case OPT_PARSER_THREAD:
+			opts.parser_depth = FRAME_QUEUE_DEFAULT_DEPTH;
+			if (optarg != NULL) {
+				int depth = atoi(optarg);
+				if (!frame_queue_depth_valid((unsigned)depth)) {
+					fprintf(stderr, "Invalid frame queue depth %s, use a power of two from 2 to %d frames\n", optarg, FRAME_QUEUE_MAX_DEPTH);
+					usage();
+				}
+				opts.parser_depth = (unsigned)depth;
+			}
 			break;
-		case 'l':
-			flac_level = (uint32_t)atoi(optarg);
+		case OPT_BUFFER_TIME:
+			opts.buffers.seconds = atof(optarg);
+			if (opts.buffers.seconds <= 0.0 || opts.buffers.seconds > BUFFER_SIZING_MAX_SECONDS) {
+				fprintf(stderr, "Invalid buffer time %s, use up to %.0f seconds\n", optarg, BUFFER_SIZING_MAX_SECONDS);
+				usage();
+			}
 			break;
-		case 'v':
-			flac_verify = true;
+		case OPT_BUFFER_MEMORY:
+			if (file_segment_parse_size(optarg, &opts.buffers.budget) != 0 || opts.buffers.budget == 0) {
+				fprintf(stderr, "Invalid buffer memory %s\n", optarg);
+				usage();
+			}
 			break;
-#endif
-		case 'x':
-			output_name_aux = optarg;
+		case OPT_LOW_MEMORY:
+			opts.buffers.low_memory = true;
 			break;
-		case 'r':
-			output_name_raw = optarg;
+		case OPT_OVERLOAD:
+			overload_policy_default(&opts.overload);
+			if (optarg && overload_policy_parse(optarg, &opts.overload) != 0) {
+				fprintf(stderr, "Invalid overload policy %s, use display, aux, audio or flac=PERCENT or off and rf-wait=MS\n", optarg);
+				usage();
+			}
+			opts.overload_on = true;
 			break;
-		case 'p':
-			pad = 1;
+		case OPT_DECIMATE_A:
+		case OPT_DECIMATE_B:
+			opts.decimation[opt - OPT_DECIMATE_A] = (unsigned)atoi(optarg);
+			if (!decimator_factor_valid(opts.decimation[opt - OPT_DECIMATE_A])) {
+				fprintf(stderr, "ERROR: Decimation factor has to be 2, 4 or 8!\n");
+				usage();
+			}
 			break;
 		case 'w':
-			overwrite_files = true;
+			opts.overwrite_files = true;
 			break;
 		case 'n':
-			total_samples_before_exit = (uint64_t)strtoull(optarg,NULL,0);
+			opts.total_samples_before_exit = (uint64_t)strtoull(optarg,NULL,0);
 			break;
 		case 't':
-			if(total_samples_before_exit == 0) {
+			if(opts.total_samples_before_exit == 0) {
 				char *tp;
 				tp = strtok(optarg, ":");
 				while (tp != NULL) {
-					total_samples_before_exit *= 60;
-					total_samples_before_exit += (uint64_t)strtoull(tp,NULL,10);
+					opts.total_samples_before_exit *= 60;
+					opts.total_samples_before_exit += (uint64_t)strtoull(tp,NULL,10);
 					tp = strtok(NULL, ":");
 				}
-				total_samples_before_exit *= 40000000;
+				opts.total_samples_before_exit *= 40000000;
 			}
 			break;
 		case 'A':
-			suppress_a_clipping = true;
+			opts.suppress_a_clipping = true;
 			break;
 		case 'B':
-			suppress_b_clipping = true;
+			opts.suppress_b_clipping = true;
 			break;
 		case 'L':
-			plevel = 1;
+			opts.plevel = 1;
+			break;
+		case OPT_HISTOGRAM:
+			if (atoi(optarg) < 1) {
+				fprintf(stderr, "Invalid histogram report interval %s, use at least 1 second\n", optarg);
+				usage();
+			}
+			opts.histogram_s = (unsigned)atoi(optarg);
 			break;
 #if LIBSOXR_ENABLED == 1
 		case OPT_RESAMPLE_A:
-			resample_rate[0] = atof(optarg);
+			opts.resample_rate[0] = atof(optarg);
 			break;
 		case OPT_RESAMPLE_B:
-			resample_rate[1] = atof(optarg);
+			opts.resample_rate[1] = atof(optarg);
 			break;
 		case OPT_RESAMPLE_QUAL_A:
-			resample_qual[0] = (uint32_t)atoi(optarg);
+			opts.resample_qual[0] = (uint32_t)atoi(optarg);
 			break;
 		case OPT_RESAMPLE_QUAL_B:
-			resample_qual[1] = (uint32_t)atoi(optarg);
+			opts.resample_qual[1] = (uint32_t)atoi(optarg);
 			break;
 		case OPT_RESAMPLE_GAIN_A:
-			resample_gain[0] = atof(optarg);
+			opts.resample_gain[0] = atof(optarg);
 			break;
 		case OPT_RESAMPLE_GAIN_B:
-			resample_gain[1] = atof(optarg);
+			opts.resample_gain[1] = atof(optarg);
 			break;
 		case OPT_8BIT_A:
-			reduce_8bit[0] = true;
+			opts.reduce_8bit[0] = true;
 			break;
 		case OPT_8BIT_B:
-			reduce_8bit[1] = true;
+			opts.reduce_8bit[1] = true;
 			break;
 #endif
 		case OPT_AUDIO_4CH_OUT:
-			output_name_4ch_audio = optarg;
+			opts.output_name_4ch_audio = optarg;
 			break;
 		case OPT_AUDIO_2CH_12_OUT:
-			output_names_2ch_audio[0] = optarg;
+			opts.output_names_2ch_audio[0] = optarg;
 			break;
 		case OPT_AUDIO_2CH_34_OUT:
-			output_names_2ch_audio[1] = optarg;
+			opts.output_names_2ch_audio[1] = optarg;
 			break;
 		case OPT_AUDIO_1CH_1_OUT:
-			output_names_1ch_audio[0] = optarg;
+			opts.output_names_1ch_audio[0] = optarg;
 			break;
 		case OPT_AUDIO_1CH_2_OUT:
-			output_names_1ch_audio[1] = optarg;
+			opts.output_names_1ch_audio[1] = optarg;
 			break;
 		case OPT_AUDIO_1CH_3_OUT:
-			output_names_1ch_audio[2] = optarg;
+			opts.output_names_1ch_audio[2] = optarg;
 			break;
 		case OPT_AUDIO_1CH_4_OUT:
-			output_names_1ch_audio[3] = optarg;
+			opts.output_names_1ch_audio[3] = optarg;
 			break;
 		case OPT_LIST_DEVICES:
 			list_devices();
 			break;
+		case OPT_HUGEPAGES:
+			opts.huge_size = RB_HUGE_2M;
+			if (optarg != NULL) {
+				if (strcmp(optarg, "1G") == 0) opts.huge_size = RB_HUGE_1G;
+				else if (strcmp(optarg, "2M") != 0) {
+					fprintf(stderr, "Invalid huge page size %s, use 2M or 1G\n", optarg);
+					usage();
+				}
+			}
+			break;
+		case OPT_DIRECT_IO:
+			opts.io_direct = true;
+			// fall through
+		case OPT_ASYNC_IO:
+			opts.io_backend = RB_WRITER_ASYNC;
+			if (optarg != NULL) {
+				opts.io_depth = atoi(optarg);
+				if (opts.io_depth < 1 || opts.io_depth > RB_WRITER_MAX_QUEUE_DEPTH) {
+					fprintf(stderr, "Invalid queue depth %s, use 1 to %d\n", optarg, RB_WRITER_MAX_QUEUE_DEPTH);
+					usage();
+				}
+			}
+			break;
+		case OPT_REPLAY:
+			opts.replay_path = optarg;
+			break;
+		case OPT_REPLAY_SPEED:
+			if (replay_parse_speed(optarg, &opts.replay_speed) != 0) {
+				fprintf(stderr, "Invalid replay speed %s, use N x real time up to %.0f or max\n", optarg, REPLAY_SPEED_LIMIT);
+				usage();
+			}
+			break;
+		case OPT_REPLAY_LOOP:
+			opts.replay_loop = true;
+			break;
+		case OPT_DUMP_FRAMES:
+			opts.output_name_frames = optarg;
+			break;
+		case OPT_PREVIEW:
+			opts.output_name_preview = optarg;
+			break;
+		case OPT_PREVIEW_DECIMATION:
+			if (preview_parse_decimation(optarg, &opts.preview_decimation) != 0) {
+				fprintf(stderr, "Invalid preview decimation %s, use a power of two from %u to %u\n", optarg, PREVIEW_MIN_DECIMATION, PREVIEW_MAX_DECIMATION);
+				usage();
+			}
+			break;
+		case OPT_TRIGGER:
+			if (record_trigger_parse(optarg, &opts.trigger) != 0) {
+				fprintf(stderr, "Invalid trigger %s\n", optarg);
+				usage();
+			}
+#ifdef _WIN32
+			// Only SIGUSR2 fires a manual trigger, which Windows does not have
+			if (opts.trigger.type == RECORD_TRIGGER_MANUAL) {
+				fprintf(stderr, "Manual trigger is not supported on Windows, use a level or aux condition\n");
+				usage();
+			}
+#endif
+			opts.trigger_on = true;
+			break;
+		case OPT_PRE_ROLL:
+		case OPT_POST_ROLL:
+			if (record_trigger_parse_roll(optarg, &roll) != 0) {
+				fprintf(stderr, "Invalid %s %s, use 0 to %.0f seconds\n", (opt == OPT_PRE_ROLL) ? "pre-roll" : "post-roll", optarg, RECORD_TRIGGER_MAX_ROLL);
+				usage();
+			}
+			*((opt == OPT_PRE_ROLL) ? &opts.pre_roll : &opts.post_roll) = (uint64_t)(roll * (RATE_RF_INPUT/sizeof(int16_t)));
+			roll_set = true;
+			break;
+		case OPT_TELEMETRY:
+			telemetry_address = optarg;
+			opts.telemetry = true;
+			break;
+#if TRACE_ENABLED == 1
+		case OPT_TRACE:
+			trace_path = optarg;
+			break;
+#endif
+		case OPT_TELEMETRY_INTERVAL:
+			telemetry_interval = strtod(optarg, NULL);
+			if (telemetry_interval < TELEMETRY_MIN_INTERVAL) {
+				fprintf(stderr, "Invalid telemetry interval %s, at least %.1f seconds\n", optarg, TELEMETRY_MIN_INTERVAL);
+				usage();
+			}
+			break;
+		case OPT_SEGMENT_SIZE:
+			if (file_segment_parse_size(optarg, &segment_bytes) != 0) {
+				fprintf(stderr, "Invalid segment size %s\n", optarg);
+				usage();
+			}
+			break;
+		case OPT_SEGMENT_TIME:
+			if (file_segment_parse_time(optarg, &segment_seconds) != 0) {
+				fprintf(stderr, "Invalid segment time %s\n", optarg);
+				usage();
+			}
+			break;
 		case 'h':
 		default:
 			usage();
@@ -1018,91 +3095,255 @@ int main(int argc, char **argv)
 		}
 	}
 
-	if(output_names[0] == NULL && output_names[1] == NULL && output_name_aux == NULL && output_name_raw == NULL && plevel == 0) {
+	if(opts.output_names[0] == NULL && opts.output_names[1] == NULL && opts.output_name_aux == NULL && opts.output_name_raw == NULL && opts.output_name_frames == NULL && opts.output_name_preview == NULL && opts.plevel == 0 && opts.histogram_s == 0) {
 		usage();
 	}
-	else {
-		cap_ctx.handler.capture_rf = true;
+	if (opts.aux_events && opts.output_name_aux == NULL) {
+		fprintf(stderr, "ERROR: --aux-events needs an AUX output (-x)\n");
+		usage();
+	}
+	if (roll_set && !opts.trigger_on) {
+		fprintf(stderr, "ERROR: --pre-roll and --post-roll need --trigger\n");
+		usage();
+	}
+	if (opts.trigger_on) {
+		bool audio_out = opts.output_name_4ch_audio != NULL;
+		for (int i = 0; i < 2; i++) audio_out |= opts.output_names_2ch_audio[i] != NULL;
+		for (int i = 0; i < 4; i++) audio_out |= opts.output_names_1ch_audio[i] != NULL;
+		// the raw capture, the audio and the whole capture timeline of the index and the aux events are continuous
+		if (opts.output_name_raw != NULL || audio_out || opts.output_name_index != NULL || opts.aux_events) {
+			fprintf(stderr, "ERROR: --trigger writes -a, -b and -x only, it cannot be combined with -r, audio outputs, --index or --aux-events\n");
+			usage();
+		}
+		if (segment_bytes != 0 || segment_seconds != 0) {
+			fprintf(stderr, "ERROR: --trigger writes a segment per event, it cannot be combined with --segment-size or --segment-time\n");
+			usage();
+		}
+		if (opts.output_names[0] == NULL && opts.output_names[1] == NULL && opts.output_name_aux == NULL) {
+			fprintf(stderr, "ERROR: --trigger needs an output to write the events to (-a, -b or -x)\n");
+			usage();
+		}
+	}
+	if (opts.replay_path != NULL && dev_count > 0) {
+		fprintf(stderr, "ERROR: A replay takes the place of the device, it cannot be combined with -d\n");
+		usage();
+	}
+	if (opts.replay_path != NULL && opts.overload_on) {
+		fprintf(stderr, "ERROR: A replay waits for the outputs, it cannot be combined with --overload\n");
+		usage();
+	}
+	if (dev_count == 0) dev_count = 1;
+
+	// several devices need their own files, the device number goes where %d is
+	if (dev_count > 1) {
+		char **names[CAPTURE_OUTPUT_NAMES];
+		output_name_ptrs(&opts, names);
+		for (int i = 0; i < CAPTURE_OUTPUT_NAMES; i++) {
+			if (*names[i] != NULL && strstr(*names[i], "%d") == NULL) {
+				fprintf(stderr, "ERROR: With several devices every output name needs a %%d for the device number, %s has none\n", *names[i]);
+				usage();
+			}
+		}
+		if (opts.plevel) {
+			fprintf(stderr, "ERROR: The level display (-L) shows a single device only\n");
+			usage();
+		}
+	}
+
+	thread_role_report_topology();
+
+	if (opts.io_backend != RB_WRITER_STDIO && !rb_writer_backend_available(opts.io_backend)) {
+		fprintf(stderr, "Asynchronous file output is not available on this system, using buffered writes\n");
+		opts.io_backend = RB_WRITER_STDIO;
 	}
 
 #if LIBSOXR_ENABLED == 1
 	for(int i=0; i<2; i++) {
-		switch (resample_qual[i]) {
+		switch (opts.resample_qual[i]) {
 			case 0:
-				resample_qual[i] = SOXR_QQ;
+				opts.resample_qual[i] = SOXR_QQ;
 				break;
 			case 1:
-				resample_qual[i] = SOXR_LQ;
+				opts.resample_qual[i] = SOXR_LQ;
 				break;
 			case 2:
-				resample_qual[i] = SOXR_MQ;
+				opts.resample_qual[i] = SOXR_MQ;
 				break;
 			case 3:
-				resample_qual[i] = SOXR_HQ;
+				opts.resample_qual[i] = SOXR_HQ;
 				break;
 			case 4:
-				resample_qual[i] = SOXR_VHQ;
+				opts.resample_qual[i] = SOXR_VHQ;
 				break;
 			default:
 				fprintf(stderr, "ERROR: Invalid resampling quality option!\n");
 				usage();
 		}
 	}
-	if(resample_rate[0] >= 40000.0 || resample_rate[1] >= 40000.0) {
+	if(opts.resample_rate[0] >= 40000.0 || opts.resample_rate[1] >= 40000.0) {
 		fprintf(stderr, "ERROR: Resampling to rates higher than 40 MHz is not supported!\n");
 		usage();
 	}
-	if((resample_rate[0] != 0.0 || resample_rate[1] != 0.0) && out_size == 4) {
-		if (flac_12bit) {
+#if LIBFLAC_ENABLED == 1
+	if((opts.resample_rate[0] != 0.0 || opts.resample_rate[1] != 0.0) && opts.rf_flac) {
+		if (opts.flac_12bit) {
 			conv_16to12to32 = get_16to12to32_function();
 		} else {
 			conv_16to32 = get_16to32_function();
 		}
 	}
-	if(reduce_8bit[0] || reduce_8bit[1]) {
-		if (out_size == 4) 
+#endif
+	for(int i=0; i<2; i++) {
+		if(opts.decimation[i] != 0 && (opts.resample_rate[i] != 0.0 || opts.reduce_8bit[i])) {
+			fprintf(stderr, "ERROR: Decimation cannot be combined with resampling or 8 bit reduction of the same ADC!\n");
+			usage();
+		}
+	}
+	if(opts.reduce_8bit[0] || opts.reduce_8bit[1]) {
+#if LIBFLAC_ENABLED == 1
+		if (opts.rf_flac)
 			conv_16to8to32 = get_16to8to32_function();
-		else 
+		else
+#endif
 			conv_16to8 = get_16to8_function();
-		if(reduce_8bit[0] && resample_rate[0]==0.0) resample_rate[0] = 40000.0;
-		if(reduce_8bit[1] && resample_rate[1]==0.0) resample_rate[1] = 40000.0;
+		if(opts.reduce_8bit[0] && opts.resample_rate[0]==0.0) opts.resample_rate[0] = 40000.0;
+		if(opts.reduce_8bit[1] && opts.resample_rate[1]==0.0) opts.resample_rate[1] = 40000.0;
+	}
+	// the resampler runs on across the gaps between the events
+	if(opts.trigger_on && (opts.resample_rate[0] != 0.0 || opts.resample_rate[1] != 0.0)) {
+		fprintf(stderr, "ERROR: --trigger cannot be combined with resampling or 8 bit reduction!\n");
+		usage();
 	}
 #endif
 
 #if LIBFLAC_ENABLED == 1
-	if(flac_12bit && pad == 1) {
+	if(opts.flac_12bit && opts.pad == 1) {
 		fprintf(stderr, "Warning: You enabled padding the lower 4 bits, but requested 12 bit flac output, this is not possible, will output 16 bit flac.\n");
-		flac_12bit = false;
+		opts.flac_12bit = false;
+	}
+	// decimated samples are clamped to the FLAC sample width like resampled ones
+	if((opts.decimation[0] != 0 || opts.decimation[1] != 0) && opts.rf_flac) {
+		if (opts.flac_12bit) {
+			conv_16to12to32 = get_16to12to32_function();
+		} else {
+			conv_16to32 = get_16to32_function();
+		}
 	}
 /*#if LIBSOXR_ENABLED == 1
-	if(flac_12bit && (resample_rate[0] != 0.0 || resample_rate[1] != 0.0)) {
+	if(opts.flac_12bit && (opts.resample_rate[0] != 0.0 || opts.resample_rate[1] != 0.0)) {
 		fprintf(stderr, "Warning: You use resampling, this cannot be combined with 12 bit flac output, will output 16 bit flac.\n");
-		flac_12bit = false;
+		opts.flac_12bit = false;
 	}
 #endif*/
-# if defined(FLAC_API_VERSION_CURRENT) && FLAC_API_VERSION_CURRENT >= 14
-	if (flac_threads == 0) {
-		int out_cnt = ((output_names[0] == NULL) ? 0 : 1) + ((output_names[1] == NULL) ? 0 : 1);
+	int out_cnt = ((opts.output_names[0] == NULL) ? 0 : 1) + ((opts.output_names[1] == NULL) ? 0 : 1);
+	if (opts.rf_flac && out_cnt != 0 && dev_count > 1) {
+		// the writers of all devices share one pool of encoders, -c sizes it
+		uint32_t pool_threads = opts.flac_threads;
+		if (pool_threads == 0) {
+			int cores = get_num_cores();
+			fprintf(stderr,"Detected %d cores in the system available to the process\n",cores);
+			// the capture, extraction and writer threads of every device keep their cores
+			cores -= dev_count * (2 + out_cnt);
+			pool_threads = (cores > 0) ? (uint32_t)cores : 1;
+		}
+		if (flac_writer_pool_start(pool_threads) == 0) {
+			fprintf(stderr, "Encoding the FLAC outputs of all devices on %u shared threads\n", pool_threads);
+			opts.flac_shared_pool = true;
+		}
+		else {
+			fprintf(stderr, "Failed to start the shared FLAC encoders, every output uses its own\n");
+		}
+	}
+	if (opts.flac_threads == 0) {
 		if (out_cnt != 0) {
-			flac_threads = get_num_cores();
-			fprintf(stderr,"Detected %d cores in the system available to the process\n",flac_threads);
-			flac_threads = (flac_threads - 2 - out_cnt) / out_cnt;
-			if (flac_threads == 0) flac_threads = 1;
-			if (flac_threads > 128) flac_threads = 128;
+			opts.flac_threads = get_num_cores();
+			if (dev_count == 1) fprintf(stderr,"Detected %d cores in the system available to the process\n",opts.flac_threads);
+			opts.flac_threads = (opts.flac_threads - 2 * dev_count - out_cnt * dev_count) / (out_cnt * dev_count);
+			if (opts.flac_threads == 0) opts.flac_threads = 1;
+			if (opts.flac_threads > 128) opts.flac_threads = 128;
 		}
 	}
-# endif
+	if (opts.flac_sidecar && !opts.rf_flac) {
+		fprintf(stderr, "Warning: --rf-flac-seek-sidecar only applies to FLAC RF outputs.\n");
+	}
 #endif
 
-	if(suppress_a_clipping) {
+	if(opts.rf_delta) {
+#if LIBFLAC_ENABLED == 1
+		if(opts.rf_flac) {
+			fprintf(stderr, "ERROR: Delta coded RF output cannot be combined with FLAC!\n");
+			usage();
+		}
+#endif
+		if(opts.packed_12bit) {
+			fprintf(stderr, "ERROR: Delta coded RF output cannot be combined with packed 12 bit output!\n");
+			usage();
+		}
+#if LIBSOXR_ENABLED == 1
+		if(opts.reduce_8bit[0] || opts.reduce_8bit[1]) {
+			fprintf(stderr, "ERROR: Delta coded RF output cannot be combined with 8 bit reduction!\n");
+			usage();
+		}
+#endif
+	}
+	if(opts.packed_12bit) {
+		// the packed format only has room for the 12 significant bits of the extracted samples
+		if(opts.pad == 1) {
+			fprintf(stderr, "Warning: You enabled padding the lower 4 bits, but requested packed 12 bit output, this is not possible, will output 16 bit.\n");
+			opts.packed_12bit = false;
+		}
+#if LIBFLAC_ENABLED == 1
+		else if(opts.rf_flac) {
+			fprintf(stderr, "Warning: Packed 12 bit output cannot be combined with FLAC, use --rf-flac-12bit instead.\n");
+			opts.packed_12bit = false;
+		}
+#endif
+#if LIBSOXR_ENABLED == 1
+		else if(opts.resample_rate[0] != 0.0 || opts.resample_rate[1] != 0.0) {
+			fprintf(stderr, "Warning: Packed 12 bit output cannot be combined with resampling or 8 bit reduction, will output 16 bit.\n");
+			opts.packed_12bit = false;
+		}
+#endif
+		else if(opts.decimation[0] != 0 || opts.decimation[1] != 0) {
+			fprintf(stderr, "Warning: Packed 12 bit output cannot be combined with decimation, will output 16 bit.\n");
+			opts.packed_12bit = false;
+		}
+		if(opts.packed_12bit) conv_16to12p = get_16to12p_function();
+	}
+	if(opts.rf_float) {
+		// the float samples go out as they are, nothing that reads the 16 bit samples fits in between
+		if(opts.packed_12bit || opts.rf_delta
+#if LIBFLAC_ENABLED == 1
+		   || opts.rf_flac
+#endif
+#if LIBSOXR_ENABLED == 1
+		   || opts.resample_rate[0] != 0.0 || opts.resample_rate[1] != 0.0 || opts.reduce_8bit[0] || opts.reduce_8bit[1]
+#endif
+		   || opts.decimation[0] != 0 || opts.decimation[1] != 0) {
+			fprintf(stderr, "ERROR: Float RF output cannot be combined with packing, FLAC, delta coding, resampling or decimation!\n");
+			usage();
+		}
+		conv_16tof32 = get_16tof32_function();
+	}
+	else if(opts.rf_float_dc) {
+		fprintf(stderr, "Warning: --rf-float-dc only applies to --rf-float outputs.\n");
+	}
+	if(opts.suppress_a_clipping) {
 		fprintf(stderr, "Suppressing clipping messages from ADC A\n");
 	}
-	if(suppress_b_clipping) {
+	if(opts.suppress_b_clipping) {
 		fprintf(stderr, "Suppressing clipping messages from ADC B\n");
 	}
-	if(total_samples_before_exit > 0) {
-		fprintf(stderr, "Capturing %" PRIu64 " samples before exiting\n", total_samples_before_exit);
+	if(opts.total_samples_before_exit > 0) {
+		fprintf(stderr, "Capturing %" PRIu64 " samples before exiting\n", opts.total_samples_before_exit);
+	}
+	if(segment_bytes > 0) {
+		fprintf(stderr, "Splitting outputs into segments of %" PRIu64 " bytes\n", segment_bytes);
+	}
+	if(segment_seconds > 0) {
+		fprintf(stderr, "Splitting outputs into segments of %" PRIu64 " seconds\n", segment_seconds);
 	}
+	if (size_ringbuffers(&opts, dev_count) != 0) return -ENOMEM;
 
 
 #ifndef _WIN32
@@ -1113,222 +3354,164 @@ int main(int argc, char **argv)
 	sigaction(SIGTERM, &sigact, NULL);
 	sigaction(SIGQUIT, &sigact, NULL);
 	sigaction(SIGPIPE, &sigact, NULL);
+	if (opts.trigger_on) {
+		struct sigaction trigger_sigact;
+		trigger_sigact.sa_handler = trigger_sighandler;
+		sigemptyset(&trigger_sigact.sa_mask);
+		trigger_sigact.sa_flags = SA_RESTART;
+		sigaction(SIGUSR2, &trigger_sigact, NULL);
+	}
+#if TRACE_ENABLED == 1
+	if (trace_path != NULL) {
+		struct sigaction trace_sigact;
+		trace_sigact.sa_handler = trace_sighandler;
+		sigemptyset(&trace_sigact.sa_mask);
+		trace_sigact.sa_flags = SA_RESTART;
+		sigaction(SIGUSR1, &trace_sigact, NULL);
+	}
+#endif
 #else
 	SetConsoleCtrlHandler( (PHANDLER_ROUTINE) sighandler, true );
 #endif
 	for(int i=0; i<2; i++) {
-		if (output_names[i] != NULL) {
-			if (file_open_write(&(thread_out_ctx[i].f),output_names[i],overwrite_files,true)) return -ENOENT;
-			thread_out_ctx[i].reduce_8bit = reduce_8bit[i];
-			if (out_size == 4) {
-				thread_out_ctx[i].init_scale = (reduce_8bit[i]) ? ((pad==1) ? 256.0 : 4096.0) : 65536.0;
-			} else {
-				thread_out_ctx[i].init_scale = (reduce_8bit[i]) ? ((pad==1) ? 0.00390625 : 0.0625) : 1.0;
-			}
-#if LIBFLAC_ENABLED == 1
-			thread_out_ctx[i].flac_level = flac_level;
-			thread_out_ctx[i].flac_verify = flac_verify;
-			thread_out_ctx[i].flac_threads = flac_threads;
+		opts.rf_ratio[i] = opts.packed_12bit ? 0.75 : 1.0;
+		opts.rf_async[i] = !opts.packed_12bit;
+		opts.rf_plain[i] = !opts.packed_12bit;
+		opts.rf_seg_rate[i] = RATE_RF_INPUT;
+		// float samples take twice the ringbuffer and the file
+		if (opts.rf_float) {
+			opts.rf_ratio[i] = 2.0;
+			opts.rf_seg_rate[i] = RATE_RF_INPUT * 2;
+		}
+		if (opts.decimation[i] != 0) {
+			opts.rf_ratio[i] = 1.0 / opts.decimation[i];
+			opts.rf_seg_rate[i] = RATE_RF_INPUT / opts.decimation[i];
+			opts.rf_plain[i] = false;
+		}
 #if LIBSOXR_ENABLED == 1
-			thread_out_ctx[i].flac_bits = reduce_8bit[i] ? 8 : (flac_12bit ? 12 : 16);
-			thread_out_ctx[i].conv_func = reduce_8bit[i] ? conv_16to8to32 : (flac_12bit ? conv_16to12to32 : conv_16to32);
-#else
-			thread_out_ctx[i].flac_bits = flac_12bit ? 12 : 16;
-#endif
+		if (opts.resample_rate[i] != 0.0) {
+			opts.rf_ratio[i] = opts.resample_rate[i] / 40000.0 * (opts.reduce_8bit[i] ? 0.5 : 1.0);
+			opts.rf_seg_rate[i] = (uint64_t)(RATE_RF_INPUT * opts.rf_ratio[i]);
+			opts.rf_plain[i] = false;
+		}
 #endif
+#if LIBFLAC_ENABLED == 1
+		// a guess, RF usually compresses to about half
+		if (opts.rf_flac) {
 #if LIBSOXR_ENABLED == 1
-			thread_out_ctx[i].resample_rate = resample_rate[i];
-			thread_out_ctx[i].resample_qual = resample_qual[i];
-			thread_out_ctx[i].resample_gain = resample_gain[i];
+			// the encoder reads 16 bit samples, the 8 bit reduction happens in it
+			if (opts.resample_rate[i] != 0.0) opts.rf_seg_rate[i] = (uint64_t)(RATE_RF_INPUT * opts.resample_rate[i] / 40000.0);
 #endif
-			outbuffer_name[3] = (char)(i+48);
-			rb_init(&thread_out_ctx[i].rb, outbuffer_name, BUFFER_TOTAL_SIZE);
-			r = thrd_create(&thread_out[i], output_thread_func, &thread_out_ctx[i]);
-			if (r != thrd_success) {
-				fprintf(stderr, "Failed to create thread for output processing\n");
-				return -ENOENT;
-			}
+			opts.rf_ratio[i] *= 0.5;
+			opts.rf_async[i] = false;
+			opts.rf_plain[i] = false;
 		}
-	}
-
-	if(output_name_4ch_audio != NULL)
-	{
-		//opening output file audio
-		if (file_open_write(&(thread_audio_ctx.f_4ch), output_name_4ch_audio, overwrite_files, true)) return -ENOENT;
-		cap_ctx.handler.capture_audio = true;
-	}
-
-	for(int i=0; i<2; i++) {
-		if(output_names_2ch_audio[i] != NULL)
-		{
-			//opening output file audio
-			if (file_open_write(&(thread_audio_ctx.f_2ch[i]), output_names_2ch_audio[i], overwrite_files, true)) return -ENOENT;
-			cap_ctx.handler.capture_audio = true;
+#endif
+		// a guess as well, delta coding gets a bit less than FLAC
+		if (opts.rf_delta) {
+			opts.rf_ratio[i] *= 0.6;
+			opts.rf_async[i] = false;
+			opts.rf_plain[i] = false;
 		}
 	}
 
-	for(int i=0; i<4; i++) {
-		if(output_names_1ch_audio[i] != NULL)
-		{
-			//opening output file audio
-			if (file_open_write(&(thread_audio_ctx.f_1ch[i]), output_names_1ch_audio[i], overwrite_files, true)) return -ENOENT;
-			cap_ctx.handler.capture_audio = true;
+	// every device gets the options with its own output names
+	capture_devs = calloc((size_t)dev_count, sizeof(capture_dev_t));
+	if (capture_devs == NULL) return -ENOMEM;
+	num_capture_devs = dev_count;
+	for (int d = 0; d < num_capture_devs; d++) {
+		capture_dev_t *dev = &capture_devs[d];
+		dev->o = opts;
+		dev->num = d;
+		dev->dev_index = dev_indexes[d];
+		dev->sc_name = sc_dev_names[d];
+		if (num_capture_devs > 1) {
+			char **names[CAPTURE_OUTPUT_NAMES];
+			output_name_ptrs(&dev->o, names);
+			snprintf(dev->tag, sizeof(dev->tag), "[%d] ", d);
+			for (int i = 0; i < CAPTURE_OUTPUT_NAMES; i++) {
+				if (*names[i] != NULL && (*names[i] = device_output_name(*names[i], d)) == NULL) return -ENOMEM;
+			}
 		}
 	}
 
-	if(output_name_aux != NULL)
-	{
-		//opening output file aux
-		if (file_open_write(&output_aux, output_name_aux, overwrite_files, true)) return -ENOENT;
-	}
-
-	if(output_name_raw != NULL)
-	{
-		//opening output file raw
-		if (file_open_write(&output_raw, output_name_raw, overwrite_files, true)) return -ENOENT;
-	}
-
-	if(cap_ctx.handler.capture_audio) {
-		rb_init(&cap_ctx.rb_audio,"capture_audio_ringbuffer",BUFFER_AUDIO_TOTAL_SIZE);
-		cap_ctx.handler.rb_audio = &cap_ctx.rb_audio;
-		thread_audio_ctx.rb = &cap_ctx.rb_audio;
-		r = thrd_create(&thread_audio, &audio_file_writer, &thread_audio_ctx);
-		if (r != thrd_success) {
-			fprintf(stderr, "Failed to create thread for output processing\n");
-			return -ENOENT;
+	if(preflight) {
+		preflight_output_t outs[PREFLIGHT_MAX_OUTPUTS];
+		int n = 0;
+		for (int d = 0; d < num_capture_devs; d++) {
+			const capture_opts_t *o = &capture_devs[d].o;
+			if (o->output_name_raw != NULL) outs[n++] = (preflight_output_t){ o->output_name_raw, RATE_RAW_INPUT, BUFFER_READ_SIZE*4, true };
+			for (int i = 0; i < 2; i++)
+				if (o->output_names[i] != NULL) outs[n++] = (preflight_output_t){ o->output_names[i], RATE_RF_INPUT * o->rf_ratio[i], BUFFER_READ_SIZE, o->rf_async[i] };
+			// the aux changes are too few to matter
+			if (o->output_name_aux != NULL && !o->aux_events) outs[n++] = (preflight_output_t){ o->output_name_aux, RATE_RF_INPUT / 2, BUFFER_READ_SIZE, false };
+			if (o->output_name_4ch_audio != NULL) outs[n++] = (preflight_output_t){ o->output_name_4ch_audio, RATE_AUDIO_INPUT * audio_file_ratio(o), BUFFER_AUDIO_READ_SIZE, false };
+			for (int i = 0; i < 2; i++)
+				if (o->output_names_2ch_audio[i] != NULL) outs[n++] = (preflight_output_t){ o->output_names_2ch_audio[i], RATE_AUDIO_INPUT / 2 * audio_file_ratio(o), BUFFER_AUDIO_READ_SIZE, false };
+			for (int i = 0; i < 4; i++)
+				if (o->output_names_1ch_audio[i] != NULL) outs[n++] = (preflight_output_t){ o->output_names_1ch_audio[i], RATE_AUDIO_INPUT / 4 * audio_file_ratio(o), BUFFER_AUDIO_READ_SIZE, false };
 		}
-	}
-
-	conv_function = get_conv_function(0, pad, (out_size==2) ? 0 : 1, plevel, output_names[0], output_names[1]);
-
-	rb_init(&cap_ctx.rb,"capture_ringbuffer",BUFFER_TOTAL_SIZE);
-	cap_ctx.handler.rb_rf = &cap_ctx.rb;
-
-	if (sc_dev_name) {
-		r = sc_start_capture(sc_dev_name, 1920, 1080, SC_CODEC_YUYV, 60, 1, (sc_frame_callback_t)hsdaoh_callback, &cap_ctx, &sc_dev);
-		if (r < 0) {
-			fprintf(stderr, "Failed to open %s device %s.\n", sc_get_impl_name(), sc_dev_name);
-			exit(1);
+		switch (run_preflight(outs, n, opts.io_backend, opts.io_depth, opts.io_direct)) {
+			case STORAGE_PROBE_OK:
+				break;
+			case STORAGE_PROBE_MARGINAL:
+				fprintf(stderr, "WARNING: the storage barely keeps up, expect ringbuffer stalls on any hiccup\n");
+				break;
+			case STORAGE_PROBE_TOO_SLOW:
+			case STORAGE_PROBE_FAILED:
+				fprintf(stderr, "ERROR: the storage cannot take the selected outputs, not starting (run without --preflight to capture anyway)\n");
+				return -EIO;
 		}
-		fprintf(stderr, "Opened %s device %s.\n", sc_get_impl_name(), sc_dev_name);
 	}
-	else {
-
-		r = hsdaoh_alloc(&hs_dev);
-		if (r < 0) {
-			fprintf(stderr, "Failed to allocate hsdaoh device.\n");
-			exit(1);
-		}
-
-		hsdaoh_raw_callback(hs_dev, true);
-		hsdaoh_set_msg_callback(hs_dev, &print_capture_message, NULL);
 
-		r = hsdaoh_open2(hs_dev, (uint32_t)dev_index);
-		if (r < 0) {
-			fprintf(stderr, "Failed to open hsdaoh device #%d.\n", dev_index);
+	// all outputs are ready before the first device streams, so the captures start together
+	// the indexes share an origin from before any device is started
+	opts.timeline_ns = get_time_ns();
+	for (int d = 0; d < num_capture_devs; d++) {
+		capture_devs[d].o.timeline_ns = opts.timeline_ns;
+		if ((r = capture_device_setup(&capture_devs[d])) != 0) return r;
+	}
+#if TRACE_ENABLED == 1
+	if (trace_path != NULL && trace_start(trace_path) != 0) return -EINVAL;
+#endif
+	// the ringbuffers and counters exist now, nothing is streaming yet
+	if (telemetry_address != NULL && (telemetry = telemetry_start(telemetry_address, telemetry_interval, capture_telemetry, NULL)) == NULL)
+		return -EINVAL;
+	for (int d = 0; d < num_capture_devs; d++) {
+		if (capture_device_open(&capture_devs[d]) != 0) {
+			close_devices();
 			exit(1);
 		}
-
-		dev_manufact[0] = 0;
-		dev_product[0] = 0;
-		dev_serial[0] = 0;
-		r = hsdaoh_get_usb_strings(hs_dev, dev_manufact, dev_product, dev_serial);
-		if (r < 0)
-			fprintf(stderr, "Failed to identify hsdaoh device #%d.\n", dev_index);
-		else
-			fprintf(stderr, "Opened device #%d: %s %s, serial: %s\n", dev_index, dev_manufact, dev_product, dev_serial);
-
-		fprintf(stderr, "Reading samples...\n");
-		r = hsdaoh_start_stream(hs_dev, hsdaoh_callback, &cap_ctx);
 	}
 
-
-	while (!do_exit) {
-		void *buf, *buf_out1 = NULL, *buf_out2 = NULL;
-		while((((buf = rb_read_ptr(&cap_ctx.rb, BUFFER_READ_SIZE*4)) == NULL) || 
-			  (output_names[0] != NULL && ((buf_out1 = rb_write_ptr(&thread_out_ctx[0].rb, BUFFER_READ_SIZE*out_size)) == NULL)) ||
-			  (output_names[1] != NULL && ((buf_out2 = rb_write_ptr(&thread_out_ctx[1].rb, BUFFER_READ_SIZE*out_size)) == NULL))) && 
-			  !do_exit)
-		{
-			sleep_ms(10);
-		}
-		if (do_exit) break;
-		conv_function((uint32_t*)buf, BUFFER_READ_SIZE, clip, buf_aux, buf_out1, buf_out2, peak_level);
-		if(output_raw != NULL){fwrite(buf,4,BUFFER_READ_SIZE,output_raw);}
-		rb_read_finished(&cap_ctx.rb, BUFFER_READ_SIZE*4);
-		if(output_aux != NULL){fwrite(buf_aux,1,BUFFER_READ_SIZE,output_aux);}
-		if(output_names[0] != NULL) rb_write_finished(&thread_out_ctx[0].rb, BUFFER_READ_SIZE*out_size);
-		if(output_names[1] != NULL) rb_write_finished(&thread_out_ctx[1].rb, BUFFER_READ_SIZE*out_size);
-
-		total_samples += BUFFER_READ_SIZE;
-
-		if(clip[0] > 0 && !suppress_a_clipping)
-		{
-			fprintf(stderr,"ADC A : %zu samples clipped\n",clip[0]);
-			clip[0] = 0;
-			new_line = 1;
-		}
-
-		if(clip[1] > 0 && !suppress_b_clipping)
-		{
-			fprintf(stderr,"ADC B : %zu samples clipped\n",clip[1]);
-			clip[1] = 0;
-			new_line = 1;
-		}
-		if (total_samples % (BUFFER_READ_SIZE<<(2 - plevel)) == 0) {
-			if(new_line) {
-				fprintf(stderr,"\n");
-				if(plevel) fprintf(stderr,"\n\n");
-			}
-			new_line = 0;
-			if(plevel) {
-				fprintf(stderr,"\033[A\033[A\033[A");
-				
-				print_level('A', peak_level[0]);
-				print_level('B', peak_level[1]);
-			}
-			else {
-				fprintf(stderr,"\033[A");
+	// a single device is extracted on this thread, several on one thread each
+	if (num_capture_devs == 1) {
+		capture_device_run(&capture_devs[0]);
+	}
+	else {
+		for (int d = 0; d < num_capture_devs; d++) {
+			r = thrd_create(&capture_devs[d].thread, &capture_device_run, &capture_devs[d]);
+			if (r != thrd_success) {
+				fprintf(stderr, "Failed to create extraction thread for device %d\n", d);
+				do_exit = 1;
+				close_devices();
+				capture_devs[d].thread = 0;
 			}
-			// \033[A = move cursor up
-			// \33[2K = erase line
-			
-			
-			fprintf(stderr,"\33[2K\r Progress: %13" PRIu64 " samples, %2uh %2um %2us\n", total_samples, (uint32_t)(total_samples/(144000000000)), (uint32_t)((total_samples/(2400000000)) % 60), (uint32_t)((total_samples/(40000000)) % 60));
-			fflush(stderr);
-		}
-		if (total_samples >= total_samples_before_exit && total_samples_before_exit != 0) {
-			fprintf(stderr, "%" PRIu64 " total samples have been collected, exiting early!\n", total_samples);
-			do_exit = true;
 		}
-	}
-
-	if (do_exit)
-		fprintf(stderr, "\nUser cancel, exiting...\n");
-	else
-		fprintf(stderr, "\nLibrary error %d, exiting...\n", r);
-
-	if (hs_dev) { hsdaoh_close(hs_dev); hs_dev = NULL; }
-	if (sc_dev) { sc_stop_capture(sc_dev); sc_dev = NULL; }
-
-////ending of the program
-
-	aligned_free(buf_aux);
-
-	if (output_aux && (output_aux != stdout)) fclose(output_aux);
-	if (output_raw && (output_raw != stdout)) fclose(output_raw);
-
-	for(int i=0;i<2;i++) {
-		if (thread_out[i]!=0) {
-			r = thrd_join(thread_out[i], NULL);
-			if (r != thrd_success) fprintf(stderr, "Failed to join thread %d.\n", i);
+		for (int d = 0; d < num_capture_devs; d++) {
+			if (capture_devs[d].thread == 0) continue;
+			r = thrd_join(capture_devs[d].thread, NULL);
+			if (r != thrd_success) fprintf(stderr, "Failed to join extraction thread of device %d.\n", d);
 		}
 	}
 
-	if (thread_audio!=0) {
-		r = thrd_join(thread_audio, NULL);
-		if (r != thrd_success) fprintf(stderr, "Failed to join audio thread.\n");
-	}
+#if LIBFLAC_ENABLED == 1
+	// every FLAC writer is finished now
+	if (opts.flac_shared_pool) flac_writer_pool_stop();
+#endif
+	telemetry_stop(telemetry);
+	// every thread is done, the final trace has all of them
+	trace_stop();
 
 	return 0;
 }
@@ -25,6 +25,15 @@
 #include <inttypes.h>
 
 #include "../misrc_common/buffer.h"
+#include "../misrc_common/threading.h"
+#include "../misrc_common/ringbuffer.h"
+#include "../misrc_common/rb_event.h"
+#include "../misrc_common/file_map.h"
+#include "../misrc_common/sample_index.h"
+#include "../misrc_common/aux_events.h"
+#include "../misrc_common/delta_codec.h"
+#include "../misrc_common/decimate.h"
+#include "../misrc_common/flac_writer.h"
 
 #ifndef _WIN32
 	#include <getopt.h>
@@ -50,6 +59,14 @@
 #include "../misrc_common/extract.h"
 
 #define BUFFER_SIZE 65536*32
+#define MAX_THREADS 64
+#define MMAP_CHUNK  (65536*256)  // samples per mapped window, keeps offsets aligned to 64k
+#define MMAP_ALIGN  64           // samples, SIMD kernels are only run on multiples of this
+#define FLAC_QUEUE_BLOCKS 4      // extracted blocks waiting for each FLAC encoder
+#define PIPE_RB_INPUT  (65536*1024)   // ringbuffer behind the reader thread
+#define PIPE_RB_OUTPUT (65536*512)    // ringbuffer in front of each writer thread
+#define PIPE_IO_SIZE   (65536*64)     // bytes per read and write of the pipeline threads
+#define PIPE_WAIT_MS   100
 
 #define _FILE_OFFSET_BITS 64
 
@@ -64,10 +81,698 @@ void usage(void)
 		"\t[-x AUX output file (use '-' to write on stdout)]\n"
 		"\t[-p pad lower 4 bits of 16 bit output with 0 instead of upper 4]\n"
 		"\t[-s input is captured as single channel (-b cannot be used)]\n"
+		"\t[-t number of extraction threads (default: 1, max: %d)]\n"
+		"\t[-m memory map input and output files (no stdin/stdout)]\n"
+		"\t[-P read and write on threads of their own (always on with stdin, not with -m or -u)]\n"
+		"\t[-u unpack packed 12 bit RF output of misrc_capture to 16 bit (only -a can be used)]\n"
+		"\t[-X expand this aux event file of misrc_capture --aux-events to one byte per sample into -x (instead of -i)]\n"
+		"\t[-D decode this RF file of misrc_capture --rf-delta to 16 bit into -a (instead of -i)]\n"
+		"\t[-j sample index of the capture (written by misrc_capture --index)]\n"
+		"\t[-l list the events in the sample index and exit]\n"
+		"\t[-k start at this many seconds into the capture (needs -j)]\n"
+		"\t[-e start at this event of the sample index, counting from 0 (needs -j)]\n"
+		"\t[-o start offset in samples, added to -k/-e, may be negative]\n"
+		"\t[-n number of samples to extract (default: all)]\n"
+		"\t[-d decimate ADC A/B outputs by 2, 4 or 8 with a half-band filter (not with -m or -u)]\n"
+		"\t[-F write the ADC A/B outputs as 32 bit float normalized to [-1, 1) (not with -m, -u or -f)]\n"
+		"\t[-Z remove the DC offset from the -F outputs, tracked over about 0.4 s]\n"
+		"\t[-f encode the ADC A/B outputs as FLAC (not with -m or -u)]\n"
+		"\t[-L FLAC compression level (0-8, default: 1), auto or MIN-MAX]\n"
+		"\t[-v verify the FLAC encoder output]\n"
+		"\t[-c number of FLAC encoding threads per ADC output (default: the cores shared among them)]\n",
+		MAX_THREADS
 	);
 	exit(1);
 }
 
+static struct option getopt_long_options[] =
+{
+  {"input",   required_argument, 0, 'i'},
+  {"adc-a",   required_argument, 0, 'a'},
+  {"adc-b",   required_argument, 0, 'b'},
+  {"aux",     required_argument, 0, 'x'},
+  {"pad",     no_argument,       0, 'p'},
+  {"single",  no_argument,       0, 's'},
+  {"threads", required_argument, 0, 't'},
+  {"mmap",    no_argument,       0, 'm'},
+  {"pipeline",no_argument,       0, 'P'},
+  {"unpack",  no_argument,       0, 'u'},
+  {"aux-events", required_argument, 0, 'X'},
+  {"delta",   required_argument, 0, 'D'},
+  {"index",   required_argument, 0, 'j'},
+  {"list",    no_argument,       0, 'l'},
+  {"time",    required_argument, 0, 'k'},
+  {"event",   required_argument, 0, 'e'},
+  {"offset",  required_argument, 0, 'o'},
+  {"samples", required_argument, 0, 'n'},
+  {"decimate",required_argument, 0, 'd'},
+  {"float",   no_argument,       0, 'F'},
+  {"float-dc",no_argument,       0, 'Z'},
+  {"flac",    no_argument,       0, 'f'},
+  {"flac-level", required_argument, 0, 'L'},
+  {"flac-verification", no_argument, 0, 'v'},
+  {"flac-threads", required_argument, 0, 'c'},
+  {"help",    no_argument,       0, 'h'},
+  {0, 0, 0, 0}
+};
+
+// one worker per block in flight, blocks are handed out and collected round robin
+// so the output is written back in input order
+typedef struct {
+	uint32_t *buf_tmp;
+	int16_t  *buf_1;
+	int16_t  *buf_2;
+	uint8_t  *buf_aux;
+	size_t nb_block;
+	size_t clip[2];
+	conv_function_t conv_function;
+	rb_event_t start;
+	rb_event_t done;
+	int busy;
+	int quit;
+	thrd_t thread;
+} extract_worker_t;
+
+int extract_worker(void *ctx)
+{
+	extract_worker_t *w = ctx;
+	while(1)
+	{
+		rb_event_wait(&w->start);
+		if(w->quit) break;
+		w->conv_function(w->buf_tmp, w->nb_block, w->clip, w->buf_aux, w->buf_1, w->buf_2, NULL);
+		rb_event_signal(&w->done);
+	}
+	return 0;
+}
+
+int extract_worker_start(extract_worker_t *w, conv_function_t conv_function)
+{
+	w->conv_function = conv_function;
+	if(rb_event_init(&w->start) != 0 || rb_event_init(&w->done) != 0) return -1;
+	if(thrd_create(&w->thread, extract_worker, w) != thrd_success) return -1;
+	return 0;
+}
+
+void extract_worker_stop(extract_worker_t *w)
+{
+	w->quit = 1;
+	rb_event_signal(&w->start);
+	thrd_join(w->thread, NULL);
+	rb_event_destroy(&w->start);
+	rb_event_destroy(&w->done);
+}
+
+
+// extract from a read-only mapping of the input straight into pre-sized output mappings,
+// one bounded window per file at a time, split over the worker threads
+int extract_mmap(char *input_name, char *output_name_1, char *output_name_2, char *output_name_aux,
+                 int single, int threads, conv_function_t conv_function)
+{
+	file_map_t in_map, out_map[3];
+	char *out_names[3] = { output_name_1, output_name_2, output_name_aux };
+	const size_t out_size[3] = { 2, 2, 1 };
+	const size_t sample_size = 4>>single;
+	extract_worker_t *workers;
+	uint8_t *aux_scratch = NULL;
+	uint32_t *tail_in = NULL;
+	int16_t *tail_1 = NULL, *tail_2 = NULL;
+	uint8_t *tail_aux = NULL;
+	uint64_t nsamples;
+	int r = 0;
+
+	if(file_map_open_read(&in_map, input_name) != 0) {
+		fprintf(stderr, "(1) : Failed to open %s\n", input_name);
+		return -ENOENT;
+	}
+	nsamples = in_map.file_size / sample_size;
+	for(int i = 0; i < 3; i++)
+	{
+		out_map[i].data = NULL;
+		if(out_names[i] == NULL) continue;
+		if(file_map_open_write(&out_map[i], out_names[i], nsamples * out_size[i]) != 0) {
+			fprintf(stderr, "(2) : Failed to open %s\n", out_names[i]);
+			for(int j = 0; j < i; j++) if(out_names[j] != NULL) file_map_close(&out_map[j]);
+			file_map_close(&in_map);
+			return -ENOENT;
+		}
+	}
+
+	workers = calloc(threads, sizeof(extract_worker_t));
+	// the kernels always write aux, give them somewhere to put it if it is not wanted
+	if(output_name_aux == NULL) aux_scratch = aligned_alloc(16, MMAP_CHUNK);
+	tail_in  = aligned_alloc(16, sizeof(uint32_t)*MMAP_ALIGN);
+	tail_1   = aligned_alloc(16, sizeof(int16_t) *MMAP_ALIGN);
+	tail_2   = aligned_alloc(16, sizeof(int16_t) *MMAP_ALIGN);
+	tail_aux = aligned_alloc(16, MMAP_ALIGN);
+	if(!workers || (output_name_aux == NULL && !aux_scratch) || !tail_in || !tail_1 || !tail_2 || !tail_aux) {
+		r = -ENOMEM;
+		goto cleanup;
+	}
+	for(int i = 1; i < threads; i++)
+	{
+		if(extract_worker_start(&workers[i], conv_function) != 0) {
+			fprintf(stderr, "Failed to start extraction thread %d\n", i);
+			threads = i;
+			r = -ENOMEM;
+			goto cleanup;
+		}
+	}
+	if(threads > 1) fprintf(stderr,"Using %d extraction threads\n", threads);
+
+	for(uint64_t pos = 0; pos < nsamples; pos += MMAP_CHUNK)
+	{
+		size_t n = (nsamples - pos < MMAP_CHUNK) ? (size_t)(nsamples - pos) : MMAP_CHUNK;
+		size_t body = n - (n % MMAP_ALIGN);
+		size_t part = ((body / threads) + MMAP_ALIGN - 1) & ~(size_t)(MMAP_ALIGN - 1);
+		size_t clip[2] = {0, 0};
+		uint8_t *in, *out[3];
+
+		if(file_map_window(&in_map, pos * sample_size, n * sample_size) != 0) {
+			fprintf(stderr, "Failed to map input at sample %" PRIu64 "\n", pos);
+			r = -EIO;
+			break;
+		}
+		in = in_map.data;
+		for(int i = 0; i < 3; i++)
+		{
+			out[i] = NULL;
+			if(out_names[i] == NULL) continue;
+			if(file_map_window(&out_map[i], pos * out_size[i], n * out_size[i]) != 0) {
+				fprintf(stderr, "Failed to map %s at sample %" PRIu64 "\n", out_names[i], pos);
+				r = -EIO;
+				goto cleanup;
+			}
+			out[i] = out_map[i].data;
+		}
+		if(out[2] == NULL) out[2] = aux_scratch;
+
+		// split the aligned body, thread 0 is the calling thread
+		for(int t = 0; t < threads; t++)
+		{
+			extract_worker_t *w = &workers[t];
+			size_t start = part * t;
+			w->nb_block = (start >= body) ? 0 : ((body - start < part) ? body - start : part);
+			w->buf_tmp = (uint32_t*)(in + start * sample_size);
+			w->buf_1   = out[0] ? (int16_t*)out[0] + start : NULL;
+			w->buf_2   = out[1] ? (int16_t*)out[1] + start : NULL;
+			w->buf_aux = out[2] + start;
+			w->clip[0] = 0;
+			w->clip[1] = 0;
+			if(t > 0 && w->nb_block > 0) {
+				w->busy = 1;
+				rb_event_signal(&w->start);
+			}
+		}
+		if(workers[0].nb_block > 0) {
+			extract_worker_t *w = &workers[0];
+			conv_function(w->buf_tmp, w->nb_block, w->clip, w->buf_aux, w->buf_1, w->buf_2, NULL);
+		}
+
+		// the unaligned rest goes through small bounce buffers, the kernels may overrun
+		if(body < n) {
+			size_t rest = n - body;
+			memcpy(tail_in, in + body * sample_size, rest * sample_size);
+			conv_function(tail_in, rest, clip, tail_aux, tail_1, tail_2, NULL);
+			if(out[0]) memcpy((int16_t*)out[0] + body, tail_1, rest * 2);
+			if(out[1]) memcpy((int16_t*)out[1] + body, tail_2, rest * 2);
+			if(output_name_aux != NULL) memcpy(out[2] + body, tail_aux, rest);
+		}
+
+		for(int t = 0; t < threads; t++)
+		{
+			extract_worker_t *w = &workers[t];
+			if(w->busy) {
+				rb_event_wait(&w->done);
+				w->busy = 0;
+			}
+			clip[0] += w->clip[0];
+			clip[1] += w->clip[1];
+		}
+		if(clip[0] > 0) fprintf(stderr,"ADC A : %zu samples clipped\n",clip[0]);
+		if(clip[1] > 0) fprintf(stderr,"ADC B : %zu samples clipped\n",clip[1]);
+	}
+
+cleanup:
+	if(workers) {
+		for(int i = 1; i < threads; i++)
+		{
+			if(workers[i].busy) rb_event_wait(&workers[i].done);
+			extract_worker_stop(&workers[i]);
+		}
+		free(workers);
+	}
+	if(aux_scratch) aligned_free(aux_scratch);
+	if(tail_in) aligned_free(tail_in);
+	if(tail_1) aligned_free(tail_1);
+	if(tail_2) aligned_free(tail_2);
+	if(tail_aux) aligned_free(tail_aux);
+	for(int i = 0; i < 3; i++) if(out_names[i] != NULL) file_map_close(&out_map[i]);
+	file_map_close(&in_map);
+	return r;
+}
+
+// print every event of a sample index with its sample offset and time
+int list_index(char *index_name)
+{
+	sample_index_header_t header;
+	sample_index_entry_t *entries;
+	size_t count, events = 0;
+	if(sample_index_load(index_name, &header, &entries, &count) != 0) return -EINVAL;
+	fprintf(stderr, "%zu entries, %" PRIu32 " samples per second\n", count, header.sample_rate);
+	if(header.version >= 2) {
+		// times are on the timeline shared by all devices of the capture
+		fprintf(stderr, "Device %" PRIu32 ", timeline origin %" PRIu64 ".%09" PRIu64 " s UTC\n", header.device,
+			header.wall_time_ns / 1000000000u, header.wall_time_ns % 1000000000u);
+	}
+	for(size_t i = 0; i < count; i++)
+	{
+		sample_index_entry_t *e = &entries[i];
+		if(e->type == SAMPLE_INDEX_PERIODIC) continue;
+		printf("%6zu  sample %14" PRIu64 "  %12.6f s  frame %5u  aux 0x%02x  %s (%" PRIu32 ")\n",
+			events++, e->sample, ((double)e->time_ns - (double)header.timeline_ns) * 1e-9,
+			e->frame, e->aux, sample_index_type_name(e->type), e->arg);
+	}
+	free(entries);
+	return 0;
+}
+
+// start sample from -k or -e, -1 if the index cannot be used
+int64_t seek_index(char *index_name, double seek_time, long seek_event)
+{
+	sample_index_header_t header;
+	sample_index_entry_t *entries;
+	size_t count;
+	int64_t r = 0;
+	if(sample_index_load(index_name, &header, &entries, &count) != 0) return -1;
+	if(seek_event >= 0)
+	{
+		long i = sample_index_find_event(entries, count, (size_t)seek_event);
+		if(i < 0) {
+			fprintf(stderr, "The sample index has no event %ld\n", seek_event);
+			r = -1;
+		}
+		else {
+			fprintf(stderr, "Event %ld: %s at sample %" PRIu64 "\n", seek_event,
+				sample_index_type_name(entries[i].type), entries[i].sample);
+			r = (int64_t)entries[i].sample;
+		}
+	}
+	else if(seek_time >= 0)
+	{
+		r = (int64_t)sample_index_find_time(&header, entries, count, seek_time);
+	}
+	free(entries);
+	return r;
+}
+
+// skip the first bytes of the input, a pipe has to be read through
+int skip_input(FILE *input, uint64_t bytes, void *buf, size_t buf_size)
+{
+	if(input != stdin)
+	{
+#if defined(_WIN32) || defined(_WIN64)
+		if(_fseeki64(input, (int64_t)bytes, SEEK_SET) == 0) return 0;
+#else
+		if(fseeko(input, (off_t)bytes, SEEK_SET) == 0) return 0;
+#endif
+	}
+	while(bytes > 0)
+	{
+		size_t n = fread(buf, 1, (bytes < buf_size) ? (size_t)bytes : buf_size, input);
+		if(n == 0) return -1;
+		bytes -= n;
+	}
+	return 0;
+}
+
+// packed 12 bit back to 16 bit samples, BUFFER_SIZE samples per block
+int unpack_12bit(FILE *input, FILE *output)
+{
+	uint8_t *buf_in  = aligned_alloc(16, PACKED12_SIZE(BUFFER_SIZE));
+	int16_t *buf_out = aligned_alloc(16, sizeof(int16_t)*BUFFER_SIZE);
+	conv_12pto16_t conv_12pto16 = get_12pto16_function();
+	size_t nb_bytes;
+	if(!buf_in || !buf_out) return -ENOMEM;
+	while((nb_bytes = fread(buf_in, 1, PACKED12_SIZE(BUFFER_SIZE), input)) > 0)
+	{
+		size_t nb_samples = nb_bytes / 3 * 2;
+		if(nb_bytes % 3 != 0) fprintf(stderr, "Input ends in the middle of a sample pair, dropping %zu bytes\n", nb_bytes % 3);
+		conv_12pto16(buf_in, buf_out, nb_samples);
+		fwrite(buf_out, 2, nb_samples, output);
+	}
+	aligned_free(buf_in);
+	aligned_free(buf_out);
+	return 0;
+}
+
+// aux event stream of misrc_capture --aux-events back to one byte per sample
+int expand_aux_events(char *input_name, char *output_name, uint64_t start, uint64_t remaining)
+{
+	FILE *input, *output;
+	aux_events_header_t header;
+	aux_decoder_t *dec;
+	uint8_t *buf;
+	size_t n;
+	int r = 0;
+	if(strcmp(input_name, "-") == 0) input = stdin;
+	else if((input = fopen(input_name, "rb")) == NULL) {
+		fprintf(stderr, "(1) : Failed to open %s\n", input_name);
+		return -ENOENT;
+	}
+	if((dec = aux_decoder_open(input, &header)) == NULL) return -EINVAL;
+	if(strcmp(output_name, "-") == 0) output = stdout;
+	else if((output = fopen(output_name, "wb")) == NULL) {
+		fprintf(stderr, "(2) : Failed to open %s\n", output_name);
+		aux_decoder_close(dec);
+		return -ENOENT;
+	}
+	buf = malloc(BUFFER_SIZE);
+	if(!buf) r = -ENOMEM;
+	fprintf(stderr, "Aux events at %" PRIu32 " samples per second\n", header.sample_rate);
+	// skipping does not expand anything, seeking costs nothing
+	while(r == 0 && start > 0)
+	{
+		n = aux_decoder_read(dec, NULL, (start < BUFFER_SIZE) ? (size_t)start : BUFFER_SIZE);
+		if(n == 0) {
+			fprintf(stderr, "Aux events end before the start sample\n");
+			r = -EINVAL;
+		}
+		start -= n;
+	}
+	while(r == 0 && remaining > 0
+		&& (n = aux_decoder_read(dec, buf, (remaining < BUFFER_SIZE) ? (size_t)remaining : BUFFER_SIZE)) > 0)
+	{
+		if(fwrite(buf, 1, n, output) != n) {
+			fprintf(stderr, "Failed to write %s\n", output_name);
+			r = -EIO;
+		}
+		remaining -= n;
+	}
+	free(buf);
+	aux_decoder_close(dec);
+	if(output != stdout) fclose(output);
+	return r;
+}
+
+// delta coded RF output of misrc_capture --rf-delta back to 16 bit samples
+int decode_delta(char *input_name, char *output_name, uint64_t start, uint64_t remaining)
+{
+	FILE *input, *output;
+	delta_header_t header;
+	delta_reader_t *reader;
+	int16_t *buf;
+	size_t n;
+	int r = 0;
+	if(strcmp(input_name, "-") == 0) input = stdin;
+	else if((input = fopen(input_name, "rb")) == NULL) {
+		fprintf(stderr, "(1) : Failed to open %s\n", input_name);
+		return -ENOENT;
+	}
+	if((reader = delta_reader_open(input, &header)) == NULL) return -EINVAL;
+	if(strcmp(output_name, "-") == 0) output = stdout;
+	else if((output = fopen(output_name, "wb")) == NULL) {
+		fprintf(stderr, "(2) : Failed to open %s\n", output_name);
+		delta_reader_close(reader);
+		return -ENOENT;
+	}
+	buf = malloc(sizeof(int16_t)*BUFFER_SIZE);
+	if(!buf) r = -ENOMEM;
+	fprintf(stderr, "Delta coded RF at %" PRIu32 " samples per second\n", header.sample_rate);
+	// the seek index of the file skips most of the way, a pipe is read through
+	if(r == 0 && start > 0 && delta_reader_seek(reader, start) != 0) {
+		fprintf(stderr, "Delta coded RF ends before the start sample\n");
+		r = -EINVAL;
+	}
+	while(r == 0 && remaining > 0
+		&& (n = delta_reader_read(reader, buf, (remaining < BUFFER_SIZE) ? (size_t)remaining : BUFFER_SIZE)) > 0)
+	{
+		if(fwrite(buf, sizeof(int16_t), n, output) != n) {
+			fprintf(stderr, "Failed to write %s\n", output_name);
+			r = -EIO;
+		}
+		remaining -= n;
+	}
+	free(buf);
+	delta_reader_close(reader);
+	if(output != stdout) fclose(output);
+	return r;
+}
+
+// decimate in place with -d, returns the number of samples to write
+static size_t decimate_block(decimator_t *dec, int16_t *buf, size_t len)
+{
+	return dec ? decimator_process(dec, buf, len, buf) : len;
+}
+
+// FLAC encoder of one ADC output on a thread of its own, fed the extracted blocks through a
+// short queue so the extraction of the next blocks overlaps the encoding, the writer spreads
+// the encoding itself over its block-parallel threads
+typedef struct {
+	flac_writer_t *writer;
+	int16_t *block[FLAC_QUEUE_BLOCKS];
+	size_t len[FLAC_QUEUE_BLOCKS];
+	atomic_uint_fast64_t queued;
+	atomic_uint_fast64_t encoded;
+	atomic_int quit;
+	atomic_int failed;
+	rb_event_t work;
+	rb_event_t room;
+	thrd_t thread;
+} flac_channel_t;
+
+static void flac_error_callback(void *user_data, flac_writer_error_t error, const char *message)
+{
+	(void)user_data;
+	(void)error;
+	fprintf(stderr, "FLAC ERROR: %s\n", message);
+}
+
+// the queue fills when the encoder falls behind the extraction, the adaptive level steps down then
+static double flac_backlog_callback(void *user_data)
+{
+	flac_channel_t *ch = user_data;
+	return (double)(atomic_load(&ch->queued) - atomic_load(&ch->encoded)) / FLAC_QUEUE_BLOCKS;
+}
+
+static int flac_channel_thread(void *ctx)
+{
+	flac_channel_t *ch = ctx;
+	uint64_t seq = 0;
+	while(1)
+	{
+		// everything queued before quit is encoded first
+		while(atomic_load(&ch->queued) == seq)
+		{
+			if(atomic_load(&ch->quit) && atomic_load(&ch->queued) == seq) return 0;
+			rb_event_wait(&ch->work);
+		}
+		size_t i = seq % FLAC_QUEUE_BLOCKS;
+		if(!atomic_load(&ch->failed) && flac_writer_process_int16(ch->writer, ch->block[i], (uint32_t)ch->len[i]) < 0)
+		{
+			atomic_store(&ch->failed, 1);
+		}
+		atomic_store(&ch->encoded, ++seq);
+		rb_event_signal(&ch->room);
+	}
+}
+
+static flac_channel_t *flac_channel_start(FILE *f, const flac_writer_config_t *config)
+{
+	flac_channel_t *ch = calloc(1, sizeof(flac_channel_t));
+	flac_writer_config_t cfg = *config;
+	if(!ch) return NULL;
+	cfg.callback_user_data = ch;
+	for(int i = 0; i < FLAC_QUEUE_BLOCKS; i++)
+	{
+		if((ch->block[i] = aligned_alloc(16, sizeof(int16_t)*BUFFER_SIZE)) == NULL) goto fail;
+	}
+	if(rb_event_init(&ch->work) != 0 || rb_event_init(&ch->room) != 0) goto fail;
+	if((ch->writer = flac_writer_create_file(f, &cfg)) == NULL) goto fail;
+	if(thrd_create(&ch->thread, flac_channel_thread, ch) != thrd_success)
+	{
+		flac_writer_abort(ch->writer);
+		goto fail;
+	}
+	return ch;
+fail:
+	for(int i = 0; i < FLAC_QUEUE_BLOCKS; i++) if(ch->block[i]) aligned_free(ch->block[i]);
+	rb_event_destroy(&ch->work);
+	rb_event_destroy(&ch->room);
+	free(ch);
+	return NULL;
+}
+
+// hand over a block, waits while the queue is full
+static int flac_channel_put(flac_channel_t *ch, const int16_t *buf, size_t n)
+{
+	uint64_t seq = atomic_load(&ch->queued);
+	if(n == 0) return 0;
+	while(seq - atomic_load(&ch->encoded) >= FLAC_QUEUE_BLOCKS) rb_event_wait(&ch->room);
+	memcpy(ch->block[seq % FLAC_QUEUE_BLOCKS], buf, n * sizeof(int16_t));
+	ch->len[seq % FLAC_QUEUE_BLOCKS] = n;
+	atomic_store(&ch->queued, seq + 1);
+	rb_event_signal(&ch->work);
+	return atomic_load(&ch->failed) ? -1 : 0;
+}
+
+// encode what is queued, finish the stream and free the channel
+static int flac_channel_finish(flac_channel_t *ch)
+{
+	int r = 0;
+	if(!ch) return 0;
+	atomic_store(&ch->quit, 1);
+	rb_event_signal(&ch->work);
+	thrd_join(ch->thread, NULL);
+	if(atomic_load(&ch->failed)) r = -EIO;
+	if(flac_writer_finish(ch->writer) != FLAC_WRITER_OK) r = -EIO;
+	for(int i = 0; i < FLAC_QUEUE_BLOCKS; i++) aligned_free(ch->block[i]);
+	rb_event_destroy(&ch->work);
+	rb_event_destroy(&ch->room);
+	free(ch);
+	return r;
+}
+
+// pipeline mode: the input is read and every raw output written on a thread of its own,
+// connected to the extraction by ringbuffers, so a pipe or network link and the output
+// disks all work at the same time instead of taking turns
+typedef struct {
+	ringbuffer_t rb;
+	FILE *f;
+	uint64_t limit;        // reader: bytes to read at most
+	atomic_int done;       // reader: the input ended, writer: nothing more is coming
+	atomic_int failed;
+	thrd_t thread;
+} pipe_stage_t;
+
+static int pipe_reader_thread(void *ctx)
+{
+	pipe_stage_t *p = ctx;
+	while(p->limit > 0)
+	{
+		size_t len = (p->limit < PIPE_IO_SIZE) ? (size_t)p->limit : PIPE_IO_SIZE;
+		void *buf = rb_write_ptr_wait(&p->rb, len, PIPE_WAIT_MS);
+		if(buf == NULL) continue;
+		size_t n = fread(buf, 1, len, p->f);
+		if(n > 0) rb_write_finished(&p->rb, n);
+		p->limit -= n;
+		if(n < len) break;
+	}
+	atomic_store(&p->done, 1);
+	rb_wake(&p->rb);
+	return 0;
+}
+
+static int pipe_writer_thread(void *ctx)
+{
+	pipe_stage_t *p = ctx;
+	while(1)
+	{
+		size_t len = PIPE_IO_SIZE;
+		void *buf = rb_read_ptr_wait(&p->rb, len, PIPE_WAIT_MS);
+		if(buf == NULL)
+		{
+			// done is set after the last write, what is there now is all
+			if(!atomic_load(&p->done)) continue;
+			len = rb_available(&p->rb);
+			if(len == 0) break;
+			buf = rb_read_ptr(&p->rb, len);
+		}
+		if(!atomic_load(&p->failed) && fwrite(buf, 1, len, p->f) != len) atomic_store(&p->failed, 1);
+		rb_read_finished(&p->rb, len);
+	}
+	return 0;
+}
+
+static pipe_stage_t *pipe_start(FILE *f, size_t size, uint64_t limit, int (*func)(void *))
+{
+	pipe_stage_t *p = calloc(1, sizeof(pipe_stage_t));
+	if(!p) return NULL;
+	p->f = f;
+	p->limit = limit;
+	if(rb_init(&p->rb, "pipeline", size) != 0) {
+		free(p);
+		return NULL;
+	}
+	if(thrd_create(&p->thread, func, p) != thrd_success) {
+		rb_close(&p->rb);
+		free(p);
+		return NULL;
+	}
+	return p;
+}
+
+// wait for the thread (a writer empties its ringbuffer first) and free the stage
+static int pipe_stop(pipe_stage_t *p)
+{
+	int r;
+	if(!p) return 0;
+	atomic_store(&p->done, 1);
+	rb_wake(&p->rb);
+	thrd_join(p->thread, NULL);
+	r = atomic_load(&p->failed) ? -EIO : 0;
+	rb_close(&p->rb);
+	free(p);
+	return r;
+}
+
+// read size bytes from the reader's ringbuffer, less only at the end of the input
+static size_t pipe_read(pipe_stage_t *p, void *dst, size_t size)
+{
+	size_t got = 0;
+	while(got < size)
+	{
+		size_t len = (size - got < PIPE_IO_SIZE) ? size - got : PIPE_IO_SIZE;
+		void *buf = rb_read_ptr_wait(&p->rb, len, PIPE_WAIT_MS);
+		if(buf == NULL)
+		{
+			if(!atomic_load(&p->done)) continue;
+			// the reader is gone, take the rest
+			len = rb_available(&p->rb);
+			if(len > size - got) len = size - got;
+			if(len == 0) break;
+			buf = rb_read_ptr(&p->rb, len);
+		}
+		memcpy((uint8_t*)dst + got, buf, len);
+		rb_read_finished(&p->rb, len);
+		got += len;
+	}
+	return got;
+}
+
+static int pipe_write(pipe_stage_t *p, const void *src, size_t size)
+{
+	void *buf;
+	if(size == 0) return 0;
+	while((buf = rb_write_ptr_wait(&p->rb, size, PIPE_WAIT_MS)) == NULL) {}
+	memcpy(buf, src, size);
+	rb_write_finished(&p->rb, size);
+	return atomic_load(&p->failed) ? -1 : 0;
+}
+
+// read up to count samples of size bytes, a short count means the input ended
+static size_t read_input(FILE *input, pipe_stage_t *pipe, void *buf, size_t size, size_t count)
+{
+	if(pipe) return pipe_read(pipe, buf, size * count) / size;
+	return fread(buf, size, count, input);
+}
+
+static int write_output(FILE *output, pipe_stage_t *pipe, const void *buf, size_t size)
+{
+	if(pipe) return pipe_write(pipe, buf, size);
+	return (fwrite(buf, 1, size, output) == size) ? 0 : -1;
+}
+
+// write an ADC output block, raw, converted to float (-F, through f32_buf) or to its FLAC encoder
+static int write_adc(FILE *output, pipe_stage_t *pipe, flac_channel_t *flac, f32_out_t *f32, float *f32_buf, int16_t *buf, size_t n)
+{
+	if(flac) return flac_channel_put(flac, buf, n);
+	if(f32) {
+		f32_out_convert(f32, buf, f32_buf, n);
+		return write_output(output, pipe, f32_buf, n * sizeof(float));
+	}
+	return write_output(output, pipe, buf, n * 2);
+}
 
 int main(int argc, char **argv)
 {
@@ -77,17 +782,41 @@ int main(int argc, char **argv)
 	_setmode(_fileno(stdin), O_BINARY);
 #endif
 
-	int opt, pad=0, single=0;
+	int opt, pad=0, single=0, threads=1, use_mmap=0, unpack=0, list=0, result=0;
+	int pipeline=0, input_end=0;
+	pipe_stage_t *pipe_in = NULL, *pipe_out[3] = {NULL, NULL, NULL};
+	unsigned decimation=0;
+	decimator_t *dec[2] = {NULL, NULL};
+
+	//flac
+	int flac=0, flac_threads=0;
+	flac_writer_config_t flac_config = flac_writer_default_config();
+	flac_channel_t *flac_out[2] = {NULL, NULL};
+
+	//float output, one buffer for both channels, they are written in turn
+	int f32=0, f32_dc=0;
+	f32_out_t f32_state[2];
+	f32_out_t *f32_out[2] = {NULL, NULL};
+	float *f32_buf = NULL;
+
+	//seeking
+	char *index_name = NULL;
+	double seek_time = -1;
+	long seek_event = -1;
+	int64_t seek_offset = 0, start_sample = 0;
+	uint64_t remaining = UINT64_MAX;
 
 
 	//file adress
 	char *input_name_1    = NULL;
+	char *aux_events_name = NULL;
+	char *delta_name      = NULL;
 	char *output_name_1   = NULL;
 	char *output_name_2   = NULL;
 	char *output_name_aux = NULL;
 	
 	//input file
-	FILE *input_1;
+	FILE *input_1 = NULL;
 	
 	//output files
 	FILE *output_1;
@@ -119,7 +848,7 @@ int main(int argc, char **argv)
 		MIRSC_TOOLS_COPYRIGHT "\n\n"
 	);
 
-	while ((opt = getopt(argc, argv, "i:a:b:x:psh")) != -1) {
+	while ((opt = getopt_long(argc, argv, "i:a:b:x:pst:mPuX:D:j:lk:e:o:n:d:FZfL:vc:h", getopt_long_options, NULL)) != -1) {
 		switch (opt) {
 		case 'i':
 			input_name_1 = optarg;
@@ -139,6 +868,68 @@ int main(int argc, char **argv)
 		case 's':
 			single = 1;
 			break;
+		case 't':
+			threads = atoi(optarg);
+			if(threads < 1 || threads > MAX_THREADS) usage();
+			break;
+		case 'm':
+			use_mmap = 1;
+			break;
+		case 'P':
+			pipeline = 1;
+			break;
+		case 'u':
+			unpack = 1;
+			break;
+		case 'X':
+			aux_events_name = optarg;
+			break;
+		case 'D':
+			delta_name = optarg;
+			break;
+		case 'j':
+			index_name = optarg;
+			break;
+		case 'l':
+			list = 1;
+			break;
+		case 'k':
+			seek_time = atof(optarg);
+			if(seek_time < 0) usage();
+			break;
+		case 'e':
+			seek_event = atol(optarg);
+			if(seek_event < 0) usage();
+			break;
+		case 'o':
+			seek_offset = strtoll(optarg, NULL, 10);
+			break;
+		case 'n':
+			remaining = strtoull(optarg, NULL, 10);
+			break;
+		case 'd':
+			decimation = (unsigned)atoi(optarg);
+			if(!decimator_factor_valid(decimation)) usage();
+			break;
+		case 'F':
+			f32 = 1;
+			break;
+		case 'Z':
+			f32_dc = 1;
+			break;
+		case 'f':
+			flac = 1;
+			break;
+		case 'L':
+			if(flac_writer_parse_level(optarg, &flac_config) != 0) usage();
+			break;
+		case 'v':
+			flac_config.verify = true;
+			break;
+		case 'c':
+			flac_threads = atoi(optarg);
+			if(flac_threads < 1) usage();
+			break;
 		case 'h':
 		default:
 			usage();
@@ -146,11 +937,92 @@ int main(int argc, char **argv)
 		}
 	}
 	
-	if((input_name_1 == NULL || (output_name_1 == NULL && output_name_2 == NULL && output_name_aux == NULL))
-		|| (single == 1 && output_name_2 != NULL))
+	if(list)
+	{
+		if(index_name == NULL) usage();
+		return list_index(index_name);
+	}
+
+	if(((input_name_1 != NULL) + (aux_events_name != NULL) + (delta_name != NULL) != 1
+			|| (output_name_1 == NULL && output_name_2 == NULL && output_name_aux == NULL))
+		|| (aux_events_name != NULL && (output_name_1 != NULL || output_name_2 != NULL || output_name_aux == NULL
+			|| pad == 1 || single == 1 || use_mmap == 1 || unpack == 1 || decimation != 0))
+		|| (delta_name != NULL && (output_name_1 == NULL || output_name_2 != NULL || output_name_aux != NULL
+			|| pad == 1 || single == 1 || use_mmap == 1 || unpack == 1 || decimation != 0))
+		|| (single == 1 && output_name_2 != NULL)
+		|| (unpack == 1 && (output_name_1 == NULL || output_name_2 != NULL || output_name_aux != NULL
+			|| pad == 1 || single == 1 || use_mmap == 1))
+		|| (decimation != 0 && (use_mmap == 1 || unpack == 1))
+		|| (pipeline == 1 && (input_name_1 == NULL || use_mmap == 1 || unpack == 1))
+		|| (flac == 1 && (input_name_1 == NULL || use_mmap == 1 || unpack == 1
+			|| (output_name_1 == NULL && output_name_2 == NULL)))
+		|| (f32 == 1 && (input_name_1 == NULL || use_mmap == 1 || unpack == 1 || flac == 1
+			|| (output_name_1 == NULL && output_name_2 == NULL)))
+		|| (f32_dc == 1 && f32 == 0)
+		|| ((seek_time >= 0 || seek_event >= 0) && index_name == NULL)
+		|| (seek_time >= 0 && seek_event >= 0))
 	{
 		usage();
 	}
+	if(flac && !flac_writer_available())
+	{
+		fprintf(stderr, "FLAC support is not compiled in\n");
+		return -EINVAL;
+	}
+	if(use_mmap && (seek_time >= 0 || seek_event >= 0 || seek_offset != 0 || remaining != UINT64_MAX))
+	{
+		fprintf(stderr, "Seeking is not supported in memory mapped mode\n");
+		return -EINVAL;
+	}
+	if(unpack && (seek_time >= 0 || seek_event >= 0 || seek_offset != 0 || remaining != UINT64_MAX))
+	{
+		fprintf(stderr, "Seeking is not supported when unpacking\n");
+		return -EINVAL;
+	}
+	if(seek_time >= 0 || seek_event >= 0)
+	{
+		start_sample = seek_index(index_name, seek_time, seek_event);
+		if(start_sample < 0) return -EINVAL;
+	}
+	start_sample += seek_offset;
+	if(start_sample < 0) start_sample = 0;
+
+	if(aux_events_name != NULL)
+	{
+		aligned_free(buf_tmp);
+		aligned_free(buf_1);
+		aligned_free(buf_2);
+		aligned_free(buf_aux);
+		return expand_aux_events(aux_events_name, output_name_aux, (uint64_t)start_sample, remaining);
+	}
+	if(delta_name != NULL)
+	{
+		aligned_free(buf_tmp);
+		aligned_free(buf_1);
+		aligned_free(buf_2);
+		aligned_free(buf_aux);
+		return decode_delta(delta_name, output_name_1, (uint64_t)start_sample, remaining);
+	}
+
+	if(use_mmap)
+	{
+		int r;
+		if(strcmp(input_name_1, "-") == 0
+			|| (output_name_1   != NULL && strcmp(output_name_1, "-") == 0)
+			|| (output_name_2   != NULL && strcmp(output_name_2, "-") == 0)
+			|| (output_name_aux != NULL && strcmp(output_name_aux, "-") == 0))
+		{
+			fprintf(stderr, "Memory mapped mode needs regular files, stdin/stdout cannot be used\n");
+			return -EINVAL;
+		}
+		conv_function = get_conv_function(single, pad, 0, 0, output_name_1, output_name_2);
+		r = extract_mmap(input_name_1, output_name_1, output_name_2, output_name_aux, single, threads, conv_function);
+		aligned_free(buf_tmp);
+		aligned_free(buf_1);
+		aligned_free(buf_2);
+		aligned_free(buf_aux);
+		return r;
+	}
 	
 	//reading file 1
 	if(input_name_1 != NULL)
@@ -220,17 +1092,176 @@ int main(int argc, char **argv)
 		}
 	}
 
+	if(unpack)
+	{
+		if(input_1 == NULL)
+		{
+			fprintf(stderr, "Unpacking needs an input file\n");
+			return -EINVAL;
+		}
+		int r = unpack_12bit(input_1, output_1);
+		aligned_free(buf_tmp);
+		aligned_free(buf_1);
+		aligned_free(buf_2);
+		aligned_free(buf_aux);
+		if(input_1 != stdin) fclose(input_1);
+		if(output_1 != stdout) fclose(output_1);
+		return r;
+	}
+
+	if(start_sample > 0)
+	{
+		fprintf(stderr, "Starting at sample %" PRId64 "\n", start_sample);
+		if(skip_input(input_1, (uint64_t)start_sample * (4>>single), buf_tmp, sizeof(uint32_t)*BUFFER_SIZE) != 0) {
+			fprintf(stderr, "Input ends before sample %" PRId64 "\n", start_sample);
+			return -EINVAL;
+		}
+	}
+
 	conv_function = get_conv_function(single, pad, 0, 0, output_name_1, output_name_2);
 
-	if(input_name_1 != NULL && (output_name_1 != NULL || output_name_2 != NULL || output_name_aux != NULL))
+	if(decimation != 0)
+	{
+		// one filter per channel, the blocks reach it in input order
+		if((output_name_1 != NULL && (dec[0] = decimator_create(decimation)) == NULL)
+			|| (output_name_2 != NULL && (dec[1] = decimator_create(decimation)) == NULL))
+		{
+			return -ENOMEM;
+		}
+		fprintf(stderr, "Decimating by %u with the %s half-band filter\n", decimation, decimator_impl_name());
+	}
+
+	if(f32)
+	{
+		// converted after the decimation, which keeps the scale of the samples
+		conv_16tof32_t conv_16tof32 = get_16tof32_function();
+		if((f32_buf = aligned_alloc(16, sizeof(float)*BUFFER_SIZE)) == NULL) return -ENOMEM;
+		for(int i = 0; i < 2; i++)
+		{
+			f32_out_init(&f32_state[i], conv_16tof32, pad, f32_dc);
+			f32_out[i] = &f32_state[i];
+		}
+	}
+
+	if(flac)
+	{
+		int outputs = (output_name_1 != NULL) + (output_name_2 != NULL);
+		// the cores left by the extraction, shared among the outputs
+		if(flac_threads == 0) flac_threads = ((int)get_cpu_count() - threads - outputs) / outputs;
+		if(flac_threads < 1) flac_threads = 1;
+		flac_config.sample_rate = 40000 / (decimation ? decimation : 1);
+		flac_config.num_threads = (uint32_t)flac_threads;
+		flac_config.block_parallel = true;
+		flac_config.error_cb = flac_error_callback;
+		flac_config.backlog_cb = flac_backlog_callback;
+		if((output_name_1 != NULL && (flac_out[0] = flac_channel_start(output_1, &flac_config)) == NULL)
+			|| (output_name_2 != NULL && (flac_out[1] = flac_channel_start(output_2, &flac_config)) == NULL))
+		{
+			fprintf(stderr, "Failed to start the FLAC encoder\n");
+			flac_channel_finish(flac_out[0]);
+			return -ENOMEM;
+		}
+		fprintf(stderr, "Encoding FLAC with %d threads per output\n", flac_threads);
+	}
+
+	// a pipe delivers in small pieces at its own pace, keep reading while extracting
+	if(strcmp(input_name_1, "-") == 0) pipeline = 1;
+	if(pipeline)
+	{
+		uint64_t limit = (remaining > UINT64_MAX / 4) ? UINT64_MAX : remaining * (4>>single);
+		FILE *outputs[3] = { output_name_1 ? output_1 : NULL, output_name_2 ? output_2 : NULL, output_name_aux ? output_aux : NULL };
+		int ok = (pipe_in = pipe_start(input_1, PIPE_RB_INPUT, limit, pipe_reader_thread)) != NULL;
+		for(int i = 0; i < 3 && ok; i++)
+		{
+			// FLAC outputs are written by their encoder threads
+			if(outputs[i] == NULL || (i < 2 && flac_out[i] != NULL)) continue;
+			ok = (pipe_out[i] = pipe_start(outputs[i], PIPE_RB_OUTPUT, 0, pipe_writer_thread)) != NULL;
+		}
+		if(!ok)
+		{
+			fprintf(stderr, "Failed to start the pipeline threads\n");
+			return -ENOMEM;
+		}
+		fprintf(stderr, "Reading and writing on pipeline threads\n");
+	}
+
+	if(threads > 1 && input_name_1 != NULL && (output_name_1 != NULL || output_name_2 != NULL || output_name_aux != NULL))
 	{
-		while(!feof(input_1))
+		extract_worker_t *workers = calloc(threads, sizeof(extract_worker_t));
+		size_t seq = 0;
+		fprintf(stderr,"Using %d extraction threads\n", threads);
+		for(int i = 0; i < threads; i++)
 		{
+			extract_worker_t *w = &workers[i];
+			w->buf_tmp = aligned_alloc(16,sizeof(uint32_t)*BUFFER_SIZE);
+			w->buf_1   = aligned_alloc(16,sizeof(int16_t) *BUFFER_SIZE);
+			w->buf_2   = aligned_alloc(16,sizeof(int16_t) *BUFFER_SIZE);
+			w->buf_aux = aligned_alloc(16,sizeof(uint8_t) *BUFFER_SIZE);
+			if(!w->buf_tmp || !w->buf_1 || !w->buf_2 || !w->buf_aux
+				|| extract_worker_start(w, conv_function) != 0)
+			{
+				fprintf(stderr, "Failed to start extraction thread %d\n", i);
+				return -ENOMEM;
+			}
+		}
+
+		while(1)
+		{
+			extract_worker_t *w = &workers[seq % threads];
+			// collect the oldest block before reusing its worker
+			if(w->busy)
+			{
+				rb_event_wait(&w->done);
+				w->busy = 0;
+				if(w->clip[0] > 0) fprintf(stderr,"ADC A : %zu samples clipped\n",w->clip[0]);
+				if(w->clip[1] > 0) fprintf(stderr,"ADC B : %zu samples clipped\n",w->clip[1]);
+				if(output_name_1   != NULL){write_adc(output_1,pipe_out[0],flac_out[0],f32_out[0],f32_buf,w->buf_1,decimate_block(dec[0],w->buf_1,w->nb_block));}
+				if(output_name_2   != NULL){write_adc(output_2,pipe_out[1],flac_out[1],f32_out[1],f32_buf,w->buf_2,decimate_block(dec[1],w->buf_2,w->nb_block));}
+				if(output_name_aux != NULL){write_output(output_aux,pipe_out[2],w->buf_aux,w->nb_block);}
+			}
+			if(input_end || remaining == 0)
+			{
+				// drain: stop once every worker is idle
+				int pending = 0;
+				for(int i = 0; i < threads; i++) pending |= workers[i].busy;
+				if(!pending) break;
+				seq++;
+				continue;
+			}
+			size_t count = (remaining < BUFFER_SIZE) ? remaining : BUFFER_SIZE;
+			w->nb_block = read_input(input_1,pipe_in,w->buf_tmp,4>>single,count);
+			input_end = w->nb_block < count;
+			remaining -= w->nb_block;
+			w->clip[0] = 0;
+			w->clip[1] = 0;
+			w->busy = 1;
+			rb_event_signal(&w->start);
+			seq++;
+		}
+
+		for(int i = 0; i < threads; i++)
+		{
+			extract_worker_t *w = &workers[i];
+			extract_worker_stop(w);
+			aligned_free(w->buf_tmp);
+			aligned_free(w->buf_1);
+			aligned_free(w->buf_2);
+			aligned_free(w->buf_aux);
+		}
+		free(workers);
+	}
+	else if(input_name_1 != NULL && (output_name_1 != NULL || output_name_2 != NULL || output_name_aux != NULL))
+	{
+		while(!input_end && remaining > 0)
+		{
+			size_t count = (remaining < BUFFER_SIZE) ? remaining : BUFFER_SIZE;
 #if PERF_MEASURE
 			clock_gettime(CLOCK_MONOTONIC, &start);
 #endif
 
-			nb_block = fread(buf_tmp,4>>single,BUFFER_SIZE,input_1);
+			nb_block = read_input(input_1,pipe_in,buf_tmp,4>>single,count);
+			input_end = (size_t)nb_block < count;
+			remaining -= nb_block;
 
 #if PERF_MEASURE
 			clock_gettime(CLOCK_MONOTONIC, &stop);
@@ -260,9 +1291,9 @@ int main(int argc, char **argv)
 			clock_gettime(CLOCK_MONOTONIC, &start);
 #endif
 			//write output
-			if(output_name_1   != NULL){fwrite(buf_1, 2,nb_block,output_1);}
-			if(output_name_2   != NULL){fwrite(buf_2, 2,nb_block,output_2);}
-			if(output_name_aux != NULL){fwrite(buf_aux,1,nb_block,output_aux);}
+			if(output_name_1   != NULL){write_adc(output_1,pipe_out[0],flac_out[0],f32_out[0],f32_buf,buf_1,decimate_block(dec[0],buf_1,nb_block));}
+			if(output_name_2   != NULL){write_adc(output_2,pipe_out[1],flac_out[1],f32_out[1],f32_buf,buf_2,decimate_block(dec[1],buf_2,nb_block));}
+			if(output_name_aux != NULL){write_output(output_aux,pipe_out[2],buf_aux,nb_block);}
 
 #if PERF_MEASURE
 			clock_gettime(CLOCK_MONOTONIC, &stop);
@@ -272,10 +1303,30 @@ int main(int argc, char **argv)
 	}
 
 ////ending of the program
+
+	// the encoders and writers finish before their files are closed
+	for(int i = 0; i < 2; i++)
+	{
+		if(flac_channel_finish(flac_out[i]) != 0) {
+			fprintf(stderr, "FLAC encoder of ADC %c did not finish correctly\n", i ? 'B' : 'A');
+			result = -EIO;
+		}
+	}
+	pipe_stop(pipe_in);
+	for(int i = 0; i < 3; i++)
+	{
+		if(pipe_stop(pipe_out[i]) != 0) {
+			fprintf(stderr, "Failed to write %s\n", (i == 0) ? output_name_1 : (i == 1) ? output_name_2 : output_name_aux);
+			result = -EIO;
+		}
+	}
 	
 	aligned_free(buf_1);
 	aligned_free(buf_2);
 	aligned_free(buf_aux);
+	if(f32_buf) aligned_free(f32_buf);
+	decimator_free(dec[0]);
+	decimator_free(dec[1]);
 	
 	//Close file 1
 	if(input_name_1 != NULL)
@@ -315,5 +1366,5 @@ int main(int argc, char **argv)
 	fprintf(stderr, "Readtime: %f\nConvtime: %f\nwrittime: %f\n", timeread, timeconv, timewrite);
 #endif
 
-	return 0;
+	return result;
 }
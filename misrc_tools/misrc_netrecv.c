@@ -0,0 +1,163 @@
+/*
+* MISRC netrecv
+* Copyright (C) 2024-2025  vrunk11, stefan_o
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// receiving end of a misrc_capture tcp:// output, writes the samples to a file or stdout
+// for a decoder to read, a starting point for receiving the stream in a decoder directly
+
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "../misrc_common/buffer.h"
+#include "../misrc_common/net_stream.h"
+
+#ifndef _WIN32
+	#include <getopt.h>
+#else
+	#include <windows.h>
+	#include <io.h>
+	#include <fcntl.h>
+	#if defined(__MINGW32__)
+		#include <getopt.h>
+	#else
+		#include "getopt/getopt.h"
+	#endif
+#endif
+
+#include "version.h"
+
+#define MAX_CHUNK (64*1024*1024)
+
+void usage(void)
+{
+	fprintf(stderr,
+		"Receives an RF channel streamed by misrc_capture -a/-b tcp://...\n\n"
+		"Usage:\n"
+		"\t[-i address to receive from, tcp://:port to wait for misrc_capture or tcp://host:port to connect]\n"
+		"\t[-o output file (use '-' to write on stdout)]\n"
+		"\t[-q do not print the stream statistics]\n"
+	);
+	exit(1);
+}
+
+static struct option getopt_long_options[] =
+{
+  {"input",   required_argument, 0, 'i'},
+  {"output",  required_argument, 0, 'o'},
+  {"quiet",   no_argument,       0, 'q'},
+  {"help",    no_argument,       0, 'h'},
+  {0, 0, 0, 0}
+};
+
+static const char *format_name(uint8_t format)
+{
+	switch(format) {
+		case NET_FORMAT_S16:        return "16 bit";
+		case NET_FORMAT_S16_PADDED: return "16 bit, padded";
+		case NET_FORMAT_RAW32:      return "32 bit capture words";
+		case NET_FORMAT_PREVIEW:    return "preview records";
+		case NET_FORMAT_F32:        return "32 bit float";
+		default:                    return "unknown";
+	}
+}
+
+int main(int argc, char **argv)
+{
+//set pipe mode to binary in windows
+#if defined(_WIN32) || defined(_WIN64)
+	_setmode(_fileno(stdout), O_BINARY);
+#endif
+
+	int opt, quiet = 0;
+	char *input_name = NULL;
+	char *output_name = NULL;
+	FILE *output;
+	net_source_t *src;
+	net_stream_header_t header;
+	net_chunk_header_t chunk;
+	uint8_t *buf;
+	uint64_t received = 0, next_report = 0;
+	long n;
+
+	fprintf(stderr,
+		"MISRC netrecv " MIRSC_TOOLS_VERSION "\n"
+		MIRSC_TOOLS_COPYRIGHT "\n\n"
+	);
+
+	while ((opt = getopt_long(argc, argv, "i:o:qh", getopt_long_options, NULL)) != -1) {
+		switch (opt) {
+		case 'i':
+			input_name = optarg;
+			break;
+		case 'o':
+			output_name = optarg;
+			break;
+		case 'q':
+			quiet = 1;
+			break;
+		case 'h':
+		default:
+			usage();
+			break;
+		}
+	}
+
+	if(input_name == NULL || output_name == NULL || !net_stream_is_url(input_name)) usage();
+
+	if (strcmp(output_name, "-") == 0) output = stdout;
+	else if ((output = fopen(output_name, "wb")) == NULL) {
+		fprintf(stderr, "Failed to open %s\n", output_name);
+		return -ENOENT;
+	}
+
+	src = net_source_open(input_name, &header);
+	if (!src) return -EIO;
+	fprintf(stderr, "Receiving ADC %c, %" PRIu32 " Hz, %s (%u significant bits)\n",
+		header.channel == 0 ? 'A' : 'B', header.sample_rate, format_name(header.format), header.bits);
+	if (header.max_chunk > MAX_CHUNK) {
+		fprintf(stderr, "Chunks of %" PRIu32 " bytes are too large\n", header.max_chunk);
+		net_source_close(src);
+		return -EINVAL;
+	}
+	buf = aligned_alloc(32, header.max_chunk);
+	if (!buf) return -ENOMEM;
+
+	while ((n = net_source_read(src, &chunk, buf, header.max_chunk)) > 0)
+	{
+		// TCP does not lose data, a gap means the sender is broken
+		if (chunk.offset != received) {
+			fprintf(stderr, "Stream jumps from %" PRIu64 " to %" PRIu64 "\n", received, chunk.offset);
+		}
+		fwrite(buf, 1, (size_t)n, output);
+		received = chunk.offset + (uint64_t)n;
+		if (!quiet && received >= next_report) {
+			fprintf(stderr, "\33[2K\r Received %" PRIu64 " MB, frame %5" PRIu32, received >> 20, chunk.frame);
+			next_report = received + ((uint64_t)header.sample_rate << 1);
+		}
+	}
+	if (!quiet) fprintf(stderr, "\n");
+	fprintf(stderr, "%s after %" PRIu64 " bytes\n", n < 0 ? "Stream error" : "Stream ended", received);
+
+	aligned_free(buf);
+	net_source_close(src);
+	if (output != stdout) fclose(output);
+	return n < 0 ? -EIO : 0;
+}
@@ -0,0 +1,192 @@
+/*
+* MISRC shmrecv
+* Copyright (C) 2024-2025  vrunk11, stefan_o
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// consumer of a misrc_capture shm:// output, writes the samples to a file or stdout,
+// a starting point for reading the shared memory directly in a decoder
+
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdbool.h>
+
+#include "../misrc_common/rb_shm.h"
+
+#ifndef _WIN32
+	#include <getopt.h>
+#else
+	#include <windows.h>
+	#include <io.h>
+	#include <fcntl.h>
+	#if defined(__MINGW32__)
+		#include <getopt.h>
+	#else
+		#include "getopt/getopt.h"
+	#endif
+#endif
+
+#include "version.h"
+
+#define READ_SIZE (1024*1024)
+
+static volatile bool do_exit = false;
+
+void usage(void)
+{
+	fprintf(stderr,
+		"Reads an RF channel shared by misrc_capture -a/-b shm://...\n\n"
+		"Usage:\n"
+		"\t[-i name of the shared memory output, with or without shm://]\n"
+		"\t[-o output file (use '-' to write on stdout)]\n"
+		"\t[-l lossy, skip data instead of holding the capture back when falling behind]\n"
+		"\t[-q do not print the stream statistics]\n"
+	);
+	exit(1);
+}
+
+static struct option getopt_long_options[] =
+{
+  {"input",   required_argument, 0, 'i'},
+  {"output",  required_argument, 0, 'o'},
+  {"lossy",   no_argument,       0, 'l'},
+  {"quiet",   no_argument,       0, 'q'},
+  {"help",    no_argument,       0, 'h'},
+  {0, 0, 0, 0}
+};
+
+#ifdef _WIN32
+BOOL WINAPI sighandler(int signum)
+{
+	if (CTRL_C_EVENT == signum) {
+		do_exit = true;
+		return TRUE;
+	}
+	return FALSE;
+}
+#else
+static void sighandler(int signum)
+{
+	(void)signum;
+	do_exit = true;
+}
+#endif
+
+static const char *format_name(uint8_t format)
+{
+	switch(format) {
+		case RB_SHM_FORMAT_S16:        return "16 bit";
+		case RB_SHM_FORMAT_S16_PADDED: return "16 bit, padded";
+		case RB_SHM_FORMAT_PREVIEW:    return "preview records";
+		case RB_SHM_FORMAT_F32:        return "32 bit float";
+		default:                       return "unknown";
+	}
+}
+
+int main(int argc, char **argv)
+{
+//set pipe mode to binary in windows
+#if defined(_WIN32) || defined(_WIN64)
+	_setmode(_fileno(stdout), O_BINARY);
+#endif
+
+	int opt, quiet = 0, lossy = 0, overruns = 0;
+	char *input_name = NULL;
+	char *output_name = NULL;
+	FILE *output;
+	rb_shm_reader_t *src;
+	const rb_shm_header_t *header;
+	uint64_t received = 0, next_report = 0;
+	void *buf;
+
+	fprintf(stderr,
+		"MISRC shmrecv " MIRSC_TOOLS_VERSION "\n"
+		MIRSC_TOOLS_COPYRIGHT "\n\n"
+	);
+
+	while ((opt = getopt_long(argc, argv, "i:o:lqh", getopt_long_options, NULL)) != -1) {
+		switch (opt) {
+		case 'i':
+			input_name = optarg;
+			break;
+		case 'o':
+			output_name = optarg;
+			break;
+		case 'l':
+			lossy = 1;
+			break;
+		case 'q':
+			quiet = 1;
+			break;
+		case 'h':
+		default:
+			usage();
+			break;
+		}
+	}
+
+	if(input_name == NULL || output_name == NULL) usage();
+
+#ifndef _WIN32
+	signal(SIGINT, sighandler);
+	signal(SIGTERM, sighandler);
+	signal(SIGPIPE, sighandler);
+#else
+	SetConsoleCtrlHandler( (PHANDLER_ROUTINE) sighandler, TRUE );
+#endif
+
+	if (strcmp(output_name, "-") == 0) output = stdout;
+	else if ((output = fopen(output_name, "wb")) == NULL) {
+		fprintf(stderr, "Failed to open %s\n", output_name);
+		return -ENOENT;
+	}
+
+	src = rb_shm_reader_open(input_name, lossy);
+	if (!src) return -ENOENT;
+	header = rb_shm_reader_header(src);
+	fprintf(stderr, "Reading ADC %c, %" PRIu32 " Hz, %s (%u significant bits), %s\n",
+		header->channel == 0 ? 'A' : 'B', header->sample_rate,
+		format_name(header->format), header->bits,
+		lossy ? "lossy" : "lossless");
+
+	while (!do_exit)
+	{
+		if ((buf = rb_shm_reader_read_ptr_wait(src, READ_SIZE, 100)) == NULL) {
+			if (rb_shm_reader_stopped(src)) break;
+			continue;
+		}
+		fwrite(buf, 1, READ_SIZE, output);
+		// a lossy reader can be overtaken while writing the block out
+		if (rb_shm_reader_read_finished(src, READ_SIZE) != 0) overruns++;
+		received += READ_SIZE;
+		if (!quiet && received >= next_report) {
+			fprintf(stderr, "\33[2K\r Received %" PRIu64 " MB, skipped %" PRIu64 " MB", received >> 20, rb_shm_reader_dropped(src) >> 20);
+			next_report = received + ((uint64_t)header->sample_rate << 1);
+		}
+	}
+	if (!quiet) fprintf(stderr, "\n");
+	fprintf(stderr, "%s after %" PRIu64 " bytes", do_exit ? "Stopped" : "Capture ended", received);
+	if (lossy) fprintf(stderr, ", %" PRIu64 " bytes skipped, %d blocks overwritten while reading", rb_shm_reader_dropped(src), overruns);
+	fprintf(stderr, "\n");
+
+	rb_shm_reader_close(src);
+	if (output != stdout) fclose(output);
+	return 0;
+}
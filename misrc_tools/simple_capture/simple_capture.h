@@ -129,6 +129,14 @@ typedef struct {
 	sc_codec_t codec;
 } sc_data_info_t;
 
+typedef struct {
+	uint32_t buffers;         /* capture buffers granted by the driver, or outstanding reads */
+	uint64_t frames;          /* frames handed to the callback */
+	uint64_t dropped;         /* frames the driver skipped, e.g. while all buffers were in use */
+	uint64_t latency_avg_ns;  /* capture timestamp to dequeue, average and maximum, 0 if unknown */
+	uint64_t latency_max_ns;
+} sc_stats_t;
+
 typedef struct sc_handle sc_handle_t;
 
 typedef void(*sc_frame_callback_t)(sc_data_info_t *data_info);
@@ -140,5 +148,11 @@ size_t	sc_get_formats(char* device_id, sc_formatlist_t **fmt_list);
 int		sc_start_capture(const char* device_id, uint32_t width, uint32_t height, sc_codec_t codec,
 			uint32_t fps_num, uint32_t fps_den, sc_frame_callback_t cb, void* cb_ctx, sc_handle_t** out_handle);
 void	sc_stop_capture(sc_handle_t *handle);
+/* number of capture buffers (V4L2) or outstanding read requests (Media Foundation)
+ * for the next sc_start_capture(), 0 for the default, more absorb longer stalls
+ * of the callback before frames are dropped */
+void	sc_set_buffer_count(uint32_t count);
+/* statistics of a running capture, returns -1 if the implementation has none */
+int		sc_get_stats(sc_handle_t *handle, sc_stats_t *stats);
 
 #endif
\ No newline at end of file
@@ -382,4 +382,15 @@ void sc_stop_capture(sc_handle_t *handle) {
 		handle->queue = NULL;
 		free(handle);
 	}
-}
\ No newline at end of file
+}
+
+/* AVCaptureVideoDataOutput manages its own buffers */
+void sc_set_buffer_count(uint32_t count) {
+	(void)count;
+}
+
+int sc_get_stats(sc_handle_t *handle, sc_stats_t *stats) {
+	(void)handle;
+	(void)stats;
+	return -1;
+}
@@ -23,14 +23,28 @@
 #include <stdlib.h>
 #include <string.h>
 #include <wchar.h>
+#include <stddef.h>
 #include "simple_capture.h"
 
+/* ReadSample requests kept outstanding in asynchronous mode */
+#define SC_MF_DEFAULT_READS 4
+
+static uint32_t sc_buffer_count = 0;
+
 struct sc_handle {
 	IMFSourceReader* reader;
-	HANDLE th;
+	HANDLE th;                          /* reader thread, synchronous mode only */
 	volatile LONG stop;
 	sc_frame_callback_t cb;
 	sc_data_info_t data_info;
+	/* asynchronous mode, the reader calls back on its own work queue threads */
+	IMFSourceReaderCallback async_cb;
+	int async;
+	uint32_t reads;
+	CRITICAL_SECTION lock;              /* frame callbacks one at a time */
+	HANDLE flushed;
+	volatile LONG64 frames;
+	volatile LONG64 dropped;
 };
 
 /* Simple one-time MF startup */
@@ -256,6 +270,76 @@ done:
 	return nfmt;
 }
 
+static uint32_t mf_bytes_per_pixel(const sc_codec_t* codec) {
+	if (SC_CODEC_EQUAL(*codec, SC_CODEC_YUYV) || SC_CODEC_EQUAL(*codec, SC_CODEC_UYVY)) return 2;
+#ifdef SC_CODEC_YVYU
+	if (SC_CODEC_EQUAL(*codec, SC_CODEC_YVYU)) return 2;
+#endif
+#ifdef SC_CODEC_VYUY
+	if (SC_CODEC_EQUAL(*codec, SC_CODEC_VYUY)) return 2;
+#endif
+	if (SC_CODEC_EQUAL(*codec, SC_CODEC_RGB24) || SC_CODEC_EQUAL(*codec, SC_CODEC_BGR24)) return 3;
+	if (SC_CODEC_EQUAL(*codec, SC_CODEC_GREY)) return 1;
+	return 0;  /* compressed or unknown, always contiguous */
+}
+
+static void mf_call(struct sc_handle* hc, BYTE* data, uint32_t len) {
+	hc->data_info.data = data;
+	hc->data_info.len = len;
+	if (hc->cb && hc->data_info.data && hc->data_info.len > 0) {
+		hc->cb(&(hc->data_info));
+	}
+}
+
+/* A sample of a single 2D buffer without row padding is locked in place,
+ * anything else goes through ConvertToContiguousBuffer(), which may copy */
+static void mf_deliver(struct sc_handle* hc, IMFSample* sample) {
+	uint32_t stride = hc->data_info.width * mf_bytes_per_pixel(&hc->data_info.codec);
+	IMFMediaBuffer* buf = NULL;
+	DWORD nbufs = 0;
+	HRESULT hr;
+
+	if (stride && SUCCEEDED(IMFSample_GetBufferCount(sample, &nbufs)) && nbufs == 1 &&
+	    SUCCEEDED(IMFSample_GetBufferByIndex(sample, 0, &buf))) {
+		IMF2DBuffer2* buf2d = NULL;
+		int done = 0;
+		if (SUCCEEDED(IMFMediaBuffer_QueryInterface(buf, &IID_IMF2DBuffer2, (void**)&buf2d))) {
+			BYTE *scanline0 = NULL, *start = NULL;
+			LONG pitch = 0;
+			DWORD length = 0;
+			if (SUCCEEDED(IMF2DBuffer2_Lock2DSize(buf2d, MF2DBuffer_LockFlags_Read, &scanline0, &pitch, &start, &length))) {
+				/* bottom-up images have a negative pitch */
+				if (pitch == (LONG)stride) {
+					mf_call(hc, scanline0, stride * hc->data_info.height);
+					done = 1;
+				}
+				IMF2DBuffer2_Unlock2D(buf2d);
+			}
+			IMF2DBuffer2_Release(buf2d);
+		}
+		IMFMediaBuffer_Release(buf);
+		buf = NULL;
+		if (done) return;
+	}
+
+	hr = IMFSample_ConvertToContiguousBuffer(sample, &buf);
+	if (SUCCEEDED(hr) && buf) {
+		BYTE* pData = NULL;
+		DWORD maxLen = 0, curLen = 0;
+		if (SUCCEEDED(IMFMediaBuffer_Lock(buf, &pData, &maxLen, &curLen))) {
+			mf_call(hc, pData, (uint32_t)curLen);
+			IMFMediaBuffer_Unlock(buf);
+		}
+		IMFMediaBuffer_Release(buf);
+	}
+}
+
+static void mf_account(struct sc_handle* hc, DWORD flags, IMFSample* sample) {
+	/* a stream tick marks a gap, the source skipped frames */
+	if (flags & MF_SOURCE_READERF_STREAMTICK) InterlockedIncrement64(&hc->dropped);
+	if (sample) InterlockedIncrement64(&hc->frames);
+}
+
 static unsigned __stdcall mf_thread(void* p) {
 	struct sc_handle* hc = (struct sc_handle*)p;
 	for (;;) {
@@ -266,28 +350,95 @@ static unsigned __stdcall mf_thread(void* p) {
 		IMFSample* sample = NULL;
 		HRESULT hr = IMFSourceReader_ReadSample(hc->reader, MF_SOURCE_READER_FIRST_VIDEO_STREAM, 0, &stream, &flags, &ts, &sample);
 		if (FAILED(hr)) { Sleep(1); continue; }
+		mf_account(hc, flags, sample);
 		if (!sample) continue;
 
-		IMFMediaBuffer* buf = NULL;
-		hr = IMFSample_ConvertToContiguousBuffer(sample, &buf);
-		if (SUCCEEDED(hr) && buf) {
-			BYTE* pData = NULL;
-			DWORD maxLen = 0, curLen = 0;
-			if (SUCCEEDED(IMFMediaBuffer_Lock(buf, &pData, &maxLen, &curLen))) {
-				hc->data_info.data = pData;
-				hc->data_info.len = (uint32_t)curLen;
-				if (hc->cb && hc->data_info.data && hc->data_info.len > 0) {
-					hc->cb(&(hc->data_info));
-				}
-				IMFMediaBuffer_Unlock(buf);
-			}
-			IMFMediaBuffer_Release(buf);
-		}
+		mf_deliver(hc, sample);
 		IMFSample_Release(sample);
 	}
 	return 0;
 }
 
+//-----------------------------------------------------------------------------
+// Asynchronous mode: several ReadSample() requests stay outstanding, so the
+// source keeps delivering while a frame callback stalls
+//-----------------------------------------------------------------------------
+
+#define MF_HANDLE_OF(cb) ((struct sc_handle*)((char*)(cb) - offsetof(struct sc_handle, async_cb)))
+
+static HRESULT mf_request(struct sc_handle* hc) {
+	return IMFSourceReader_ReadSample(hc->reader, MF_SOURCE_READER_FIRST_VIDEO_STREAM, 0, NULL, NULL, NULL, NULL);
+}
+
+static HRESULT STDMETHODCALLTYPE mf_cb_query_interface(IMFSourceReaderCallback* This, REFIID riid, void** ppv) {
+	if (!ppv) return E_POINTER;
+	if (IsEqualIID(riid, &IID_IUnknown) || IsEqualIID(riid, &IID_IMFSourceReaderCallback)) {
+		*ppv = This;
+		return S_OK;
+	}
+	*ppv = NULL;
+	return E_NOINTERFACE;
+}
+
+/* the callback lives inside the handle, sc_stop_capture() frees both after the reader is gone */
+static ULONG STDMETHODCALLTYPE mf_cb_add_ref(IMFSourceReaderCallback* This) {
+	(void)This;
+	return 2;
+}
+
+static ULONG STDMETHODCALLTYPE mf_cb_release(IMFSourceReaderCallback* This) {
+	(void)This;
+	return 1;
+}
+
+static HRESULT STDMETHODCALLTYPE mf_cb_on_read_sample(IMFSourceReaderCallback* This, HRESULT status, DWORD stream,
+	DWORD flags, LONGLONG ts, IMFSample* sample)
+{
+	struct sc_handle* hc = MF_HANDLE_OF(This);
+	(void)stream; (void)ts;
+
+	EnterCriticalSection(&hc->lock);
+	if (InterlockedCompareExchange(&hc->stop, 0, 0)) {
+		LeaveCriticalSection(&hc->lock);
+		return S_OK;
+	}
+	if (SUCCEEDED(status)) {
+		mf_account(hc, flags, sample);
+		if (sample) mf_deliver(hc, sample);
+	}
+	LeaveCriticalSection(&hc->lock);
+	if (FAILED(status)) Sleep(1);
+	/* replace the completed request, unless the stream is gone */
+	if (!(flags & (MF_SOURCE_READERF_ERROR | MF_SOURCE_READERF_ENDOFSTREAM))) mf_request(hc);
+	return S_OK;
+}
+
+static HRESULT STDMETHODCALLTYPE mf_cb_on_flush(IMFSourceReaderCallback* This, DWORD stream) {
+	(void)stream;
+	SetEvent(MF_HANDLE_OF(This)->flushed);
+	return S_OK;
+}
+
+static HRESULT STDMETHODCALLTYPE mf_cb_on_event(IMFSourceReaderCallback* This, DWORD stream, IMFMediaEvent* event) {
+	(void)This; (void)stream; (void)event;
+	return S_OK;
+}
+
+static IMFSourceReaderCallbackVtbl mf_cb_vtbl = {
+	mf_cb_query_interface,
+	mf_cb_add_ref,
+	mf_cb_release,
+	mf_cb_on_read_sample,
+	mf_cb_on_flush,
+	mf_cb_on_event,
+};
+
+static void mf_free_handle(struct sc_handle* hc) {
+	if (hc->flushed) CloseHandle(hc->flushed);
+	DeleteCriticalSection(&hc->lock);
+	free(hc);
+}
+
 int sc_start_capture(const char* device_id, uint32_t width, uint32_t height, sc_codec_t codec,
     uint32_t fps_num, uint32_t fps_den, sc_frame_callback_t cb, void* cb_ctx, sc_handle_t** out_handle)
 {
@@ -300,6 +451,8 @@ int sc_start_capture(const char* device_id, uint32_t width, uint32_t height, sc_
 	UINT32 count = 0;
 	IMFMediaSource* src = NULL;
 	IMFSourceReader* reader = NULL;
+	IMFAttributes* rattr = NULL;
+	struct sc_handle* hc = NULL;
 	int ret = -1;
 
 	if (FAILED(MFCreateAttributes(&attr, 1))) goto done;
@@ -321,7 +474,20 @@ int sc_start_capture(const char* device_id, uint32_t width, uint32_t height, sc_
 	}
 	if (!src) goto done;
 
-	if (FAILED(MFCreateSourceReaderFromMediaSource(src, NULL, &reader))) goto done;
+	hc = (struct sc_handle*)calloc(1, sizeof(struct sc_handle));
+	if (!hc) goto done;
+	InitializeCriticalSection(&hc->lock);
+	hc->async_cb.lpVtbl = &mf_cb_vtbl;
+
+	/* Asynchronous reader if possible, the synchronous one as fallback */
+	hc->flushed = CreateEventW(NULL, FALSE, FALSE, NULL);
+	if (hc->flushed && SUCCEEDED(MFCreateAttributes(&rattr, 1)) &&
+	    SUCCEEDED(IMFAttributes_SetUnknown(rattr, &MF_SOURCE_READER_ASYNC_CALLBACK, (IUnknown*)&hc->async_cb)) &&
+	    SUCCEEDED(MFCreateSourceReaderFromMediaSource(src, rattr, &reader))) {
+		hc->async = 1;
+	} else if (FAILED(MFCreateSourceReaderFromMediaSource(src, NULL, &reader))) {
+		goto done;
+	}
 
 	/* Request the exact type directly using sc_codec_t (GUID) */
 	IMFMediaType* mt = NULL;
@@ -350,9 +516,6 @@ int sc_start_capture(const char* device_id, uint32_t width, uint32_t height, sc_
 		IMFMediaType_Release(act);
 	}
 
-	struct sc_handle* hc = (struct sc_handle*)calloc(1, sizeof(struct sc_handle));
-	if (!hc) goto done;
-
 	hc->reader = reader;
 	reader = NULL;
 	hc->cb = cb;
@@ -362,15 +525,34 @@ int sc_start_capture(const char* device_id, uint32_t width, uint32_t height, sc_
 	hc->data_info.codec = codec;
 	hc->stop = 0;
 
-	uintptr_t th = _beginthreadex(NULL, 0, mf_thread, hc, 0, NULL);
-	if (!th) { free(hc); goto done; }
-	hc->th = (HANDLE)th;
+	if (hc->async) {
+		hc->reads = sc_buffer_count ? sc_buffer_count : SC_MF_DEFAULT_READS;
+		for (uint32_t i = 0; i < hc->reads; ++i) {
+			if (FAILED(mf_request(hc))) {
+				if (i == 0) goto done;
+				hc->reads = i;
+				break;
+			}
+		}
+	} else {
+		hc->reads = 1;
+		uintptr_t th = _beginthreadex(NULL, 0, mf_thread, hc, 0, NULL);
+		if (!th) goto done;
+		hc->th = (HANDLE)th;
+	}
 
 	*out_handle = hc;
+	hc = NULL;
 	ret = 0;
 
 done:
+	/* reader and attributes first, they may point to the callback in the handle */
 	if (reader) IMFSourceReader_Release(reader);
+	if (rattr) IMFAttributes_Release(rattr);
+	if (hc) {
+		if (hc->reader) IMFSourceReader_Release(hc->reader);
+		mf_free_handle(hc);
+	}
 	if (src) IMFMediaSource_Release(src);
 	if (devs) {
 		for (UINT32 i=0; i<count; ++i) if (devs[i]) IMFActivate_Release(devs[i]);
@@ -387,6 +569,32 @@ void sc_stop_capture(sc_handle_t *handle) {
 		WaitForSingleObject(handle->th, INFINITE);
 		CloseHandle(handle->th);
 	}
+	if (handle->async) {
+		/* cancel the outstanding requests, the reader calls OnFlush() once the
+		 * callbacks are done, the lock covers one still delivering otherwise */
+		if (SUCCEEDED(IMFSourceReader_Flush(handle->reader, MF_SOURCE_READER_ALL_STREAMS))) {
+			WaitForSingleObject(handle->flushed, 2000);
+		}
+		EnterCriticalSection(&handle->lock);
+		LeaveCriticalSection(&handle->lock);
+	}
 	if (handle->reader) IMFSourceReader_Release(handle->reader);
-	free(handle);
-}
\ No newline at end of file
+	mf_free_handle(handle);
+}
+
+/* Outstanding ReadSample() requests in asynchronous mode, the source reader
+ * manages the buffers itself */
+void sc_set_buffer_count(uint32_t count) {
+	sc_buffer_count = count;
+}
+
+int sc_get_stats(sc_handle_t *handle, sc_stats_t *stats) {
+	if (!handle || !stats) return -1;
+	stats->buffers = handle->reads;
+	stats->frames = (uint64_t)InterlockedCompareExchange64(&handle->frames, 0, 0);
+	stats->dropped = (uint64_t)InterlockedCompareExchange64(&handle->dropped, 0, 0);
+	/* the sample times are presentation times, no dequeue latency */
+	stats->latency_avg_ns = 0;
+	stats->latency_max_ns = 0;
+	return 0;
+}
@@ -29,9 +29,15 @@
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
 
 #include "simple_capture.h"
 
+#define SC_V4L2_DEFAULT_BUFFERS 8
+
+static uint32_t sc_buffer_count = 0;
+
 typedef struct {
     void* start;
     size_t length;
@@ -45,6 +51,13 @@ struct sc_handle {
 	volatile int stop;
 	sc_frame_callback_t cb;
 	sc_data_info_t data_info;
+	/* written by the capture thread, read by sc_get_stats() */
+	atomic_uint_fast64_t frames;
+	atomic_uint_fast64_t dropped;
+	atomic_uint_fast64_t latency_sum_ns;
+	atomic_uint_fast64_t latency_count;
+	atomic_uint_fast64_t latency_max_ns;
+	uint32_t next_sequence;
 };
 
 char* sc_get_impl_name() {
@@ -140,6 +153,29 @@ size_t sc_get_formats(char* device_id, sc_formatlist_t **fmt_list) {
 	return cnt;
 }
 
+/* dropped frames from gaps in the sequence numbers, latency from the driver's
+ * capture timestamp if it is taken from the monotonic clock */
+static void v4l2_account(sc_handle_t* hc, const struct v4l2_buffer* buf) {
+	uint64_t frames = atomic_load_explicit(&hc->frames, memory_order_relaxed);
+	if (frames > 0 && buf->sequence != hc->next_sequence) {
+		atomic_fetch_add_explicit(&hc->dropped, (uint32_t)(buf->sequence - hc->next_sequence), memory_order_relaxed);
+	}
+	hc->next_sequence = buf->sequence + 1;
+	atomic_store_explicit(&hc->frames, frames + 1, memory_order_relaxed);
+
+	if ((buf->flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) != V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) return;
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	int64_t latency = ((int64_t)now.tv_sec - buf->timestamp.tv_sec) * 1000000000
+	                + ((int64_t)now.tv_nsec - (int64_t)buf->timestamp.tv_usec * 1000);
+	if (latency < 0) return;
+	atomic_fetch_add_explicit(&hc->latency_sum_ns, (uint64_t)latency, memory_order_relaxed);
+	atomic_fetch_add_explicit(&hc->latency_count, 1, memory_order_relaxed);
+	if ((uint64_t)latency > atomic_load_explicit(&hc->latency_max_ns, memory_order_relaxed)) {
+		atomic_store_explicit(&hc->latency_max_ns, (uint64_t)latency, memory_order_relaxed);
+	}
+}
+
 static void* v4l2_thread(void* p) {
 	sc_handle_t* hc = (sc_handle_t*)p;
 	while (!hc->stop) {
@@ -154,6 +190,7 @@ static void* v4l2_thread(void* p) {
 		buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 		buf.memory = V4L2_MEMORY_MMAP;
 		if (ioctl(hc->fd, VIDIOC_DQBUF, &buf) == 0) {
+			v4l2_account(hc, &buf);
 			if (buf.index < (uint32_t)hc->nbufs) {
 				hc->data_info.data = (uint8_t*)hc->bufs[buf.index].start;
 				hc->data_info.len = (uint32_t) buf.bytesused;
@@ -196,7 +233,7 @@ int sc_start_capture(const char* device_id, uint32_t width, uint32_t height, sc_
 
 	struct v4l2_requestbuffers req; 
 	memset(&req, 0, sizeof(req));
-	req.count = 8;
+	req.count = sc_buffer_count ? sc_buffer_count : SC_V4L2_DEFAULT_BUFFERS;
 	req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 	req.memory = V4L2_MEMORY_MMAP;
 	if (ioctl(fd, VIDIOC_REQBUFS, &req) < 0 || req.count < 2) { close(fd); return -1; }
@@ -271,3 +308,18 @@ void sc_stop_capture(sc_handle_t* handle) {
 	close(handle->fd);
 	free(handle);
 }
+
+void sc_set_buffer_count(uint32_t count) {
+	sc_buffer_count = count;
+}
+
+int sc_get_stats(sc_handle_t *handle, sc_stats_t *stats) {
+	if (!handle || !stats) return -1;
+	stats->buffers = (uint32_t)handle->nbufs;
+	stats->frames = atomic_load_explicit(&handle->frames, memory_order_relaxed);
+	stats->dropped = atomic_load_explicit(&handle->dropped, memory_order_relaxed);
+	uint64_t timed = atomic_load_explicit(&handle->latency_count, memory_order_relaxed);
+	stats->latency_avg_ns = timed ? atomic_load_explicit(&handle->latency_sum_ns, memory_order_relaxed) / timed : 0;
+	stats->latency_max_ns = atomic_load_explicit(&handle->latency_max_ns, memory_order_relaxed);
+	return 0;
+}
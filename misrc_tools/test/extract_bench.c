@@ -0,0 +1,347 @@
+/*
+* extract_bench
+* Copyright (C) 2024-2025  vrunk11, stefan_o
+*
+* This program will benchmark the extraction and conversion functions
+* and print the results as JSON
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "../../misrc_common/extract.h"
+#include "../../misrc_common/buffer.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+	#if defined(_MSC_VER)
+		#include <intrin.h>
+	#else
+		#include <x86intrin.h>
+	#endif
+	#define HAVE_TSC 1
+#else
+	#define HAVE_TSC 0
+#endif
+
+#define MAX_SIZES 16
+#define OVERRUN 256 // SIMD kernels may write past the end
+
+static const size_t default_sizes[] = { 32<<10, 256<<10, 8<<20, 128<<20 };
+
+typedef struct {
+	const char *name;
+	conv_function_t fn;
+} kernel_name_t;
+
+#define CK(n) { #n, (conv_function_t) &extract_##n##_C }
+
+// C reference of each kernel get_conv_function() can return, used for naming and as baseline
+static const kernel_name_t c_kernels[] = {
+	CK(X), CK(XS), CK(X_peak),
+	CK(A), CK(B), CK(AB),
+	CK(S), CK(A_p), CK(B_p),
+	CK(AB_p), CK(S_p), CK(A_32),
+	CK(B_32), CK(AB_32), CK(A_p_32),
+	CK(B_p_32), CK(AB_p_32), CK(A_peak),
+	CK(B_peak), CK(AB_peak), CK(A_p_peak),
+	CK(B_p_peak), CK(AB_p_peak), CK(A_peak_32),
+	CK(B_peak_32), CK(AB_peak_32), CK(A_p_peak_32),
+	CK(B_p_peak_32), CK(AB_p_peak_32),
+};
+
+// same selection as the C fallback of get_conv_function()
+static const char *c_name(uint8_t single, uint8_t pad, uint8_t dword, uint8_t peak, int outs, conv_function_t *fn) {
+	char name[32];
+	const char *base;
+	if (single) peak = 0;
+	if (outs == 0) base = single ? "XS" : (peak ? "X_peak" : "X");
+	else if (single && !dword && !peak) base = "S";
+	else base = (outs == 1) ? "A" : ((outs == 2) ? "B" : "AB");
+	if (outs == 0 || (single && !dword)) {
+		snprintf(name, sizeof(name), "%s%s", base, (outs != 0 && pad) ? "_p" : "");
+	} else {
+		snprintf(name, sizeof(name), "%s%s%s%s", base, pad ? "_p" : "", peak ? "_peak" : "", dword ? "_32" : "");
+	}
+	for (size_t i = 0; i < sizeof(c_kernels)/sizeof(c_kernels[0]); i++) {
+		if (strcmp(c_kernels[i].name, name) == 0) {
+			*fn = c_kernels[i].fn;
+			return c_kernels[i].name;
+		}
+	}
+	*fn = NULL;
+	return "unknown";
+}
+
+static double now_sec(void) {
+#ifdef _WIN32
+	LARGE_INTEGER f, c;
+	QueryPerformanceFrequency(&f);
+	QueryPerformanceCounter(&c);
+	return (double)c.QuadPart / (double)f.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+static uint64_t now_cycles(void) {
+#if HAVE_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static size_t parse_size(const char *s) {
+	char *end;
+	double v = strtod(s, &end);
+	switch (*end) {
+		case 'k': case 'K': v *= 1024.0; break;
+		case 'm': case 'M': v *= 1024.0*1024.0; break;
+		case 'g': case 'G': v *= 1024.0*1024.0*1024.0; break;
+		default: break;
+	}
+	return ((size_t)v + 4095) & ~(size_t)4095;
+}
+
+typedef struct {
+	double min_time;
+	int first;
+} bench_ctx_t;
+
+typedef enum { B_EXTRACT, B_CONV32, B_CONV8, B_CONVF32, B_AUDIO, B_AUDIO_LEGACY } bench_kind_t;
+
+typedef struct {
+	bench_kind_t kind;
+	void *fn;
+	size_t len;          // samples (bytes for audio)
+	void *in;
+	void *out[6];
+	uint8_t *aux;
+} bench_call_t;
+
+static void bench_run_once(bench_call_t *c) {
+	size_t clip[2] = {0, 0};
+	uint16_t peak[2] = {0, 0};
+	switch (c->kind) {
+		case B_EXTRACT:
+			((conv_function_t)c->fn)(c->in, c->len, clip, c->aux, c->out[0], c->out[1], peak);
+			break;
+		case B_CONV32:
+			((conv_16to32_t)c->fn)(c->in, c->out[0], c->len);
+			break;
+		case B_CONV8:
+			((conv_16to8_t)c->fn)(c->in, c->out[0], c->len);
+			break;
+		case B_CONVF32:
+			((conv_16tof32_t)c->fn)(c->in, c->out[0], c->len, 0.0f, F32_SCALE_12BIT);
+			break;
+		case B_AUDIO: {
+			uint8_t *out2ch[2] = { c->out[0], c->out[1] };
+			uint8_t *out1ch[4] = { c->out[2], c->out[3], c->out[4], c->out[5] };
+			((conv_audio_t)c->fn)(c->in, c->len, out2ch, out1ch);
+			break;
+		}
+		case B_AUDIO_LEGACY:
+			extract_audio_2ch_C(c->in, c->len, c->out[0], c->out[1]);
+			extract_audio_1ch_C(c->in, c->len, c->out[2], c->out[3], c->out[4], c->out[5]);
+			break;
+	}
+}
+
+// run until min_time has passed (at least 3 iterations after a warmup) and print one JSON record
+static void bench(bench_ctx_t *ctx, bench_call_t *c, const char *group, const char *kernel, const char *impl,
+                  const char *params, size_t buf_bytes, size_t samples, double in_bytes, double out_bytes) {
+	double t0, t1;
+	uint64_t c0, c1;
+	size_t iter = 0;
+
+	bench_run_once(c);
+	t0 = now_sec();
+	c0 = now_cycles();
+	do {
+		bench_run_once(c);
+		iter++;
+		t1 = now_sec();
+	} while (t1 - t0 < ctx->min_time || iter < 3);
+	c1 = now_cycles();
+
+	double secs = t1 - t0;
+	double sps = (double)samples * iter / secs;
+	printf("%s\n    {\"group\": \"%s\", \"kernel\": \"%s\", \"impl\": \"%s\", %s\"buffer_bytes\": %zu, "
+	       "\"samples\": %zu, \"iterations\": %zu, \"seconds\": %.6f, \"samples_per_s\": %.1f, "
+	       "\"in_gb_per_s\": %.3f, \"total_gb_per_s\": %.3f, ",
+	       ctx->first ? "" : ",", group, kernel, impl, params, buf_bytes, samples, iter, secs, sps,
+	       in_bytes * sps / 1e9, (in_bytes + out_bytes) * sps / 1e9);
+	if (HAVE_TSC) printf("\"cycles_per_sample\": %.4f}", (double)(c1 - c0) / ((double)samples * iter));
+	else printf("\"cycles_per_sample\": null}");
+	fflush(stdout);
+	ctx->first = 0;
+}
+
+static void usage(void) {
+	fprintf(stderr,
+		"Benchmark of the extraction and conversion functions, results are printed as JSON\n\n"
+		"Usage:\n"
+		"\t[-s comma separated input buffer sizes, k/M/G suffixes allowed (default: 32k,256k,8M,128M)]\n"
+		"\t[-t minimum time per measurement in seconds (default: 0.2)]\n"
+		"\t[-C skip the C reference functions]\n"
+	);
+	exit(1);
+}
+
+int main(int argc, char **argv) {
+	bench_ctx_t ctx = { 0.2, 1 };
+	size_t sizes[MAX_SIZES];
+	int nsizes = 0, with_c = 1;
+	size_t max_size = 0;
+	uint8_t *in, *aux, *out[6];
+	uint32_t rnd = 0x12345678;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+			char *list = argv[++i];
+			char *tok = strtok(list, ",");
+			while (tok && nsizes < MAX_SIZES) {
+				sizes[nsizes++] = parse_size(tok);
+				tok = strtok(NULL, ",");
+			}
+		}
+		else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) ctx.min_time = atof(argv[++i]);
+		else if (strcmp(argv[i], "-C") == 0) with_c = 0;
+		else usage();
+	}
+	if (nsizes == 0) {
+		for (size_t i = 0; i < sizeof(default_sizes)/sizeof(default_sizes[0]); i++) sizes[nsizes++] = default_sizes[i];
+	}
+	for (int i = 0; i < nsizes; i++) if (sizes[i] > max_size) max_size = sizes[i];
+
+	// 16 to 32 bit conversion doubles the size, aux is at most one byte per input byte
+	in  = aligned_alloc(32, max_size + OVERRUN);
+	aux = aligned_alloc(32, max_size + OVERRUN);
+	for (int i = 0; i < 6; i++) out[i] = aligned_alloc(32, 2*max_size + OVERRUN);
+	if (!in || !aux || !out[0] || !out[1] || !out[2] || !out[3] || !out[4] || !out[5]) {
+		fprintf(stderr, "Failed to allocate %zu byte buffers\n", max_size);
+		return 1;
+	}
+	for (size_t i = 0; i < max_size + OVERRUN; i++) {
+		rnd = rnd * 1664525 + 1013904223;
+		in[i] = rnd >> 24;
+	}
+	for (int i = 0; i < 6; i++) memset(out[i], 0, 2*max_size + OVERRUN);
+	memset(aux, 0, max_size + OVERRUN);
+
+	printf("{\n  \"tool\": \"extract_bench\",\n");
+#if defined(__x86_64__) || defined(_M_X64)
+	printf("  \"arch\": \"x86_64\",\n  \"cpu_feat\": %d,\n", check_cpu_feat());
+#elif defined(__aarch64__) || defined(__arm64__)
+	printf("  \"arch\": \"aarch64\",\n");
+#else
+	printf("  \"arch\": \"generic\",\n");
+#endif
+	printf("  \"cycles\": \"%s\",\n  \"results\": [", HAVE_TSC ? "tsc" : "unavailable");
+
+	for (int si = 0; si < nsizes; si++) {
+		size_t bytes = sizes[si];
+		char params[160];
+
+		// extraction, every combination get_conv_function() accepts
+		for (int single = 0; single < 2; single++)
+		for (int pad = 0; pad < 2; pad++)
+		for (int dword = 0; dword < 2; dword++)
+		for (int peak = 0; peak < 2; peak++)
+		for (int outs = 0; outs < 4; outs++) {
+			conv_function_t fn_c;
+			void *oa = (outs & 1) ? (void*)out[0] : NULL;
+			void *ob = (outs & 2) ? (void*)out[1] : NULL;
+			if (single && ob) continue;
+			if (single && peak) continue;     // peak is ignored for single channel
+			if (outs == 0 && (pad || dword)) continue; // aux only, pad/dword do not apply
+			const char *name = c_name(single, pad, dword, peak, outs, &fn_c);
+			size_t in_bps = (single && (!dword || outs == 0)) ? 2 : 4;
+			size_t out_bps = 1 + ((outs & 1) ? (dword ? 4 : 2) : 0) + ((outs & 2) ? (dword ? 4 : 2) : 0);
+			size_t samples = bytes / in_bps;
+			bench_call_t call = { B_EXTRACT, NULL, samples, in, { oa, ob }, aux };
+			snprintf(params, sizeof(params), "\"single\": %d, \"pad\": %d, \"dword\": %d, \"peak\": %d, \"outputs\": \"%s\", ",
+			         single, pad, dword, peak, outs == 0 ? "aux" : (outs == 1 ? "A" : (outs == 2 ? "B" : "AB")));
+			call.fn = get_conv_function(single, pad, dword, peak, oa, ob);
+			bench(&ctx, &call, "extract", name, "dispatch", params, bytes, samples, in_bps, out_bps);
+			if (with_c && fn_c) {
+				call.fn = fn_c;
+				bench(&ctx, &call, "extract", name, "C", params, bytes, samples, in_bps, out_bps);
+			}
+		}
+
+		// 16 bit repacking helpers
+		{
+			struct { const char *name; conv_16to32_t d; conv_16to32_t c; } conv32[] = {
+				{ "16to32",     get_16to32_function(),     convert_16to32_C },
+				{ "16to8to32",  get_16to8to32_function(),  convert_16to8to32_C },
+				{ "16to12to32", get_16to12to32_function(), convert_16to12to32_C },
+			};
+			size_t samples = bytes / 2;
+			for (size_t k = 0; k < sizeof(conv32)/sizeof(conv32[0]); k++) {
+				bench_call_t call = { B_CONV32, (void*)conv32[k].d, samples, in, { out[0] }, NULL };
+				bench(&ctx, &call, "convert", conv32[k].name, "dispatch", "", bytes, samples, 2, 4);
+				if (with_c) {
+					call.fn = (void*)conv32[k].c;
+					bench(&ctx, &call, "convert", conv32[k].name, "C", "", bytes, samples, 2, 4);
+				}
+			}
+			bench_call_t call8 = { B_CONV8, (void*)get_16to8_function(), samples, in, { out[0] }, NULL };
+			bench(&ctx, &call8, "convert", "16to8", "dispatch", "", bytes, samples, 2, 1);
+			if (with_c) {
+				call8.fn = (void*)convert_16to8_C;
+				bench(&ctx, &call8, "convert", "16to8", "C", "", bytes, samples, 2, 1);
+			}
+			bench_call_t callf = { B_CONVF32, (void*)get_16tof32_function(), samples, in, { out[0] }, NULL };
+			bench(&ctx, &callf, "convert", "16tof32", "dispatch", "", bytes, samples, 2, 4);
+			if (with_c) {
+				callf.fn = (void*)convert_16tof32_C;
+				bench(&ctx, &callf, "convert", "16tof32", "C", "", bytes, samples, 2, 4);
+			}
+		}
+
+		// audio de-interleave, 12 byte frames of 4 channels
+		{
+			size_t len = bytes - (bytes % 48);
+			size_t frames = len / 12;
+			bench_call_t call = { B_AUDIO, (void*)get_audio_function(), len, in,
+			                      { out[0], out[0] + len/2, out[1], out[1] + len/4, out[1] + len/2, out[1] + 3*(len/4) }, NULL };
+			bench(&ctx, &call, "audio", "audio", "dispatch", "", bytes, frames, 12, 24);
+			if (with_c) {
+				call.fn = (void*)extract_audio_C;
+				bench(&ctx, &call, "audio", "audio", "C", "", bytes, frames, 12, 24);
+				call.kind = B_AUDIO_LEGACY;
+				bench(&ctx, &call, "audio", "audio_1ch_2ch", "C", "", bytes, frames, 12, 24);
+			}
+		}
+	}
+
+	printf("\n  ]\n}\n");
+
+	aligned_free(in);
+	aligned_free(aux);
+	for (int i = 0; i < 6; i++) aligned_free(out[i]);
+	return 0;
+}
@@ -21,10 +21,12 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 #include <time.h>
 #include "../../misrc_common/extract.h"
 
 #define BUFSIZE ((2<<19)*1024)
+#define FIRST_AVX_TEST 38
 
 typedef struct {
 	conv_function_t C;
@@ -83,7 +85,35 @@ int main() {
 		/*34*/ {extract_AB_peak_32_C, extract_AB_peak_32_sse, 16, 64, 64, 1 },
 		/*35*/ {extract_A_p_peak_32_C, extract_A_p_peak_32_sse, 16, 64, 0, 1 },
 		/*36*/ {extract_B_p_peak_32_C, extract_B_p_peak_32_sse, 16, 0, 64, 1 },
-		/*37*/ {extract_AB_p_peak_32_C, extract_AB_p_peak_32_sse, 16, 64, 64, 1 }
+		/*37*/ {extract_AB_p_peak_32_C, extract_AB_p_peak_32_sse, 16, 64, 64, 1 },
+		/*38*/ {extract_A_C, extract_A_avx, BUFSIZE>>2, BUFSIZE>>1, 0, 0 },
+		/*39*/ {extract_B_C, extract_B_avx, BUFSIZE>>2, 0, BUFSIZE>>1, 0 },
+		/*40*/ {extract_AB_C, extract_AB_avx, BUFSIZE>>2, BUFSIZE>>1, BUFSIZE>>1, 0 },
+		/*41*/ {extract_S_C, extract_S_avx, BUFSIZE>>2, BUFSIZE>>2, 0, 0 },
+		/*42*/ {extract_A_p_C, extract_A_p_avx, BUFSIZE>>2, BUFSIZE>>1, 0, 0 },
+		/*43*/ {extract_B_p_C, extract_B_p_avx, BUFSIZE>>2, 0, BUFSIZE>>1, 0 },
+		/*44*/ {extract_AB_p_C, extract_AB_p_avx, BUFSIZE>>2, BUFSIZE>>1, BUFSIZE>>1, 0 },
+		/*45*/ {extract_S_p_C, extract_S_p_avx, BUFSIZE>>2, BUFSIZE>>2, 0, 0 },
+		/*46*/ {extract_A_32_C, extract_A_32_avx, BUFSIZE>>2, BUFSIZE, 0, 0 },
+		/*47*/ {extract_B_32_C, extract_B_32_avx, BUFSIZE>>2, 0, BUFSIZE, 0 },
+		/*48*/ {extract_AB_32_C, extract_AB_32_avx, BUFSIZE>>2, BUFSIZE, BUFSIZE, 0 },
+		/*49*/ {extract_A_p_32_C, extract_A_p_32_avx, BUFSIZE>>2, BUFSIZE, 0, 0 },
+		/*50*/ {extract_B_p_32_C, extract_B_p_32_avx, BUFSIZE>>2, 0, BUFSIZE, 0 },
+		/*51*/ {extract_AB_p_32_C, extract_AB_p_32_avx, BUFSIZE>>2, BUFSIZE, BUFSIZE, 0 },
+		/*52*/ {extract_A_peak_C, extract_A_peak_avx, BUFSIZE>>2, BUFSIZE>>1, 0, 1 },
+		/*53*/ {extract_B_peak_C, extract_B_peak_avx, BUFSIZE>>2, 0, BUFSIZE>>1, 1 },
+		/*54*/ {extract_AB_peak_C, extract_AB_peak_avx, BUFSIZE>>2, BUFSIZE>>1, BUFSIZE>>1, 1 },
+		/*55*/ {extract_A_p_peak_C, extract_A_p_peak_avx, BUFSIZE>>2, BUFSIZE>>1, 0, 1 },
+		/*56*/ {extract_B_p_peak_C, extract_B_p_peak_avx, BUFSIZE>>2, 0, BUFSIZE>>1, 1 },
+		/*57*/ {extract_AB_p_peak_C, extract_AB_p_peak_avx, BUFSIZE>>2, BUFSIZE>>1, BUFSIZE>>1, 1 },
+		/*58*/ {extract_A_peak_32_C, extract_A_peak_32_avx, BUFSIZE>>2, BUFSIZE, 0, 1 },
+		/*59*/ {extract_B_peak_32_C, extract_B_peak_32_avx, BUFSIZE>>2, 0, BUFSIZE, 1 },
+		/*60*/ {extract_AB_peak_32_C, extract_AB_peak_32_avx, BUFSIZE>>2, BUFSIZE, BUFSIZE, 1 },
+		/*61*/ {extract_A_p_peak_32_C, extract_A_p_peak_32_avx, BUFSIZE>>2, BUFSIZE, 0, 1 },
+		/*62*/ {extract_B_p_peak_32_C, extract_B_p_peak_32_avx, BUFSIZE>>2, 0, BUFSIZE, 1 },
+		/*63*/ {extract_AB_p_peak_32_C, extract_AB_p_peak_32_avx, BUFSIZE>>2, BUFSIZE, BUFSIZE, 1 },
+		/*64*/ {extract_AB_peak_C, extract_AB_peak_avx, 32, 64, 64, 1 },
+		/*65*/ {extract_AB_peak_32_C, extract_AB_peak_32_avx, 16, 64, 64, 1 }
 	};
 
 	fprintf(stderr,"Testing C and ASM extraction functions by comparison with random data.\n");
@@ -102,6 +132,10 @@ int main() {
 	fclose(rnd);
 
 	for(int i=0; i<sizeof(cvs)/sizeof(cvs[0]);i++) {
+		if(i>=FIRST_AVX_TEST && check_cpu_feat()<3) {
+			fprintf(stderr,"Skipping %i, processor without AVX2\n", i);
+			continue;
+		}
 		fprintf(stderr,"Testing %i...\n", i);
 		clipa[0] = 0;
 		clipa[1] = 0;
@@ -151,7 +185,7 @@ int main() {
 		if(cvs[i].b_cmp > 0 && cvs[i].pl_cmp > 0) {
 			if(peaka[1] != peakb[1]) fprintf(stderr, "%i Incorrect peak level B: %u vs %u\n", i, peaka[1], peakb[1]);
 		}
-		fprintf(stderr, "%i: SSE version was %.2f times faster\n", i, (double)(time_a)/(double)(time_b));
+		fprintf(stderr, "%i: ASM version was %.2f times faster\n", i, (double)(time_a)/(double)(time_b));
 	}
 
 	fprintf(stderr,"Test of C and ASM resampling / repacking functions with random data.\n");
@@ -271,5 +305,116 @@ int main() {
 	}
 	fprintf(stderr, "SSE version was %.2fx faster\n", (double)(time_a)/(double)(time_b));
 
+	fprintf(stderr,"Test of C and ASM audio de-interleave functions with random data.\n");
+
+	{
+		size_t len = (BUFSIZE>>2) - ((BUFSIZE>>2) % 48) + 36; // include a partial block
+		uint8_t *o2a[2] = { bufAa, (uint8_t*)bufAa + (BUFSIZE>>1) };
+		uint8_t *o2b[2] = { bufBa, (uint8_t*)bufBa + (BUFSIZE>>1) };
+		uint8_t *o1a[4], *o1b[4];
+		conv_audio_t conv_audio = get_audio_function();
+		for(int c=0; c<4; c++) {
+			o1a[c] = (uint8_t*)bufAb + (BUFSIZE>>2)*c;
+			o1b[c] = (uint8_t*)bufBb + (BUFSIZE>>2)*c;
+		}
+		time_start = clock();
+		extract_audio_2ch_C(buf, len, (uint16_t*)o2a[0], (uint16_t*)o2a[1]);
+		extract_audio_1ch_C(buf, len, o1a[0], o1a[1], o1a[2], o1a[3]);
+		time_end = clock();
+		time_a = time_end - time_start;
+		time_start = clock();
+		conv_audio(buf, len, o2b, o1b);
+		time_end = clock();
+		time_b = time_end - time_start;
+		fprintf(stderr,"Verify fused version.\n");
+		for(int c=0; c<2; c++) if (memcmp(o2a[c], o2b[c], len/2)) fprintf(stderr, "Incorrect 2ch buffer %i\n", c);
+		for(int c=0; c<4; c++) if (memcmp(o1a[c], o1b[c], len/4)) fprintf(stderr, "Incorrect 1ch buffer %i\n", c);
+	}
+	fprintf(stderr, "Fused version was %.2fx faster\n", (double)(time_a)/(double)(time_b));
+
+	fprintf(stderr,"Test of C and ASM float conversion functions with random data.\n");
+
+	{
+		size_t len = (BUFSIZE>>3) - 5; // more than one asm call and a partial block
+		int64_t ref = 0;
+		int16_t *in = (int16_t*)buf;
+		for(size_t j=0; j<len; j++) ref += in[j];
+		time_start = clock();
+		int64_t sum_c = convert_16tof32_C(in, (float*)bufAa, len, 3.5f, F32_SCALE_16BIT);
+		time_end = clock();
+		time_a = time_end - time_start;
+		conv_16tof32_t conv_f32 = get_16tof32_function();
+		time_start = clock();
+		int64_t sum_b = conv_f32(in, (float*)bufBa, len, 3.5f, F32_SCALE_16BIT);
+		time_end = clock();
+		time_b = time_end - time_start;
+		fprintf(stderr,"Verify optimized version.\n");
+		if(sum_c != ref || sum_b != ref) fprintf(stderr, "Incorrect sum: %lld %lld vs %lld\n", (long long)sum_c, (long long)sum_b, (long long)ref);
+		if(memcmp(bufAa, bufBa, len*sizeof(float))) fprintf(stderr, "Incorrect float buffer\n");
+	}
+	fprintf(stderr, "Optimized version was %.2fx faster\n", (double)(time_a)/(double)(time_b));
+
+	fprintf(stderr,"Test of C extraction with statistics against plain extraction.\n");
+
+	{
+		conv_function_t plain[] = { (conv_function_t) extract_AB_C, (conv_function_t) extract_AB_p_C, (conv_function_t) extract_AB_32_C, (conv_function_t) extract_AB_p_32_C };
+		conv_stats_t stats_fn[] = { extract_AB_stats_C, extract_AB_p_stats_C, extract_AB_stats_32_C, extract_AB_p_stats_32_C };
+		size_t len = (BUFSIZE>>2) - 100; // include a partial block
+		for(int k=0; k<4; k++) {
+			extract_stats_t st;
+			extract_envelope_t *env = malloc(((BUFSIZE>>2) / EXTRACT_STATS_BLOCK + 1) * sizeof(extract_envelope_t));
+			size_t bytes = len * ((k < 2) ? 2 : 4);
+			clipa[0] = clipa[1] = clipb[0] = clipb[1] = 0;
+			extract_stats_reset(&st);
+			st.envelope = env;
+			time_start = clock();
+			plain[k](buf,len,clipa,bufAUXa,bufAa,bufBa,peaka);
+			time_end = clock();
+			time_a = time_end - time_start;
+			time_start = clock();
+			stats_fn[k](buf,len,clipb,bufAUXb,bufAb,bufBb,&st);
+			time_end = clock();
+			time_b = time_end - time_start;
+			if(clipa[0] != clipb[0] || clipa[1] != clipb[1]) fprintf(stderr, "%i Incorrect Clip\n", k);
+			if(memcmp(bufAa, bufAb, bytes)) fprintf(stderr, "%i Incorrect Buffer A\n", k);
+			if(memcmp(bufBa, bufBb, bytes)) fprintf(stderr, "%i Incorrect Buffer B\n", k);
+			if(memcmp(bufAUXa, bufAUXb, len)) fprintf(stderr, "%i Incorrect Buffer AUX\n", k);
+			if(st.count != len) fprintf(stderr, "%i Incorrect sample count\n", k);
+			if(k == 0) {
+				int16_t *out[2] = { bufAa, bufBa };
+				for(int c=0; c<2; c++) {
+					int16_t mn = INT16_MAX, mx = INT16_MIN;
+					uint64_t cp = 0, cn = 0, sq = 0;
+					int64_t sum = 0;
+					for(size_t j=0; j<len; j++) {
+						int16_t v = out[c][j];
+						if(v < mn) mn = v;
+						if(v > mx) mx = v;
+						cp += (v == 2047);
+						cn += (v == -2048);
+						sum += v;
+						sq += (uint64_t)(v * v);
+					}
+					if(st.min[c] != mn || st.max[c] != mx) fprintf(stderr, "Incorrect min/max %i: %i/%i vs %i/%i\n", c, st.min[c], st.max[c], mn, mx);
+					if(st.clip_pos[c] != cp || st.clip_neg[c] != cn) fprintf(stderr, "Incorrect clip count %i\n", c);
+					if(st.sum[c] != sum || st.sum_sq[c] != sq) fprintf(stderr, "Incorrect sum %i\n", c);
+					for(size_t j=0; j<len; j+=EXTRACT_STATS_BLOCK) {
+						int16_t bmn = INT16_MAX, bmx = INT16_MIN;
+						for(size_t i=j; i<len && i<j+EXTRACT_STATS_BLOCK; i++) {
+							if(out[c][i] < bmn) bmn = out[c][i];
+							if(out[c][i] > bmx) bmx = out[c][i];
+						}
+						if(env[j/EXTRACT_STATS_BLOCK].min[c] != bmn || env[j/EXTRACT_STATS_BLOCK].max[c] != bmx) {
+							fprintf(stderr, "Incorrect envelope %i at block %zu\n", c, j/EXTRACT_STATS_BLOCK);
+							break;
+						}
+					}
+				}
+			}
+			fprintf(stderr, "%i: version with statistics took %.2fx the time\n", k, (double)(time_b)/(double)(time_a));
+			free(env);
+		}
+	}
+
 	free(buf);
 }
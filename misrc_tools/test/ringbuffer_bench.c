@@ -0,0 +1,244 @@
+/*
+* ringbuffer_bench
+* Copyright (C) 2024-2025  vrunk11, stefan_o
+*
+* This program will benchmark the throughput of the ringbuffer between
+* one producer and one consumer thread and print the results as JSON
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "../../misrc_common/ringbuffer.h"
+#include "../../misrc_common/threading.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#define MAX_SIZES 16
+#define WAIT_MS 100
+
+static const size_t default_sizes[] = { 64, 4<<10, 64<<10, 1<<20 };
+
+typedef enum { M_SPIN, M_WAIT, M_BATCH, M_COPY } bench_mode_t;
+
+static const char *mode_names[] = { "spin", "wait", "batch", "copy" };
+
+typedef struct {
+	ringbuffer_t rb;
+	bench_mode_t mode;
+	size_t block;
+	size_t batch;
+	double min_time;
+	uint8_t *src;
+	uint8_t *dst;
+	atomic_int stop;
+	uint64_t blocks;  // written by the producer after stop
+	uint64_t errors;  // sequence mismatches seen by the consumer
+} bench_ctx_t;
+
+static double now_sec(void) {
+#ifdef _WIN32
+	LARGE_INTEGER f, c;
+	QueryPerformanceFrequency(&f);
+	QueryPerformanceCounter(&c);
+	return (double)c.QuadPart / (double)f.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+static size_t parse_size(const char *s) {
+	char *end;
+	double v = strtod(s, &end);
+	switch (*end) {
+		case 'k': case 'K': v *= 1024.0; break;
+		case 'm': case 'M': v *= 1024.0*1024.0; break;
+		case 'g': case 'G': v *= 1024.0*1024.0*1024.0; break;
+		default: break;
+	}
+	return ((size_t)v + 7) & ~(size_t)7;
+}
+
+// every block starts with its sequence number so the consumer can check ordering
+static int producer(void *arg) {
+	bench_ctx_t *ctx = arg;
+	uint64_t seq = 0;
+	size_t staged = 0;
+	uint8_t *ptr;
+
+	while (!atomic_load_explicit(&ctx->stop, memory_order_relaxed)) {
+		if (ctx->mode == M_SPIN) {
+			if ((ptr = rb_write_ptr(&ctx->rb, ctx->block)) == NULL) continue;
+		}
+		else if ((ptr = rb_write_ptr_wait(&ctx->rb, ctx->block, WAIT_MS)) == NULL) {
+			// publish what we have so the consumer can make room
+			rb_write_flush(&ctx->rb);
+			staged = 0;
+			continue;
+		}
+		if (ctx->mode == M_COPY) memcpy(ptr, ctx->src, ctx->block);
+		memcpy(ptr, &seq, sizeof(seq));
+		seq++;
+		if (ctx->mode == M_BATCH) {
+			rb_write_stage(&ctx->rb, ctx->block);
+			if (++staged == ctx->batch) {
+				rb_write_flush(&ctx->rb);
+				staged = 0;
+			}
+		}
+		else rb_write_finished(&ctx->rb, ctx->block);
+	}
+	rb_write_flush(&ctx->rb);
+	ctx->blocks = seq;
+	return 0;
+}
+
+static int consumer(void *arg) {
+	bench_ctx_t *ctx = arg;
+	uint64_t seq = 0, got;
+	uint8_t *ptr;
+
+	for (;;) {
+		if (ctx->mode == M_SPIN) ptr = rb_read_ptr(&ctx->rb, ctx->block);
+		else ptr = rb_read_ptr_wait(&ctx->rb, ctx->block, WAIT_MS);
+		if (ptr == NULL) {
+			// the producer flushed its last blocks before setting blocks
+			if (atomic_load(&ctx->stop) == 2 && rb_available(&ctx->rb) < ctx->block) break;
+			continue;
+		}
+		memcpy(&got, ptr, sizeof(got));
+		if (got != seq) ctx->errors++;
+		if (ctx->mode == M_COPY) memcpy(ctx->dst, ptr, ctx->block);
+		seq++;
+		rb_read_finished(&ctx->rb, ctx->block);
+	}
+	return 0;
+}
+
+static int bench(bench_ctx_t *ctx, int first) {
+	thrd_t tp, tc;
+	rb_stats_t st;
+	double t0, t1;
+
+	rb_reset(&ctx->rb);
+	atomic_store(&ctx->stop, 0);
+	ctx->errors = 0;
+	t0 = now_sec();
+	if (thrd_create(&tc, &consumer, ctx) != thrd_success) return 1;
+	if (thrd_create(&tp, &producer, ctx) != thrd_success) return 1;
+	thrd_sleep_ms((int)(ctx->min_time * 1000));
+	atomic_store(&ctx->stop, 1);
+	thrd_join(tp, NULL);
+	atomic_store(&ctx->stop, 2);
+	thrd_join(tc, NULL);
+	t1 = now_sec();
+	rb_get_stats(&ctx->rb, &st);
+
+	double secs = t1 - t0;
+	double bytes = (double)ctx->blocks * ctx->block;
+	printf("%s\n    {\"mode\": \"%s\", \"block_bytes\": %zu, \"batch\": %zu, \"ring_bytes\": %zu, "
+	       "\"blocks\": %llu, \"seconds\": %.6f, \"gb_per_s\": %.3f, \"ns_per_block\": %.2f, "
+	       "\"full_count\": %llu, \"empty_count\": %llu, \"errors\": %llu}",
+	       first ? "" : ",", mode_names[ctx->mode], ctx->block, ctx->mode == M_BATCH ? ctx->batch : 1,
+	       ctx->rb.buffer_size, (unsigned long long)ctx->blocks, secs, bytes / secs / 1e9,
+	       secs * 1e9 / (double)ctx->blocks, (unsigned long long)st.full_count,
+	       (unsigned long long)st.empty_count, (unsigned long long)ctx->errors);
+	fflush(stdout);
+	return ctx->errors != 0;
+}
+
+static void usage(void) {
+	fprintf(stderr,
+		"Benchmark of the ringbuffer with one producer and one consumer thread, results are printed as JSON\n\n"
+		"Usage:\n"
+		"\t[-s comma separated block sizes, k/M/G suffixes allowed (default: 64,4k,64k,1M)]\n"
+		"\t[-r ringbuffer size (default: 64M)]\n"
+		"\t[-b blocks per commit in batch mode (default: 16)]\n"
+		"\t[-t time per measurement in seconds (default: 0.5)]\n"
+	);
+	exit(1);
+}
+
+int main(int argc, char **argv) {
+	static bench_ctx_t ctx;
+	size_t sizes[MAX_SIZES];
+	size_t ring = 64<<20;
+	int nsizes = 0, r = 0, first = 1;
+
+	ctx.min_time = 0.5;
+	ctx.batch = 16;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+			char *list = argv[++i];
+			char *tok = strtok(list, ",");
+			while (tok && nsizes < MAX_SIZES) {
+				sizes[nsizes++] = parse_size(tok);
+				tok = strtok(NULL, ",");
+			}
+		}
+		else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) ring = parse_size(argv[++i]);
+		else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) ctx.batch = strtoul(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) ctx.min_time = atof(argv[++i]);
+		else usage();
+	}
+	if (nsizes == 0) {
+		for (size_t i = 0; i < sizeof(default_sizes)/sizeof(default_sizes[0]); i++) sizes[nsizes++] = default_sizes[i];
+	}
+	if (ctx.batch == 0) ctx.batch = 1;
+
+	if (rb_init(&ctx.rb, "ringbuffer_bench", ring) != 0) {
+		fprintf(stderr, "Failed to create %zu byte ringbuffer\n", ring);
+		return 1;
+	}
+	ring = ctx.rb.buffer_size;
+	for (int i = 0; i < nsizes; i++) {
+		// batch mode needs room for a whole batch
+		if (sizes[i] * ctx.batch > ring / 2) {
+			fprintf(stderr, "Block size %zu too large for a %zu byte ringbuffer\n", sizes[i], ring);
+			return 1;
+		}
+	}
+	ctx.src = malloc(ring / 2);
+	ctx.dst = malloc(ring / 2);
+	if (!ctx.src || !ctx.dst) {
+		fprintf(stderr, "Failed to allocate copy buffers\n");
+		return 1;
+	}
+	memset(ctx.src, 0x5a, ring / 2);
+
+	printf("{\n  \"tool\": \"ringbuffer_bench\",\n  \"results\": [");
+	for (int i = 0; i < nsizes; i++) {
+		ctx.block = sizes[i];
+		for (int m = M_SPIN; m <= M_COPY; m++) {
+			ctx.mode = (bench_mode_t)m;
+			r |= bench(&ctx, first);
+			first = 0;
+		}
+	}
+	printf("\n  ]\n}\n");
+
+	rb_close(&ctx.rb);
+	free(ctx.src);
+	free(ctx.dst);
+	return r;
+}